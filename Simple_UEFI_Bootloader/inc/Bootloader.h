@@ -26,6 +26,10 @@
 #include "loader.h"
 #include "fat.h"
 #include "dos.h"
+#include "uefi.h"
+#include "acpi.h"
+#include "smbios.h"
+#include "cpu.h"
 
 #define MAJOR_VER 2
 #define MINOR_VER 3
@@ -34,35 +38,46 @@
 // Useful Debugging Code
 //==================================================================================================================================
 //
-// Enable useful debugging prints and convenient key-awaiting pauses
-//
 // NOTE: Due to little endianness, all printed data at dereferenced pointers is in LITTLE ENDIAN, so each byte (0xXX) is read
 // left to right while the byte order is reversed (right to left)!!
 //
-// Debug binary has this uncommented, release has it commented
-//#define ENABLE_DEBUG // Master debug enable switch
-
-// Debug Lite only has the below flag enabled (for main debug binary, leave this commented out and only use the above definition)
-#define FINAL_LOADER_DEBUG_ENABLED
-
-#ifdef ENABLE_DEBUG
-    #define SHOW_KERNEL_METADATA
-    #define DISABLE_UEFI_WATCHDOG_TIMER
-    #define MAIN_DEBUG_ENABLED
-    #define GOP_DEBUG_ENABLED
-    #define GOP_NAMING_DEBUG_ENABLED
-    #define LOADER_DEBUG_ENABLED
-    #define PE_LOADER_DEBUG_ENABLED
-    #define DOS_LOADER_DEBUG_ENABLED
-    #define ELF_LOADER_DEBUG_ENABLED
-    #define MACH_LOADER_DEBUG_ENABLED
-    #define FINAL_LOADER_DEBUG_ENABLED
-
-    #define MEMMAP_PRINT_ENABLED
-    #define MEMORY_CHECK_INFO
-//    #define MEMORY_DEBUG_ENABLED // Potential massive performance hit when enabling this and searching for free RAM page-by-page (it prints them all out)
+
+// Stop the UEFI watchdog timer, which would otherwise reset the machine 5 minutes in (e.g. while stepping through this in a debugger)
+//#define DISABLE_UEFI_WATCHDOG_TIMER
+
+// Everything logged with LOG_MESSAGE() goes into a ring buffer with a TSC timestamp, which the kernel gets in LOADER_PARAMS->Loader_Log.
+// LOADER_LOG_CONSOLE_ENABLED also prints each record to the console as it's logged (until ExitBootServices()), without waiting for a
+// key. See Log.c.
+//
+// Which messages get logged is decided at runtime, per subsystem: each one starts out at LOADER_LOG_DEFAULT_LEVELS, and the
+// "loader.log=" load option in Kernel64.txt or the LoaderLog UEFI variable can change it (see Kernel64.txt Format and Contents in
+// Bootloader.c). There's no separate debug build: "loader.log=debug" gets everything, and debug output that takes more than a print,
+// like the memory map dumps at MEMORY:DEBUG or the per-mode listings at GOP:DEBUG, checks LOG_ENABLED() first.
+//
+// LOADER_LOG_SERIAL_ENABLED sends each record (with a timestamp) straight to a 16550 UART instead, e.g. for a BMC's serial-over-LAN
+// console on a headless server. This never goes through ConOut, which is slow on a lot of firmware, so it also replaces the console
+// mirror. Output is batched and sent a full FIFO at a time, and it keeps working after ExitBootServices() right up to the kernel jump.
+// The UART is at I/O port LOADER_LOG_SERIAL_PORT, or at LOADER_LOG_SERIAL_MMIO if the port is 0 (with LOADER_PAGE_TABLES_ENABLED that
+// address has to be in the memory map to stay mapped until the end). LOADER_LOG_SERIAL_IO_ENABLED uses firmware's EFI_SERIAL_IO_PROTOCOL
+// instead, which is slower and stops at ExitBootServices(); everything after that is still in the ring buffer.
+//#define LOADER_LOG_SERIAL_ENABLED
+//#define LOADER_LOG_SERIAL_IO_ENABLED
+
+#ifndef LOADER_LOG_SERIAL_ENABLED
+    #define LOADER_LOG_CONSOLE_ENABLED
 #endif
 
+#define LOADER_LOG_DEFAULT_LEVELS   L"info,handoff:debug" // In the same format as loader.log=
+#define LOADER_LOG_SIZE_KB          64               // The oldest records get overwritten once it's full
+#define LOADER_LOG_CONSOLE_LEVEL    LOADER_LOG_DEBUG // Least severe level that gets printed with LOADER_LOG_CONSOLE_ENABLED
+#define LOADER_LOG_SERIAL_LEVEL     LOADER_LOG_DEBUG // Least severe level that gets sent with LOADER_LOG_SERIAL_ENABLED
+#define LOADER_LOG_SERIAL_PORT      0x3F8            // COM1
+#define LOADER_LOG_SERIAL_MMIO      0x0ULL           // Only used if LOADER_LOG_SERIAL_PORT is 0, e.g. the address in the ACPI SPCR table
+#define LOADER_LOG_SERIAL_MMIO_SHIFT 0               // Register spacing is (1 << this) bytes; 2 also makes the accesses 32-bit
+#define LOADER_LOG_SERIAL_CLOCK     1843200          // The UART's input clock in Hz; the fastest baud rate is this / 16
+#define LOADER_LOG_SERIAL_BAUD      115200           // 0 keeps whatever firmware set up
+#define LOADER_LOG_SERIAL_BATCH     1024             // Bytes of records held back before they're sent; warnings and errors go out right away
+
 //==================================================================================================================================
 // Memory Allocation Debugging
 //==================================================================================================================================
@@ -73,15 +88,80 @@
 // Some systems need the page-by-page search, so it's best to leave this commented out
 //#define BY_PAGE_SEARCH_DISABLED
 
-// Leave this alone: It exists in the event it's needed for some really screwy systems or for aid with debugging AllocatePages
-// It's the "buggy firmware workaround."
+// The "buggy firmware workaround," which checks that the kernel's pages are really free, is for really screwy systems or for aid with
+// debugging AllocatePages. It's off unless Kernel64.txt has loader.memcheck=on (see SetMemoryCheck() in Loader.c).
 
-#define MEMORY_CHECK_DISABLED
+//==================================================================================================================================
+// Optional Loader Stages
+//==================================================================================================================================
+//
+// Extra work the bootloader can do for the kernel before ExitBootServices(). These are all off by default.
+//
 
-// Enabling debug mode will enable the memory check automatically
-#ifdef ENABLE_DEBUG
-#undef MEMORY_CHECK_DISABLED
-#endif
+// Measure the bandwidth & latency of each large EfiConventionalMemory range and pass the results in LOADER_PARAMS->Memory_Performance.
+// See CharacterizeMemory() in Memory.c.
+//#define MEMORY_CHARACTERIZATION_ENABLED
+
+#define MEMORY_CHARACTERIZATION_BUDGET_MS 200 // Time limit for the whole pass. Ranges that don't fit get skipped.
+#define MEMORY_CHARACTERIZATION_MIN_MB    256 // Ranges smaller than this don't get tested
+#define MEMORY_CHARACTERIZATION_SAMPLE_MB 32  // How much of each range gets tested. This should be bigger than the last-level cache.
+
+// Build x86-64 page tables for the kernel and switch to them right before the jump. Everything in the memory map gets identity mapped with
+// 1GB pages (or 2MB pages if the CPU doesn't have 1GB pages), and the kernel image also gets mapped at LOADER_PAGING_KERNEL_VIRTUAL_BASE
+// with the permissions of its sections/segments. The PML4 address goes in LOADER_PARAMS->Page_Table_Root. See Paging.c.
+//#define LOADER_PAGE_TABLES_ENABLED
+
+#define LOADER_PAGING_KERNEL_VIRTUAL_BASE 0xFFFFFFFF80000000 // Where the kernel's base address shows up in the higher half
+
+// Give every EFI_MEMORY_RUNTIME range a virtual address, packed together from RUNTIME_VIRTUAL_BASE up, and call SetVirtualAddressMap()
+// right after ExitBootServices(). The kernel can then call runtime services through its own higher-half mappings instead of keeping
+// firmware's ranges identity mapped. With LOADER_PAGE_TABLES_ENABLED, the loader-built page tables map the ranges there too. The layout
+// goes in LOADER_PARAMS->Runtime_Map and in the VirtualStart of each runtime memory map descriptor. See Runtime.c.
+//#define RUNTIME_VIRTUAL_MAP_ENABLED
+
+#define RUNTIME_VIRTUAL_BASE              0xFFFFFFFE00000000 // 2MB-aligned, canonical, and below LOADER_PAGING_KERNEL_VIRTUAL_BASE
+
+// Zero free memory ahead of time on all processors, using EFI_MP_SERVICES_PROTOCOL to run on the APs. Zeroed memory gets allocated as
+// EfiLoaderData so nothing can dirty it before the kernel runs, and LOADER_PARAMS->Zeroed_Memory says which 2MB chunks are zero.
+// See PrezeroMemory() in Memory.c.
+//#define MEMORY_PREZERO_ENABLED
+
+#define MEMORY_PREZERO_LIMIT_MB           16384 // Zero at most this much memory. 0 means no limit.
+#define MEMORY_PREZERO_RESERVE_MB         64    // Always leave at least this much EfiConventionalMemory alone for firmware to use
+
+// Turn on the vector register state in CPU_FEATURES_XCR0 (via CR4.OSXSAVE and XCR0) and the CR4 features in CPU_FEATURES_CR4 right
+// before jumping to the kernel, so it can use SSE/AVX/AVX-512 from its first instruction. Anything the CPU doesn't support gets left
+// off. LOADER_PARAMS->Cpu_Features says what the kernel actually gets either way. See EnableCpuFeatures() in Cpu.c.
+//#define CPU_FEATURES_ENABLED
+
+#define CPU_FEATURES_XCR0                 (XCR0_X87 | XCR0_SSE | XCR0_AVX | XCR0_AVX512)
+#define CPU_FEATURES_CR4                  (CR4_OSFXSR | CR4_OSXMMEXCPT | CR4_FSGSBASE) // Can also have CR4_UMIP, CR4_SMEP and CR4_SMAP, but not CR4_PCIDE
+
+// Read the topology and cache CPUID leaves on every processor through EFI_MP_SERVICES_PROTOCOL, instead of working everything out from
+// the BSP's CPUID and each processor's APIC ID. Only hybrid CPUs (with more than one kind of core, and different caches for each) need
+// this to be described right. See GetCpuTopology() in Topology.c.
+//#define CPU_TOPOLOGY_ALL_CPUS_ENABLED
+
+// Make the framebuffers write-combining instead of whatever firmware left them as (often uncached). Each one gets a variable MTRR if
+// there's a free one that fits, or else PAT entry 4 through the loader-built page tables if LOADER_PAGE_TABLES_ENABLED is on. What each
+// framebuffer ended up as goes in GPU_CONFIG->FrameBufferCaching. See Caching.c.
+//#define FRAMEBUFFER_WRITE_COMBINING_ENABLED
+
+// Enter the kernel on a loader-allocated stack with a loader-built flat GDT and an IDT whose exception handlers print the CPU state to
+// the first framebuffer and COM1, instead of on firmware's stack with firmware's descriptors. Interrupts are off at entry. Where all of
+// it is goes in LOADER_PARAMS->Entry_State. See Entry.c.
+//#define LOADER_ENTRY_STATE_ENABLED
+
+#define LOADER_STACK_SIZE_MB              2 // Rounded up to a multiple of 2MB, and includes the 4kB guard page at the bottom
+
+// Send every application processor (AP) into a loader-owned parking loop through EFI_MP_SERVICES_PROTOCOL, so the kernel can start
+// them by writing a jump address into their mailboxes instead of going through INIT-SIPI-SIPI and a real mode trampoline. Where the
+// mailboxes are goes in LOADER_PARAMS->Ap_Parking. Some firmware takes the APs back at ExitBootServices(), in which case their mailboxes
+// say so. See Parking.c.
+//#define AP_PARKING_ENABLED
+
+#define AP_PARKING_STACK_KB               16  // Each AP's stack, which it keeps after being started if the kernel doesn't give it one
+#define AP_PARKING_TIMEOUT_MS             100 // How long to wait for the APs to check in, both before and after ExitBootServices()
 
 //==================================================================================================================================
 // Text File UCS-2 Definitions
@@ -116,11 +196,481 @@
 // (It's just an idea.)
 //
 
+// How a framebuffer's memory type was set
+#define FRAMEBUFFER_CACHING_FIRMWARE  0 // Left as firmware had it
+#define FRAMEBUFFER_CACHING_MTRR      1 // A variable MTRR covers it
+#define FRAMEBUFFER_CACHING_PAT       2 // The loader-built page tables map it with PAT entry 4, which is set to WC
+
+typedef struct {
+  UINT8                     MemoryType;                     // MEMORY_TYPE_* value (see cpu.h) the framebuffer has at kernel entry
+  UINT8                     Method;                         // FRAMEBUFFER_CACHING_* value
+  UINT16                    MtrrIndex;                      // Which variable MTRR, if Method is FRAMEBUFFER_CACHING_MTRR
+  UINT32                    Reserved;
+  EFI_PHYSICAL_ADDRESS      MtrrBase;                       // The range the MTRR covers, which is the smallest naturally aligned power of 2
+  UINT64                    MtrrSize;                       // that contains the whole framebuffer. Both 0 if there's no MTRR.
+} FRAMEBUFFER_CACHING;
+
 typedef struct {
   EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE  *GPUArray;             // This array contains the EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE structures for each available framebuffer
   UINT64                              NumberOfFrameBuffers; // The number of pointers in the array (== the number of available framebuffers)
+  FRAMEBUFFER_CACHING                *FrameBufferCaching;   // The memory type of each framebuffer, in the same order as GPUArray
 } GPU_CONFIG;
 
+// Memory tiers, as classified by the bootloader. See BuildMemoryTierTable() in Memory.c for how ranges get sorted into these.
+#define MEMORY_TIER_DRAM              0 // Regular write-back system RAM
+#define MEMORY_TIER_SPECIFIC_PURPOSE  1 // EFI_MEMORY_SP ranges, e.g. HBM or CXL-attached memory
+#define MEMORY_TIER_PERSISTENT        2 // EfiPersistentMemory or EFI_MEMORY_NV ranges
+#define MEMORY_TIER_UNCACHED          3 // RAM that firmware does not allow to be mapped write-back
+
+#define MEMORY_TIER_NO_DOMAIN         0xFFFFFFFF // ProximityDomain value for ranges not described by the SRAT
+
+// MEMORY_TIER_TABLE Flags
+#define MEMORY_TIER_FLAG_SRAT         0x1 // ProximityDomain values came from the SRAT
+#define MEMORY_TIER_FLAG_HMAT         0x2 // Latency & bandwidth values came from the HMAT
+#define MEMORY_TIER_FLAG_ATTRIBUTES   0x4 // Runtime ranges were split according to the EFI_MEMORY_ATTRIBUTES_TABLE
+#define MEMORY_TIER_FLAG_TRUNCATED    0x8 // Ran out of entries; the table does not cover all of memory
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS      PhysicalStart;                  // Start of the range
+  UINT64                    NumberOfPages;                  // Size of the range in 4kB pages
+  UINT64                    Attribute;                      // EFI_MEMORY_* attributes of the range
+  UINT32                    Tier;                           // One of the MEMORY_TIER_* values
+  UINT32                    ProximityDomain;                // SRAT proximity domain, or MEMORY_TIER_NO_DOMAIN
+  UINT32                    ReadLatency;                    // Best HMAT-reported read latency to this range in picoseconds, 0 if unknown
+  UINT32                    ReadBandwidth;                  // Best HMAT-reported read bandwidth to this range in MB/s, 0 if unknown
+} MEMORY_TIER_ENTRY;
+
+typedef struct {
+  UINT32                    NumberOfEntries;                // Number of valid entries in the Entries array
+  UINT32                    MaxEntries;                     // Number of entries allocated for the Entries array
+  UINT64                    Flags;                          // MEMORY_TIER_FLAG_* values
+  MEMORY_TIER_ENTRY         Entries[];                      // Sorted by address; adjacent ranges with identical properties are merged
+} MEMORY_TIER_TABLE;
+
+// MEMORY_PERF_TABLE Flags
+#define MEMORY_PERF_FLAG_BUDGET_EXHAUSTED 0x1 // Ran out of time before every large range could be tested
+
+// Bandwidth is what a single core (the BSP) can pull, not what the whole memory controller can do.
+typedef struct {
+  EFI_PHYSICAL_ADDRESS      PhysicalStart;                  // Start of the tested EfiConventionalMemory range
+  UINT64                    NumberOfPages;                  // Size of the tested range in 4kB pages
+  EFI_PHYSICAL_ADDRESS      SampleStart;                    // Start of the part of the range that actually got tested
+  UINT64                    SampleSize;                     // Size of the tested part in bytes
+  UINT32                    ReadBandwidth;                  // Measured read bandwidth in MB/s
+  UINT32                    WriteBandwidth;                 // Measured write bandwidth in MB/s
+  UINT32                    CopyBandwidth;                  // Measured copy (a[i] = b[i]) bandwidth in MB/s, counting both the read and the write
+  UINT32                    TriadBandwidth;                 // Measured triad (a[i] = b[i] + k*c[i]) bandwidth in MB/s, counting both reads and the write
+  UINT32                    Latency;                        // Measured random-access load latency in picoseconds, same units as MEMORY_TIER_ENTRY
+  UINT32                    Reserved;
+} MEMORY_PERF_ENTRY;
+
+typedef struct {
+  UINT32                    NumberOfEntries;                // Number of entries in the Entries array
+  UINT32                    Flags;                          // MEMORY_PERF_FLAG_* values
+  UINT64                    TscFrequency;                   // TSC frequency in Hz that was used to time the tests
+  UINT64                    ElapsedMicroseconds;            // How long the whole pass took
+  MEMORY_PERF_ENTRY         Entries[];                      // Sorted by address, since they come straight from the memory map
+} MEMORY_PERF_TABLE;
+
+#define ZEROED_MEMORY_CHUNK_SIZE      0x200000 // 2MB
+
+// Bit N of the Bitmap is set if the 2MB chunk starting at N * ZEROED_MEMORY_CHUNK_SIZE is all zeroes. Chunks are LSB-first in each byte.
+typedef struct {
+  UINT64                    ChunkSize;                      // Bytes covered by each bit, ZEROED_MEMORY_CHUNK_SIZE
+  UINT64                    NumberOfChunks;                 // Number of bits in the Bitmap, enough to cover the highest EfiConventionalMemory address
+  UINT64                    BytesZeroed;                    // Total amount of memory that was zeroed
+  UINT64                    ElapsedMicroseconds;            // How long zeroing took, from starting the APs to all of them finishing
+  UINT32                    NumberOfCpus;                   // Number of processors that helped, including the BSP
+  UINT32                    PerCpuBandwidth;                // Average zeroing speed of a single processor in MB/s
+  UINT64                    TotalBandwidth;                 // Combined zeroing speed of all processors in MB/s
+  UINT8                     Bitmap[];
+} ZEROED_MEMORY_MAP;
+
+// CPU_FEATURES Words[] indexes, one per CPUID register. Bits are exactly as CPUID has them, except that features whose register state
+// isn't enabled in Xcr0 (like AVX when XCR0_AVX is off) are cleared, and OSXSAVE matches Cr4.
+#define CPU_FEATURE_WORD_1_ECX        0  // CPUID 0x1 ECX
+#define CPU_FEATURE_WORD_1_EDX        1  // CPUID 0x1 EDX
+#define CPU_FEATURE_WORD_7_0_EBX      2  // CPUID 0x7 subleaf 0 EBX
+#define CPU_FEATURE_WORD_7_0_ECX      3
+#define CPU_FEATURE_WORD_7_0_EDX      4
+#define CPU_FEATURE_WORD_7_1_EAX      5  // CPUID 0x7 subleaf 1 EAX
+#define CPU_FEATURE_WORD_D_1_EAX      6  // CPUID 0xD subleaf 1 EAX (XSAVEOPT, XSAVEC, etc.)
+#define CPU_FEATURE_WORD_80000001_ECX 7
+#define CPU_FEATURE_WORD_80000001_EDX 8
+#define CPU_FEATURE_WORD_80000007_EDX 9
+#define CPU_FEATURE_WORD_80000008_EBX 10
+#define CPU_FEATURE_WORDS             11
+
+#define CPU_FEATURE_PRESENT(Features, Word, Bit) (((Features)->Words[(Word)] >> (Bit)) & 1)
+
+typedef struct {
+  CHAR8                     Vendor[12];                     // "GenuineIntel", "AuthenticAMD", etc. (not null-terminated)
+  UINT32                    Signature;                      // CPUID 0x1 EAX: family, model & stepping
+  UINT32                    MaxLeaf;                        // Highest basic CPUID leaf
+  UINT32                    MaxExtendedLeaf;                // Highest 0x8000xxxx leaf
+  UINT32                    MaxHypervisorLeaf;              // Highest 0x4000xxxx leaf, or 0 if not running under a hypervisor
+  UINT32                    Enabled;                        // 1 if CPU_FEATURES_ENABLED set Cr4 and Xcr0, 0 if they're just what firmware left
+  UINT64                    Cr4;                            // CR4 at kernel entry
+  UINT64                    Xcr0;                           // XCR0 at kernel entry, or 0 if CR4.OSXSAVE is off
+  UINT64                    Xcr0Supported;                  // XCR0 bits the CPU supports
+  UINT32                    XsaveSize;                      // Bytes XSAVE needs for everything in Xcr0 (standard format), or 0 if XSAVE is off
+  UINT32                    XsaveMaxSize;                   // Bytes XSAVE would need for everything in Xcr0Supported
+  UINT32                    Words[CPU_FEATURE_WORDS];       // See CPU_FEATURE_WORD_*
+  UINT32                    Reserved;
+} CPU_FEATURES;
+
+// PCI_DEVICE_BAR Type
+#define PCI_BAR_NONE                  0 // Not implemented, or the upper half of the BAR before it
+#define PCI_BAR_MEMORY32              1
+#define PCI_BAR_MEMORY64              2
+#define PCI_BAR_IO                    3
+
+// PCI_DEVICE_BAR Flags
+#define PCI_BAR_PREFETCHABLE          0x1
+
+typedef struct {
+  UINT64                    Address;                        // As firmware assigned it, in CPU address space
+  UINT64                    Size;
+  UINT32                    Type;                           // PCI_BAR_* value
+  UINT32                    Flags;                          // PCI_BAR_* bits
+} PCI_DEVICE_BAR;
+
+#define PCI_DEVICE_NAME_SIZE          48 // Bytes, including the null terminator
+
+// PCI_DEVICE Flags
+#define PCI_DEVICE_HAS_ROM            0x1 // Firmware found an option ROM image for it
+#define PCI_DEVICE_DRIVER_BOUND       0x2 // A UEFI driver was managing it; its name is in DriverName
+
+// One PCI function that firmware enumerated. Bars[] is indexed by BAR register, so a 64-bit BAR at index N leaves index N + 1 as
+// PCI_BAR_NONE. Bridges only have the first two.
+typedef struct {
+  UINT16                    Segment;
+  UINT8                     Bus;
+  UINT8                     Device;
+  UINT8                     Function;
+  UINT8                     HeaderType;                     // Without the multi-function bit
+  UINT16                    VendorId;
+  UINT16                    DeviceId;
+  UINT16                    SubsystemVendorId;              // 0 for bridges
+  UINT16                    SubsystemId;
+  UINT8                     RevisionId;
+  UINT8                     ProgInterface;
+  UINT8                     SubClass;
+  UINT8                     BaseClass;
+  UINT16                    Reserved;
+  UINT32                    Flags;                          // PCI_DEVICE_* bits
+  UINT64                    RomSize;                        // Of the option ROM image firmware found, or 0
+  PCI_DEVICE_BAR            Bars[6];
+  CHAR8                     DriverName[PCI_DEVICE_NAME_SIZE]; // Null-terminated and possibly cut short; non-ASCII characters come out as '?'
+} PCI_DEVICE;
+
+// Every EFI_PCI_IO_PROTOCOL handle firmware has, sorted by segment, bus, device and function
+typedef struct {
+  UINT32                    NumberOfDevices;
+  UINT32                    Reserved;
+  PCI_DEVICE                Devices[];
+} PCI_INVENTORY;
+
+// Vendor GUID of the loader's own UEFI variables, like LoaderLog
+#define LOADER_VARIABLE_GUID { 0x5b2c8e41, 0x9d3a, 0x4f17, { 0xa6, 0x0e, 0x73, 0xd4, 0x1c, 0x98, 0xb2, 0x5f }}
+
+// Contents of the LoaderFastBoot UEFI variable (LOADER_VARIABLE_GUID), see FastBoot.c
+typedef struct {
+  UINT32                    Enabled;                        // 1 to skip the countdown, banner and menus
+  UINT32                    GpuOption;                      // Multi-GPU menu option to use: 2 (default resolutions) or 3 (1024x768)
+  UINT32                    GpuMode;                        // Graphics mode to use when there's only one GPU
+  UINT32                    Reserved;
+} LOADER_FAST_BOOT;
+
+// Contents of the LoaderPlacement UEFI variable (LOADER_VARIABLE_GUID): where FindActuallyFreePages() last had to search its way to,
+// so the next boot of the same kernel can go straight there. See Placement.c.
+typedef struct {
+  UINT64                    KernelId;                       // PlacementKernelId() of the kernel's path and file size
+  UINT64                    Pages;
+  EFI_PHYSICAL_ADDRESS      Address;
+  UINT64                    Alignment;                      // What Address has to be a multiple of
+} LOADER_PLACEMENT_MEMO;
+
+// Kernel64.txt, as parsed by ParseLoaderConfig() in Config.c. Nothing gets copied out of the file: strings are LOADER_CONFIG_SPANs
+// pointing into it, which ConfigSpanToChar16() turns into UTF-16 when they're needed.
+
+#define LOADER_CONFIG_MAX_ENTRIES     10 // So each one gets a single digit in the boot entry menu
+#define LOADER_CONFIG_MAX_MODULES     8  // Per entry
+
+#define LOADER_CONFIG_DEFAULT_TIMEOUT      10 // Seconds
+#define LOADER_CONFIG_DEFAULT_GOP_TIMEOUT  90 // Seconds
+
+// LOADER_CONFIG Encoding
+#define LOADER_CONFIG_UTF8            0
+#define LOADER_CONFIG_UTF16           1
+
+// LOADER_CONFIG Gop
+#define LOADER_CONFIG_GOP_MENU        0 // Ask, like always
+#define LOADER_CONFIG_GOP_NATIVE      1 // Each GPU's default mode, no menus
+#define LOADER_CONFIG_GOP_RESOLUTION  2 // GopWidth x GopHeight wherever it's available, no menus
+
+// LOADER_CONFIG_ENTRY Placement
+#define LOADER_PLACEMENT_DEFAULT      0 // Below 4GB for PE32+, anywhere for ELF and Mach-O
+#define LOADER_PLACEMENT_BELOW_4GB    1 // Kernel and modules both
+
+// LOADER_CONFIG_SPAN Flags
+#define LOADER_CONFIG_SPAN_NO_SPACES  0x1 // Leave out the spaces when converting (Kernel64.txt v1 kernel paths)
+
+typedef struct {
+  UINT32                    Offset;                         // Of the first byte, from the start of the file
+  UINT32                    Bytes;                          // Size in the file's own encoding
+  UINT32                    Length;                         // In UTF-16 code units once converted, not counting a null terminator
+  UINT32                    Flags;                          // LOADER_CONFIG_SPAN_* bits
+} LOADER_CONFIG_SPAN;
+
+typedef struct {
+  LOADER_CONFIG_SPAN        Name;                           // Empty for the entry made by keys that come before any [name]
+  LOADER_CONFIG_SPAN        Kernel;
+  LOADER_CONFIG_SPAN        Options;
+  LOADER_CONFIG_SPAN        Modules[LOADER_CONFIG_MAX_MODULES];
+  UINT32                    NumberOfModules;
+  UINT32                    Placement;                      // LOADER_PLACEMENT_* value
+  UINT32                    Line;                           // Where the entry starts
+  UINT32                    Reserved;
+} LOADER_CONFIG_ENTRY;
+
+typedef struct {
+  CONST UINT8              *File;
+  UINT64                    FileSize;
+  UINT32                    Encoding;                       // LOADER_CONFIG_* value
+  UINT32                    Version;                        // 1 for the two-line format, 2 for key = value
+  UINT32                    Timeout;                        // Seconds of countdown before booting, 0 for none
+  UINT32                    GopTimeout;                     // Seconds before the graphics menus pick their defaults
+  UINT32                    Gop;                            // LOADER_CONFIG_GOP_* value
+  UINT32                    GopWidth;
+  UINT32                    GopHeight;
+  UINT32                    DefaultEntry;
+  UINT32                    SelectedEntry;                  // Starts out as DefaultEntry; the boot entry menu can change it
+  UINT32                    NumberOfEntries;
+  UINT32                    ErrorLine;                      // The first line that got ignored for not making sense, or 0
+  UINT32                    Reserved;
+  LOADER_CONFIG_ENTRY       Entries[LOADER_CONFIG_MAX_ENTRIES];
+} LOADER_CONFIG;
+
+// LOADER_LOG_RECORD Level
+#define LOADER_LOG_ERROR              0
+#define LOADER_LOG_WARNING            1
+#define LOADER_LOG_INFO               2
+#define LOADER_LOG_DEBUG              3
+
+// LOADER_LOG_RECORD Subsystem
+#define LOADER_LOG_SUBSYSTEM_MAIN     0 // efi_main()
+#define LOADER_LOG_SUBSYSTEM_GOP      1 // Graphics output setup
+#define LOADER_LOG_SUBSYSTEM_LOADER   2 // Kernel64.txt and the kernel file
+#define LOADER_LOG_SUBSYSTEM_PE       3
+#define LOADER_LOG_SUBSYSTEM_ELF      4
+#define LOADER_LOG_SUBSYSTEM_MACHO    5
+#define LOADER_LOG_SUBSYSTEM_MEMORY   6 // Memory map, page allocation, characterization and zeroing
+#define LOADER_LOG_SUBSYSTEM_HANDOFF  7 // Everything GoTime() sets up for the kernel once it's loaded
+#define LOADER_LOG_SUBSYSTEMS         8
+
+#define LOADER_LOG_RECORD_SIZE        256
+
+typedef struct {
+  UINT64                    Tsc;                            // When it was logged
+  UINT8                     Level;                          // LOADER_LOG_* value
+  UINT8                     Subsystem;                      // LOADER_LOG_SUBSYSTEM_* value
+  UINT16                    Length;                         // Of Text, not counting the null terminator
+  UINT32                    Reserved2;
+  CHAR8                     Text[LOADER_LOG_RECORD_SIZE - 16]; // One line of ASCII with no line break, null-terminated
+} LOADER_LOG_RECORD;
+
+// Record N (counting from 0) is at Records[N % NumberOfRecords]. The ones still there are the last min(NextSequence, NumberOfRecords).
+// The loader keeps logging into LOADER_PARAMS->Loader_Log right up until the jump; the handoff has a copy from just before it.
+typedef struct {
+  UINT64                    TscFrequency;                   // In Hz, same as in LOADER_TIMING_TAG
+  UINT64                    NextSequence;                   // How many records have been logged
+  UINT32                    NumberOfRecords;
+  UINT32                    Reserved;
+  LOADER_LOG_RECORD         Records[];
+} LOADER_LOG;
+
+// RUNTIME_MAP Flags
+#define RUNTIME_MAP_APPLIED           0x1 // SetVirtualAddressMap() succeeded, so runtime services only work at the virtual addresses now
+#define RUNTIME_MAP_PAGE_TABLES       0x2 // The loader-built page tables map the ranges at VirtualStart (except RUNTIME_RANGE_NOT_MAPPED ones)
+#define RUNTIME_MAP_TRUNCATED         0x4 // Ran out of entries; the memory map descriptors are complete, but Ranges isn't
+
+// RUNTIME_MAP_RANGE Flags
+#define RUNTIME_RANGE_NOT_MAPPED      0x1 // Showed up after the page tables were built, or there were too many to map
+
+// Each range keeps its offset within a 2MB page, so ranges with big enough alignment can be mapped with 2MB pages
+typedef struct {
+  EFI_PHYSICAL_ADDRESS      PhysicalStart;
+  EFI_VIRTUAL_ADDRESS       VirtualStart;
+  UINT64                    NumberOfPages;
+  UINT64                    Attribute;                      // From the memory map descriptor, so it includes EFI_MEMORY_RUNTIME
+  UINT32                    Type;                           // EFI_MEMORY_TYPE
+  UINT32                    Flags;                          // RUNTIME_RANGE_* bits
+} RUNTIME_MAP_RANGE;
+
+// The virtual address of every EFI_MEMORY_RUNTIME range, as given to SetVirtualAddressMap(). LOADER_PARAMS->RTServices stays a
+// physical address, but once RUNTIME_MAP_APPLIED is set its function pointers are virtual, and RuntimeServices is where the table
+// itself is mapped. SetVirtualAddressMap() can only be called once, so kernels can't pick a different layout afterwards.
+typedef struct {
+  EFI_VIRTUAL_ADDRESS       VirtualBase;                    // RUNTIME_VIRTUAL_BASE
+  EFI_VIRTUAL_ADDRESS       RuntimeServices;                // Virtual address of the EFI_RUNTIME_SERVICES table, or 0 if it isn't in a runtime range
+  EFI_STATUS                Status;                         // What SetVirtualAddressMap() returned
+  UINT32                    Flags;                          // RUNTIME_MAP_* bits
+  UINT32                    Reserved;
+  UINT32                    NumberOfRanges;
+  UINT32                    MaxRanges;                      // How many fit in Ranges
+  RUNTIME_MAP_RANGE         Ranges[];                       // In memory map order
+} RUNTIME_MAP;
+
+// CPU_TOPOLOGY Source
+#define CPU_TOPOLOGY_LEAF_1F          1 // CPUID 0x1F, which can have module, tile and die levels
+#define CPU_TOPOLOGY_LEAF_B           2 // CPUID 0xB, which only has thread and core levels
+#define CPU_TOPOLOGY_AMD              3 // CPUID 0x80000008 and 0x8000001E
+#define CPU_TOPOLOGY_LEGACY           4 // CPUID 0x1 and 0x4, with no way to tell dies apart
+
+// CPU_TOPOLOGY Flags
+#define CPU_TOPOLOGY_ALL_CPUS         0x1 // Every processor read its own CPUID (CPU_TOPOLOGY_ALL_CPUS_ENABLED)
+#define CPU_TOPOLOGY_HYBRID           0x2 // There's more than one kind of core
+#define CPU_TOPOLOGY_BSP_ONLY         0x4 // No MP services protocol, so only the BSP is listed
+
+// CPU_TOPOLOGY_CPU Flags
+#define CPU_TOPOLOGY_CPU_BSP          0x1
+#define CPU_TOPOLOGY_CPU_ENABLED      0x2
+#define CPU_TOPOLOGY_CPU_ENUMERATED   0x4 // CoreType and the caches came from this processor's own CPUID
+
+// CPU_TOPOLOGY_CACHE Type, same as in CPUID leaf 0x4
+#define CPU_TOPOLOGY_CACHE_DATA       1
+#define CPU_TOPOLOGY_CACHE_INSTRUCTION 2
+#define CPU_TOPOLOGY_CACHE_UNIFIED    3
+
+// CPU_TOPOLOGY_CACHE Flags
+#define CPU_TOPOLOGY_CACHE_INCLUSIVE  0x1 // Holds everything the lower levels do
+#define CPU_TOPOLOGY_CACHE_FULLY_ASSOCIATIVE 0x2
+#define CPU_TOPOLOGY_CACHE_COMPLEX_INDEXING 0x4 // Addresses get hashed to sets, so page coloring doesn't work
+
+// Package, Die, Core and LlcDomain are numbered from 0 across the whole system, with no gaps, so they can index arrays directly. Thread
+// is the processor's number within its core. Processors with the same LlcDomain share a last-level cache.
+typedef struct {
+  UINT32                    ApicId;                         // Initial (x2)APIC ID
+  UINT32                    Package;
+  UINT32                    Die;
+  UINT32                    Core;
+  UINT32                    Thread;
+  UINT32                    LlcDomain;
+  UINT16                    Flags;                          // CPU_TOPOLOGY_CPU_* bits
+  UINT8                     CoreType;                       // CPUID 0x1A EAX[31:24] (0x20 Atom, 0x40 Core) on hybrid CPUs, 0 if unknown
+  UINT8                     Reserved;
+  UINT32                    Reserved2;
+} CPU_TOPOLOGY_CPU;
+
+// Each kind of cache, once. Processors whose APIC IDs are the same after shifting them right by SharingShift share one of them. On hybrid
+// CPUs, caches that differ between core types are listed once per CoreType; otherwise CoreType is 0 and applies to everything.
+typedef struct {
+  UINT8                     Level;
+  UINT8                     Type;                           // CPU_TOPOLOGY_CACHE_* value
+  UINT8                     CoreType;
+  UINT8                     Flags;                          // CPU_TOPOLOGY_CACHE_* bits
+  UINT32                    SharingShift;
+  UINT64                    Size;                           // In bytes
+  UINT32                    Ways;
+  UINT32                    Sets;
+  UINT16                    LineSize;
+  UINT16                    Partitions;
+  UINT32                    Reserved;
+} CPU_TOPOLOGY_CACHE;
+
+// Every processor firmware knows about, sorted by APIC ID, followed by the caches at CacheOffset. The shifts split an APIC ID into its
+// parts: ApicId >> ThreadShift is the core, ApicId >> CoreShift is the die, and ApicId >> PackageShift is the package. CoreShift is the
+// same as PackageShift when there are no separate dies. Modules and tiles count as part of the core.
+typedef struct {
+  UINT32                    NumberOfCpus;
+  UINT32                    NumberOfCaches;
+  UINT32                    NumberOfPackages;
+  UINT32                    NumberOfDies;
+  UINT32                    NumberOfCores;
+  UINT32                    NumberOfLlcDomains;
+  UINT8                     ThreadShift;
+  UINT8                     CoreShift;
+  UINT8                     PackageShift;
+  UINT8                     Source;                         // CPU_TOPOLOGY_* value
+  UINT32                    Flags;                          // CPU_TOPOLOGY_* bits
+  UINT32                    CacheOffset;                    // Offset of the CPU_TOPOLOGY_CACHE array from the start of this structure
+  UINT32                    Size;                           // Of the whole thing, caches included
+  CPU_TOPOLOGY_CPU          Cpus[];
+} CPU_TOPOLOGY;
+
+// Segment selectors in the loader's GDT
+#define LOADER_GDT_CODE_SELECTOR      0x08
+#define LOADER_GDT_DATA_SELECTOR      0x10
+#define LOADER_GDT_TSS_SELECTOR       0x18 // Takes up two GDT entries, like all 64-bit system descriptors
+
+// LOADER_ENTRY_STATE Flags
+#define LOADER_ENTRY_GUARD_UNMAPPED   0x1 // The guard page isn't mapped in the loader-built page tables, so overflowing the stack faults
+
+// The stack is 2MB-aligned and StackSize bytes long, including the guard page at its bottom, and RSP at entry is StackTop minus room
+// for a return address (and the 32-byte shadow space of MS ABI kernels). The IDT's exception handlers run on FaultStackTop (IST1), so
+// they still work after a stack overflow; they print the CPU state and halt. Kernels should install their own IDT before enabling
+// interrupts (everything past vector 31 is left not-present) or reusing EfiLoaderCode memory (where the handlers are).
+typedef struct {
+  EFI_PHYSICAL_ADDRESS      StackBase;                      // The guard page
+  UINT64                    StackSize;
+  EFI_PHYSICAL_ADDRESS      StackTop;
+  EFI_PHYSICAL_ADDRESS      FaultStackTop;
+  EFI_PHYSICAL_ADDRESS      Gdt;
+  EFI_PHYSICAL_ADDRESS      Idt;
+  EFI_PHYSICAL_ADDRESS      Tss;
+  UINT16                    GdtLimit;
+  UINT16                    IdtLimit;
+  UINT32                    Flags;                          // LOADER_ENTRY_* bits
+} LOADER_ENTRY_STATE;
+
+// LOADER_AP_MAILBOX Status
+#define LOADER_AP_NOT_PARKED          0 // Never made it to the parking loop, or firmware took it back; start it with INIT-SIPI-SIPI instead
+#define LOADER_AP_PARKED              1
+#define LOADER_AP_STARTED             2 // Saw JumpAddress and left the parking loop
+
+// LOADER_AP_PARKING Flags
+#define LOADER_AP_PARKING_MWAIT       0x1 // The APs wait with MONITOR/MWAIT instead of spinning on PAUSE
+
+// One per AP, MailboxStride bytes apart. A parked AP waits with interrupts off until JumpAddress isn't 0, and then sets Status to
+// LOADER_AP_STARTED and jumps there with RSP = StackPointer - 40 (or StackTop - 40 if StackPointer is 0) and a return address of 0,
+// like the BSP's entry. Argument goes in RCX and RDI, and the mailbox's address in RDX and RSI. So to start an AP, write Argument and
+// StackPointer first and JumpAddress last, then wait for Status to change.
+//
+// Parked APs run on firmware's GDT and IDT (interrupts stay off), and on firmware's page tables unless the loader built its own. To move
+// a parked AP to other page tables without starting it, write their PML4 address to Cr3 and then add 1 to Ping; the AP turns on the
+// EferBits bits in its EFER (e.g. EFER_NXE, if the new tables use the NX bit), switches to the tables, and copies Ping to Pong. Cr3 or
+// EferBits can be 0 to skip that part. Do that before reusing EfiBootServicesData if the APs might still be on firmware's page tables.
+// The loader already did it once with its own page tables (if it built them) and the BSP's EFER.NXE.
+//
+// The parking loop in Parking.c depends on these offsets.
+typedef struct {
+  volatile UINT64           JumpAddress;                    // Offset 0
+  volatile UINT64           Argument;                       // Offset 8
+  volatile UINT64           StackPointer;                   // Offset 16
+  volatile UINT64           Cr3;                            // Offset 24, only looked at when Ping changes
+  volatile UINT32           Status;                         // Offset 32, LOADER_AP_* value
+  UINT32                    ApicId;                         // Offset 36, the AP's initial (x2)APIC ID
+  volatile UINT32           Ping;                           // Offset 40
+  volatile UINT32           Pong;                           // Offset 44
+  EFI_PHYSICAL_ADDRESS      StackTop;                       // Offset 48, the AP's parking stack
+  volatile UINT64           EferBits;                       // Offset 56, only looked at when Ping changes
+} LOADER_AP_MAILBOX;
+
+typedef struct {
+  UINT32                    NumberOfMailboxes;              // One for each enabled AP, whether or not it got parked
+  UINT32                    MailboxStride;                  // A whole MONITOR line, so waking one AP doesn't wake the others
+  UINT32                    BspApicId;
+  UINT32                    Flags;                          // LOADER_AP_PARKING_* bits
+  EFI_PHYSICAL_ADDRESS      Mailboxes;
+  EFI_PHYSICAL_ADDRESS      ParkingCode;                    // The EfiLoaderCode page the parking loop runs from, which has to stay put until every AP is started
+  UINT64                    StackSize;                      // Of each AP's parking stack
+} LOADER_AP_PARKING;
+
+// Kernel segment permissions, for the loader-built page tables
+#define KERNEL_SEGMENT_WRITE          0x1
+#define KERNEL_SEGMENT_EXECUTE        0x2
+
 typedef struct {
   UINT32                    UEFI_Version;                   // The system UEFI version
   UINT32                    Bootloader_MajorVersion;        // The major version of the bootloader
@@ -146,8 +696,382 @@ typedef struct {
   EFI_FILE_INFO            *FileMeta;                       // Kernel file metadata
   EFI_CONFIGURATION_TABLE  *ConfigTables;                   // UEFI-installed system configuration tables (ACPI, SMBIOS, etc.)
   UINTN                     Number_of_ConfigTables;         // The number of system configuration tables
+
+  MEMORY_TIER_TABLE        *Memory_Tiers;                   // RAM classified by tier (DRAM, specific-purpose, persistent, uncached) with SRAT/HMAT hints
+  MEMORY_PERF_TABLE        *Memory_Performance;             // Measured bandwidth & latency of large RAM ranges, or NULL if MEMORY_CHARACTERIZATION_ENABLED is off
+
+  EFI_PHYSICAL_ADDRESS      Page_Table_Root;                // Physical address of the loader-built PML4 (already loaded in CR3), or 0 if LOADER_PAGE_TABLES_ENABLED is off
+  UINT64                    Kernel_VirtualBase;             // Higher-half virtual address that Kernel_BaseAddress is mapped to, or 0 if there's no such mapping
+
+  ZEROED_MEMORY_MAP        *Zeroed_Memory;                  // Which 2MB chunks of RAM are already zeroed, or NULL if MEMORY_PREZERO_ENABLED is off
+
+  struct _LOADER_HANDOFF_HEADER *Handoff;                   // All of the above (and more) in one contiguous buffer; see LOADER_HANDOFF_HEADER below
+
+  CPU_FEATURES             *Cpu_Features;                   // CPUID summary and the CR4/XCR0 state at kernel entry
+
+  LOADER_ENTRY_STATE       *Entry_State;                    // The loader's stack, GDT and IDT the kernel starts with, or NULL if LOADER_ENTRY_STATE_ENABLED is off
+
+  LOADER_AP_PARKING        *Ap_Parking;                     // Mailboxes of the parked application processors, or NULL if AP_PARKING_ENABLED is off or there are no APs
+
+  CPU_TOPOLOGY             *Cpu_Topology;                   // Packages, dies, cores, threads and caches of every processor
+
+  PCI_INVENTORY            *Pci_Inventory;                  // Every PCI function firmware found, with its IDs, class, BARs and driver name
+
+  RUNTIME_MAP              *Runtime_Map;                    // Virtual addresses of the runtime services ranges, or NULL if RUNTIME_VIRTUAL_MAP_ENABLED is off
+
+  LOADER_LOG               *Loader_Log;                     // Everything the loader logged, with timestamps
+
+  struct _LOADER_MODULES_TAG *Modules;                      // The kernel, then the boot entry's module files in Kernel64.txt order; see LOADER_MODULES_TAG below
 } LOADER_PARAMS;
 
+//----------------------------------------------------------------------------------------------------------------------------------
+// Handoff Format v3
+//----------------------------------------------------------------------------------------------------------------------------------
+//
+// LOADER_PARAMS is mostly pointers to things scattered all over memory, and every new field changes its layout. The v3 handoff copies
+// everything into one buffer instead: a LOADER_HANDOFF_HEADER followed by tagged records, each a LOADER_TAG and then Size bytes of
+// payload. The next record starts at the next 8-byte boundary, and a LOADER_TAG_END record ends the list. Kernels should skip tags
+// they don't know about, so new tags can be added without breaking anything.
+//
+// Bit N of Capabilities is set if there's a tag of type N, e.g. (Handoff->Capabilities & LOADER_CAPABILITY(LOADER_TAG_ACPI)).
+//
+// The kernel gets a pointer to the header as the second argument of its entry point (which kernels that only take LOADER_PARAMS can
+// just ignore), and in LOADER_PARAMS->Handoff.
+//
+
+#define LOADER_HANDOFF_SIGNATURE      0x3346464F444E4148 // "HANDOFF3"
+#define LOADER_HANDOFF_VERSION        3
+
+#define LOADER_TAG_END                0
+#define LOADER_TAG_LOADER_INFO        1  // LOADER_INFO_TAG
+#define LOADER_TAG_MEMORY_MAP         2  // LOADER_MEMORY_MAP_TAG
+#define LOADER_TAG_FRAMEBUFFERS       3  // LOADER_FRAMEBUFFERS_TAG
+#define LOADER_TAG_CMDLINE            4  // LOADER_CMDLINE_TAG
+#define LOADER_TAG_FIRMWARE           5  // LOADER_FIRMWARE_TAG
+#define LOADER_TAG_ACPI               6  // LOADER_ACPI_TAG
+#define LOADER_TAG_TIMING             7  // LOADER_TIMING_TAG
+#define LOADER_TAG_MODULES            8  // LOADER_MODULES_TAG
+#define LOADER_TAG_MEMORY_TIERS       9  // MEMORY_TIER_TABLE
+#define LOADER_TAG_MEMORY_PERFORMANCE 10 // MEMORY_PERF_TABLE
+#define LOADER_TAG_ZEROED_MEMORY      11 // ZEROED_MEMORY_MAP
+#define LOADER_TAG_KERNEL_FILE_INFO   12 // EFI_FILE_INFO
+#define LOADER_TAG_ACPI_SUMMARY       13 // LOADER_ACPI_SUMMARY_TAG
+#define LOADER_TAG_SMBIOS             14 // LOADER_SMBIOS_TAG
+#define LOADER_TAG_ARGUMENTS          15 // LOADER_ARGUMENTS_TAG
+#define LOADER_TAG_CLOCK              16 // LOADER_CLOCK_TAG
+#define LOADER_TAG_CPU_FEATURES       17 // CPU_FEATURES
+#define LOADER_TAG_FRAMEBUFFER_CACHING 18 // LOADER_FRAMEBUFFER_CACHING_TAG
+#define LOADER_TAG_ENTRY_STATE        19 // LOADER_ENTRY_STATE
+#define LOADER_TAG_AP_PARKING         20 // LOADER_AP_PARKING
+#define LOADER_TAG_CPU_TOPOLOGY       21 // CPU_TOPOLOGY
+#define LOADER_TAG_PCI_INVENTORY      22 // PCI_INVENTORY
+#define LOADER_TAG_RUNTIME_MAP        23 // RUNTIME_MAP
+#define LOADER_TAG_BOOT_TIMELINE      24 // LOADER_BOOT_TIMELINE_TAG
+#define LOADER_TAG_LOG                25 // LOADER_LOG
+
+#define LOADER_CAPABILITY(Tag)        (1ULL << (Tag))
+
+typedef struct _LOADER_HANDOFF_HEADER {
+  UINT64                    Signature;                      // LOADER_HANDOFF_SIGNATURE
+  UINT32                    Version;                        // LOADER_HANDOFF_VERSION
+  UINT32                    HeaderSize;                     // Size of this header; the first tag starts here
+  UINT64                    TotalSize;                      // Size of the header plus all tags, including the LOADER_TAG_END one
+  UINT64                    Capabilities;                   // LOADER_CAPABILITY() bits for each tag type that's present
+  LOADER_PARAMS            *Legacy;                         // The v2 LOADER_PARAMS structure, which is still filled in
+} LOADER_HANDOFF_HEADER;
+
+typedef struct {
+  UINT32                    Type;                           // LOADER_TAG_* value
+  UINT32                    Size;                           // Size of the payload that follows, not counting this header or padding
+} LOADER_TAG;
+
+typedef struct {
+  UINT32                    Bootloader_MajorVersion;
+  UINT32                    Bootloader_MinorVersion;
+  EFI_PHYSICAL_ADDRESS      Kernel_BaseAddress;             // Same as in LOADER_PARAMS
+  UINT64                    Kernel_Pages;
+  UINT64                    Kernel_VirtualBase;
+  EFI_PHYSICAL_ADDRESS      Page_Table_Root;
+} LOADER_INFO_TAG;
+
+// Space for this gets reserved before ExitBootServices() and filled in afterwards. If the final map turns out not to fit, Map_Size is 0
+// and the LOADER_TAG_MEMORY_MAP capability bit is clear; LOADER_PARAMS->Memory_Map is still there in that case.
+typedef struct {
+  UINT32                    Descriptor_Version;
+  UINT32                    Reserved;
+  UINT64                    Descriptor_Size;
+  UINT64                    Map_Size;                       // Bytes of descriptors in Map
+  UINT8                     Map[];                          // EFI_MEMORY_DESCRIPTORs, Descriptor_Size bytes apart
+} LOADER_MEMORY_MAP_TAG;
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS      FrameBufferBase;
+  UINT64                    FrameBufferSize;
+  UINT32                    HorizontalResolution;
+  UINT32                    VerticalResolution;
+  UINT32                    PixelsPerScanLine;
+  UINT32                    PixelFormat;                    // EFI_GRAPHICS_PIXEL_FORMAT
+  EFI_PIXEL_BITMASK         PixelInformation;
+} LOADER_FRAMEBUFFER;
+
+typedef struct {
+  UINT64                    NumberOfFrameBuffers;
+  LOADER_FRAMEBUFFER        FrameBuffers[];
+} LOADER_FRAMEBUFFERS_TAG;
+
+// One per LOADER_FRAMEBUFFERS_TAG entry, in the same order. With FRAMEBUFFER_WRITE_COMBINING_ENABLED, the loader-built page tables map
+// every framebuffer through PAT entry 4, so kernels that keep them need to leave IA32_PAT entry 4 as WC. Kernels should also copy the
+// BSP's MTRRs and IA32_PAT to the APs when starting them.
+typedef struct {
+  UINT64                    NumberOfFrameBuffers;
+  FRAMEBUFFER_CACHING       FrameBuffers[];
+} LOADER_FRAMEBUFFER_CACHING_TAG;
+
+// The three UTF-16 strings from LOADER_PARAMS, one after the other in Strings. Sizes are in bytes and include the null terminators.
+typedef struct {
+  UINT64                    ESP_Root_Size;
+  UINT64                    Kernel_Path_Size;
+  UINT64                    Kernel_Options_Size;
+  CHAR16                    Strings[];
+} LOADER_CMDLINE_TAG;
+
+typedef struct {
+  UINT32                    UEFI_Version;
+  UINT32                    Reserved;
+  EFI_RUNTIME_SERVICES     *RTServices;
+  EFI_CONFIGURATION_TABLE  *ConfigTables;
+  UINT64                    Number_of_ConfigTables;
+} LOADER_FIRMWARE_TAG;
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS      Rsdp;                           // ACPI RSDP
+  EFI_PHYSICAL_ADDRESS      Xsdt;                           // 0 on ACPI 1.0 systems
+  EFI_PHYSICAL_ADDRESS      Rsdt;
+  UINT32                    Revision;                       // RSDP revision: 0 for ACPI 1.0, 2 for ACPI 2.0+
+  UINT32                    Reserved;
+} LOADER_ACPI_TAG;
+
+// LOADER_ACPI_CPU Flags
+#define LOADER_ACPI_CPU_ENABLED          0x1 // Usable right now
+#define LOADER_ACPI_CPU_ONLINE_CAPABLE   0x2 // Not enabled, but can be brought online later
+#define LOADER_ACPI_CPU_X2APIC           0x4 // Came from an x2APIC entry in the MADT
+
+typedef struct {
+  UINT32                    ApicId;                         // Local APIC ID, or x2APIC ID if LOADER_ACPI_CPU_X2APIC is set
+  UINT32                    AcpiProcessorUid;
+  UINT32                    Flags;                          // LOADER_ACPI_CPU_* bits
+  UINT32                    Reserved;
+} LOADER_ACPI_CPU;
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS      BaseAddress;                    // ECAM base for this segment, as if StartBus were 0
+  UINT16                    Segment;
+  UINT8                     StartBus;
+  UINT8                     EndBus;
+  UINT32                    Reserved;
+} LOADER_ACPI_ECAM;
+
+// The tables a kernel usually wants first, found with one pass over the XSDT (or RSDT), and what's in the MADT and MCFG already
+// decoded. Table addresses are 0 if the firmware doesn't have that table. Cpus[] is in MADT order, so the BSP is normally first, and
+// is followed by the ECAM ranges at EcamOffset.
+typedef struct {
+  EFI_PHYSICAL_ADDRESS      Madt;
+  EFI_PHYSICAL_ADDRESS      Fadt;
+  EFI_PHYSICAL_ADDRESS      Hpet;
+  EFI_PHYSICAL_ADDRESS      Mcfg;
+  EFI_PHYSICAL_ADDRESS      Srat;
+  EFI_PHYSICAL_ADDRESS      Slit;
+  EFI_PHYSICAL_ADDRESS      Hmat;
+  EFI_PHYSICAL_ADDRESS      LocalApicAddress;               // From the MADT, including any 64-bit override
+  EFI_PHYSICAL_ADDRESS      HpetAddress;                    // HPET register block, or 0 if there's no HPET table
+  UINT32                    MadtFlags;                      // ACPI_MADT->Flags
+  UINT32                    NumberOfCpus;
+  UINT32                    NumberOfEcamRanges;
+  UINT32                    EcamOffset;                     // Offset of the LOADER_ACPI_ECAM array from the start of this structure
+  LOADER_ACPI_CPU           Cpus[];
+} LOADER_ACPI_SUMMARY_TAG;
+
+// In all of the SMBIOS records below, Offset is where the structure starts and the string fields are where the string starts (or 0 if
+// it doesn't have that string), both counted from LOADER_SMBIOS_TAG->TableAddress.
+
+typedef struct {
+  EFI_GUID                  Uuid;
+  UINT32                    Offset;
+  UINT32                    Manufacturer;
+  UINT32                    ProductName;
+  UINT32                    Version;
+  UINT32                    SerialNumber;
+  UINT32                    SkuNumber;
+  UINT32                    Family;
+  UINT8                     WakeUpType;
+  UINT8                     Present;                        // 0 if there's no type 1 structure, in which case the rest is all 0
+  UINT16                    Reserved;
+} LOADER_SMBIOS_SYSTEM;
+
+typedef struct {
+  UINT64                    ProcessorId;                    // CPUID leaf 1 EAX and EDX
+  UINT32                    Offset;
+  UINT32                    SocketDesignation;
+  UINT32                    Manufacturer;
+  UINT32                    Version;
+  UINT16                    Handle;
+  UINT16                    ProcessorFamily;                // Already resolved to the ProcessorFamily2 value where needed
+  UINT16                    MaxSpeed;                       // MHz
+  UINT16                    CurrentSpeed;                   // MHz
+  UINT16                    ExternalClock;                  // MHz
+  UINT16                    CoreCount;                      // The counts are 0 if unknown, and already resolved to the 3.0 values
+  UINT16                    CoreEnabled;
+  UINT16                    ThreadCount;
+  UINT16                    Characteristics;
+  UINT8                     ProcessorType;
+  UINT8                     Status;                         // Bit 6 is set if the socket is populated
+  UINT32                    Reserved;
+} LOADER_SMBIOS_PROCESSOR;
+
+typedef struct {
+  UINT64                    Size;                           // Bytes, 0 if the slot is empty, ~0ULL if unknown
+  UINT32                    Offset;
+  UINT32                    DeviceLocator;
+  UINT32                    BankLocator;
+  UINT32                    Manufacturer;
+  UINT32                    SerialNumber;
+  UINT32                    PartNumber;
+  UINT32                    Speed;                          // MT/s, 0 if unknown
+  UINT32                    ConfiguredSpeed;                // MT/s, 0 if unknown
+  UINT16                    Handle;
+  UINT16                    PhysicalMemoryArrayHandle;
+  UINT16                    TotalWidth;                     // Bits, including ECC
+  UINT16                    DataWidth;                      // Bits
+  UINT16                    TypeDetail;
+  UINT16                    MinimumVoltage;                 // mV, 0 if unknown
+  UINT16                    MaximumVoltage;
+  UINT16                    ConfiguredVoltage;
+  UINT8                     FormFactor;
+  UINT8                     DeviceSet;
+  UINT8                     MemoryType;                     // SMBIOS memory type, e.g. 0x1A for DDR4
+  UINT8                     Rank;                           // 0 if unknown
+  UINT32                    Reserved;
+} LOADER_SMBIOS_MEMORY_DEVICE;
+
+typedef struct {
+  UINT32                    First;                          // Index of the first offset for this type in the structure offset array
+  UINT32                    Count;
+} LOADER_SMBIOS_TYPE_INDEX;
+
+// An index of the SMBIOS structure table, so kernels don't have to walk it every time they want something. Types[t] says where the
+// offsets of all type t structures are in the UINT32 array at StructureOffsetsOffset (in table order), and the processor (type 4) and
+// memory device (type 17) structures are also decoded into arrays at ProcessorsOffset and MemoryDevicesOffset. All of the *Offset
+// fields in here are from the start of this structure.
+typedef struct {
+  EFI_PHYSICAL_ADDRESS      EntryPoint;                     // SMBIOS3_ENTRY_POINT if EntryPointType is 3, else SMBIOS_STRUCTURE_TABLE
+  EFI_PHYSICAL_ADDRESS      TableAddress;
+  UINT32                    TableLength;                    // Bytes actually used, up to and including the end-of-table structure
+  UINT8                     EntryPointType;                 // 2 or 3
+  UINT8                     MajorVersion;
+  UINT8                     MinorVersion;
+  UINT8                     DocRev;                         // 0 for SMBIOS 2.x
+  UINT32                    NumberOfStructures;
+  UINT32                    NumberOfProcessors;
+  UINT32                    NumberOfMemoryDevices;
+  UINT32                    StructureOffsetsOffset;
+  UINT32                    ProcessorsOffset;
+  UINT32                    MemoryDevicesOffset;
+  LOADER_SMBIOS_SYSTEM      System;                         // The first type 1 structure
+  LOADER_SMBIOS_TYPE_INDEX  Types[256];
+} LOADER_SMBIOS_TAG;
+
+typedef struct {
+  CHAR8                    *Key;                            // Points at the argument itself, so it's KeyLength bytes long and not null-terminated
+  CHAR8                    *Value;                          // Whatever's after the '=' (null-terminated), or NULL for a bare flag like "quiet"
+  UINT32                    KeyLength;
+  UINT32                    Hash;
+} LOADER_ARGUMENT_KEY;
+
+// Kernel_Options, already converted to UTF-8 and split into arguments (see TokenizeOptions() in Arguments.c for the quoting rules).
+// Every argument also gets an entry in the Keys hash table under the part before its '=', or the whole thing if it has no '='. To look
+// up a key, take its 32-bit FNV-1a hash, start at Keys[Hash & (HashBuckets - 1)] and step forward one slot at a time (wrapping around)
+// until finding it or hitting a slot with a NULL Key. If a key is given more than once, the last one wins.
+//
+// All of the pointers point inside this tag, which is identity-mapped.
+typedef struct {
+  UINT32                    Argc;
+  UINT32                    NumberOfKeys;
+  UINT32                    HashBuckets;                    // A power of 2, or 0 if there are no arguments
+  UINT32                    Utf8Size;                       // Size of Utf8 in bytes, including the null terminator
+  CHAR8                    *Utf8;                           // The whole load options line as UTF-8
+  CHAR8                   **Argv;                           // Argc arguments, then NULL
+  LOADER_ARGUMENT_KEY      *Keys;                           // HashBuckets slots
+} LOADER_ARGUMENTS_TAG;
+
+// TSC readings at various points of the boot, for working out where the time went
+typedef struct {
+  UINT64                    TscFrequency;                   // In Hz
+  UINT64                    LoaderStart_Tsc;                // Start of efi_main()
+  UINT64                    HandoffBuilt_Tsc;               // Right before ExitBootServices()
+  UINT64                    ExitBootServices_Tsc;           // Right after ExitBootServices() succeeded
+  UINT64                    KernelEntry_Tsc;                // Right before jumping to the kernel, after everything else the loader does
+  UINT64                    ExitBootServicesStart_Tsc;      // Right before the first GetMemoryMap() call for ExitBootServices()
+  UINT32                    ExitBootServices_Attempts;      // How many ExitBootServices() calls it took; more than 1 means the map kept changing
+  UINT32                    Reserved;
+  UINT64                    ExitBootServicesCall_Tsc;       // Right before the ExitBootServices() call that succeeded
+} LOADER_TIMING_TAG;
+
+// Where the TSC frequency came from, best first
+#define LOADER_TSC_SOURCE_CPUID       1 // CPUID leaf 0x15 (or 0x16), no measuring needed
+#define LOADER_TSC_SOURCE_HPET        2
+#define LOADER_TSC_SOURCE_PM_TIMER    3 // ACPI PM timer
+#define LOADER_TSC_SOURCE_STALL       4 // BS->Stall(), which is only as good as the firmware's idea of a microsecond
+
+// LOADER_CLOCK_TAG Flags
+#define LOADER_CLOCK_INVARIANT_TSC    0x1 // CPUID says the TSC rate doesn't change with P-, C- or T-states
+
+// What a kernel needs to start keeping time without calibrating anything itself: the TSC frequency, and a wall clock time paired with
+// the TSC value when it was read. Time is the RT->GetTime() reading from the start of efi_main(), and Time_Tsc is halfway between the
+// TSC readings right before and after it, with Time_TscUncertainty being half the gap between them.
+typedef struct {
+  UINT64                    TscFrequency;                   // In Hz, same as in LOADER_TIMING_TAG
+  UINT32                    TscSource;                      // LOADER_TSC_SOURCE_* value
+  UINT32                    Flags;                          // LOADER_CLOCK_* bits
+  EFI_TIME                  Time;
+  UINT64                    Time_Tsc;
+  UINT64                    Time_TscUncertainty;
+} LOADER_CLOCK_TAG;
+
+// LOADER_BOOT_TIMELINE_TAG Flags
+#define LOADER_TIMELINE_FPDT          0x1 // Firmware's boot record was found, so the firmware times (and maybe ExitBootServices) come from there
+#define LOADER_TIMELINE_FPDT_UPDATED  0x2 // Some of firmware's loader timestamps were 0, so the loader wrote its own into the boot record
+
+// Everything from reset to kernel entry on one clock, in nanoseconds since reset, so firmware time and loader time can be told apart.
+// Firmware times come from the ACPI FPDT. The loader's own are its LOADER_TIMING_TAG readings scaled by TscFrequency, which lines up
+// with the FPDT as long as the TSC counted up from 0 at reset (firmware's FPDT times are usually TSC-based too). 0 means unknown.
+typedef struct {
+  UINT32                    Flags;                          // LOADER_TIMELINE_* bits
+  UINT32                    Reserved;
+  UINT64                    ResetEnd;                       // Firmware took over from the reset vector
+  UINT64                    LoaderLoadImageStart;           // Firmware started loading this bootloader
+  UINT64                    LoaderStartImageStart;          // Firmware started running this bootloader
+  UINT64                    LoaderStart;                    // Start of efi_main()
+  UINT64                    HandoffBuilt;                   // The loader was done and about to exit boot services
+  UINT64                    ExitBootServicesEntry;
+  UINT64                    ExitBootServicesExit;
+  UINT64                    KernelEntry;
+} LOADER_BOOT_TIMELINE_TAG;
+
+#define LOADER_MODULE_KERNEL          0
+#define LOADER_MODULE_FILE            1  // A "module =" file from Kernel64.txt, loaded as-is
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS      PhysicalStart;
+  UINT64                    Size;                           // In bytes, rounded up to whole pages
+  UINT64                    VirtualStart;                   // Higher-half address, or 0 if it's only identity mapped
+  UINT64                    Type;                           // LOADER_MODULE_* value
+} LOADER_MODULE;
+
+typedef struct _LOADER_MODULES_TAG {
+  UINT64                    NumberOfModules;
+  LOADER_MODULE             Modules[];                      // The kernel is always the first one
+} LOADER_MODULES_TAG;
+
 //==================================================================================================================================
 // Function Prototypes
 //==================================================================================================================================
@@ -159,18 +1083,115 @@ EFI_STATUS Keywait(CHAR16 *String);
 UINT8 compare(const void* firstitem, const void* seconditem, UINT64 comparelength);
 
 EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics);
-EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATION_TABLE * SysCfgTables, UINTN NumSysCfgTables, UINT32 UEFIVer);
+EFI_STATUS InitLoaderLog(VOID);
+LOADER_LOG * GetLoaderLog(VOID);
+VOID DetachLogConsole(VOID);
+VOID SetLogConsoleLevel(UINT32 Level);
+VOID FlushLoaderLogSerial(VOID);
+VOID LoaderLog(UINT32 Subsystem, UINT32 Level, CONST CHAR16 * Format, ...);
+VOID SetLoaderLogLevels(CONST CHAR16 * Settings, UINT64 Length);
+VOID InitFastBoot(VOID);
+VOID SetFastBoot(CONST CHAR16 * Setting, UINT64 Length);
+EFI_STATUS ParseLoaderConfig(CONST VOID * File, UINT64 FileSize, LOADER_CONFIG * Config);
+UINT64 ConfigSpanToChar16(CONST LOADER_CONFIG * Config, CONST LOADER_CONFIG_SPAN * Span, CHAR16 * String);
+EFI_STATUS LoadLoaderConfig(EFI_HANDLE ImageHandle, LOADER_CONFIG * Config);
+EFI_STATUS PrintBootEntries(VOID);
+UINT8 SelectBootEntry(CHAR16 Key);
+
+// Bit (Subsystem * 4 + Level) of LoaderLogMask is set if that subsystem logs messages at that level
+extern UINT32 LoaderLogMask;
+#define LOADER_LOG_BIT(Subsystem, Level) (1U << ((Subsystem) * 4 + (Level)))
+
+// e.g. if(LOG_ENABLED(MEMORY, DEBUG)), around debug output that takes more work than a LOG_MESSAGE()
+#define LOG_ENABLED(Subsystem, Level) \
+  __builtin_expect((LoaderLogMask & LOADER_LOG_BIT(LOADER_LOG_SUBSYSTEM_##Subsystem, LOADER_LOG_##Level)) != 0, 0)
+
+// e.g. LOG_MESSAGE(GOP, DEBUG, L"Mode: %u", Mode). When the level's off, this is one test of LoaderLogMask, and the arguments don't
+// get evaluated.
+#define LOG_MESSAGE(Subsystem, Level, ...) \
+  do { \
+    if(LOG_ENABLED(Subsystem, Level)) \
+    { \
+      LoaderLog(LOADER_LOG_SUBSYSTEM_##Subsystem, LOADER_LOG_##Level, __VA_ARGS__); \
+    } \
+  } while(0)
+
+EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATION_TABLE * SysCfgTables, UINTN NumSysCfgTables, UINT32 UEFIVer, UINT8 * ExitBootServicesCalled);
 
 UINT8 VerifyZeroMem(UINT64 NumBytes, UINT64 BaseAddr);
 EFI_PHYSICAL_ADDRESS ActuallyFreeAddress(UINT64 pages, EFI_PHYSICAL_ADDRESS OldAddress);
 EFI_PHYSICAL_ADDRESS ActuallyFreeAddressByPage(UINT64 pages, EFI_PHYSICAL_ADDRESS OldAddress);
+EFI_STATUS FindActuallyFreePages(UINT64 pages, EFI_PHYSICAL_ADDRESS * AllocatedMemory, CONST VOID * MemCheck, UINT64 MemCheckSize, UINT8 Below4GB, UINT64 KernelId, CONST CHAR16 * KernelType);
+UINT64 PlacementKernelId(CONST CHAR16 * KernelPath, UINT64 FileSize);
 
 VOID print_memmap(void);
+EFI_STATUS GetMemoryMapCopy(EFI_MEMORY_DESCRIPTOR ** MemMap, UINTN * MemMapSize, UINTN * MemMapDescriptorSize);
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-EFI_STATUS WhatProtocols(EFI_HANDLE * HandleArray, UINTN NumHandlesInHandleArray);
+EFI_STATUS AllocateMemoryTierTable(MEMORY_TIER_TABLE ** TierTable);
+VOID BuildMemoryTierTable(MEMORY_TIER_TABLE * TierTable, EFI_MEMORY_DESCRIPTOR * MemMap, UINTN MemMapSize, UINTN MemMapDescriptorSize);
+
+#ifdef MEMORY_CHARACTERIZATION_ENABLED
+EFI_STATUS CharacterizeMemory(MEMORY_PERF_TABLE ** PerfTable);
+#endif
+
+#ifdef MEMORY_PREZERO_ENABLED
+EFI_STATUS PrezeroMemory(ZEROED_MEMORY_MAP ** ZeroMap);
 #endif
 
+ACPI_RSDP * FindRsdp(VOID);
+ACPI_SDT_HEADER * FindAcpiTable(CONST char * Signature, UINTN Instance);
+UINT64 BuildAcpiSummary(LOADER_ACPI_SUMMARY_TAG * Summary);
+ACPI_FPDT_BOOT_RECORD * FindFirmwareBootRecord(VOID);
+
+UINT64 BuildSmbiosIndex(LOADER_SMBIOS_TAG * Index);
+EFI_STATUS GetPciInventory(EFI_HANDLE ImageHandle, PCI_INVENTORY ** Inventory);
+UINT64 BuildKernelArguments(CONST CHAR16 * Options, UINT64 OptionsSize, LOADER_ARGUMENTS_TAG * Arguments);
+
+UINT64 GetTscFrequency(VOID);
+UINT32 GetTscFrequencySource(VOID);
+EFI_STATUS GetCpuFeatures(CPU_FEATURES ** Features);
+EFI_STATUS GetCpuTopology(CPU_TOPOLOGY ** Topology);
+
+#ifdef CPU_FEATURES_ENABLED
+VOID EnableCpuFeatures(CPU_FEATURES * Features);
+#endif
+
+EFI_STATUS PlanFrameBufferCaching(GPU_CONFIG * Graphics, UINT8 LoaderPageTables);
+
+#ifdef FRAMEBUFFER_WRITE_COMBINING_ENABLED
+VOID ApplyFrameBufferCaching(GPU_CONFIG * Graphics);
+#endif
+
+#ifdef LOADER_ENTRY_STATE_ENABLED
+EFI_STATUS BuildEntryState(GPU_CONFIG * Graphics, LOADER_ENTRY_STATE ** EntryState);
+VOID LoadEntryState(LOADER_ENTRY_STATE * EntryState);
+__attribute__((noreturn)) VOID JumpToKernel(EFI_PHYSICAL_ADDRESS EntryPoint, LOADER_PARAMS * Loader_block, LOADER_HANDOFF_HEADER * Handoff, EFI_PHYSICAL_ADDRESS StackTop);
+#endif
+
+#ifdef RUNTIME_VIRTUAL_MAP_ENABLED
+EFI_STATUS PlanRuntimeMap(RUNTIME_MAP ** RuntimeMap);
+VOID ApplyRuntimeMap(RUNTIME_MAP * RuntimeMap, EFI_MEMORY_DESCRIPTOR * MemMap, UINTN MemMapSize, UINTN MemMapDescriptorSize, UINT32 MemMapDescriptorVersion);
+#endif
+
+#ifdef AP_PARKING_ENABLED
+EFI_STATUS ParkApplicationProcessors(LOADER_AP_PARKING ** Parking);
+VOID CheckParkedApplicationProcessors(LOADER_AP_PARKING * Parking, EFI_PHYSICAL_ADDRESS PageTableRoot);
+#endif
+
+EFI_STATUS BuildHandoff(LOADER_PARAMS * Loader_block, LOADER_HANDOFF_HEADER ** Handoff);
+VOID FinishHandoff(LOADER_HANDOFF_HEADER * Handoff, LOADER_PARAMS * Loader_block, UINT64 ExitBootServicesStartTsc, UINT64 ExitBootServicesCallTsc, UINT64 ExitBootServicesTsc, UINT32 ExitBootServicesAttempts);
+VOID StampKernelEntry(LOADER_HANDOFF_HEADER * Handoff);
+
+#ifdef LOADER_PAGE_TABLES_ENABLED
+VOID AddKernelSegment(UINT64 Offset, UINT64 Size, UINT64 Flags);
+VOID AddGuardPage(EFI_PHYSICAL_ADDRESS Address);
+UINT8 AddRuntimeMapping(EFI_PHYSICAL_ADDRESS PhysicalStart, EFI_VIRTUAL_ADDRESS VirtualStart, UINT64 Pages);
+EFI_STATUS BuildPageTables(EFI_PHYSICAL_ADDRESS KernelBaseAddress, UINT64 KernelPages, GPU_CONFIG * Graphics, EFI_PHYSICAL_ADDRESS * PageTableRoot);
+VOID LoadPageTables(EFI_PHYSICAL_ADDRESS PageTableRoot);
+#endif
+
+EFI_STATUS WhatProtocols(EFI_HANDLE * HandleArray, UINTN NumHandlesInHandleArray);
+
 //==================================================================================================================================
 // Misc. Global Variables
 //==================================================================================================================================
@@ -179,5 +1200,14 @@ EFI_STATUS WhatProtocols(EFI_HANDLE * HandleArray, UINTN NumHandlesInHandleArray
 //
 
 extern UINT8 IsApple;
+extern UINT64 LoaderStartTsc;
+extern EFI_TIME LoaderStartTime;
+extern UINT64 LoaderStartTime_Tsc;
+extern UINT64 LoaderStartTime_TscUncertainty;
+extern LOADER_FAST_BOOT FastBoot;
+extern UINT8 FastBootActive;
+extern LOADER_CONFIG LoaderConfig;
+extern UINT32 PlacementMemoHits;
+extern UINT32 PlacementMemoMisses;
 
 #endif
@@ -0,0 +1,347 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: ACPI Table Definitions
+//==================================================================================================================================
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// Just the ACPI structures the bootloader needs to read. Field layouts are from the ACPI Specification 6.3 (http://www.uefi.org/specifications).
+// All ACPI tables are byte-packed.
+//
+
+#ifndef _ACPI_H
+#define _ACPI_H
+
+#pragma pack(push, 1)
+
+//==================================================================================================================================
+// RSDP and System Description Table Header
+//==================================================================================================================================
+
+typedef struct {
+  CHAR8   Signature[8];     // "RSD PTR "
+  UINT8   Checksum;         // Checksum of the first 20 bytes
+  CHAR8   OEMID[6];
+  UINT8   Revision;         // 0 for ACPI 1.0, 2 for ACPI 2.0+
+  UINT32  RsdtAddress;
+  // ACPI 2.0+
+  UINT32  Length;
+  UINT64  XsdtAddress;
+  UINT8   ExtendedChecksum;
+  UINT8   Reserved[3];
+} ACPI_RSDP;
+
+typedef struct {
+  CHAR8   Signature[4];
+  UINT32  Length;           // Length of the whole table, including this header
+  UINT8   Revision;
+  UINT8   Checksum;
+  CHAR8   OEMID[6];
+  CHAR8   OEMTableID[8];
+  UINT32  OEMRevision;
+  UINT32  CreatorID;
+  UINT32  CreatorRevision;
+} ACPI_SDT_HEADER;
+
+// Generic Address Structure
+typedef struct {
+  UINT8   AddressSpaceId;   // 0 for system memory, 1 for system I/O
+  UINT8   RegisterBitWidth;
+  UINT8   RegisterBitOffset;
+  UINT8   AccessSize;
+  UINT64  Address;
+} ACPI_GAS;
+
+#define ACPI_GAS_SYSTEM_MEMORY 0
+#define ACPI_GAS_SYSTEM_IO     1
+
+//==================================================================================================================================
+// FADT: Fixed ACPI Description Table
+//==================================================================================================================================
+//
+// Only goes up to the ACPI 2.0 extended register blocks; check Header.Length before using anything past Flags.
+//
+
+typedef struct {
+  ACPI_SDT_HEADER Header;   // "FACP"
+  UINT32          FirmwareCtrl;
+  UINT32          Dsdt;
+  UINT8           Reserved0;
+  UINT8           PreferredPmProfile;
+  UINT16          SciInt;
+  UINT32          SmiCmd;
+  UINT8           AcpiEnable;
+  UINT8           AcpiDisable;
+  UINT8           S4BiosReq;
+  UINT8           PstateCnt;
+  UINT32          Pm1aEvtBlk;
+  UINT32          Pm1bEvtBlk;
+  UINT32          Pm1aCntBlk;
+  UINT32          Pm1bCntBlk;
+  UINT32          Pm2CntBlk;
+  UINT32          PmTmrBlk; // I/O port of the 3.579545 MHz ACPI PM timer, 0 if there isn't one
+  UINT32          Gpe0Blk;
+  UINT32          Gpe1Blk;
+  UINT8           Pm1EvtLen;
+  UINT8           Pm1CntLen;
+  UINT8           Pm2CntLen;
+  UINT8           PmTmrLen;
+  UINT8           Gpe0BlkLen;
+  UINT8           Gpe1BlkLen;
+  UINT8           Gpe1Base;
+  UINT8           CstCnt;
+  UINT16          PLvl2Lat;
+  UINT16          PLvl3Lat;
+  UINT16          FlushSize;
+  UINT16          FlushStride;
+  UINT8           DutyOffset;
+  UINT8           DutyWidth;
+  UINT8           DayAlrm;
+  UINT8           MonAlrm;
+  UINT8           Century;
+  UINT16          IaPcBootArch;
+  UINT8           Reserved1;
+  UINT32          Flags;
+  // ACPI 2.0+
+  ACPI_GAS        ResetReg;
+  UINT8           ResetValue;
+  UINT16          ArmBootArch;
+  UINT8           FadtMinorVersion;
+  UINT64          XFirmwareCtrl;
+  UINT64          XDsdt;
+  ACPI_GAS        XPm1aEvtBlk;
+  ACPI_GAS        XPm1bEvtBlk;
+  ACPI_GAS        XPm1aCntBlk;
+  ACPI_GAS        XPm1bCntBlk;
+  ACPI_GAS        XPm2CntBlk;
+  ACPI_GAS        XPmTmrBlk;
+  ACPI_GAS        XGpe0Blk;
+  ACPI_GAS        XGpe1Blk;
+} ACPI_FADT;
+
+#define ACPI_FADT_TMR_VAL_EXT   (1U << 8) // PM timer is 32 bits instead of 24
+
+#define ACPI_PM_TIMER_FREQUENCY 3579545
+
+//==================================================================================================================================
+// MADT: Multiple APIC Description Table
+//==================================================================================================================================
+
+typedef struct {
+  ACPI_SDT_HEADER Header;   // "APIC"
+  UINT32          LocalApicAddress;
+  UINT32          Flags;    // Bit 0: PC-AT compatible dual 8259s are installed
+//ACPI_MADT_SUBTABLE_HEADER Structures[];
+} ACPI_MADT;
+
+typedef struct {
+  UINT8   Type;
+  UINT8   Length;
+} ACPI_MADT_SUBTABLE_HEADER;
+
+#define ACPI_MADT_TYPE_LOCAL_APIC          0
+#define ACPI_MADT_TYPE_LOCAL_APIC_OVERRIDE 5
+#define ACPI_MADT_TYPE_LOCAL_X2APIC        9
+
+// Local APIC & x2APIC flags
+#define ACPI_MADT_ENABLED        0x1
+#define ACPI_MADT_ONLINE_CAPABLE 0x2 // ACPI 6.3+: disabled, but can be brought online later
+
+typedef struct {
+  UINT8   Type;             // 0
+  UINT8   Length;           // 8
+  UINT8   AcpiProcessorUid;
+  UINT8   ApicId;
+  UINT32  Flags;
+} ACPI_MADT_LOCAL_APIC;
+
+typedef struct {
+  UINT8   Type;             // 5
+  UINT8   Length;           // 12
+  UINT16  Reserved;
+  UINT64  LocalApicAddress;
+} ACPI_MADT_LOCAL_APIC_OVERRIDE;
+
+typedef struct {
+  UINT8   Type;             // 9
+  UINT8   Length;           // 16
+  UINT16  Reserved;
+  UINT32  X2ApicId;
+  UINT32  Flags;
+  UINT32  AcpiProcessorUid;
+} ACPI_MADT_LOCAL_X2APIC;
+
+//==================================================================================================================================
+// HPET: High Precision Event Timer Table
+//==================================================================================================================================
+
+typedef struct {
+  ACPI_SDT_HEADER Header;   // "HPET"
+  UINT32          EventTimerBlockId;
+  ACPI_GAS        BaseAddress;
+  UINT8           HpetNumber;
+  UINT16          MinimumTick;
+  UINT8           PageProtection;
+} ACPI_HPET;
+
+// HPET registers, as offsets from the HPET table's BaseAddress
+#define HPET_GENERAL_CAPABILITIES 0x000 // Bits 63:32 are the counter period in femtoseconds
+#define HPET_GENERAL_CONFIG       0x010
+#define HPET_MAIN_COUNTER         0x0F0
+
+#define HPET_CAP_COUNT_SIZE       (1ULL << 13) // Main counter is 64 bits
+#define HPET_CONFIG_ENABLE        (1ULL << 0)
+
+//==================================================================================================================================
+// MCFG: PCI Express Memory-Mapped Configuration Space Table
+//==================================================================================================================================
+
+typedef struct {
+  ACPI_SDT_HEADER Header;   // "MCFG"
+  UINT64          Reserved;
+//ACPI_MCFG_ALLOCATION Allocations[];
+} ACPI_MCFG;
+
+typedef struct {
+  UINT64  BaseAddress;      // ECAM base, as if StartBus were 0
+  UINT16  Segment;
+  UINT8   StartBus;
+  UINT8   EndBus;
+  UINT32  Reserved;
+} ACPI_MCFG_ALLOCATION;
+
+//==================================================================================================================================
+// SRAT: System Resource Affinity Table
+//==================================================================================================================================
+
+typedef struct {
+  ACPI_SDT_HEADER Header;   // "SRAT"
+  UINT32          Reserved1;
+  UINT64          Reserved2;
+//ACPI_SRAT_SUBTABLE_HEADER Structures[];
+} ACPI_SRAT;
+
+typedef struct {
+  UINT8   Type;
+  UINT8   Length;
+} ACPI_SRAT_SUBTABLE_HEADER;
+
+#define ACPI_SRAT_TYPE_MEMORY_AFFINITY 1
+
+#define ACPI_SRAT_MEM_ENABLED       0x1
+#define ACPI_SRAT_MEM_HOT_PLUGGABLE 0x2
+#define ACPI_SRAT_MEM_NON_VOLATILE  0x4
+
+typedef struct {
+  UINT8   Type;             // 1
+  UINT8   Length;           // 40
+  UINT32  ProximityDomain;
+  UINT16  Reserved1;
+  UINT64  BaseAddress;
+  UINT64  RangeLength;
+  UINT32  Reserved2;
+  UINT32  Flags;
+  UINT64  Reserved3;
+} ACPI_SRAT_MEMORY_AFFINITY;
+
+//==================================================================================================================================
+// HMAT: Heterogeneous Memory Attribute Table
+//==================================================================================================================================
+
+typedef struct {
+  ACPI_SDT_HEADER Header;   // "HMAT"
+  UINT32          Reserved;
+//ACPI_HMAT_STRUCTURE_HEADER Structures[];
+} ACPI_HMAT;
+
+typedef struct {
+  UINT16  Type;
+  UINT16  Reserved;
+  UINT32  Length;
+} ACPI_HMAT_STRUCTURE_HEADER;
+
+#define ACPI_HMAT_TYPE_LOCALITY 1
+
+// DataType values
+#define ACPI_HMAT_ACCESS_LATENCY    0
+#define ACPI_HMAT_READ_LATENCY      1
+#define ACPI_HMAT_WRITE_LATENCY     2
+#define ACPI_HMAT_ACCESS_BANDWIDTH  3
+#define ACPI_HMAT_READ_BANDWIDTH    4
+#define ACPI_HMAT_WRITE_BANDWIDTH   5
+
+// Flags[3:0] is the memory hierarchy, and 0 means the memory itself (as opposed to a memory-side cache level)
+#define ACPI_HMAT_HIERARCHY_MASK    0x0F
+#define ACPI_HMAT_HIERARCHY_MEMORY  0
+
+// A matrix entry of 0 or 0xFFFF means the information is not provided
+#define ACPI_HMAT_ENTRY_NONE        0
+#define ACPI_HMAT_ENTRY_UNREACHABLE 0xFFFF
+
+typedef struct {
+  UINT16  Type;             // 1
+  UINT16  Reserved1;
+  UINT32  Length;
+  UINT8   Flags;
+  UINT8   DataType;
+  UINT8   MinTransferSize;
+  UINT8   Reserved2;
+  UINT32  NumberOfInitiatorDomains;
+  UINT32  NumberOfTargetDomains;
+  UINT32  Reserved3;
+  UINT64  EntryBaseUnit;    // Latency entries are in units of EntryBaseUnit picoseconds, bandwidth in units of EntryBaseUnit MB/s
+//UINT32  InitiatorDomains[NumberOfInitiatorDomains];
+//UINT32  TargetDomains[NumberOfTargetDomains];
+//UINT16  Entries[NumberOfInitiatorDomains][NumberOfTargetDomains];
+} ACPI_HMAT_LOCALITY;
+
+//==================================================================================================================================
+// FPDT: Firmware Performance Data Table
+//==================================================================================================================================
+//
+// The FPDT itself just points to the FBPT, which is where firmware keeps its boot timestamps. All of them are in nanoseconds since reset.
+//
+
+typedef struct {
+  ACPI_SDT_HEADER Header;   // "FPDT"
+//ACPI_FPDT_RECORD_HEADER Records[];
+} ACPI_FPDT;
+
+typedef struct {
+  UINT16  Type;
+  UINT8   Length;           // Including this header
+  UINT8   Revision;
+} ACPI_FPDT_RECORD_HEADER;
+
+#define ACPI_FPDT_TYPE_BOOT_POINTER 0 // In the FPDT
+#define ACPI_FPDT_TYPE_BOOT_RECORD  2 // In the FBPT
+
+typedef struct {
+  ACPI_FPDT_RECORD_HEADER Header; // Type 0
+  UINT32  Reserved;
+  UINT64  Address;          // Of the FBPT
+} ACPI_FPDT_BOOT_POINTER;
+
+typedef struct {
+  CHAR8   Signature[4];     // "FBPT"
+  UINT32  Length;           // Including this header
+//ACPI_FPDT_RECORD_HEADER Records[];
+} ACPI_FBPT;
+
+// Any of these can be 0 if firmware didn't record it
+typedef struct {
+  ACPI_FPDT_RECORD_HEADER Header; // Type 2
+  UINT32  Reserved;
+  UINT64  ResetEnd;                 // Firmware took over from the reset vector
+  UINT64  OsLoaderLoadImageStart;   // Firmware started loading the OS loader
+  UINT64  OsLoaderStartImageStart;  // Firmware started running the OS loader
+  UINT64  ExitBootServicesEntry;
+  UINT64  ExitBootServicesExit;
+} ACPI_FPDT_BOOT_RECORD;
+
+#pragma pack(pop)
+
+#endif
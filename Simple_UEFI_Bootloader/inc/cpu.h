@@ -0,0 +1,363 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: CPU Instruction Wrappers
+//==================================================================================================================================
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// Small inline wrappers for x86-64 instructions that GNU-EFI doesn't expose. These are all safe to use after ExitBootServices().
+// NOTE: These are "static inline" on purpose: GNU-EFI #defines STATIC as nothing, and a plain C11 inline has no out-of-line copy.
+//
+
+#ifndef _CPU_H
+#define _CPU_H
+
+// Control register bits
+#define CR0_WP        (1ULL << 16) // Write protect: supervisor-mode writes respect read-only pages
+#define CR0_NW        (1ULL << 29) // Not write-through
+#define CR0_CD        (1ULL << 30) // Cache disable
+#define CR4_PAE       (1ULL << 5)
+#define CR4_PGE       (1ULL << 7)  // Global pages
+#define CR4_OSFXSR    (1ULL << 9)  // FXSAVE/FXRSTOR and SSE instructions
+#define CR4_OSXMMEXCPT (1ULL << 10) // Unmasked SSE exceptions raise #XM instead of #UD
+#define CR4_UMIP      (1ULL << 11) // User-mode instruction prevention
+#define CR4_LA57      (1ULL << 12) // 5-level paging
+#define CR4_FSGSBASE  (1ULL << 16) // RDFSBASE & co.
+#define CR4_PCIDE     (1ULL << 17) // Process-context identifiers
+#define CR4_OSXSAVE   (1ULL << 18) // XSAVE and XGETBV/XSETBV, needed for AVX and up
+#define CR4_SMEP      (1ULL << 20) // Supervisor-mode execution prevention
+#define CR4_SMAP      (1ULL << 21) // Supervisor-mode access prevention
+
+// XCR0 state components
+#define XCR0_X87      (1ULL << 0)
+#define XCR0_SSE      (1ULL << 1)
+#define XCR0_AVX      (1ULL << 2)  // Upper halves of YMM0-15
+#define XCR0_OPMASK   (1ULL << 5)  // AVX-512 k0-7
+#define XCR0_ZMM_HI256 (1ULL << 6) // Upper halves of ZMM0-15
+#define XCR0_HI16_ZMM (1ULL << 7)  // ZMM16-31
+#define XCR0_AVX512   (XCR0_OPMASK | XCR0_ZMM_HI256 | XCR0_HI16_ZMM) // AVX-512 needs all three
+#define XCR0_TILECFG  (1ULL << 17) // AMX
+#define XCR0_TILEDATA (1ULL << 18)
+
+#define XSAVE_LEGACY_AND_HEADER_SIZE 576 // 512-byte FXSAVE area plus the 64-byte XSAVE header
+
+// MSRs
+#define MSR_EFER      0xC0000080
+#define EFER_NXE      (1ULL << 11) // No-execute enable
+#define MSR_MTRRCAP   0xFE
+#define MTRRCAP_VCNT_MASK 0xFF     // Number of variable-range MTRRs
+#define MTRRCAP_FIX   (1ULL << 8)  // Fixed-range MTRRs are supported
+#define MTRRCAP_WC    (1ULL << 10) // Write-combining is supported
+#define MSR_MTRR_PHYSBASE(n) (0x200 + 2 * (n))
+#define MSR_MTRR_PHYSMASK(n) (0x201 + 2 * (n))
+#define MTRR_PHYSMASK_VALID  (1ULL << 11)
+#define MSR_PAT       0x277
+#define MSR_MTRR_DEF_TYPE 0x2FF
+#define MTRR_DEF_TYPE_MASK 0xFF
+#define MTRR_DEF_TYPE_FE (1ULL << 10) // Fixed-range MTRRs enabled
+#define MTRR_DEF_TYPE_E (1ULL << 11)  // MTRRs enabled
+
+// Memory types, as used by the MTRRs and the PAT
+#define MEMORY_TYPE_UC      0 // Uncacheable
+#define MEMORY_TYPE_WC      1 // Write-combining
+#define MEMORY_TYPE_WT      4 // Write-through
+#define MEMORY_TYPE_WP      5 // Write-protected
+#define MEMORY_TYPE_WB      6 // Write-back
+#define MEMORY_TYPE_UC_MINUS 7 // UC, but MTRRs can override it with WC (PAT only)
+
+// CPUID leaves & feature bits
+#define CPUID_MAX_LEAF            0x0
+#define CPUID_FEATURES            0x1
+#define CPUID_FEATURES_ECX_MONITOR (1U << 3) // MONITOR/MWAIT
+#define CPUID_FEATURES_ECX_PCID   (1U << 17)
+#define CPUID_FEATURES_ECX_XSAVE  (1U << 26)
+#define CPUID_FEATURES_ECX_OSXSAVE (1U << 27)
+#define CPUID_FEATURES_ECX_HYPERVISOR (1U << 31)
+#define CPUID_FEATURES_EDX_MTRR   (1U << 12)
+#define CPUID_FEATURES_EDX_HTT    (1U << 28) // EBX[23:16] is valid
+#define CPUID_CACHE_PARAMETERS    0x4        // Subleaf N describes one cache, until EAX[4:0] is 0
+#define CPUID_MONITOR             0x5        // EBX: largest monitor line size in bytes
+#define CPUID_STRUCTURED_FEATURES 0x7
+#define CPUID_STRUCTURED_EBX_FSGSBASE (1U << 0)
+#define CPUID_STRUCTURED_EBX_SMEP (1U << 7)
+#define CPUID_STRUCTURED_EBX_SMAP (1U << 20)
+#define CPUID_STRUCTURED_ECX_UMIP (1U << 2)
+#define CPUID_STRUCTURED_EDX_HYBRID (1U << 15) // More than one kind of core
+#define CPUID_EXTENDED_TOPOLOGY   0xB        // EDX: x2APIC ID, if subleaf 0 EBX isn't 0
+#define CPUID_XSAVE               0xD        // Subleaf 0 EDX:EAX: supported XCR0 bits, subleaf N EAX/EBX: size/offset of component N
+#define CPUID_HYBRID              0x1A       // EAX[31:24]: this core's type
+#define CPUID_V2_EXTENDED_TOPOLOGY 0x1F       // Like 0xB, but with module, tile and die levels too
+#define CPUID_TSC_CRYSTAL         0x15       // EAX/EBX: TSC to crystal ratio, ECX: crystal frequency in Hz
+#define CPUID_FREQUENCY           0x16       // EAX: base frequency in MHz
+#define CPUID_EXTENDED_MAX_LEAF   0x80000000
+#define CPUID_EXTENDED_FEATURES   0x80000001
+#define CPUID_EXTENDED_ECX_TOPOEXT (1U << 22) // AMD: leaves 0x8000001D and 0x8000001E exist
+#define CPUID_EXTENDED_EDX_NX     (1U << 20)
+#define CPUID_EXTENDED_EDX_1GB    (1U << 26) // 1GB pages
+#define CPUID_ADVANCED_POWER      0x80000007
+#define CPUID_ADVANCED_EDX_INVARIANT_TSC (1U << 8) // TSC ticks at the same rate in every P-, C- and T-state
+#define CPUID_ADDRESS_SIZES       0x80000008
+#define CPUID_AMD_CACHE_PARAMETERS 0x8000001D // Same format as CPUID_CACHE_PARAMETERS
+#define CPUID_AMD_PROCESSOR_TOPOLOGY 0x8000001E // EBX[15:8]: threads per core - 1, ECX[10:8]: nodes per package - 1
+#define CPUID_HYPERVISOR_MAX_LEAF 0x40000000 // Only there if CPUID_FEATURES_ECX_HYPERVISOR is set
+
+// Descriptor table structures
+#pragma pack(push, 1)
+
+typedef struct {
+  UINT16  Limit;            // Size of the table minus 1
+  UINT64  Base;
+} DESCRIPTOR_TABLE_POINTER; // What LGDT and LIDT take
+
+typedef struct {
+  UINT16  OffsetLow;
+  UINT16  Selector;
+  UINT8   Ist;              // Bits 2:0 pick an interrupt stack from the TSS, 0 means don't switch stacks
+  UINT8   TypeAttributes;   // IDT_INTERRUPT_GATE for a present, ring 0 interrupt gate
+  UINT16  OffsetMiddle;
+  UINT32  OffsetHigh;
+  UINT32  Reserved;
+} IDT_GATE;
+
+typedef struct {
+  UINT32  Reserved0;
+  UINT64  Rsp[3];           // Stacks for switching into rings 0-2
+  UINT64  Reserved1;
+  UINT64  Ist[7];           // IST1-IST7
+  UINT64  Reserved2;
+  UINT16  Reserved3;
+  UINT16  IoMapBase;        // Set to sizeof(TASK_STATE_SEGMENT) for no I/O permission bitmap
+} TASK_STATE_SEGMENT;
+
+#pragma pack(pop)
+
+#define IDT_INTERRUPT_GATE        0x8E
+#define GDT_FLAT_CODE64           0x00AF9A000000FFFFULL // Present, ring 0, execute/read, long mode
+#define GDT_FLAT_DATA             0x00CF92000000FFFFULL // Present, ring 0, read/write, 4GB limit (ignored in long mode)
+#define GDT_TSS_AVAILABLE         0x89ULL               // Present, 64-bit TSS (available), goes in bits 47:40
+
+// Read the timestamp counter. The LFENCE keeps RDTSC from executing before earlier instructions finish, which matters when timing
+// a block of code.
+static inline UINT64 ReadTsc(VOID)
+{
+  UINT32 Low, High;
+  __asm__ __volatile__("lfence\n\t"
+                       "rdtsc"
+                       : "=a" (Low), "=d" (High)
+                       :
+                       : "memory");
+  return ((UINT64)High << 32) | Low;
+}
+
+static inline VOID CpuId(UINT32 Leaf, UINT32 Subleaf, UINT32 * Eax, UINT32 * Ebx, UINT32 * Ecx, UINT32 * Edx)
+{
+  __asm__ __volatile__("cpuid"
+                       : "=a" (*Eax), "=b" (*Ebx), "=c" (*Ecx), "=d" (*Edx)
+                       : "a" (Leaf), "c" (Subleaf));
+}
+
+// The x2APIC ID if CPUID has it, otherwise the 8-bit initial xAPIC ID. This is what EFI_PROCESSOR_INFORMATION->ProcessorId has, too.
+static inline UINT32 GetInitialApicId(VOID)
+{
+  UINT32 Eax, Ebx, Ecx, Edx;
+
+  CpuId(CPUID_MAX_LEAF, 0, &Eax, &Ebx, &Ecx, &Edx);
+  if(Eax >= CPUID_EXTENDED_TOPOLOGY)
+  {
+    CpuId(CPUID_EXTENDED_TOPOLOGY, 0, &Eax, &Ebx, &Ecx, &Edx);
+    if(Ebx != 0)
+    {
+      return Edx;
+    }
+  }
+
+  CpuId(CPUID_FEATURES, 0, &Eax, &Ebx, &Ecx, &Edx);
+  return Ebx >> 24;
+}
+
+static inline UINT32 IoRead32(UINT16 Port)
+{
+  UINT32 Value;
+  __asm__ __volatile__("inl %1, %0" : "=a" (Value) : "Nd" (Port));
+  return Value;
+}
+
+static inline UINT8 IoRead8(UINT16 Port)
+{
+  UINT8 Value;
+  __asm__ __volatile__("inb %1, %0" : "=a" (Value) : "Nd" (Port));
+  return Value;
+}
+
+static inline VOID IoWrite8(UINT16 Port, UINT8 Value)
+{
+  __asm__ __volatile__("outb %0, %1" : : "a" (Value), "Nd" (Port));
+}
+
+static inline UINT64 ReadMsr(UINT32 Msr)
+{
+  UINT32 Low, High;
+  __asm__ __volatile__("rdmsr" : "=a" (Low), "=d" (High) : "c" (Msr));
+  return ((UINT64)High << 32) | Low;
+}
+
+static inline VOID WriteMsr(UINT32 Msr, UINT64 Value)
+{
+  __asm__ __volatile__("wrmsr" : : "c" (Msr), "a" ((UINT32)Value), "d" ((UINT32)(Value >> 32)) : "memory");
+}
+
+// XGETBV/XSETBV on XCR0. These #UD unless CR4.OSXSAVE is set.
+static inline UINT64 ReadXcr0(VOID)
+{
+  UINT32 Low, High;
+  __asm__ __volatile__("xgetbv" : "=a" (Low), "=d" (High) : "c" (0));
+  return ((UINT64)High << 32) | Low;
+}
+
+static inline VOID WriteXcr0(UINT64 Value)
+{
+  __asm__ __volatile__("xsetbv" : : "c" (0), "a" ((UINT32)Value), "d" ((UINT32)(Value >> 32)) : "memory");
+}
+
+// Write back and invalidate every cache line. Slow, but needed when changing memory types.
+static inline VOID WriteBackInvalidateCaches(VOID)
+{
+  __asm__ __volatile__("wbinvd" : : : "memory");
+}
+
+// Turn interrupts off, returning RFLAGS from before so RestoreInterrupts() can put IF back the way it was
+static inline UINT64 DisableInterrupts(VOID)
+{
+  UINT64 Flags;
+  __asm__ __volatile__("pushfq\n\t"
+                       "popq %0\n\t"
+                       "cli"
+                       : "=r" (Flags)
+                       :
+                       : "memory");
+  return Flags;
+}
+
+static inline VOID RestoreInterrupts(UINT64 Flags)
+{
+  __asm__ __volatile__("pushq %0\n\t"
+                       "popfq"
+                       :
+                       : "r" (Flags)
+                       : "memory", "cc");
+}
+
+static inline UINT64 ReadCr0(VOID)
+{
+  UINT64 Value;
+  __asm__ __volatile__("mov %%cr0, %0" : "=r" (Value));
+  return Value;
+}
+
+static inline VOID WriteCr0(UINT64 Value)
+{
+  __asm__ __volatile__("mov %0, %%cr0" : : "r" (Value) : "memory");
+}
+
+static inline UINT64 ReadCr2(VOID)
+{
+  UINT64 Value;
+  __asm__ __volatile__("mov %%cr2, %0" : "=r" (Value));
+  return Value;
+}
+
+static inline UINT64 ReadCr3(VOID)
+{
+  UINT64 Value;
+  __asm__ __volatile__("mov %%cr3, %0" : "=r" (Value));
+  return Value;
+}
+
+static inline VOID WriteCr3(UINT64 Value)
+{
+  __asm__ __volatile__("mov %0, %%cr3" : : "r" (Value) : "memory");
+}
+
+static inline UINT64 ReadCr4(VOID)
+{
+  UINT64 Value;
+  __asm__ __volatile__("mov %%cr4, %0" : "=r" (Value));
+  return Value;
+}
+
+static inline VOID WriteCr4(UINT64 Value)
+{
+  __asm__ __volatile__("mov %0, %%cr4" : : "r" (Value) : "memory");
+}
+
+static inline VOID LoadGdt(DESCRIPTOR_TABLE_POINTER * Gdtr)
+{
+  __asm__ __volatile__("lgdt %0" : : "m" (*Gdtr) : "memory");
+}
+
+static inline VOID LoadIdt(DESCRIPTOR_TABLE_POINTER * Idtr)
+{
+  __asm__ __volatile__("lidt %0" : : "m" (*Idtr) : "memory");
+}
+
+static inline VOID LoadTaskRegister(UINT16 Selector)
+{
+  __asm__ __volatile__("ltr %0" : : "r" (Selector) : "memory");
+}
+
+// Load CS with a far return, since there's no MOV to CS, then point all the data segment registers at Data. Loading FS and GS this way
+// also zeroes their bases.
+static inline VOID LoadSegments(UINT16 Code, UINT16 Data)
+{
+  __asm__ __volatile__("pushq %q0\n\t"
+                       "leaq 1f(%%rip), %%rax\n\t"
+                       "pushq %%rax\n\t"
+                       "lretq\n"
+                       "1:\n\t"
+                       "movw %w1, %%ds\n\t"
+                       "movw %w1, %%es\n\t"
+                       "movw %w1, %%fs\n\t"
+                       "movw %w1, %%gs\n\t"
+                       "movw %w1, %%ss"
+                       :
+                       : "r" ((UINT64)Code), "r" ((UINT64)Data)
+                       : "rax", "memory");
+}
+
+// Zero Bytes bytes at Buffer with MOVNTI, which writes straight to memory instead of filling the cache with zeroes nobody is going to
+// read. Buffer must be 8-byte aligned and Bytes must be a nonzero multiple of 64. Needs an SFENCE afterwards before anyone else can
+// count on seeing the zeroes.
+static inline VOID ZeroMemNonTemporal(VOID * Buffer, UINT64 Bytes)
+{
+  __asm__ __volatile__("1:\n\t"
+                       "movnti %2, 0(%0)\n\t"
+                       "movnti %2, 8(%0)\n\t"
+                       "movnti %2, 16(%0)\n\t"
+                       "movnti %2, 24(%0)\n\t"
+                       "movnti %2, 32(%0)\n\t"
+                       "movnti %2, 40(%0)\n\t"
+                       "movnti %2, 48(%0)\n\t"
+                       "movnti %2, 56(%0)\n\t"
+                       "add $64, %0\n\t"
+                       "sub $64, %1\n\t"
+                       "jnz 1b"
+                       : "+r" (Buffer), "+r" (Bytes)
+                       : "r" (0ULL)
+                       : "memory", "cc");
+}
+
+static inline VOID StoreFence(VOID)
+{
+  __asm__ __volatile__("sfence" : : : "memory");
+}
+
+// For spin loops. The memory clobber makes the compiler re-read whatever is being waited on.
+static inline VOID CpuPause(VOID)
+{
+  __asm__ __volatile__("pause" : : : "memory");
+}
+
+#endif
@@ -0,0 +1,169 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: SMBIOS Structure Definitions
+//==================================================================================================================================
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// The SMBIOS structures the bootloader decodes that GNU-EFI's libsmbios.h doesn't have (or only has an old, short version of).
+// Field layouts are from the SMBIOS Reference Specification 3.3 (https://www.dmtf.org/standards/smbios). All SMBIOS structures are
+// byte-packed, and each one is followed by its string set: null-terminated strings, ending with an extra null.
+//
+// Structures keep growing with new SMBIOS versions, so check Length before reading a field. The SMBIOS_*_LENGTH_* values below are
+// the lengths that include everything up to and including the fields added by that version.
+//
+
+#ifndef _SMBIOS_H
+#define _SMBIOS_H
+
+#pragma pack(push, 1)
+
+//==================================================================================================================================
+// SMBIOS 3.x Entry Point (2.x is SMBIOS_STRUCTURE_TABLE in libsmbios.h)
+//==================================================================================================================================
+
+typedef struct {
+  UINT8   AnchorString[5];  // "_SM3_"
+  UINT8   EntryPointStructureChecksum;
+  UINT8   EntryPointLength;
+  UINT8   MajorVersion;
+  UINT8   MinorVersion;
+  UINT8   DocRev;
+  UINT8   EntryPointRevision;
+  UINT8   Reserved;
+  UINT32  TableMaximumSize; // The table ends at the first type 127 structure, which is somewhere within this many bytes
+  UINT64  TableAddress;
+} SMBIOS3_ENTRY_POINT;
+
+#define SMBIOS_TYPE_SYSTEM_INFORMATION 1
+#define SMBIOS_TYPE_PROCESSOR          4
+#define SMBIOS_TYPE_MEMORY_DEVICE      17
+#define SMBIOS_TYPE_END_OF_TABLE       127
+
+//==================================================================================================================================
+// Type 1: System Information
+//==================================================================================================================================
+
+typedef struct {
+  SMBIOS_HEADER   Hdr;
+  SMBIOS_STRING   Manufacturer;
+  SMBIOS_STRING   ProductName;
+  SMBIOS_STRING   Version;
+  SMBIOS_STRING   SerialNumber;
+  // 2.1+
+  EFI_GUID        Uuid;     // Not aligned, so copy it out with CopyMem()
+  UINT8           WakeUpType;
+  // 2.4+
+  SMBIOS_STRING   SkuNumber;
+  SMBIOS_STRING   Family;
+} SMBIOS_SYSTEM_INFORMATION;
+
+#define SMBIOS_TYPE1_LENGTH_2_1 0x19
+#define SMBIOS_TYPE1_LENGTH_2_4 0x1B
+
+//==================================================================================================================================
+// Type 4: Processor Information
+//==================================================================================================================================
+
+typedef struct {
+  SMBIOS_HEADER   Hdr;
+  SMBIOS_STRING   SocketDesignation;
+  UINT8           ProcessorType;
+  UINT8           ProcessorFamily;          // 0xFE means see ProcessorFamily2
+  SMBIOS_STRING   ProcessorManufacturer;
+  UINT64          ProcessorId;              // CPUID leaf 1 EAX and EDX on x86
+  SMBIOS_STRING   ProcessorVersion;
+  UINT8           Voltage;
+  UINT16          ExternalClock;            // MHz
+  UINT16          MaxSpeed;                 // MHz
+  UINT16          CurrentSpeed;             // MHz
+  UINT8           Status;
+  UINT8           ProcessorUpgrade;
+  // 2.1+
+  UINT16          L1CacheHandle;
+  UINT16          L2CacheHandle;
+  UINT16          L3CacheHandle;
+  // 2.3+
+  SMBIOS_STRING   SerialNumber;
+  SMBIOS_STRING   AssetTag;
+  SMBIOS_STRING   PartNumber;
+  // 2.5+
+  UINT8           CoreCount;                // 0xFF means see CoreCount2
+  UINT8           CoreEnabled;              // 0xFF means see CoreEnabled2
+  UINT8           ThreadCount;              // 0xFF means see ThreadCount2
+  UINT16          ProcessorCharacteristics;
+  // 2.6+
+  UINT16          ProcessorFamily2;
+  // 3.0+
+  UINT16          CoreCount2;
+  UINT16          CoreEnabled2;
+  UINT16          ThreadCount2;
+} SMBIOS_PROCESSOR_INFORMATION;
+
+#define SMBIOS_TYPE4_LENGTH_2_0 0x1A
+#define SMBIOS_TYPE4_LENGTH_2_5 0x28
+#define SMBIOS_TYPE4_LENGTH_2_6 0x2A
+#define SMBIOS_TYPE4_LENGTH_3_0 0x30
+
+//==================================================================================================================================
+// Type 17: Memory Device
+//==================================================================================================================================
+
+typedef struct {
+  SMBIOS_HEADER   Hdr;
+  UINT16          PhysicalMemoryArrayHandle;
+  UINT16          MemoryErrorInformationHandle;
+  UINT16          TotalWidth;               // Bits, including ECC
+  UINT16          DataWidth;                // Bits
+  UINT16          Size;                     // 0 if empty, 0xFFFF if unknown, 0x7FFF means see ExtendedSize. Bit 15 set means KB, else MB.
+  UINT8           FormFactor;
+  UINT8           DeviceSet;
+  SMBIOS_STRING   DeviceLocator;
+  SMBIOS_STRING   BankLocator;
+  UINT8           MemoryType;
+  UINT16          TypeDetail;
+  // 2.3+
+  UINT16          Speed;                    // MT/s, 0xFFFF means see ExtendedSpeed
+  SMBIOS_STRING   Manufacturer;
+  SMBIOS_STRING   SerialNumber;
+  SMBIOS_STRING   AssetTag;
+  SMBIOS_STRING   PartNumber;
+  // 2.6+
+  UINT8           Attributes;               // Bits 3:0 are the rank
+  // 2.7+
+  UINT32          ExtendedSize;             // MB, bits 30:0
+  UINT16          ConfiguredMemorySpeed;    // MT/s, 0xFFFF means see ExtendedConfiguredMemorySpeed
+  // 2.8+
+  UINT16          MinimumVoltage;           // mV
+  UINT16          MaximumVoltage;           // mV
+  UINT16          ConfiguredVoltage;        // mV
+  // 3.2+
+  UINT8           MemoryTechnology;
+  UINT16          MemoryOperatingModeCapability;
+  SMBIOS_STRING   FirmwareVersion;
+  UINT16          ModuleManufacturerId;
+  UINT16          ModuleProductId;
+  UINT16          MemorySubsystemControllerManufacturerId;
+  UINT16          MemorySubsystemControllerProductId;
+  UINT64          NonVolatileSize;
+  UINT64          VolatileSize;
+  UINT64          CacheSize;
+  UINT64          LogicalSize;
+  // 3.3+
+  UINT32          ExtendedSpeed;
+  UINT32          ExtendedConfiguredMemorySpeed;
+} SMBIOS_MEMORY_DEVICE;
+
+#define SMBIOS_TYPE17_LENGTH_2_1 0x15
+#define SMBIOS_TYPE17_LENGTH_2_3 0x1B
+#define SMBIOS_TYPE17_LENGTH_2_6 0x1C
+#define SMBIOS_TYPE17_LENGTH_2_7 0x22
+#define SMBIOS_TYPE17_LENGTH_2_8 0x28
+#define SMBIOS_TYPE17_LENGTH_3_3 0x5C
+
+#pragma pack(pop)
+
+#endif
@@ -0,0 +1,149 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Supplemental UEFI Definitions
+//==================================================================================================================================
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// Definitions from newer UEFI specifications that GNU-EFI 3.0.9 does not provide.
+// See the UEFI Specification 2.8 (http://www.uefi.org/specifications) for details.
+//
+
+#ifndef _UEFI_Supplemental_H
+#define _UEFI_Supplemental_H
+
+//==================================================================================================================================
+// Memory Attributes
+//==================================================================================================================================
+//
+// These go along with the EFI_MEMORY_UC, EFI_MEMORY_WB, etc. attributes in efidef.h
+//
+
+#ifndef EFI_MEMORY_NV
+#define EFI_MEMORY_NV             0x0000000000008000 // Persistent (non-volatile) memory
+#endif
+
+#ifndef EFI_MEMORY_MORE_RELIABLE
+#define EFI_MEMORY_MORE_RELIABLE  0x0000000000010000 // Higher reliability relative to other memory in the system
+#endif
+
+#ifndef EFI_MEMORY_RO
+#define EFI_MEMORY_RO             0x0000000000020000 // Read-only
+#endif
+
+#ifndef EFI_MEMORY_SP
+#define EFI_MEMORY_SP             0x0000000000040000 // Specific-purpose memory (HBM, CXL-attached memory, etc.)
+#endif
+
+#ifndef EFI_MEMORY_CPU_CRYPTO
+#define EFI_MEMORY_CPU_CRYPTO     0x0000000000080000 // Memory capable of being protected with CPU memory encryption
+#endif
+
+//==================================================================================================================================
+// EFI_MEMORY_ATTRIBUTES_TABLE
+//==================================================================================================================================
+//
+// Installed as a configuration table by firmware that describes the permissions of runtime code & data at finer granularity than
+// the memory map does. It is followed by NumberOfEntries EFI_MEMORY_DESCRIPTORs, each DescriptorSize bytes apart.
+//
+
+#define EFI_MEMORY_ATTRIBUTES_TABLE_GUID \
+    { 0xdcfa911d, 0x26eb, 0x469f, {0xa2, 0x20, 0x38, 0xb7, 0xdc, 0x46, 0x12, 0x20} }
+
+typedef struct {
+  UINT32  Version;
+  UINT32  NumberOfEntries;
+  UINT32  DescriptorSize;
+  UINT32  Reserved;
+//EFI_MEMORY_DESCRIPTOR Entry[1];
+} EFI_MEMORY_ATTRIBUTES_TABLE;
+
+//==================================================================================================================================
+// EFI_MP_SERVICES_PROTOCOL
+//==================================================================================================================================
+//
+// From the UEFI Platform Initialization Specification 1.7, Volume 2. Lets the BSP run a function on the other processors (APs) before
+// ExitBootServices(). The function runs on the APs with no access to boot services, so it can only touch memory.
+//
+
+#define EFI_MP_SERVICES_PROTOCOL_GUID \
+    { 0x3fdda605, 0xa76e, 0x4f46, {0xad, 0x29, 0x12, 0xf4, 0x53, 0x1b, 0x3d, 0x08} }
+
+// EFI_PROCESSOR_INFORMATION StatusFlag bits
+#define PROCESSOR_AS_BSP_BIT        0x00000001
+#define PROCESSOR_ENABLED_BIT       0x00000002
+#define PROCESSOR_HEALTH_STATUS_BIT 0x00000004
+
+typedef struct {
+  UINT32  Package;
+  UINT32  Core;
+  UINT32  Thread;
+} EFI_CPU_PHYSICAL_LOCATION;
+
+typedef struct {
+  UINT64                    ProcessorId;  // The processor's APIC ID
+  UINT32                    StatusFlag;
+  EFI_CPU_PHYSICAL_LOCATION Location;
+} EFI_PROCESSOR_INFORMATION;
+
+typedef VOID (EFIAPI *EFI_AP_PROCEDURE)(IN VOID *ProcedureArgument);
+
+typedef struct _EFI_MP_SERVICES_PROTOCOL EFI_MP_SERVICES_PROTOCOL;
+
+typedef EFI_STATUS (EFIAPI *EFI_MP_SERVICES_GET_NUMBER_OF_PROCESSORS)(IN EFI_MP_SERVICES_PROTOCOL *This, OUT UINTN *NumberOfProcessors, OUT UINTN *NumberOfEnabledProcessors);
+typedef EFI_STATUS (EFIAPI *EFI_MP_SERVICES_GET_PROCESSOR_INFO)(IN EFI_MP_SERVICES_PROTOCOL *This, IN UINTN ProcessorNumber, OUT EFI_PROCESSOR_INFORMATION *ProcessorInfoBuffer);
+typedef EFI_STATUS (EFIAPI *EFI_MP_SERVICES_STARTUP_ALL_APS)(IN EFI_MP_SERVICES_PROTOCOL *This, IN EFI_AP_PROCEDURE Procedure, IN BOOLEAN SingleThread, IN EFI_EVENT WaitEvent OPTIONAL, IN UINTN TimeoutInMicroSeconds, IN VOID *ProcedureArgument OPTIONAL, OUT UINTN **FailedCpuList OPTIONAL);
+typedef EFI_STATUS (EFIAPI *EFI_MP_SERVICES_STARTUP_THIS_AP)(IN EFI_MP_SERVICES_PROTOCOL *This, IN EFI_AP_PROCEDURE Procedure, IN UINTN ProcessorNumber, IN EFI_EVENT WaitEvent OPTIONAL, IN UINTN TimeoutInMicroseconds, IN VOID *ProcedureArgument OPTIONAL, OUT BOOLEAN *Finished OPTIONAL);
+typedef EFI_STATUS (EFIAPI *EFI_MP_SERVICES_SWITCH_BSP)(IN EFI_MP_SERVICES_PROTOCOL *This, IN UINTN ProcessorNumber, IN BOOLEAN EnableOldBSP);
+typedef EFI_STATUS (EFIAPI *EFI_MP_SERVICES_ENABLEDISABLEAP)(IN EFI_MP_SERVICES_PROTOCOL *This, IN UINTN ProcessorNumber, IN BOOLEAN EnableAP, IN UINT32 *HealthFlag OPTIONAL);
+typedef EFI_STATUS (EFIAPI *EFI_MP_SERVICES_WHOAMI)(IN EFI_MP_SERVICES_PROTOCOL *This, OUT UINTN *ProcessorNumber);
+
+struct _EFI_MP_SERVICES_PROTOCOL {
+  EFI_MP_SERVICES_GET_NUMBER_OF_PROCESSORS  GetNumberOfProcessors;
+  EFI_MP_SERVICES_GET_PROCESSOR_INFO        GetProcessorInfo;
+  EFI_MP_SERVICES_STARTUP_ALL_APS           StartupAllAPs;
+  EFI_MP_SERVICES_STARTUP_THIS_AP           StartupThisAP;
+  EFI_MP_SERVICES_SWITCH_BSP                SwitchBSP;
+  EFI_MP_SERVICES_ENABLEDISABLEAP           EnableDisableAP;
+  EFI_MP_SERVICES_WHOAMI                    WhoAmI;
+};
+
+//==================================================================================================================================
+// EFI_PCI_IO_PROTOCOL BAR Resources
+//==================================================================================================================================
+//
+// EFI_PCI_IO_PROTOCOL.GetBarAttributes() describes a BAR with ACPI QWORD Address Space Descriptors, ending with an End Tag. See the ACPI
+// Specification 6.3, section 6.4.3.5.1.
+//
+// NOTE: GNU-EFI 3.0.9 gets the last argument of EFI_PCI_IO_PROTOCOL.GetLocation() wrong; it's really a UINTN * for the function number.
+//
+
+#define ACPI_QWORD_ADDRESS_SPACE_DESCRIPTOR 0x8A
+#define ACPI_END_TAG_DESCRIPTOR             0x79
+
+// ResType
+#define ACPI_ADDRESS_SPACE_TYPE_MEM         0
+#define ACPI_ADDRESS_SPACE_TYPE_IO          1
+
+// SpecificFlag, for memory
+#define ACPI_MEMORY_RESOURCE_PREFETCHABLE   0x06
+
+#pragma pack(push, 1)
+typedef struct {
+  UINT8   Desc;
+  UINT16  Len;
+  UINT8   ResType;
+  UINT8   GenFlag;
+  UINT8   SpecificFlag;
+  UINT64  AddrSpaceGranularity; // 32 or 64 for memory BARs
+  UINT64  AddrRangeMin;
+  UINT64  AddrRangeMax;
+  UINT64  AddrTranslationOffset;
+  UINT64  AddrLen;
+} ACPI_QWORD_ADDRESS_SPACE;
+#pragma pack(pop)
+
+#endif
@@ -0,0 +1,357 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: ACPI Functions
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This file contains functions for locating and reading ACPI tables.
+//
+// NOTE: Nothing in here calls boot services, so it's all safe to use after ExitBootServices().
+//
+
+#include "Bootloader.h"
+
+STATIC CONST CHAR8 RSDPSignature[8] = {'R','S','D',' ','P','T','R',' '};
+
+//==================================================================================================================================
+//  FindRsdp: Get A Pointer To The ACPI RSDP
+//==================================================================================================================================
+//
+// Look up the RSDP in the UEFI configuration tables, preferring the ACPI 2.0+ one. Returns NULL if there isn't a valid one.
+//
+
+ACPI_RSDP * FindRsdp(VOID)
+{
+  ACPI_RSDP * RSDP = NULL;
+
+  // Prefer ACPI 2.0+, since that's the one with the 64-bit XSDT
+  if(EFI_ERROR(LibGetSystemConfigurationTable(&Acpi20TableGuid, (VOID**)&RSDP)))
+  {
+    if(EFI_ERROR(LibGetSystemConfigurationTable(&AcpiTableGuid, (VOID**)&RSDP)))
+    {
+      return NULL;
+    }
+  }
+
+  if((RSDP == NULL) || !compare(RSDP->Signature, RSDPSignature, 8))
+  {
+    return NULL;
+  }
+
+  return RSDP;
+}
+
+//==================================================================================================================================
+//  AcpiRootTableEntries: Get The List Of ACPI Tables
+//==================================================================================================================================
+//
+// Find the XSDT (or the RSDT on ACPI 1.0 systems) and return how many table pointers it has. Entries gets set to the first one, and
+// EntrySize to how big each one is (8 bytes for the XSDT, 4 for the RSDT). Returns 0 if there's no usable root table.
+//
+
+STATIC UINTN AcpiRootTableEntries(UINT8 ** Entries, UINTN * EntrySize)
+{
+  ACPI_RSDP * RSDP = FindRsdp();
+  if(RSDP == NULL)
+  {
+    return 0;
+  }
+
+  ACPI_SDT_HEADER * RootTable;
+
+  if((RSDP->Revision >= 2) && (RSDP->XsdtAddress != 0))
+  {
+    RootTable = (ACPI_SDT_HEADER*)RSDP->XsdtAddress;
+    *EntrySize = sizeof(UINT64);
+  }
+  else
+  {
+    RootTable = (ACPI_SDT_HEADER*)(UINT64)RSDP->RsdtAddress;
+    *EntrySize = sizeof(UINT32);
+  }
+
+  if((RootTable == NULL) || (RootTable->Length < sizeof(ACPI_SDT_HEADER)))
+  {
+    return 0;
+  }
+
+  *Entries = (UINT8*)RootTable + sizeof(ACPI_SDT_HEADER);
+  return (RootTable->Length - sizeof(ACPI_SDT_HEADER)) / *EntrySize;
+}
+
+//==================================================================================================================================
+//  AcpiRootTableEntry: Get One Table From The List
+//==================================================================================================================================
+//
+// Return the Index-th table pointer from AcpiRootTableEntries().
+//
+
+STATIC ACPI_SDT_HEADER * AcpiRootTableEntry(UINT8 * Entries, UINTN EntrySize, UINTN Index)
+{
+  // XSDT entries are not 8-byte aligned, so read them a byte at a time
+  UINT64 TableAddress = 0;
+  CopyMem(&TableAddress, &Entries[Index * EntrySize], EntrySize);
+
+  return (ACPI_SDT_HEADER*)TableAddress;
+}
+
+//==================================================================================================================================
+//  FindAcpiTable: Get A Pointer To An ACPI Table
+//==================================================================================================================================
+//
+// Walk the XSDT (or the RSDT on ACPI 1.0 systems) for the table with the given 4-character signature, e.g. "SRAT".
+// Instance is 0 for the first table with that signature, 1 for the second, etc. (SSDTs, for example, can show up more than once).
+// Returns NULL if there's no such table.
+//
+
+ACPI_SDT_HEADER * FindAcpiTable(CONST char * Signature, UINTN Instance)
+{
+  UINT8 * Entries;
+  UINTN EntrySize;
+  UINTN NumEntries = AcpiRootTableEntries(&Entries, &EntrySize);
+
+  for(UINTN i = 0; i < NumEntries; i++)
+  {
+    ACPI_SDT_HEADER * Table = AcpiRootTableEntry(Entries, EntrySize, i);
+    if((Table != NULL) && compare(Table->Signature, Signature, 4))
+    {
+      if(Instance == 0)
+      {
+        return Table;
+      }
+      Instance--;
+    }
+  }
+
+  return NULL;
+}
+
+//==================================================================================================================================
+//  BuildAcpiSummary: Find The Main ACPI Tables And Decode The MADT & MCFG
+//==================================================================================================================================
+//
+// Walk the XSDT (or RSDT) once, noting where the MADT, FADT, HPET, MCFG, SRAT, SLIT and HMAT are, and then decode the processor
+// entries of the MADT and the ECAM ranges of the MCFG into Summary. Only the first copy of each table counts.
+//
+// Returns the size Summary needs to be, or 0 if there are no ACPI tables. Call it with Summary = NULL first to get the size, then
+// again with a buffer that big.
+//
+
+UINT64 BuildAcpiSummary(LOADER_ACPI_SUMMARY_TAG * Summary)
+{
+  UINT8 * Entries;
+  UINTN EntrySize;
+  UINTN NumEntries = AcpiRootTableEntries(&Entries, &EntrySize);
+  if(NumEntries == 0)
+  {
+    return 0;
+  }
+
+  LOADER_ACPI_SUMMARY_TAG Found;
+  ZeroMem(&Found, sizeof(LOADER_ACPI_SUMMARY_TAG));
+
+  for(UINTN i = 0; i < NumEntries; i++)
+  {
+    ACPI_SDT_HEADER * Table = AcpiRootTableEntry(Entries, EntrySize, i);
+    if(Table == NULL)
+    {
+      continue;
+    }
+
+    EFI_PHYSICAL_ADDRESS * Slot = NULL;
+
+    if(compare(Table->Signature, "APIC", 4))
+    {
+      Slot = &Found.Madt;
+    }
+    else if(compare(Table->Signature, "FACP", 4))
+    {
+      Slot = &Found.Fadt;
+    }
+    else if(compare(Table->Signature, "HPET", 4))
+    {
+      Slot = &Found.Hpet;
+    }
+    else if(compare(Table->Signature, "MCFG", 4))
+    {
+      Slot = &Found.Mcfg;
+    }
+    else if(compare(Table->Signature, "SRAT", 4))
+    {
+      Slot = &Found.Srat;
+    }
+    else if(compare(Table->Signature, "SLIT", 4))
+    {
+      Slot = &Found.Slit;
+    }
+    else if(compare(Table->Signature, "HMAT", 4))
+    {
+      Slot = &Found.Hmat;
+    }
+
+    if((Slot != NULL) && (*Slot == 0))
+    {
+      *Slot = (EFI_PHYSICAL_ADDRESS)Table;
+    }
+  }
+
+  // Processors, in MADT order
+  ACPI_MADT * Madt = (ACPI_MADT*)Found.Madt;
+  if((Madt != NULL) && (Madt->Header.Length >= sizeof(ACPI_MADT)))
+  {
+    Found.LocalApicAddress = Madt->LocalApicAddress;
+    Found.MadtFlags = Madt->Flags;
+
+    UINT8 * Next = (UINT8*)Madt + sizeof(ACPI_MADT);
+    UINT8 * End = (UINT8*)Madt + Madt->Header.Length;
+
+    while(Next + sizeof(ACPI_MADT_SUBTABLE_HEADER) <= End)
+    {
+      ACPI_MADT_SUBTABLE_HEADER * Entry = (ACPI_MADT_SUBTABLE_HEADER*)Next;
+      if((Entry->Length < sizeof(ACPI_MADT_SUBTABLE_HEADER)) || (Next + Entry->Length > End))
+      {
+        break; // Malformed, and there's no telling where the next entry would be
+      }
+
+      LOADER_ACPI_CPU Cpu;
+      UINT8 IsCpu = 0;
+
+      if((Entry->Type == ACPI_MADT_TYPE_LOCAL_APIC) && (Entry->Length >= sizeof(ACPI_MADT_LOCAL_APIC)))
+      {
+        ACPI_MADT_LOCAL_APIC * LocalApic = (ACPI_MADT_LOCAL_APIC*)Entry;
+        Cpu.ApicId = LocalApic->ApicId;
+        Cpu.AcpiProcessorUid = LocalApic->AcpiProcessorUid;
+        Cpu.Flags = LocalApic->Flags & (ACPI_MADT_ENABLED | ACPI_MADT_ONLINE_CAPABLE);
+        IsCpu = 1;
+      }
+      else if((Entry->Type == ACPI_MADT_TYPE_LOCAL_X2APIC) && (Entry->Length >= sizeof(ACPI_MADT_LOCAL_X2APIC)))
+      {
+        ACPI_MADT_LOCAL_X2APIC * LocalX2Apic = (ACPI_MADT_LOCAL_X2APIC*)Entry;
+        Cpu.ApicId = LocalX2Apic->X2ApicId;
+        Cpu.AcpiProcessorUid = LocalX2Apic->AcpiProcessorUid;
+        Cpu.Flags = (LocalX2Apic->Flags & (ACPI_MADT_ENABLED | ACPI_MADT_ONLINE_CAPABLE)) | LOADER_ACPI_CPU_X2APIC;
+        IsCpu = 1;
+      }
+      else if((Entry->Type == ACPI_MADT_TYPE_LOCAL_APIC_OVERRIDE) && (Entry->Length >= sizeof(ACPI_MADT_LOCAL_APIC_OVERRIDE)))
+      {
+        Found.LocalApicAddress = ((ACPI_MADT_LOCAL_APIC_OVERRIDE*)Entry)->LocalApicAddress;
+      }
+
+      if(IsCpu)
+      {
+        if(Summary != NULL)
+        {
+          Cpu.Reserved = 0;
+          Summary->Cpus[Found.NumberOfCpus] = Cpu;
+        }
+        Found.NumberOfCpus++;
+      }
+
+      Next += Entry->Length;
+    }
+  }
+
+  Found.EcamOffset = sizeof(LOADER_ACPI_SUMMARY_TAG) + Found.NumberOfCpus * sizeof(LOADER_ACPI_CPU);
+
+  // PCIe ECAM ranges
+  ACPI_MCFG * Mcfg = (ACPI_MCFG*)Found.Mcfg;
+  if((Mcfg != NULL) && (Mcfg->Header.Length >= sizeof(ACPI_MCFG)))
+  {
+    Found.NumberOfEcamRanges = (Mcfg->Header.Length - sizeof(ACPI_MCFG)) / sizeof(ACPI_MCFG_ALLOCATION);
+
+    if(Summary != NULL)
+    {
+      ACPI_MCFG_ALLOCATION * Allocations = (ACPI_MCFG_ALLOCATION*)((UINT8*)Mcfg + sizeof(ACPI_MCFG));
+      LOADER_ACPI_ECAM * Ecam = (LOADER_ACPI_ECAM*)((UINT8*)Summary + Found.EcamOffset);
+
+      for(UINT32 k = 0; k < Found.NumberOfEcamRanges; k++)
+      {
+        Ecam[k].BaseAddress = Allocations[k].BaseAddress;
+        Ecam[k].Segment = Allocations[k].Segment;
+        Ecam[k].StartBus = Allocations[k].StartBus;
+        Ecam[k].EndBus = Allocations[k].EndBus;
+        Ecam[k].Reserved = 0;
+      }
+    }
+  }
+
+  // HPET registers are always memory-mapped on x86, but check anyway
+  ACPI_HPET * Hpet = (ACPI_HPET*)Found.Hpet;
+  if((Hpet != NULL) && (Hpet->Header.Length >= sizeof(ACPI_HPET)) && (Hpet->BaseAddress.AddressSpaceId == ACPI_GAS_SYSTEM_MEMORY))
+  {
+    Found.HpetAddress = Hpet->BaseAddress.Address;
+  }
+
+  if(Summary != NULL)
+  {
+    CopyMem(Summary, &Found, sizeof(LOADER_ACPI_SUMMARY_TAG));
+  }
+
+  return Found.EcamOffset + Found.NumberOfEcamRanges * sizeof(LOADER_ACPI_ECAM);
+}
+
+//==================================================================================================================================
+//  FindFirmwareBootRecord: Get Firmware's Boot Timestamps
+//==================================================================================================================================
+//
+// Follow the FPDT's pointer to the FBPT and return its Firmware Basic Boot Performance Data Record, or NULL if anything along the way is
+// missing or malformed. The FBPT is firmware-reserved memory that stays mapped, and the OS reads it later, so it can be written to.
+//
+
+ACPI_FPDT_BOOT_RECORD * FindFirmwareBootRecord(VOID)
+{
+  ACPI_SDT_HEADER * Fpdt = FindAcpiTable("FPDT", 0);
+  if(Fpdt == NULL)
+  {
+    return NULL;
+  }
+
+  ACPI_FBPT * Fbpt = NULL;
+  UINT8 * Next = (UINT8*)Fpdt + sizeof(ACPI_FPDT);
+  UINT8 * End = (UINT8*)Fpdt + Fpdt->Length;
+
+  while(Next + sizeof(ACPI_FPDT_RECORD_HEADER) <= End)
+  {
+    ACPI_FPDT_RECORD_HEADER * Record = (ACPI_FPDT_RECORD_HEADER*)Next;
+    if(Record->Length < sizeof(ACPI_FPDT_RECORD_HEADER))
+    {
+      return NULL;
+    }
+    if((Record->Type == ACPI_FPDT_TYPE_BOOT_POINTER) && (Record->Length >= sizeof(ACPI_FPDT_BOOT_POINTER)))
+    {
+      Fbpt = (ACPI_FBPT*)((ACPI_FPDT_BOOT_POINTER*)Record)->Address;
+      break;
+    }
+    Next += Record->Length;
+  }
+
+  if((Fbpt == NULL) || !compare(Fbpt->Signature, "FBPT", 4))
+  {
+    return NULL;
+  }
+
+  Next = (UINT8*)Fbpt + sizeof(ACPI_FBPT);
+  End = (UINT8*)Fbpt + Fbpt->Length;
+
+  while(Next + sizeof(ACPI_FPDT_RECORD_HEADER) <= End)
+  {
+    ACPI_FPDT_RECORD_HEADER * Record = (ACPI_FPDT_RECORD_HEADER*)Next;
+    if(Record->Length < sizeof(ACPI_FPDT_RECORD_HEADER))
+    {
+      return NULL;
+    }
+    if((Record->Type == ACPI_FPDT_TYPE_BOOT_RECORD) && (Record->Length >= sizeof(ACPI_FPDT_BOOT_RECORD)))
+    {
+      return (ACPI_FPDT_BOOT_RECORD*)Record;
+    }
+    Next += Record->Length;
+  }
+
+  return NULL;
+}
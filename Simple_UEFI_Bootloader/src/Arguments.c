@@ -0,0 +1,313 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Kernel Argument Functions
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This file contains the functions that turn the UTF-16 load options from Kernel64.txt into UTF-8, an argv array and a key=value hash
+// table, so that kernels can read their boot flags without having to transcode or tokenize anything first.
+//
+// NOTE: Nothing in here calls boot services, so it's all safe to use after ExitBootServices().
+//
+
+#include "Bootloader.h"
+
+//==================================================================================================================================
+//  NextCodePoint: Decode One UTF-16 Character
+//==================================================================================================================================
+//
+// Return the Unicode code point at String[*Position] and move *Position past it. Surrogate pairs get combined, and unpaired surrogates
+// come out as U+FFFD (the replacement character).
+//
+
+STATIC UINT32 NextCodePoint(CONST CHAR16 * String, UINT64 Length, UINT64 * Position)
+{
+  UINT32 CodePoint = String[(*Position)++];
+
+  if((CodePoint >= 0xD800) && (CodePoint <= 0xDBFF))
+  {
+    if((*Position < Length) && (String[*Position] >= 0xDC00) && (String[*Position] <= 0xDFFF))
+    {
+      CodePoint = 0x10000 + ((CodePoint - 0xD800) << 10) + (String[(*Position)++] - 0xDC00);
+    }
+    else
+    {
+      CodePoint = 0xFFFD;
+    }
+  }
+  else if((CodePoint >= 0xDC00) && (CodePoint <= 0xDFFF))
+  {
+    CodePoint = 0xFFFD;
+  }
+
+  return CodePoint;
+}
+
+//==================================================================================================================================
+//  EncodeUtf8: Encode One Character As UTF-8
+//==================================================================================================================================
+//
+// Write CodePoint to Out as UTF-8 and return how many bytes that took. If Out is NULL, just return how many bytes it would take.
+//
+
+STATIC UINT32 EncodeUtf8(UINT32 CodePoint, CHAR8 * Out)
+{
+  CHAR8 Bytes[4];
+  UINT32 Count;
+
+  if(CodePoint < 0x80)
+  {
+    Bytes[0] = (CHAR8)CodePoint;
+    Count = 1;
+  }
+  else if(CodePoint < 0x800)
+  {
+    Bytes[0] = (CHAR8)(0xC0 | (CodePoint >> 6));
+    Bytes[1] = (CHAR8)(0x80 | (CodePoint & 0x3F));
+    Count = 2;
+  }
+  else if(CodePoint < 0x10000)
+  {
+    Bytes[0] = (CHAR8)(0xE0 | (CodePoint >> 12));
+    Bytes[1] = (CHAR8)(0x80 | ((CodePoint >> 6) & 0x3F));
+    Bytes[2] = (CHAR8)(0x80 | (CodePoint & 0x3F));
+    Count = 3;
+  }
+  else
+  {
+    Bytes[0] = (CHAR8)(0xF0 | (CodePoint >> 18));
+    Bytes[1] = (CHAR8)(0x80 | ((CodePoint >> 12) & 0x3F));
+    Bytes[2] = (CHAR8)(0x80 | ((CodePoint >> 6) & 0x3F));
+    Bytes[3] = (CHAR8)(0x80 | (CodePoint & 0x3F));
+    Count = 4;
+  }
+
+  if(Out != NULL)
+  {
+    for(UINT32 i = 0; i < Count; i++)
+    {
+      Out[i] = Bytes[i];
+    }
+  }
+
+  return Count;
+}
+
+//==================================================================================================================================
+//  TokenizeOptions: Split The Load Options Into Arguments
+//==================================================================================================================================
+//
+// Split Options into arguments the way a shell would: arguments are separated by spaces or tabs, double or single quotes group text
+// (including spaces) into one argument and get removed, and outside of single quotes a backslash makes the next character literal.
+// So `title="My Kernel" path=C:\\EFI` gives the arguments `title=My Kernel` and `path=C:\EFI`.
+//
+// Each argument is written to Tokens as null-terminated UTF-8, and a pointer to it goes in Argv. Either can be NULL to just count.
+// Returns the number of arguments, and puts how many bytes of Tokens they take up in TokensSize.
+//
+
+STATIC UINT32 TokenizeOptions(CONST CHAR16 * Options, UINT64 Length, CHAR8 * Tokens, CHAR8 ** Argv, UINT64 * TokensSize)
+{
+  UINT32 Argc = 0;
+  UINT64 Size = 0;
+  UINT64 Position = 0;
+
+  while(Position < Length)
+  {
+    // Skip whitespace between arguments
+    if((Options[Position] == L' ') || (Options[Position] == L'\t'))
+    {
+      Position++;
+      continue;
+    }
+
+    if(Argv != NULL)
+    {
+      Argv[Argc] = &Tokens[Size];
+    }
+    Argc++;
+
+    CHAR16 Quote = 0;
+    while(Position < Length)
+    {
+      CHAR16 Character = Options[Position];
+
+      if((Quote == 0) && ((Character == L' ') || (Character == L'\t')))
+      {
+        break;
+      }
+
+      if((Quote == 0) && ((Character == L'"') || (Character == L'\'')))
+      {
+        Quote = Character;
+        Position++;
+        continue;
+      }
+
+      if((Quote != 0) && (Character == Quote))
+      {
+        Quote = 0;
+        Position++;
+        continue;
+      }
+
+      if((Character == L'\\') && (Quote != L'\'') && (Position + 1 < Length))
+      {
+        Position++;
+      }
+
+      UINT32 CodePoint = NextCodePoint(Options, Length, &Position);
+      Size += EncodeUtf8(CodePoint, (Tokens != NULL) ? &Tokens[Size] : NULL);
+    }
+
+    if(Tokens != NULL)
+    {
+      Tokens[Size] = '\0';
+    }
+    Size++;
+  }
+
+  *TokensSize = Size;
+  return Argc;
+}
+
+//==================================================================================================================================
+//  HashArgumentKey: Hash A Key For The Argument Table
+//==================================================================================================================================
+//
+// 32-bit FNV-1a. This is what kernels should use to look things up in LOADER_ARGUMENTS_TAG->Keys, too.
+//
+
+STATIC UINT32 HashArgumentKey(CONST CHAR8 * Key, UINT32 KeyLength)
+{
+  UINT32 Hash = 2166136261U;
+
+  for(UINT32 i = 0; i < KeyLength; i++)
+  {
+    Hash ^= (UINT8)Key[i];
+    Hash *= 16777619U;
+  }
+
+  return Hash;
+}
+
+//==================================================================================================================================
+//  BuildKernelArguments: Pre-Parse The Kernel's Load Options
+//==================================================================================================================================
+//
+// Convert the UTF-16 load options (OptionsSize bytes, including the null terminator) into a UTF-8 copy, a null-terminated argv array and
+// a hash table of keys, all inside Arguments. See LOADER_ARGUMENTS_TAG in Bootloader.h.
+//
+// Returns the size Arguments needs to be. Call it with Arguments = NULL first to get the size, then again with a buffer that big. The
+// pointers in Arguments point into Arguments itself, so it can't be moved afterwards.
+//
+
+UINT64 BuildKernelArguments(CONST CHAR16 * Options, UINT64 OptionsSize, LOADER_ARGUMENTS_TAG * Arguments)
+{
+  // Only go up to the null terminator
+  UINT64 Length = 0;
+  while((Length < (OptionsSize >> 1)) && (Options[Length] != L'\0'))
+  {
+    Length++;
+  }
+
+  // Whole-line UTF-8 copy
+  UINT64 Utf8Size = 1;
+  UINT64 Position = 0;
+  while(Position < Length)
+  {
+    Utf8Size += EncodeUtf8(NextCodePoint(Options, Length, &Position), NULL);
+  }
+
+  UINT64 TokensSize;
+  UINT32 Argc = TokenizeOptions(Options, Length, NULL, NULL, &TokensSize);
+
+  // Keep the hash table at most half full so probe chains stay short
+  UINT32 HashBuckets = 0;
+  if(Argc != 0)
+  {
+    HashBuckets = 1;
+    while(HashBuckets < 2 * Argc)
+    {
+      HashBuckets <<= 1;
+    }
+  }
+
+  UINT64 KeysOffset = sizeof(LOADER_ARGUMENTS_TAG);
+  UINT64 ArgvOffset = KeysOffset + HashBuckets * sizeof(LOADER_ARGUMENT_KEY);
+  UINT64 Utf8Offset = ArgvOffset + (Argc + 1) * sizeof(CHAR8*);
+  UINT64 TokensOffset = Utf8Offset + Utf8Size;
+
+  if(Arguments == NULL)
+  {
+    return TokensOffset + TokensSize;
+  }
+
+  Arguments->Argc = Argc;
+  Arguments->NumberOfKeys = 0;
+  Arguments->HashBuckets = HashBuckets;
+  Arguments->Utf8Size = (UINT32)Utf8Size;
+  Arguments->Keys = (LOADER_ARGUMENT_KEY*)((UINT8*)Arguments + KeysOffset);
+  Arguments->Argv = (CHAR8**)((UINT8*)Arguments + ArgvOffset);
+  Arguments->Utf8 = (CHAR8*)((UINT8*)Arguments + Utf8Offset);
+
+  CHAR8 * Utf8 = Arguments->Utf8;
+  Position = 0;
+  while(Position < Length)
+  {
+    Utf8 += EncodeUtf8(NextCodePoint(Options, Length, &Position), Utf8);
+  }
+  *Utf8 = '\0';
+
+  TokenizeOptions(Options, Length, (CHAR8*)Arguments + TokensOffset, Arguments->Argv, &TokensSize);
+  Arguments->Argv[Argc] = NULL;
+
+  ZeroMem(Arguments->Keys, HashBuckets * sizeof(LOADER_ARGUMENT_KEY));
+
+  for(UINT32 i = 0; i < Argc; i++)
+  {
+    CHAR8 * Argument = Arguments->Argv[i];
+    UINT32 KeyLength = 0;
+    while((Argument[KeyLength] != '\0') && (Argument[KeyLength] != '='))
+    {
+      KeyLength++;
+    }
+
+    if(KeyLength == 0)
+    {
+      continue; // Nothing to look it up by
+    }
+
+    CHAR8 * Value = (Argument[KeyLength] == '=') ? &Argument[KeyLength + 1] : NULL;
+    UINT32 Hash = HashArgumentKey(Argument, KeyLength);
+    UINT32 Slot = Hash & (HashBuckets - 1);
+
+    // Linear probing. If a key shows up more than once, the last one wins.
+    while(Arguments->Keys[Slot].Key != NULL)
+    {
+      LOADER_ARGUMENT_KEY * Existing = &Arguments->Keys[Slot];
+      if((Existing->Hash == Hash) && (Existing->KeyLength == KeyLength) && compare(Existing->Key, Argument, KeyLength))
+      {
+        break;
+      }
+      Slot = (Slot + 1) & (HashBuckets - 1);
+    }
+
+    if(Arguments->Keys[Slot].Key == NULL)
+    {
+      Arguments->NumberOfKeys++;
+    }
+
+    Arguments->Keys[Slot].Key = Argument;
+    Arguments->Keys[Slot].Value = Value;
+    Arguments->Keys[Slot].KeyLength = KeyLength;
+    Arguments->Keys[Slot].Hash = Hash;
+  }
+
+  return TokensOffset + TokensSize;
+}
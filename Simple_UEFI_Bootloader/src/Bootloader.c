@@ -42,15 +42,47 @@
     EFI_FILE_INFO            *FileMeta;                       // Kernel file metadata
     EFI_CONFIGURATION_TABLE  *ConfigTables;                   // UEFI-installed system configuration tables (ACPI, SMBIOS, etc.)
     UINTN                     Number_of_ConfigTables;         // The number of system configuration tables
+
+    MEMORY_TIER_TABLE        *Memory_Tiers;                   // RAM classified by tier (DRAM, specific-purpose, persistent, uncached) with SRAT/HMAT hints
+    MEMORY_PERF_TABLE        *Memory_Performance;             // Measured bandwidth & latency of large RAM ranges, or NULL if MEMORY_CHARACTERIZATION_ENABLED is off
+
+    EFI_PHYSICAL_ADDRESS      Page_Table_Root;                // Physical address of the loader-built PML4 (already loaded in CR3), or 0 if LOADER_PAGE_TABLES_ENABLED is off
+    UINT64                    Kernel_VirtualBase;             // Higher-half virtual address that Kernel_BaseAddress is mapped to, or 0 if there's no such mapping
+
+    ZEROED_MEMORY_MAP        *Zeroed_Memory;                  // Which 2MB chunks of RAM are already zeroed, or NULL if MEMORY_PREZERO_ENABLED is off
+
+    struct _LOADER_HANDOFF_HEADER *Handoff;                   // All of the above (and more) in one contiguous buffer; see LOADER_HANDOFF_HEADER below
+
+    CPU_FEATURES             *Cpu_Features;                   // CPUID summary and the CR4/XCR0 state at kernel entry
+
+    LOADER_ENTRY_STATE       *Entry_State;                    // The loader's stack, GDT and IDT the kernel starts with, or NULL if LOADER_ENTRY_STATE_ENABLED is off
+
+    LOADER_AP_PARKING        *Ap_Parking;                     // Mailboxes of the parked application processors, or NULL if AP_PARKING_ENABLED is off or there are no APs
+
+    CPU_TOPOLOGY             *Cpu_Topology;                   // Packages, dies, cores, threads and caches of every processor
+
+    PCI_INVENTORY            *Pci_Inventory;                  // Every PCI function firmware found, with its IDs, class, BARs and driver name
+
+    RUNTIME_MAP              *Runtime_Map;                    // Virtual addresses of the runtime services ranges, or NULL if RUNTIME_VIRTUAL_MAP_ENABLED is off
+
+    LOADER_LOG               *Loader_Log;                     // Everything the loader logged, with timestamps
+
+    struct _LOADER_MODULES_TAG *Modules;                      // The kernel, then the boot entry's module files in Kernel64.txt order
   } LOADER_PARAMS;
 */
 //
+// The same information also comes in the v3 handoff format, which is one contiguous buffer of tagged records instead of pointers to
+// scattered structures. Kernels that want it can take it as a second entry point argument: kernel_main(LOADER_PARAMS * LP,
+// LOADER_HANDOFF_HEADER * Handoff). See LOADER_HANDOFF_HEADER in Bootloader.h for the format.
+//
+//
 // GPU_CONFIG is a custom structure that is defined as follows:
 //
 /*
   typedef struct {
     EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE  *GPUArray;             // An array of EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE structs defining each available framebuffer
     UINT64                              NumberOfFrameBuffers; // The number of structs in the array (== the number of available framebuffers)
+    FRAMEBUFFER_CACHING                *FrameBufferCaching;   // The memory type of each framebuffer, in the same order as GPUArray
   } GPU_CONFIG;
 */
 //
@@ -105,32 +137,65 @@
 // Kernel64.txt Format and Contents:
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// Kernel64.txt should be stored in UTF-16 format in the same directory as the boot loader on the EFI System Partition. Windows Notepad
-// and Wordpad can save text files in this format (select "Unicode Text Document" or "UTF-16 LE" as the encoding format in the "Save As"
-// dialog). Linux users can use gedit or xed, saving as a .txt file with UTF-16 encoding. Also, it does not matter if the file uses
-// Windows (CRLF) or Unix (LF) line endings, but the file does need a 2-byte identification Byte Order Mark (BOM). Don't worry too much
-// about the BOM; it gets added automatically by all of the aforementioned editors when saving with the correct encoding.
+// Kernel64.txt should be stored in the same directory as the boot loader on the EFI System Partition, as either UTF-8 or UTF-16 LE
+// (what Windows Notepad calls "Unicode"). A Byte Order Mark is optional for UTF-8 and recommended for UTF-16; UTF-16 BE doesn't work.
+// It does not matter if the file uses Windows (CRLF) or Unix (LF) line endings.
 //
-// The contents of the text file are simple: only three lines are needed. The first line should be the filename and location of the
-// kernel to be booted relative to the root of the EFI System Partition, e.g. \EFI\Kernel1\MyKernel.64 or \Socks\Bubbles.ReallyLongFileExtension
-// (do not use spaces or special characters in file/folder names), and the second line is the string of load options to be passed to
-// the kernel, e.g. "root=/dev/nvme0n1p5 initrd=\\\EFI\\\ubuntu\\\initrd.img ro rootfstype=ext4 debug ignore_loglevel libata.force=dump_id
-// crashkernel=384M-:128M quiet splash acpi_rev_override=1 acpi_osi=Linux" (without quotes! -- note this example is just a random string
-// of Linux arguments). The third line should be blank--and make sure there is a third line, as this program expects a line break to
-// denote the end of the kernel arguments.**
+// The original format still works: the first line is the filename and location of the kernel to be booted relative to the root of
+// the EFI System Partition, e.g. \EFI\Kernel1\MyKernel.64 (spaces get dropped), and the second line is the string of load options to
+// be passed to the kernel, e.g. "root=/dev/nvme0n1p5 ro rootfstype=ext4 debug quiet splash" (without quotes). Anything after that is
+// ignored.
 //
-// That's it!
+// Otherwise the file is a list of "key = value" lines. Lines starting with # or ; are comments, and spaces around keys and values are
+// ignored. These keys apply to the whole file:
+//
+//   timeout = 10            Seconds to wait for 's' before booting (default 10)
+//   gop_timeout = 90        Seconds each graphics menu waits before picking its default (default 90)
+//   gop = menu              Ask which graphics modes to use (the default); "native" uses each display's native mode and "1920x1080"
+//                           uses that mode where it exists, both without asking
+//   default = Name          The boot entry to use if nobody picks one (default: the first one)
+//
+// A line like [Name] starts a boot entry, and these keys describe it (keys before the first [Name] make an unnamed entry):
+//
+//   kernel = \EFI\Kernel\Kernel64.elf        The kernel file; an entry without one is skipped
+//   options = debug loader.log=info          The kernel's load options
+//   module = \EFI\Kernel\initrd.img          A file to load alongside the kernel, up to 8 of them
+//   placement = below4g                      Keep the kernel and modules below 4GB ("default" lets them go anywhere)
 //
-// ** Technically you could use the remainder of the text file to contain an actual text document. You could put this info in there if
-// you wanted, or your favorite song lyrics, though the smaller the text file the faster it is to load.
+// There can be up to 10 entries. With more than one, the countdown lists them and pressing an entry's number boots it. Modules are
+// loaded as-is into pages of their own and are listed, after the kernel, in LOADER_PARAMS->Modules and in the handoff's
+// LOADER_MODULES_TAG. A line that doesn't make sense gets a warning with its line number and is otherwise ignored.
+// tools/ConfigFuzz/sample_Kernel64.txt is an example.
+//
+// The load options get passed to the kernel exactly as written, and also already split into UTF-8 arguments in the v3 handoff (see
+// LOADER_ARGUMENTS_TAG in Bootloader.h). For that, arguments are separated by spaces, quotes (double or single) keep spaces inside one
+// argument, and outside of single quotes a backslash makes the next character literal.
+//
+// The loader reads one option itself: loader.log= sets how much goes into the loader's log (LOADER_PARAMS->Loader_Log), per subsystem.
+// It takes a comma-separated list of [subsystem:]level, where the levels are off, error, warning, info and debug, and the subsystems
+// are main, gop, loader, pe, elf, macho, memory and handoff (no subsystem means all of them), e.g. loader.log=info,gop:debug,memory:off.
+// The same list can be stored in a UTF-16 UEFI variable called LoaderLog with vendor GUID 5b2c8e41-9d3a-4f17-a60e-73d41c98b25f (see
+// LOADER_VARIABLE_GUID in Bootloader.h), which covers everything from the start of the loader instead of just what comes after
+// Kernel64.txt is read; loader.log= wins where they disagree. The option still gets passed to the kernel with the rest.
+//
+// loader.fastboot=on turns on the fast-boot profile for the next boots: the loader saves the graphics choices made on this boot (or
+// the menu defaults, if the menus timed out) in a UEFI variable called LoaderFastBoot, and from then on it skips the countdown, the
+// banner, and the graphics device names and menus, going straight to the kernel with those choices. Press Esc before the loader
+// starts to get the menus back for one boot. loader.fastboot=off deletes the variable. Only multi-GPU options 2 and 3 can be saved,
+// since 0 and 1 need someone to pick the modes; a saved 0 or 1 becomes 2. With the profile on, errors don't wait for a key either.
+//
+// loader.memcheck=on makes the loader check that the memory it got for the kernel is really free, and go find some that is if it
+// isn't. Some firmware hands out memory that's in use, but the check is slow, so it's off unless this turns it on.
+//
+// That's it!
 //
 //----------------------------------------------------------------------------------------------------------------------------------
 // Booting Multiple Kernels:
 //----------------------------------------------------------------------------------------------------------------------------------
 //
-// A copy of the bootloader and a kernel64.txt file is required for every kernel in a multi-use situation. Recommended
-// practice for booting multiple kernels is to make a folder for each kernel, and each folder should contain its own bootloader,
-// kernel64.txt, and kernel file. The method to boot multiple kernel files varies by machine: generally there is a firmware boot menu
+// One Kernel64.txt can list several kernels as boot entries (see above), and the countdown lets you pick one. Alternatively, a copy
+// of the bootloader and a kernel64.txt file can be used for every kernel: make a folder for each kernel, and each folder should contain
+// its own bootloader, kernel64.txt, and kernel file. The method to boot multiple kernel files that way varies by machine: generally there is a firmware boot menu
 // accessed by F10, F11, F12, etc. at power-on, and entries can be added to this menu in the UEFI firmware setup (accessed by F2, DEL,
 // etc. at power-on). Some machines may need boot entries added by the Linux program efibootmgr, and some might only work with one UEFI
 // application stored in the folder \EFI\BOOT\ with the filename BOOTX64.EFI. In more inconvenient cases like these, it is probably easier
@@ -142,6 +207,10 @@
 
 STATIC CONST CHAR16 AppleFirmwareVendor[6] = L"Apple";
 UINT8 IsApple = 0;
+UINT64 LoaderStartTsc = 0;
+EFI_TIME LoaderStartTime = {0};
+UINT64 LoaderStartTime_Tsc = 0;
+UINT64 LoaderStartTime_TscUncertainty = 0;
 
 //==================================================================================================================================
 //  efi_main: Main Function
@@ -155,6 +224,9 @@ EFI_STATUS efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
   // ImageHandle is this program's own EFI_HANDLE
   // SystemTable is the EFI system table of the machine
 
+  // Note when the loader started, for the handoff timing tag
+  LoaderStartTsc = ReadTsc();
+
   // Initialize the GNU-EFI library
   InitializeLib(ImageHandle, SystemTable);
 /*
@@ -167,11 +239,20 @@ EFI_STATUS efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
 */
   EFI_STATUS Status;
 
-  // Do a preliminary screen clear, always
-  Status = SystemTable->ConOut->ClearScreen(SystemTable->ConOut);
-  if(EFI_ERROR(Status))
+  // Nothing gets logged before this
+  InitLoaderLog();
+
+  // A saved fast-boot profile skips everything here that waits for or talks to a person (see FastBoot.c)
+  InitFastBoot();
+
+  // Do a preliminary screen clear, unless nobody's watching
+  if(!FastBootActive)
   {
-    Print(L"NOTE: Could not clear the screen, so there may be some system text above this line.\r\n");
+    Status = SystemTable->ConOut->ClearScreen(SystemTable->ConOut);
+    if(EFI_ERROR(Status))
+    {
+      Print(L"NOTE: Could not clear the screen, so there may be some system text above this line.\r\n");
+    }
   }
 
 #ifdef DISABLE_UEFI_WATCHDOG_TIMER
@@ -193,9 +274,7 @@ EFI_STATUS efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
     {
       ConsoleMode = NULL;
 
-  #ifdef MAIN_DEBUG_ENABLED
-      Print(L"Console Control Protocol not located. It may not be supported.\r\n");
-  #endif
+      LOG_MESSAGE(MAIN, DEBUG, L"Console Control Protocol not located. It may not be supported.");
     }
 
     if(ConsoleMode != NULL)
@@ -206,168 +285,201 @@ EFI_STATUS efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
 
       if(Current_Mode != EfiConsoleControlScreenText)
       {
-  #ifdef MAIN_DEBUG_ENABLED
-        Print(L"Console control protocol located & now setting text mode...\r\n");
-  #endif
+        LOG_MESSAGE(MAIN, DEBUG, L"Console control protocol located & now setting text mode...");
 
         ConsoleMode->SetMode(ConsoleMode, EfiConsoleControlScreenText);
 
-  #ifdef MAIN_DEBUG_ENABLED
-        Print(L"Text mode set.\r\n");
-  #endif
+        LOG_MESSAGE(MAIN, DEBUG, L"Text mode set.");
       }
-  #ifdef MAIN_DEBUG_ENABLED
       else
       {
-        Print(L"Output already in text mode.\r\n");
+        LOG_MESSAGE(MAIN, DEBUG, L"Output already in text mode.");
       }
-  #endif
     }
   }
   // End text mode
 
   // Print out general system info
+  // The TSC readings around this pair the time with a TSC value for the handoff clock tag
   EFI_TIME Now;
+  UINT64 BeforeTime_Tsc = ReadTsc();
   Status = RT->GetTime(&Now, NULL);
+  UINT64 AfterTime_Tsc = ReadTsc();
   if(EFI_ERROR(Status))
   {
     Print(L"Error getting time...\r\n");
     return Status;
   }
+  LoaderStartTime = Now;
+  LoaderStartTime_Tsc = BeforeTime_Tsc + (AfterTime_Tsc - BeforeTime_Tsc) / 2;
+  LoaderStartTime_TscUncertainty = (AfterTime_Tsc - BeforeTime_Tsc) / 2;
 
-  Print(L"%02hhu/%02hhu/%04hu - %02hhu:%02hhu:%02hhu.%u\r\n\n", Now.Month, Now.Day, Now.Year, Now.Hour, Now.Minute, Now.Second, Now.Nanosecond); // GNU-EFI apparently has a print function for time... Oh well.
-#ifdef MAIN_DEBUG_ENABLED
-  #ifdef MEMORY_DEBUG_ENABLED // Very slow memory debug version
-    Print(L"Simple UEFI Bootloader - V%u.%u DEBUG (Memory)\r\n", MAJOR_VER, MINOR_VER);
-  #else // Standard debug version
-    Print(L"Simple UEFI Bootloader - V%u.%u DEBUG\r\n", MAJOR_VER, MINOR_VER);
-  #endif
-#else
-  #ifdef FINAL_LOADER_DEBUG_ENABLED // Lite debug version
-    Print(L"Simple UEFI Bootloader - V%u.%u DEBUG (Lite)\r\n", MAJOR_VER, MINOR_VER);
-  #else // Release version
+  // Read Kernel64.txt now, since it has the countdown, the boot entries and the graphics preferences in it (see Loader.c)
+  Status = LoadLoaderConfig(ImageHandle, &LoaderConfig);
+  if(EFI_ERROR(Status))
+  {
+    return Status;
+  }
+
+  if(!FastBootActive)
+  {
+    Print(L"%02hhu/%02hhu/%04hu - %02hhu:%02hhu:%02hhu.%u\r\n\n", Now.Month, Now.Day, Now.Year, Now.Hour, Now.Minute, Now.Second, Now.Nanosecond); // GNU-EFI apparently has a print function for time... Oh well.
     Print(L"Simple UEFI Bootloader - V%u.%u\r\n", MAJOR_VER, MINOR_VER);
-  #endif
-#endif
-  Print(L"Copyright (c) 2017-2019 KNNSpeed\r\n\n");
-  Print(L"For software licensing information and related usage terms, please refer to the LICENSE file found at https://github.com/KNNSpeed/Simple-UEFI-Bootloader.\r\n\n");
+    Print(L"Copyright (c) 2017-2019 KNNSpeed\r\n\n");
+    Print(L"For software licensing information and related usage terms, please refer to the LICENSE file found at https://github.com/KNNSpeed/Simple-UEFI-Bootloader.\r\n\n");
 
-  UINT64 timeout_seconds = 10; // 10 seconds
-  EFI_INPUT_KEY Key_Check = {0};
+    UINT64 timeout_seconds = LoaderConfig.Timeout;
+    EFI_INPUT_KEY Key_Check = {0};
 
-  while(timeout_seconds)
-  {
-    Print(L"Continuing in %llu, press 's' to stop timer or press any other key to continue. \r", timeout_seconds);
-    Status = WaitForSingleEvent(ST->ConIn->WaitForKey, 10000000); // Timeout units are 100ns
-    if(Status != EFI_TIMEOUT)
+    // With more than one boot entry, pressing an entry's number during the countdown boots that one instead of the default
+    if(LoaderConfig.NumberOfEntries > 1)
     {
-      Status = ST->ConIn->ReadKeyStroke(ST->ConIn, &Key_Check);
-      if (EFI_ERROR(Status))
+      Status = PrintBootEntries();
+      if(EFI_ERROR(Status))
       {
-        Print(L"\nError reading keystroke. 0x%llx\r\n", Status);
         return Status;
       }
+    }
 
-      if(Key_Check.UnicodeChar == L's')
+    while(timeout_seconds)
+    {
+      if(LoaderConfig.NumberOfEntries > 1)
       {
-        Keywait(L"\nTimer stopped. ");
+        Print(L"Continuing in %llu, press an entry's number to boot it, 's' to stop timer or any other key to continue. \r", timeout_seconds);
       }
       else
       {
-        Print(L"\n");
-        Status = ST->ConIn->Reset(ST->ConIn, FALSE);
+        Print(L"Continuing in %llu, press 's' to stop timer or press any other key to continue. \r", timeout_seconds);
+      }
+      Status = WaitForSingleEvent(ST->ConIn->WaitForKey, 10000000); // Timeout units are 100ns
+      if(Status != EFI_TIMEOUT)
+      {
+        Status = ST->ConIn->ReadKeyStroke(ST->ConIn, &Key_Check);
         if (EFI_ERROR(Status))
         {
-          Print(L"Error resetting input buffer. 0x%llx\r\n", Status);
+          Print(L"\nError reading keystroke. 0x%llx\r\n", Status);
           return Status;
         }
-      }
 
-      break;
-    }
-    timeout_seconds -= 1;
-  }
-  if(!timeout_seconds)
-  {
-    Print(L"\n");
-  }
-  Print(L"\r\n");
+        if(Key_Check.UnicodeChar == L's')
+        {
+          if(LoaderConfig.NumberOfEntries > 1)
+          {
+            // Same as Keywait(), except that the key can pick an entry
+            Print(L"\nTimer stopped. Press an entry's number to boot it or any other key to continue...");
+            UINTN Index;
+            Status = BS->WaitForEvent(1, &ST->ConIn->WaitForKey, &Index);
+            if(!EFI_ERROR(Status))
+            {
+              Status = ST->ConIn->ReadKeyStroke(ST->ConIn, &Key_Check);
+            }
+            if(EFI_ERROR(Status))
+            {
+              Print(L"\nError reading keystroke. 0x%llx\r\n", Status);
+              return Status;
+            }
+            SelectBootEntry(Key_Check.UnicodeChar);
+            Print(L"\r\n");
+          }
+          else
+          {
+            Keywait(L"\nTimer stopped. ");
+          }
+        }
+        else
+        {
+          SelectBootEntry(Key_Check.UnicodeChar);
+          Print(L"\n");
+          Status = ST->ConIn->Reset(ST->ConIn, FALSE);
+          if (EFI_ERROR(Status))
+          {
+            Print(L"Error resetting input buffer. 0x%llx\r\n", Status);
+            return Status;
+          }
+        }
 
-#ifdef MAIN_DEBUG_ENABLED
-  Print(L"EFI System Table Info\r\n   Signature: 0x%lx\r\n   UEFI Revision: 0x%08x\r\n   Header Size: %u Bytes\r\n   CRC32: 0x%08x\r\n   Reserved: 0x%x\r\n", ST->Hdr.Signature, ST->Hdr.Revision, ST->Hdr.HeaderSize, ST->Hdr.CRC32, ST->Hdr.Reserved);
-#else
-  Print(L"EFI System Table Info\r\n   Signature: 0x%lx\r\n   UEFI Revision: %u.%u", ST->Hdr.Signature, ST->Hdr.Revision >> 16, (ST->Hdr.Revision & 0xFFFF) / 10);
-  if((ST->Hdr.Revision & 0xFFFF) % 10)
-  {
-    Print(L".%u\r\n", (ST->Hdr.Revision & 0xFFFF) % 10); // UEFI major.minor version numbers are defined in BCD (in a 65535.65535 format) and are meant to be displayed as 2 digits if the minor ones digit is 0. Sub-minor revisions are included in the minor number. See the "EFI_TABLE_HEADER" section in any UEFI spec.
-    // The spec also states that minor versions are limited to a max of 99, even though they get to have a whole 16-bit number.
-  }
-  else
-  {
+        break;
+      }
+      timeout_seconds -= 1;
+    }
+    if(!timeout_seconds)
+    {
+      Print(L"\n");
+    }
     Print(L"\r\n");
-  }
-#endif
 
-  Print(L"   Firmware Vendor: %s\r\n   Firmware Revision: 0x%08x\r\n\n", ST->FirmwareVendor, ST->FirmwareRevision);
+    Print(L"EFI System Table Info\r\n   Signature: 0x%lx\r\n   UEFI Revision: %u.%u", ST->Hdr.Signature, ST->Hdr.Revision >> 16, (ST->Hdr.Revision & 0xFFFF) / 10);
+    if((ST->Hdr.Revision & 0xFFFF) % 10)
+    {
+      Print(L".%u\r\n", (ST->Hdr.Revision & 0xFFFF) % 10); // UEFI major.minor version numbers are defined in BCD (in a 65535.65535 format) and are meant to be displayed as 2 digits if the minor ones digit is 0. Sub-minor revisions are included in the minor number. See the "EFI_TABLE_HEADER" section in any UEFI spec.
+      // The spec also states that minor versions are limited to a max of 99, even though they get to have a whole 16-bit number.
+    }
+    else
+    {
+      Print(L"\r\n");
+    }
+    LOG_MESSAGE(MAIN, DEBUG, L"EFI System Table: Revision 0x%08x, Header Size: %u Bytes, CRC32: 0x%08x, Reserved: 0x%x", ST->Hdr.Revision, ST->Hdr.HeaderSize, ST->Hdr.CRC32, ST->Hdr.Reserved);
 
-  // Configuration table info
-  Print(L"%llu system configuration tables are available.\r\n", ST->NumberOfTableEntries);
+    Print(L"   Firmware Vendor: %s\r\n   Firmware Revision: 0x%08x\r\n\n", ST->FirmwareVendor, ST->FirmwareRevision);
 
-#ifdef MAIN_DEBUG_ENABLED
-  Keywait(L"\0");
+    // Configuration table info
+    Print(L"%llu system configuration tables are available.\r\n", ST->NumberOfTableEntries);
+  }
 
   // Search for ACPI tables
   UINT8 RSDPfound = 0;
   UINTN RSDP_index = 0;
 
-  // This print is for debugging
-  for(UINTN i=0; i < ST->NumberOfTableEntries; i++)
-  {
-    Print(L"Table %llu GUID: %08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x\r\n", i,
-            ST->ConfigurationTable[i].VendorGuid.Data1,
-            ST->ConfigurationTable[i].VendorGuid.Data2,
-            ST->ConfigurationTable[i].VendorGuid.Data3,
-            ST->ConfigurationTable[i].VendorGuid.Data4[0],
-            ST->ConfigurationTable[i].VendorGuid.Data4[1],
-            ST->ConfigurationTable[i].VendorGuid.Data4[2],
-            ST->ConfigurationTable[i].VendorGuid.Data4[3],
-            ST->ConfigurationTable[i].VendorGuid.Data4[4],
-            ST->ConfigurationTable[i].VendorGuid.Data4[5],
-            ST->ConfigurationTable[i].VendorGuid.Data4[6],
-            ST->ConfigurationTable[i].VendorGuid.Data4[7]);
-
-    if (compare(&ST->ConfigurationTable[i].VendorGuid, &Acpi20TableGuid, 16))
-    {
-      Print(L"RSDP 2.0 found!\r\n");
-      RSDP_index = i;
-      RSDPfound = 2;
-    }
-  }
-  // If no RSDP 2.0, check for 1.0
-  if(!RSDPfound)
+  // This is for debugging
+  if(LOG_ENABLED(MAIN, DEBUG))
   {
     for(UINTN i=0; i < ST->NumberOfTableEntries; i++)
     {
-      if (compare(&ST->ConfigurationTable[i].VendorGuid, &AcpiTableGuid, 16))
+      LOG_MESSAGE(MAIN, DEBUG, L"Table %llu GUID: %08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x", i,
+              ST->ConfigurationTable[i].VendorGuid.Data1,
+              ST->ConfigurationTable[i].VendorGuid.Data2,
+              ST->ConfigurationTable[i].VendorGuid.Data3,
+              ST->ConfigurationTable[i].VendorGuid.Data4[0],
+              ST->ConfigurationTable[i].VendorGuid.Data4[1],
+              ST->ConfigurationTable[i].VendorGuid.Data4[2],
+              ST->ConfigurationTable[i].VendorGuid.Data4[3],
+              ST->ConfigurationTable[i].VendorGuid.Data4[4],
+              ST->ConfigurationTable[i].VendorGuid.Data4[5],
+              ST->ConfigurationTable[i].VendorGuid.Data4[6],
+              ST->ConfigurationTable[i].VendorGuid.Data4[7]);
+
+      if (compare(&ST->ConfigurationTable[i].VendorGuid, &Acpi20TableGuid, 16))
       {
-        Print(L"RSDP 1.0 found!\r\n");
+        LOG_MESSAGE(MAIN, DEBUG, L"RSDP 2.0 found!");
         RSDP_index = i;
-        RSDPfound = 1;
+        RSDPfound = 2;
+      }
+    }
+    // If no RSDP 2.0, check for 1.0
+    if(!RSDPfound)
+    {
+      for(UINTN i=0; i < ST->NumberOfTableEntries; i++)
+      {
+        if (compare(&ST->ConfigurationTable[i].VendorGuid, &AcpiTableGuid, 16))
+        {
+          LOG_MESSAGE(MAIN, DEBUG, L"RSDP 1.0 found!");
+          RSDP_index = i;
+          RSDPfound = 1;
+        }
       }
     }
-  }
 
-  if(!RSDPfound)
-  {
-    Print(L"System has no RSDP.\r\n");
+    if(!RSDPfound)
+    {
+      LOG_MESSAGE(MAIN, DEBUG, L"System has no RSDP.");
+    }
   }
 
-  Keywait(L"\0");
-
   // View memmap before too much happens to it
-  print_memmap();
-  Keywait(L"Done printing MemMap.\r\n");
-#endif
+  if(LOG_ENABLED(MEMORY, DEBUG))
+  {
+    print_memmap();
+  }
 
   // Create graphics structure
   GPU_CONFIG *Graphics;
@@ -378,9 +490,7 @@ EFI_STATUS efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
     return Status;
   }
 
-#ifdef MAIN_DEBUG_ENABLED
-  Print(L"Graphics struct allocated\r\n");
-#endif
+  LOG_MESSAGE(MAIN, DEBUG, L"Graphics struct allocated");
 
   // Set up graphics
   Status = InitUEFI_GOP(ImageHandle, Graphics);
@@ -391,22 +501,97 @@ EFI_STATUS efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
     return Status;
   }
 
-#ifdef MAIN_DEBUG_ENABLED
-  Keywait(L"InitUEFI_GOP finished.\r\n");
+  LOG_MESSAGE(MAIN, DEBUG, L"InitUEFI_GOP finished.");
 
-  // Data verification
-  Print(L"Config table address: 0x%llx\r\n", ST->ConfigurationTable);
-  Print(L"Data at RSDP (first 16 bytes): 0x%016llx%016llx\r\n", *(EFI_PHYSICAL_ADDRESS*)(((UINT64)ST->ConfigurationTable[RSDP_index].VendorTable) + 8), *(EFI_PHYSICAL_ADDRESS*)ST->ConfigurationTable[RSDP_index].VendorTable);
-#endif
+  // Data verification (RSDP_index is only looked for at MAIN:DEBUG)
+  LOG_MESSAGE(MAIN, DEBUG, L"Config table address: 0x%llx", ST->ConfigurationTable);
+  if(RSDPfound)
+  {
+    LOG_MESSAGE(MAIN, DEBUG, L"Data at RSDP (first 16 bytes): 0x%016llx%016llx", *(EFI_PHYSICAL_ADDRESS*)(((UINT64)ST->ConfigurationTable[RSDP_index].VendorTable) + 8), *(EFI_PHYSICAL_ADDRESS*)ST->ConfigurationTable[RSDP_index].VendorTable);
+  }
 
   // Load a program and exit boot services, then pass a loader block to that program's entry point to execute the program
-  Status = GoTime(ImageHandle, Graphics, ST->ConfigurationTable, ST->NumberOfTableEntries, ST->Hdr.Revision);
+  UINT8 ExitBootServicesCalled = 0;
+  Status = GoTime(ImageHandle, Graphics, ST->ConfigurationTable, ST->NumberOfTableEntries, ST->Hdr.Revision, &ExitBootServicesCalled);
+
+  // Even a failed ExitBootServices() leaves boot services unusable, so there's no console to pause on
+  if(ExitBootServicesCalled)
+  {
+    return Status;
+  }
 
   // Pause to evaluate any errors
   Keywait(L"GoTime returned...\r\n");
   return Status;
 }
 
+//==================================================================================================================================
+//  PrintBootEntries: List Kernel64.txt's Boot Entries
+//==================================================================================================================================
+//
+// Print each boot entry's number and name (or its kernel path, if it doesn't have a name) for the countdown, marking the default.
+//
+
+EFI_STATUS PrintBootEntries(VOID)
+{
+  EFI_STATUS entry_status;
+
+  for(UINT32 k = 0; k < LoaderConfig.NumberOfEntries; k++)
+  {
+    CONST LOADER_CONFIG_SPAN * EntryName = LoaderConfig.Entries[k].Name.Length ? &LoaderConfig.Entries[k].Name : &LoaderConfig.Entries[k].Kernel;
+    CHAR16 * EntryNameString;
+
+    entry_status = BS->AllocatePool(EfiBootServicesData, (EntryName->Length + 1) * sizeof(CHAR16), (void**)&EntryNameString);
+    if(EFI_ERROR(entry_status))
+    {
+      Print(L"EntryNameString AllocatePool error. 0x%llx\r\n", entry_status);
+      return entry_status;
+    }
+    ConfigSpanToChar16(&LoaderConfig, EntryName, EntryNameString);
+
+    // Entry 10 is on the 0 key
+    Print(L"%u. %s%s\r\n", (k + 1) % 10, EntryNameString, (k == LoaderConfig.DefaultEntry) ? L" (default)" : L"");
+
+    entry_status = BS->FreePool(EntryNameString);
+    if(EFI_ERROR(entry_status))
+    {
+      Print(L"Error freeing EntryNameString pool. 0x%llx\r\n", entry_status);
+      return entry_status;
+    }
+  }
+  Print(L"\r\n");
+
+  return EFI_SUCCESS;
+}
+
+//==================================================================================================================================
+//  SelectBootEntry: Pick A Boot Entry By Its Number
+//==================================================================================================================================
+//
+// If Key is the number of one of Kernel64.txt's boot entries, as listed by PrintBootEntries(), boot that one. Returns 1 if it was.
+//
+
+UINT8 SelectBootEntry(CHAR16 Key)
+{
+  UINT32 Number;
+
+  if((Key < L'0') || (Key > L'9'))
+  {
+    return 0;
+  }
+
+  Number = (Key == L'0') ? 10 : (UINT32)(Key - L'0');
+  if(Number > LoaderConfig.NumberOfEntries)
+  {
+    return 0;
+  }
+
+  LoaderConfig.SelectedEntry = Number - 1;
+  LOG_MESSAGE(MAIN, INFO, L"Boot entry %u picked", Number);
+
+  return 1;
+}
+
 //==================================================================================================================================
 //  Keywait: Pause
 //==================================================================================================================================
@@ -415,14 +600,22 @@ EFI_STATUS efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
 // Adapted from http://wiki.osdev.org/UEFI_Bare_Bones
 //
 // Note: Does not take format modifier arguments like %s, %d, etc., only plain strings.
+// With the fast-boot profile active this only prints String, since there's nobody there to press a key.
 //
 
 EFI_STATUS Keywait(CHAR16 *String)
 {
   EFI_STATUS Status;
   EFI_INPUT_KEY Key;
+  UINTN Index;
   Print(String);
 
+  if(FastBootActive)
+  {
+    Print(L"\r\n");
+    return EFI_SUCCESS;
+  }
+
   Status = ST->ConOut->OutputString(ST->ConOut, L"Press any key to continue...");
   if (EFI_ERROR(Status))
   {
@@ -436,8 +629,13 @@ EFI_STATUS Keywait(CHAR16 *String)
     return Status;
   }
 
-  // Poll for key
-  while ((Status = ST->ConIn->ReadKeyStroke(ST->ConIn, &Key)) == EFI_NOT_READY);
+  // Wait for a key, letting firmware idle the CPU instead of spinning on ReadKeyStroke()
+  Status = BS->WaitForEvent(1, &ST->ConIn->WaitForKey, &Index);
+  if (EFI_ERROR(Status))
+  {
+    return Status;
+  }
+  ST->ConIn->ReadKeyStroke(ST->ConIn, &Key);
 
   // Clear keystroke buffer (this is just a pause)
   Status = ST->ConIn->Reset(ST->ConIn, FALSE);
@@ -0,0 +1,373 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Framebuffer Caching Functions
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This file contains the functions that work out what memory type each framebuffer is, and, if FRAMEBUFFER_WRITE_COMBINING_ENABLED is
+// defined in Bootloader.h, make them write-combining. Drawing to an uncached framebuffer means every pixel write is its own bus
+// transaction, which is many times slower than letting the CPU combine them into full cache-line bursts.
+//
+// MTRRs get changed after ExitBootServices(), since firmware might reprogram them while it's still running. Changing them on just the
+// BSP leaves the APs with different MTRRs, which the SDM says not to do for long, so kernels should copy the BSP's MTRRs (and IA32_PAT)
+// to each AP when starting it.
+//
+
+#include "Bootloader.h"
+
+#ifdef FRAMEBUFFER_WRITE_COMBINING_ENABLED
+STATIC UINT8 FrameBufferMtrrsPlanned = 0;
+STATIC UINT8 FrameBufferPatPlanned = 0;
+#endif
+
+//==================================================================================================================================
+//  PhysicalAddressMask: Get The Valid Physical Address Bits
+//==================================================================================================================================
+//
+// Return a mask of the physical address bits above bit 11, i.e. the bits MTRR bases and masks use.
+//
+
+STATIC UINT64 PhysicalAddressMask(VOID)
+{
+  UINT32 Eax, Ebx, Ecx, Edx;
+  UINT64 PhysicalBits = 36; // Every x86-64 CPU supports at least this much
+
+  CpuId(CPUID_EXTENDED_MAX_LEAF, 0, &Eax, &Ebx, &Ecx, &Edx);
+  if(Eax >= CPUID_ADDRESS_SIZES)
+  {
+    CpuId(CPUID_ADDRESS_SIZES, 0, &Eax, &Ebx, &Ecx, &Edx);
+    PhysicalBits = Eax & 0xFF;
+  }
+
+  return ((1ULL << PhysicalBits) - 1) & ~(EFI_PAGE_SIZE - 1);
+}
+
+//==================================================================================================================================
+//  MtrrMemoryType: Get The MTRR Memory Type Of An Address
+//==================================================================================================================================
+//
+// Return the MEMORY_TYPE_* value the MTRRs give Address, using the SDM's rules for overlapping variable ranges: UC wins over
+// everything, WT wins over WB, and anything else overlapping is undefined (so this just returns the first one). The fixed-range MTRRs
+// only cover the first 1MB, which is never where a GOP framebuffer is, so they're ignored.
+//
+
+STATIC UINT8 MtrrMemoryType(EFI_PHYSICAL_ADDRESS Address, UINT32 VariableMtrrs, UINT64 AddressMask)
+{
+  UINT64 DefType = ReadMsr(MSR_MTRR_DEF_TYPE);
+  UINT8 Type = 0xFF;
+
+  if(!(DefType & MTRR_DEF_TYPE_E))
+  {
+    return MEMORY_TYPE_UC;
+  }
+
+  for(UINT32 i = 0; i < VariableMtrrs; i++)
+  {
+    UINT64 PhysMask = ReadMsr(MSR_MTRR_PHYSMASK(i));
+    if(!(PhysMask & MTRR_PHYSMASK_VALID))
+    {
+      continue;
+    }
+
+    UINT64 PhysBase = ReadMsr(MSR_MTRR_PHYSBASE(i));
+    PhysMask &= AddressMask;
+    if((Address & PhysMask) != (PhysBase & PhysMask))
+    {
+      continue;
+    }
+
+    UINT8 RangeType = (UINT8)(PhysBase & 0xFF);
+    if(RangeType == MEMORY_TYPE_UC)
+    {
+      return MEMORY_TYPE_UC;
+    }
+
+    if(Type == 0xFF)
+    {
+      Type = RangeType;
+    }
+    else if(((Type == MEMORY_TYPE_WB) && (RangeType == MEMORY_TYPE_WT)) || ((Type == MEMORY_TYPE_WT) && (RangeType == MEMORY_TYPE_WB)))
+    {
+      Type = MEMORY_TYPE_WT;
+    }
+  }
+
+  if(Type == 0xFF)
+  {
+    Type = (UINT8)(DefType & MTRR_DEF_TYPE_MASK);
+  }
+
+  return Type;
+}
+
+#ifdef FRAMEBUFFER_WRITE_COMBINING_ENABLED
+//==================================================================================================================================
+//  FrameBufferMtrrFits: Check If An MTRR Can Cover A Range
+//==================================================================================================================================
+//
+// A new WC range can't overlap any valid variable MTRR, since WC on top of UC is UC and WC on top of anything else is undefined. It
+// also can't touch anything in the memory map that's RAM, since write-combining RAM would break everything that expects it to be
+// coherent. Firmware usually lists framebuffers as MMIO or reserved, if it lists them at all.
+//
+
+STATIC UINT8 FrameBufferMtrrFits(EFI_PHYSICAL_ADDRESS BlockBase, UINT64 BlockSize, UINT32 VariableMtrrs, UINT64 AddressMask, EFI_MEMORY_DESCRIPTOR * MemMap, UINTN MemMapSize, UINTN MemMapDescriptorSize)
+{
+  for(UINT32 i = 0; i < VariableMtrrs; i++)
+  {
+    UINT64 PhysMask = ReadMsr(MSR_MTRR_PHYSMASK(i));
+    if(!(PhysMask & MTRR_PHYSMASK_VALID))
+    {
+      continue;
+    }
+
+    // Treat it as the naturally aligned block its mask describes, which is what firmware always programs
+    PhysMask &= AddressMask;
+    UINT64 RangeSize = PhysMask & (~PhysMask + 1);
+    UINT64 RangeBase = ReadMsr(MSR_MTRR_PHYSBASE(i)) & PhysMask;
+    UINT64 Larger = (RangeSize > BlockSize) ? RangeSize : BlockSize;
+
+    if((RangeSize == 0) || ((RangeBase & ~(Larger - 1)) == (BlockBase & ~(Larger - 1))))
+    {
+      return 0;
+    }
+  }
+
+  for(EFI_MEMORY_DESCRIPTOR * Piece = MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
+  {
+    EFI_PHYSICAL_ADDRESS PieceEnd = Piece->PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT);
+
+    if((Piece->PhysicalStart < BlockBase + BlockSize) && (PieceEnd > BlockBase) && (Piece->Type != EfiMemoryMappedIO)
+        && (Piece->Type != EfiMemoryMappedIOPortSpace) && (Piece->Type != EfiReservedMemoryType))
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+#endif
+
+//==================================================================================================================================
+//  PlanFrameBufferCaching: Decide Each Framebuffer's Memory Type
+//==================================================================================================================================
+//
+// Allocate Graphics->FrameBufferCaching and fill it in. This needs boot services, so it runs before ExitBootServices(), and
+// ApplyFrameBufferCaching() does the actual MSR writes afterwards. LoaderPageTables is 1 if the loader-built page tables are going to be
+// loaded, since only then is there a way to use the PAT.
+//
+// Without FRAMEBUFFER_WRITE_COMBINING_ENABLED this just records what the MTRRs say. With it, each framebuffer that isn't already WC gets
+// a variable MTRR covering the smallest naturally aligned power of 2 that contains it. A framebuffer always lives inside a single PCI
+// BAR, which is itself a naturally aligned power of 2, so that block never sticks out past the end of the BAR the way rounding the size
+// up would. If that doesn't work (the CPU has no WC MTRRs, they're all taken, or something is in the way), the framebuffer falls back to
+// PAT entry 4 in the loader-built page tables, or, without those, stays whatever firmware made it.
+//
+
+EFI_STATUS PlanFrameBufferCaching(GPU_CONFIG * Graphics, UINT8 LoaderPageTables)
+{
+  EFI_STATUS caching_status;
+  UINT32 Eax, Ebx, Ecx, Edx;
+  UINT32 VariableMtrrs = 0;
+  UINT64 AddressMask = PhysicalAddressMask();
+
+  caching_status = BS->AllocatePool(EfiLoaderData, Graphics->NumberOfFrameBuffers * sizeof(FRAMEBUFFER_CACHING), (void**)&Graphics->FrameBufferCaching);
+  if(EFI_ERROR(caching_status))
+  {
+    Print(L"FrameBufferCaching AllocatePool error. 0x%llx\r\n", caching_status);
+    return caching_status;
+  }
+  ZeroMem(Graphics->FrameBufferCaching, Graphics->NumberOfFrameBuffers * sizeof(FRAMEBUFFER_CACHING));
+
+  CpuId(CPUID_FEATURES, 0, &Eax, &Ebx, &Ecx, &Edx);
+  UINT8 HasMtrrs = (Edx & CPUID_FEATURES_EDX_MTRR) != 0;
+  UINT64 MtrrCap = 0;
+  if(HasMtrrs)
+  {
+    MtrrCap = ReadMsr(MSR_MTRRCAP);
+    VariableMtrrs = (UINT32)(MtrrCap & MTRRCAP_VCNT_MASK);
+  }
+
+#ifdef FRAMEBUFFER_WRITE_COMBINING_ENABLED
+  UINTN MemMapSize = 0, MemMapDescriptorSize = 0;
+  EFI_MEMORY_DESCRIPTOR * MemMap = NULL;
+  UINT8 CanAddMtrrs = HasMtrrs && (MtrrCap & MTRRCAP_WC) && (ReadMsr(MSR_MTRR_DEF_TYPE) & MTRR_DEF_TYPE_E);
+
+  if(CanAddMtrrs)
+  {
+    caching_status = GetMemoryMapCopy(&MemMap, &MemMapSize, &MemMapDescriptorSize);
+    if(EFI_ERROR(caching_status))
+    {
+      // Not worth failing the boot over, there's still the PAT
+      CanAddMtrrs = 0;
+    }
+  }
+
+  UINT32 NextMtrr = 0;
+  FrameBufferMtrrsPlanned = 0;
+  FrameBufferPatPlanned = LoaderPageTables; // Paging.c maps all framebuffers through PAT entry 4
+#else
+  (VOID)LoaderPageTables; // Only matters for the PAT
+#endif
+
+  for(UINT64 k = 0; k < Graphics->NumberOfFrameBuffers; k++)
+  {
+    FRAMEBUFFER_CACHING * Caching = &Graphics->FrameBufferCaching[k];
+    EFI_PHYSICAL_ADDRESS Base = Graphics->GPUArray[k].FrameBufferBase;
+
+    Caching->MemoryType = HasMtrrs ? MtrrMemoryType(Base, VariableMtrrs, AddressMask) : MEMORY_TYPE_UC;
+    Caching->Method = FRAMEBUFFER_CACHING_FIRMWARE;
+
+#ifdef FRAMEBUFFER_WRITE_COMBINING_ENABLED
+    UINT64 Size = Graphics->GPUArray[k].FrameBufferSize;
+    if((Caching->MemoryType == MEMORY_TYPE_WC) || (Size == 0))
+    {
+      continue;
+    }
+
+    UINT64 BlockSize = EFI_PAGE_SIZE;
+    while(((Base & ~(BlockSize - 1)) + BlockSize < Base + Size) && (BlockSize & AddressMask))
+    {
+      BlockSize <<= 1;
+    }
+    EFI_PHYSICAL_ADDRESS BlockBase = Base & ~(BlockSize - 1);
+
+    // Two framebuffers can share a BAR, and so an MTRR
+    for(UINT64 j = 0; j < k; j++)
+    {
+      FRAMEBUFFER_CACHING * Earlier = &Graphics->FrameBufferCaching[j];
+      if((Earlier->Method == FRAMEBUFFER_CACHING_MTRR) && (Earlier->MtrrBase == BlockBase) && (Earlier->MtrrSize == BlockSize))
+      {
+        *Caching = *Earlier;
+        break;
+      }
+    }
+    if(Caching->Method == FRAMEBUFFER_CACHING_MTRR)
+    {
+      continue;
+    }
+
+    if(CanAddMtrrs && (BlockSize & AddressMask) && FrameBufferMtrrFits(BlockBase, BlockSize, VariableMtrrs, AddressMask, MemMap, MemMapSize, MemMapDescriptorSize))
+    {
+      // Find a free one. ApplyFrameBufferCaching() makes them valid, so skip past any this loop already took.
+      while((NextMtrr < VariableMtrrs) && (ReadMsr(MSR_MTRR_PHYSMASK(NextMtrr)) & MTRR_PHYSMASK_VALID))
+      {
+        NextMtrr++;
+      }
+
+      if(NextMtrr < VariableMtrrs)
+      {
+        Caching->MemoryType = MEMORY_TYPE_WC;
+        Caching->Method = FRAMEBUFFER_CACHING_MTRR;
+        Caching->MtrrIndex = (UINT16)NextMtrr;
+        Caching->MtrrBase = BlockBase;
+        Caching->MtrrSize = BlockSize;
+        FrameBufferMtrrsPlanned = 1;
+        NextMtrr++;
+        continue;
+      }
+    }
+
+    // Out of MTRRs, or one couldn't be used here. The PAT overrides whatever the MTRRs say.
+    if(LoaderPageTables)
+    {
+      Caching->MemoryType = MEMORY_TYPE_WC;
+      Caching->Method = FRAMEBUFFER_CACHING_PAT;
+    }
+#endif
+  }
+
+#ifdef FRAMEBUFFER_WRITE_COMBINING_ENABLED
+  if(MemMap != NULL)
+  {
+    caching_status = BS->FreePool(MemMap);
+    if(EFI_ERROR(caching_status))
+    {
+      Print(L"Error freeing caching MemMap pool. 0x%llx\r\n", caching_status);
+      return caching_status;
+    }
+  }
+#endif
+
+  for(UINT64 k = 0; k < Graphics->NumberOfFrameBuffers; k++)
+  {
+    LOG_MESSAGE(HANDOFF, DEBUG, L"Framebuffer %llu at 0x%llx: memory type %u, method %u", k, Graphics->GPUArray[k].FrameBufferBase, (UINT32)Graphics->FrameBufferCaching[k].MemoryType, (UINT32)Graphics->FrameBufferCaching[k].Method);
+  }
+
+  return EFI_SUCCESS;
+}
+
+#ifdef FRAMEBUFFER_WRITE_COMBINING_ENABLED
+//==================================================================================================================================
+//  ApplyFrameBufferCaching: Program The MTRRs And PAT
+//==================================================================================================================================
+//
+// Write the MTRRs PlanFrameBufferCaching() picked and set PAT entry 4 to WC, following the SDM's procedure for changing memory types
+// (Vol. 3A 11.11.7.2): caches off and flushed, TLBs flushed, MTRRs off while they change, then everything back on and flushed again.
+// Meant to be called after ExitBootServices() and LoadPageTables(), right before jumping to the kernel.
+//
+
+VOID ApplyFrameBufferCaching(GPU_CONFIG * Graphics)
+{
+  if(!FrameBufferMtrrsPlanned && !FrameBufferPatPlanned)
+  {
+    return;
+  }
+
+  UINT64 AddressMask = PhysicalAddressMask();
+  UINT64 Flags = DisableInterrupts();
+  UINT64 Cr0 = ReadCr0();
+  UINT64 Cr4 = ReadCr4();
+
+  WriteCr0((Cr0 | CR0_CD) & ~CR0_NW);
+  WriteBackInvalidateCaches();
+
+  // Turning off CR4.PGE flushes global pages too, which reloading CR3 doesn't
+  if(Cr4 & CR4_PGE)
+  {
+    WriteCr4(Cr4 & ~CR4_PGE);
+  }
+  else
+  {
+    WriteCr3(ReadCr3());
+  }
+
+  if(FrameBufferMtrrsPlanned)
+  {
+    UINT64 DefType = ReadMsr(MSR_MTRR_DEF_TYPE);
+    WriteMsr(MSR_MTRR_DEF_TYPE, DefType & ~MTRR_DEF_TYPE_E);
+
+    for(UINT64 k = 0; k < Graphics->NumberOfFrameBuffers; k++)
+    {
+      FRAMEBUFFER_CACHING * Caching = &Graphics->FrameBufferCaching[k];
+      if(Caching->Method == FRAMEBUFFER_CACHING_MTRR)
+      {
+        WriteMsr(MSR_MTRR_PHYSBASE(Caching->MtrrIndex), Caching->MtrrBase | MEMORY_TYPE_WC);
+        WriteMsr(MSR_MTRR_PHYSMASK(Caching->MtrrIndex), (~(Caching->MtrrSize - 1) & AddressMask) | MTRR_PHYSMASK_VALID);
+      }
+    }
+
+    WriteMsr(MSR_MTRR_DEF_TYPE, DefType);
+  }
+
+  if(FrameBufferPatPlanned)
+  {
+    // Entry 4 is the one with PAT = 1, PCD = 0, PWT = 0. It's WB by default, and firmware page tables don't use the PAT bit.
+    WriteMsr(MSR_PAT, (ReadMsr(MSR_PAT) & ~(0xFFULL << 32)) | ((UINT64)MEMORY_TYPE_WC << 32));
+  }
+
+  WriteBackInvalidateCaches();
+  WriteCr3(ReadCr3());
+  WriteCr0(Cr0);
+  if(Cr4 & CR4_PGE)
+  {
+    WriteCr4(Cr4);
+  }
+
+  RestoreInterrupts(Flags);
+}
+#endif
@@ -0,0 +1,770 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Kernel64.txt Parser
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This file contains the Kernel64.txt parser. It reads the file once, front to back, one character at a time, and doesn't allocate
+// anything: names, paths and options come out as LOADER_CONFIG_SPANs that point back into the file, already measured in UTF-16 units
+// so the caller can allocate each string exactly once. The file can be UTF-8 (with or without a BOM) or UTF-16LE.
+//
+// Nothing in here calls into firmware, so tools/ConfigFuzz builds this same file on the host to fuzz and benchmark it.
+//
+
+#include "Bootloader.h"
+
+#define CONFIG_END              0xFFFFFFFF // ConfigNextChar() ran out of file
+#define CONFIG_REPLACEMENT_CHAR 0xFFFD     // What malformed UTF-8 and unpaired surrogates turn into
+#define CONFIG_WORD_SIZE        16         // Keys and short values get a lowercase ASCII copy this big for matching
+
+// Where ParseLoaderConfig() is within a line
+#define CONFIG_LINE_START       0
+#define CONFIG_SECTION          1 // After '['
+#define CONFIG_SECTION_END      2 // After ']'
+#define CONFIG_KEY              3
+#define CONFIG_BEFORE_EQUALS    4 // Spaces between a key and its '='
+#define CONFIG_VALUE            5
+#define CONFIG_SKIP             6 // Comments and lines with mistakes in them
+#define CONFIG_V1_OPTIONS       7 // The second line of a v1 file, taken exactly as written
+
+// A piece of a line that's being measured as it goes by
+typedef struct {
+  LOADER_CONFIG_SPAN Span;     // Trimmed so far, i.e. up to the last non-space character
+  UINT64             Units;    // Including spaces since the last non-space character
+  CHAR8              Word[CONFIG_WORD_SIZE];
+  UINT32             WordLength; // Trimmed; more than CONFIG_WORD_SIZE means it didn't fit
+  UINT32             WordChars;  // Including spaces since the last non-space character
+  UINT8              Started;
+} CONFIG_FIELD;
+
+//==================================================================================================================================
+//  ConfigNextChar: Decode One Character
+//==================================================================================================================================
+//
+// Return the Unicode code point at *Position and move *Position past it, or return CONFIG_END at the end of the file. Malformed UTF-8
+// (overlong, truncated, surrogates) and unpaired UTF-16 surrogates come out as U+FFFD, one byte or unit at a time, so every byte of
+// the file is consumed exactly once no matter what's in it.
+//
+
+STATIC UINT32 ConfigNextChar(CONST UINT8 * File, UINT64 FileSize, UINT32 Encoding, UINT64 * Position)
+{
+  UINT64 i = *Position;
+
+  if(Encoding == LOADER_CONFIG_UTF16)
+  {
+    if(i + 1 >= FileSize) // Including a stray last byte
+    {
+      *Position = FileSize;
+      return CONFIG_END;
+    }
+
+    UINT32 Char = File[i] | ((UINT32)File[i + 1] << 8);
+    *Position = i + 2;
+
+    if(((Char & 0xFC00) == 0xD800) && (i + 3 < FileSize))
+    {
+      UINT32 Low = File[i + 2] | ((UINT32)File[i + 3] << 8);
+      if((Low & 0xFC00) == 0xDC00)
+      {
+        *Position = i + 4;
+        return 0x10000 + ((Char - 0xD800) << 10) + (Low - 0xDC00);
+      }
+    }
+
+    return ((Char & 0xF800) == 0xD800) ? CONFIG_REPLACEMENT_CHAR : Char;
+  }
+
+  if(i >= FileSize)
+  {
+    return CONFIG_END;
+  }
+
+  UINT32 Lead = File[i];
+  *Position = i + 1;
+  if(Lead < 0x80)
+  {
+    return Lead;
+  }
+
+  UINT32 Count, Minimum, Char;
+  if((Lead & 0xE0) == 0xC0)
+  {
+    Count = 1;
+    Minimum = 0x80;
+    Char = Lead & 0x1F;
+  }
+  else if((Lead & 0xF0) == 0xE0)
+  {
+    Count = 2;
+    Minimum = 0x800;
+    Char = Lead & 0x0F;
+  }
+  else if((Lead & 0xF8) == 0xF0)
+  {
+    Count = 3;
+    Minimum = 0x10000;
+    Char = Lead & 0x07;
+  }
+  else
+  {
+    return CONFIG_REPLACEMENT_CHAR; // A continuation byte on its own, or 0xF8 - 0xFF
+  }
+
+  if(i + Count >= FileSize)
+  {
+    return CONFIG_REPLACEMENT_CHAR;
+  }
+
+  for(UINT32 k = 1; k <= Count; k++)
+  {
+    if((File[i + k] & 0xC0) != 0x80)
+    {
+      return CONFIG_REPLACEMENT_CHAR;
+    }
+    Char = (Char << 6) | (File[i + k] & 0x3F);
+  }
+
+  if((Char < Minimum) || (Char > 0x10FFFF) || ((Char & 0xFFFFF800) == 0xD800))
+  {
+    return CONFIG_REPLACEMENT_CHAR;
+  }
+
+  *Position = i + 1 + Count;
+  return Char;
+}
+
+//==================================================================================================================================
+//  ConfigFieldStart: Start Measuring A Field
+//==================================================================================================================================
+//
+// Fields start at their first non-space character, which is found by ConfigFieldAdd().
+//
+
+STATIC VOID ConfigFieldStart(CONFIG_FIELD * Field, UINT32 Flags)
+{
+  Field->Span.Offset = 0;
+  Field->Span.Bytes = 0;
+  Field->Span.Length = 0;
+  Field->Span.Flags = Flags;
+  Field->Units = 0;
+  Field->WordLength = 0;
+  Field->WordChars = 0;
+  Field->Started = 0;
+}
+
+//==================================================================================================================================
+//  ConfigFieldAdd: Add A Character To A Field
+//==================================================================================================================================
+//
+// Char is the character that started at byte Start and ends right before byte End. Spaces only count once something comes after
+// them (unless KeepSpaces is set), and with LOADER_CONFIG_SPAN_NO_SPACES they never count toward the converted length at all.
+//
+
+STATIC VOID ConfigFieldAdd(CONFIG_FIELD * Field, UINT32 Char, UINT64 Start, UINT64 End, UINT8 KeepSpaces)
+{
+  UINT8 Space = (Char == ' ') || (Char == '\t');
+
+  if(!Field->Started)
+  {
+    if(Space && !KeepSpaces)
+    {
+      return;
+    }
+    Field->Started = 1;
+    Field->Span.Offset = (UINT32)Start;
+  }
+
+  if(!(Space && (Field->Span.Flags & LOADER_CONFIG_SPAN_NO_SPACES)))
+  {
+    Field->Units += (Char >= 0x10000) ? 2 : 1;
+  }
+
+  if(Field->WordChars < CONFIG_WORD_SIZE)
+  {
+    Field->Word[Field->WordChars] = ((Char >= 'A') && (Char <= 'Z')) ? (CHAR8)(Char + ('a' - 'A')) : ((Char < 0x80) ? (CHAR8)Char : '?');
+  }
+  Field->WordChars++;
+
+  if(!Space || KeepSpaces)
+  {
+    Field->Span.Bytes = (UINT32)(End - Field->Span.Offset);
+    Field->Span.Length = (UINT32)Field->Units;
+    Field->WordLength = Field->WordChars;
+  }
+}
+
+//==================================================================================================================================
+//  ConfigWordIs: Match A Keyword
+//==================================================================================================================================
+//
+// Compare a field's lowercase ASCII copy with Word, which has to be lowercase too.
+//
+
+STATIC UINT8 ConfigWordIs(CONST CONFIG_FIELD * Field, CONST char * Word)
+{
+  UINT32 i = 0;
+
+  if(Field->WordLength > CONFIG_WORD_SIZE)
+  {
+    return 0;
+  }
+
+  while((i < Field->WordLength) && (Word[i] != '\0'))
+  {
+    if(Field->Word[i] != Word[i])
+    {
+      return 0;
+    }
+    i++;
+  }
+
+  return (i == Field->WordLength) && (Word[i] == '\0');
+}
+
+//==================================================================================================================================
+//  ConfigWordNumber: Read A Decimal Number
+//==================================================================================================================================
+//
+// Read digits from Word[*Index] on, stopping at the first non-digit, into *Number. Returns 0 if there weren't any digits, or too many.
+//
+
+STATIC UINT8 ConfigWordNumber(CONST CONFIG_FIELD * Field, UINT32 * Index, UINT32 * Number)
+{
+  UINT32 Start = *Index;
+
+  *Number = 0;
+  if(Field->WordLength > CONFIG_WORD_SIZE)
+  {
+    return 0;
+  }
+
+  while((*Index < Field->WordLength) && (Field->Word[*Index] >= '0') && (Field->Word[*Index] <= '9'))
+  {
+    *Number = *Number * 10 + (UINT32)(Field->Word[*Index] - '0');
+    (*Index)++;
+  }
+
+  return (*Index != Start) && (*Index - Start <= 9);
+}
+
+//==================================================================================================================================
+//  ConfigNewEntry: Start A Boot Entry
+//==================================================================================================================================
+//
+// Entries only get zeroed once they're used, since most files have far fewer than LOADER_CONFIG_MAX_ENTRIES. The caller checks that
+// there's room.
+//
+
+STATIC LOADER_CONFIG_ENTRY * ConfigNewEntry(LOADER_CONFIG * Config, UINT32 Line)
+{
+  LOADER_CONFIG_ENTRY * Entry = &Config->Entries[Config->NumberOfEntries++];
+
+  for(UINT64 i = 0; i < sizeof(LOADER_CONFIG_ENTRY); i++)
+  {
+    ((UINT8*)Entry)[i] = 0;
+  }
+  Entry->Line = Line;
+
+  return Entry;
+}
+
+//==================================================================================================================================
+//  ApplyConfigSetting: Use One key = value Line
+//==================================================================================================================================
+//
+// Store Value where Key says it goes. Entry keys before the first [name] make an unnamed entry to put them in. Returns 0 if the line
+// doesn't make sense, which ParseLoaderConfig() reports in ErrorLine.
+//
+
+STATIC UINT8 ApplyConfigSetting(LOADER_CONFIG * Config, LOADER_CONFIG_ENTRY ** Entry, CONST CONFIG_FIELD * Key, CONST CONFIG_FIELD * Value, UINT32 Line, LOADER_CONFIG_SPAN * DefaultName, UINT32 * DefaultLine)
+{
+  UINT32 Index = 0;
+  UINT32 Number;
+
+  // Global settings
+  if(ConfigWordIs(Key, "timeout") || ConfigWordIs(Key, "gop_timeout"))
+  {
+    if(!ConfigWordNumber(Value, &Index, &Number) || (Index != Value->WordLength))
+    {
+      return 0;
+    }
+
+    if(ConfigWordIs(Key, "timeout"))
+    {
+      Config->Timeout = Number;
+    }
+    else
+    {
+      Config->GopTimeout = Number;
+    }
+    return 1;
+  }
+
+  if(ConfigWordIs(Key, "gop"))
+  {
+    UINT32 Width, Height;
+
+    if(ConfigWordIs(Value, "menu"))
+    {
+      Config->Gop = LOADER_CONFIG_GOP_MENU;
+    }
+    else if(ConfigWordIs(Value, "native"))
+    {
+      Config->Gop = LOADER_CONFIG_GOP_NATIVE;
+    }
+    else if(ConfigWordNumber(Value, &Index, &Width) && (Index < Value->WordLength) && (Value->Word[Index++] == 'x')
+            && ConfigWordNumber(Value, &Index, &Height) && (Index == Value->WordLength) && Width && Height)
+    {
+      Config->Gop = LOADER_CONFIG_GOP_RESOLUTION;
+      Config->GopWidth = Width;
+      Config->GopHeight = Height;
+    }
+    else
+    {
+      return 0;
+    }
+    return 1;
+  }
+
+  if(ConfigWordIs(Key, "default"))
+  {
+    *DefaultName = Value->Span;
+    *DefaultLine = Line;
+    return 1;
+  }
+
+  // Everything else belongs to an entry
+  if(*Entry == NULL)
+  {
+    if(Config->NumberOfEntries != 0)
+    {
+      return 0; // Only after too many [name]s
+    }
+    *Entry = ConfigNewEntry(Config, Line);
+  }
+
+  if(ConfigWordIs(Key, "kernel"))
+  {
+    (*Entry)->Kernel = Value->Span;
+    return Value->Span.Bytes != 0;
+  }
+
+  if(ConfigWordIs(Key, "options"))
+  {
+    (*Entry)->Options = Value->Span;
+    return 1;
+  }
+
+  if(ConfigWordIs(Key, "module"))
+  {
+    if((Value->Span.Bytes == 0) || ((*Entry)->NumberOfModules == LOADER_CONFIG_MAX_MODULES))
+    {
+      return 0;
+    }
+    (*Entry)->Modules[(*Entry)->NumberOfModules++] = Value->Span;
+    return 1;
+  }
+
+  if(ConfigWordIs(Key, "placement"))
+  {
+    if(ConfigWordIs(Value, "default"))
+    {
+      (*Entry)->Placement = LOADER_PLACEMENT_DEFAULT;
+    }
+    else if(ConfigWordIs(Value, "below4g"))
+    {
+      (*Entry)->Placement = LOADER_PLACEMENT_BELOW_4GB;
+    }
+    else
+    {
+      return 0;
+    }
+    return 1;
+  }
+
+  return 0;
+}
+
+//==================================================================================================================================
+//  ParseLoaderConfig: Parse Kernel64.txt
+//==================================================================================================================================
+//
+// Fill in Config from the FileSize bytes at File, which has to stay around for as long as Config's spans get used. Two formats work:
+//
+// v1 is the original: the kernel path on the first line (spaces get dropped) and the kernel's options on the second, with anything
+// after that ignored. A file is v1 if its first line isn't blank, a comment, or a [name], and doesn't have an '=' in it.
+//
+// v2 is key = value lines, with [name] lines starting boot entries; see the Kernel64.txt section at the top of Bootloader.c.
+//
+// Lines that don't make sense get skipped, and the first one ends up in ErrorLine. Returns EFI_UNSUPPORTED for big-endian UTF-16,
+// EFI_BAD_BUFFER_SIZE for files over 4GB, and EFI_NOT_FOUND if no entry has a kernel.
+//
+
+EFI_STATUS ParseLoaderConfig(CONST VOID * File, UINT64 FileSize, LOADER_CONFIG * Config)
+{
+  CONST UINT8 * Bytes = (CONST UINT8*)File;
+  UINT64 Position = 0;
+
+  Config->File = Bytes;
+  Config->FileSize = FileSize;
+  Config->Encoding = LOADER_CONFIG_UTF8;
+  Config->Version = 0;
+  Config->Timeout = LOADER_CONFIG_DEFAULT_TIMEOUT;
+  Config->GopTimeout = LOADER_CONFIG_DEFAULT_GOP_TIMEOUT;
+  Config->Gop = LOADER_CONFIG_GOP_MENU;
+  Config->GopWidth = 1024;
+  Config->GopHeight = 768;
+  Config->DefaultEntry = 0;
+  Config->SelectedEntry = 0;
+  Config->NumberOfEntries = 0;
+  Config->ErrorLine = 0;
+  Config->Reserved = 0;
+
+  if(FileSize > 0xFFFFFFFF)
+  {
+    return EFI_BAD_BUFFER_SIZE;
+  }
+
+  // Byte order marks, or a good guess at UTF-16 without one (ASCII in UTF-16LE starts with a 0 as its second byte)
+  if((FileSize >= 2) && (Bytes[0] == 0xFF) && (Bytes[1] == 0xFE))
+  {
+    Config->Encoding = LOADER_CONFIG_UTF16;
+    Position = 2;
+  }
+  else if((FileSize >= 2) && (Bytes[0] == 0xFE) && (Bytes[1] == 0xFF))
+  {
+    Config->Encoding = LOADER_CONFIG_UTF16;
+    return EFI_UNSUPPORTED;
+  }
+  else if((FileSize >= 3) && (Bytes[0] == 0xEF) && (Bytes[1] == 0xBB) && (Bytes[2] == 0xBF))
+  {
+    Config->Encoding = LOADER_CONFIG_UTF8;
+    Position = 3;
+  }
+  else if((FileSize >= 2) && (Bytes[0] != 0) && (Bytes[1] == 0))
+  {
+    Config->Encoding = LOADER_CONFIG_UTF16;
+  }
+  else
+  {
+    Config->Encoding = LOADER_CONFIG_UTF8;
+  }
+
+  LOADER_CONFIG_ENTRY * Entry = NULL;
+  LOADER_CONFIG_SPAN DefaultName = {0};
+  UINT32 DefaultLine = 0;
+
+  CONFIG_FIELD Key, Value, WholeLine;
+  UINT32 State = CONFIG_LINE_START;
+  UINT32 Line = 1;
+  UINT8 LineError = 0;
+  UINT8 SawEquals = 0;
+  UINT8 AfterCR = 0;
+
+  ConfigFieldStart(&WholeLine, LOADER_CONFIG_SPAN_NO_SPACES);
+
+  for(;;)
+  {
+    UINT64 Start = Position;
+    UINT32 Char;
+
+    // Plain ASCII is almost all of any real file, so it skips the decoder
+    if((Config->Encoding == LOADER_CONFIG_UTF8) && (Position < FileSize) && (Bytes[Position] < 0x80))
+    {
+      Char = Bytes[Position++];
+    }
+    else
+    {
+      Char = ConfigNextChar(Bytes, FileSize, Config->Encoding, &Position);
+    }
+
+    if((Char == '\n') && AfterCR)
+    {
+      AfterCR = 0;
+      continue; // The rest of a CRLF
+    }
+    AfterCR = (Char == '\r');
+
+    if((Char != '\n') && (Char != '\r') && (Char != CONFIG_END))
+    {
+      if(State == CONFIG_V1_OPTIONS)
+      {
+        ConfigFieldAdd(&Value, Char, Start, Position, 1);
+        continue;
+      }
+
+      if(Line == 1)
+      {
+        ConfigFieldAdd(&WholeLine, Char, Start, Position, 0);
+        SawEquals |= (Char == '=');
+      }
+
+      UINT8 Space = (Char == ' ') || (Char == '\t');
+      UINT8 KeyChar = ((Char >= 'a') && (Char <= 'z')) || ((Char >= 'A') && (Char <= 'Z')) || ((Char >= '0') && (Char <= '9')) || (Char == '_') || (Char == '.') || (Char == '-');
+
+      switch(State)
+      {
+        case CONFIG_LINE_START:
+          if(Space)
+          {
+            break;
+          }
+          if((Char == '#') || (Char == ';'))
+          {
+            State = CONFIG_SKIP;
+          }
+          else if(Char == '[')
+          {
+            ConfigFieldStart(&Key, 0);
+            State = CONFIG_SECTION;
+          }
+          else if(KeyChar)
+          {
+            ConfigFieldStart(&Key, 0);
+            ConfigFieldAdd(&Key, Char, Start, Position, 0);
+            State = CONFIG_KEY;
+          }
+          else
+          {
+            LineError = 1;
+            State = CONFIG_SKIP;
+          }
+          break;
+
+        case CONFIG_SECTION:
+          if(Char == ']')
+          {
+            State = CONFIG_SECTION_END;
+          }
+          else
+          {
+            ConfigFieldAdd(&Key, Char, Start, Position, 0);
+          }
+          break;
+
+        case CONFIG_SECTION_END:
+          if((Char == '#') || (Char == ';'))
+          {
+            State = CONFIG_SKIP;
+          }
+          else if(!Space)
+          {
+            LineError = 1;
+          }
+          break;
+
+        case CONFIG_KEY:
+        case CONFIG_BEFORE_EQUALS:
+          if(Char == '=')
+          {
+            ConfigFieldStart(&Value, 0);
+            State = CONFIG_VALUE;
+          }
+          else if(Space)
+          {
+            State = CONFIG_BEFORE_EQUALS;
+          }
+          else if(KeyChar && (State == CONFIG_KEY))
+          {
+            ConfigFieldAdd(&Key, Char, Start, Position, 0);
+          }
+          else
+          {
+            LineError = 1;
+            State = CONFIG_SKIP;
+          }
+          break;
+
+        case CONFIG_VALUE:
+          ConfigFieldAdd(&Value, Char, Start, Position, 0);
+          break;
+
+        default: // CONFIG_SKIP
+          break;
+      }
+      continue;
+    }
+
+    // End of a line
+    if(State == CONFIG_V1_OPTIONS)
+    {
+      Config->Entries[0].Options = Value.Span;
+      break; // The rest of a v1 file can be anything
+    }
+
+    if((Line == 1) && WholeLine.Started && !SawEquals && (State != CONFIG_SECTION_END) && (State != CONFIG_SKIP || LineError))
+    {
+      Config->Version = 1;
+      ConfigNewEntry(Config, 1)->Kernel = WholeLine.Span;
+      ConfigFieldStart(&Value, 0);
+      State = CONFIG_V1_OPTIONS;
+    }
+    else
+    {
+      if((State == CONFIG_SECTION_END) || (State == CONFIG_SECTION))
+      {
+        Entry = NULL; // Keys after a bad [name] don't go in the entry before it
+        if(State == CONFIG_SECTION)
+        {
+          LineError = 1; // No ']'
+        }
+        else if(!LineError)
+        {
+          if(Config->NumberOfEntries == LOADER_CONFIG_MAX_ENTRIES)
+          {
+            Entry = NULL;
+            LineError = 1;
+          }
+          else
+          {
+            Entry = ConfigNewEntry(Config, Line);
+            Entry->Name = Key.Span;
+          }
+        }
+      }
+      else if(State == CONFIG_VALUE)
+      {
+        if(!ApplyConfigSetting(Config, &Entry, &Key, &Value, Line, &DefaultName, &DefaultLine))
+        {
+          LineError = 1;
+        }
+      }
+      else if((State == CONFIG_KEY) || (State == CONFIG_BEFORE_EQUALS))
+      {
+        LineError = 1; // No '='
+      }
+
+      if(LineError && !Config->ErrorLine)
+      {
+        Config->ErrorLine = Line;
+      }
+      State = CONFIG_LINE_START;
+    }
+
+    if(Char == CONFIG_END)
+    {
+      if(State == CONFIG_V1_OPTIONS)
+      {
+        Config->Entries[0].Options = Value.Span; // No second line at all
+      }
+      break;
+    }
+
+    Line++;
+    LineError = 0;
+  }
+
+  if(!Config->Version)
+  {
+    Config->Version = 2;
+  }
+
+  // Entries have to have a kernel
+  UINT32 Kept = 0;
+  for(UINT32 i = 0; i < Config->NumberOfEntries; i++)
+  {
+    if(Config->Entries[i].Kernel.Bytes == 0)
+    {
+      if(!Config->ErrorLine || (Config->Entries[i].Line < Config->ErrorLine))
+      {
+        Config->ErrorLine = Config->Entries[i].Line;
+      }
+      continue;
+    }
+    if(Kept != i)
+    {
+      Config->Entries[Kept] = Config->Entries[i];
+    }
+    Kept++;
+  }
+  Config->NumberOfEntries = Kept;
+
+  if(!Config->NumberOfEntries)
+  {
+    return EFI_NOT_FOUND;
+  }
+
+  // The default's matched by name, exactly as written
+  if(DefaultLine)
+  {
+    UINT32 i;
+    for(i = 0; i < Config->NumberOfEntries; i++)
+    {
+      LOADER_CONFIG_SPAN * Name = &Config->Entries[i].Name;
+      UINT32 k = 0;
+
+      if(Name->Bytes != DefaultName.Bytes)
+      {
+        continue;
+      }
+      while((k < Name->Bytes) && (Bytes[Name->Offset + k] == Bytes[DefaultName.Offset + k]))
+      {
+        k++;
+      }
+      if(k == Name->Bytes)
+      {
+        break;
+      }
+    }
+
+    if(i < Config->NumberOfEntries)
+    {
+      Config->DefaultEntry = i;
+    }
+    else if(!Config->ErrorLine || (DefaultLine < Config->ErrorLine))
+    {
+      Config->ErrorLine = DefaultLine;
+    }
+  }
+  Config->SelectedEntry = Config->DefaultEntry;
+
+  return EFI_SUCCESS;
+}
+
+//==================================================================================================================================
+//  ConfigSpanToChar16: Convert A Span To UTF-16
+//==================================================================================================================================
+//
+// Write Span as a null-terminated UTF-16 string to String, which needs room for Span->Length + 1 CHAR16s. Returns the number of
+// CHAR16s written, not counting the null terminator, which is always Span->Length.
+//
+
+UINT64 ConfigSpanToChar16(CONST LOADER_CONFIG * Config, CONST LOADER_CONFIG_SPAN * Span, CHAR16 * String)
+{
+  UINT64 Position = Span->Offset;
+  UINT64 End = (UINT64)Span->Offset + Span->Bytes;
+  UINT64 Length = 0;
+
+  while((Position < End) && (Length < Span->Length))
+  {
+    UINT32 Char = ConfigNextChar(Config->File, End, Config->Encoding, &Position);
+
+    if((Char == CONFIG_END) || (((Char == ' ') || (Char == '\t')) && (Span->Flags & LOADER_CONFIG_SPAN_NO_SPACES)))
+    {
+      continue;
+    }
+
+    if(Char >= 0x10000)
+    {
+      if(Length + 2 > Span->Length)
+      {
+        break;
+      }
+      String[Length++] = (CHAR16)(0xD800 + ((Char - 0x10000) >> 10));
+      String[Length++] = (CHAR16)(0xDC00 + ((Char - 0x10000) & 0x3FF));
+    }
+    else
+    {
+      String[Length++] = (CHAR16)Char;
+    }
+  }
+
+  String[Length] = L'\0';
+  return Length;
+}
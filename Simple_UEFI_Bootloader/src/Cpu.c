@@ -0,0 +1,503 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: CPU Functions
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This file contains functions for querying and setting up the processor the bootloader is running on.
+//
+
+#include "Bootloader.h"
+
+#define TSC_CALIBRATION_MICROSECONDS 10000
+
+// If a timer reads the same this many times in a row, it isn't running
+#define TSC_CALIBRATION_STUCK_READS  1000000
+
+STATIC UINT64 TscFrequency = 0;
+STATIC UINT32 TscFrequencySource = 0;
+
+//==================================================================================================================================
+//  TscFrequencyFromCpuid: Get The TSC Frequency Straight From The CPU
+//==================================================================================================================================
+//
+// Newer Intel CPUs say what the TSC frequency is in CPUID leaf 0x15: it ticks at crystal frequency * EBX / EAX. Some of them leave the
+// crystal frequency out, but then the TSC runs at the base frequency, which is in leaf 0x16. Returns 0 if the CPU doesn't say.
+//
+
+STATIC UINT64 TscFrequencyFromCpuid(VOID)
+{
+  UINT32 Eax, Ebx, Ecx, Edx;
+
+  CpuId(CPUID_MAX_LEAF, 0, &Eax, &Ebx, &Ecx, &Edx);
+  UINT32 MaxLeaf = Eax;
+
+  if(MaxLeaf < CPUID_TSC_CRYSTAL)
+  {
+    return 0;
+  }
+
+  CpuId(CPUID_TSC_CRYSTAL, 0, &Eax, &Ebx, &Ecx, &Edx);
+  if((Eax == 0) || (Ebx == 0))
+  {
+    return 0;
+  }
+
+  if(Ecx != 0)
+  {
+    return ((UINT64)Ecx * Ebx) / Eax;
+  }
+
+  if(MaxLeaf >= CPUID_FREQUENCY)
+  {
+    CpuId(CPUID_FREQUENCY, 0, &Eax, &Ebx, &Ecx, &Edx);
+    if(Eax != 0)
+    {
+      return (UINT64)Eax * 1000000ULL;
+    }
+  }
+
+  return 0;
+}
+
+//==================================================================================================================================
+//  TscFrequencyFromHpet: Measure The TSC Against The HPET
+//==================================================================================================================================
+//
+// Count TSC ticks over TSC_CALIBRATION_MICROSECONDS worth of HPET ticks. If the HPET is off, it gets turned on for the measurement and
+// turned back off afterwards. Returns 0 if there's no usable HPET.
+//
+
+STATIC UINT64 TscFrequencyFromHpet(VOID)
+{
+  ACPI_HPET * Hpet = (ACPI_HPET*)FindAcpiTable("HPET", 0);
+  if((Hpet == NULL) || (Hpet->Header.Length < sizeof(ACPI_HPET)) || (Hpet->BaseAddress.AddressSpaceId != ACPI_GAS_SYSTEM_MEMORY) || (Hpet->BaseAddress.Address == 0))
+  {
+    return 0;
+  }
+
+  volatile UINT64 * Capabilities = (volatile UINT64*)(Hpet->BaseAddress.Address + HPET_GENERAL_CAPABILITIES);
+  volatile UINT64 * Config = (volatile UINT64*)(Hpet->BaseAddress.Address + HPET_GENERAL_CONFIG);
+  volatile UINT64 * Counter = (volatile UINT64*)(Hpet->BaseAddress.Address + HPET_MAIN_COUNTER);
+
+  UINT64 PeriodFs = *Capabilities >> 32;
+  if((PeriodFs == 0) || (PeriodFs > 100000000)) // The spec caps the period at 100ns
+  {
+    return 0;
+  }
+
+  UINT64 CounterMask = (*Capabilities & HPET_CAP_COUNT_SIZE) ? ~0ULL : 0xFFFFFFFFULL;
+  UINT64 CounterFrequency = 1000000000000000ULL / PeriodFs;
+  UINT64 Ticks = (CounterFrequency * TSC_CALIBRATION_MICROSECONDS) / 1000000ULL;
+
+  UINT64 OldConfig = *Config;
+  if(!(OldConfig & HPET_CONFIG_ENABLE))
+  {
+    *Config = OldConfig | HPET_CONFIG_ENABLE;
+  }
+
+  UINT64 Elapsed = 0, StuckReads = 0;
+  UINT64 Start = *Counter;
+  UINT64 StartTsc = ReadTsc();
+  UINT64 Last = Start;
+
+  while(Elapsed < Ticks)
+  {
+    UINT64 Now = *Counter;
+    if(Now == Last)
+    {
+      if(++StuckReads > TSC_CALIBRATION_STUCK_READS)
+      {
+        break;
+      }
+    }
+    else
+    {
+      StuckReads = 0;
+      Last = Now;
+    }
+    Elapsed = (Now - Start) & CounterMask;
+  }
+  UINT64 EndTsc = ReadTsc();
+
+  if(!(OldConfig & HPET_CONFIG_ENABLE))
+  {
+    *Config = OldConfig;
+  }
+
+  if(Elapsed < Ticks)
+  {
+    return 0;
+  }
+
+  return ((EndTsc - StartTsc) * CounterFrequency) / Elapsed;
+}
+
+//==================================================================================================================================
+//  TscFrequencyFromPmTimer: Measure The TSC Against The ACPI PM Timer
+//==================================================================================================================================
+//
+// Count TSC ticks over TSC_CALIBRATION_MICROSECONDS worth of PM timer ticks. The PM timer is usually an I/O port, but ACPI 2.0+ allows
+// it to be memory-mapped. Returns 0 if there's no usable PM timer.
+//
+
+STATIC UINT64 TscFrequencyFromPmTimer(VOID)
+{
+  ACPI_FADT * Fadt = (ACPI_FADT*)FindAcpiTable("FACP", 0);
+  if((Fadt == NULL) || (Fadt->Header.Length < 116)) // Needs at least everything up to and including Flags
+  {
+    return 0;
+  }
+
+  UINT16 Port = (UINT16)Fadt->PmTmrBlk;
+  volatile UINT32 * Register = NULL;
+
+  if((Fadt->Header.Length >= 220) && (Fadt->XPmTmrBlk.Address != 0)) // Everything up to and including XPmTmrBlk
+  {
+    if(Fadt->XPmTmrBlk.AddressSpaceId == ACPI_GAS_SYSTEM_IO)
+    {
+      Port = (UINT16)Fadt->XPmTmrBlk.Address;
+    }
+    else if(Fadt->XPmTmrBlk.AddressSpaceId == ACPI_GAS_SYSTEM_MEMORY)
+    {
+      Register = (volatile UINT32*)Fadt->XPmTmrBlk.Address;
+    }
+  }
+
+  if((Register == NULL) && (Port == 0))
+  {
+    return 0;
+  }
+
+  UINT32 CounterMask = (Fadt->Flags & ACPI_FADT_TMR_VAL_EXT) ? 0xFFFFFFFF : 0xFFFFFF;
+  UINT32 Ticks = (UINT32)((ACPI_PM_TIMER_FREQUENCY * (UINT64)TSC_CALIBRATION_MICROSECONDS) / 1000000ULL);
+
+  UINT32 Elapsed = 0;
+  UINT64 StuckReads = 0;
+  UINT32 Start = ((Register != NULL) ? *Register : IoRead32(Port)) & CounterMask;
+  UINT64 StartTsc = ReadTsc();
+  UINT32 Last = Start;
+
+  while(Elapsed < Ticks)
+  {
+    UINT32 Now = ((Register != NULL) ? *Register : IoRead32(Port)) & CounterMask;
+    if(Now == Last)
+    {
+      if(++StuckReads > TSC_CALIBRATION_STUCK_READS)
+      {
+        return 0;
+      }
+    }
+    else
+    {
+      StuckReads = 0;
+      Last = Now;
+    }
+    Elapsed = (Now - Start) & CounterMask;
+  }
+  UINT64 EndTsc = ReadTsc();
+
+  return ((EndTsc - StartTsc) * ACPI_PM_TIMER_FREQUENCY) / Elapsed;
+}
+
+//==================================================================================================================================
+//  GetTscFrequency: Find Out How Fast The Timestamp Counter Ticks
+//==================================================================================================================================
+//
+// Return the TSC frequency in Hz. The first call works it out, trying CPUID first since that's exact and free, then measuring it
+// against the HPET, the ACPI PM timer, and finally BS->Stall(), which is the only clock every UEFI implementation is guaranteed to have.
+// That last one means the first call has to happen before ExitBootServices(). Later calls just return the stored value.
+//
+
+UINT64 GetTscFrequency(VOID)
+{
+  if(TscFrequency == 0)
+  {
+    TscFrequency = TscFrequencyFromCpuid();
+    TscFrequencySource = LOADER_TSC_SOURCE_CPUID;
+  }
+
+  if(TscFrequency == 0)
+  {
+    TscFrequency = TscFrequencyFromHpet();
+    TscFrequencySource = LOADER_TSC_SOURCE_HPET;
+  }
+
+  if(TscFrequency == 0)
+  {
+    TscFrequency = TscFrequencyFromPmTimer();
+    TscFrequencySource = LOADER_TSC_SOURCE_PM_TIMER;
+  }
+
+  if(TscFrequency == 0)
+  {
+    UINT64 Start = ReadTsc();
+    BS->Stall(TSC_CALIBRATION_MICROSECONDS);
+    UINT64 End = ReadTsc();
+
+    TscFrequency = ((End - Start) * 1000000ULL) / TSC_CALIBRATION_MICROSECONDS;
+    TscFrequencySource = LOADER_TSC_SOURCE_STALL;
+  }
+
+  return TscFrequency;
+}
+
+//==================================================================================================================================
+//  GetTscFrequencySource: Find Out Where The TSC Frequency Came From
+//==================================================================================================================================
+//
+// Return the LOADER_TSC_SOURCE_* value for what GetTscFrequency() used, or 0 if it hasn't been called yet.
+//
+
+UINT32 GetTscFrequencySource(VOID)
+{
+  return TscFrequencySource;
+}
+
+//==================================================================================================================================
+//  XsaveAreaSize: Work Out How Big An XSAVE Area Is
+//==================================================================================================================================
+//
+// Return how many bytes XSAVE (standard, not compacted, format) needs for the state components in Xcr0. CPUID 0xD subleaf 0 only gives
+// this for the current XCR0, which isn't necessarily the one the kernel will have.
+//
+
+STATIC UINT32 XsaveAreaSize(UINT64 Xcr0)
+{
+  UINT32 Eax, Ebx, Ecx, Edx;
+  UINT32 Size = XSAVE_LEGACY_AND_HEADER_SIZE;
+
+  // Components 0 and 1 (x87 & SSE) are in the legacy area
+  for(UINT32 Component = 2; Component < 63; Component++)
+  {
+    if(Xcr0 & (1ULL << Component))
+    {
+      CpuId(CPUID_XSAVE, Component, &Eax, &Ebx, &Ecx, &Edx);
+      if(Ebx + Eax > Size)
+      {
+        Size = Ebx + Eax;
+      }
+    }
+  }
+
+  return Size;
+}
+
+//==================================================================================================================================
+//  GetCpuFeatures: Summarize What The CPU Can Do
+//==================================================================================================================================
+//
+// Allocate a CPU_FEATURES structure and fill it with the CPUID feature words, the highest leaves, and the CR4 and XCR0 values the
+// kernel is going to start with. With CPU_FEATURES_ENABLED, those are what EnableCpuFeatures() will set; otherwise they're whatever
+// firmware left. Feature bits that need register state the kernel won't have (e.g. AVX without XCR0_AVX) get cleared, so a set bit
+// means the kernel can just use that feature.
+//
+
+// Features that need XCR0_AVX
+#define CPU_FEATURES_1_ECX_AVX       ((1U << 12) | (1U << 28) | (1U << 29))                  // FMA, AVX, F16C
+#define CPU_FEATURES_7_0_EBX_AVX     (1U << 5)                                               // AVX2
+#define CPU_FEATURES_7_0_ECX_AVX     ((1U << 9) | (1U << 10))                                // VAES, VPCLMULQDQ
+#define CPU_FEATURES_7_1_EAX_AVX     (1U << 4)                                               // AVX-VNNI
+
+// Features that need XCR0_AVX512
+#define CPU_FEATURES_7_0_EBX_AVX512  ((1U << 16) | (1U << 17) | (1U << 21) | (1U << 26) | (1U << 27) | (1U << 28) | (1U << 30) | (1U << 31))
+#define CPU_FEATURES_7_0_ECX_AVX512  ((1U << 1) | (1U << 6) | (1U << 11) | (1U << 12) | (1U << 14))
+#define CPU_FEATURES_7_0_EDX_AVX512  ((1U << 2) | (1U << 3) | (1U << 8) | (1U << 23))
+#define CPU_FEATURES_7_1_EAX_AVX512  (1U << 5)                                               // AVX512_BF16
+
+// Features that need XCR0_TILECFG and XCR0_TILEDATA
+#define CPU_FEATURES_7_0_EDX_AMX     ((1U << 22) | (1U << 24) | (1U << 25))                  // AMX-BF16, AMX-TILE, AMX-INT8
+
+EFI_STATUS GetCpuFeatures(CPU_FEATURES ** Features)
+{
+  EFI_STATUS cpu_status = BS->AllocatePool(EfiLoaderData, sizeof(CPU_FEATURES), (void**)Features);
+  if(EFI_ERROR(cpu_status))
+  {
+    Print(L"Error allocating CPU feature summary. 0x%llx\r\n", cpu_status);
+    return cpu_status;
+  }
+
+  CPU_FEATURES * Cpu = *Features;
+  ZeroMem(Cpu, sizeof(CPU_FEATURES));
+
+  UINT32 Eax, Ebx, Ecx, Edx;
+
+  CpuId(CPUID_MAX_LEAF, 0, &Eax, &Ebx, &Ecx, &Edx);
+  Cpu->MaxLeaf = Eax;
+  CopyMem(&Cpu->Vendor[0], &Ebx, 4);
+  CopyMem(&Cpu->Vendor[4], &Edx, 4);
+  CopyMem(&Cpu->Vendor[8], &Ecx, 4);
+
+  CpuId(CPUID_FEATURES, 0, &Eax, &Ebx, &Ecx, &Edx);
+  Cpu->Signature = Eax;
+  Cpu->Words[CPU_FEATURE_WORD_1_ECX] = Ecx;
+  Cpu->Words[CPU_FEATURE_WORD_1_EDX] = Edx;
+
+  if(Cpu->MaxLeaf >= CPUID_STRUCTURED_FEATURES)
+  {
+    CpuId(CPUID_STRUCTURED_FEATURES, 0, &Eax, &Ebx, &Ecx, &Edx);
+    Cpu->Words[CPU_FEATURE_WORD_7_0_EBX] = Ebx;
+    Cpu->Words[CPU_FEATURE_WORD_7_0_ECX] = Ecx;
+    Cpu->Words[CPU_FEATURE_WORD_7_0_EDX] = Edx;
+
+    if(Eax >= 1) // Highest subleaf
+    {
+      CpuId(CPUID_STRUCTURED_FEATURES, 1, &Eax, &Ebx, &Ecx, &Edx);
+      Cpu->Words[CPU_FEATURE_WORD_7_1_EAX] = Eax;
+    }
+  }
+
+  if((Cpu->MaxLeaf >= CPUID_XSAVE) && (Cpu->Words[CPU_FEATURE_WORD_1_ECX] & CPUID_FEATURES_ECX_XSAVE))
+  {
+    CpuId(CPUID_XSAVE, 0, &Eax, &Ebx, &Ecx, &Edx);
+    Cpu->Xcr0Supported = ((UINT64)Edx << 32) | Eax;
+    Cpu->XsaveMaxSize = Ecx;
+
+    CpuId(CPUID_XSAVE, 1, &Eax, &Ebx, &Ecx, &Edx);
+    Cpu->Words[CPU_FEATURE_WORD_D_1_EAX] = Eax;
+  }
+
+  CpuId(CPUID_EXTENDED_MAX_LEAF, 0, &Eax, &Ebx, &Ecx, &Edx);
+  Cpu->MaxExtendedLeaf = Eax;
+
+  if(Cpu->MaxExtendedLeaf >= CPUID_EXTENDED_FEATURES)
+  {
+    CpuId(CPUID_EXTENDED_FEATURES, 0, &Eax, &Ebx, &Ecx, &Edx);
+    Cpu->Words[CPU_FEATURE_WORD_80000001_ECX] = Ecx;
+    Cpu->Words[CPU_FEATURE_WORD_80000001_EDX] = Edx;
+  }
+  if(Cpu->MaxExtendedLeaf >= CPUID_ADVANCED_POWER)
+  {
+    CpuId(CPUID_ADVANCED_POWER, 0, &Eax, &Ebx, &Ecx, &Edx);
+    Cpu->Words[CPU_FEATURE_WORD_80000007_EDX] = Edx;
+  }
+  if(Cpu->MaxExtendedLeaf >= CPUID_ADDRESS_SIZES)
+  {
+    CpuId(CPUID_ADDRESS_SIZES, 0, &Eax, &Ebx, &Ecx, &Edx);
+    Cpu->Words[CPU_FEATURE_WORD_80000008_EBX] = Ebx;
+  }
+
+  if(Cpu->Words[CPU_FEATURE_WORD_1_ECX] & CPUID_FEATURES_ECX_HYPERVISOR)
+  {
+    CpuId(CPUID_HYPERVISOR_MAX_LEAF, 0, &Eax, &Ebx, &Ecx, &Edx);
+    Cpu->MaxHypervisorLeaf = Eax;
+  }
+
+  // Work out what CR4 and XCR0 will be at kernel entry
+  UINT64 Cr4 = ReadCr4();
+  UINT64 Xcr0 = (Cr4 & CR4_OSXSAVE) ? ReadXcr0() : 0;
+
+#ifdef CPU_FEATURES_ENABLED
+  // PCIDE isn't allowed here, since it needs CR3's low 12 bits clear and firmware page tables don't promise that
+#if (CPU_FEATURES_CR4) & CR4_PCIDE
+  #error "CPU_FEATURES_CR4 can't have CR4_PCIDE, since it would just get left off"
+#endif
+  UINT64 SupportedCr4 = CR4_OSFXSR | CR4_OSXMMEXCPT;
+  if(Cpu->Words[CPU_FEATURE_WORD_7_0_EBX] & CPUID_STRUCTURED_EBX_FSGSBASE)
+  {
+    SupportedCr4 |= CR4_FSGSBASE;
+  }
+  if(Cpu->Words[CPU_FEATURE_WORD_7_0_EBX] & CPUID_STRUCTURED_EBX_SMEP)
+  {
+    SupportedCr4 |= CR4_SMEP;
+  }
+  if(Cpu->Words[CPU_FEATURE_WORD_7_0_EBX] & CPUID_STRUCTURED_EBX_SMAP)
+  {
+    SupportedCr4 |= CR4_SMAP;
+  }
+  if(Cpu->Words[CPU_FEATURE_WORD_7_0_ECX] & CPUID_STRUCTURED_ECX_UMIP)
+  {
+    SupportedCr4 |= CR4_UMIP;
+  }
+  Cr4 |= CPU_FEATURES_CR4 & SupportedCr4;
+
+  if(Cpu->Xcr0Supported != 0)
+  {
+    Cr4 |= CR4_OSXSAVE;
+    Xcr0 = (CPU_FEATURES_XCR0 | XCR0_X87 | XCR0_SSE) & Cpu->Xcr0Supported;
+
+    // XSETBV #GPs on combinations that don't make sense
+    if(!(Xcr0 & XCR0_SSE))
+    {
+      Xcr0 &= ~XCR0_AVX;
+    }
+    if((!(Xcr0 & XCR0_AVX)) || ((Xcr0 & XCR0_AVX512) != XCR0_AVX512))
+    {
+      Xcr0 &= ~XCR0_AVX512;
+    }
+    if((Xcr0 & (XCR0_TILECFG | XCR0_TILEDATA)) != (XCR0_TILECFG | XCR0_TILEDATA))
+    {
+      Xcr0 &= ~(XCR0_TILECFG | XCR0_TILEDATA);
+    }
+  }
+
+  Cpu->Enabled = 1;
+#endif
+
+  Cpu->Cr4 = Cr4;
+  Cpu->Xcr0 = Xcr0;
+  if(Xcr0 != 0)
+  {
+    Cpu->XsaveSize = XsaveAreaSize(Xcr0);
+  }
+
+  // Only report what the kernel can actually use
+  if(Cr4 & CR4_OSXSAVE)
+  {
+    Cpu->Words[CPU_FEATURE_WORD_1_ECX] |= CPUID_FEATURES_ECX_OSXSAVE;
+  }
+  else
+  {
+    Cpu->Words[CPU_FEATURE_WORD_1_ECX] &= ~CPUID_FEATURES_ECX_OSXSAVE;
+  }
+
+  if(!(Xcr0 & XCR0_AVX))
+  {
+    Cpu->Words[CPU_FEATURE_WORD_1_ECX] &= ~CPU_FEATURES_1_ECX_AVX;
+    Cpu->Words[CPU_FEATURE_WORD_7_0_EBX] &= ~CPU_FEATURES_7_0_EBX_AVX;
+    Cpu->Words[CPU_FEATURE_WORD_7_0_ECX] &= ~CPU_FEATURES_7_0_ECX_AVX;
+    Cpu->Words[CPU_FEATURE_WORD_7_1_EAX] &= ~CPU_FEATURES_7_1_EAX_AVX;
+  }
+
+  if((Xcr0 & XCR0_AVX512) != XCR0_AVX512)
+  {
+    Cpu->Words[CPU_FEATURE_WORD_7_0_EBX] &= ~CPU_FEATURES_7_0_EBX_AVX512;
+    Cpu->Words[CPU_FEATURE_WORD_7_0_ECX] &= ~CPU_FEATURES_7_0_ECX_AVX512;
+    Cpu->Words[CPU_FEATURE_WORD_7_0_EDX] &= ~CPU_FEATURES_7_0_EDX_AVX512;
+    Cpu->Words[CPU_FEATURE_WORD_7_1_EAX] &= ~CPU_FEATURES_7_1_EAX_AVX512;
+  }
+
+  if((Xcr0 & (XCR0_TILECFG | XCR0_TILEDATA)) != (XCR0_TILECFG | XCR0_TILEDATA))
+  {
+    Cpu->Words[CPU_FEATURE_WORD_7_0_EDX] &= ~CPU_FEATURES_7_0_EDX_AMX;
+  }
+
+  return EFI_SUCCESS;
+}
+
+#ifdef CPU_FEATURES_ENABLED
+//==================================================================================================================================
+//  EnableCpuFeatures: Set CR4 And XCR0 For The Kernel
+//==================================================================================================================================
+//
+// Load the CR4 and XCR0 values GetCpuFeatures() picked. This goes right before the jump to the kernel, after ExitBootServices(), since
+// firmware might not expect the bigger XSAVE state or things like SMAP.
+//
+
+VOID EnableCpuFeatures(CPU_FEATURES * Features)
+{
+  // OSXSAVE has to be on before XSETBV will work
+  WriteCr4(Features->Cr4);
+
+  if(Features->Xcr0 != 0)
+  {
+    WriteXcr0(Features->Xcr0);
+  }
+}
+#endif
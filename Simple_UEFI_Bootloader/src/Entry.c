@@ -0,0 +1,497 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Kernel Entry Functions
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This file contains the functions that set up the CPU state the kernel starts in: a big stack with a guard page, a flat GDT with a
+// TSS, and an IDT whose exception handlers print the CPU state to the screen and COM1 so early kernel crashes don't just reboot.
+//
+// NOTE: The exception handlers and the font they use are part of the bootloader image (EfiLoaderCode), so they stop working once the
+// kernel reuses that memory. Kernels should have their own IDT loaded by then.
+//
+// Only used if LOADER_ENTRY_STATE_ENABLED is defined in Bootloader.h.
+//
+
+#include "Bootloader.h"
+
+#ifdef LOADER_ENTRY_STATE_ENABLED
+
+#define ENTRY_STACK_ALIGNMENT   0x200000ULL // 2MB
+#define ENTRY_FAULT_STACK_PAGES 4           // IST1, which all of the exception handlers run on
+#define ENTRY_DESCRIPTOR_PAGES  (2 + ENTRY_FAULT_STACK_PAGES) // The IDT, then the GDT & TSS, then the fault stack
+#define ENTRY_EXCEPTION_VECTORS 32
+
+#define COM1_PORT               0x3F8
+
+// What the exception stubs below leave on the stack
+typedef struct {
+  UINT64 R15;
+  UINT64 R14;
+  UINT64 R13;
+  UINT64 R12;
+  UINT64 R11;
+  UINT64 R10;
+  UINT64 R9;
+  UINT64 R8;
+  UINT64 Rbp;
+  UINT64 Rdi;
+  UINT64 Rsi;
+  UINT64 Rdx;
+  UINT64 Rcx;
+  UINT64 Rbx;
+  UINT64 Rax;
+  UINT64 Vector;
+  UINT64 ErrorCode; // 0 for exceptions that don't have one
+  UINT64 Rip;       // Everything from here on was pushed by the CPU
+  UINT64 Cs;
+  UINT64 Rflags;
+  UINT64 Rsp;
+  UINT64 Ss;
+} ENTRY_FAULT_FRAME;
+
+//==================================================================================================================================
+//  EntryFaultStubs: Exception Entry Points
+//==================================================================================================================================
+//
+// One 16-byte stub per exception vector. Each pushes a 0 in place of an error code if the CPU doesn't push one (bit N of 0x60227D00 is
+// set if vector N has one), then the vector number, and jumps to the common part, which saves the general purpose registers and calls
+// EntryFaultHandler(). That never returns, but in case it ever does, the CPU just halts.
+//
+
+extern UINT8 EntryFaultStubs[];
+
+__asm__(".text\n"
+        ".balign 16\n"
+        "EntryFaultStubs:\n"
+        ".set EntryFaultVector, 0\n"
+        ".rept 32\n"
+        ".balign 16\n"
+        ".if ((0x60227D00 >> EntryFaultVector) & 1) == 0\n"
+        "pushq $0\n"
+        ".endif\n"
+        "pushq $EntryFaultVector\n"
+        "jmp EntryFaultCommon\n"
+        ".set EntryFaultVector, EntryFaultVector + 1\n"
+        ".endr\n"
+        "EntryFaultCommon:\n"
+        "pushq %rax\n"
+        "pushq %rbx\n"
+        "pushq %rcx\n"
+        "pushq %rdx\n"
+        "pushq %rsi\n"
+        "pushq %rdi\n"
+        "pushq %rbp\n"
+        "pushq %r8\n"
+        "pushq %r9\n"
+        "pushq %r10\n"
+        "pushq %r11\n"
+        "pushq %r12\n"
+        "pushq %r13\n"
+        "pushq %r14\n"
+        "pushq %r15\n"
+        "cld\n"
+        "movq %rsp, %rdi\n"
+        "andq $-16, %rsp\n"
+        "call EntryFaultHandler\n"
+        "1:\n"
+        "cli\n"
+        "hlt\n"
+        "jmp 1b\n");
+
+//==================================================================================================================================
+//  Fault Output
+//==================================================================================================================================
+//
+// A 5x7 font for digits and capital letters (bit 4 is the leftmost pixel), drawn at twice the size in 12x16 cells so it can be read
+// on a high resolution screen. Anything else comes out as a blank.
+//
+
+STATIC CONST UINT8 EntryFaultFont[36][7] = {
+  {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}, // 0
+  {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}, // 1
+  {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}, // 2
+  {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}, // 3
+  {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}, // 4
+  {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}, // 5
+  {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}, // 6
+  {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}, // 7
+  {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}, // 8
+  {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}, // 9
+  {0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, // A
+  {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E}, // B
+  {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E}, // C
+  {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C}, // D
+  {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}, // E
+  {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10}, // F
+  {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F}, // G
+  {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, // H
+  {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}, // I
+  {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C}, // J
+  {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}, // K
+  {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F}, // L
+  {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11}, // M
+  {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}, // N
+  {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, // O
+  {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10}, // P
+  {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D}, // Q
+  {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11}, // R
+  {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E}, // S
+  {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, // T
+  {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, // U
+  {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04}, // V
+  {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A}, // W
+  {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11}, // X
+  {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04}, // Y
+  {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F}  // Z
+};
+
+STATIC CONST char * CONST EntryFaultNames[ENTRY_EXCEPTION_VECTORS] = {
+  "DE", "DB", "NMI", "BP", "OF", "BR", "UD", "NM", "DF", "CSO", "TS", "NP", "SS", "GP", "PF", "",
+  "MF", "AC", "MC", "XM", "VE", "CP", "", "", "", "", "", "", "HV", "VC", "SX", ""
+};
+
+// Copied out of GPU_CONFIG, since the GOP mode info is in boot services memory the kernel may have reused
+STATIC UINT32 * EntryFaultFrameBuffer = NULL;
+STATIC UINT64 EntryFaultWidth = 0;
+STATIC UINT64 EntryFaultHeight = 0;
+STATIC UINT64 EntryFaultPixelsPerScanLine = 0;
+STATIC UINT32 EntryFaultForeground = 0;
+STATIC UINT32 EntryFaultBackground = 0;
+
+STATIC UINT64 EntryFaultColumn = 0;
+STATIC UINT64 EntryFaultRow = 0;
+
+STATIC VOID EntryFaultSerialInit(VOID)
+{
+  IoWrite8(COM1_PORT + 1, 0x00); // No UART interrupts
+  IoWrite8(COM1_PORT + 3, 0x80); // Divisor latch on
+  IoWrite8(COM1_PORT + 0, 0x01); // 115200 baud
+  IoWrite8(COM1_PORT + 1, 0x00);
+  IoWrite8(COM1_PORT + 3, 0x03); // 8N1, divisor latch off
+  IoWrite8(COM1_PORT + 2, 0xC7); // FIFOs on and cleared
+}
+
+STATIC VOID EntryFaultSerialPut(char Character)
+{
+  // Don't wait forever if there's no UART there
+  for(UINT32 Timeout = 100000; Timeout && !(IoRead8(COM1_PORT + 5) & 0x20); Timeout--);
+  IoWrite8(COM1_PORT, (UINT8)Character);
+}
+
+STATIC VOID EntryFaultDrawCharacter(char Character)
+{
+  CONST UINT8 * Glyph = NULL;
+  UINT64 Left = 8 + EntryFaultColumn * 12;
+  UINT64 Top = 8 + EntryFaultRow * 16;
+
+  if((EntryFaultFrameBuffer == NULL) || (Left + 12 > EntryFaultWidth) || (Top + 16 > EntryFaultHeight))
+  {
+    return;
+  }
+
+  if((Character >= '0') && (Character <= '9'))
+  {
+    Glyph = EntryFaultFont[Character - '0'];
+  }
+  else if((Character >= 'A') && (Character <= 'Z'))
+  {
+    Glyph = EntryFaultFont[10 + Character - 'A'];
+  }
+
+  for(UINT64 y = 0; y < 16; y++)
+  {
+    UINT32 * Line = EntryFaultFrameBuffer + (Top + y) * EntryFaultPixelsPerScanLine + Left;
+    for(UINT64 x = 0; x < 12; x++)
+    {
+      UINT8 Lit = (Glyph != NULL) && (x < 10) && (y < 14) && ((Glyph[y >> 1] >> (4 - (x >> 1))) & 1);
+      Line[x] = Lit ? EntryFaultForeground : EntryFaultBackground;
+    }
+  }
+}
+
+STATIC VOID EntryFaultPrint(CONST char * String)
+{
+  for(; *String != '\0'; String++)
+  {
+    if(*String == '\n')
+    {
+      EntryFaultSerialPut('\r');
+      EntryFaultSerialPut('\n');
+      EntryFaultColumn = 0;
+      EntryFaultRow++;
+      continue;
+    }
+
+    EntryFaultSerialPut(*String);
+    EntryFaultDrawCharacter(*String);
+    EntryFaultColumn++;
+  }
+}
+
+STATIC VOID EntryFaultPrintHex(CONST char * Name, UINT64 Value)
+{
+  char Line[32];
+  UINT64 i = 0;
+
+  for(; (Name[i] != '\0') && (i < 7); i++)
+  {
+    Line[i] = Name[i];
+  }
+  for(; i < 7; i++)
+  {
+    Line[i] = ' ';
+  }
+  for(UINT64 Digit = 0; Digit < 16; Digit++)
+  {
+    Line[i++] = "0123456789ABCDEF"[(Value >> (60 - 4 * Digit)) & 0xF];
+  }
+  Line[i++] = '\n';
+  Line[i] = '\0';
+
+  EntryFaultPrint(Line);
+}
+
+//==================================================================================================================================
+//  EntryFaultHandler: Print The CPU State And Halt
+//==================================================================================================================================
+//
+// Called by the exception stubs on the IST1 stack with interrupts off. It can't rely on anything but its own image and the I/O ports.
+//
+
+__attribute__((used, sysv_abi)) VOID EntryFaultHandler(ENTRY_FAULT_FRAME * Frame)
+{
+  EntryFaultSerialInit();
+  EntryFaultColumn = 0;
+  EntryFaultRow = 0;
+
+  EntryFaultPrint("\nEXCEPTION ");
+  EntryFaultPrint(EntryFaultNames[Frame->Vector & (ENTRY_EXCEPTION_VECTORS - 1)]);
+  EntryFaultPrint("\n");
+  EntryFaultPrintHex("VECTOR", Frame->Vector);
+  EntryFaultPrintHex("ERROR", Frame->ErrorCode);
+  EntryFaultPrintHex("RIP", Frame->Rip);
+  EntryFaultPrintHex("CS", Frame->Cs);
+  EntryFaultPrintHex("RFLAGS", Frame->Rflags);
+  EntryFaultPrintHex("RSP", Frame->Rsp);
+  EntryFaultPrintHex("SS", Frame->Ss);
+  EntryFaultPrintHex("CR2", ReadCr2());
+  EntryFaultPrintHex("CR3", ReadCr3());
+  EntryFaultPrintHex("RAX", Frame->Rax);
+  EntryFaultPrintHex("RBX", Frame->Rbx);
+  EntryFaultPrintHex("RCX", Frame->Rcx);
+  EntryFaultPrintHex("RDX", Frame->Rdx);
+  EntryFaultPrintHex("RSI", Frame->Rsi);
+  EntryFaultPrintHex("RDI", Frame->Rdi);
+  EntryFaultPrintHex("RBP", Frame->Rbp);
+  EntryFaultPrintHex("R8", Frame->R8);
+  EntryFaultPrintHex("R9", Frame->R9);
+  EntryFaultPrintHex("R10", Frame->R10);
+  EntryFaultPrintHex("R11", Frame->R11);
+  EntryFaultPrintHex("R12", Frame->R12);
+  EntryFaultPrintHex("R13", Frame->R13);
+  EntryFaultPrintHex("R14", Frame->R14);
+  EntryFaultPrintHex("R15", Frame->R15);
+
+  for(;;)
+  {
+    __asm__ __volatile__("cli\n\t"
+                         "hlt");
+  }
+}
+
+//==================================================================================================================================
+//  BuildEntryState: Allocate The Kernel's Stack And Descriptor Tables
+//==================================================================================================================================
+//
+// This needs boot services, so it runs before ExitBootServices(). It has to run before BuildPageTables() too, so that the stack's guard
+// page can be left out of the page tables. LoadEntryState() loads the descriptor tables afterwards.
+//
+// UEFI can't allocate aligned memory, so the stack gets an extra 2MB and whatever's left over on either side of the aligned part is
+// freed again.
+//
+
+EFI_STATUS BuildEntryState(GPU_CONFIG * Graphics, LOADER_ENTRY_STATE ** EntryState)
+{
+  EFI_STATUS entry_status;
+  UINT64 StackSize = (((UINT64)LOADER_STACK_SIZE_MB << 20) + ENTRY_STACK_ALIGNMENT - 1) & ~(ENTRY_STACK_ALIGNMENT - 1);
+  if(StackSize == 0)
+  {
+    StackSize = ENTRY_STACK_ALIGNMENT;
+  }
+  UINT64 AllocationPages = (StackSize + ENTRY_STACK_ALIGNMENT) >> EFI_PAGE_SHIFT;
+  EFI_PHYSICAL_ADDRESS Allocation = 0;
+
+  entry_status = BS->AllocatePages(AllocateAnyPages, EfiLoaderData, AllocationPages, &Allocation);
+  if(EFI_ERROR(entry_status))
+  {
+    Print(L"Kernel stack AllocatePages error. 0x%llx\r\n", entry_status);
+    return entry_status;
+  }
+
+  EFI_PHYSICAL_ADDRESS StackBase = (Allocation + ENTRY_STACK_ALIGNMENT - 1) & ~(ENTRY_STACK_ALIGNMENT - 1);
+  EFI_PHYSICAL_ADDRESS StackTop = StackBase + StackSize;
+  EFI_PHYSICAL_ADDRESS AllocationEnd = Allocation + (AllocationPages << EFI_PAGE_SHIFT);
+
+  if(StackBase > Allocation)
+  {
+    entry_status = BS->FreePages(Allocation, (StackBase - Allocation) >> EFI_PAGE_SHIFT);
+    if(EFI_ERROR(entry_status))
+    {
+      Print(L"Error freeing kernel stack head. 0x%llx\r\n", entry_status);
+      return entry_status;
+    }
+  }
+  if(AllocationEnd > StackTop)
+  {
+    entry_status = BS->FreePages(StackTop, (AllocationEnd - StackTop) >> EFI_PAGE_SHIFT);
+    if(EFI_ERROR(entry_status))
+    {
+      Print(L"Error freeing kernel stack tail. 0x%llx\r\n", entry_status);
+      return entry_status;
+    }
+  }
+
+#ifdef LOADER_PAGE_TABLES_ENABLED
+  AddGuardPage(StackBase);
+#endif
+
+  EFI_PHYSICAL_ADDRESS Descriptors = 0;
+  entry_status = BS->AllocatePages(AllocateAnyPages, EfiLoaderData, ENTRY_DESCRIPTOR_PAGES, &Descriptors);
+  if(EFI_ERROR(entry_status))
+  {
+    Print(L"Descriptor table AllocatePages error. 0x%llx\r\n", entry_status);
+    return entry_status;
+  }
+  ZeroMem((VOID*)Descriptors, 2 * EFI_PAGE_SIZE);
+
+  entry_status = BS->AllocatePool(EfiLoaderData, sizeof(LOADER_ENTRY_STATE), (void**)EntryState);
+  if(EFI_ERROR(entry_status))
+  {
+    Print(L"EntryState AllocatePool error. 0x%llx\r\n", entry_status);
+    return entry_status;
+  }
+
+  LOADER_ENTRY_STATE * State = *EntryState;
+  State->StackBase = StackBase;
+  State->StackSize = StackSize;
+  State->StackTop = StackTop;
+  State->FaultStackTop = Descriptors + (ENTRY_DESCRIPTOR_PAGES << EFI_PAGE_SHIFT);
+  State->Idt = Descriptors;
+  State->IdtLimit = 256 * sizeof(IDT_GATE) - 1; // Vectors past the exceptions are there, but not present
+  State->Gdt = Descriptors + EFI_PAGE_SIZE;
+  State->GdtLimit = 5 * sizeof(UINT64) - 1;
+  State->Tss = State->Gdt + 64;
+  State->Flags = 0;
+
+  TASK_STATE_SEGMENT * Tss = (TASK_STATE_SEGMENT*)State->Tss;
+  Tss->Ist[0] = State->FaultStackTop;
+  Tss->IoMapBase = sizeof(TASK_STATE_SEGMENT);
+
+  UINT64 * Gdt = (UINT64*)State->Gdt;
+  UINT64 TssLimit = sizeof(TASK_STATE_SEGMENT) - 1;
+  Gdt[LOADER_GDT_CODE_SELECTOR >> 3] = GDT_FLAT_CODE64;
+  Gdt[LOADER_GDT_DATA_SELECTOR >> 3] = GDT_FLAT_DATA;
+  Gdt[LOADER_GDT_TSS_SELECTOR >> 3] = (TssLimit & 0xFFFF) | ((State->Tss & 0xFFFFFF) << 16) | (GDT_TSS_AVAILABLE << 40) | (((TssLimit >> 16) & 0xF) << 48) | (((State->Tss >> 24) & 0xFF) << 56);
+  Gdt[(LOADER_GDT_TSS_SELECTOR >> 3) + 1] = State->Tss >> 32;
+
+  IDT_GATE * Idt = (IDT_GATE*)State->Idt;
+  for(UINT64 Vector = 0; Vector < ENTRY_EXCEPTION_VECTORS; Vector++)
+  {
+    UINT64 Handler = (UINT64)EntryFaultStubs + Vector * 16;
+    Idt[Vector].OffsetLow = (UINT16)Handler;
+    Idt[Vector].Selector = LOADER_GDT_CODE_SELECTOR;
+    Idt[Vector].Ist = 1;
+    Idt[Vector].TypeAttributes = IDT_INTERRUPT_GATE;
+    Idt[Vector].OffsetMiddle = (UINT16)(Handler >> 16);
+    Idt[Vector].OffsetHigh = (UINT32)(Handler >> 32);
+  }
+
+  // The handlers draw on the first framebuffer, as long as it has 32-bit pixels they know how to make
+  if(Graphics->NumberOfFrameBuffers != 0)
+  {
+    EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * Mode = &Graphics->GPUArray[0];
+    EFI_GRAPHICS_PIXEL_FORMAT Format = Mode->Info->PixelFormat;
+
+    if(Format == PixelRedGreenBlueReserved8BitPerColor)
+    {
+      EntryFaultForeground = 0x00FFFFFF;
+      EntryFaultBackground = 0x00000080; // Dark red
+    }
+    else if(Format == PixelBlueGreenRedReserved8BitPerColor)
+    {
+      EntryFaultForeground = 0x00FFFFFF;
+      EntryFaultBackground = 0x00800000;
+    }
+    else if(Format == PixelBitMask)
+    {
+      EntryFaultForeground = Mode->Info->PixelInformation.RedMask | Mode->Info->PixelInformation.GreenMask | Mode->Info->PixelInformation.BlueMask;
+      EntryFaultBackground = 0;
+    }
+
+    if(Format != PixelBltOnly)
+    {
+      EntryFaultFrameBuffer = (UINT32*)Mode->FrameBufferBase;
+      EntryFaultWidth = Mode->Info->HorizontalResolution;
+      EntryFaultHeight = Mode->Info->VerticalResolution;
+      EntryFaultPixelsPerScanLine = Mode->Info->PixelsPerScanLine;
+    }
+  }
+
+  LOG_MESSAGE(HANDOFF, DEBUG, L"Kernel stack: 0x%llx - 0x%llx, GDT: 0x%llx, IDT: 0x%llx", StackBase, StackTop, State->Gdt, State->Idt);
+
+  return EFI_SUCCESS;
+}
+
+//==================================================================================================================================
+//  LoadEntryState: Switch To The Loader's Descriptor Tables
+//==================================================================================================================================
+//
+// Meant to be called after ExitBootServices(), right before JumpToKernel(). Interrupts get turned off for good here, since nothing in
+// the new IDT can handle them.
+//
+
+VOID LoadEntryState(LOADER_ENTRY_STATE * EntryState)
+{
+  DESCRIPTOR_TABLE_POINTER Gdtr, Idtr;
+
+  DisableInterrupts();
+
+  Gdtr.Limit = EntryState->GdtLimit;
+  Gdtr.Base = EntryState->Gdt;
+  LoadGdt(&Gdtr);
+  LoadSegments(LOADER_GDT_CODE_SELECTOR, LOADER_GDT_DATA_SELECTOR);
+  LoadTaskRegister(LOADER_GDT_TSS_SELECTOR);
+
+  Idtr.Limit = EntryState->IdtLimit;
+  Idtr.Base = EntryState->Idt;
+  LoadIdt(&Idtr);
+}
+
+//==================================================================================================================================
+//  JumpToKernel: Switch Stacks And Enter The Kernel
+//==================================================================================================================================
+//
+// Jump to EntryPoint on the loader's stack as if it had been called from there, with a return address of 0 and the 32-byte shadow space
+// MS ABI functions expect (which keeps RSP + 8 16-byte aligned either way). The arguments go in both RCX/RDX and RDI/RSI, so this works
+// for MS ABI (PE) and System V ABI (ELF, Mach-O) kernels alike.
+//
+
+VOID JumpToKernel(EFI_PHYSICAL_ADDRESS EntryPoint, LOADER_PARAMS * Loader_block, LOADER_HANDOFF_HEADER * Handoff, EFI_PHYSICAL_ADDRESS StackTop)
+{
+  __asm__ __volatile__("movq %1, %%rsp\n\t"
+                       "movq $0, (%%rsp)\n\t"
+                       "jmp *%0"
+                       :
+                       : "a" (EntryPoint), "r" (StackTop - 40), "c" (Loader_block), "d" (Handoff), "D" (Loader_block), "S" (Handoff)
+                       : "memory");
+  __builtin_unreachable();
+}
+
+#endif
@@ -0,0 +1,127 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Fast Boot Functions
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This file contains the fast-boot profile: a LoaderFastBoot UEFI variable that makes the loader skip the countdown, the banner, and
+// the graphics device naming and menus, using the choices saved in the variable instead. It's meant for machines nobody's watching,
+// which otherwise spend 10 seconds or more in the loader before the kernel gets to run.
+//
+
+#include "Bootloader.h"
+
+LOADER_FAST_BOOT FastBoot = {0, 2, 0, 0}; // The choices for this boot: what's saved, or else the menu defaults, updated by the menus
+UINT8 FastBootActive = 0;
+
+STATIC EFI_GUID FastBootVariableGuid = LOADER_VARIABLE_GUID;
+STATIC LOADER_FAST_BOOT FastBootSaved = {0}; // What's in the variable right now, all 0 if there isn't one
+
+//==================================================================================================================================
+//  InitFastBoot: Load The Fast-Boot Profile
+//==================================================================================================================================
+//
+// Read the LoaderFastBoot variable into FastBoot and, if it's enabled, turn on FastBootActive. Holding Esc (or pressing it any time
+// before this runs) boots normally instead; that's only a check of what's already in the key buffer, so it never waits.
+//
+
+VOID InitFastBoot(VOID)
+{
+  LOADER_FAST_BOOT Saved;
+  UINTN SavedSize = sizeof(Saved);
+
+  if(EFI_ERROR(RT->GetVariable(L"LoaderFastBoot", &FastBootVariableGuid, NULL, &SavedSize, &Saved)) || (SavedSize != sizeof(Saved)))
+  {
+    return;
+  }
+
+  FastBootSaved = Saved;
+  FastBoot = Saved;
+  if((FastBoot.GpuOption != 2) && (FastBoot.GpuOption != 3))
+  {
+    FastBoot.GpuOption = 2; // Options 0 and 1 need someone to pick modes
+  }
+
+  if(!FastBoot.Enabled)
+  {
+    return;
+  }
+
+  EFI_INPUT_KEY Key;
+  while(!EFI_ERROR(ST->ConIn->ReadKeyStroke(ST->ConIn, &Key)))
+  {
+    if(Key.ScanCode == SCAN_ESC)
+    {
+      Print(L"Esc pressed, skipping fast boot.\r\n");
+      LOG_MESSAGE(MAIN, INFO, L"Fast boot skipped with Esc");
+      return;
+    }
+  }
+
+  FastBootActive = 1;
+
+  // Firmware consoles on servers can take milliseconds a line, so only warnings and errors get printed. The kernel still gets the rest.
+  SetLogConsoleLevel(LOADER_LOG_WARNING);
+  LOG_MESSAGE(MAIN, INFO, L"Fast boot, GPU option %u, mode %u", FastBoot.GpuOption, FastBoot.GpuMode);
+}
+
+//==================================================================================================================================
+//  SetFastBoot: Turn The Fast-Boot Profile On Or Off
+//==================================================================================================================================
+//
+// Handle a loader.fastboot= option from Kernel64.txt: "on" saves this boot's choices (from the menus, or the defaults if there
+// weren't any) in LoaderFastBoot, and "off" deletes it. Setting is the Length characters at Setting, which doesn't need to be
+// null-terminated. The variable only gets written when it would change, since it's in flash.
+//
+
+VOID SetFastBoot(CONST CHAR16 * Setting, UINT64 Length)
+{
+  EFI_STATUS fastboot_status;
+
+  if((Length >= 2) && compare(Setting, L"on", 2 * sizeof(CHAR16)) && ((Length == 2) || (Setting[2] == L' ')))
+  {
+    FastBoot.Enabled = 1;
+    if(compare(&FastBoot, &FastBootSaved, sizeof(LOADER_FAST_BOOT)))
+    {
+      return;
+    }
+
+    fastboot_status = RT->SetVariable(L"LoaderFastBoot", &FastBootVariableGuid, EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS, sizeof(LOADER_FAST_BOOT), &FastBoot);
+    if(EFI_ERROR(fastboot_status))
+    {
+      Print(L"Error saving fast boot profile. 0x%llx\r\n", fastboot_status);
+      return;
+    }
+
+    FastBootSaved = FastBoot;
+    LOG_MESSAGE(MAIN, INFO, L"Fast boot profile saved, GPU option %u, mode %u", FastBoot.GpuOption, FastBoot.GpuMode);
+  }
+  else if((Length >= 3) && compare(Setting, L"off", 3 * sizeof(CHAR16)) && ((Length == 3) || (Setting[3] == L' ')))
+  {
+    FastBoot.Enabled = 0;
+    if(!FastBootSaved.Enabled)
+    {
+      return;
+    }
+
+    fastboot_status = RT->SetVariable(L"LoaderFastBoot", &FastBootVariableGuid, 0, 0, NULL); // Deletes it
+    if(EFI_ERROR(fastboot_status))
+    {
+      Print(L"Error deleting fast boot profile. 0x%llx\r\n", fastboot_status);
+      return;
+    }
+
+    ZeroMem(&FastBootSaved, sizeof(LOADER_FAST_BOOT));
+    LOG_MESSAGE(MAIN, INFO, L"Fast boot profile deleted");
+  }
+  else
+  {
+    LOG_MESSAGE(MAIN, WARNING, L"loader.fastboot= takes on or off");
+  }
+}
@@ -15,9 +15,8 @@
 
 #include "Bootloader.h"
 
-#define GPU_MENU_TIMEOUT_SECONDS 90
-
 STATIC EFI_STATUS apple_set_os(VOID);
+STATIC EFI_STATUS FindGraphicsMode(EFI_GRAPHICS_OUTPUT_PROTOCOL * GOPTable, UINT32 Width, UINT32 Height, UINT32 * Mode);
 
 //==================================================================================================================================
 //  InitUEFI_GOP: Graphics Initialization
@@ -29,6 +28,7 @@ STATIC EFI_STATUS apple_set_os(VOID);
   typedef struct {
     EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE  *GPUArray;             // An array of EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE structs defining each available framebuffer
     UINT64                              NumberOfFrameBuffers; // The number of structs in the array (== the number of available framebuffers)
+    FRAMEBUFFER_CACHING                *FrameBufferCaching;   // The memory type of each framebuffer, in the same order as GPUArray (filled in by GoTime())
   } GPU_CONFIG;
 */
 // The GPUArray pointer points to the base address of an array of these structures:
@@ -83,6 +83,7 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
 { // Declaring a pointer only allocates 8 bytes (64-bit) for that pointer. Buffers must be manually allocated memory via AllocatePool and then freed with FreePool when done with.
 
   Graphics->NumberOfFrameBuffers = 0;
+  Graphics->FrameBufferCaching = NULL;
 
   EFI_STATUS GOPStatus;
 
@@ -134,19 +135,20 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
     return GOPStatus;
   }
 
-  Print(L"\r\n");
-  if(NumHandlesInHandleBuffer == 1) // Grammar
+  if(!FastBootActive)
   {
-    Print(L"There is %llu UEFI graphics device:\r\n\n", NumHandlesInHandleBuffer);
-  }
-  else
-  {
-    Print(L"There are %llu UEFI graphics devices:\r\n\n", NumHandlesInHandleBuffer);
+    Print(L"\r\n");
+    if(NumHandlesInHandleBuffer == 1) // Grammar
+    {
+      Print(L"There is %llu UEFI graphics device:\r\n\n", NumHandlesInHandleBuffer);
+    }
+    else
+    {
+      Print(L"There are %llu UEFI graphics devices:\r\n\n", NumHandlesInHandleBuffer);
+    }
   }
 
-#ifdef GOP_DEBUG_ENABLED
-  Print(L"NameBuffer size: %llu\r\n", sizeof(CHAR16*) * NumHandlesInHandleBuffer);
-#endif
+  LOG_MESSAGE(GOP, DEBUG, L"NameBuffer size: %llu", sizeof(CHAR16*) * NumHandlesInHandleBuffer);
 
   CHAR16 ** NameBuffer; // Pointer to a list of pointers that describe the string names of each output device. Each entry in the list is a pointer to CHAR16s, i.e. a string.
   GOPStatus = BS->AllocatePool(EfiBootServicesData, sizeof(CHAR16*) * NumHandlesInHandleBuffer, (void**)&NameBuffer); // Allocate space for the list
@@ -155,6 +157,7 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
     Print(L"NameBuffer AllocatePool error. 0x%llx\r\n", GOPStatus);
     return GOPStatus;
   }
+  ZeroMem(NameBuffer, sizeof(CHAR16*) * NumHandlesInHandleBuffer); // Names stay NULL with the fast-boot profile
 
   // NOTE: The UEFI names of drivers are meaningless after ExitBootServices() is called, which is why a buffer of names is not a part of the GPU_Configs passed to the kernel.
   // The memory address of GraphicsHandles[DevNum] will also be meaningless at that stage, too, since it'll be somewhere in EfiBootServicesData.
@@ -162,6 +165,12 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
 
   // List all GPUs
 
+  // The names are only for the menus, which the fast-boot profile and Kernel64.txt's gop = native or WxH skip
+  if(FastBootActive || (LoaderConfig.Gop != LOADER_CONFIG_GOP_MENU))
+  {
+    goto fruitcake;
+  }
+
   // First check for Apple, as device names don't work on Apple machines, unfortunately.
   if(IsApple)
   {
@@ -200,16 +209,13 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
     return GOPStatus;
   }
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-  Print(L"Number of Name2Handles: %llu\r\n", NumName2Handles);
-//  Print(L"Number of DriverHandles: %llu\r\n", NumDriverHandles);
-  Print(L"Number of DevPathHandles: %llu\r\n", NumDevPathHandles);
+  LOG_MESSAGE(GOP, DEBUG, L"Number of Name2Handles: %llu", NumName2Handles);
+  LOG_MESSAGE(GOP, DEBUG, L"Number of DevPathHandles: %llu", NumDevPathHandles);
 
-//  WhatProtocols(GraphicsHandles, NumHandlesInHandleBuffer); // Display all supported protocols of the GOP-supporting devices
-//  WhatProtocols(Name2Handles, NumName2Handles); // Display all supported protocols of all Name2 devices
-//  WhatProtocols(DriverHandles, NumDriverHandles); // Display all supported protocols of all drivers
-//  WhatProtocols(DevPathHandles, NumDevPathHandles); // Display all supported protocols of all devices with Device Paths (all Controllers, pretty much)
-#endif
+  if(LOG_ENABLED(GOP, DEBUG))
+  {
+    WhatProtocols(GraphicsHandles, NumHandlesInHandleBuffer); // Display all supported protocols of the GOP-supporting devices
+  }
 
   for(DevNum = 0; DevNum < NumHandlesInHandleBuffer; DevNum++)
   {
@@ -224,12 +230,6 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
     {
       UINTN CntlrPathSize = DevicePathSize(DevicePath_Graphics) - DevicePathNodeLength(DevicePath_Graphics) + 4; // Add 4 bytes to account for the end node
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-//      Print(L"DevPathStructBytes: 0x%x, PathBytes: 0x%016llx%016llx%016llx\r\n", *(DevicePath_Graphics), *(EFI_PHYSICAL_ADDRESS *)((CHAR8*)DevicePath_Graphics + 20), *(EFI_PHYSICAL_ADDRESS *)((CHAR8*)DevicePath_Graphics + 12), *(EFI_PHYSICAL_ADDRESS *)((CHAR8*)DevicePath_Graphics + 4)); // DevicePath struct is 4 bytes
-//      Print(L"a. DevPathGraphics: %s, CntlrPathSize: %llu\r\n", DevicePathToStr(DevicePath_Graphics), CntlrPathSize); // FYI: This allocates pool for the string; don't enable it unless you know you need it
-      Keywait(L"\0");
-#endif
-
       // Find the controller that corresponds to the GraphicsHandle's device path
 
       EFI_DEVICE_PATH *DevicePath_DevPath;
@@ -240,9 +240,7 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
         // Per https://github.com/tianocore/edk2/blob/master/ShellPkg/Library/UefiShellDriver1CommandsLib/DevTree.c
         // Controllers don't have DriverBinding or LoadedImage
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-        Print(L"b. CntlrIndex: %llu\r\n", CntlrIndex);
-#endif
+        LOG_MESSAGE(GOP, DEBUG, L"b. CntlrIndex: %llu", CntlrIndex);
 
         GOPStatus = BS->OpenProtocol(DevPathHandles[CntlrIndex], &DriverBindingProtocol, NULL, NULL, NULL, EFI_OPEN_PROTOCOL_TEST_PROTOCOL);
         if (!EFI_ERROR (GOPStatus))
@@ -273,9 +271,7 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
           continue;
         }
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-        Print(L"c. Filtered CntlrIndex: %llu\r\n", CntlrIndex);
-#endif
+        LOG_MESSAGE(GOP, DEBUG, L"c. Filtered CntlrIndex: %llu", CntlrIndex);
 
         // Get controller's device path
         GOPStatus = BS->OpenProtocol(DevPathHandles[CntlrIndex], &DevicePathProtocol, (void**)&DevicePath_DevPath, ImageHandle, NULL, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
@@ -289,11 +285,6 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
         // This will fail on certain kinds of systems, like Hyper-V VMs. This method is made with PCI-Express graphics devices in mind.
         UINTN ThisCntlrPathSize = DevicePathSize(DevicePath_DevPath);
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-//        Print(L"d. DevPathDevPath: %s, ThisCntlrPathSize: %llu\r\n", DevicePathToStr(DevicePath_DevPath), ThisCntlrPathSize); // FYI: This allocates pool for the string; don't enable it unless you know you need it
-        Keywait(L"\0");
-#endif
-
         if(ThisCntlrPathSize != CntlrPathSize)
         { // Might be something like PciRoot(0), which would match DevPath_Graphics for a PCI-E GPU without this check
           continue;
@@ -303,17 +294,13 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
         {
           // Found it. The desired controller is DevPathHandles[CntlrIndex]
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-          Print(L"e. Above DevPathDevPath matched DevPathGraphics %llu, CntlrIndex: %llu\r\n", DevNum, CntlrIndex);
-#endif
+          LOG_MESSAGE(GOP, DEBUG, L"e. Above DevPathDevPath matched DevPathGraphics %llu, CntlrIndex: %llu", DevNum, CntlrIndex);
 
           // Now match controller to its Name2-supporting driver
           for(UINT64 Name2DriverIndex = 0; Name2DriverIndex < NumName2Handles; Name2DriverIndex++)
           {
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-            Print(L"f. Name2DriverIndex: %llu\r\n", Name2DriverIndex);
-#endif
+            LOG_MESSAGE(GOP, DEBUG, L"f. Name2DriverIndex: %llu", Name2DriverIndex);
 
             // Check if Name2Handles[Name2DriverIndex] manages the DevPathHandles[CntlrIndex] controller
             // See EfiTestManagedDevice at
@@ -341,9 +328,7 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
             }
             // Yes, found it! Get names.
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-            Print(L"i. Success! CntlrIndex %llu, Name2DriverIndex: %llu, DevNum: %llu\r\n", CntlrIndex, Name2DriverIndex, DevNum);
-#endif
+            LOG_MESSAGE(GOP, DEBUG, L"i. Success! CntlrIndex %llu, Name2DriverIndex: %llu, DevNum: %llu", CntlrIndex, Name2DriverIndex, DevNum);
 
             EFI_COMPONENT_NAME2_PROTOCOL *Name2Device;
 
@@ -368,32 +353,20 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
             if(EFI_ERROR(GOPStatus))
             {
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-              Print(L"Name2Device GetDriverName error. 0x%llx\r\n", GOPStatus);
-
+              LOG_MESSAGE(GOP, DEBUG, L"Name2Device GetDriverName error. 0x%llx", GOPStatus);
               if(GOPStatus == EFI_UNSUPPORTED)
               {
                 // This is the format of the language, since it isn't "en-US" or "en"
                 // It will need to be implemented like the above arrays
-                Print(L"First 10 language characters look like this:\r\n");
-                for(UINT32 p = 0; p < 10; p++)
-                {
-                  Print(L"%c", Name2Device->SupportedLanguages[p]);
-                }
-                Print(L"\r\n");
-
-                Keywait(L"\0");
+                LOG_MESSAGE(GOP, DEBUG, L"Supported languages look like this: %a", Name2Device->SupportedLanguages);
               }
-#endif
               // You know, we have specifications for a reason.
               // Those who refuse to follow them get this.
               DriverDisplayName = DefaultDriverDisplayName;
             }
             // Got driver's name
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-            Print(L"j. Got driver name\r\n");
-#endif
+            LOG_MESSAGE(GOP, DEBUG, L"j. Got driver name");
 
             // Get controller's name
             GOPStatus = Name2Device->GetControllerName(Name2Device, DevPathHandles[CntlrIndex], NULL, LanguageToUse, &ControllerDisplayName); // The child should be NULL to get the controller's name.
@@ -408,18 +381,14 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
             if(EFI_ERROR(GOPStatus))
             {
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-              Print(L"Name2Device GetControllerName error. 0x%llx\r\n", GOPStatus); // Enable this to diagnose crashes due to controller name matching.
-#endif
+              LOG_MESSAGE(GOP, DEBUG, L"Name2Device GetControllerName error. 0x%llx", GOPStatus);
               // You know, we have specifications for a reason.
               // Those who refuse to follow them get this.
               ControllerDisplayName = DefaultControllerDisplayName;
             }
             // Got controller's name
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-            Print(L"k. Got controller name\r\n");
-#endif
+            LOG_MESSAGE(GOP, DEBUG, L"k. Got controller name");
 
             // Get child's name
             GOPStatus = Name2Device->GetControllerName(Name2Device, DevPathHandles[CntlrIndex], GraphicsHandles[DevNum], LanguageToUse, &ChildDisplayName);
@@ -434,17 +403,13 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
             if(EFI_ERROR(GOPStatus))
             {
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-              Print(L"Name2Device GetControllerName ChildName error. 0x%llx\r\n", GOPStatus);
-#endif
+              LOG_MESSAGE(GOP, DEBUG, L"Name2Device GetControllerName ChildName error. 0x%llx", GOPStatus);
               // You know, we have specifications for a reason.
               // Those who refuse to follow them get this.
               ChildDisplayName = DefaultChildDisplayName;
             }
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-            Print(L"l. Got names\r\n");
-#endif
+            LOG_MESSAGE(GOP, DEBUG, L"l. Got names");
 
             // Got child's name
             break;
@@ -463,13 +428,7 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
       if((ControllerDisplayName == DefaultControllerDisplayName) && (DriverDisplayName == DefaultDriverDisplayName) && (ChildDisplayName == DefaultChildDisplayName))
       {
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-        Print(L"\r\nFunky graphics device here.\r\n");
-
-//        Print(L"DevPathStructBytes: 0x%x, PathBytes: 0x%016llx%016llx%016llx\r\n", *(DevicePath_Graphics), *(EFI_PHYSICAL_ADDRESS *)((CHAR8*)DevicePath_Graphics + 20), *(EFI_PHYSICAL_ADDRESS *)((CHAR8*)DevicePath_Graphics + 12), *(EFI_PHYSICAL_ADDRESS *)((CHAR8*)DevicePath_Graphics + 4)); // DevicePath struct is 4 bytes
-//        Print(L"af. DevPathGraphics: %s\r\n", DevicePathToStr(DevicePath_Graphics)); // FYI: This allocates pool for the string; don't enable it unless you know you need it
-        Keywait(L"\0");
-#endif
+        LOG_MESSAGE(GOP, DEBUG, L"Funky graphics device here.");
         // Find the controller that corresponds to the GraphicsHandle's device path
 
         // These have already been defined.
@@ -481,9 +440,7 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
           // Per https://github.com/tianocore/edk2/blob/master/ShellPkg/Library/UefiShellDriver1CommandsLib/DevTree.c
           // Controllers don't have DriverBinding or LoadedImage
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-          Print(L"bf. CntlrIndex: %llu\r\n", CntlrIndex);
-#endif
+          LOG_MESSAGE(GOP, DEBUG, L"bf. CntlrIndex: %llu", CntlrIndex);
 
           GOPStatus = BS->OpenProtocol(DevPathHandles[CntlrIndex], &DriverBindingProtocol, NULL, NULL, NULL, EFI_OPEN_PROTOCOL_TEST_PROTOCOL);
           if (!EFI_ERROR (GOPStatus))
@@ -514,9 +471,7 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
             continue;
           }
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-          Print(L"cf. Filtered CntlrIndex: %llu\r\n", CntlrIndex);
-#endif
+          LOG_MESSAGE(GOP, DEBUG, L"cf. Filtered CntlrIndex: %llu", CntlrIndex);
           // Get controller's device path
           GOPStatus = BS->OpenProtocol(DevPathHandles[CntlrIndex], &DevicePathProtocol, (void**)&DevicePath_DevPath, ImageHandle, NULL, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
           if(EFI_ERROR(GOPStatus))
@@ -527,24 +482,16 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
 
           // Match device paths; DevPath is a Multi, Graphics is a Single
           // DevPath could be as generic as VMBus or something, which is fine for this case since it's not PCIe.
-#ifdef GOP_NAMING_DEBUG_ENABLED
-//          Print(L"df. DevPathDevPath: %s\r\n", DevicePathToStr(DevicePath_DevPath)); // FYI: This allocates pool for the string; don't enable it unless you know you need it
-          Keywait(L"\0");
-#endif
           if(LibMatchDevicePaths(DevicePath_DevPath, DevicePath_Graphics))
           {
             // Found something on controller DevPathHandles[CntlrIndex]
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-            Print(L"ef. Above DevPathDevPath matched DevPathGraphics %llu, CntlrIndex: %llu\r\n", DevNum, CntlrIndex);
-#endif
+            LOG_MESSAGE(GOP, DEBUG, L"ef. Above DevPathDevPath matched DevPathGraphics %llu, CntlrIndex: %llu", DevNum, CntlrIndex);
             // Now match controller to its Name2-supporting driver
             for(UINT64 Name2DriverIndex = 0; Name2DriverIndex < NumName2Handles; Name2DriverIndex++)
             {
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-              Print(L"ff. Name2DriverIndex: %llu\r\n", Name2DriverIndex);
-#endif
+              LOG_MESSAGE(GOP, DEBUG, L"ff. Name2DriverIndex: %llu", Name2DriverIndex);
               // Check if Name2Handles[Name2DriverIndex] manages the DevPathHandles[CntlrIndex] controller
               // See EfiTestManagedDevice at
               // https://github.com/tianocore-docs/edk2-UefiDriverWritersGuide/blob/master/11_uefi_driver_and_controller_names/113_getcontrollername_implementations/1132_bus_drivers_and_hybrid_drivers.md
@@ -574,9 +521,7 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
               }
               // Yes, found it! Get names.
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-              Print(L"if. Success! CntlrIndex %llu, Name2DriverIndex: %llu, DevNum: %llu\r\n", CntlrIndex, Name2DriverIndex, DevNum);
-#endif
+              LOG_MESSAGE(GOP, DEBUG, L"if. Success! CntlrIndex %llu, Name2DriverIndex: %llu, DevNum: %llu", CntlrIndex, Name2DriverIndex, DevNum);
 */
               EFI_COMPONENT_NAME2_PROTOCOL *Name2Device;
 
@@ -601,23 +546,13 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
               if(EFI_ERROR(GOPStatus))
               {
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-                Print(L"Funky Name2Device GetDriverName error. 0x%llx\r\n", GOPStatus);
-
+                LOG_MESSAGE(GOP, DEBUG, L"Funky Name2Device GetDriverName error. 0x%llx", GOPStatus);
                 if(GOPStatus == EFI_UNSUPPORTED)
                 {
                   // This is the format of the language, since it isn't "en-US" or "en"
                   // It will need to be implemented like the above arrays
-                  Print(L"First 10 language characters look like this:\r\n");
-                  for(UINT32 p = 0; p < 10; p++)
-                  {
-                    Print(L"%c", Name2Device->SupportedLanguages[p]);
-                  }
-                  Print(L"\r\n");
-
-                  Keywait(L"\0");
+                  LOG_MESSAGE(GOP, DEBUG, L"Supported languages look like this: %a", Name2Device->SupportedLanguages);
                 }
-#endif
                 // You know, we have specifications for a reason.
                 // Those who refuse to follow them get this.
                 DriverDisplayName = DefaultDriverDisplayName;
@@ -629,15 +564,11 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
 
                 for(KnownBadDriversIter = 0; KnownBadDriversIter < NUM_ON_WALL; KnownBadDriversIter++)
                 {
-#ifdef GOP_NAMING_DEBUG_ENABLED
-                  Print(L"%s - %s\r\n", DriverDisplayName, Wall_of_Shame[KnownBadDriversIter]);
-#endif
+                  LOG_MESSAGE(GOP, DEBUG, L"%s - %s", DriverDisplayName, Wall_of_Shame[KnownBadDriversIter]);
                   UINTN b = StrSize(Wall_of_Shame[KnownBadDriversIter]);
                   if(compare(DriverDisplayName, Wall_of_Shame[KnownBadDriversIter], (a < b) ? a : b)) // Need to compare data, not pointers
                   {
-#ifdef GOP_NAMING_DEBUG_ENABLED
-                    Print(L"Matched a known bad driver: %s\r\n", Wall_of_Shame[KnownBadDriversIter]);
-#endif
+                    LOG_MESSAGE(GOP, DEBUG, L"Matched a known bad driver: %s", Wall_of_Shame[KnownBadDriversIter]);
                     // Get MAD. I don't want your damn lemons! What am I supposed to do with these?!
                     // (Props to anyone who gets the reference)
                     DriverDisplayName = DefaultDriverDisplayName;
@@ -652,9 +583,7 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
               }
               // Got driver's name
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-              Print(L"jf. Got driver name\r\n");
-#endif
+              LOG_MESSAGE(GOP, DEBUG, L"jf. Got driver name");
               // Get controller's name
               GOPStatus = Name2Device->GetControllerName(Name2Device, DevPathHandles[CntlrIndex], NULL, LanguageToUse, &ControllerDisplayName); // The child should be NULL to get the controller's name.
               if(GOPStatus == EFI_UNSUPPORTED)
@@ -668,18 +597,14 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
               if(EFI_ERROR(GOPStatus))
               {
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-                Print(L"Funky Name2Device GetControllerName error. 0x%llx\r\n", GOPStatus); // Enable this to diagnose crashes due to controller name matching.
-#endif
+                LOG_MESSAGE(GOP, DEBUG, L"Funky Name2Device GetControllerName error. 0x%llx", GOPStatus);
                 // You know, we have specifications for a reason.
                 // Those who refuse to follow them get this.
                 ControllerDisplayName = DefaultControllerDisplayName;
               }
               // Got controller's name
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-              Print(L"kf. Got controller name\r\n");
-#endif
+              LOG_MESSAGE(GOP, DEBUG, L"kf. Got controller name");
               // Get child's name
               GOPStatus = Name2Device->GetControllerName(Name2Device, DevPathHandles[CntlrIndex], GraphicsHandles[DevNum], LanguageToUse, &ChildDisplayName);
               if(GOPStatus == EFI_UNSUPPORTED)
@@ -693,19 +618,14 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
               if(EFI_ERROR(GOPStatus))
               {
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-                Print(L"Funky Name2Device GetControllerName ChildName error. 0x%llx\r\n", GOPStatus);
-#endif
+                LOG_MESSAGE(GOP, DEBUG, L"Funky Name2Device GetControllerName ChildName error. 0x%llx", GOPStatus);
                 // You know, we have specifications for a reason.
                 // Those who refuse to follow them get this.
                 ChildDisplayName = DefaultChildDisplayName;
               }
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-              Print(L"lf. Got names\r\n");
-              Print(L"%s: %s: %s\r\n", ControllerDisplayName, DriverDisplayName, ChildDisplayName);
-              Keywait(L"\0");
-#endif
+              LOG_MESSAGE(GOP, DEBUG, L"lf. Got names");
+              LOG_MESSAGE(GOP, DEBUG, L"%s: %s: %s", ControllerDisplayName, DriverDisplayName, ChildDisplayName);
               // Got child's name
               // Hopefully this wasn't another case of the "PS/2 driver that tries to claim that all handles are its children" :P
               // There's no way to check without explicitly blacklisting by driver name or filtering by protocol (as was done above).
@@ -749,10 +669,7 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
       CatPrint(&StringName, L"%c. %s: %s @ Memory Address 0x%llx, using %s\r\n", DevNum + 0x30, ControllerDisplayName, ChildDisplayName, GraphicsHandles[DevNum], DriverDisplayName); // CatPrint allocates pool
       NameBuffer[DevNum] = StringName.str;
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-      Print(L"%s", NameBuffer[DevNum]);
-      Keywait(L"\0");
-#endif
+      LOG_MESSAGE(GOP, DEBUG, L"%s", NameBuffer[DevNum]);
 
     }
     else if(GOPStatus == EFI_UNSUPPORTED) // Need to do this because VMs can throw curveballs sometimes
@@ -773,9 +690,7 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
       CatPrint(&StringName, L"%c. Weird unknown device @ Memory Address 0x%llx (is this in a VM?)\r\n", DevNum + 0x30, GraphicsHandles[DevNum]); // CatPrint allocates pool
       NameBuffer[DevNum] = StringName.str;
 
-#ifdef GOP_NAMING_DEBUG_ENABLED
-      Print(L"%s", NameBuffer[DevNum]);
-#endif
+      LOG_MESSAGE(GOP, DEBUG, L"%s", NameBuffer[DevNum]);
 
     }
     else if(EFI_ERROR(GOPStatus))
@@ -812,7 +727,7 @@ EFI_STATUS InitUEFI_GOP(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics)
 
 fruitcake: ;
 
-  if(IsApple)
+  if(IsApple && !FastBootActive && (LoaderConfig.Gop == LOADER_CONFIG_GOP_MENU))
   {
     //
     // Apple GPU names aren't supported, as they don't work like everyone else's.
@@ -844,12 +759,21 @@ fruitcake: ;
   Print(L"\r\n");
 */
   // If applicable, select a GPU. Otherwise, skip all the way to single GPU configuration.
-  if(NumHandlesInHandleBuffer > 1)
+  if((NumHandlesInHandleBuffer > 1) && FastBootActive)
+  {
+    DevNum = FastBoot.GpuOption;
+  }
+  else if((NumHandlesInHandleBuffer > 1) && (LoaderConfig.Gop != LOADER_CONFIG_GOP_MENU))
+  {
+    // Kernel64.txt already says: gop = native is option 2, gop = WxH is option 3
+    DevNum = (LoaderConfig.Gop == LOADER_CONFIG_GOP_NATIVE) ? 2 : 3;
+  }
+  else if(NumHandlesInHandleBuffer > 1)
   {
     // Using this as the choice holder
     // This sets the default option.
     DevNum = 2;
-    UINT64 timeout_seconds = GPU_MENU_TIMEOUT_SECONDS;
+    UINT64 timeout_seconds = LoaderConfig.GopTimeout;
     UINT8 already_set_os = 0;
     // FYI: The EFI watchdog has something like a 5 minute timeout before it resets the system if ExitBootServices() hasn't been reached.
     // Not all systems have a watchdog enabled, but enough do that knowing about the watchdog (and assuming there's always one) is useful.
@@ -867,7 +791,7 @@ fruitcake: ;
       Print(L"0. Configure all individually\r\n");
       Print(L"1. Configure one\r\n");
       Print(L"2. Configure all to use default resolutions of active displays (usually native)\r\n");
-      Print(L"3. Configure all to use 1024x768\r\n");
+      Print(L"3. Configure all to use %ux%u\r\n", (LoaderConfig.Gop == LOADER_CONFIG_GOP_RESOLUTION) ? LoaderConfig.GopWidth : 1024, (LoaderConfig.Gop == LOADER_CONFIG_GOP_RESOLUTION) ? LoaderConfig.GopHeight : 768);
 
       if(IsApple)
       {
@@ -926,6 +850,11 @@ fruitcake: ;
       DevNum = (UINT64)(Key.UnicodeChar - 0x30); // Convert user input character from unicode to number
     }
 
+    if(DevNum >= 2)
+    {
+      FastBoot.GpuOption = (UINT32)DevNum; // For loader.fastboot=on
+    }
+
     Key.UnicodeChar = 0; // Reset input
     GOPStatus = ST->ConIn->Reset(ST->ConIn, FALSE); // Reset input buffer
     if (EFI_ERROR(GOPStatus))
@@ -972,47 +901,44 @@ fruitcake: ;
         return GOPStatus;
       }
 
-#ifdef GOP_DEBUG_ENABLED
-      Keywait(L"OpenProtocol passed.\r\n");
-
-      Print(L"Current GOP Mode Info:\r\n");
-      Print(L"Max Mode supported: %u, Current Mode: %u\r\nSize of Mode Info Structure: %llu Bytes\r\n", GOPTable->Mode->MaxMode - 1, GOPTable->Mode->Mode, GOPTable->Mode->SizeOfInfo);
-      Print(L"FrameBufferBase: 0x%016llx, FrameBufferSize: 0x%llx\r\n", GOPTable->Mode->FrameBufferBase, GOPTable->Mode->FrameBufferSize); // Per spec, the FrameBufferBase might be 0 until SetMode is called
+      if(LOG_ENABLED(GOP, DEBUG))
+      {
+        LOG_MESSAGE(GOP, DEBUG, L"OpenProtocol passed.");
 
-      Keywait(L"\0");
+        LOG_MESSAGE(GOP, DEBUG, L"Current GOP Mode Info:");
+        LOG_MESSAGE(GOP, DEBUG, L"Max Mode supported: %u, Current Mode: %u", GOPTable->Mode->MaxMode - 1, GOPTable->Mode->Mode);
+        LOG_MESSAGE(GOP, DEBUG, L"Size of Mode Info Structure: %llu Bytes", GOPTable->Mode->SizeOfInfo);
+        LOG_MESSAGE(GOP, DEBUG, L"FrameBufferBase: 0x%016llx, FrameBufferSize: 0x%llx", GOPTable->Mode->FrameBufferBase, GOPTable->Mode->FrameBufferSize); // Per spec, the FrameBufferBase might be 0 until SetMode is called
 
-      EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *GOPInfo; // Querymode allocates GOPInfo
-      // Get detailed info about supported graphics modes
-      for(mode = 0; mode < GOPTable->Mode->MaxMode; mode++) // Valid modes are from 0 to MaxMode - 1
-      {
-        GOPStatus = GOPTable->QueryMode(GOPTable, mode, &GOPInfoSize, &GOPInfo); // IN IN OUT OUT
-        if(EFI_ERROR(GOPStatus))
+        EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *GOPInfo; // Querymode allocates GOPInfo
+        // Get detailed info about supported graphics modes
+        for(mode = 0; mode < GOPTable->Mode->MaxMode; mode++) // Valid modes are from 0 to MaxMode - 1
         {
-          Print(L"GraphicsTable QueryMode error. 0x%llx\r\n", GOPStatus);
-          return GOPStatus;
-        }
-        Print(L"Mode %u of %u (%llu Bytes):\r\n Ver: 0x%x, Res: %ux%u\r\n", mode, GOPTable->Mode->MaxMode - 1, GOPInfoSize, GOPInfo->Version, GOPInfo->HorizontalResolution, GOPInfo->VerticalResolution);
-        Print(L"PxPerScanLine: %u\r\n", GOPInfo->PixelsPerScanLine);
-        Print(L"PxFormat: 0x%x, PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x\r\n", GOPInfo->PixelFormat, GOPInfo->PixelInformation.RedMask, GOPInfo->PixelInformation.GreenMask, GOPInfo->PixelInformation.BlueMask, GOPInfo->PixelInformation.ReservedMask);
-        Keywait(L"\0");
+          GOPStatus = GOPTable->QueryMode(GOPTable, mode, &GOPInfoSize, &GOPInfo); // IN IN OUT OUT
+          if(EFI_ERROR(GOPStatus))
+          {
+            Print(L"GraphicsTable QueryMode error. 0x%llx\r\n", GOPStatus);
+            return GOPStatus;
+          }
+          LOG_MESSAGE(GOP, DEBUG, L"Mode %u of %u (%llu Bytes): Ver: 0x%x, Res: %ux%u", mode, GOPTable->Mode->MaxMode - 1, GOPInfoSize, GOPInfo->Version, GOPInfo->HorizontalResolution, GOPInfo->VerticalResolution);
+          LOG_MESSAGE(GOP, DEBUG, L"PxPerScanLine: %u", GOPInfo->PixelsPerScanLine);
+          LOG_MESSAGE(GOP, DEBUG, L"PxFormat: 0x%x, PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x", GOPInfo->PixelFormat, GOPInfo->PixelInformation.RedMask, GOPInfo->PixelInformation.GreenMask, GOPInfo->PixelInformation.BlueMask, GOPInfo->PixelInformation.ReservedMask);
 
-        // Don't need GOPInfo anymore
-        GOPStatus = BS->FreePool(GOPInfo);
-        if(EFI_ERROR(GOPStatus))
-        {
-          Print(L"Error freeing GOPInfo pool. 0x%llx\r\n", GOPStatus);
-          return GOPStatus;
+          // Don't need GOPInfo anymore
+          GOPStatus = BS->FreePool(GOPInfo);
+          if(EFI_ERROR(GOPStatus))
+          {
+            Print(L"Error freeing GOPInfo pool. 0x%llx\r\n", GOPStatus);
+            return GOPStatus;
+          }
         }
-      }
 
-      Keywait(L"Getting list of supported modes...\r\n");
-#endif
+        LOG_MESSAGE(GOP, DEBUG, L"Getting list of supported modes...");
+      }
 
       if(GOPTable->Mode->MaxMode == 1) // Grammar
       {
-#ifdef GOP_DEBUG_ENABLED
-        Print(L"%u available graphics mode found.\r\n", GOPTable->Mode->MaxMode);
-#endif
+        LOG_MESSAGE(GOP, DEBUG, L"%u available graphics mode found.", GOPTable->Mode->MaxMode);
         mode = 0; // If there's only one mode, it's going to be mode 0.
       }
       else
@@ -1067,9 +993,7 @@ fruitcake: ;
         return GOPStatus;
       }
 
-#ifdef GOP_DEBUG_ENABLED
-      Print(L"Current GOP Info Size: %llu\r\n", GOPTable->Mode->SizeOfInfo);
-#endif
+      LOG_MESSAGE(GOP, DEBUG, L"Current GOP Info Size: %llu", GOPTable->Mode->SizeOfInfo);
 
       // Allocate graphics mode info
       GOPStatus = ST->BootServices->AllocatePool(EfiLoaderData, GOPTable->Mode->SizeOfInfo, (void**)&Graphics->GPUArray[DevNum].Info);
@@ -1079,9 +1003,7 @@ fruitcake: ;
         return GOPStatus;
       }
 
-#ifdef GOP_DEBUG_ENABLED
-      Keywait(L"Current mode info allocated.\r\n");
-#endif
+      LOG_MESSAGE(GOP, DEBUG, L"Current mode info allocated.");
 
       // Store graphics mode info
       // Can't blanketly store Mode struct because Mode->Info pointer in array will get overwritten
@@ -1093,9 +1015,7 @@ fruitcake: ;
       // Can blanketly override Info struct, though (no pointers in it, just raw data)
       *(Graphics->GPUArray[DevNum].Info) = *(GOPTable->Mode->Info);
 
-#ifdef GOP_DEBUG_ENABLED
-      Keywait(L"Current mode info assigned.\r\n");
-#endif
+      LOG_MESSAGE(GOP, DEBUG, L"Current mode info assigned.");
 
     } // End for each individual DevNum
   }
@@ -1133,9 +1053,7 @@ fruitcake: ;
     DevNum = (UINT64)(Key.UnicodeChar - 0x30); // Convert user input character from UTF-16 to number
     Key.UnicodeChar = 0; // Reset input
 
-#ifdef GOP_DEBUG_ENABLED
-    Print(L"Using handle %llu...\r\n", DevNum);
-#endif
+    LOG_MESSAGE(GOP, DEBUG, L"Using handle %llu...", DevNum);
 
     EFI_GRAPHICS_OUTPUT_PROTOCOL *GOPTable;
 
@@ -1146,47 +1064,44 @@ fruitcake: ;
       return GOPStatus;
     }
 
-#ifdef GOP_DEBUG_ENABLED
-    Keywait(L"OpenProtocol passed.\r\n");
-
-    Print(L"Current GOP Mode Info:\r\n");
-    Print(L"Max Mode supported: %u, Current Mode: %u\r\nSize of Mode Info Structure: %llu Bytes\r\n", GOPTable->Mode->MaxMode - 1, GOPTable->Mode->Mode, GOPTable->Mode->SizeOfInfo);
-    Print(L"FrameBufferBase: 0x%016llx, FrameBufferSize: 0x%llx\r\n", GOPTable->Mode->FrameBufferBase, GOPTable->Mode->FrameBufferSize); // Per spec, the FrameBufferBase might be 0 until SetMode is called
+    if(LOG_ENABLED(GOP, DEBUG))
+    {
+      LOG_MESSAGE(GOP, DEBUG, L"OpenProtocol passed.");
 
-    Keywait(L"\0");
+      LOG_MESSAGE(GOP, DEBUG, L"Current GOP Mode Info:");
+      LOG_MESSAGE(GOP, DEBUG, L"Max Mode supported: %u, Current Mode: %u", GOPTable->Mode->MaxMode - 1, GOPTable->Mode->Mode);
+      LOG_MESSAGE(GOP, DEBUG, L"Size of Mode Info Structure: %llu Bytes", GOPTable->Mode->SizeOfInfo);
+      LOG_MESSAGE(GOP, DEBUG, L"FrameBufferBase: 0x%016llx, FrameBufferSize: 0x%llx", GOPTable->Mode->FrameBufferBase, GOPTable->Mode->FrameBufferSize); // Per spec, the FrameBufferBase might be 0 until SetMode is called
 
-    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *GOPInfo; // Querymode allocates GOPInfo
-    // Get detailed info about supported graphics modes
-    for(mode = 0; mode < GOPTable->Mode->MaxMode; mode++) // Valid modes are from 0 to MaxMode - 1
-    {
-      GOPStatus = GOPTable->QueryMode(GOPTable, mode, &GOPInfoSize, &GOPInfo); // IN IN OUT OUT
-      if(EFI_ERROR(GOPStatus))
+      EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *GOPInfo; // Querymode allocates GOPInfo
+      // Get detailed info about supported graphics modes
+      for(mode = 0; mode < GOPTable->Mode->MaxMode; mode++) // Valid modes are from 0 to MaxMode - 1
       {
-        Print(L"GraphicsTable QueryMode error. 0x%llx\r\n", GOPStatus);
-        return GOPStatus;
-      }
-      Print(L"Mode %u of %u (%llu Bytes):\r\n Ver: 0x%x, Res: %ux%u\r\n", mode, GOPTable->Mode->MaxMode - 1, GOPInfoSize, GOPInfo->Version, GOPInfo->HorizontalResolution, GOPInfo->VerticalResolution);
-      Print(L"PxPerScanLine: %u\r\n", GOPInfo->PixelsPerScanLine);
-      Print(L"PxFormat: 0x%x, PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x\r\n", GOPInfo->PixelFormat, GOPInfo->PixelInformation.RedMask, GOPInfo->PixelInformation.GreenMask, GOPInfo->PixelInformation.BlueMask, GOPInfo->PixelInformation.ReservedMask);
-      Keywait(L"\0");
+        GOPStatus = GOPTable->QueryMode(GOPTable, mode, &GOPInfoSize, &GOPInfo); // IN IN OUT OUT
+        if(EFI_ERROR(GOPStatus))
+        {
+          Print(L"GraphicsTable QueryMode error. 0x%llx\r\n", GOPStatus);
+          return GOPStatus;
+        }
+        LOG_MESSAGE(GOP, DEBUG, L"Mode %u of %u (%llu Bytes): Ver: 0x%x, Res: %ux%u", mode, GOPTable->Mode->MaxMode - 1, GOPInfoSize, GOPInfo->Version, GOPInfo->HorizontalResolution, GOPInfo->VerticalResolution);
+        LOG_MESSAGE(GOP, DEBUG, L"PxPerScanLine: %u", GOPInfo->PixelsPerScanLine);
+        LOG_MESSAGE(GOP, DEBUG, L"PxFormat: 0x%x, PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x", GOPInfo->PixelFormat, GOPInfo->PixelInformation.RedMask, GOPInfo->PixelInformation.GreenMask, GOPInfo->PixelInformation.BlueMask, GOPInfo->PixelInformation.ReservedMask);
 
-      // Don't need GOPInfo anymore
-      GOPStatus = BS->FreePool(GOPInfo);
-      if(EFI_ERROR(GOPStatus))
-      {
-        Print(L"Error freeing GOPInfo pool. 0x%llx\r\n", GOPStatus);
-        return GOPStatus;
+        // Don't need GOPInfo anymore
+        GOPStatus = BS->FreePool(GOPInfo);
+        if(EFI_ERROR(GOPStatus))
+        {
+          Print(L"Error freeing GOPInfo pool. 0x%llx\r\n", GOPStatus);
+          return GOPStatus;
+        }
       }
-    }
 
-    Keywait(L"\r\nGetting list of supported modes...\r\n");
-#endif
+      LOG_MESSAGE(GOP, DEBUG, L"Getting list of supported modes...");
+    }
 
     if(GOPTable->Mode->MaxMode == 1) // Grammar
     {
-#ifdef GOP_DEBUG_ENABLED
-      Print(L"%u available graphics mode found.\r\n", GOPTable->Mode->MaxMode);
-#endif
+      LOG_MESSAGE(GOP, DEBUG, L"%u available graphics mode found.", GOPTable->Mode->MaxMode);
       mode = 0; // If there's only one mode, it's going to be mode 0.
     }
     else
@@ -1241,9 +1156,7 @@ fruitcake: ;
       return GOPStatus;
     }
 
-#ifdef GOP_DEBUG_ENABLED
-    Print(L"Current GOP Info Size: %llu\r\n", GOPTable->Mode->SizeOfInfo);
-#endif
+    LOG_MESSAGE(GOP, DEBUG, L"Current GOP Info Size: %llu", GOPTable->Mode->SizeOfInfo);
 
     DevNum = 0; // There's only one item in the array
     // Allocate graphics mode info
@@ -1254,9 +1167,7 @@ fruitcake: ;
       return GOPStatus;
     }
 
-#ifdef GOP_DEBUG_ENABLED
-    Keywait(L"Current mode info allocated.\r\n");
-#endif
+    LOG_MESSAGE(GOP, DEBUG, L"Current mode info allocated.");
 
     // Store graphics mode info
     // Can't blanketly store Mode struct because Mode->Info pointer in array will get overwritten
@@ -1268,9 +1179,7 @@ fruitcake: ;
     // Can blanketly override Info struct, though (no pointers in it, just raw data)
     *(Graphics->GPUArray[DevNum].Info) = *(GOPTable->Mode->Info);
 
-#ifdef GOP_DEBUG_ENABLED
-    Keywait(L"Current mode info assigned.\r\n");
-#endif
+    LOG_MESSAGE(GOP, DEBUG, L"Current mode info assigned.");
 
   // End configure one only
   }
@@ -1300,15 +1209,12 @@ fruitcake: ;
         return GOPStatus;
       }
 
-#ifdef GOP_DEBUG_ENABLED
-      Keywait(L"OpenProtocol passed.\r\n");
+      LOG_MESSAGE(GOP, DEBUG, L"OpenProtocol passed.");
 
-      Print(L"Current GOP Mode Info:\r\n");
-      Print(L"Max Mode supported: %u, Current Mode: %u\r\nSize of Mode Info Structure: %llu Bytes\r\n", GOPTable->Mode->MaxMode - 1, GOPTable->Mode->Mode, GOPTable->Mode->SizeOfInfo);
-      Print(L"FrameBufferBase: 0x%016llx, FrameBufferSize: 0x%llx\r\n", GOPTable->Mode->FrameBufferBase, GOPTable->Mode->FrameBufferSize); // Per spec, the FrameBufferBase might be 0 until SetMode is called
-
-      Keywait(L"\0");
-#endif
+      LOG_MESSAGE(GOP, DEBUG, L"Current GOP Mode Info:");
+      LOG_MESSAGE(GOP, DEBUG, L"Max Mode supported: %u, Current Mode: %u", GOPTable->Mode->MaxMode - 1, GOPTable->Mode->Mode);
+      LOG_MESSAGE(GOP, DEBUG, L"Size of Mode Info Structure: %llu Bytes", GOPTable->Mode->SizeOfInfo);
+      LOG_MESSAGE(GOP, DEBUG, L"FrameBufferBase: 0x%016llx, FrameBufferSize: 0x%llx", GOPTable->Mode->FrameBufferBase, GOPTable->Mode->FrameBufferSize); // Per spec, the FrameBufferBase might be 0 until SetMode is called
 
       // Set mode 0
       mode = 0;
@@ -1324,12 +1230,9 @@ fruitcake: ;
         return GOPStatus;
       }
 
-#ifdef GOP_DEBUG_ENABLED
-      Print(L"Mode %u of %u (%llu Bytes):\r\n Ver: 0x%x, Res: %ux%u\r\n", GOPTable->Mode->Mode, GOPTable->Mode->MaxMode - 1, GOPTable->Mode->SizeOfInfo, GOPTable->Mode->Info->Version, GOPTable->Mode->Info->HorizontalResolution, GOPTable->Mode->Info->VerticalResolution);
-      Print(L"PxPerScanLine: %u\r\n", GOPTable->Mode->Info->PixelsPerScanLine);
-      Print(L"PxFormat: 0x%x, PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x\r\n", GOPTable->Mode->Info->PixelFormat, GOPTable->Mode->Info->PixelInformation.RedMask, GOPTable->Mode->Info->PixelInformation.GreenMask, GOPTable->Mode->Info->PixelInformation.BlueMask, GOPTable->Mode->Info->PixelInformation.ReservedMask);
-      Keywait(L"\0");
-#endif
+      LOG_MESSAGE(GOP, DEBUG, L"Mode %u of %u (%llu Bytes): Ver: 0x%x, Res: %ux%u", GOPTable->Mode->Mode, GOPTable->Mode->MaxMode - 1, GOPTable->Mode->SizeOfInfo, GOPTable->Mode->Info->Version, GOPTable->Mode->Info->HorizontalResolution, GOPTable->Mode->Info->VerticalResolution);
+      LOG_MESSAGE(GOP, DEBUG, L"PxPerScanLine: %u", GOPTable->Mode->Info->PixelsPerScanLine);
+      LOG_MESSAGE(GOP, DEBUG, L"PxFormat: 0x%x, PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x", GOPTable->Mode->Info->PixelFormat, GOPTable->Mode->Info->PixelInformation.RedMask, GOPTable->Mode->Info->PixelInformation.GreenMask, GOPTable->Mode->Info->PixelInformation.BlueMask, GOPTable->Mode->Info->PixelInformation.ReservedMask);
 
       // Allocate graphics mode info
       GOPStatus = ST->BootServices->AllocatePool(EfiLoaderData, GOPTable->Mode->SizeOfInfo, (void**)&Graphics->GPUArray[DevNum].Info);
@@ -1339,9 +1242,7 @@ fruitcake: ;
         return GOPStatus;
       }
 
-#ifdef GOP_DEBUG_ENABLED
-      Keywait(L"Current mode info allocated.\r\n");
-#endif
+      LOG_MESSAGE(GOP, DEBUG, L"Current mode info allocated.");
 
       // Store graphics mode info
       // Can't blanketly store Mode struct because Mode->Info pointer in array will get overwritten
@@ -1353,9 +1254,7 @@ fruitcake: ;
       // Can blanketly override Info struct, though (no pointers in it, just raw data)
       *(Graphics->GPUArray[DevNum].Info) = *(GOPTable->Mode->Info);
 
-#ifdef GOP_DEBUG_ENABLED
-      Keywait(L"Current mode info assigned.\r\n");
-#endif
+      LOG_MESSAGE(GOP, DEBUG, L"Current mode info assigned.");
 
     } // End for each individual DevNum
 
@@ -1363,8 +1262,10 @@ fruitcake: ;
   }
   else if((NumHandlesInHandleBuffer > 1) && (DevNum == 3))
   {
-    // Configure all to use 1024x768
+    // Configure all to use 1024x768, or Kernel64.txt's gop = WxH
     // Despite the UEFI spec's mandating only 640x480 and 800x600, everyone who supports Windows must also support 1024x768
+    UINT32 Width = (LoaderConfig.Gop == LOADER_CONFIG_GOP_RESOLUTION) ? LoaderConfig.GopWidth : 1024;
+    UINT32 Height = (LoaderConfig.Gop == LOADER_CONFIG_GOP_RESOLUTION) ? LoaderConfig.GopHeight : 768;
 
     // Setup
     Graphics->NumberOfFrameBuffers = NumHandlesInHandleBuffer;
@@ -1388,49 +1289,21 @@ fruitcake: ;
         return GOPStatus;
       }
 
-#ifdef GOP_DEBUG_ENABLED
-      Keywait(L"OpenProtocol passed.\r\n");
-
-      Print(L"Current GOP Mode Info:\r\n");
-      Print(L"Max Mode supported: %u, Current Mode: %u\r\nSize of Mode Info Structure: %llu Bytes\r\n", GOPTable->Mode->MaxMode - 1, GOPTable->Mode->Mode, GOPTable->Mode->SizeOfInfo);
-      Print(L"FrameBufferBase: 0x%016llx, FrameBufferSize: 0x%llx\r\n", GOPTable->Mode->FrameBufferBase, GOPTable->Mode->FrameBufferSize); // Per spec, the FrameBufferBase might be 0 until SetMode is called
+      LOG_MESSAGE(GOP, DEBUG, L"OpenProtocol passed.");
 
-      Keywait(L"\0");
-#endif
+      LOG_MESSAGE(GOP, DEBUG, L"Current GOP Mode Info:");
+      LOG_MESSAGE(GOP, DEBUG, L"Max Mode supported: %u, Current Mode: %u", GOPTable->Mode->MaxMode - 1, GOPTable->Mode->Mode);
+      LOG_MESSAGE(GOP, DEBUG, L"Size of Mode Info Structure: %llu Bytes", GOPTable->Mode->SizeOfInfo);
+      LOG_MESSAGE(GOP, DEBUG, L"FrameBufferBase: 0x%016llx, FrameBufferSize: 0x%llx", GOPTable->Mode->FrameBufferBase, GOPTable->Mode->FrameBufferSize); // Per spec, the FrameBufferBase might be 0 until SetMode is called
 
-      // Get supported graphics modes
-      EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *GOPInfo2; // Querymode allocates GOPInfo
-      for(mode = 0; mode < GOPTable->Mode->MaxMode; mode++) // Valid modes are from 0 to MaxMode - 1
+      GOPStatus = FindGraphicsMode(GOPTable, Width, Height, &mode);
+      if(EFI_ERROR(GOPStatus))
       {
-        GOPStatus = GOPTable->QueryMode(GOPTable, mode, &GOPInfoSize, &GOPInfo2); // IN IN OUT OUT
-        if(EFI_ERROR(GOPStatus))
-        {
-          Print(L"GraphicsTable QueryMode error. 0x%llx\r\n", GOPStatus);
-          return GOPStatus;
-        }
-        if((GOPInfo2->HorizontalResolution == 1024) && (GOPInfo2->VerticalResolution == 768))
-        {
-          // Don't need GOPInfo2 anymore
-          GOPStatus = BS->FreePool(GOPInfo2);
-          if(EFI_ERROR(GOPStatus))
-          {
-            Print(L"Error freeing GOPInfo2 pool. 0x%llx\r\n", GOPStatus);
-            return GOPStatus;
-          }
-          break; // Use this mode
-        }
-
-        // Don't need GOPInfo2 anymore
-        GOPStatus = BS->FreePool(GOPInfo2);
-        if(EFI_ERROR(GOPStatus))
-        {
-          Print(L"Error freeing GOPInfo2 pool. 0x%llx\r\n", GOPStatus);
-          return GOPStatus;
-        }
+        return GOPStatus;
       }
       if(mode == GOPTable->Mode->MaxMode) // Hyper-V only has a 1024x768 mode, and it's mode 0
       {
-        Print(L"Odd. No 1024x768 mode found. Using mode 0...\r\n");
+        Print(L"Odd. No %ux%u mode found. Using mode 0...\r\n", Width, Height);
         mode = 0;
       }
 
@@ -1445,12 +1318,9 @@ fruitcake: ;
         return GOPStatus;
       }
 
-#ifdef GOP_DEBUG_ENABLED
-      Print(L"Mode %u of %u (%llu Bytes):\r\n Ver: 0x%x, Res: %ux%u\r\n", GOPTable->Mode->Mode, GOPTable->Mode->MaxMode - 1, GOPTable->Mode->SizeOfInfo, GOPTable->Mode->Info->Version, GOPTable->Mode->Info->HorizontalResolution, GOPTable->Mode->Info->VerticalResolution);
-      Print(L"PxPerScanLine: %u\r\n", GOPTable->Mode->Info->PixelsPerScanLine);
-      Print(L"PxFormat: 0x%x, PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x\r\n", GOPTable->Mode->Info->PixelFormat, GOPTable->Mode->Info->PixelInformation.RedMask, GOPTable->Mode->Info->PixelInformation.GreenMask, GOPTable->Mode->Info->PixelInformation.BlueMask, GOPTable->Mode->Info->PixelInformation.ReservedMask);
-      Keywait(L"\0");
-#endif
+      LOG_MESSAGE(GOP, DEBUG, L"Mode %u of %u (%llu Bytes): Ver: 0x%x, Res: %ux%u", GOPTable->Mode->Mode, GOPTable->Mode->MaxMode - 1, GOPTable->Mode->SizeOfInfo, GOPTable->Mode->Info->Version, GOPTable->Mode->Info->HorizontalResolution, GOPTable->Mode->Info->VerticalResolution);
+      LOG_MESSAGE(GOP, DEBUG, L"PxPerScanLine: %u", GOPTable->Mode->Info->PixelsPerScanLine);
+      LOG_MESSAGE(GOP, DEBUG, L"PxFormat: 0x%x, PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x", GOPTable->Mode->Info->PixelFormat, GOPTable->Mode->Info->PixelInformation.RedMask, GOPTable->Mode->Info->PixelInformation.GreenMask, GOPTable->Mode->Info->PixelInformation.BlueMask, GOPTable->Mode->Info->PixelInformation.ReservedMask);
 
       // Allocate graphics mode info
       GOPStatus = ST->BootServices->AllocatePool(EfiLoaderData, GOPTable->Mode->SizeOfInfo, (void**)&Graphics->GPUArray[DevNum].Info);
@@ -1460,9 +1330,7 @@ fruitcake: ;
         return GOPStatus;
       }
 
-#ifdef GOP_DEBUG_ENABLED
-      Keywait(L"Current mode info allocated.\r\n");
-#endif
+      LOG_MESSAGE(GOP, DEBUG, L"Current mode info allocated.");
 
       // Store graphics mode info
       // Can't blanketly store Mode struct because Mode->Info pointer in array will get overwritten
@@ -1474,13 +1342,11 @@ fruitcake: ;
       // Can blanketly override Info struct, though (no pointers in it, just raw data)
       *(Graphics->GPUArray[DevNum].Info) = *(GOPTable->Mode->Info);
 
-#ifdef GOP_DEBUG_ENABLED
-      Keywait(L"Current mode info assigned.\r\n");
-#endif
+      LOG_MESSAGE(GOP, DEBUG, L"Current mode info assigned.");
 
     } // End for each individual DevNum
 
-    // End 1024x768
+    // End 1024x768 (or WxH)
   }
   else
   {
@@ -1501,9 +1367,7 @@ fruitcake: ;
     // Only one device
     DevNum = 0;
 
-#ifdef GOP_DEBUG_ENABLED
-    Print(L"One GPU detected.\r\n");
-#endif
+    LOG_MESSAGE(GOP, DEBUG, L"One GPU detected.");
 
     EFI_GRAPHICS_OUTPUT_PROTOCOL *GOPTable;
 
@@ -1514,54 +1378,72 @@ fruitcake: ;
       return GOPStatus;
     }
 
-#ifdef GOP_DEBUG_ENABLED
-    Keywait(L"OpenProtocol passed.\r\n");
-
-    Print(L"Current GOP Mode Info:\r\n");
-    Print(L"Max Mode supported: %u, Current Mode: %u\r\nSize of Mode Info Structure: %llu Bytes\r\n", GOPTable->Mode->MaxMode - 1, GOPTable->Mode->Mode, GOPTable->Mode->SizeOfInfo);
-    Print(L"FrameBufferBase: 0x%016llx, FrameBufferSize: 0x%llx\r\n", GOPTable->Mode->FrameBufferBase, GOPTable->Mode->FrameBufferSize); // Per spec, the FrameBufferBase might be 0 until SetMode is called
+    if(LOG_ENABLED(GOP, DEBUG))
+    {
+      LOG_MESSAGE(GOP, DEBUG, L"OpenProtocol passed.");
 
-    Keywait(L"\0");
+      LOG_MESSAGE(GOP, DEBUG, L"Current GOP Mode Info:");
+      LOG_MESSAGE(GOP, DEBUG, L"Max Mode supported: %u, Current Mode: %u", GOPTable->Mode->MaxMode - 1, GOPTable->Mode->Mode);
+      LOG_MESSAGE(GOP, DEBUG, L"Size of Mode Info Structure: %llu Bytes", GOPTable->Mode->SizeOfInfo);
+      LOG_MESSAGE(GOP, DEBUG, L"FrameBufferBase: 0x%016llx, FrameBufferSize: 0x%llx", GOPTable->Mode->FrameBufferBase, GOPTable->Mode->FrameBufferSize); // Per spec, the FrameBufferBase might be 0 until SetMode is called
 
-    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *GOPInfo; // Querymode allocates GOPInfo
-    // Get detailed info about supported graphics modes
-    for(mode = 0; mode < GOPTable->Mode->MaxMode; mode++) // Valid modes are from 0 to MaxMode - 1
-    {
-      GOPStatus = GOPTable->QueryMode(GOPTable, mode, &GOPInfoSize, &GOPInfo); // IN IN OUT OUT
-      if(EFI_ERROR(GOPStatus))
+      EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *GOPInfo; // Querymode allocates GOPInfo
+      // Get detailed info about supported graphics modes
+      for(mode = 0; mode < GOPTable->Mode->MaxMode; mode++) // Valid modes are from 0 to MaxMode - 1
       {
-        Print(L"GraphicsTable QueryMode error. 0x%llx\r\n", GOPStatus);
-        return GOPStatus;
-      }
-      Print(L"Mode %u of %u (%llu Bytes):\r\n Ver: 0x%x, Res: %ux%u\r\n", mode, GOPTable->Mode->MaxMode - 1, GOPInfoSize, GOPInfo->Version, GOPInfo->HorizontalResolution, GOPInfo->VerticalResolution);
-      Print(L"PxPerScanLine: %u\r\n", GOPInfo->PixelsPerScanLine);
-      Print(L"PxFormat: 0x%x, PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x\r\n", GOPInfo->PixelFormat, GOPInfo->PixelInformation.RedMask, GOPInfo->PixelInformation.GreenMask, GOPInfo->PixelInformation.BlueMask, GOPInfo->PixelInformation.ReservedMask);
-      Keywait(L"\0");
+        GOPStatus = GOPTable->QueryMode(GOPTable, mode, &GOPInfoSize, &GOPInfo); // IN IN OUT OUT
+        if(EFI_ERROR(GOPStatus))
+        {
+          Print(L"GraphicsTable QueryMode error. 0x%llx\r\n", GOPStatus);
+          return GOPStatus;
+        }
+        LOG_MESSAGE(GOP, DEBUG, L"Mode %u of %u (%llu Bytes): Ver: 0x%x, Res: %ux%u", mode, GOPTable->Mode->MaxMode - 1, GOPInfoSize, GOPInfo->Version, GOPInfo->HorizontalResolution, GOPInfo->VerticalResolution);
+        LOG_MESSAGE(GOP, DEBUG, L"PxPerScanLine: %u", GOPInfo->PixelsPerScanLine);
+        LOG_MESSAGE(GOP, DEBUG, L"PxFormat: 0x%x, PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x", GOPInfo->PixelFormat, GOPInfo->PixelInformation.RedMask, GOPInfo->PixelInformation.GreenMask, GOPInfo->PixelInformation.BlueMask, GOPInfo->PixelInformation.ReservedMask);
 
-      // Don't need GOPInfo anymore
-      GOPStatus = BS->FreePool(GOPInfo);
-      if(EFI_ERROR(GOPStatus))
-      {
-        Print(L"Error freeing GOPInfo pool. 0x%llx\r\n", GOPStatus);
-        return GOPStatus;
+        // Don't need GOPInfo anymore
+        GOPStatus = BS->FreePool(GOPInfo);
+        if(EFI_ERROR(GOPStatus))
+        {
+          Print(L"Error freeing GOPInfo pool. 0x%llx\r\n", GOPStatus);
+          return GOPStatus;
+        }
       }
-    }
 
-    Keywait(L"\r\nGetting list of supported modes...\r\n");
-#endif
+      LOG_MESSAGE(GOP, DEBUG, L"Getting list of supported modes...");
+    }
 
     if(GOPTable->Mode->MaxMode == 1) // Grammar
     {
-#ifdef GOP_DEBUG_ENABLED
-      Print(L"%u available graphics mode found.\r\n", GOPTable->Mode->MaxMode);
-#endif
+      LOG_MESSAGE(GOP, DEBUG, L"%u available graphics mode found.", GOPTable->Mode->MaxMode);
       mode = 0; // If there's only one mode, it's going to be mode 0.
     }
+    else if(FastBootActive)
+    {
+      mode = (FastBoot.GpuMode < GOPTable->Mode->MaxMode) ? FastBoot.GpuMode : 0;
+    }
+    else if(LoaderConfig.Gop == LOADER_CONFIG_GOP_NATIVE)
+    {
+      mode = 0; // Same as multi-GPU option 2
+    }
+    else if(LoaderConfig.Gop == LOADER_CONFIG_GOP_RESOLUTION)
+    {
+      GOPStatus = FindGraphicsMode(GOPTable, LoaderConfig.GopWidth, LoaderConfig.GopHeight, &mode);
+      if(EFI_ERROR(GOPStatus))
+      {
+        return GOPStatus;
+      }
+      if(mode == GOPTable->Mode->MaxMode)
+      {
+        Print(L"No %ux%u mode found. Using mode 0...\r\n", LoaderConfig.GopWidth, LoaderConfig.GopHeight);
+        mode = 0;
+      }
+    }
     else
     {
       // Default mode
       UINT32 default_mode = 0;
-      UINT64 timeout_seconds = GPU_MENU_TIMEOUT_SECONDS;
+      UINT64 timeout_seconds = LoaderConfig.GopTimeout;
 
       // Get supported graphics modes
       EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *GOPInfo2; // Querymode allocates GOPInfo
@@ -1625,6 +1507,7 @@ fruitcake: ;
         mode = (UINT32)(Key.UnicodeChar - 0x30);
       }
       Key.UnicodeChar = 0;
+      FastBoot.GpuMode = mode; // For loader.fastboot=on
 
       Print(L"Setting graphics mode %u of %u.\r\n\n", mode + 1, GOPTable->Mode->MaxMode);
     }
@@ -1638,9 +1521,7 @@ fruitcake: ;
       return GOPStatus;
     }
 
-#ifdef GOP_DEBUG_ENABLED
-    Print(L"Current GOP Info Size: %llu\r\n", GOPTable->Mode->SizeOfInfo);
-#endif
+    LOG_MESSAGE(GOP, DEBUG, L"Current GOP Info Size: %llu", GOPTable->Mode->SizeOfInfo);
 
     // Allocate graphics mode info
     GOPStatus = ST->BootServices->AllocatePool(EfiLoaderData, GOPTable->Mode->SizeOfInfo, (void**)&Graphics->GPUArray[DevNum].Info);
@@ -1650,9 +1531,7 @@ fruitcake: ;
       return GOPStatus;
     }
 
-#ifdef GOP_DEBUG_ENABLED
-    Keywait(L"Current mode info allocated.\r\n");
-#endif
+    LOG_MESSAGE(GOP, DEBUG, L"Current mode info allocated.");
 
     // Store graphics mode info
     // Can't blanketly store Mode struct because Mode->Info pointer in array will get overwritten
@@ -1664,9 +1543,7 @@ fruitcake: ;
     // Can blanketly override Info struct, though (no pointers in it, just raw data)
     *(Graphics->GPUArray[DevNum].Info) = *(GOPTable->Mode->Info);
 
-#ifdef GOP_DEBUG_ENABLED
-    Keywait(L"Current mode info assigned.\r\n");
-#endif
+    LOG_MESSAGE(GOP, DEBUG, L"Current mode info assigned.");
 
   // End single GPU
   }
@@ -1674,6 +1551,11 @@ fruitcake: ;
   // Don't need string names anymore
   for(UINTN StringNameFree = 0; StringNameFree < NumHandlesInHandleBuffer; StringNameFree++)
   {
+    if(NameBuffer[StringNameFree] == NULL)
+    {
+      continue;
+    }
+
     GOPStatus = BS->FreePool(NameBuffer[StringNameFree]);
     if(EFI_ERROR(GOPStatus))
     {
@@ -1698,20 +1580,21 @@ fruitcake: ;
     return GOPStatus;
   }
 
-#ifdef GOP_DEBUG_ENABLED
-    // Data verification
-  for(DevNum = 0; DevNum < Graphics->NumberOfFrameBuffers; DevNum++)
-  {
-    Print(L"\r\nCurrent GOP Mode Info:\r\n");
-    Print(L"Max Mode supported: %u, Current Mode: %u\r\nSize of Mode Info Structure: %llu Bytes\r\n", Graphics->GPUArray[DevNum].MaxMode - 1, Graphics->GPUArray[DevNum].Mode, Graphics->GPUArray[DevNum].SizeOfInfo);
-    Print(L"FrameBufferBase: 0x%016llx, FrameBufferSize: 0x%llx\r\n", Graphics->GPUArray[DevNum].FrameBufferBase, Graphics->GPUArray[DevNum].FrameBufferSize);
-
-    Print(L"Mode %u of %u (%llu Bytes):\r\n Ver: 0x%x, Res: %ux%u\r\n", Graphics->GPUArray[DevNum].Mode, Graphics->GPUArray[DevNum].MaxMode - 1, Graphics->GPUArray[DevNum].SizeOfInfo, Graphics->GPUArray[DevNum].Info->Version, Graphics->GPUArray[DevNum].Info->HorizontalResolution, Graphics->GPUArray[DevNum].Info->VerticalResolution);
-    Print(L"PxPerScanLine: %u\r\n", Graphics->GPUArray[DevNum].Info->PixelsPerScanLine);
-    Print(L"PxFormat: 0x%x, PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x\r\n", Graphics->GPUArray[DevNum].Info->PixelFormat, Graphics->GPUArray[DevNum].Info->PixelInformation.RedMask, Graphics->GPUArray[DevNum].Info->PixelInformation.GreenMask, Graphics->GPUArray[DevNum].Info->PixelInformation.BlueMask, Graphics->GPUArray[DevNum].Info->PixelInformation.ReservedMask);
-    Keywait(L"\0");
-  }
-#endif
+    if(LOG_ENABLED(GOP, DEBUG))
+    {
+      // Data verification
+    for(DevNum = 0; DevNum < Graphics->NumberOfFrameBuffers; DevNum++)
+    {
+      LOG_MESSAGE(GOP, DEBUG, L"Current GOP Mode Info:");
+      LOG_MESSAGE(GOP, DEBUG, L"Max Mode supported: %u, Current Mode: %u", Graphics->GPUArray[DevNum].MaxMode - 1, Graphics->GPUArray[DevNum].Mode);
+      LOG_MESSAGE(GOP, DEBUG, L"Size of Mode Info Structure: %llu Bytes", Graphics->GPUArray[DevNum].SizeOfInfo);
+      LOG_MESSAGE(GOP, DEBUG, L"FrameBufferBase: 0x%016llx, FrameBufferSize: 0x%llx", Graphics->GPUArray[DevNum].FrameBufferBase, Graphics->GPUArray[DevNum].FrameBufferSize);
+
+      LOG_MESSAGE(GOP, DEBUG, L"Mode %u of %u (%llu Bytes): Ver: 0x%x, Res: %ux%u", Graphics->GPUArray[DevNum].Mode, Graphics->GPUArray[DevNum].MaxMode - 1, Graphics->GPUArray[DevNum].SizeOfInfo, Graphics->GPUArray[DevNum].Info->Version, Graphics->GPUArray[DevNum].Info->HorizontalResolution, Graphics->GPUArray[DevNum].Info->VerticalResolution);
+      LOG_MESSAGE(GOP, DEBUG, L"PxPerScanLine: %u", Graphics->GPUArray[DevNum].Info->PixelsPerScanLine);
+      LOG_MESSAGE(GOP, DEBUG, L"PxFormat: 0x%x, PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x", Graphics->GPUArray[DevNum].Info->PixelFormat, Graphics->GPUArray[DevNum].Info->PixelInformation.RedMask, Graphics->GPUArray[DevNum].Info->PixelInformation.GreenMask, Graphics->GPUArray[DevNum].Info->PixelInformation.BlueMask, Graphics->GPUArray[DevNum].Info->PixelInformation.ReservedMask);
+    }
+    }
 
   return GOPStatus;
 }
@@ -1820,9 +1703,6 @@ typedef union {
 
 */
 
-
-#ifdef GOP_NAMING_DEBUG_ENABLED
-
 // Want more GUIDs or see some you can't identify?
 // Try here: https://github.com/tianocore/edk2/blob/master/MdePkg/MdePkg.dec
 // And check out this insane list: https://github.com/snare/ida-efiutils
@@ -1944,6 +1824,14 @@ STATIC struct {
 // I've seen a rogue EFI_GUID that I can't find what it's for: 39487C79-236D-4666-87E5-09547CAAE1BC. It seems exclusive to Intel HD graphics family GOP handles.
 // In "GUID Format" it's this: {0x39487c79, 0x236d, 0x4666, {0x87, 0xe5, 0x09, 0x54, 0x7c, 0xaa, 0xe1, 0xbc}}
 
+//==================================================================================================================================
+//  WhatProtocols: List The Protocols On Some Handles
+//==================================================================================================================================
+//
+// Log every protocol on each of HandleArray's handles at GOP:DEBUG, with names for the GUIDs in KnownGuids and the driver's name for
+// Name2 handles. InitUEFI_GOP() does this for the GOP handles when GOP:DEBUG is on.
+//
+
 EFI_STATUS WhatProtocols(EFI_HANDLE * HandleArray, UINTN NumHandlesInHandleArray)
 {
   UINTN NumInHandle = 0;
@@ -1961,10 +1849,10 @@ EFI_STATUS WhatProtocols(EFI_HANDLE * HandleArray, UINTN NumHandlesInHandleArray
 
   for(UINT64 j = 0; j < NumHandlesInHandleArray; j++)
   {
-    Print(L"Handle %llu: 0x%llx\r\n", j, HandleArray[j]);
+    LOG_MESSAGE(GOP, DEBUG, L"Handle %llu: 0x%llx", j, HandleArray[j]);
     if(HandleArray[j] == NULL)
     {
-      Print(L"Null Handle\r\n");
+      LOG_MESSAGE(GOP, DEBUG, L"Null Handle");
       continue;
     }
 
@@ -1977,7 +1865,16 @@ EFI_STATUS WhatProtocols(EFI_HANDLE * HandleArray, UINTN NumHandlesInHandleArray
 
     for(UINT64 q = 0; q < NumInHandle; q++)
     {
-      Print(L"%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x: ",
+      CHAR16 * GuidName = L"";
+      for (UINTN Index=0; KnownGuids[Index].Guid; Index++)
+      {
+        if (CompareGuid(ProtocolGUIDList[q], KnownGuids[Index].Guid) == 0)
+        {
+          GuidName = KnownGuids[Index].GuidName;
+        }
+      }
+
+      LOG_MESSAGE(GOP, DEBUG, L"%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x: %s",
           ProtocolGUIDList[q]->Data1,
           ProtocolGUIDList[q]->Data2,
           ProtocolGUIDList[q]->Data3,
@@ -1988,18 +1885,10 @@ EFI_STATUS WhatProtocols(EFI_HANDLE * HandleArray, UINTN NumHandlesInHandleArray
           ProtocolGUIDList[q]->Data4[4],
           ProtocolGUIDList[q]->Data4[5],
           ProtocolGUIDList[q]->Data4[6],
-          ProtocolGUIDList[q]->Data4[7]
+          ProtocolGUIDList[q]->Data4[7],
+          GuidName
           );
 
-      for (UINTN Index=0; KnownGuids[Index].Guid; Index++)
-      {
-        if (CompareGuid(ProtocolGUIDList[q], KnownGuids[Index].Guid) == 0)
-        {
-          Print(L"%s", KnownGuids[Index].GuidName);
-        }
-      }
-      Print(L"\r\n");
-
       if (CompareGuid(ProtocolGUIDList[q], &gEfiComponentName2ProtocolGuid) == 0) // Display the name. At least we'll have something legible.
       {
         EFI_COMPONENT_NAME2_PROTOCOL *Name2Device;
@@ -2022,51 +1911,74 @@ EFI_STATUS WhatProtocols(EFI_HANDLE * HandleArray, UINTN NumHandlesInHandleArray
         }
         if(EFI_ERROR(GOPStatus))
         {
-          Print(L"Name2Device GetDriverName error. 0x%llx\r\n", GOPStatus);
+          LOG_MESSAGE(GOP, DEBUG, L"Name2Device GetDriverName error. 0x%llx", GOPStatus);
 
           if(GOPStatus == EFI_UNSUPPORTED)
           {
             // This is the format of the language, since it isn't "en-US" or "en"
             // It will need to be implemented like the above arrays
-            Print(L"First 10 language characters look like this:\r\n");
-            for(UINT32 p = 0; p < 10; p++)
-            {
-              Print(L"%c", Name2Device->SupportedLanguages[p]);
-            }
-            Print(L"\r\n");
-
-            Keywait(L"\0");
+            LOG_MESSAGE(GOP, DEBUG, L"Supported languages look like this: %a", Name2Device->SupportedLanguages);
           }
           // You know, we have specifications for a reason.
           // Those who refuse to follow them get this.
           DriverDisplayName = DefaultDriverDisplayName;
         }
-        Print(L"%s\r\n", DriverDisplayName);
+        LOG_MESSAGE(GOP, DEBUG, L"%s", DriverDisplayName);
       }
-
     }
 
-    if(((j+1) % 2) == 0) // Show 2 handles at a time before prompt
+    GOPStatus = BS->FreePool(ProtocolGUIDList); // ProtocolsPerHandle() allocates a new one for each handle
+    if(EFI_ERROR(GOPStatus))
     {
-      Keywait(L"\0");
+      Print(L"ProtocolsPerHandle FreePool error. 0x%llx\r\n", GOPStatus);
+      return GOPStatus;
     }
   }
-  Print(L"Done\r\n");
-  Keywait(L"\0");
+  LOG_MESSAGE(GOP, DEBUG, L"Done");
+
+  return GOPStatus;
+}
+
+//==================================================================================================================================
+//  FindGraphicsMode: Find A Resolution
+//==================================================================================================================================
+//
+// Set Mode to the first of GOPTable's modes that's Width x Height, or to MaxMode if there isn't one.
+//
 
-  if(ProtocolGUIDList)
+STATIC EFI_STATUS FindGraphicsMode(EFI_GRAPHICS_OUTPUT_PROTOCOL * GOPTable, UINT32 Width, UINT32 Height, UINT32 * Mode)
+{
+  EFI_STATUS mode_status;
+  EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *GOPInfo; // Querymode allocates GOPInfo
+  UINTN GOPInfoSize;
+
+  for(*Mode = 0; *Mode < GOPTable->Mode->MaxMode; (*Mode)++) // Valid modes are from 0 to MaxMode - 1
   {
-    GOPStatus = BS->FreePool(ProtocolGUIDList);
-    if(EFI_ERROR(GOPStatus))
+    mode_status = GOPTable->QueryMode(GOPTable, *Mode, &GOPInfoSize, &GOPInfo); // IN IN OUT OUT
+    if(EFI_ERROR(mode_status))
     {
-      Print(L"ProtocolsPerHandle FreePool error. 0x%llx\r\n", GOPStatus);
-      return GOPStatus;
+      Print(L"GraphicsTable QueryMode error. 0x%llx\r\n", mode_status);
+      return mode_status;
+    }
+
+    UINT8 Found = (GOPInfo->HorizontalResolution == Width) && (GOPInfo->VerticalResolution == Height);
+
+    // Don't need GOPInfo anymore
+    mode_status = BS->FreePool(GOPInfo);
+    if(EFI_ERROR(mode_status))
+    {
+      Print(L"Error freeing GOPInfo pool. 0x%llx\r\n", mode_status);
+      return mode_status;
+    }
+
+    if(Found)
+    {
+      break; // Use this mode
     }
   }
 
-  return GOPStatus;
+  return EFI_SUCCESS;
 }
-#endif
 
 //==================================================================================================================================
 //  apple_set_os: Tell a Mac It's Booting Mac OS
@@ -0,0 +1,518 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Handoff Functions
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This file contains the functions that pack everything the kernel gets into the v3 handoff buffer. See LOADER_HANDOFF_HEADER in
+// Bootloader.h for the format.
+//
+
+#include "Bootloader.h"
+
+// Room for this many more descriptors gets reserved in the memory map tag, since the map keeps changing until ExitBootServices()
+#define HANDOFF_MEMMAP_SLACK 8
+
+// Tags start on 8-byte boundaries
+#define HANDOFF_ALIGN(x) (((x) + 7) & ~7ULL)
+
+//==================================================================================================================================
+//  HandoffTagSize: Size Of A Tag Record
+//==================================================================================================================================
+//
+// Return how much space a tag with the given payload size takes up, counting its header and padding.
+//
+
+STATIC UINT64 HandoffTagSize(UINT64 PayloadSize)
+{
+  return sizeof(LOADER_TAG) + HANDOFF_ALIGN(PayloadSize);
+}
+
+//==================================================================================================================================
+//  AddHandoffTag: Append A Tag
+//==================================================================================================================================
+//
+// Add a zeroed tag to the end of the handoff buffer and return a pointer to its payload. The caller has to have made room for it.
+//
+
+STATIC VOID * AddHandoffTag(LOADER_HANDOFF_HEADER * Handoff, UINT32 Type, UINT64 Size)
+{
+  LOADER_TAG * Tag = (LOADER_TAG*)((UINT8*)Handoff + Handoff->TotalSize);
+
+  Tag->Type = Type;
+  Tag->Size = (UINT32)Size;
+  ZeroMem(Tag + 1, HANDOFF_ALIGN(Size));
+
+  Handoff->TotalSize += HandoffTagSize(Size);
+  if(Type != LOADER_TAG_END)
+  {
+    Handoff->Capabilities |= LOADER_CAPABILITY(Type);
+  }
+
+  return Tag + 1;
+}
+
+//==================================================================================================================================
+//  FindHandoffTag: Get A Pointer To A Tag's Payload
+//==================================================================================================================================
+//
+// Return a pointer to the payload of the first tag of the given type and put its size in Size, or return NULL if there's no such tag.
+// This is what a kernel would do, too.
+//
+
+STATIC VOID * FindHandoffTag(LOADER_HANDOFF_HEADER * Handoff, UINT32 Type, UINT32 * Size)
+{
+  UINT8 * Next = (UINT8*)Handoff + Handoff->HeaderSize;
+  UINT8 * End = (UINT8*)Handoff + Handoff->TotalSize;
+
+  while(Next < End)
+  {
+    LOADER_TAG * Tag = (LOADER_TAG*)Next;
+    if(Tag->Type == LOADER_TAG_END)
+    {
+      break;
+    }
+    if(Tag->Type == Type)
+    {
+      *Size = Tag->Size;
+      return Tag + 1;
+    }
+    Next += HandoffTagSize(Tag->Size);
+  }
+
+  return NULL;
+}
+
+//==================================================================================================================================
+//  BuildHandoff: Pack Everything Into The v3 Handoff Buffer
+//==================================================================================================================================
+//
+// Allocate the handoff buffer and copy in everything from Loader_block that's already known. This has to happen before
+// ExitBootServices(), so the memory map and memory tier table only get space reserved here. FinishHandoff() fills them in.
+//
+
+EFI_STATUS BuildHandoff(LOADER_PARAMS * Loader_block, LOADER_HANDOFF_HEADER ** Handoff)
+{
+  EFI_STATUS handoff_status;
+  UINTN MemMapSize = 0, MemMapKey, MemMapDescriptorSize;
+  UINT32 MemMapDescriptorVersion;
+
+  // Just need to know how big the memory map is right now
+  handoff_status = BS->GetMemoryMap(&MemMapSize, NULL, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
+  if(handoff_status != EFI_BUFFER_TOO_SMALL)
+  {
+    Print(L"Error getting memory map size for handoff. 0x%llx\r\n", handoff_status);
+    return handoff_status;
+  }
+  UINT64 MemMapCapacity = MemMapSize + HANDOFF_MEMMAP_SLACK * MemMapDescriptorSize;
+
+  GPU_CONFIG * Graphics = Loader_block->GPU_Configs;
+  MEMORY_TIER_TABLE * TierTable = Loader_block->Memory_Tiers;
+  MEMORY_PERF_TABLE * PerfTable = Loader_block->Memory_Performance;
+  ZEROED_MEMORY_MAP * ZeroMap = Loader_block->Zeroed_Memory;
+  EFI_FILE_INFO * FileInfo = Loader_block->FileMeta;
+  ACPI_RSDP * RSDP = FindRsdp();
+
+  UINT64 CmdlineSize = Loader_block->ESP_Root_Size + Loader_block->Kernel_Path_Size + Loader_block->Kernel_Options_Size;
+  UINT64 TierTableSize = sizeof(MEMORY_TIER_TABLE) + TierTable->MaxEntries * sizeof(MEMORY_TIER_ENTRY);
+  UINT64 PerfTableSize = 0;
+  UINT64 ZeroMapSize = 0;
+  UINT64 EntryStateSize = 0;
+  UINT64 ApParkingSize = 0;
+  UINT64 RuntimeMapSize = 0;
+  UINT64 LogSize = 0;
+  UINT64 AcpiSummarySize = BuildAcpiSummary(NULL);
+  UINT64 SmbiosIndexSize = BuildSmbiosIndex(NULL);
+  UINT64 PciInventorySize = sizeof(PCI_INVENTORY) + Loader_block->Pci_Inventory->NumberOfDevices * sizeof(PCI_DEVICE);
+  UINT64 ArgumentsSize = BuildKernelArguments(Loader_block->Kernel_Options, Loader_block->Kernel_Options_Size, NULL);
+
+  if(PerfTable != NULL)
+  {
+    PerfTableSize = sizeof(MEMORY_PERF_TABLE) + PerfTable->NumberOfEntries * sizeof(MEMORY_PERF_ENTRY);
+  }
+  if(ZeroMap != NULL)
+  {
+    ZeroMapSize = sizeof(ZEROED_MEMORY_MAP) + (ZeroMap->NumberOfChunks + 7) / 8;
+  }
+  if(Loader_block->Entry_State != NULL)
+  {
+    EntryStateSize = sizeof(LOADER_ENTRY_STATE);
+  }
+  if(Loader_block->Ap_Parking != NULL)
+  {
+    ApParkingSize = sizeof(LOADER_AP_PARKING);
+  }
+  if(Loader_block->Loader_Log != NULL)
+  {
+    LogSize = sizeof(LOADER_LOG) + Loader_block->Loader_Log->NumberOfRecords * sizeof(LOADER_LOG_RECORD);
+  }
+  if(Loader_block->Runtime_Map != NULL)
+  {
+    RuntimeMapSize = sizeof(RUNTIME_MAP) + Loader_block->Runtime_Map->MaxRanges * sizeof(RUNTIME_MAP_RANGE);
+  }
+  UINT64 ModulesSize = sizeof(LOADER_MODULES_TAG) + Loader_block->Modules->NumberOfModules * sizeof(LOADER_MODULE);
+
+  UINT64 TotalSize = sizeof(LOADER_HANDOFF_HEADER)
+                   + HandoffTagSize(sizeof(LOADER_INFO_TAG))
+                   + HandoffTagSize(sizeof(LOADER_MEMORY_MAP_TAG) + MemMapCapacity)
+                   + HandoffTagSize(sizeof(LOADER_FRAMEBUFFERS_TAG) + Graphics->NumberOfFrameBuffers * sizeof(LOADER_FRAMEBUFFER))
+                   + HandoffTagSize(sizeof(LOADER_FRAMEBUFFER_CACHING_TAG) + Graphics->NumberOfFrameBuffers * sizeof(FRAMEBUFFER_CACHING))
+                   + HandoffTagSize(sizeof(LOADER_CMDLINE_TAG) + CmdlineSize)
+                   + HandoffTagSize(ArgumentsSize)
+                   + HandoffTagSize(sizeof(LOADER_FIRMWARE_TAG))
+                   + HandoffTagSize(sizeof(LOADER_ACPI_TAG))
+                   + HandoffTagSize(AcpiSummarySize)
+                   + HandoffTagSize(SmbiosIndexSize)
+                   + HandoffTagSize(sizeof(LOADER_TIMING_TAG))
+                   + HandoffTagSize(sizeof(LOADER_BOOT_TIMELINE_TAG))
+                   + HandoffTagSize(sizeof(LOADER_CLOCK_TAG))
+                   + HandoffTagSize(ModulesSize)
+                   + HandoffTagSize(TierTableSize)
+                   + HandoffTagSize(PerfTableSize)
+                   + HandoffTagSize(ZeroMapSize)
+                   + HandoffTagSize(FileInfo->Size)
+                   + HandoffTagSize(sizeof(CPU_FEATURES))
+                   + HandoffTagSize(Loader_block->Cpu_Topology->Size)
+                   + HandoffTagSize(PciInventorySize)
+                   + HandoffTagSize(EntryStateSize)
+                   + HandoffTagSize(ApParkingSize)
+                   + HandoffTagSize(RuntimeMapSize)
+                   + HandoffTagSize(LogSize)
+                   + HandoffTagSize(0); // LOADER_TAG_END
+
+  handoff_status = BS->AllocatePool(EfiLoaderData, TotalSize, (void**)Handoff);
+  if(EFI_ERROR(handoff_status))
+  {
+    Print(L"Error allocating handoff buffer. 0x%llx\r\n", handoff_status);
+    return handoff_status;
+  }
+
+  LOADER_HANDOFF_HEADER * Header = *Handoff;
+  Header->Signature = LOADER_HANDOFF_SIGNATURE;
+  Header->Version = LOADER_HANDOFF_VERSION;
+  Header->HeaderSize = sizeof(LOADER_HANDOFF_HEADER);
+  Header->TotalSize = sizeof(LOADER_HANDOFF_HEADER);
+  Header->Capabilities = 0;
+  Header->Legacy = Loader_block;
+
+  // Roughly in the order a kernel would want them
+
+  LOADER_INFO_TAG * Info = AddHandoffTag(Header, LOADER_TAG_LOADER_INFO, sizeof(LOADER_INFO_TAG));
+  Info->Bootloader_MajorVersion = Loader_block->Bootloader_MajorVersion;
+  Info->Bootloader_MinorVersion = Loader_block->Bootloader_MinorVersion;
+  Info->Kernel_BaseAddress = Loader_block->Kernel_BaseAddress;
+  Info->Kernel_Pages = Loader_block->Kernel_Pages;
+  Info->Kernel_VirtualBase = Loader_block->Kernel_VirtualBase;
+  Info->Page_Table_Root = Loader_block->Page_Table_Root;
+
+  // Doesn't count as present until FinishHandoff() fills it in
+  AddHandoffTag(Header, LOADER_TAG_MEMORY_MAP, sizeof(LOADER_MEMORY_MAP_TAG) + MemMapCapacity);
+  Header->Capabilities &= ~LOADER_CAPABILITY(LOADER_TAG_MEMORY_MAP);
+
+  LOADER_FRAMEBUFFERS_TAG * FrameBuffers = AddHandoffTag(Header, LOADER_TAG_FRAMEBUFFERS, sizeof(LOADER_FRAMEBUFFERS_TAG) + Graphics->NumberOfFrameBuffers * sizeof(LOADER_FRAMEBUFFER));
+  FrameBuffers->NumberOfFrameBuffers = Graphics->NumberOfFrameBuffers;
+  for(UINT64 k = 0; k < Graphics->NumberOfFrameBuffers; k++)
+  {
+    EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE * Mode = &Graphics->GPUArray[k];
+    FrameBuffers->FrameBuffers[k].FrameBufferBase = Mode->FrameBufferBase;
+    FrameBuffers->FrameBuffers[k].FrameBufferSize = Mode->FrameBufferSize;
+    FrameBuffers->FrameBuffers[k].HorizontalResolution = Mode->Info->HorizontalResolution;
+    FrameBuffers->FrameBuffers[k].VerticalResolution = Mode->Info->VerticalResolution;
+    FrameBuffers->FrameBuffers[k].PixelsPerScanLine = Mode->Info->PixelsPerScanLine;
+    FrameBuffers->FrameBuffers[k].PixelFormat = Mode->Info->PixelFormat;
+    FrameBuffers->FrameBuffers[k].PixelInformation = Mode->Info->PixelInformation;
+  }
+
+  LOADER_FRAMEBUFFER_CACHING_TAG * FrameBufferCaching = AddHandoffTag(Header, LOADER_TAG_FRAMEBUFFER_CACHING, sizeof(LOADER_FRAMEBUFFER_CACHING_TAG) + Graphics->NumberOfFrameBuffers * sizeof(FRAMEBUFFER_CACHING));
+  FrameBufferCaching->NumberOfFrameBuffers = Graphics->NumberOfFrameBuffers;
+  CopyMem(FrameBufferCaching->FrameBuffers, Graphics->FrameBufferCaching, Graphics->NumberOfFrameBuffers * sizeof(FRAMEBUFFER_CACHING));
+
+  LOADER_CMDLINE_TAG * Cmdline = AddHandoffTag(Header, LOADER_TAG_CMDLINE, sizeof(LOADER_CMDLINE_TAG) + CmdlineSize);
+  Cmdline->ESP_Root_Size = Loader_block->ESP_Root_Size;
+  Cmdline->Kernel_Path_Size = Loader_block->Kernel_Path_Size;
+  Cmdline->Kernel_Options_Size = Loader_block->Kernel_Options_Size;
+  UINT8 * Strings = (UINT8*)Cmdline->Strings;
+  CopyMem(Strings, Loader_block->ESP_Root_Device_Path, Loader_block->ESP_Root_Size);
+  Strings += Loader_block->ESP_Root_Size;
+  CopyMem(Strings, Loader_block->Kernel_Path, Loader_block->Kernel_Path_Size);
+  Strings += Loader_block->Kernel_Path_Size;
+  CopyMem(Strings, Loader_block->Kernel_Options, Loader_block->Kernel_Options_Size);
+
+  BuildKernelArguments(Loader_block->Kernel_Options, Loader_block->Kernel_Options_Size, AddHandoffTag(Header, LOADER_TAG_ARGUMENTS, ArgumentsSize));
+
+  LOADER_FIRMWARE_TAG * Firmware = AddHandoffTag(Header, LOADER_TAG_FIRMWARE, sizeof(LOADER_FIRMWARE_TAG));
+  Firmware->UEFI_Version = Loader_block->UEFI_Version;
+  Firmware->RTServices = Loader_block->RTServices;
+  Firmware->ConfigTables = Loader_block->ConfigTables;
+  Firmware->Number_of_ConfigTables = Loader_block->Number_of_ConfigTables;
+
+  if(RSDP != NULL)
+  {
+    LOADER_ACPI_TAG * Acpi = AddHandoffTag(Header, LOADER_TAG_ACPI, sizeof(LOADER_ACPI_TAG));
+    Acpi->Rsdp = (EFI_PHYSICAL_ADDRESS)RSDP;
+    Acpi->Revision = RSDP->Revision;
+    Acpi->Rsdt = RSDP->RsdtAddress;
+    if(RSDP->Revision >= 2)
+    {
+      Acpi->Xsdt = RSDP->XsdtAddress;
+    }
+  }
+
+  if(AcpiSummarySize != 0)
+  {
+    BuildAcpiSummary(AddHandoffTag(Header, LOADER_TAG_ACPI_SUMMARY, AcpiSummarySize));
+  }
+
+  if(SmbiosIndexSize != 0)
+  {
+    BuildSmbiosIndex(AddHandoffTag(Header, LOADER_TAG_SMBIOS, SmbiosIndexSize));
+  }
+
+  // The kernel, then Kernel64.txt's modules (see LoadBootModules() in Loader.c)
+  CopyMem(AddHandoffTag(Header, LOADER_TAG_MODULES, ModulesSize), Loader_block->Modules, ModulesSize);
+
+  // Also filled in by FinishHandoff()
+  AddHandoffTag(Header, LOADER_TAG_MEMORY_TIERS, TierTableSize);
+  Header->Capabilities &= ~LOADER_CAPABILITY(LOADER_TAG_MEMORY_TIERS);
+
+  if(PerfTable != NULL)
+  {
+    CopyMem(AddHandoffTag(Header, LOADER_TAG_MEMORY_PERFORMANCE, PerfTableSize), PerfTable, PerfTableSize);
+  }
+
+  if(ZeroMap != NULL)
+  {
+    CopyMem(AddHandoffTag(Header, LOADER_TAG_ZEROED_MEMORY, ZeroMapSize), ZeroMap, ZeroMapSize);
+  }
+
+  CopyMem(AddHandoffTag(Header, LOADER_TAG_KERNEL_FILE_INFO, FileInfo->Size), FileInfo, FileInfo->Size);
+
+  CopyMem(AddHandoffTag(Header, LOADER_TAG_CPU_FEATURES, sizeof(CPU_FEATURES)), Loader_block->Cpu_Features, sizeof(CPU_FEATURES));
+  CopyMem(AddHandoffTag(Header, LOADER_TAG_CPU_TOPOLOGY, Loader_block->Cpu_Topology->Size), Loader_block->Cpu_Topology, Loader_block->Cpu_Topology->Size);
+  CopyMem(AddHandoffTag(Header, LOADER_TAG_PCI_INVENTORY, PciInventorySize), Loader_block->Pci_Inventory, PciInventorySize);
+
+  if(Loader_block->Entry_State != NULL)
+  {
+    CopyMem(AddHandoffTag(Header, LOADER_TAG_ENTRY_STATE, sizeof(LOADER_ENTRY_STATE)), Loader_block->Entry_State, sizeof(LOADER_ENTRY_STATE));
+  }
+
+  // The mailboxes themselves stay where they are, since the APs are watching them
+  if(Loader_block->Ap_Parking != NULL)
+  {
+    CopyMem(AddHandoffTag(Header, LOADER_TAG_AP_PARKING, sizeof(LOADER_AP_PARKING)), Loader_block->Ap_Parking, sizeof(LOADER_AP_PARKING));
+  }
+
+  // Filled in by FinishHandoff(), after SetVirtualAddressMap()
+  if(Loader_block->Runtime_Map != NULL)
+  {
+    AddHandoffTag(Header, LOADER_TAG_RUNTIME_MAP, RuntimeMapSize);
+    Header->Capabilities &= ~LOADER_CAPABILITY(LOADER_TAG_RUNTIME_MAP);
+  }
+
+  // Timing goes last so that the TSC calibration doesn't get counted as handoff time
+  LOADER_TIMING_TAG * Timing = AddHandoffTag(Header, LOADER_TAG_TIMING, sizeof(LOADER_TIMING_TAG));
+  Timing->TscFrequency = GetTscFrequency();
+  Timing->LoaderStart_Tsc = LoaderStartTsc;
+
+  // Also filled in by FinishHandoff(), once the last timestamps are in
+  AddHandoffTag(Header, LOADER_TAG_BOOT_TIMELINE, sizeof(LOADER_BOOT_TIMELINE_TAG));
+  Header->Capabilities &= ~LOADER_CAPABILITY(LOADER_TAG_BOOT_TIMELINE);
+
+  // Same here, so it has everything up to the jump
+  if(Loader_block->Loader_Log != NULL)
+  {
+    Loader_block->Loader_Log->TscFrequency = Timing->TscFrequency;
+    AddHandoffTag(Header, LOADER_TAG_LOG, LogSize);
+    Header->Capabilities &= ~LOADER_CAPABILITY(LOADER_TAG_LOG);
+  }
+
+  UINT32 Eax, Ebx, Ecx, Edx;
+  LOADER_CLOCK_TAG * Clock = AddHandoffTag(Header, LOADER_TAG_CLOCK, sizeof(LOADER_CLOCK_TAG));
+  Clock->TscFrequency = Timing->TscFrequency;
+  Clock->TscSource = GetTscFrequencySource();
+  Clock->Time = LoaderStartTime;
+  Clock->Time_Tsc = LoaderStartTime_Tsc;
+  Clock->Time_TscUncertainty = LoaderStartTime_TscUncertainty;
+
+  CpuId(CPUID_EXTENDED_MAX_LEAF, 0, &Eax, &Ebx, &Ecx, &Edx);
+  if(Eax >= CPUID_ADVANCED_POWER)
+  {
+    CpuId(CPUID_ADVANCED_POWER, 0, &Eax, &Ebx, &Ecx, &Edx);
+    if(Edx & CPUID_ADVANCED_EDX_INVARIANT_TSC)
+    {
+      Clock->Flags |= LOADER_CLOCK_INVARIANT_TSC;
+    }
+  }
+
+  AddHandoffTag(Header, LOADER_TAG_END, 0);
+
+  Timing->HandoffBuilt_Tsc = ReadTsc();
+
+  return EFI_SUCCESS;
+}
+
+//==================================================================================================================================
+//  BuildBootTimeline: Put Firmware And Loader Timestamps On One Clock
+//==================================================================================================================================
+//
+// Fill in Timeline from firmware's FPDT boot record and the TSC readings in Timing. Firmware's times win where both exist. Loader
+// timestamps that firmware left as 0 get written back into the boot record, so the OS's own FPDT reader sees them too.
+//
+
+STATIC UINT64 TscToNanoseconds(UINT64 Tsc, UINT64 TscFrequency)
+{
+  if((Tsc == 0) || (TscFrequency == 0))
+  {
+    return 0;
+  }
+
+  // Split up so that Tsc * 1000000000 can't overflow
+  return (Tsc / TscFrequency) * 1000000000ULL + ((Tsc % TscFrequency) * 1000000000ULL) / TscFrequency;
+}
+
+STATIC VOID BuildBootTimeline(LOADER_BOOT_TIMELINE_TAG * Timeline, LOADER_TIMING_TAG * Timing)
+{
+  Timeline->LoaderStart = TscToNanoseconds(Timing->LoaderStart_Tsc, Timing->TscFrequency);
+  Timeline->HandoffBuilt = TscToNanoseconds(Timing->HandoffBuilt_Tsc, Timing->TscFrequency);
+  Timeline->ExitBootServicesEntry = TscToNanoseconds(Timing->ExitBootServicesCall_Tsc, Timing->TscFrequency);
+  Timeline->ExitBootServicesExit = TscToNanoseconds(Timing->ExitBootServices_Tsc, Timing->TscFrequency);
+  // KernelEntry gets filled in by StampKernelEntry()
+
+  ACPI_FPDT_BOOT_RECORD * BootRecord = FindFirmwareBootRecord();
+  if(BootRecord == NULL)
+  {
+    return;
+  }
+  Timeline->Flags |= LOADER_TIMELINE_FPDT;
+
+  Timeline->ResetEnd = BootRecord->ResetEnd;
+  Timeline->LoaderLoadImageStart = BootRecord->OsLoaderLoadImageStart;
+
+  if(BootRecord->OsLoaderStartImageStart != 0)
+  {
+    Timeline->LoaderStartImageStart = BootRecord->OsLoaderStartImageStart;
+  }
+  else
+  {
+    BootRecord->OsLoaderStartImageStart = Timeline->LoaderStart;
+    Timeline->LoaderStartImageStart = Timeline->LoaderStart;
+    Timeline->Flags |= LOADER_TIMELINE_FPDT_UPDATED;
+  }
+
+  if(BootRecord->ExitBootServicesEntry != 0)
+  {
+    Timeline->ExitBootServicesEntry = BootRecord->ExitBootServicesEntry;
+  }
+  else
+  {
+    BootRecord->ExitBootServicesEntry = Timeline->ExitBootServicesEntry;
+    Timeline->Flags |= LOADER_TIMELINE_FPDT_UPDATED;
+  }
+
+  if(BootRecord->ExitBootServicesExit != 0)
+  {
+    Timeline->ExitBootServicesExit = BootRecord->ExitBootServicesExit;
+  }
+  else
+  {
+    BootRecord->ExitBootServicesExit = Timeline->ExitBootServicesExit;
+    Timeline->Flags |= LOADER_TIMELINE_FPDT_UPDATED;
+  }
+}
+
+//==================================================================================================================================
+//  FinishHandoff: Fill In The Parts Of The Handoff That Come From The Final Memory Map
+//==================================================================================================================================
+//
+// Copy the final memory map, the memory tier table and the runtime map into the space BuildHandoff() reserved for them, and record the
+// ExitBootServices() timestamps, the boot timeline and the loader log. The kernel entry time comes later, from StampKernelEntry().
+// This runs after ExitBootServices(), so it can't call any boot services.
+//
+
+VOID FinishHandoff(LOADER_HANDOFF_HEADER * Handoff, LOADER_PARAMS * Loader_block, UINT64 ExitBootServicesStartTsc, UINT64 ExitBootServicesCallTsc, UINT64 ExitBootServicesTsc, UINT32 ExitBootServicesAttempts)
+{
+  UINT32 Size;
+
+  LOADER_MEMORY_MAP_TAG * MemMapTag = FindHandoffTag(Handoff, LOADER_TAG_MEMORY_MAP, &Size);
+  if((MemMapTag != NULL) && (Loader_block->Memory_Map_Size <= Size - sizeof(LOADER_MEMORY_MAP_TAG)))
+  {
+    MemMapTag->Descriptor_Version = Loader_block->Memory_Map_Descriptor_Version;
+    MemMapTag->Descriptor_Size = Loader_block->Memory_Map_Descriptor_Size;
+    MemMapTag->Map_Size = Loader_block->Memory_Map_Size;
+    CopyMem(MemMapTag->Map, Loader_block->Memory_Map, Loader_block->Memory_Map_Size);
+    Handoff->Capabilities |= LOADER_CAPABILITY(LOADER_TAG_MEMORY_MAP);
+  }
+
+  MEMORY_TIER_TABLE * TierTag = FindHandoffTag(Handoff, LOADER_TAG_MEMORY_TIERS, &Size);
+  if(TierTag != NULL)
+  {
+    MEMORY_TIER_TABLE * TierTable = Loader_block->Memory_Tiers;
+    CopyMem(TierTag, TierTable, sizeof(MEMORY_TIER_TABLE) + TierTable->NumberOfEntries * sizeof(MEMORY_TIER_ENTRY));
+    Handoff->Capabilities |= LOADER_CAPABILITY(LOADER_TAG_MEMORY_TIERS);
+  }
+
+  RUNTIME_MAP * RuntimeMapTag = FindHandoffTag(Handoff, LOADER_TAG_RUNTIME_MAP, &Size);
+  if(RuntimeMapTag != NULL)
+  {
+    RUNTIME_MAP * RuntimeMap = Loader_block->Runtime_Map;
+    CopyMem(RuntimeMapTag, RuntimeMap, sizeof(RUNTIME_MAP) + RuntimeMap->NumberOfRanges * sizeof(RUNTIME_MAP_RANGE));
+    Handoff->Capabilities |= LOADER_CAPABILITY(LOADER_TAG_RUNTIME_MAP);
+  }
+
+  LOADER_TIMING_TAG * Timing = FindHandoffTag(Handoff, LOADER_TAG_TIMING, &Size);
+  if(Timing != NULL)
+  {
+    Timing->ExitBootServicesStart_Tsc = ExitBootServicesStartTsc;
+    Timing->ExitBootServicesCall_Tsc = ExitBootServicesCallTsc;
+    Timing->ExitBootServices_Tsc = ExitBootServicesTsc;
+    Timing->ExitBootServices_Attempts = ExitBootServicesAttempts;
+
+    LOADER_BOOT_TIMELINE_TAG * Timeline = FindHandoffTag(Handoff, LOADER_TAG_BOOT_TIMELINE, &Size);
+    if(Timeline != NULL)
+    {
+      BuildBootTimeline(Timeline, Timing);
+      Handoff->Capabilities |= LOADER_CAPABILITY(LOADER_TAG_BOOT_TIMELINE);
+    }
+  }
+
+  // Anything logged after this only goes in LOADER_PARAMS->Loader_Log
+  LOADER_LOG * LogTag = FindHandoffTag(Handoff, LOADER_TAG_LOG, &Size);
+  if(LogTag != NULL)
+  {
+    CopyMem(LogTag, Loader_block->Loader_Log, Size);
+    Handoff->Capabilities |= LOADER_CAPABILITY(LOADER_TAG_LOG);
+  }
+}
+
+//==================================================================================================================================
+//  StampKernelEntry: Record When The Kernel Got Control
+//==================================================================================================================================
+//
+// Patch the kernel entry time into the timing tag and the boot timeline. Everything between FinishHandoff() and the jump (page tables,
+// AP checks, MTRRs, CPU features) counts as loader time, so this has to be the very last thing before the jump.
+//
+
+VOID StampKernelEntry(LOADER_HANDOFF_HEADER * Handoff)
+{
+  UINT64 Tsc = ReadTsc();
+  UINT32 Size;
+
+  LOADER_TIMING_TAG * Timing = FindHandoffTag(Handoff, LOADER_TAG_TIMING, &Size);
+  if(Timing == NULL)
+  {
+    return;
+  }
+  Timing->KernelEntry_Tsc = Tsc;
+
+  LOADER_BOOT_TIMELINE_TAG * Timeline = FindHandoffTag(Handoff, LOADER_TAG_BOOT_TIMELINE, &Size);
+  if(Timeline != NULL)
+  {
+    Timeline->KernelEntry = TscToNanoseconds(Tsc, Timing->TscFrequency);
+  }
+}
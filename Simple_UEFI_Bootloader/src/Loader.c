@@ -15,101 +15,57 @@
 
 #include "Bootloader.h"
 
+// Room for this many more descriptors gets allocated for the final memory map, since allocating it can change the map
+#define EXIT_BOOT_SERVICES_MEMMAP_SLACK 16
+
+// How many times GetMemoryMap() and ExitBootServices() get tried before giving up
+#define EXIT_BOOT_SERVICES_MAX_ATTEMPTS 8
+
+// Kernel64.txt, parsed. efi_main() picks SelectedEntry before GoTime() loads it.
+LOADER_CONFIG LoaderConfig;
+
+// Set by loader.memcheck=on (see SetMemoryCheck() below)
+STATIC UINT8 MemoryCheckEnabled = 0;
+
 //==================================================================================================================================
-//  GoTime: Kernel Loader
+//  LoadLoaderConfig: Read Kernel64.txt
 //==================================================================================================================================
 //
-// Load Kernel (64-bit PE32+, ELF, or Mach-O), exit boot services, and jump to the entry point of kernel file
+// Read Kernel64.txt from the folder this program is in and parse it into Config (see Config.c). The file stays in memory, since
+// Config's strings point into it, until GoTime() is done with it. Lines that don't make sense only get a warning, but there has to be
+// at least one boot entry with a kernel in it.
 //
 
-EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATION_TABLE * SysCfgTables, UINTN NumSysCfgTables, UINT32 UEFIVer)
+EFI_STATUS LoadLoaderConfig(EFI_HANDLE ImageHandle, LOADER_CONFIG * Config)
 {
-#ifdef GOP_DEBUG_ENABLED
-  // Integrity check
-  for(UINT64 k = 0; k < Graphics->NumberOfFrameBuffers; k++)
-  {
-    Print(L"GPU Mode: %u of %u\r\n", Graphics->GPUArray[k].Mode, Graphics->GPUArray[k].MaxMode - 1);
-    Print(L"GPU FB: 0x%016llx\r\n", Graphics->GPUArray[k].FrameBufferBase);
-    Print(L"GPU FB Size: 0x%016llx\r\n", Graphics->GPUArray[k].FrameBufferSize);
-    Print(L"GPU SizeOfInfo: %u Bytes\r\n", Graphics->GPUArray[k].SizeOfInfo);
-    Print(L"GPU Info Ver: 0x%x\r\n", Graphics->GPUArray[k].Info->Version);
-    Print(L"GPU Info Res: %ux%u\r\n", Graphics->GPUArray[k].Info->HorizontalResolution, Graphics->GPUArray[k].Info->VerticalResolution);
-    Print(L"GPU Info PxFormat: 0x%x\r\n", Graphics->GPUArray[k].Info->PixelFormat);
-    Print(L"GPU Info PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x\r\n", Graphics->GPUArray[k].Info->PixelInformation.RedMask, Graphics->GPUArray[k].Info->PixelInformation.GreenMask, Graphics->GPUArray[k].Info->PixelInformation.BlueMask, Graphics->GPUArray[k].Info->PixelInformation.ReservedMask);
-    Print(L"GPU Info PxPerScanLine: %u\r\n", Graphics->GPUArray[k].Info->PixelsPerScanLine);
-    Keywait(L"\0");
-  }
-#endif
-
-#ifdef LOADER_DEBUG_ENABLED
-  Print(L"GO GO GO!!!\r\n");
-#endif
-
-  EFI_STATUS GoTimeStatus;
-
-  // These hold data for the loader params at the end
-  EFI_PHYSICAL_ADDRESS KernelBaseAddress = 0;
-  UINTN KernelPages = 0;
-
-  // Load kernel file from somewhere on this drive
-
-	EFI_LOADED_IMAGE_PROTOCOL *LoadedImage;
+  EFI_STATUS config_status;
+  EFI_LOADED_IMAGE_PROTOCOL *LoadedImage;
 
-  // Get a pointer to the (loaded image) pointer of BOOTX64.EFI
-  // Pointer 1 -> Pointer 2 -> BOOTX64.EFI
-  // OpenProtocol wants Pointer 1 as input to give you Pointer 2.
-	GoTimeStatus = ST->BootServices->OpenProtocol(ImageHandle, &LoadedImageProtocol, (void**)&LoadedImage, ImageHandle, NULL, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
-  if(EFI_ERROR(GoTimeStatus))
+  config_status = BS->OpenProtocol(ImageHandle, &LoadedImageProtocol, (void**)&LoadedImage, ImageHandle, NULL, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+  if(EFI_ERROR(config_status))
   {
-    Print(L"LoadedImage OpenProtocol error. 0x%llx\r\n", GoTimeStatus);
-    return GoTimeStatus;
-  }
-
-  // Need these for later
-  CHAR16 * ESPRootTemp = DevicePathToStr(DevicePathFromHandle(LoadedImage->DeviceHandle));
-  UINT64 ESPRootSize = StrSize(ESPRootTemp);
-
-  // DevicePathToStr allocates memory of type Loadedimage->ImageDataType (this is set by firmware)
-  // Instead we want a known data type, so reallocate it:
-  CHAR16 * ESPRoot;
-
-  GoTimeStatus = ST->BootServices->AllocatePool(EfiLoaderData, ESPRootSize, (void**)&ESPRoot);
-  if(EFI_ERROR(GoTimeStatus))
-  {
-    Print(L"ESPRoot AllocatePool error. 0x%llx\r\n", GoTimeStatus);
-    return GoTimeStatus;
-  }
-
-  CopyMem(ESPRoot, ESPRootTemp, ESPRootSize);
-
-  GoTimeStatus = BS->FreePool(ESPRootTemp);
-  if(EFI_ERROR(GoTimeStatus))
-  {
-    Print(L"Error freeing ESPRootTemp pool. 0x%llx\r\n", GoTimeStatus);
-    return GoTimeStatus;
+    Print(L"LoadedImage OpenProtocol error. 0x%llx\r\n", config_status);
+    return config_status;
   }
 
   EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *FileSystem;
 
-  // Parent device of BOOTX64.EFI (the ImageHandle originally passed in is this very file)
-  // Loadedimage is an EFI_LOADED_IMAGE_PROTOCOL pointer that points to BOOTX64.EFI
-  GoTimeStatus = ST->BootServices->OpenProtocol(LoadedImage->DeviceHandle, &FileSystemProtocol, (void**)&FileSystem, ImageHandle, NULL, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
-  if(EFI_ERROR(GoTimeStatus))
+  config_status = BS->OpenProtocol(LoadedImage->DeviceHandle, &FileSystemProtocol, (void**)&FileSystem, ImageHandle, NULL, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+  if(EFI_ERROR(config_status))
   {
-    Print(L"FileSystem OpenProtocol error. 0x%llx\r\n", GoTimeStatus);
-    return GoTimeStatus;
+    Print(L"FileSystem OpenProtocol error. 0x%llx\r\n", config_status);
+    return config_status;
   }
 
   EFI_FILE *CurrentDriveRoot;
 
-  GoTimeStatus = FileSystem->OpenVolume(FileSystem, &CurrentDriveRoot);
-  if(EFI_ERROR(GoTimeStatus))
+  config_status = FileSystem->OpenVolume(FileSystem, &CurrentDriveRoot);
+  if(EFI_ERROR(config_status))
   {
-    Print(L"OpenVolume error. 0x%llx\r\n", GoTimeStatus);
-    return GoTimeStatus;
+    Print(L"OpenVolume error. 0x%llx\r\n", config_status);
+    return config_status;
   }
 
-///
   // Below Kernel64.txt loading & parsing code adapted from V2.1 of https://github.com/KNNSpeed/UEFI-Stub-Loader
 
   // Locate Kernel64.txt, which should be in the same directory as this program
@@ -117,9 +73,7 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
 
   CHAR16 * BootFilePath = ((FILEPATH_DEVICE_PATH*)LoadedImage->FilePath)->PathName;
 
-#ifdef LOADER_DEBUG_ENABLED
-  Print(L"BootFilePath: %s\r\n", BootFilePath);
-#endif
+  LOG_MESSAGE(LOADER, DEBUG, L"BootFilePath: %s", BootFilePath);
 
   UINTN TxtFilePathPrefixLength = 0;
   UINTN BootFilePathLength = 0;
@@ -135,10 +89,7 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
   BootFilePathLength += 1; // For Null Term
   TxtFilePathPrefixLength += 1; // To account for the last '\' in the file path (file path prefix does not get null-terminated)
 
-#ifdef LOADER_DEBUG_ENABLED
-  Print(L"BootFilePathLength: %llu, TxtFilePathPrefixLength: %llu, BootFilePath Size: %llu \r\n", BootFilePathLength, TxtFilePathPrefixLength, StrSize(BootFilePath));
-  Keywait(L"\0");
-#endif
+  LOG_MESSAGE(LOADER, DEBUG, L"BootFilePathLength: %llu, TxtFilePathPrefixLength: %llu, BootFilePath Size: %llu", BootFilePathLength, TxtFilePathPrefixLength, StrSize(BootFilePath));
 
   CONST CHAR16 TxtFileName[13] = L"Kernel64.txt";
 
@@ -147,11 +98,11 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
 
   CHAR16 * TxtFilePath;
 
-  GoTimeStatus = ST->BootServices->AllocatePool(EfiBootServicesData, TxtFilePathSize, (void**)&TxtFilePath);
-  if(EFI_ERROR(GoTimeStatus))
+  config_status = BS->AllocatePool(EfiBootServicesData, TxtFilePathSize, (void**)&TxtFilePath);
+  if(EFI_ERROR(config_status))
   {
-    Print(L"TxtFilePathPrefix AllocatePool error. 0x%llx\r\n", GoTimeStatus);
-    return GoTimeStatus;
+    Print(L"TxtFilePathPrefix AllocatePool error. 0x%llx\r\n", config_status);
+    return config_status;
   }
 
   // Don't really need this. Data is measured to be the right size, meaning every byte in TxtFilePath gets overwritten.
@@ -160,62 +111,54 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
   CopyMem(TxtFilePath, BootFilePath, TxtFilePathPrefixSize);
   CopyMem(&TxtFilePath[TxtFilePathPrefixLength], TxtFileName, sizeof(TxtFileName));
 
-#ifdef LOADER_DEBUG_ENABLED
-  Print(L"TxtFilePath: %s, TxtFilePath Size: %llu\r\n", TxtFilePath, TxtFilePathSize);
-  Keywait(L"\0");
-#endif
+  LOG_MESSAGE(LOADER, DEBUG, L"TxtFilePath: %s, TxtFilePath Size: %llu", TxtFilePath, TxtFilePathSize);
 
   // Get ready to open the Kernel64.txt file
   EFI_FILE *KernelcmdFile;
 
   // Open the Kernel64.txt file and assign it to the KernelcmdFile EFI_FILE variable
   // It turns out the Open command can support directory trees with "\" like in Windows. Neat!
-  GoTimeStatus = CurrentDriveRoot->Open(CurrentDriveRoot, &KernelcmdFile, TxtFilePath, EFI_FILE_MODE_READ, EFI_FILE_READ_ONLY);
-  if (EFI_ERROR(GoTimeStatus))
+  config_status = CurrentDriveRoot->Open(CurrentDriveRoot, &KernelcmdFile, TxtFilePath, EFI_FILE_MODE_READ, EFI_FILE_READ_ONLY);
+  if (EFI_ERROR(config_status))
   {
     Keywait(L"Kernel64.txt file is missing\r\n");
-    return GoTimeStatus;
+    return config_status;
   }
 
-#ifdef LOADER_DEBUG_ENABLED
-  Keywait(L"Kernel64.txt file opened.\r\n");
-#endif
+  LOG_MESSAGE(LOADER, DEBUG, L"Kernel64.txt file opened.");
 
   // Now to get Kernel64.txt's file size
   UINTN Txt_FileInfoSize;
   // Need to know the size of the file metadata to get the file metadata...
-  GoTimeStatus = KernelcmdFile->GetInfo(KernelcmdFile, &gEfiFileInfoGuid, &Txt_FileInfoSize, NULL);
+  config_status = KernelcmdFile->GetInfo(KernelcmdFile, &gEfiFileInfoGuid, &Txt_FileInfoSize, NULL);
   // GetInfo will intentionally error out and provide the correct Txt_FileInfoSize value
 
-#ifdef LOADER_DEBUG_ENABLED
-  Print(L"Txt_FileInfoSize: %llu Bytes\r\n", Txt_FileInfoSize);
-#endif
+  LOG_MESSAGE(LOADER, DEBUG, L"Txt_FileInfoSize: %llu Bytes", Txt_FileInfoSize);
 
   // Prep metadata destination
   EFI_FILE_INFO *Txt_FileInfo;
   // Reserve memory for file info/attributes and such to prevent it from getting run over
-  GoTimeStatus = ST->BootServices->AllocatePool(EfiBootServicesData, Txt_FileInfoSize, (void**)&Txt_FileInfo);
-  if(EFI_ERROR(GoTimeStatus))
+  config_status = BS->AllocatePool(EfiBootServicesData, Txt_FileInfoSize, (void**)&Txt_FileInfo);
+  if(EFI_ERROR(config_status))
   {
-    Print(L"Txt_FileInfo AllocatePool error. 0x%llx\r\n", GoTimeStatus);
-    return GoTimeStatus;
+    Print(L"Txt_FileInfo AllocatePool error. 0x%llx\r\n", config_status);
+    return config_status;
   }
 
   // Actually get the metadata
-  GoTimeStatus = KernelcmdFile->GetInfo(KernelcmdFile, &gEfiFileInfoGuid, &Txt_FileInfoSize, Txt_FileInfo);
-  if(EFI_ERROR(GoTimeStatus))
+  config_status = KernelcmdFile->GetInfo(KernelcmdFile, &gEfiFileInfoGuid, &Txt_FileInfoSize, Txt_FileInfo);
+  if(EFI_ERROR(config_status))
   {
-    Print(L"GetInfo error. 0x%llx\r\n", GoTimeStatus);
-    return GoTimeStatus;
+    Print(L"GetInfo error. 0x%llx\r\n", config_status);
+    return config_status;
   }
 
-#ifdef SHOW_KERNEL_METADATA
   // Show metadata
-  Print(L"FileName: %s\r\n", Txt_FileInfo->FileName);
-  Print(L"Size: %llu\r\n", Txt_FileInfo->Size);
-  Print(L"FileSize: %llu\r\n", Txt_FileInfo->FileSize);
-  Print(L"PhysicalSize: %llu\r\n", Txt_FileInfo->PhysicalSize);
-  Print(L"Attribute: %llx\r\n", Txt_FileInfo->Attribute);
+  LOG_MESSAGE(LOADER, DEBUG, L"FileName: %s", Txt_FileInfo->FileName);
+  LOG_MESSAGE(LOADER, DEBUG, L"Size: %llu", Txt_FileInfo->Size);
+  LOG_MESSAGE(LOADER, DEBUG, L"FileSize: %llu", Txt_FileInfo->FileSize);
+  LOG_MESSAGE(LOADER, DEBUG, L"PhysicalSize: %llu", Txt_FileInfo->PhysicalSize);
+  LOG_MESSAGE(LOADER, DEBUG, L"Attribute: %llx", Txt_FileInfo->Attribute);
 /*
   NOTE: Attributes:
 
@@ -228,185 +171,386 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
   #define EFI_FILE_VALID_ATTR 0x0000000000000037
 
 */
-  Print(L"Created: %02hhu/%02hhu/%04hu - %02hhu:%02hhu:%02hhu.%u\r\n", Txt_FileInfo->CreateTime.Month, Txt_FileInfo->CreateTime.Day, Txt_FileInfo->CreateTime.Year, Txt_FileInfo->CreateTime.Hour, Txt_FileInfo->CreateTime.Minute, Txt_FileInfo->CreateTime.Second, Txt_FileInfo->CreateTime.Nanosecond);
-  Print(L"Last Modified: %02hhu/%02hhu/%04hu - %02hhu:%02hhu:%02hhu.%u\r\n", Txt_FileInfo->ModificationTime.Month, Txt_FileInfo->ModificationTime.Day, Txt_FileInfo->ModificationTime.Year, Txt_FileInfo->ModificationTime.Hour, Txt_FileInfo->ModificationTime.Minute, Txt_FileInfo->ModificationTime.Second, Txt_FileInfo->ModificationTime.Nanosecond);
-  Keywait(L"\0");
-#endif
+  LOG_MESSAGE(LOADER, DEBUG, L"Created: %02hhu/%02hhu/%04hu - %02hhu:%02hhu:%02hhu.%u", Txt_FileInfo->CreateTime.Month, Txt_FileInfo->CreateTime.Day, Txt_FileInfo->CreateTime.Year, Txt_FileInfo->CreateTime.Hour, Txt_FileInfo->CreateTime.Minute, Txt_FileInfo->CreateTime.Second, Txt_FileInfo->CreateTime.Nanosecond);
+  LOG_MESSAGE(LOADER, DEBUG, L"Last Modified: %02hhu/%02hhu/%04hu - %02hhu:%02hhu:%02hhu.%u", Txt_FileInfo->ModificationTime.Month, Txt_FileInfo->ModificationTime.Day, Txt_FileInfo->ModificationTime.Year, Txt_FileInfo->ModificationTime.Hour, Txt_FileInfo->ModificationTime.Minute, Txt_FileInfo->ModificationTime.Second, Txt_FileInfo->ModificationTime.Nanosecond);
 
   // Read text file into memory now that we know the file size
-  CHAR16 * KernelcmdArray;
+  UINT8 * KernelcmdArray;
+  UINTN KernelcmdSize = Txt_FileInfo->FileSize;
   // Reserve memory for text file
-  GoTimeStatus = ST->BootServices->AllocatePool(EfiBootServicesData, Txt_FileInfo->FileSize, (void**)&KernelcmdArray);
-  if(EFI_ERROR(GoTimeStatus))
+  config_status = BS->AllocatePool(EfiBootServicesData, KernelcmdSize, (void**)&KernelcmdArray);
+  if(EFI_ERROR(config_status))
   {
-    Print(L"KernelcmdArray AllocatePool error. 0x%llx\r\n", GoTimeStatus);
-    return GoTimeStatus;
+    Print(L"KernelcmdArray AllocatePool error. 0x%llx\r\n", config_status);
+    return config_status;
   }
 
   // Actually read the file
-  GoTimeStatus = KernelcmdFile->Read(KernelcmdFile, &Txt_FileInfo->FileSize, KernelcmdArray);
-  if(EFI_ERROR(GoTimeStatus))
+  config_status = KernelcmdFile->Read(KernelcmdFile, &KernelcmdSize, KernelcmdArray);
+  if(EFI_ERROR(config_status))
   {
-    Print(L"KernelcmdArray read error. 0x%llx\r\n", GoTimeStatus);
-    return GoTimeStatus;
+    Print(L"KernelcmdArray read error. 0x%llx\r\n", config_status);
+    return config_status;
   }
 
-#ifdef LOADER_DEBUG_ENABLED
-  Keywait(L"KernelcmdFile read into memory.\r\n");
-#endif
+  LOG_MESSAGE(LOADER, DEBUG, L"KernelcmdFile read into memory.");
+
+  config_status = ParseLoaderConfig(KernelcmdArray, KernelcmdSize, Config);
+  if(config_status == EFI_UNSUPPORTED)
+  {
+    Print(L"Error: Kernel64.txt has the wrong endianness for this system.\r\n");
+    Print(L"Save it as UTF-8 or as UTF-16 LE (\"Unicode\" in Windows Notepad).\r\n");
+    Keywait(L"Please fix the file and try again.\r\n");
+    return config_status;
+  }
+  else if(config_status == EFI_BAD_BUFFER_SIZE)
+  {
+    Keywait(L"Error: Kernel64.txt is too big.\r\n");
+    return config_status;
+  }
+  else if(EFI_ERROR(config_status))
+  {
+    Print(L"Error: Kernel64.txt doesn't have a kernel in it.\r\n");
+    Keywait(L"Please fix the file and try again.\r\n");
+    return config_status;
+  }
+
+  if(Config->ErrorLine)
+  {
+    Print(L"Warning: Ignoring line %u of Kernel64.txt, which doesn't make sense.\r\n", Config->ErrorLine);
+    LOG_MESSAGE(LOADER, WARNING, L"Kernel64.txt line %u ignored", Config->ErrorLine);
+  }
+
+  LOG_MESSAGE(LOADER, INFO, L"Kernel64.txt v%u (%s), %u boot entries", Config->Version, (Config->Encoding == LOADER_CONFIG_UTF16) ? L"UTF-16" : L"UTF-8", Config->NumberOfEntries);
+
+  config_status = KernelcmdFile->Close(KernelcmdFile);
+  if(EFI_ERROR(config_status))
+  {
+    Print(L"Error closing Kernel64.txt. 0x%llx\r\n", config_status);
+    return config_status;
+  }
+
+  // Free pools allocated from before as they are no longer needed
+  config_status = BS->FreePool(TxtFilePath);
+  if(EFI_ERROR(config_status))
+  {
+    Print(L"Error freeing TxtFilePathPrefix pool. 0x%llx\r\n", config_status);
+    return config_status;
+  }
+
+  config_status = BS->FreePool(Txt_FileInfo);
+  if(EFI_ERROR(config_status))
+  {
+    Print(L"Error freeing Txt_FileInfo pool. 0x%llx\r\n", config_status);
+    return config_status;
+  }
+
+  return config_status;
+}
+
+//==================================================================================================================================
+//  AllocateBootPages: Allocate Pages For The Kernel Or A Module
+//==================================================================================================================================
+//
+// AllocateAnyPages, unless the boot entry's placement keeps everything below 4GB.
+//
 
-  // UTF-16 format check
-  UINT16 BOM_check = UTF16_BOM_LE;
-  if(!compare(KernelcmdArray, &BOM_check, 2))
+STATIC EFI_STATUS AllocateBootPages(UINT64 pages, EFI_PHYSICAL_ADDRESS * AllocatedMemory)
+{
+  if(LoaderConfig.Entries[LoaderConfig.SelectedEntry].Placement == LOADER_PLACEMENT_BELOW_4GB)
   {
-    BOM_check = UTF16_BOM_BE; // Check endianness
-    if(compare(KernelcmdArray, &BOM_check, 2))
+    *AllocatedMemory = 0xFFFFFFFF;
+    return BS->AllocatePages(AllocateMaxAddress, EfiLoaderData, pages, AllocatedMemory);
+  }
+
+  return BS->AllocatePages(AllocateAnyPages, EfiLoaderData, pages, AllocatedMemory);
+}
+
+//==================================================================================================================================
+//  LoadBootModules: Load A Boot Entry's Module Files
+//==================================================================================================================================
+//
+// Read each of Entry's module files (an initrd, a font, whatever the kernel wants) from Root into pages of its own, and list them in
+// a LOADER_MODULES_TAG in Kernel64.txt order. Modules[0] is left for the kernel, which GoTime() fills in once it knows the kernel's
+// virtual base. Each module's last page is zeroed past the end of the file.
+//
+
+STATIC EFI_STATUS LoadBootModules(EFI_FILE * Root, CONST LOADER_CONFIG_ENTRY * Entry, LOADER_MODULES_TAG ** Modules)
+{
+  EFI_STATUS module_status;
+  UINT64 ModulesSize = sizeof(LOADER_MODULES_TAG) + (1 + Entry->NumberOfModules) * sizeof(LOADER_MODULE);
+
+  module_status = BS->AllocatePool(EfiLoaderData, ModulesSize, (void**)Modules);
+  if(EFI_ERROR(module_status))
+  {
+    Print(L"Modules AllocatePool error. 0x%llx\r\n", module_status);
+    return module_status;
+  }
+  ZeroMem(*Modules, ModulesSize);
+  (*Modules)->NumberOfModules = 1 + Entry->NumberOfModules;
+
+  for(UINT32 k = 0; k < Entry->NumberOfModules; k++)
+  {
+    LOADER_MODULE * Module = &(*Modules)->Modules[k + 1];
+    CHAR16 * ModulePath;
+
+    module_status = BS->AllocatePool(EfiBootServicesData, (Entry->Modules[k].Length + 1) * sizeof(CHAR16), (void**)&ModulePath);
+    if(EFI_ERROR(module_status))
     {
-      Print(L"Error: Kernel64.txt has the wrong endianness for this system.\r\n");
+      Print(L"ModulePath AllocatePool error. 0x%llx\r\n", module_status);
+      return module_status;
     }
-    else // Probably missing a BOM
+    ConfigSpanToChar16(&LoaderConfig, &Entry->Modules[k], ModulePath);
+
+    EFI_FILE * ModuleFile;
+    module_status = Root->Open(Root, &ModuleFile, ModulePath, EFI_FILE_MODE_READ, EFI_FILE_READ_ONLY);
+    if(EFI_ERROR(module_status))
     {
-      Print(L"Error: Kernel64.txt not formatted as UTF-16/UCS-2 with BOM.\r\n\n");
-      Print(L"Q: What is a BOM?\r\n\n");
-      Print(L"A: The BOM (Byte Order Mark) is a 2-byte identification sequence\r\n");
-      Print(L"(U+FEFF) at the start of a UTF16/UCS-2-encoded file.\r\n");
-      Print(L"Unfortunately not all editors add it in, and without\r\n");
-      Print(L"a BOM present programs like this one cannot easily tell that a\r\n");
-      Print(L"text file is encoded in UTF16/UCS-2.\r\n\n");
-      Print(L"Windows Notepad & Wordpad and Linux gedit & xed all add BOMs when\r\n");
-      Print(L"saving files as .txt with encoding set to \"Unicode\" (Windows)\r\n");
-      Print(L"or \"UTF16\" (Linux), so use one of them to make Kernel64.txt.\r\n\n");
+      Print(L"%s file is missing\r\n", ModulePath);
+      return module_status;
     }
-    Keywait(L"Please fix the file and try again.\r\n");
-    return GoTimeStatus;
-  }
-  // Parse Kernel64.txt file for location of kernel image and command line
-  // Kernel image location line will be of format e.g. \EFI\ubuntu\vmlinuz.efi followed by \n or \r\n
-  // Command line will just go until the next \n or \r\n, and should just be loaded as a UTF-16 string
 
-  // Get size of kernel image path & command line and populate the data retention variables
-  UINT64 FirstLineLength = 0;
-  UINT64 KernelPathSize = 0;
+    UINTN ModuleInfoSize = 0;
+    EFI_FILE_INFO * ModuleInfo;
+    ModuleFile->GetInfo(ModuleFile, &gEfiFileInfoGuid, &ModuleInfoSize, NULL); // Intentionally errors out with the size
 
-  for(UINT64 i = 1; i < ((Txt_FileInfo->FileSize) >> 1); i++) // i starts at 1 to skip the BOM, ((Txt_FileInfo->FileSize) >> 1) is the number of 2-byte units in the file
-  {
-    if(KernelcmdArray[i] == L'\n')
+    module_status = BS->AllocatePool(EfiBootServicesData, ModuleInfoSize, (void**)&ModuleInfo);
+    if(EFI_ERROR(module_status))
     {
-      // Account for the L'\n'
-      FirstLineLength = i + 1;
-      // The extra +1 is to start the command line parse in the correct place
-      break;
+      Print(L"ModuleInfo AllocatePool error. 0x%llx\r\n", module_status);
+      return module_status;
     }
-    else if(KernelcmdArray[i] == L'\r')
+
+    module_status = ModuleFile->GetInfo(ModuleFile, &gEfiFileInfoGuid, &ModuleInfoSize, ModuleInfo);
+    if(EFI_ERROR(module_status))
     {
-      // There'll be a \n after the \r
-      FirstLineLength = i + 1 + 1;
-      // The extra +1 is to start the command line parse in the correct place
-      break;
+      Print(L"Module GetInfo error. 0x%llx\r\n", module_status);
+      return module_status;
     }
 
-    if(KernelcmdArray[i] != L' ') // There might be an errant space or two. Ignore them.
+    UINTN ModuleFileSize = ModuleInfo->FileSize;
+    UINT64 pages = EFI_SIZE_TO_PAGES(ModuleFileSize);
+    if(pages == 0)
     {
-      KernelPathSize++;
+      pages = 1; // Empty files still get an address
     }
-  }
-  UINT64 KernelPathLen = KernelPathSize; // Need this for later
-  // Need to add null terminator. Multiply by size of CHAR16 (2 bytes) to get size.
-  KernelPathSize = (KernelPathSize + 1) << 1; // (KernelPathSize + 1) * sizeof(CHAR16)
 
-#ifdef LOADER_DEBUG_ENABLED
-  Print(L"KernelPathSize: %llu\r\n", KernelPathSize);
-#endif
+    module_status = BS->FreePool(ModuleInfo);
+    if(EFI_ERROR(module_status))
+    {
+      Print(L"Error freeing ModuleInfo pool. 0x%llx\r\n", module_status);
+      return module_status;
+    }
 
-  // Command line's turn
-  UINT64 CmdlineSize = 0; // Interestingly, the Linux kernel only takes 256 to 4096 chars for load options depending on architecture. Here's 2^63 UTF-16 characters (-1 to account for null terminator).
+    module_status = AllocateBootPages(pages, &Module->PhysicalStart);
+    if(EFI_ERROR(module_status))
+    {
+      Print(L"Could not allocate pages for %s. 0x%llx\r\n", ModulePath, module_status);
+      return module_status;
+    }
+    Module->Size = pages << EFI_PAGE_SHIFT;
+    Module->Type = LOADER_MODULE_FILE;
 
-  for(UINT64 j = FirstLineLength; j < ((Txt_FileInfo->FileSize) >> 1); j++)
-  {
-    if((KernelcmdArray[j] == L'\n') || (KernelcmdArray[j] == L'\r')) // Reached the end of the line
+    module_status = ModuleFile->Read(ModuleFile, &ModuleFileSize, (VOID*)Module->PhysicalStart);
+    if(EFI_ERROR(module_status))
     {
-      break;
+      Print(L"Error reading %s. 0x%llx\r\n", ModulePath, module_status);
+      return module_status;
     }
+    ZeroMem((UINT8*)Module->PhysicalStart + ModuleFileSize, Module->Size - ModuleFileSize);
+
+    LOG_MESSAGE(LOADER, INFO, L"Module %s: %llu bytes at 0x%llx", ModulePath, (UINT64)ModuleFileSize, Module->PhysicalStart);
+
+    ModuleFile->Close(ModuleFile);
 
-    CmdlineSize++;
+    module_status = BS->FreePool(ModulePath);
+    if(EFI_ERROR(module_status))
+    {
+      Print(L"Error freeing ModulePath pool. 0x%llx\r\n", module_status);
+      return module_status;
+    }
   }
-  UINT64 CmdlineLen = CmdlineSize; // Need this for later
-  // Need to add null terminator. Multiply by size of CHAR16 (2 bytes) to get size.
-  CmdlineSize = (CmdlineSize + 1) << 1; // (CmdlineSize + 1) * sizeof(CHAR16)
 
-#ifdef LOADER_DEBUG_ENABLED
-  Print(L"CmdlineSize: %llu\r\n", CmdlineSize);
-#endif
+  return EFI_SUCCESS;
+}
 
-  CHAR16 * KernelPath; // EFI Kernel file's Path
-  GoTimeStatus = ST->BootServices->AllocatePool(EfiLoaderData, KernelPathSize, (void**)&KernelPath);
+//==================================================================================================================================
+//  SetMemoryCheck: Turn The Buggy Firmware Workaround On Or Off
+//==================================================================================================================================
+//
+// Handle a loader.memcheck= option from Kernel64.txt. With "on", the kernel loaders make sure the pages they got for the kernel are
+// really free, and go looking for some that are if not (see FindActuallyFreePages() in Placement.c). That's only needed on firmware
+// that hands out memory that's in use, and it can take a while, so it's off by default. Setting is the Length characters at Setting,
+// which doesn't need to be null-terminated.
+//
+
+STATIC VOID SetMemoryCheck(CONST CHAR16 * Setting, UINT64 Length)
+{
+  if((Length >= 2) && compare(Setting, L"on", 2 * sizeof(CHAR16)) && ((Length == 2) || (Setting[2] == L' ')))
+  {
+    MemoryCheckEnabled = 1;
+  }
+  else if((Length >= 3) && compare(Setting, L"off", 3 * sizeof(CHAR16)) && ((Length == 3) || (Setting[3] == L' ')))
+  {
+    MemoryCheckEnabled = 0;
+  }
+  else
+  {
+    LOG_MESSAGE(LOADER, WARNING, L"loader.memcheck= takes on or off");
+  }
+}
+
+//==================================================================================================================================
+//  GoTime: Kernel Loader
+//==================================================================================================================================
+//
+// Load Kernel (64-bit PE32+, ELF, or Mach-O), exit boot services, and jump to the entry point of kernel file
+//
+// ExitBootServicesCalled gets set once ExitBootServices() has been tried, whether or not it worked, since after that the caller can't
+// use boot services (like the console) to report anything.
+//
+
+EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATION_TABLE * SysCfgTables, UINTN NumSysCfgTables, UINT32 UEFIVer, UINT8 * ExitBootServicesCalled)
+{
+  *ExitBootServicesCalled = 0;
+
+  // Integrity check
+  for(UINT64 k = 0; k < Graphics->NumberOfFrameBuffers; k++)
+  {
+    LOG_MESSAGE(GOP, DEBUG, L"GPU Mode: %u of %u", Graphics->GPUArray[k].Mode, Graphics->GPUArray[k].MaxMode - 1);
+    LOG_MESSAGE(GOP, DEBUG, L"GPU FB: 0x%016llx", Graphics->GPUArray[k].FrameBufferBase);
+    LOG_MESSAGE(GOP, DEBUG, L"GPU FB Size: 0x%016llx", Graphics->GPUArray[k].FrameBufferSize);
+    LOG_MESSAGE(GOP, DEBUG, L"GPU SizeOfInfo: %u Bytes", Graphics->GPUArray[k].SizeOfInfo);
+    LOG_MESSAGE(GOP, DEBUG, L"GPU Info Ver: 0x%x", Graphics->GPUArray[k].Info->Version);
+    LOG_MESSAGE(GOP, DEBUG, L"GPU Info Res: %ux%u", Graphics->GPUArray[k].Info->HorizontalResolution, Graphics->GPUArray[k].Info->VerticalResolution);
+    LOG_MESSAGE(GOP, DEBUG, L"GPU Info PxFormat: 0x%x", Graphics->GPUArray[k].Info->PixelFormat);
+    LOG_MESSAGE(GOP, DEBUG, L"GPU Info PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x", Graphics->GPUArray[k].Info->PixelInformation.RedMask, Graphics->GPUArray[k].Info->PixelInformation.GreenMask, Graphics->GPUArray[k].Info->PixelInformation.BlueMask, Graphics->GPUArray[k].Info->PixelInformation.ReservedMask);
+    LOG_MESSAGE(GOP, DEBUG, L"GPU Info PxPerScanLine: %u", Graphics->GPUArray[k].Info->PixelsPerScanLine);
+  }
+
+  LOG_MESSAGE(LOADER, DEBUG, L"GO GO GO!!!");
+
+  EFI_STATUS GoTimeStatus;
+
+  // These hold data for the loader params at the end
+  EFI_PHYSICAL_ADDRESS KernelBaseAddress = 0;
+  UINTN KernelPages = 0;
+
+  // Load kernel file from somewhere on this drive
+
+	EFI_LOADED_IMAGE_PROTOCOL *LoadedImage;
+
+  // Get a pointer to the (loaded image) pointer of BOOTX64.EFI
+  // Pointer 1 -> Pointer 2 -> BOOTX64.EFI
+  // OpenProtocol wants Pointer 1 as input to give you Pointer 2.
+	GoTimeStatus = ST->BootServices->OpenProtocol(ImageHandle, &LoadedImageProtocol, (void**)&LoadedImage, ImageHandle, NULL, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
   if(EFI_ERROR(GoTimeStatus))
   {
-    Print(L"KernelPath AllocatePool error. 0x%llx\r\n", GoTimeStatus);
+    Print(L"LoadedImage OpenProtocol error. 0x%llx\r\n", GoTimeStatus);
     return GoTimeStatus;
   }
 
-  CHAR16 * Cmdline; // Command line to pass to EFI kernel
-  GoTimeStatus = ST->BootServices->AllocatePool(EfiLoaderData, CmdlineSize, (void**)&Cmdline);
+  // Need these for later
+  CHAR16 * ESPRootTemp = DevicePathToStr(DevicePathFromHandle(LoadedImage->DeviceHandle));
+  UINT64 ESPRootSize = StrSize(ESPRootTemp);
+
+  // DevicePathToStr allocates memory of type Loadedimage->ImageDataType (this is set by firmware)
+  // Instead we want a known data type, so reallocate it:
+  CHAR16 * ESPRoot;
+
+  GoTimeStatus = ST->BootServices->AllocatePool(EfiLoaderData, ESPRootSize, (void**)&ESPRoot);
   if(EFI_ERROR(GoTimeStatus))
   {
-    Print(L"Cmdline AllocatePool error. 0x%llx\r\n", GoTimeStatus);
+    Print(L"ESPRoot AllocatePool error. 0x%llx\r\n", GoTimeStatus);
     return GoTimeStatus;
   }
 
-  for(UINT64 i = 1; i < FirstLineLength; i++)
-  {
-    if((KernelcmdArray[i] == L'\n') || (KernelcmdArray[i] == L'\r'))
-    {
-      break;
-    }
+  CopyMem(ESPRoot, ESPRootTemp, ESPRootSize);
 
-    if(KernelcmdArray[i] != L' ') // There might be an errant space or two. Ignore them.
-    {
-      KernelPath[i-1] = KernelcmdArray[i]; // i-1 to ignore the 2 bytes of UTF-16 BOM
-    }
+  GoTimeStatus = BS->FreePool(ESPRootTemp);
+  if(EFI_ERROR(GoTimeStatus))
+  {
+    Print(L"Error freeing ESPRootTemp pool. 0x%llx\r\n", GoTimeStatus);
+    return GoTimeStatus;
   }
-  KernelPath[KernelPathLen] = L'\0'; // Need to null-terminate this string
 
-  // Command line's turn
-  for(UINT64 j = FirstLineLength; j < ((Txt_FileInfo->FileSize) >> 1); j++)
-  {
-    if((KernelcmdArray[j] == L'\n') || (KernelcmdArray[j] == L'\r')) // Reached the end of the line
-    {
-      break;
-    }
+  EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *FileSystem;
 
-    Cmdline[j-FirstLineLength] = KernelcmdArray[j];
+  // Parent device of BOOTX64.EFI (the ImageHandle originally passed in is this very file)
+  // Loadedimage is an EFI_LOADED_IMAGE_PROTOCOL pointer that points to BOOTX64.EFI
+  GoTimeStatus = ST->BootServices->OpenProtocol(LoadedImage->DeviceHandle, &FileSystemProtocol, (void**)&FileSystem, ImageHandle, NULL, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+  if(EFI_ERROR(GoTimeStatus))
+  {
+    Print(L"FileSystem OpenProtocol error. 0x%llx\r\n", GoTimeStatus);
+    return GoTimeStatus;
   }
-  Cmdline[CmdlineLen] = L'\0'; // Need to null-terminate this string
 
-#ifdef LOADER_DEBUG_ENABLED
-  Print(L"Kernel image path: %s\r\nKernel image path size: %u\r\n", KernelPath, KernelPathSize);
-  Print(L"Kernel command line: %s\r\nKernel command line size: %u\r\n", Cmdline, CmdlineSize);
-  Keywait(L"Loading image... (might take a second or two after pressing a key)\r\n");
-#endif
+  EFI_FILE *CurrentDriveRoot;
 
-  // Free pools allocated from before as they are no longer needed
-  GoTimeStatus = BS->FreePool(TxtFilePath);
+  GoTimeStatus = FileSystem->OpenVolume(FileSystem, &CurrentDriveRoot);
   if(EFI_ERROR(GoTimeStatus))
   {
-    Print(L"Error freeing TxtFilePathPrefix pool. 0x%llx\r\n", GoTimeStatus);
+    Print(L"OpenVolume error. 0x%llx\r\n", GoTimeStatus);
     return GoTimeStatus;
   }
 
-  GoTimeStatus = BS->FreePool(KernelcmdArray);
+///
+  // Kernel64.txt was already read by LoadLoaderConfig(), so all that's left is to turn the chosen entry's strings into UTF-16 for the
+  // kernel. The parser measured them, so they each get allocated exactly once.
+  LOADER_CONFIG_ENTRY * BootEntry = &LoaderConfig.Entries[LoaderConfig.SelectedEntry];
+
+  UINT64 KernelPathSize = (BootEntry->Kernel.Length + 1) << 1; // (Length + 1) * sizeof(CHAR16), for the null terminator
+  UINT64 CmdlineSize = (BootEntry->Options.Length + 1) << 1;
+
+  LOG_MESSAGE(LOADER, DEBUG, L"KernelPathSize: %llu, CmdlineSize: %llu", KernelPathSize, CmdlineSize);
+
+  CHAR16 * KernelPath; // EFI Kernel file's Path
+  GoTimeStatus = ST->BootServices->AllocatePool(EfiLoaderData, KernelPathSize, (void**)&KernelPath);
   if(EFI_ERROR(GoTimeStatus))
   {
-    Print(L"Error freeing KernelcmdArray pool. 0x%llx\r\n", GoTimeStatus);
+    Print(L"KernelPath AllocatePool error. 0x%llx\r\n", GoTimeStatus);
     return GoTimeStatus;
   }
+  ConfigSpanToChar16(&LoaderConfig, &BootEntry->Kernel, KernelPath);
 
-  GoTimeStatus = BS->FreePool(Txt_FileInfo);
+  CHAR16 * Cmdline; // Command line to pass to EFI kernel
+  GoTimeStatus = ST->BootServices->AllocatePool(EfiLoaderData, CmdlineSize, (void**)&Cmdline);
   if(EFI_ERROR(GoTimeStatus))
   {
-    Print(L"Error freeing Txt_FileInfo pool. 0x%llx\r\n", GoTimeStatus);
+    Print(L"Cmdline AllocatePool error. 0x%llx\r\n", GoTimeStatus);
     return GoTimeStatus;
   }
+  UINT64 CmdlineLen = ConfigSpanToChar16(&LoaderConfig, &BootEntry->Options, Cmdline);
+
+  // The loader's own options: loader.log= changes the log levels (see SetLoaderLogLevels() in Log.c), overriding the LoaderLog
+  // variable, loader.fastboot= turns the fast-boot profile on or off (see FastBoot.c), and loader.memcheck= turns the check for
+  // kernel pages that aren't really free on or off (see SetMemoryCheck() above)
+  for(UINT64 i = 0; i < CmdlineLen; i++)
+  {
+    if((i != 0) && (Cmdline[i - 1] != L' '))
+    {
+      continue;
+    }
+
+    if((i + 11 <= CmdlineLen) && compare(&Cmdline[i], L"loader.log=", 11 * sizeof(CHAR16)))
+    {
+      SetLoaderLogLevels(&Cmdline[i + 11], CmdlineLen - (i + 11));
+    }
+    else if((i + 16 <= CmdlineLen) && compare(&Cmdline[i], L"loader.fastboot=", 16 * sizeof(CHAR16)))
+    {
+      SetFastBoot(&Cmdline[i + 16], CmdlineLen - (i + 16));
+    }
+    else if((i + 16 <= CmdlineLen) && compare(&Cmdline[i], L"loader.memcheck=", 16 * sizeof(CHAR16)))
+    {
+      SetMemoryCheck(&Cmdline[i + 16], CmdlineLen - (i + 16));
+    }
+  }
+
+  LOG_MESSAGE(LOADER, DEBUG, L"Kernel image path: %s", KernelPath);
+  LOG_MESSAGE(LOADER, DEBUG, L"Kernel image path size: %u", KernelPathSize);
+  LOG_MESSAGE(LOADER, DEBUG, L"Kernel command line: %s", Cmdline);
+  LOG_MESSAGE(LOADER, DEBUG, L"Kernel command line size: %u", CmdlineSize);
+  LOG_MESSAGE(LOADER, DEBUG, L"Loading image...");
 
 ///
 
@@ -420,15 +564,12 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
 		return GoTimeStatus;
 	}
 
-#ifdef LOADER_DEBUG_ENABLED
-  Keywait(L"Kernel file opened.\r\n");
-#endif
+  LOG_MESSAGE(LOADER, DEBUG, L"Kernel file opened.");
 
   // Get address of start of file
   // ...Don't need to do this
 //  UINT64 FileStartPosition;
 //  KernelFile->GetPosition(KernelFile, &FileStartPosition);
-//  Keywait(L"Kernel file start position acquired.\r\n");
 
   // Default ImageBase for 64-bit PE DLLs
   EFI_PHYSICAL_ADDRESS Header_memory = 0x400000;
@@ -438,9 +579,7 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
   GoTimeStatus = KernelFile->GetInfo(KernelFile, &gEfiFileInfoGuid, &FileInfoSize, NULL);
   // GetInfo will intentionally error out and provide the correct fileinfosize value
 
-#ifdef LOADER_DEBUG_ENABLED
-  Print(L"FileInfoSize: %llu Bytes\r\n", FileInfoSize);
-#endif
+  LOG_MESSAGE(LOADER, DEBUG, L"FileInfoSize: %llu Bytes", FileInfoSize);
 
   EFI_FILE_INFO *FileInfo;
   GoTimeStatus = ST->BootServices->AllocatePool(EfiLoaderData, FileInfoSize, (void**)&FileInfo); // Reserve memory for file info/attributes and such, to prevent it from getting run over
@@ -458,13 +597,12 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
     return GoTimeStatus;
   }
 
-#ifdef SHOW_KERNEL_METADATA
   // Show metadata
-  Print(L"FileName: %s\r\n", FileInfo->FileName);
-  Print(L"Size: %llu\r\n", FileInfo->Size);
-  Print(L"FileSize: %llu\r\n", FileInfo->FileSize);
-  Print(L"PhysicalSize: %llu\r\n", FileInfo->PhysicalSize);
-  Print(L"Attribute: %llx\r\n", FileInfo->Attribute);
+  LOG_MESSAGE(LOADER, DEBUG, L"FileName: %s", FileInfo->FileName);
+  LOG_MESSAGE(LOADER, DEBUG, L"Size: %llu", FileInfo->Size);
+  LOG_MESSAGE(LOADER, DEBUG, L"FileSize: %llu", FileInfo->FileSize);
+  LOG_MESSAGE(LOADER, DEBUG, L"PhysicalSize: %llu", FileInfo->PhysicalSize);
+  LOG_MESSAGE(LOADER, DEBUG, L"Attribute: %llx", FileInfo->Attribute);
 /*
   NOTE: Attributes:
 
@@ -477,13 +615,10 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
   #define EFI_FILE_VALID_ATTR 0x0000000000000037
 
 */
-  Print(L"Created: %02hhu/%02hhu/%04hu - %02hhu:%02hhu:%02hhu.%u\r\n", FileInfo->CreateTime.Month, FileInfo->CreateTime.Day, FileInfo->CreateTime.Year, FileInfo->CreateTime.Hour, FileInfo->CreateTime.Minute, FileInfo->CreateTime.Second, FileInfo->CreateTime.Nanosecond);
-  Print(L"Last Modified: %02hhu/%02hhu/%04hu - %02hhu:%02hhu:%02hhu.%u\r\n", FileInfo->ModificationTime.Month, FileInfo->ModificationTime.Day, FileInfo->ModificationTime.Year, FileInfo->ModificationTime.Hour, FileInfo->ModificationTime.Minute, FileInfo->ModificationTime.Second, FileInfo->ModificationTime.Nanosecond);
-#endif
+  LOG_MESSAGE(LOADER, DEBUG, L"Created: %02hhu/%02hhu/%04hu - %02hhu:%02hhu:%02hhu.%u", FileInfo->CreateTime.Month, FileInfo->CreateTime.Day, FileInfo->CreateTime.Year, FileInfo->CreateTime.Hour, FileInfo->CreateTime.Minute, FileInfo->CreateTime.Second, FileInfo->CreateTime.Nanosecond);
+  LOG_MESSAGE(LOADER, DEBUG, L"Last Modified: %02hhu/%02hhu/%04hu - %02hhu:%02hhu:%02hhu.%u", FileInfo->ModificationTime.Month, FileInfo->ModificationTime.Day, FileInfo->ModificationTime.Year, FileInfo->ModificationTime.Hour, FileInfo->ModificationTime.Minute, FileInfo->ModificationTime.Second, FileInfo->ModificationTime.Nanosecond);
 
-#ifdef LOADER_DEBUG_ENABLED
-  Keywait(L"GetInfo memory allocated and populated.\r\n");
-#endif
+  LOG_MESSAGE(LOADER, DEBUG, L"GetInfo memory allocated and populated.");
 
   // Read file header
 //  UINTN size = 0x40; // Size of DOS header
@@ -497,9 +632,7 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
     return GoTimeStatus;
   }
 
-#ifdef LOADER_DEBUG_ENABLED
-  Keywait(L"DOS Header read from file.\r\n");
-#endif
+  LOG_MESSAGE(LOADER, DEBUG, L"DOS Header read from file.");
 
   // For the entry point jump, we need to know if the file uses ms_abi (is a PE image) or sysv_abi (*NIX image) calling convention
   UINT8 KernelisPE = 0;
@@ -511,12 +644,10 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
     //  64-Bit PE32+ Loader
     //----------------------------------------------------------------------------------------------------------------------------------
 
-#ifdef LOADER_DEBUG_ENABLED
-    Keywait(L"DOS header passed.\r\n");
-    Print(L"e_lfanew: 0x%x\r\n", DOSheader.e_lfanew);
+    LOG_MESSAGE(LOADER, DEBUG, L"DOS header passed.");
+    LOG_MESSAGE(LOADER, DEBUG, L"e_lfanew: 0x%x", DOSheader.e_lfanew);
 //    Print(L"FileStart: 0x%llx\r\n", &FileStartPosition);
 //    Print(L"Corrected filestart: 0x%llx\r\n", &FileStartPosition + (UINT64)DOSheader.e_lfanew);
-#endif
 
     // Get to the PE section of the header (Use the pointer at offset 0x3C, which contains the offset of the PE header relative to the start of the file)
     GoTimeStatus = KernelFile->SetPosition(KernelFile, (UINT64)DOSheader.e_lfanew); // Go to PE Header
@@ -537,9 +668,7 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
       return GoTimeStatus;
     }
 
-#ifdef LOADER_DEBUG_ENABLED
-    Print(L"PE Header Signature: 0x%x\r\n", PEHeader.Signature);
-#endif
+    LOG_MESSAGE(LOADER, DEBUG, L"PE Header Signature: 0x%x", PEHeader.Signature);
 
     //NOTE: SetPosition is RELATIVE TO THE FILE. Phoenix wiki is unclear:
     // the position is not "absolute" (implying absolute memory location with
@@ -549,17 +678,13 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
     {
       // PE
 
-#ifdef LOADER_DEBUG_ENABLED
-      Keywait(L"PE header passed.\r\n");
-#endif
+      LOG_MESSAGE(LOADER, DEBUG, L"PE header passed.");
 
       if(PEHeader.FileHeader.Machine == IMAGE_FILE_MACHINE_X64 && PEHeader.OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC) // PE Headers have Signature, FileHeader, and OptionalHeader
       {
         // PE32+
 
-#ifdef LOADER_DEBUG_ENABLED
-        Keywait(L"PE32+ header passed.\r\n");
-#endif
+        LOG_MESSAGE(LOADER, DEBUG, L"PE32+ header passed.");
 
         if (PEHeader.OptionalHeader.Subsystem != IMAGE_SUBSYSTEM_EFI_APPLICATION) // Was it compiled with -Wl,--subsystem,10 (MINGW-W64 GCC)?
         {
@@ -572,9 +697,7 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
         // It's a PE image
         KernelisPE = 1;
 
-#ifdef LOADER_DEBUG_ENABLED
-        Keywait(L"UEFI PE32+ header passed.\r\n");
-#endif
+        LOG_MESSAGE(LOADER, DEBUG, L"UEFI PE32+ header passed.");
 
         UINT64 i; // Iterator
         UINT64 virt_size = 0; // Size of all the data sections combined, which we need to know in order to allocate the right number of pages
@@ -582,11 +705,8 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
         size = IMAGE_SIZEOF_SECTION_HEADER*Numofsections; // Size of section header table in file
 
 //        IMAGE_SECTION_HEADER *section_headers_table_pointer = section_headers_table; // Pointer to the first section header is the same as a pointer to the table
-#ifdef PE_LOADER_DEBUG_ENABLED
-        Print(L"Numofsections: %llu, size: %llu\r\n", Numofsections, size);
+        LOG_MESSAGE(PE, DEBUG, L"Numofsections: %llu, size: %llu", Numofsections, size);
 //        Print(L"section_headers_table_pointer: 0x%llx\r\n&section_headers_table[0]: 0x%llx\r\n", section_headers_table_pointer, &section_headers_table[0]);
-        Keywait(L"\0");
-#endif
 
         IMAGE_SECTION_HEADER * section_headers_table; // This table is an array of section headers
 
@@ -610,394 +730,72 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
         {
           IMAGE_SECTION_HEADER *specific_section_header = &section_headers_table[i];
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-          Print(L"current section address: 0x%x, size: 0x%x\r\n", specific_section_header->VirtualAddress, specific_section_header->Misc.VirtualSize);
-          Print(L"current section address + size 0x%x\r\n", specific_section_header->VirtualAddress + specific_section_header->Misc.VirtualSize);
-#endif
+          LOG_MESSAGE(PE, DEBUG, L"current section address: 0x%x, size: 0x%x", specific_section_header->VirtualAddress, specific_section_header->Misc.VirtualSize);
+          LOG_MESSAGE(PE, DEBUG, L"current section address + size 0x%x", specific_section_header->VirtualAddress + specific_section_header->Misc.VirtualSize);
 
           virt_size = (virt_size > (UINT64)(specific_section_header->VirtualAddress + specific_section_header->Misc.VirtualSize) ? virt_size: (UINT64)(specific_section_header->VirtualAddress + specific_section_header->Misc.VirtualSize));
         }
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-        Print(L"virt_size: 0x%llx\r\n", virt_size);
-        Keywait(L"Section Headers table passed.\r\n");
-#endif
+        LOG_MESSAGE(PE, DEBUG, L"virt_size: 0x%llx", virt_size);
+        LOG_MESSAGE(PE, DEBUG, L"Section Headers table passed.");
 
         UINTN Header_size = (UINTN)PEHeader.OptionalHeader.SizeOfHeaders;
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-        Print(L"Total image size: %llu Bytes\r\nHeaders total size: %llu Bytes\r\n", (UINT64)PEHeader.OptionalHeader.SizeOfImage, Header_size);
-#endif
+        LOG_MESSAGE(PE, DEBUG, L"Total image size: %llu Bytes", (UINT64)PEHeader.OptionalHeader.SizeOfImage);
+        LOG_MESSAGE(PE, DEBUG, L"Headers total size: %llu Bytes", Header_size);
         // NOTE: This implies the max file size for a PE executable is 4GB (SizeOfImage is a UINT32).
-        // In any event, this has to be loaded from FAT32. You can't have a file larger than 4GB (32-bit max) on FAT32 anyways.
-        // A 4GB bootloader, or even kernel, would be insane. You'd need to use a 64-bit linux ELF for those.
-
-        UINT64 pages = EFI_SIZE_TO_PAGES(virt_size); // To get number of pages (typically 4KB per), rounded up
-        KernelPages = pages;
-
-#ifdef PE_LOADER_DEBUG_ENABLED
-        Print(L"pages: %llu\r\n", pages);
-        Print(L"Expected ImageBase: 0x%llx\r\n", PEHeader.OptionalHeader.ImageBase);
-        Keywait(L"\0");
-  #ifdef MEMMAP_PRINT_ENABLED
-        print_memmap();
-        Keywait(L"Done printing MemMap.\r\n");
-  #endif
-#endif
-
-        EFI_PHYSICAL_ADDRESS AllocatedMemory = PEHeader.OptionalHeader.ImageBase;
-//        EFI_PHYSICAL_ADDRESS AllocatedMemory = 0x400000;
-
-#ifdef PE_LOADER_DEBUG_ENABLED
-        Print(L"Address of AllocatedMemory: 0x%llx\r\n", &AllocatedMemory);
-#endif
-
-        GoTimeStatus = BS->AllocatePages(AllocateAnyPages, EfiLoaderData, pages, &AllocatedMemory);
-//        GoTimeStatus = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &AllocatedMemory);
-//        AllocatedMemory = 0xFFFFFFFF; // This appears to be what AllocateAnyPages does.
-//        GoTimeStatus = BS->AllocatePages(AllocateMaxAddress, EfiLoaderData, pages, &AllocatedMemory);
-        if(EFI_ERROR(GoTimeStatus))
-        {
-          Print(L"Could not allocate pages for PE32+ sections. Error code: 0x%llx\r\n", GoTimeStatus);
-          return GoTimeStatus;
-        }
-
-#ifdef PE_LOADER_DEBUG_ENABLED
-        Print(L"AllocatedMemory location: 0x%llx\r\n", AllocatedMemory);
-  #ifdef MEMMAP_PRINT_ENABLED
-        print_memmap();
-        Keywait(L"Done printing MemMap.\r\n");
-  #endif
-        Keywait(L"Zeroing\r\n");
-#endif
-
-        // Zero the allocated pages
-        ZeroMem((VOID*)AllocatedMemory, (pages << EFI_PAGE_SHIFT));
-
-#ifdef PE_LOADER_DEBUG_ENABLED
-        Keywait(L"MemZeroed\r\n");
-#endif
-
-#ifndef MEMORY_CHECK_DISABLED
-        // If that memory isn't actually free due to weird firmware behavior...
-        // Iterate through the entirety of what was just allocated and check to make sure it's all zeros
-        // Start buggy firmware workaround
-        if(VerifyZeroMem(pages << EFI_PAGE_SHIFT, AllocatedMemory))
-        {
-
-          // From UEFI Specification 2.7, Errata A (http://www.uefi.org/specifications):
-          // MemoryType values in the range 0x80000000..0xFFFFFFFF are reserved for use by
-          // UEFI OS loaders that are provided by operating system vendors.
-
-  #ifdef MEMORY_CHECK_INFO
-          Print(L"Non-zero memory location allocated. Verifying cause...\r\n");
-  #endif
-
-          // Compare what's there with the kernel file's first bytes; the system might have been reset and the non-zero
-          // memory is what remains of last time. This can be safely overwritten to avoid cluttering up system RAM.
-
-          // Sure hope there aren't any other page-aligned kernel images floating around in memory marked as free
-          UINT64 MemCheck = IMAGE_DOS_SIGNATURE; // Good thing we know what to expect!
-
-          if(compare((EFI_PHYSICAL_ADDRESS*)AllocatedMemory, &MemCheck, 2))
-          {
-            // Do nothing, we're fine
-  #ifdef MEMORY_CHECK_INFO
-            Print(L"System was reset. No issues.\r\n");
-  #endif
-          }
-          else // Not our remains, proceed with discovery of viable memory address
-          {
-
-  #ifdef MEMORY_CHECK_INFO
-            Print(L"Searching for actually free memory...\r\nPerhaps the firmware is buggy?\r\n");
-  #endif
-
-            // Free the pages (well, return them to the system as they were...)
-            GoTimeStatus = BS->FreePages(AllocatedMemory, pages);
-            if(EFI_ERROR(GoTimeStatus))
-            {
-              Print(L"Could not free pages for PE32+ sections. Error code: 0x%llx\r\n", GoTimeStatus);
-              return GoTimeStatus;
-            }
-
-            // NOTE: CANNOT create an array of all compatible free addresses because the array takes up memory. So does the memory map.
-            // This results in a paradox, so we need to scan the memory map every time we need to find a new address...
-
-            // It appears that AllocateAnyPages uses a "MaxAddress" approach. This will go bottom-up instead.
-            EFI_PHYSICAL_ADDRESS NewAddress = 0; // Start at zero
-            EFI_PHYSICAL_ADDRESS OldAllocatedMemory = AllocatedMemory;
-
-            GoTimeStatus = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress); // Need to check 0x0
-            while(GoTimeStatus != EFI_SUCCESS)
-            { // Keep checking free memory addresses until one works
-
-              if(GoTimeStatus == EFI_NOT_FOUND)
-              {
-                // 0's not a good address (not enough contiguous pages could be found), get another one
-                NewAddress = ActuallyFreeAddress(pages, NewAddress);
-                // Make sure the new address isn't the known bad one
-                if(NewAddress == OldAllocatedMemory)
-                {
-                  // Get a new address if it is
-                  NewAddress = ActuallyFreeAddress(pages, NewAddress);
-                }
-                else if(NewAddress >= 0x100000000) // Need to stay under 4GB for PE32+
-                {
-                  NewAddress = ~0ULL;
-                }
-              }
-              else if(EFI_ERROR(GoTimeStatus))
-              {
-                Print(L"Could not get an address for PE32+ pages. Error code: 0x%llx\r\n", GoTimeStatus);
-                return GoTimeStatus;
-              }
-
-              if(NewAddress == ~0ULL)
-              {
-                // If you get this, you had no memory free anywhere.
-                Print(L"No memory marked as EfiConventionalMemory...\r\n");
-                return GoTimeStatus;
-              }
-
-              // Allocate the new address
-              GoTimeStatus = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
-              // This loop shouldn't run more than once, but in the event something is at 0x0 we need to
-              // leave the loop with an allocated address
-
-            }
-
-            // Got a new address that's been allocated--save it
-            AllocatedMemory = NewAddress;
-
-            // Verify it's empty
-            while((NewAddress != ~0ULL) && VerifyZeroMem(pages << EFI_PAGE_SHIFT, AllocatedMemory)) // Loop this in case the firmware is really screwed
-            { // It's not empty :(
-
-              // Sure hope there aren't any other page-aligned kernel images floating around in memory marked as free
-              if(compare((EFI_PHYSICAL_ADDRESS*)AllocatedMemory, &MemCheck, 2))
-              {
-                // Do nothing, we're fine
-  #ifdef MEMORY_CHECK_INFO
-                Print(L"System appears to have been reset. No issues.\r\n");
-  #endif
-
-                break;
-              }
-              else
-              { // Gotta keep looking for a good memory address
-
-  #ifdef MEMORY_DEBUG_ENABLED
-                Print(L"Still searching... 0x%llx\r\n", AllocatedMemory);
-  #endif
-
-                // It's not actually free...
-                GoTimeStatus = BS->FreePages(AllocatedMemory, pages);
-                if(EFI_ERROR(GoTimeStatus))
-                {
-                  Print(L"Could not free pages for PE32+ sections (loop). Error code: 0x%llx\r\n", GoTimeStatus);
-                  return GoTimeStatus;
-                }
-
-                // Allocate a new address
-                GoTimeStatus = EFI_NOT_FOUND;
-                while((GoTimeStatus != EFI_SUCCESS) && (NewAddress != ~0ULL))
-                {
-                  if(GoTimeStatus == EFI_NOT_FOUND)
-                  {
-                    // Get an address (ideally, this should be very rare)
-                    NewAddress = ActuallyFreeAddress(pages, NewAddress);
-                    // Make sure the new address isn't the known bad one
-                    if(NewAddress == OldAllocatedMemory)
-                    {
-                      // Get a new address if it is
-                      NewAddress = ActuallyFreeAddress(pages, NewAddress);
-                    }
-                    else if(NewAddress >= 0x100000000) // Need to stay under 4GB
-                    {
-                      NewAddress = ~0ULL; // Get out of this loop, do a more thorough check
-                      break;
-                    }
-                    // This loop will run until we get a good address (shouldn't be more than once, if ever)
-                  }
-                  else if(EFI_ERROR(GoTimeStatus))
-                  {
-                    // EFI_OUT_OF_RESOURCES means the firmware's just not gonna load anything.
-                    Print(L"Could not get an address for PE32+ pages (loop). Error code: 0x%llx\r\n", GoTimeStatus);
-                    return GoTimeStatus;
-                  }
-                  // NOTE: The number of times the message "No more free addresses" pops up
-                  // helps indicate which NewAddress assignment hit the end.
-
-                  GoTimeStatus = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
-                } // loop
-
-                // It's a new address
-                AllocatedMemory = NewAddress;
-
-                // Verify new address is empty (in loop), if not then free it and try again.
-              } // else
-            } // End VerifyZeroMem while loop
-
-            // Ran out of easy addresses, time for a more thorough check
-            // Hopefully no one ever gets here
-            if(AllocatedMemory == ~0ULL)
-            { // NewAddress is also -1
-
-  #ifdef BY_PAGE_SEARCH_DISABLED // Set this to disable ByPage searching
-              Print(L"No easy addresses found with enough space and containing only zeros.\r\nConsider enabling page-by-page search.\r\n");
-              return GoTimeStatus;
-  #endif
+        // In any event, this has to be loaded from FAT32. You can't have a file larger than 4GB (32-bit max) on FAT32 anyways.
+        // A 4GB bootloader, or even kernel, would be insane. You'd need to use a 64-bit linux ELF for those.
 
-  #ifndef BY_PAGE_SEARCH_DISABLED
-    #ifdef MEMORY_CHECK_INFO
-              Print(L"Performing page-by-page search.\r\nThis might take a while...\r\n");
-    #endif
+        UINT64 pages = EFI_SIZE_TO_PAGES(virt_size); // To get number of pages (typically 4KB per), rounded up
+        KernelPages = pages;
 
-    #ifdef MEMORY_DEBUG_ENABLED
-              Keywait(L"About to search page by page\r\n");
-    #endif
+        LOG_MESSAGE(PE, DEBUG, L"pages: %llu", pages);
+        LOG_MESSAGE(PE, DEBUG, L"Expected ImageBase: 0x%llx", PEHeader.OptionalHeader.ImageBase);
 
-              NewAddress = 0x80000000 - EFI_PAGE_SIZE; // Start over
-              // Allocate the page's address
-              GoTimeStatus = EFI_NOT_FOUND;
-              while(GoTimeStatus != EFI_SUCCESS)
-              {
-                if(GoTimeStatus == EFI_NOT_FOUND)
-                {
-                  // Nope, get another one
-                  NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
-                  // Make sure the new address isn't the known bad one
-                  if(NewAddress == OldAllocatedMemory)
-                  {
-                    // Get a new address if it is
-                    NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
-                  }
-                  else if(NewAddress >= 0x100000000) // Need to stay under 4GB
-                  {
-                    NewAddress = ActuallyFreeAddress(pages, 0); // Start from the first suitable EfiConventionalMemory address.
-                    // This is for BIOS vendors who blanketly set 0x80000000 in an EfiReservedMemoryType section.
-                  }
-                }
-                else if(EFI_ERROR(GoTimeStatus))
-                {
-                  Print(L"Could not get an address for PE32+ pages by page. Error code: 0x%llx\r\n", GoTimeStatus);
-                  return GoTimeStatus;
-                }
+        EFI_PHYSICAL_ADDRESS AllocatedMemory = PEHeader.OptionalHeader.ImageBase;
+//        EFI_PHYSICAL_ADDRESS AllocatedMemory = 0x400000;
 
-                if(NewAddress == ~0ULL)
-                {
-                  // If you somehow get this, you really had no memory free anywhere.
-                  Print(L"Hmm... How did you get here?\r\n");
-                  return GoTimeStatus;
-                }
+        LOG_MESSAGE(PE, DEBUG, L"Address of AllocatedMemory: 0x%llx", &AllocatedMemory);
 
-                GoTimeStatus = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
-              }
+        GoTimeStatus = AllocateBootPages(pages, &AllocatedMemory);
+//        GoTimeStatus = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &AllocatedMemory);
+//        AllocatedMemory = 0xFFFFFFFF; // This appears to be what AllocateAnyPages does.
+//        GoTimeStatus = BS->AllocatePages(AllocateMaxAddress, EfiLoaderData, pages, &AllocatedMemory);
+        if(EFI_ERROR(GoTimeStatus))
+        {
+          Print(L"Could not allocate pages for PE32+ sections. Error code: 0x%llx\r\n", GoTimeStatus);
+          return GoTimeStatus;
+        }
 
-              AllocatedMemory = NewAddress;
+        LOG_MESSAGE(PE, DEBUG, L"AllocatedMemory location: 0x%llx", AllocatedMemory);
+        if(LOG_ENABLED(MEMORY, DEBUG))
+        {
+          print_memmap();
+        }
 
-              while(VerifyZeroMem(pages << EFI_PAGE_SHIFT, AllocatedMemory))
-              {
-                // Sure hope there aren't any other page-aligned kernel images floating around in memory marked as free
-                if(compare((EFI_PHYSICAL_ADDRESS*)AllocatedMemory, &MemCheck, 2))
-                {
-                  // Do nothing, we're fine
-    #ifdef MEMORY_CHECK_INFO
-                  Print(L"System might have been reset. Hopefully no issues.\r\n");
-    #endif
+        // Zero the allocated pages
+        ZeroMem((VOID*)AllocatedMemory, (pages << EFI_PAGE_SHIFT));
 
-                  break;
-                }
-                else
-                {
+        LOG_MESSAGE(PE, DEBUG, L"MemZeroed");
 
-    #ifdef MEMORY_DEBUG_ENABLED
-                Print(L"Still searching by page... 0x%llx\r\n", AllocatedMemory);
-    #endif
-
-                  // It's not actually free...
-                  GoTimeStatus = BS->FreePages(AllocatedMemory, pages);
-                  if(EFI_ERROR(GoTimeStatus))
-                  {
-                    Print(L"Could not free pages for PE32+ sections by page (loop). Error code: 0x%llx\r\n", GoTimeStatus);
-                    return GoTimeStatus;
-                  }
-
-                  GoTimeStatus = EFI_NOT_FOUND;
-                  while(GoTimeStatus != EFI_SUCCESS)
-                  {
-                    if(GoTimeStatus == EFI_NOT_FOUND)
-                    {
-                      // Nope, get another one
-                      NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
-                      // Make sure the new address isn't the known bad one
-                      if(NewAddress == OldAllocatedMemory)
-                      {
-                        // Get a new address if it is
-                        NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
-                      }
-                      else if(NewAddress >= 0x100000000) // Need to stay under 4GB
-                      {
-                        Print(L"Too much junk below 4GB. Complain to your motherboard vendor.\r\nTry using a 64-bit ELF or MACH-O kernel binary instead of PE32+.\r\n");
-                        NewAddress = ActuallyFreeAddress(pages, 0); // Either the BIOS vendor didn't read the spec or you need to use RAM space above 4GB.
-                      }
-                    }
-                    else if(EFI_ERROR(GoTimeStatus))
-                    {
-                      Print(L"Could not get an address for PE32+ pages by page (loop). Error code: 0x%llx\r\n", GoTimeStatus);
-                      return GoTimeStatus;
-                    }
-
-                    if(NewAddress == ~0ULL)
-                    {
-                      // Well, darn. Something's up with the system memory. Maybe you have 4GB or less?
-                      Print(L"Do you have 4GB or less of RAM? Looks like you need > 4GB for this.\r\nThat also means you'll need to use 64-bit ELF or MACH-O kernels.\r\n");
-                      return GoTimeStatus;
-                    }
-
-                    GoTimeStatus = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
-                  } // loop
-
-                  AllocatedMemory = NewAddress;
-
-                } // else
-              } // end ByPage VerifyZeroMem loop
-  #endif
-            } // End "big guns"
-
-            // Got a good address!
-  #ifdef MEMORY_CHECK_INFO
-            Print(L"Found!\r\n");
-  #endif
-          } // End discovery of viable memory address (else)
-          // Can move on now
-  #ifdef MEMORY_CHECK_INFO
-          Print(L"New AllocatedMemory location: 0x%llx\r\n", AllocatedMemory);
-  #endif
-        } // End VerifyZeroMem buggy firmware workaround (outermost if)
-        else
+        if(MemoryCheckEnabled)
         {
-  #ifdef MEMORY_CHECK_INFO
-          Print(L"Allocated memory was zeroed OK\r\n");
-  #endif
+          // If that memory isn't actually free due to weird firmware behavior, go find some that is
+          UINT64 MemCheck = IMAGE_DOS_SIGNATURE; // Good thing we know what to expect!
+          GoTimeStatus = FindActuallyFreePages(pages, &AllocatedMemory, &MemCheck, 2, 1, PlacementKernelId(KernelPath, FileInfo->FileSize), L"PE32+");
+          if(EFI_ERROR(GoTimeStatus))
+          {
+            return GoTimeStatus;
+          }
         }
-#endif
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-        Keywait(L"Allocate Pages passed.\r\n");
-
-  #ifdef MEMMAP_PRINT_ENABLED
-        // Check the address given to AllocatedMemory as listed in the MemMap
-        print_memmap();
-        Keywait(L"Done printing MemMap.\r\n");
-  #endif
+        LOG_MESSAGE(PE, DEBUG, L"Allocate Pages passed.");
 
         // Map headers
-        Print(L"\nLoading Headers:\r\n");
-        Print(L"Check:\r\nSectionAddress: 0x%llx\r\nData there: 0x%016llx%016llx (Should be 0)\r\n", AllocatedMemory, *(EFI_PHYSICAL_ADDRESS*)(AllocatedMemory + 8), *(EFI_PHYSICAL_ADDRESS*)AllocatedMemory); // Print the first 128 bits of data at that address to compare
-        Keywait(L"\0");
-#endif
+        LOG_MESSAGE(PE, DEBUG, L"Loading Headers:");
+        LOG_MESSAGE(PE, DEBUG, L"Check: SectionAddress: 0x%llx", AllocatedMemory);
+        LOG_MESSAGE(PE, DEBUG, L"Data there: 0x%016llx%016llx (Should be 0)", *(EFI_PHYSICAL_ADDRESS*)(AllocatedMemory + 8), *(EFI_PHYSICAL_ADDRESS*)AllocatedMemory); // Log the first 128 bits of data at that address to compare
 
         GoTimeStatus = KernelFile->SetPosition(KernelFile, 0);
         if(EFI_ERROR(GoTimeStatus))
@@ -1014,28 +812,28 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
           return GoTimeStatus;
         }
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-        // Little endian; print various 16 bytes to make sure data landed in memory properly
-        Print(L"\r\nVerify:\r\nSectionAddress: 0x%llx\r\nData there (first 16 bytes): 0x%016llx%016llx\r\n", AllocatedMemory, *(EFI_PHYSICAL_ADDRESS*)(AllocatedMemory + 8), *(EFI_PHYSICAL_ADDRESS*)AllocatedMemory);
-        Print(L"Last 16 bytes: 0x%016llx%016llx\r\n", *(EFI_PHYSICAL_ADDRESS *)(AllocatedMemory + Header_size - 8), *(EFI_PHYSICAL_ADDRESS *)(AllocatedMemory + Header_size - 16));
-        Print(L"Next 16 bytes: 0x%016llx%016llx (should be 0)\r\n", *(EFI_PHYSICAL_ADDRESS *)(AllocatedMemory + Header_size + 8), *(EFI_PHYSICAL_ADDRESS *)(AllocatedMemory + Header_size));
-        Keywait(L"\0");
+#ifdef LOADER_PAGE_TABLES_ENABLED
+        AddKernelSegment(0, Header_size, 0); // Headers are read-only
 #endif
 
+        // Little endian; print various 16 bytes to make sure data landed in memory properly
+        LOG_MESSAGE(PE, DEBUG, L"Verify: SectionAddress: 0x%llx", AllocatedMemory);
+        LOG_MESSAGE(PE, DEBUG, L"Data there (first 16 bytes): 0x%016llx%016llx", *(EFI_PHYSICAL_ADDRESS*)(AllocatedMemory + 8), *(EFI_PHYSICAL_ADDRESS*)AllocatedMemory);
+        LOG_MESSAGE(PE, DEBUG, L"Last 16 bytes: 0x%016llx%016llx", *(EFI_PHYSICAL_ADDRESS *)(AllocatedMemory + Header_size - 8), *(EFI_PHYSICAL_ADDRESS *)(AllocatedMemory + Header_size - 16));
+        LOG_MESSAGE(PE, DEBUG, L"Next 16 bytes: 0x%016llx%016llx (should be 0)", *(EFI_PHYSICAL_ADDRESS *)(AllocatedMemory + Header_size + 8), *(EFI_PHYSICAL_ADDRESS *)(AllocatedMemory + Header_size));
+
         for(i = 0; i < Numofsections; i++) // Load sections into memory
         {
           IMAGE_SECTION_HEADER *specific_section_header = &section_headers_table[i];
           UINTN RawDataSize = (UINTN)specific_section_header->SizeOfRawData;
           EFI_PHYSICAL_ADDRESS SectionAddress = AllocatedMemory + (UINT64)specific_section_header->VirtualAddress;
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-          Print(L"\n%llu. current section address: 0x%x, RawDataSize: 0x%llx\r\n", i+1, specific_section_header->VirtualAddress, RawDataSize);
-          Print(L"current destination address: 0x%llx, AllocatedMemory base: 0x%llx\r\n", SectionAddress, AllocatedMemory);
-          Print(L"PointerToRawData: 0x%llx\r\n", (UINT64)specific_section_header->PointerToRawData);
-          Print(L"Check:\r\nSectionAddress: 0x%llx\r\nData there: 0x%016llx%016llx (should be 0)\r\n", SectionAddress, *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + 8), *(EFI_PHYSICAL_ADDRESS *)SectionAddress); // Print the first 128 bits of data at that address to compare
-          Print(L"About to load section %llu of %llu...\r\n", i + 1, Numofsections);
-          Keywait(L"\0");
-#endif
+          LOG_MESSAGE(PE, DEBUG, L"%llu. current section address: 0x%x, RawDataSize: 0x%llx", i+1, specific_section_header->VirtualAddress, RawDataSize);
+          LOG_MESSAGE(PE, DEBUG, L"current destination address: 0x%llx, AllocatedMemory base: 0x%llx", SectionAddress, AllocatedMemory);
+          LOG_MESSAGE(PE, DEBUG, L"PointerToRawData: 0x%llx", (UINT64)specific_section_header->PointerToRawData);
+          LOG_MESSAGE(PE, DEBUG, L"Check: SectionAddress: 0x%llx", SectionAddress);
+          LOG_MESSAGE(PE, DEBUG, L"Data there: 0x%016llx%016llx (should be 0)", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + 8), *(EFI_PHYSICAL_ADDRESS *)SectionAddress); // Print the first 128 bits of data at that address to compare
+          LOG_MESSAGE(PE, DEBUG, L"About to load section %llu of %llu...", i + 1, Numofsections);
 
           GoTimeStatus = KernelFile->SetPosition(KernelFile, (UINT64)specific_section_header->PointerToRawData);
           if(EFI_ERROR(GoTimeStatus))
@@ -1054,12 +852,15 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
             }
           }
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-          Print(L"\r\nVerify:\r\nSectionAddress: 0x%llx\r\nData there (first 16 bytes): 0x%016llx%016llx\r\n", SectionAddress, *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + 8), *(EFI_PHYSICAL_ADDRESS*)SectionAddress); // Print the first 128 bits of data at that address to compare
-          Print(L"Last 16 bytes: 0x%016llx%016llx\r\n", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize - 8), *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize - 16));
-          Print(L"Next 16 bytes: 0x%016llx%016llx (0 unless last section)\r\n", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize + 8), *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize));
-          // "Next 16 bytes" should be 0 unless last section
+#ifdef LOADER_PAGE_TABLES_ENABLED
+          AddKernelSegment((UINT64)specific_section_header->VirtualAddress, (UINT64)specific_section_header->Misc.VirtualSize, ((specific_section_header->Characteristics & IMAGE_SCN_MEM_WRITE) ? KERNEL_SEGMENT_WRITE : 0) | ((specific_section_header->Characteristics & IMAGE_SCN_MEM_EXECUTE) ? KERNEL_SEGMENT_EXECUTE : 0));
 #endif
+
+          LOG_MESSAGE(PE, DEBUG, L"Verify: SectionAddress: 0x%llx", SectionAddress);
+          LOG_MESSAGE(PE, DEBUG, L"Data there (first 16 bytes): 0x%016llx%016llx", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + 8), *(EFI_PHYSICAL_ADDRESS*)SectionAddress); // Print the first 128 bits of data at that address to compare
+          LOG_MESSAGE(PE, DEBUG, L"Last 16 bytes: 0x%016llx%016llx", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize - 8), *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize - 16));
+          LOG_MESSAGE(PE, DEBUG, L"Next 16 bytes: 0x%016llx%016llx (0 unless last section)", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize + 8), *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize));
+          // "Next 16 bytes" should be 0 unless last section
         }
 
         // Done with section_headers_table
@@ -1073,9 +874,7 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
           }
         }
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-        Keywait(L"\nLoad file sections into allocated pages passed.\r\n");
-#endif
+        LOG_MESSAGE(PE, DEBUG, L"Load file sections into allocated pages passed.");
 
         // Apply relocation fixes, if necessary
         if((AllocatedMemory != PEHeader.OptionalHeader.ImageBase) && (PEHeader.OptionalHeader.NumberOfRvaAndSizes > IMAGE_DIRECTORY_ENTRY_BASERELOC)) // Need to perform relocations
@@ -1092,17 +891,13 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
           {
             delta = AllocatedMemory - PEHeader.OptionalHeader.ImageBase; // Determine by how much we are off the executable's intended ImageBase
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-            Print(L"AllocatedMemory: 0x%llx, ImageBase: 0x%llx, Delta: 0x%llx\r\n", AllocatedMemory, PEHeader.OptionalHeader.ImageBase, delta);
-#endif
+            LOG_MESSAGE(PE, DEBUG, L"AllocatedMemory: 0x%llx, ImageBase: 0x%llx, Delta: 0x%llx", AllocatedMemory, PEHeader.OptionalHeader.ImageBase, delta);
           }
           else
           {
             delta = PEHeader.OptionalHeader.ImageBase - AllocatedMemory;
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-            Print(L"AllocatedMemory: 0x%llx, ImageBase: 0x%llx, Delta: -0x%llx\r\n", AllocatedMemory, PEHeader.OptionalHeader.ImageBase, delta);
-#endif
+            LOG_MESSAGE(PE, DEBUG, L"AllocatedMemory: 0x%llx, ImageBase: 0x%llx, Delta: -0x%llx", AllocatedMemory, PEHeader.OptionalHeader.ImageBase, delta);
           }
 
           UINT64 NumRelocationsPerChunk;
@@ -1110,20 +905,16 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
           for(;(Relocation_Directory_Base->SizeOfBlock) && (Relocation_Directory_Base < RelocTableEnd);)
           {
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-            Print(L"\nSizeOfBlock: %u Bytes\r\n", Relocation_Directory_Base->SizeOfBlock);
-            Print(L"Rel_dir_base: 0x%llx, RelTableEnd: 0x%llx\r\n", Relocation_Directory_Base, RelocTableEnd);
-#endif
+            LOG_MESSAGE(PE, DEBUG, L"SizeOfBlock: %u Bytes", Relocation_Directory_Base->SizeOfBlock);
+            LOG_MESSAGE(PE, DEBUG, L"Rel_dir_base: 0x%llx, RelTableEnd: 0x%llx", Relocation_Directory_Base, RelocTableEnd);
 
             EFI_PHYSICAL_ADDRESS page = AllocatedMemory + (UINT64)Relocation_Directory_Base->VirtualAddress; // This virtual address is page-specific, and needs to be offset by Header_memory
             UINT16* DataToFix = (UINT16*)((UINT8*)Relocation_Directory_Base + IMAGE_SIZEOF_BASE_RELOCATION); // The base relocation size is 8 bytes (64 bits)
             NumRelocationsPerChunk = (Relocation_Directory_Base->SizeOfBlock - IMAGE_SIZEOF_BASE_RELOCATION)/sizeof(UINT16);
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-            Print(L"DataToFix: 0x%hx, Base page: 0x%llx\r\n", DataToFix, page);
-            Print(L"NumRelocations in this chunk: %llu\r\n", NumRelocationsPerChunk);
-            Keywait(L"About to relocate this chunk...\r\n");
-#endif
+            LOG_MESSAGE(PE, DEBUG, L"DataToFix: 0x%hx, Base page: 0x%llx", DataToFix, page);
+            LOG_MESSAGE(PE, DEBUG, L"NumRelocations in this chunk: %llu", NumRelocationsPerChunk);
+            LOG_MESSAGE(PE, DEBUG, L"About to relocate this chunk...");
 
             for(i = 0; i < NumRelocationsPerChunk; i++)
             {
@@ -1131,45 +922,33 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
               {
                 // Nothing, this is a padding area
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-                Print(L"%llu of %llu -- Padding Area\r\n", i+1, NumRelocationsPerChunk);
-#endif
+                LOG_MESSAGE(PE, DEBUG, L"%llu of %llu -- Padding Area", i+1, NumRelocationsPerChunk);
               }
               else if (DataToFix[i] >> EFI_PAGE_SHIFT == IMAGE_REL_BASED_DIR64) // IMAGE_REL_BASED_DIR64 == 10: Only doing 64-bit offset relocation (that's all that's needed for these PE32+ files), so check uppper 4 bits of each DataToFix entry
               {
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-                Print(L"%llu of %llu, DataToFix[%llu]: 0x%hx\r\n", i+1, NumRelocationsPerChunk, i, DataToFix[i]);
-#endif
+                LOG_MESSAGE(PE, DEBUG, L"%llu of %llu, DataToFix[%llu]: 0x%hx", i+1, NumRelocationsPerChunk, i, DataToFix[i]);
 
                 if(AllocatedMemory > PEHeader.OptionalHeader.ImageBase)
                 {
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-                  Print(L"Page: 0x%llx, Current Address: 0x%llx, Data there: 0x%llx\r\n", page, (UINT64*)((UINT8*)page + (DataToFix[i] & EFI_PAGE_MASK)), *((UINT64*)((UINT8*)page + (DataToFix[i] & EFI_PAGE_MASK))));
-#endif
+                  LOG_MESSAGE(PE, DEBUG, L"Page: 0x%llx, Current Address: 0x%llx, Data there: 0x%llx", page, (UINT64*)((UINT8*)page + (DataToFix[i] & EFI_PAGE_MASK)), *((UINT64*)((UINT8*)page + (DataToFix[i] & EFI_PAGE_MASK))));
 
                   *((UINT64*)((UINT8*)page + (DataToFix[i] & EFI_PAGE_MASK))) += delta;
                   // Lower 12 bits of each DataToFix entry (each entry is of size word) needs to be added to virtual address of the block.
                   // The real location of the virtual address in memory is stored in "page".
                   // This is an "on-the-fly" RAM patch.
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-                  Print(L"Delta: 0x%llx, Corrected Data there: 0x%llx\r\n", delta, *((UINT64*)((UINT8*)page + (DataToFix[i] & EFI_PAGE_MASK))));
-#endif
+                  LOG_MESSAGE(PE, DEBUG, L"Delta: 0x%llx, Corrected Data there: 0x%llx", delta, *((UINT64*)((UINT8*)page + (DataToFix[i] & EFI_PAGE_MASK))));
                 }
                 else
                 {
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-                  Print(L"Page: 0x%llx, Current Address: 0x%llx, Data there: 0x%llx\r\n", page, (UINT64*)((UINT8*)page + (DataToFix[i] & EFI_PAGE_MASK)), *((UINT64*)((UINT8*)page + (DataToFix[i] & EFI_PAGE_MASK))));
-#endif
+                  LOG_MESSAGE(PE, DEBUG, L"Page: 0x%llx, Current Address: 0x%llx, Data there: 0x%llx", page, (UINT64*)((UINT8*)page + (DataToFix[i] & EFI_PAGE_MASK)), *((UINT64*)((UINT8*)page + (DataToFix[i] & EFI_PAGE_MASK))));
 
                   *((UINT64*)((UINT8*)page + (DataToFix[i] & EFI_PAGE_MASK))) -= delta;
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-                  Print(L"Delta: -0x%llx, Corrected Data there: 0x%llx\r\n", delta, *((UINT64*)((UINT8*)page + (DataToFix[i] & EFI_PAGE_MASK))));
-#endif
+                  LOG_MESSAGE(PE, DEBUG, L"Delta: -0x%llx, Corrected Data there: 0x%llx", delta, *((UINT64*)((UINT8*)page + (DataToFix[i] & EFI_PAGE_MASK))));
                 }
               }
               else
@@ -1185,9 +964,7 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
         else
         {
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-          Print(L"Well that's convenient. No relocation necessary.\r\n");
-#endif
+          LOG_MESSAGE(PE, DEBUG, L"Well that's convenient. No relocation necessary.");
         }
 
 
@@ -1207,10 +984,8 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
         KernelBaseAddress = AllocatedMemory;
         Header_memory = AllocatedMemory + (UINT64)PEHeader.OptionalHeader.AddressOfEntryPoint;
 
-#ifdef PE_LOADER_DEBUG_ENABLED
-        Print(L"Header_memory: 0x%llx, AllocatedMemory: 0x%llx, EntryPoint: 0x%x\r\n", Header_memory, AllocatedMemory, PEHeader.OptionalHeader.AddressOfEntryPoint);
-        Print(L"Data at Header_memory (first 16 bytes): 0x%016llx%016llx\r\n", *(EFI_PHYSICAL_ADDRESS*)(Header_memory + 8), *(EFI_PHYSICAL_ADDRESS*)Header_memory);
-#endif
+        LOG_MESSAGE(PE, DEBUG, L"Header_memory: 0x%llx, AllocatedMemory: 0x%llx, EntryPoint: 0x%x", Header_memory, AllocatedMemory, PEHeader.OptionalHeader.AddressOfEntryPoint);
+        LOG_MESSAGE(PE, DEBUG, L"Data at Header_memory (first 16 bytes): 0x%016llx%016llx", *(EFI_PHYSICAL_ADDRESS*)(Header_memory + 8), *(EFI_PHYSICAL_ADDRESS*)Header_memory);
 
       // Loaded! On to memorymap and exitbootservices...
       // NOTE: Executable entry point is now defined in Header_memory's contained address, which is AllocatedMemory + OptionalHeader.AddressOfEntryPoint
@@ -1238,10 +1013,8 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
       UINT64 pages = EFI_SIZE_TO_PAGES(size);
       KernelPages = pages;
 
-#ifdef DOS_LOADER_DEBUG_ENABLED
-      Print(L"e_cp: %hu, e_cblp: %hu, e_cparhdr: %hu\r\n", DOSheader.e_cp, DOSheader.e_cblp, DOSheader.e_cparhdr);
-      Print(L"file size: %llu, load module size: %llu, pages: %llu\r\n", size + 16*(UINT64)DOSheader.e_cparhdr, size, pages);
-#endif
+      LOG_MESSAGE(PE, DEBUG, L"e_cp: %hu, e_cblp: %hu, e_cparhdr: %hu", DOSheader.e_cp, DOSheader.e_cblp, DOSheader.e_cparhdr);
+      LOG_MESSAGE(PE, DEBUG, L"file size: %llu, load module size: %llu, pages: %llu", size + 16*(UINT64)DOSheader.e_cparhdr, size, pages);
 
       EFI_PHYSICAL_ADDRESS DOSMem = 0x100;
       GoTimeStatus = BS->AllocatePages(AllocateAnyPages, EfiLoaderData, pages, &DOSMem);
@@ -1251,21 +1024,16 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
         return GoTimeStatus;
       }
 
-#ifdef DOS_LOADER_DEBUG_ENABLED
-        Print(L"DOSMem location: 0x%llx\r\n", DOSMem);
-  #ifdef MEMMAP_PRINT_ENABLED
+      LOG_MESSAGE(PE, DEBUG, L"DOSMem location: 0x%llx", DOSMem);
+      if(LOG_ENABLED(MEMORY, DEBUG))
+      {
         print_memmap();
-        Keywait(L"Done printing MemMap.\r\n");
-  #endif
-        Keywait(L"Zeroing\r\n");
-#endif
+      }
 
       // Zero the allocated pages
       ZeroMem((VOID*)DOSMem, (pages << EFI_PAGE_SHIFT));
 
-#ifdef DOS_LOADER_DEBUG_ENABLED
-      Keywait(L"MemZeroed and Allocate Pages passed.\r\n");
-#endif
+      LOG_MESSAGE(PE, DEBUG, L"MemZeroed and Allocate Pages passed.");
 
       GoTimeStatus = KernelFile->SetPosition(KernelFile, (UINT64)DOSheader.e_cparhdr*16); // Load module is right after the header
       if(EFI_ERROR(GoTimeStatus))
@@ -1274,11 +1042,9 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
         return GoTimeStatus;
       }
 
-#ifdef DOS_LOADER_DEBUG_ENABLED
-      Print(L"current destination address: 0x%llx, DOSMem base: 0x%llx, size: 0x%llx\r\n", DOSMem, DOSMem, size);
-      Print(L"Check:\r\nDOSMem: 0x%llx\r\nData there: 0x%016llx%016llx (should be 0)\r\n", DOSMem, *(EFI_PHYSICAL_ADDRESS*)(DOSMem + 8), *(EFI_PHYSICAL_ADDRESS *)DOSMem); // Print the first 128 bits of data at that address to compare
-      Keywait(L"\0");
-#endif
+      LOG_MESSAGE(PE, DEBUG, L"current destination address: 0x%llx, DOSMem base: 0x%llx, size: 0x%llx", DOSMem, DOSMem, size);
+      LOG_MESSAGE(PE, DEBUG, L"Check: DOSMem: 0x%llx", DOSMem);
+      LOG_MESSAGE(PE, DEBUG, L"Data there: 0x%016llx%016llx (should be 0)", *(EFI_PHYSICAL_ADDRESS*)(DOSMem + 8), *(EFI_PHYSICAL_ADDRESS *)DOSMem); // Print the first 128 bits of data at that address to compare
 
       GoTimeStatus = KernelFile->Read(KernelFile, &size, (EFI_PHYSICAL_ADDRESS*)DOSMem); // Read load module into DOSMem
       if(EFI_ERROR(GoTimeStatus))
@@ -1287,12 +1053,10 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
         return GoTimeStatus;
       }
 
-#ifdef DOS_LOADER_DEBUG_ENABLED
-      Print(L"\r\nVerify:\r\nDOSMem: 0x%llx\r\nData there (first 16 bytes): 0x%016llx%016llx\r\n", DOSMem, *(EFI_PHYSICAL_ADDRESS*)(DOSMem + 8), *(EFI_PHYSICAL_ADDRESS*)DOSMem); // Print the first 128 bits of data at that address to compare
-      Print(L"Last 16 bytes: 0x%016llx%016llx\r\n", *(EFI_PHYSICAL_ADDRESS*)(DOSMem + size - 8), *(EFI_PHYSICAL_ADDRESS*)(DOSMem + size - 16));
-      Print(L"Next 16 bytes: 0x%016llx%016llx (0 unless last section)\r\n", *(EFI_PHYSICAL_ADDRESS*)(DOSMem + size + 8), *(EFI_PHYSICAL_ADDRESS*)(DOSMem + size));
-      Keywait(L"\0");
-#endif
+      LOG_MESSAGE(PE, DEBUG, L"Verify: DOSMem: 0x%llx", DOSMem);
+      LOG_MESSAGE(PE, DEBUG, L"Data there (first 16 bytes): 0x%016llx%016llx", *(EFI_PHYSICAL_ADDRESS*)(DOSMem + 8), *(EFI_PHYSICAL_ADDRESS*)DOSMem); // Print the first 128 bits of data at that address to compare
+      LOG_MESSAGE(PE, DEBUG, L"Last 16 bytes: 0x%016llx%016llx", *(EFI_PHYSICAL_ADDRESS*)(DOSMem + size - 8), *(EFI_PHYSICAL_ADDRESS*)(DOSMem + size - 16));
+      LOG_MESSAGE(PE, DEBUG, L"Next 16 bytes: 0x%016llx%016llx (0 unless last section)", *(EFI_PHYSICAL_ADDRESS*)(DOSMem + size + 8), *(EFI_PHYSICAL_ADDRESS*)(DOSMem + size));
 
       // mov relocated e_sp to %rsp
 
@@ -1300,11 +1064,8 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
       KernelBaseAddress = DOSMem;
       Header_memory = DOSMem + (UINT64)DOSheader.e_ip*16;
 
-#ifdef DOS_LOADER_DEBUG_ENABLED
-      Print(L"\r\nHeader_memory: 0x%llx, DOSMem: 0x%llx, EntryPoint: 0x%llx\r\n", Header_memory, DOSMem, (UINT64)DOSheader.e_ip*16);
-      Print(L"Data at Header_memory (first 16 bytes): 0x%016llx%016llx\r\n", *(EFI_PHYSICAL_ADDRESS*)(Header_memory + 8), *(EFI_PHYSICAL_ADDRESS*)Header_memory);
-      Keywait(L"\0");
-#endif
+      LOG_MESSAGE(PE, DEBUG, L"Header_memory: 0x%llx, DOSMem: 0x%llx, EntryPoint: 0x%llx", Header_memory, DOSMem, (UINT64)DOSheader.e_ip*16);
+      LOG_MESSAGE(PE, DEBUG, L"Data at Header_memory (first 16 bytes): 0x%016llx%016llx", *(EFI_PHYSICAL_ADDRESS*)(Header_memory + 8), *(EFI_PHYSICAL_ADDRESS*)Header_memory);
       // Loaded! On to memorymap and exitbootservices...
 
       // No idea what will happen if these three lines get commented out and the program tries to run. It might actually work if a 64-bit program got packed in there with a correctly-formatted header.
@@ -1337,25 +1098,19 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
       return GoTimeStatus;
     }
 
-#ifdef LOADER_DEBUG_ENABLED
-    Keywait(L"ELF header read from file.\r\n");
-#endif
+    LOG_MESSAGE(LOADER, DEBUG, L"ELF header read from file.");
 
     if(compare(&ELF64header.e_ident[EI_MAG0], ELFMAG, SELFMAG)) // Check for \177ELF (hex: \xfELF)
     {
       // ELF!
 
-#ifdef LOADER_DEBUG_ENABLED
-      Keywait(L"ELF header passed.\r\n");
-#endif
+      LOG_MESSAGE(LOADER, DEBUG, L"ELF header passed.");
 
       // Check if 64-bit
       if(ELF64header.e_ident[EI_CLASS] == ELFCLASS64 && ELF64header.e_machine == EM_X86_64)
       {
 
-#ifdef LOADER_DEBUG_ENABLED
-        Keywait(L"ELF64 header passed.\r\n");
-#endif
+        LOG_MESSAGE(LOADER, DEBUG, L"ELF64 header passed.");
 
         if (ELF64header.e_type != ET_DYN)
         {
@@ -1365,9 +1120,7 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
           return GoTimeStatus;
         }
 
-#ifdef LOADER_DEBUG_ENABLED
-        Keywait(L"Executable ELF64 header passed.\r\n");
-#endif
+        LOG_MESSAGE(LOADER, DEBUG, L"Executable ELF64 header passed.");
 
         UINT64 i; // Iterator
         UINT64 virt_size = 0; // Virtual address max
@@ -1404,348 +1157,57 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
           if(specific_program_header->p_type == PT_LOAD)
           {
 
-#ifdef ELF_LOADER_DEBUG_ENABLED
-            Print(L"current program address: 0x%x, size: 0x%x\r\n", specific_program_header->p_vaddr, specific_program_header->p_memsz);
-            Print(L"current program address + size 0x%x\r\n", specific_program_header->p_vaddr + specific_program_header->p_memsz);
-#endif
+            LOG_MESSAGE(ELF, DEBUG, L"current program address: 0x%x, size: 0x%x", specific_program_header->p_vaddr, specific_program_header->p_memsz);
+            LOG_MESSAGE(ELF, DEBUG, L"current program address + size 0x%x", specific_program_header->p_vaddr + specific_program_header->p_memsz);
 
             virt_size = (virt_size > (specific_program_header->p_vaddr + specific_program_header->p_memsz) ? virt_size: (specific_program_header->p_vaddr + specific_program_header->p_memsz));
             virt_min = (virt_min < (specific_program_header->p_vaddr) ? virt_min: (specific_program_header->p_vaddr));
           }
         }
 
-#ifdef ELF_LOADER_DEBUG_ENABLED
-        Print(L"virt_size: 0x%llx, virt_min: 0x%llx, difference: 0x%llx\r\n", virt_size, virt_min, virt_size - virt_min);
-        Keywait(L"Program Headers table passed.\r\n");
-#endif
+        LOG_MESSAGE(ELF, DEBUG, L"virt_size: 0x%llx, virt_min: 0x%llx, difference: 0x%llx", virt_size, virt_min, virt_size - virt_min);
+        LOG_MESSAGE(ELF, DEBUG, L"Program Headers table passed.");
 
         // Virt_min is technically also the base address of the loadable segments
         UINT64 pages = EFI_SIZE_TO_PAGES(virt_size - virt_min); //To get number of pages (typically 4KB per), rounded up
         KernelPages = pages;
 
-#ifdef ELF_LOADER_DEBUG_ENABLED
-        Print(L"pages: %llu\r\n", pages);
-#endif
+        LOG_MESSAGE(ELF, DEBUG, L"pages: %llu", pages);
         EFI_PHYSICAL_ADDRESS AllocatedMemory = 0x400000; // Default for ELF
 
-#ifdef ELF_LOADER_DEBUG_ENABLED
-        Print(L"Address of AllocatedMemory: 0x%llx\r\n", &AllocatedMemory);
-#endif
+        LOG_MESSAGE(ELF, DEBUG, L"Address of AllocatedMemory: 0x%llx", &AllocatedMemory);
 
-        GoTimeStatus = BS->AllocatePages(AllocateAnyPages, EfiLoaderData, pages, &AllocatedMemory);
+        GoTimeStatus = AllocateBootPages(pages, &AllocatedMemory);
         if(EFI_ERROR(GoTimeStatus))
         {
           Print(L"Could not allocate pages for ELF program segments. Error code: 0x%llx\r\n", GoTimeStatus);
           return GoTimeStatus;
         }
 
-#ifdef ELF_LOADER_DEBUG_ENABLED
-        Print(L"AllocatedMemory location: 0x%llx\r\n", AllocatedMemory);
-  #ifdef MEMMAP_PRINT_ENABLED
-        print_memmap();
-        Keywait(L"Done printing MemMap.\r\n");
-  #endif
-        Keywait(L"Zeroing\r\n");
-#endif
+        LOG_MESSAGE(ELF, DEBUG, L"AllocatedMemory location: 0x%llx", AllocatedMemory);
+        if(LOG_ENABLED(MEMORY, DEBUG))
+        {
+          print_memmap();
+        }
 
         // Zero the allocated pages
         ZeroMem((VOID*)AllocatedMemory, (pages << EFI_PAGE_SHIFT));
 
-#ifdef ELF_LOADER_DEBUG_ENABLED
-        Keywait(L"MemZeroed\r\n");
-#endif
+        LOG_MESSAGE(ELF, DEBUG, L"MemZeroed");
 
-#ifndef MEMORY_CHECK_DISABLED
-        // If that memory isn't actually free due to weird firmware behavior...
-        // Iterate through the entirety of what was just allocated and check to make sure it's all zeros
-        // Start buggy firmware workaround
-        if(VerifyZeroMem(pages << EFI_PAGE_SHIFT, AllocatedMemory))
+        if(MemoryCheckEnabled)
         {
-
-          // From UEFI Specification 2.7, Errata A (http://www.uefi.org/specifications):
-          // MemoryType values in the range 0x80000000..0xFFFFFFFF are reserved for use by
-          // UEFI OS loaders that are provided by operating system vendors.
-  #ifdef MEMORY_CHECK_INFO
-          Print(L"Non-zero memory location allocated. Verifying cause...\r\n");
-  #endif
-          // Compare what's there with the kernel file's first bytes; the system might have been reset and the non-zero
-          // memory is what remains of last time. This can be safely overwritten to avoid cluttering up system RAM.
-
-          // Sure hope there aren't any other page-aligned kernel images floating around in memory marked as free
+          // If that memory isn't actually free due to weird firmware behavior, go find some that is
           // Good thing we know what to expect!
-
-          if(compare((EFI_PHYSICAL_ADDRESS*)AllocatedMemory, ELFMAG, SELFMAG))
+          GoTimeStatus = FindActuallyFreePages(pages, &AllocatedMemory, ELFMAG, SELFMAG, (BootEntry->Placement == LOADER_PLACEMENT_BELOW_4GB), PlacementKernelId(KernelPath, FileInfo->FileSize), L"ELF");
+          if(EFI_ERROR(GoTimeStatus))
           {
-            // Do nothing, we're fine
-  #ifdef MEMORY_CHECK_INFO
-            Print(L"System was reset. No issues.\r\n");
-  #endif
+            return GoTimeStatus;
           }
-          else // Not our remains, proceed with discovery of viable memory address
-          {
-
-  #ifdef MEMORY_CHECK_INFO
-            Print(L"Searching for actually free memory...\r\nPerhaps the firmware is buggy?\r\n");
-  #endif
-            // Free the pages (well, return them to the system as they were...)
-            GoTimeStatus = BS->FreePages(AllocatedMemory, pages);
-            if(EFI_ERROR(GoTimeStatus))
-            {
-              Print(L"Could not free pages for ELF sections. Error code: 0x%llx\r\n", GoTimeStatus);
-              return GoTimeStatus;
-            }
-
-            // NOTE: CANNOT create an array of all compatible free addresses because the array takes up memory. So does the memory map.
-            // This results in a paradox, so we need to scan the memory map every time we need to find a new address...
-
-            // It appears that AllocateAnyPages uses a "MaxAddress" approach. This will go bottom-up instead.
-            EFI_PHYSICAL_ADDRESS NewAddress = 0; // Start at zero
-            EFI_PHYSICAL_ADDRESS OldAllocatedMemory = AllocatedMemory;
-
-            GoTimeStatus = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress); // Need to check 0x0
-            while(GoTimeStatus != EFI_SUCCESS)
-            { // Keep checking free memory addresses until one works
-
-              if(GoTimeStatus == EFI_NOT_FOUND)
-              {
-                // 0's not a good address (not enough contiguous pages could be found), get another one
-                NewAddress = ActuallyFreeAddress(pages, NewAddress);
-                // Make sure the new address isn't the known bad one
-                if(NewAddress == OldAllocatedMemory)
-                {
-                  // Get a new address if it is
-                  NewAddress = ActuallyFreeAddress(pages, NewAddress);
-                }
-                // Address can be > 4GB
-              }
-              else if(EFI_ERROR(GoTimeStatus))
-              {
-                Print(L"Could not get an address for ELF pages. Error code: 0x%llx\r\n", GoTimeStatus);
-                return GoTimeStatus;
-              }
-
-              if(NewAddress == ~0ULL)
-              {
-                // If you get this, you had no memory free anywhere.
-                Print(L"No memory marked as EfiConventionalMemory...\r\n");
-                return GoTimeStatus;
-              }
-
-              // Allocate the new address
-              GoTimeStatus = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
-              // This loop shouldn't run more than once, but in the event something is at 0x0 we need to
-              // leave the loop with an allocated address
-
-            }
-
-            // Got a new address that's been allocated--save it
-            AllocatedMemory = NewAddress;
-
-            // Verify it's empty
-            while((NewAddress != ~0ULL) && VerifyZeroMem(pages << EFI_PAGE_SHIFT, AllocatedMemory)) // Loop this in case the firmware is really screwed
-            { // It's not empty :(
-
-              // Sure hope there aren't any other page-aligned kernel images floating around in memory marked as free
-              if(compare((EFI_PHYSICAL_ADDRESS*)AllocatedMemory, ELFMAG, SELFMAG))
-              {
-                // Do nothing, we're fine
-  #ifdef MEMORY_CHECK_INFO
-                Print(L"System appears to have been reset. No issues.\r\n");
-  #endif
-
-                break;
-              }
-              else
-              { // Gotta keep looking for a good memory address
-
-  #ifdef MEMORY_DEBUG_ENABLED
-                Print(L"Still searching... 0x%llx\r\n", AllocatedMemory);
-  #endif
-
-                // It's not actually free...
-                GoTimeStatus = BS->FreePages(AllocatedMemory, pages);
-                if(EFI_ERROR(GoTimeStatus))
-                {
-                  Print(L"Could not free pages for ELF sections (loop). Error code: 0x%llx\r\n", GoTimeStatus);
-                  return GoTimeStatus;
-                }
-
-                // Allocate a new address
-                GoTimeStatus = EFI_NOT_FOUND;
-                while((GoTimeStatus != EFI_SUCCESS) && (NewAddress != ~0ULL))
-                {
-                  if(GoTimeStatus == EFI_NOT_FOUND)
-                  {
-                    // Get an address (ideally, this should be very rare)
-                    NewAddress = ActuallyFreeAddress(pages, NewAddress);
-                    // Make sure the new address isn't the known bad one
-                    if(NewAddress == OldAllocatedMemory)
-                    {
-                      // Get a new address if it is
-                      NewAddress = ActuallyFreeAddress(pages, NewAddress);
-                    }
-                    // Address can be > 4GB
-                    // This loop will run until we get a good address (shouldn't be more than once, if ever)
-                  }
-                  else if(EFI_ERROR(GoTimeStatus))
-                  {
-                    // EFI_OUT_OF_RESOURCES means the firmware's just not gonna load anything.
-                    Print(L"Could not get an address for ELF pages (loop). Error code: 0x%llx\r\n", GoTimeStatus);
-                    return GoTimeStatus;
-                  }
-                  // NOTE: The number of times the message "No more free addresses" pops up
-                  // helps indicate which NewAddress assignment hit the end.
-
-                  GoTimeStatus = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
-                } // loop
-
-                // It's a new address
-                AllocatedMemory = NewAddress;
-
-                // Verify new address is empty (in loop), if not then free it and try again.
-              } // else
-            } // End VerifyZeroMem while loop
-
-            // Ran out of easy addresses, time for a more thorough check
-            // Hopefully no one ever gets here
-            if(AllocatedMemory == ~0ULL)
-            { // NewAddress is also -1
-
-  #ifdef BY_PAGE_SEARCH_DISABLED // Set this to disable ByPage searching
-              Print(L"No easy addresses found with enough space and containing only zeros.\r\nConsider enabling page-by-page search.\r\n");
-              return GoTimeStatus;
-  #endif
-
-  #ifndef BY_PAGE_SEARCH_DISABLED
-    #ifdef MEMORY_CHECK_INFO
-              Print(L"Performing page-by-page search.\r\nThis might take a while...\r\n");
-    #endif
-
-    #ifdef MEMORY_DEBUG_ENABLED
-              Keywait(L"About to search page by page\r\n");
-    #endif
-
-              NewAddress = ActuallyFreeAddress(pages, 0); // Start from the first suitable EfiConventionalMemory address.
-              // Allocate the page's address
-              GoTimeStatus = EFI_NOT_FOUND;
-              while(GoTimeStatus != EFI_SUCCESS)
-              {
-                if(GoTimeStatus == EFI_NOT_FOUND)
-                {
-                  // Nope, get another one
-                  NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
-                  // Make sure the new address isn't the known bad one
-                  if(NewAddress == OldAllocatedMemory)
-                  {
-                    // Get a new address if it is
-                    NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
-                  }
-                  // Adresses very well might be > 4GB with the filesizes these are allowed to be
-                }
-                else if(EFI_ERROR(GoTimeStatus))
-                {
-                  Print(L"Could not get an address for ELF pages by page. Error code: 0x%llx\r\n", GoTimeStatus);
-                  return GoTimeStatus;
-                }
-
-                if(NewAddress == ~0ULL)
-                {
-                  // If you somehow get this, you really had no memory free anywhere.
-                  Print(L"Hmm... How did you get here?\r\n");
-                  return GoTimeStatus;
-                }
-
-                GoTimeStatus = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
-              }
-
-              AllocatedMemory = NewAddress;
-
-              while(VerifyZeroMem(pages << EFI_PAGE_SHIFT, AllocatedMemory))
-              {
-                // Sure hope there aren't any other page-aligned kernel images floating around in memory marked as free
-                if(compare((EFI_PHYSICAL_ADDRESS*)AllocatedMemory, ELFMAG, SELFMAG))
-                {
-                  // Do nothing, we're fine
-    #ifdef MEMORY_CHECK_INFO
-                  Print(L"System might have been reset. Hopefully no issues.\r\n");
-    #endif
-
-                  break;
-                }
-                else
-                {
-
-    #ifdef MEMORY_DEBUG_ENABLED
-                Print(L"Still searching by page... 0x%llx\r\n", AllocatedMemory);
-    #endif
-
-                  // It's not actually free...
-                  GoTimeStatus = BS->FreePages(AllocatedMemory, pages);
-                  if(EFI_ERROR(GoTimeStatus))
-                  {
-                    Print(L"Could not free pages for ELF sections by page (loop). Error code: 0x%llx\r\n", GoTimeStatus);
-                    return GoTimeStatus;
-                  }
-
-                  GoTimeStatus = EFI_NOT_FOUND;
-                  while(GoTimeStatus != EFI_SUCCESS)
-                  {
-                    if(GoTimeStatus == EFI_NOT_FOUND)
-                    {
-                      // Nope, get another one
-                      NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
-                      // Make sure the new address isn't the known bad one
-                      if(NewAddress == OldAllocatedMemory)
-                      {
-                        // Get a new address if it is
-                        NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
-                      }
-                      // Address can be > 4GB
-                    }
-                    else if(EFI_ERROR(GoTimeStatus))
-                    {
-                      Print(L"Could not get an address for ELF pages by page (loop). Error code: 0x%llx\r\n", GoTimeStatus);
-                      return GoTimeStatus;
-                    }
-
-                    if(AllocatedMemory == ~0ULL)
-                    {
-                      // Well, darn. Something's up with the system memory.
-                      return GoTimeStatus;
-                    }
-
-                    GoTimeStatus = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
-                  } // loop
-
-                  AllocatedMemory = NewAddress;
-
-                } // else
-              } // end ByPage VerifyZeroMem loop
-  #endif
-            } // End "big guns"
-
-            // Got a good address!
-  #ifdef MEMORY_CHECK_INFO
-            Print(L"Found!\r\n");
-  #endif
-          } // End discovery of viable memory address (else)
-          // Can move on now
-  #ifdef MEMORY_CHECK_INFO
-          Print(L"New AllocatedMemory location: 0x%llx\r\n", AllocatedMemory);
-  #endif
-        } // End VerifyZeroMem buggy firmware workaround (outermost if)
-        else
-        {
-  #ifdef MEMORY_CHECK_INFO
-          Print(L"Allocated memory was zeroed OK\r\n");
-  #endif
         }
-#endif
 
-#ifdef ELF_LOADER_DEBUG_ENABLED
-        Print(L"New AllocatedMemory location: 0x%llx\r\n", AllocatedMemory);
-        Keywait(L"Allocate Pages passed.\r\n");
-#endif
+        LOG_MESSAGE(ELF, DEBUG, L"New AllocatedMemory location: 0x%llx", AllocatedMemory);
+        LOG_MESSAGE(ELF, DEBUG, L"Allocate Pages passed.");
 
         // No need to copy headers to memory for ELFs, just the program itself
         // Only want to include PT_LOAD segments
@@ -1755,20 +1217,16 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
           UINTN RawDataSize = specific_program_header->p_filesz; // 64-bit ELFs can have 64-bit file sizes!
           EFI_PHYSICAL_ADDRESS SectionAddress = AllocatedMemory + specific_program_header->p_vaddr; // 64-bit ELFs use 64-bit addressing!
 
-#ifdef ELF_LOADER_DEBUG_ENABLED
-          Print(L"\n%llu. current section address: 0x%x, RawDataSize: 0x%llx\r\n", i+1, specific_program_header->p_vaddr, RawDataSize);
-#endif
+          LOG_MESSAGE(ELF, DEBUG, L"%llu. current section address: 0x%x, RawDataSize: 0x%llx", i+1, specific_program_header->p_vaddr, RawDataSize);
 
           if(specific_program_header->p_type == PT_LOAD)
           {
 
-#ifdef ELF_LOADER_DEBUG_ENABLED
-            Print(L"current destination address: 0x%llx, AllocatedMemory base: 0x%llx\r\n", SectionAddress, AllocatedMemory);
-            Print(L"PointerToRawData: 0x%llx\r\n", specific_program_header->p_offset);
-            Print(L"Check:\r\nSectionAddress: 0x%llx\r\nData there: 0x%016llx%016llx (should be 0)\r\n", SectionAddress, *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + 8), *(EFI_PHYSICAL_ADDRESS *)SectionAddress); // print the first 128 bits of that address to compare
-            Print(L"About to load section %llu of %llu...\r\n", i + 1, Numofprogheaders);
-            Keywait(L"\0");
-#endif
+            LOG_MESSAGE(ELF, DEBUG, L"current destination address: 0x%llx, AllocatedMemory base: 0x%llx", SectionAddress, AllocatedMemory);
+            LOG_MESSAGE(ELF, DEBUG, L"PointerToRawData: 0x%llx", specific_program_header->p_offset);
+            LOG_MESSAGE(ELF, DEBUG, L"Check: SectionAddress: 0x%llx", SectionAddress);
+            LOG_MESSAGE(ELF, DEBUG, L"Data there: 0x%016llx%016llx (should be 0)", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + 8), *(EFI_PHYSICAL_ADDRESS *)SectionAddress); // print the first 128 bits of that address to compare
+            LOG_MESSAGE(ELF, DEBUG, L"About to load section %llu of %llu...", i + 1, Numofprogheaders);
 
             GoTimeStatus = KernelFile->SetPosition(KernelFile, specific_program_header->p_offset); // p_offset is a UINT64 relative to the beginning of the file, just like Read() expects!
             if(EFI_ERROR(GoTimeStatus))
@@ -1786,18 +1244,19 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
                 return GoTimeStatus;
               }
             }
-#ifdef ELF_LOADER_DEBUG_ENABLED
-            Print(L"\r\nVerify:\r\nSectionAddress: 0x%llx\r\nData there (first 16 bytes): 0x%016llx%016llx\r\n", SectionAddress, *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + 8), *(EFI_PHYSICAL_ADDRESS*)SectionAddress); // print the first 128 bits of that address to compare
-            Print(L"Last 16 bytes: 0x%016llx%016llx\r\n", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize - 8), *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize - 16));
-            Print(L"Next 16 bytes: 0x%016llx%016llx (0 unless last section)\r\n", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize + 8), *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize));
-            // "Next 16 bytes" should be 0 unless last section
+
+#ifdef LOADER_PAGE_TABLES_ENABLED
+            AddKernelSegment(specific_program_header->p_vaddr, specific_program_header->p_memsz, ((specific_program_header->p_flags & PF_W) ? KERNEL_SEGMENT_WRITE : 0) | ((specific_program_header->p_flags & PF_X) ? KERNEL_SEGMENT_EXECUTE : 0));
 #endif
+            LOG_MESSAGE(ELF, DEBUG, L"Verify: SectionAddress: 0x%llx", SectionAddress);
+            LOG_MESSAGE(ELF, DEBUG, L"Data there (first 16 bytes): 0x%016llx%016llx", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + 8), *(EFI_PHYSICAL_ADDRESS*)SectionAddress); // print the first 128 bits of that address to compare
+            LOG_MESSAGE(ELF, DEBUG, L"Last 16 bytes: 0x%016llx%016llx", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize - 8), *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize - 16));
+            LOG_MESSAGE(ELF, DEBUG, L"Next 16 bytes: 0x%016llx%016llx (0 unless last section)", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize + 8), *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize));
+            // "Next 16 bytes" should be 0 unless last section
           }
           else if((specific_program_header->p_type == PT_DYNAMIC) && (specific_program_header->p_filesz != 0)) // If there's a PT_DYNAMIC section, it's always after PT_LOADs. Relocations thus will never be applied until after the PT_LOAD sections have been loaded.
           {
-#ifdef ELF_LOADER_DEBUG_ENABLED
-          Keywait(L"Found a PT_DYNAMIC section...\r\n");
-#endif
+          LOG_MESSAGE(ELF, DEBUG, L"Found a PT_DYNAMIC section...");
             // Check if there are relocations
             UINTN Dyn_array_size = specific_program_header->p_memsz; // For PT_DYNAMIC, memsz and filesz should always be the same, though if memsz is 0 then that probably means the section should be ignored
             Elf64_Dyn * Elf64_dynamic_array;
@@ -1808,11 +1267,9 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
               Print(L"PT_DYNAMIC program headers table AllocatePool error (ELF). 0x%llx\r\n", GoTimeStatus);
               return GoTimeStatus;
             }
-#ifdef ELF_LOADER_DEBUG_ENABLED
-            Print(L"PT_DYNAMIC area allocated, Elf64_dynamic_array: 0x%llx, Dyn_array_size: %llu Bytes in memory\r\n", (UINT64)Elf64_dynamic_array, Dyn_array_size);
-            Print(L"PT_DYNAMIC size in file: %llu Bytes\r\n", specific_program_header->p_filesz);
-            Keywait(L"About to read section into memory...\r\n");
-#endif
+            LOG_MESSAGE(ELF, DEBUG, L"PT_DYNAMIC area allocated, Elf64_dynamic_array: 0x%llx, Dyn_array_size: %llu Bytes in memory", (UINT64)Elf64_dynamic_array, Dyn_array_size);
+            LOG_MESSAGE(ELF, DEBUG, L"PT_DYNAMIC size in file: %llu Bytes", specific_program_header->p_filesz);
+            LOG_MESSAGE(ELF, DEBUG, L"About to read section into memory...");
             GoTimeStatus = KernelFile->SetPosition(KernelFile, specific_program_header->p_offset); // p_offset is a UINT64 relative to the beginning of the file, just like Read() expects!
             if(EFI_ERROR(GoTimeStatus))
             {
@@ -1827,10 +1284,7 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
               Print(L"PT_DYNAMIC program segment read error (ELF). 0x%llx\r\n", GoTimeStatus);
               return GoTimeStatus;
             }
-#ifdef ELF_LOADER_DEBUG_ENABLED
-            Print(L"PT_DYNAMIC Data read.\r\n");
-            Keywait(L"\0");
-#endif
+            LOG_MESSAGE(ELF, DEBUG, L"PT_DYNAMIC Data read.");
             Elf64_Dyn * Dyn_array_end = (Elf64_Dyn *) ((UINT64)Elf64_dynamic_array + Dyn_array_size);
 
             UINT64 Rela_table_size = 0;
@@ -1845,27 +1299,21 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
 
                 Rela_table = (Elf64_Rela*)(AllocatedMemory + Dyn_array_iter->d_un.d_ptr);
 
-#ifdef ELF_LOADER_DEBUG_ENABLED
-                Print(L"Relocation table address found: 0x%llx, in memory at: 0x%llx\r\n", Dyn_array_iter->d_un.d_ptr, AllocatedMemory + Dyn_array_iter->d_un.d_ptr);
-#endif
+                LOG_MESSAGE(ELF, DEBUG, L"Relocation table address found: 0x%llx, in memory at: 0x%llx", Dyn_array_iter->d_un.d_ptr, AllocatedMemory + Dyn_array_iter->d_un.d_ptr);
               }
               else if(Dyn_array_iter->d_tag == DT_RELASZ)
               {
 
                 Rela_table_size = Dyn_array_iter->d_un.d_val;
 
-#ifdef ELF_LOADER_DEBUG_ENABLED
-                Print(L"Relocation table size found: %llu\r\n", Rela_table_size);
-#endif
+                LOG_MESSAGE(ELF, DEBUG, L"Relocation table size found: %llu", Rela_table_size);
               }
               else if(Dyn_array_iter->d_tag == DT_RELAENT)
               {
 
                 Rela_table_entry_size = Dyn_array_iter->d_un.d_val;
 
-#ifdef ELF_LOADER_DEBUG_ENABLED
-                Print(L"Relocation table entry size found: %llu\r\n", Rela_table_entry_size);
-#endif
+                LOG_MESSAGE(ELF, DEBUG, L"Relocation table entry size found: %llu", Rela_table_entry_size);
               }
             } // end for
 
@@ -1880,46 +1328,32 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
               // Time to relocate!
 
               UINT64 Num_Rela = Rela_table_size / Rela_table_entry_size;
-#ifdef ELF_LOADER_DEBUG_ENABLED
-              Print(L"Number of relocations to perform: %llu\r\n", Num_Rela);
-              Keywait(L"About to perform relocations...\r\n");
-#endif
+              LOG_MESSAGE(ELF, DEBUG, L"Number of relocations to perform: %llu", Num_Rela);
+              LOG_MESSAGE(ELF, DEBUG, L"About to perform relocations...");
 
               for(UINT64 Rela_iter = 0; Rela_iter < Num_Rela; Rela_iter++)
               {
                 if(ELF64_R_TYPE(Rela_table[Rela_iter].r_info) == R_X86_64_RELATIVE)
                 {
-#ifdef ELF_LOADER_DEBUG_ENABLED
-                  Print(L"%llu of %llu, Rela_table[%llu] -- Offset: 0x%llx, Info: 0x%llx, Addend 0x%llx\r\n", Rela_iter+1, Num_Rela, Rela_iter, Rela_table[Rela_iter].r_offset, Rela_table[Rela_iter].r_info, Rela_table[Rela_iter].r_addend);
-                  Print(L"Data at offset: 0x%llx\r\n", *(UINT64*)(AllocatedMemory + Rela_table[Rela_iter].r_offset));
-#endif
+                  LOG_MESSAGE(ELF, DEBUG, L"%llu of %llu, Rela_table[%llu] -- Offset: 0x%llx, Info: 0x%llx, Addend 0x%llx", Rela_iter+1, Num_Rela, Rela_iter, Rela_table[Rela_iter].r_offset, Rela_table[Rela_iter].r_info, Rela_table[Rela_iter].r_addend);
+                  LOG_MESSAGE(ELF, DEBUG, L"Data at offset: 0x%llx", *(UINT64*)(AllocatedMemory + Rela_table[Rela_iter].r_offset));
 
                   *(UINT64*)(AllocatedMemory + Rela_table[Rela_iter].r_offset) = AllocatedMemory + Rela_table[Rela_iter].r_addend;
 
-#ifdef ELF_LOADER_DEBUG_ENABLED
-                  Print(L"Corrected data at offset: 0x%llx\r\n", *(UINT64*)(AllocatedMemory + Rela_table[Rela_iter].r_offset));
-                  if( (!(Rela_iter % 20)) && (Rela_iter > 0)) // There could be thousands. Mod 20 gives 20 lines per keywait.
-                  {
-                    Keywait(L"\0");
-                  }
-#endif
+                  LOG_MESSAGE(ELF, DEBUG, L"Corrected data at offset: 0x%llx", *(UINT64*)(AllocatedMemory + Rela_table[Rela_iter].r_offset));
                 }
-#ifdef ELF_LOADER_DEBUG_ENABLED
                 else
                 {
-                  Print(L"Not an x86_64 relative relocation. Other relocation types are not supported.\r\nUnsafe to continue because things will break (ELF).\r\n");
-                  return EFI_LOAD_ERROR;
+                  // Only R_X86_64_RELATIVE gets applied; anything else is left alone
+                  LOG_MESSAGE(ELF, WARNING, L"Rela_table[%llu] isn't an x86_64 relative relocation (type %llu), so it was skipped. Other relocation types are not supported.", Rela_iter, (UINT64)ELF64_R_TYPE(Rela_table[Rela_iter].r_info));
                 }
-#endif
               } // end for
             }
-#ifdef ELF_LOADER_DEBUG_ENABLED
             else
             {
               // It's also possible that there just isn't a relocation table, which is fine.
-              Print(L"Conveniently, no relocation table was found (ELF). Moving on...\r\n");
+              LOG_MESSAGE(ELF, DEBUG, L"Conveniently, no relocation table was found (ELF). Moving on...");
             }
-#endif
 
             // Done with PT_DYNAMIC section
             if(Elf64_dynamic_array)
@@ -1935,9 +1369,7 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
           else
           {
 
-#ifdef ELF_LOADER_DEBUG_ENABLED
-            Print(L"Not a PT_LOAD or PT_DYNAMIC section. Type: 0x%x\r\n", specific_program_header->p_type);
-#endif
+            LOG_MESSAGE(ELF, DEBUG, L"Not a PT_LOAD or PT_DYNAMIC section. Type: 0x%x", specific_program_header->p_type);
           }
         }
 
@@ -1952,9 +1384,7 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
           }
         }
 
-#ifdef ELF_LOADER_DEBUG_ENABLED
-        Keywait(L"\nLoad file sections into allocated pages passed.\r\n");
-#endif
+        LOG_MESSAGE(ELF, DEBUG, L"Load file sections into allocated pages passed.");
 
         // Link kernel with -static-pie and there's no need for relocations beyond the base-relative ones just done. YUS!
 
@@ -1962,10 +1392,8 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
         KernelBaseAddress = AllocatedMemory;
         Header_memory = AllocatedMemory + ELF64header.e_entry;
 
-#ifdef ELF_LOADER_DEBUG_ENABLED
-        Print(L"Header_memory: 0x%llx, AllocatedMemory: 0x%llx, EntryPoint: 0x%x\r\n", Header_memory, AllocatedMemory, ELF64header.e_entry);
-        Print(L"Data at Header_memory (first 16 bytes): 0x%016llx%016llx\r\n", *(EFI_PHYSICAL_ADDRESS*)(Header_memory + 8), *(EFI_PHYSICAL_ADDRESS*)Header_memory);
-#endif
+        LOG_MESSAGE(ELF, DEBUG, L"Header_memory: 0x%llx, AllocatedMemory: 0x%llx, EntryPoint: 0x%x", Header_memory, AllocatedMemory, ELF64header.e_entry);
+        LOG_MESSAGE(ELF, DEBUG, L"Data at Header_memory (first 16 bytes): 0x%016llx%016llx", *(EFI_PHYSICAL_ADDRESS*)(Header_memory + 8), *(EFI_PHYSICAL_ADDRESS*)Header_memory);
 
         // Loaded! On to memorymap and exitbootservices...
         // NOTE: Executable entry point is now defined in Header_memory's contained address, which is AllocatedMemory + ELF64header.e_entry
@@ -2002,17 +1430,13 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
         return GoTimeStatus;
       }
 
-#ifdef LOADER_DEBUG_ENABLED
-      Keywait(L"Mach header read from file.\r\n");
-#endif
+      LOG_MESSAGE(LOADER, DEBUG, L"Mach header read from file.");
 
       if(MACheader.magic == MH_MAGIC_64 && MACheader.cputype == CPU_TYPE_X86_64)
       {
         // Big endian: 0xfeedfacf && little endian: 0x07000001
 
-#ifdef LOADER_DEBUG_ENABLED
-        Keywait(L"Mach64 header passed.\r\n");
-#endif
+        LOG_MESSAGE(LOADER, DEBUG, L"Mach64 header passed.");
 
         if (MACheader.filetype != MH_EXECUTE)
         {
@@ -2022,9 +1446,7 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
           return GoTimeStatus;
         }
 
-#ifdef LOADER_DEBUG_ENABLED
-        Keywait(L"Executable Mach64 header passed.\r\n");
-#endif
+        LOG_MESSAGE(LOADER, DEBUG, L"Executable Mach64 header passed.");
 
         UINT64 i; // Iterator
         UINT64 virt_size = 0;
@@ -2064,363 +1486,69 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
           struct load_command *specific_load_command = (struct load_command*)&commands_buffer[current_spot];
           if(specific_load_command->cmd == LC_SEGMENT_64) // vmaddr and vmsize are 64-bit!!
           {
-            struct segment_command_64 *specific_segment_command = (struct segment_command_64 *)specific_load_command;
-
-#ifdef MACH_LOADER_DEBUG_ENABLED
-            Print(L"current segment address: 0x%x, size: 0x%x\r\n", specific_segment_command->vmaddr, specific_segment_command->vmsize);
-            Print(L"current segment address + size 0x%x\r\n", specific_segment_command->vmaddr + specific_segment_command->vmsize);
-#endif
-
-            virt_size = (virt_size > (specific_segment_command->vmaddr + specific_segment_command->vmsize) ? virt_size: (specific_segment_command->vmaddr + specific_segment_command->vmsize));
-            virt_min = (virt_min < (specific_segment_command->vmaddr) ? virt_min: (specific_segment_command->vmaddr));
-          }
-          current_spot += (UINT64)specific_load_command->cmdsize;
-        }
-
-#ifdef MACH_LOADER_DEBUG_ENABLED
-        Print(L"virt_size: 0x%llx, virt_min: 0x%llx, difference: 0x%llx\r\n", virt_size, virt_min, virt_size - virt_min);
-#endif
-
-        if(current_spot != size)
-        {
-          GoTimeStatus = EFI_INVALID_PARAMETER;
-          Print(L"Hmmm... current_spot: %llu != total cmd size: %llu\r\n", current_spot, size);
-          return GoTimeStatus;
-        }
-
-#ifdef MACH_LOADER_DEBUG_ENABLED
-        Print(L"current_spot: %llu == total cmd size: %llu\r\n", current_spot, size);
-        Keywait(L"Load commands buffer passed.\r\n");
-#endif
-
-        UINT64 pages = EFI_SIZE_TO_PAGES(virt_size - virt_min); // To get number of pages (typically 4KB per), rounded up
-        KernelPages = pages;
-
-#ifdef MACH_LOADER_DEBUG_ENABLED
-        Print(L"pages: %llu\r\n", pages);
-#endif
-
-        EFI_PHYSICAL_ADDRESS AllocatedMemory = 0x100000000; // Default for non-pagezero Mach-O with a 4GB pagezero
-
-#ifdef MACH_LOADER_DEBUG_ENABLED
-        Print(L"Address of AllocatedMemory: 0x%llx\r\n", &AllocatedMemory);
-#endif
-
-        GoTimeStatus = BS->AllocatePages(AllocateAnyPages, EfiLoaderData, pages, &AllocatedMemory);
-        if(EFI_ERROR(GoTimeStatus))
-        {
-          Print(L"Could not allocate pages for Mach64 segment sections. Error code: 0x%llx\r\n", GoTimeStatus);
-          return GoTimeStatus;
-        }
-
-#ifdef MACH_LOADER_DEBUG_ENABLED
-        Print(L"AllocatedMemory location: 0x%llx\r\n", AllocatedMemory);
-  #ifdef MEMMAP_PRINT_ENABLED
-        print_memmap();
-        Keywait(L"Done printing MemMap.\r\n");
-  #endif
-        Keywait(L"Zeroing\r\n");
-#endif
-
-        // Zero the allocated pages
-        ZeroMem((VOID*)AllocatedMemory, (pages << EFI_PAGE_SHIFT));
-
-#ifdef MACH_LOADER_DEBUG_ENABLED
-        Keywait(L"MemZeroed\r\n");
-#endif
-
-#ifndef MEMORY_CHECK_DISABLED
-        // If that memory isn't actually free due to weird firmware behavior...
-        // Iterate through the entirety of what was just allocated and check to make sure it's all zeros
-        // Start buggy firmware workaround
-        if(VerifyZeroMem(pages << EFI_PAGE_SHIFT, AllocatedMemory))
-        {
-
-          // From UEFI Specification 2.7, Errata A (http://www.uefi.org/specifications):
-          // MemoryType values in the range 0x80000000..0xFFFFFFFF are reserved for use by
-          // UEFI OS loaders that are provided by operating system vendors.
-  #ifdef MEMORY_CHECK_INFO
-          Print(L"Non-zero memory location allocated. Verifying cause...\r\n");
-  #endif
-          // Compare what's there with the kernel file's first bytes; the system might have been reset and the non-zero
-          // memory is what remains of last time. This can be safely overwritten to avoid cluttering up system RAM.
-
-          // Sure hope there aren't any other page-aligned kernel images floating around in memory marked as free
-          UINT64 MemCheck = MH_MAGIC_64; // Good thing we know what to expect!
-
-          if(compare((EFI_PHYSICAL_ADDRESS*)AllocatedMemory, &MemCheck, 4))
-          {
-            // Do nothing, we're fine
-  #ifdef MEMORY_CHECK_INFO
-            Print(L"System was reset. No issues.\r\n");
-  #endif
-          }
-          else // Not our remains, proceed with discovery of viable memory address
-          {
-
-  #ifdef MEMORY_CHECK_INFO
-            Print(L"Searching for actually free memory...\r\nPerhaps the firmware is buggy?\r\n");
-  #endif
-            // Free the pages (well, return them to the system as they were...)
-            GoTimeStatus = BS->FreePages(AllocatedMemory, pages);
-            if(EFI_ERROR(GoTimeStatus))
-            {
-              Print(L"Could not free pages for Mach64 sections. Error code: 0x%llx\r\n", GoTimeStatus);
-              return GoTimeStatus;
-            }
-
-            // NOTE: CANNOT create an array of all compatible free addresses because the array takes up memory. So does the memory map.
-            // This results in a paradox, so we need to scan the memory map every time we need to find a new address...
-
-            // It appears that AllocateAnyPages uses a "MaxAddress" approach. This will go bottom-up instead.
-            EFI_PHYSICAL_ADDRESS NewAddress = 0; // Start at zero
-            EFI_PHYSICAL_ADDRESS OldAllocatedMemory = AllocatedMemory;
-
-            GoTimeStatus = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress); // Need to check 0x0
-            while(GoTimeStatus != EFI_SUCCESS)
-            { // Keep checking free memory addresses until one works
-
-              if(GoTimeStatus == EFI_NOT_FOUND)
-              {
-                // 0's not a good address (not enough contiguous pages could be found), get another one
-                NewAddress = ActuallyFreeAddress(pages, NewAddress);
-                // Make sure the new address isn't the known bad one
-                if(NewAddress == OldAllocatedMemory)
-                {
-                  // Get a new address if it is
-                  NewAddress = ActuallyFreeAddress(pages, NewAddress);
-                }
-                // Address can be > 4GB
-              }
-              else if(EFI_ERROR(GoTimeStatus))
-              {
-                Print(L"Could not get an address for Mach64 pages. Error code: 0x%llx\r\n", GoTimeStatus);
-                return GoTimeStatus;
-              }
-
-              if(NewAddress == ~0ULL)
-              {
-                // If you get this, you had no memory free anywhere.
-                Print(L"No memory marked as EfiConventionalMemory...\r\n");
-                return GoTimeStatus;
-              }
-
-              // Allocate the new address
-              GoTimeStatus = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
-              // This loop shouldn't run more than once, but in the event something is at 0x0 we need to
-              // leave the loop with an allocated address
-
-            }
-
-            // Got a new address that's been allocated--save it
-            AllocatedMemory = NewAddress;
-
-            // Verify it's empty
-            while((NewAddress != ~0ULL) && VerifyZeroMem(pages << EFI_PAGE_SHIFT, AllocatedMemory)) // Loop this in case the firmware is really screwed
-            { // It's not empty :(
-
-              // Sure hope there aren't any other page-aligned kernel images floating around in memory marked as free
-              if(compare((EFI_PHYSICAL_ADDRESS*)AllocatedMemory, &MemCheck, 4))
-              {
-                // Do nothing, we're fine
-  #ifdef MEMORY_CHECK_INFO
-                Print(L"System appears to have been reset. No issues.\r\n");
-  #endif
+            struct segment_command_64 *specific_segment_command = (struct segment_command_64 *)specific_load_command;
 
-                break;
-              }
-              else
-              { // Gotta keep looking for a good memory address
+            LOG_MESSAGE(MACHO, DEBUG, L"current segment address: 0x%x, size: 0x%x", specific_segment_command->vmaddr, specific_segment_command->vmsize);
+            LOG_MESSAGE(MACHO, DEBUG, L"current segment address + size 0x%x", specific_segment_command->vmaddr + specific_segment_command->vmsize);
 
-  #ifdef MEMORY_DEBUG_ENABLED
-                Print(L"Still searching... 0x%llx\r\n", AllocatedMemory);
-  #endif
+            virt_size = (virt_size > (specific_segment_command->vmaddr + specific_segment_command->vmsize) ? virt_size: (specific_segment_command->vmaddr + specific_segment_command->vmsize));
+            virt_min = (virt_min < (specific_segment_command->vmaddr) ? virt_min: (specific_segment_command->vmaddr));
+          }
+          current_spot += (UINT64)specific_load_command->cmdsize;
+        }
 
-                // It's not actually free...
-                GoTimeStatus = BS->FreePages(AllocatedMemory, pages);
-                if(EFI_ERROR(GoTimeStatus))
-                {
-                  Print(L"Could not free pages for Mach64 sections (loop). Error code: 0x%llx\r\n", GoTimeStatus);
-                  return GoTimeStatus;
-                }
+        LOG_MESSAGE(MACHO, DEBUG, L"virt_size: 0x%llx, virt_min: 0x%llx, difference: 0x%llx", virt_size, virt_min, virt_size - virt_min);
 
-                // Allocate a new address
-                GoTimeStatus = EFI_NOT_FOUND;
-                while((GoTimeStatus != EFI_SUCCESS) && (NewAddress != ~0ULL))
-                {
-                  if(GoTimeStatus == EFI_NOT_FOUND)
-                  {
-                    // Get an address (ideally, this should be very rare)
-                    NewAddress = ActuallyFreeAddress(pages, NewAddress);
-                    // Make sure the new address isn't the known bad one
-                    if(NewAddress == OldAllocatedMemory)
-                    {
-                      // Get a new address if it is
-                      NewAddress = ActuallyFreeAddress(pages, NewAddress);
-                    }
-                    // Address can be > 4GB
-                    // This loop will run until we get a good address (shouldn't be more than once, if ever)
-                  }
-                  else if(EFI_ERROR(GoTimeStatus))
-                  {
-                    // EFI_OUT_OF_RESOURCES means the firmware's just not gonna load anything.
-                    Print(L"Could not get an address for Mach64 pages (loop). Error code: 0x%llx\r\n", GoTimeStatus);
-                    return GoTimeStatus;
-                  }
-                  // NOTE: The number of times the message "No more free addresses" pops up
-                  // helps indicate which NewAddress assignment hit the end.
-
-                  GoTimeStatus = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
-                } // loop
-
-                // It's a new address
-                AllocatedMemory = NewAddress;
-
-                // Verify new address is empty (in loop), if not then free it and try again.
-              } // else
-            } // End VerifyZeroMem while loop
-
-            // Ran out of easy addresses, time for a more thorough check
-            // Hopefully no one ever gets here
-            if(AllocatedMemory == ~0ULL)
-            { // NewAddress is also -1
-
-  #ifdef BY_PAGE_SEARCH_DISABLED // Set this to disable ByPage searching
-              Print(L"No easy addresses found with enough space and containing only zeros.\r\nConsider enabling page-by-page search.\r\n");
-              return GoTimeStatus;
-  #endif
+        if(current_spot != size)
+        {
+          GoTimeStatus = EFI_INVALID_PARAMETER;
+          Print(L"Hmmm... current_spot: %llu != total cmd size: %llu\r\n", current_spot, size);
+          return GoTimeStatus;
+        }
 
-  #ifndef BY_PAGE_SEARCH_DISABLED
-    #ifdef MEMORY_CHECK_INFO
-              Print(L"Performing page-by-page search.\r\nThis might take a while...\r\n");
-    #endif
+        LOG_MESSAGE(MACHO, DEBUG, L"current_spot: %llu == total cmd size: %llu", current_spot, size);
+        LOG_MESSAGE(MACHO, DEBUG, L"Load commands buffer passed.");
 
-    #ifdef MEMORY_DEBUG_ENABLED
-              Keywait(L"About to search page by page\r\n");
-    #endif
+        UINT64 pages = EFI_SIZE_TO_PAGES(virt_size - virt_min); // To get number of pages (typically 4KB per), rounded up
+        KernelPages = pages;
 
-              NewAddress = ActuallyFreeAddress(pages, 0); // Start from the first suitable EfiConventionalMemory address.
-              // Allocate the page's address
-              GoTimeStatus = EFI_NOT_FOUND;
-              while(GoTimeStatus != EFI_SUCCESS)
-              {
-                if(GoTimeStatus == EFI_NOT_FOUND)
-                {
-                  // Nope, get another one
-                  NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
-                  // Make sure the new address isn't the known bad one
-                  if(NewAddress == OldAllocatedMemory)
-                  {
-                    // Get a new address if it is
-                    NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
-                  }
-                  // Addresses very well might be > 4GB for the filesizes these are allowed to be
-                }
-                else if(EFI_ERROR(GoTimeStatus))
-                {
-                  Print(L"Could not get an address for Mach64 pages by page. Error code: 0x%llx\r\n", GoTimeStatus);
-                  return GoTimeStatus;
-                }
+        LOG_MESSAGE(MACHO, DEBUG, L"pages: %llu", pages);
 
-                if(NewAddress == ~0ULL)
-                {
-                  // If you somehow get this, you really had no memory free anywhere.
-                  Print(L"Hmm... How did you get here?\r\n");
-                  return GoTimeStatus;
-                }
+        EFI_PHYSICAL_ADDRESS AllocatedMemory = 0x100000000; // Default for non-pagezero Mach-O with a 4GB pagezero
 
-                GoTimeStatus = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
-              }
+        LOG_MESSAGE(MACHO, DEBUG, L"Address of AllocatedMemory: 0x%llx", &AllocatedMemory);
 
-              AllocatedMemory = NewAddress;
+        GoTimeStatus = AllocateBootPages(pages, &AllocatedMemory);
+        if(EFI_ERROR(GoTimeStatus))
+        {
+          Print(L"Could not allocate pages for Mach64 segment sections. Error code: 0x%llx\r\n", GoTimeStatus);
+          return GoTimeStatus;
+        }
 
-              while(VerifyZeroMem(pages << EFI_PAGE_SHIFT, AllocatedMemory))
-              {
+        LOG_MESSAGE(MACHO, DEBUG, L"AllocatedMemory location: 0x%llx", AllocatedMemory);
+        if(LOG_ENABLED(MEMORY, DEBUG))
+        {
+          print_memmap();
+        }
 
-                // Sure hope there aren't any other page-aligned kernel images floating around in memory marked as free
-                if(compare((EFI_PHYSICAL_ADDRESS*)AllocatedMemory, &MemCheck, 4))
-                {
-                  // Do nothing, we're fine
-    #ifdef MEMORY_CHECK_INFO
-                  Print(L"System might have been reset. Hopefully no issues.\r\n");
-    #endif
+        // Zero the allocated pages
+        ZeroMem((VOID*)AllocatedMemory, (pages << EFI_PAGE_SHIFT));
 
-                  break;
-                }
-                else
-                {
+        LOG_MESSAGE(MACHO, DEBUG, L"MemZeroed");
 
-    #ifdef MEMORY_DEBUG_ENABLED
-                Print(L"Still searching by page... 0x%llx\r\n", AllocatedMemory);
-    #endif
-
-                  // It's not actually free...
-                  GoTimeStatus = BS->FreePages(AllocatedMemory, pages);
-                  if(EFI_ERROR(GoTimeStatus))
-                  {
-                    Print(L"Could not free pages for Mach64 sections by page (loop). Error code: 0x%llx\r\n", GoTimeStatus);
-                    return GoTimeStatus;
-                  }
-
-                  GoTimeStatus = EFI_NOT_FOUND;
-                  while(GoTimeStatus != EFI_SUCCESS)
-                  {
-                    if(GoTimeStatus == EFI_NOT_FOUND)
-                    {
-                      // Nope, get another one
-                      NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
-                      // Make sure the new address isn't the known bad one
-                      if(NewAddress == OldAllocatedMemory)
-                      {
-                        // Get a new address if it is
-                        NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
-                      }
-                      // Address can be > 4GB
-                    }
-                    else if(EFI_ERROR(GoTimeStatus))
-                    {
-                      Print(L"Could not get an address for Mach64 pages by page (loop). Error code: 0x%llx\r\n", GoTimeStatus);
-                      return GoTimeStatus;
-                    }
-
-                    if(AllocatedMemory == ~0ULL)
-                    {
-                      // Well, darn. Something's up with the system memory.
-                      return GoTimeStatus;
-                    }
-
-                    GoTimeStatus = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
-                  } // loop
-
-                  AllocatedMemory = NewAddress;
-
-                } // else
-              } // end ByPage VerifyZeroMem loop
-  #endif
-            } // End "big guns"
-
-            // Got a good address!
-  #ifdef MEMORY_CHECK_INFO
-            Print(L"Found!\r\n");
-  #endif
-          } // End discovery of viable memory address (else)
-          // Can move on now
-  #ifdef MEMORY_CHECK_INFO
-          Print(L"New AllocatedMemory location: 0x%llx\r\n", AllocatedMemory);
-  #endif
-        } // End VerifyZeroMem buggy firmware workaround (outermost if)
-        else
+        if(MemoryCheckEnabled)
         {
-  #ifdef MEMORY_CHECK_INFO
-          Print(L"Allocated memory was zeroed OK\r\n");
-  #endif
+          // If that memory isn't actually free due to weird firmware behavior, go find some that is
+          UINT64 MemCheck = MH_MAGIC_64; // Good thing we know what to expect!
+          GoTimeStatus = FindActuallyFreePages(pages, &AllocatedMemory, &MemCheck, 4, (BootEntry->Placement == LOADER_PLACEMENT_BELOW_4GB), PlacementKernelId(KernelPath, FileInfo->FileSize), L"Mach64");
+          if(EFI_ERROR(GoTimeStatus))
+          {
+            return GoTimeStatus;
+          }
         }
-#endif
 
-#ifdef MACH_LOADER_DEBUG_ENABLED
-        Print(L"New AllocatedMemory location: 0x%llx\r\n", AllocatedMemory);
-        Keywait(L"Allocate Pages passed.\r\n");
-#endif
+        LOG_MESSAGE(MACHO, DEBUG, L"New AllocatedMemory location: 0x%llx", AllocatedMemory);
+        LOG_MESSAGE(MACHO, DEBUG, L"Allocate Pages passed.");
 
         current_spot = 0;
         UINT64 entrypointoffset = 0;
@@ -2434,14 +1562,12 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
             UINTN RawDataSize = specific_segment_command->filesize; // 64-bit Mach-Os can have 64-bit file sizes!
             EFI_PHYSICAL_ADDRESS SectionAddress = AllocatedMemory + specific_segment_command->vmaddr; // 64-bit Mach-Os use 64-bit addressing!
 
-#ifdef MACH_LOADER_DEBUG_ENABLED
-            Print(L"\n%llu. current section address: 0x%x, RawDataSize: 0x%llx\r\n", i+1, specific_segment_command->vmaddr, RawDataSize);
-            Print(L"current destination address: 0x%llx, AllocatedMemory base: 0x%llx\r\n", SectionAddress, AllocatedMemory);
-            Print(L"PointerToRawData: 0x%llx\r\n", specific_segment_command->fileoff);
-            Print(L"Check:\r\nSectionAddress: 0x%llx\r\nData there: 0x%016llx%016llx (should be 0)\r\n", SectionAddress, *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + 8), *(EFI_PHYSICAL_ADDRESS *)SectionAddress); // Print the first 128 bits of data at that address to compare
-            Print(L"About to load section %llu of %llu...\r\n", i + 1, Numofcommands);
-            Keywait(L"\0");
-#endif
+            LOG_MESSAGE(MACHO, DEBUG, L"%llu. current section address: 0x%x, RawDataSize: 0x%llx", i+1, specific_segment_command->vmaddr, RawDataSize);
+            LOG_MESSAGE(MACHO, DEBUG, L"current destination address: 0x%llx, AllocatedMemory base: 0x%llx", SectionAddress, AllocatedMemory);
+            LOG_MESSAGE(MACHO, DEBUG, L"PointerToRawData: 0x%llx", specific_segment_command->fileoff);
+            LOG_MESSAGE(MACHO, DEBUG, L"Check: SectionAddress: 0x%llx", SectionAddress);
+            LOG_MESSAGE(MACHO, DEBUG, L"Data there: 0x%016llx%016llx (should be 0)", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + 8), *(EFI_PHYSICAL_ADDRESS *)SectionAddress); // Print the first 128 bits of data at that address to compare
+            LOG_MESSAGE(MACHO, DEBUG, L"About to load section %llu of %llu...", i + 1, Numofcommands);
 
             GoTimeStatus = KernelFile->SetPosition(KernelFile, specific_segment_command->fileoff); // p_offset is a UINT64 relative to the beginning of the file, just like Read() expects!
             if(EFI_ERROR(GoTimeStatus))
@@ -2460,13 +1586,16 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
               }
             }
 
-#ifdef MACH_LOADER_DEBUG_ENABLED
-            Print(L"\r\nVerify:\r\nSectionAddress: 0x%llx\r\nData there (first 16 bytes): 0x%016llx%016llx\r\n", SectionAddress, *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + 8), *(EFI_PHYSICAL_ADDRESS*)SectionAddress); // Print the first 128 bits of data at that address to compare
-            Print(L"Last 16 bytes: 0x%016llx%016llx\r\n", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize - 8), *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize - 16));
-            Print(L"Next 16 bytes: 0x%016llx%016llx (0 unless last section)\r\n", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize + 8), *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize));
-            // "Next 16 bytes" should be 0 unless last section
+#ifdef LOADER_PAGE_TABLES_ENABLED
+            AddKernelSegment(specific_segment_command->vmaddr, specific_segment_command->vmsize, ((specific_segment_command->initprot & VM_PROT_WRITE) ? KERNEL_SEGMENT_WRITE : 0) | ((specific_segment_command->initprot & VM_PROT_EXECUTE) ? KERNEL_SEGMENT_EXECUTE : 0));
 #endif
 
+            LOG_MESSAGE(MACHO, DEBUG, L"Verify: SectionAddress: 0x%llx", SectionAddress);
+            LOG_MESSAGE(MACHO, DEBUG, L"Data there (first 16 bytes): 0x%016llx%016llx", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + 8), *(EFI_PHYSICAL_ADDRESS*)SectionAddress); // Print the first 128 bits of data at that address to compare
+            LOG_MESSAGE(MACHO, DEBUG, L"Last 16 bytes: 0x%016llx%016llx", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize - 8), *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize - 16));
+            LOG_MESSAGE(MACHO, DEBUG, L"Next 16 bytes: 0x%016llx%016llx (0 unless last section)", *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize + 8), *(EFI_PHYSICAL_ADDRESS*)(SectionAddress + RawDataSize));
+            // "Next 16 bytes" should be 0 unless last section
+
           }
           else if(specific_load_command->cmd == LC_UNIXTHREAD)
           {
@@ -2474,9 +1603,7 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
             UINT64 *unixthread_data = (UINT64*)specific_load_command; // Or use an array of 64-bit UINTs and grab RIP. The other registers should be zero.
             entrypointoffset = unixthread_data[18]; // Get entrypoint from RIP register initialization
 
-#ifdef MACH_LOADER_DEBUG_ENABLED
-            Print(L"Entry Point: 0x%llx\r\n", entrypointoffset);
-#endif
+            LOG_MESSAGE(MACHO, DEBUG, L"Entry Point: 0x%llx", entrypointoffset);
           }
           else if(specific_load_command->cmd == LC_MAIN)
           {
@@ -2492,9 +1619,7 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
           else
           {
 
-#ifdef MACH_LOADER_DEBUG_ENABLED
-            Print(L"Not a LC_SEGMENT_64 section. Type: 0x%x\r\n", specific_load_command->cmd);
-#endif
+            LOG_MESSAGE(MACHO, DEBUG, L"Not a LC_SEGMENT_64 section. Type: 0x%x", specific_load_command->cmd);
           }
           current_spot += (UINT64)specific_load_command->cmdsize;
         }
@@ -2510,18 +1635,14 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
           }
         }
 
-#ifdef MACH_LOADER_DEBUG_ENABLED
-        Keywait(L"\nLoad file sections into allocated pages passed.\r\n");
-#endif
+        LOG_MESSAGE(MACHO, DEBUG, L"Load file sections into allocated pages passed.");
 
         // entrypointoffset should be a 64-bit relative mem address of the entry point of the kernel
         KernelBaseAddress = AllocatedMemory;
         Header_memory = AllocatedMemory + entrypointoffset;
 
-#ifdef MACH_LOADER_DEBUG_ENABLED
-        Print(L"Header_memory: 0x%llx, AllocatedMemory: 0x%llx, EntryPoint: 0x%x\r\n", Header_memory, AllocatedMemory, entrypointoffset);
-        Print(L"Data at Header_memory (first 16 bytes): 0x%016llx%016llx\r\n", *(EFI_PHYSICAL_ADDRESS*)(Header_memory + 8), *(EFI_PHYSICAL_ADDRESS*)Header_memory);
-#endif
+        LOG_MESSAGE(MACHO, DEBUG, L"Header_memory: 0x%llx, AllocatedMemory: 0x%llx, EntryPoint: 0x%x", Header_memory, AllocatedMemory, entrypointoffset);
+        LOG_MESSAGE(MACHO, DEBUG, L"Data at Header_memory (first 16 bytes): 0x%016llx%016llx", *(EFI_PHYSICAL_ADDRESS*)(Header_memory + 8), *(EFI_PHYSICAL_ADDRESS*)Header_memory);
 
         // Loaded! On to memorymap and exitbootservices...
         // NOTE: Executable entry point is now defined in Header_memory's contained address, which is AllocatedMemory + entrypointoffset
@@ -2547,40 +1668,62 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
     }
   }
 
-#ifdef FINAL_LOADER_DEBUG_ENABLED
-  Print(L"Image info:\r\n");
-  Print(L"KernelBaseAddress (image base): 0x%llx\r\n", KernelBaseAddress);
-  Print(L"Header_memory (entry point): 0x%llx\r\n", Header_memory);
-  Print(L"Data at Header_memory (first 16 bytes): 0x%016llx%016llx\r\n", *(EFI_PHYSICAL_ADDRESS*)(Header_memory + 8), *(EFI_PHYSICAL_ADDRESS*)Header_memory);
+  LOG_MESSAGE(HANDOFF, DEBUG, L"Image info:");
+  LOG_MESSAGE(HANDOFF, DEBUG, L"KernelBaseAddress (image base): 0x%llx", KernelBaseAddress);
+  LOG_MESSAGE(HANDOFF, DEBUG, L"Header_memory (entry point): 0x%llx", Header_memory);
+  LOG_MESSAGE(HANDOFF, DEBUG, L"Data at Header_memory (first 16 bytes): 0x%016llx%016llx", *(EFI_PHYSICAL_ADDRESS*)(Header_memory + 8), *(EFI_PHYSICAL_ADDRESS*)Header_memory);
+  LOG_MESSAGE(HANDOFF, DEBUG, KernelisPE ? L"Kernel uses MS ABI" : L"Kernel uses SYSV ABI");
 
-  if(KernelisPE)
+  // Integrity check
+  for(UINT64 k = 0; k < Graphics->NumberOfFrameBuffers; k++)
   {
-    Print(L"Kernel uses MS ABI\r\n");
+    LOG_MESSAGE(HANDOFF, DEBUG, L"GPU %llu info:", k);
+    LOG_MESSAGE(HANDOFF, DEBUG, L"GPU Mode: %u of %u", Graphics->GPUArray[k].Mode, Graphics->GPUArray[k].MaxMode - 1);
+    LOG_MESSAGE(HANDOFF, DEBUG, L"GPU FB: 0x%016llx", Graphics->GPUArray[k].FrameBufferBase);
+    LOG_MESSAGE(HANDOFF, DEBUG, L"GPU FB Size: 0x%016llx", Graphics->GPUArray[k].FrameBufferSize);
+    LOG_MESSAGE(HANDOFF, DEBUG, L"GPU SizeOfInfo: %u Bytes", Graphics->GPUArray[k].SizeOfInfo);
+    LOG_MESSAGE(HANDOFF, DEBUG, L"GPU Info Ver: 0x%x", Graphics->GPUArray[k].Info->Version);
+    LOG_MESSAGE(HANDOFF, DEBUG, L"GPU Info Res: %ux%u", Graphics->GPUArray[k].Info->HorizontalResolution, Graphics->GPUArray[k].Info->VerticalResolution);
+    LOG_MESSAGE(HANDOFF, DEBUG, L"GPU Info PxFormat: 0x%x", Graphics->GPUArray[k].Info->PixelFormat);
+    LOG_MESSAGE(HANDOFF, DEBUG, L"GPU Info PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x", Graphics->GPUArray[k].Info->PixelInformation.RedMask, Graphics->GPUArray[k].Info->PixelInformation.GreenMask, Graphics->GPUArray[k].Info->PixelInformation.BlueMask, Graphics->GPUArray[k].Info->PixelInformation.ReservedMask);
+    LOG_MESSAGE(HANDOFF, DEBUG, L"GPU Info PxPerScanLine: %u", Graphics->GPUArray[k].Info->PixelsPerScanLine);
   }
-  else
+
+  LOG_MESSAGE(HANDOFF, DEBUG, L"Config table address: 0x%llx", ST->ConfigurationTable);
+
+  // Load the boot entry's modules. Kernel64.txt isn't needed after this.
+  LOADER_MODULES_TAG * Modules;
+  GoTimeStatus = LoadBootModules(CurrentDriveRoot, BootEntry, &Modules);
+  if(EFI_ERROR(GoTimeStatus))
   {
-    Print(L"Kernel uses SYSV ABI\r\n");
+    return GoTimeStatus;
   }
 
-  Keywait(L"\0");
-
-  // Integrity check
-  for(UINT64 k = 0; k < Graphics->NumberOfFrameBuffers; k++)
+  GoTimeStatus = BS->FreePool((VOID*)LoaderConfig.File);
+  if(EFI_ERROR(GoTimeStatus))
   {
-    Print(L"GPU %llu info:\r\n", k);
-    Print(L"GPU Mode: %u of %u\r\n", Graphics->GPUArray[k].Mode, Graphics->GPUArray[k].MaxMode - 1);
-    Print(L"GPU FB: 0x%016llx\r\n", Graphics->GPUArray[k].FrameBufferBase);
-    Print(L"GPU FB Size: 0x%016llx\r\n", Graphics->GPUArray[k].FrameBufferSize);
-    Print(L"GPU SizeOfInfo: %u Bytes\r\n", Graphics->GPUArray[k].SizeOfInfo);
-    Print(L"GPU Info Ver: 0x%x\r\n", Graphics->GPUArray[k].Info->Version);
-    Print(L"GPU Info Res: %ux%u\r\n", Graphics->GPUArray[k].Info->HorizontalResolution, Graphics->GPUArray[k].Info->VerticalResolution);
-    Print(L"GPU Info PxFormat: 0x%x\r\n", Graphics->GPUArray[k].Info->PixelFormat);
-    Print(L"GPU Info PxInfo (R,G,B,Rsvd Masks): 0x%08x, 0x%08x, 0x%08x, 0x%08x\r\n", Graphics->GPUArray[k].Info->PixelInformation.RedMask, Graphics->GPUArray[k].Info->PixelInformation.GreenMask, Graphics->GPUArray[k].Info->PixelInformation.BlueMask, Graphics->GPUArray[k].Info->PixelInformation.ReservedMask);
-    Print(L"GPU Info PxPerScanLine: %u\r\n", Graphics->GPUArray[k].Info->PixelsPerScanLine);
-    Keywait(L"\0");
+    Print(L"Error freeing KernelcmdArray pool. 0x%llx\r\n", GoTimeStatus);
+    return GoTimeStatus;
   }
+  LoaderConfig.File = NULL;
 
-  Print(L"Config table address: 0x%llx\r\n", ST->ConfigurationTable);
+  // Measure memory performance while there's still nothing else running on the machine
+  MEMORY_PERF_TABLE * PerfTable = NULL;
+#ifdef MEMORY_CHARACTERIZATION_ENABLED
+  GoTimeStatus = CharacterizeMemory(&PerfTable);
+  if(EFI_ERROR(GoTimeStatus))
+  {
+    // Not worth failing the boot over, the kernel just won't get any measurements
+    PerfTable = NULL;
+  }
+  else
+  {
+    LOG_MESSAGE(MEMORY, INFO, L"Memory characterization took %llu us, TSC: %llu Hz, Flags: 0x%x", PerfTable->ElapsedMicroseconds, PerfTable->TscFrequency, PerfTable->Flags);
+    for(UINT32 k = 0; k < PerfTable->NumberOfEntries; k++)
+    {
+      LOG_MESSAGE(MEMORY, DEBUG, L"0x%016llx: Read %u MB/s, Write %u MB/s, Copy %u MB/s, Triad %u MB/s, Latency %u ps", PerfTable->Entries[k].PhysicalStart, PerfTable->Entries[k].ReadBandwidth, PerfTable->Entries[k].WriteBandwidth, PerfTable->Entries[k].CopyBandwidth, PerfTable->Entries[k].TriadBandwidth, PerfTable->Entries[k].Latency);
+    }
+  }
 #endif
 
   // Reserve memory for the loader block
@@ -2592,11 +1735,186 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
     return GoTimeStatus;
   }
 
-#ifdef FINAL_LOADER_DEBUG_ENABLED
-  Print(L"Loader block allocated at 0x%llx, size of structure: %llu\r\n", (UINT64)Loader_block, sizeof(LOADER_PARAMS));
-  Keywait(L"About to get MemMap and exit boot services...\r\n");
+  // Reserve memory for the memory tier table, which gets filled in from the final memory map
+  MEMORY_TIER_TABLE * TierTable;
+  GoTimeStatus = AllocateMemoryTierTable(&TierTable);
+  if(EFI_ERROR(GoTimeStatus))
+  {
+    return GoTimeStatus;
+  }
+
+  // Allocate the kernel's stack and descriptor tables before the page tables, which leave out the stack's guard page
+  LOADER_ENTRY_STATE * EntryState = NULL;
+#ifdef LOADER_ENTRY_STATE_ENABLED
+  GoTimeStatus = BuildEntryState(Graphics, &EntryState);
+  if(EFI_ERROR(GoTimeStatus))
+  {
+    return GoTimeStatus;
+  }
+#endif
+
+  // Runtime ranges need their virtual addresses before the page tables get built, so they can be mapped there
+  RUNTIME_MAP * RuntimeMap = NULL;
+#ifdef RUNTIME_VIRTUAL_MAP_ENABLED
+  GoTimeStatus = PlanRuntimeMap(&RuntimeMap);
+  if(EFI_ERROR(GoTimeStatus))
+  {
+    return GoTimeStatus;
+  }
+#endif
+
+  // Build the kernel's page tables now, while it's still possible to allocate memory for them. They get loaded after ExitBootServices().
+  EFI_PHYSICAL_ADDRESS PageTableRoot = 0;
+  UINT64 KernelVirtualBase = 0;
+#ifdef LOADER_PAGE_TABLES_ENABLED
+  GoTimeStatus = BuildPageTables(KernelBaseAddress, KernelPages, Graphics, &PageTableRoot);
+  if(GoTimeStatus == EFI_UNSUPPORTED)
+  {
+    // The kernel just keeps the firmware's page tables
+    PageTableRoot = 0;
+  }
+  else if(EFI_ERROR(GoTimeStatus))
+  {
+    return GoTimeStatus;
+  }
+  else
+  {
+    KernelVirtualBase = LOADER_PAGING_KERNEL_VIRTUAL_BASE;
+  }
+#endif
+
+#ifdef LOADER_ENTRY_STATE_ENABLED
+  if(PageTableRoot != 0)
+  {
+    EntryState->Flags |= LOADER_ENTRY_GUARD_UNMAPPED;
+  }
+#endif
+
+#ifdef RUNTIME_VIRTUAL_MAP_ENABLED
+  if(PageTableRoot != 0)
+  {
+    RuntimeMap->Flags |= RUNTIME_MAP_PAGE_TABLES;
+  }
+#endif
+
+  // Work out the framebuffers' memory types, and pick MTRRs for any that should be write-combining
+  GoTimeStatus = PlanFrameBufferCaching(Graphics, PageTableRoot != 0);
+  if(EFI_ERROR(GoTimeStatus))
+  {
+    return GoTimeStatus;
+  }
+
+  // Read CPUID and decide what CR4 and XCR0 the kernel gets
+  CPU_FEATURES * CpuFeatures;
+  GoTimeStatus = GetCpuFeatures(&CpuFeatures);
+  if(EFI_ERROR(GoTimeStatus))
+  {
+    return GoTimeStatus;
+  }
+
+  // This might run CPUID on the APs, so it has to happen before they get parked
+  CPU_TOPOLOGY * CpuTopology;
+  GoTimeStatus = GetCpuTopology(&CpuTopology);
+  if(EFI_ERROR(GoTimeStatus))
+  {
+    return GoTimeStatus;
+  }
+
+  // Firmware already enumerated PCI, so save the kernel from doing it again
+  PCI_INVENTORY * PciInventory;
+  GoTimeStatus = GetPciInventory(ImageHandle, &PciInventory);
+  if(EFI_ERROR(GoTimeStatus))
+  {
+    return GoTimeStatus;
+  }
+
+  // Zeroing goes last, since it claims free memory that the above might have needed
+  ZEROED_MEMORY_MAP * ZeroMap = NULL;
+#ifdef MEMORY_PREZERO_ENABLED
+  GoTimeStatus = PrezeroMemory(&ZeroMap);
+  if(EFI_ERROR(GoTimeStatus))
+  {
+    // The kernel just has to zero everything itself
+    ZeroMap = NULL;
+  }
+  else
+  {
+    LOG_MESSAGE(MEMORY, INFO, L"Zeroed %llu MB in %llu us on %u CPUs: %u MB/s per CPU, %llu MB/s total", ZeroMap->BytesZeroed >> 20, ZeroMap->ElapsedMicroseconds, ZeroMap->NumberOfCpus, ZeroMap->PerCpuBandwidth, ZeroMap->TotalBandwidth);
+  }
+#endif
+
+  // The APs never come back from this, so it has to go after everything else that uses them
+  LOADER_AP_PARKING * ApParking = NULL;
+#ifdef AP_PARKING_ENABLED
+  GoTimeStatus = ParkApplicationProcessors(&ApParking);
+  if(EFI_ERROR(GoTimeStatus))
+  {
+    // The kernel just has to start the APs itself
+    ApParking = NULL;
+  }
 #endif
 
+  // Everything but the memory map is known by now, so fill in what can be filled in and pack it all into the v3 handoff buffer
+  Loader_block->UEFI_Version = UEFIVer;
+  Loader_block->Bootloader_MajorVersion = MAJOR_VER;
+  Loader_block->Bootloader_MinorVersion = MINOR_VER;
+
+  Loader_block->Kernel_BaseAddress = KernelBaseAddress;
+  Loader_block->Kernel_Pages = KernelPages;
+
+  Loader_block->ESP_Root_Device_Path = ESPRoot;
+  Loader_block->ESP_Root_Size = ESPRootSize;
+  Loader_block->Kernel_Path = KernelPath;
+  Loader_block->Kernel_Path_Size = KernelPathSize;
+  Loader_block->Kernel_Options = Cmdline;
+  Loader_block->Kernel_Options_Size = CmdlineSize;
+
+  Loader_block->RTServices = RT;
+  Loader_block->GPU_Configs = Graphics;
+  Loader_block->FileMeta = FileInfo;
+
+  Loader_block->ConfigTables = SysCfgTables;
+  Loader_block->Number_of_ConfigTables = NumSysCfgTables;
+
+  Loader_block->Memory_Tiers = TierTable;
+  Loader_block->Memory_Performance = PerfTable;
+
+  Loader_block->Page_Table_Root = PageTableRoot;
+  Loader_block->Kernel_VirtualBase = KernelVirtualBase;
+
+  Loader_block->Zeroed_Memory = ZeroMap;
+
+  Loader_block->Cpu_Features = CpuFeatures;
+  Loader_block->Cpu_Topology = CpuTopology;
+
+  Loader_block->Pci_Inventory = PciInventory;
+
+  Loader_block->Entry_State = EntryState;
+
+  Loader_block->Ap_Parking = ApParking;
+
+  Loader_block->Runtime_Map = RuntimeMap;
+
+  Loader_block->Loader_Log = GetLoaderLog();
+
+  Modules->Modules[0].PhysicalStart = KernelBaseAddress;
+  Modules->Modules[0].Size = KernelPages << EFI_PAGE_SHIFT;
+  Modules->Modules[0].VirtualStart = KernelVirtualBase;
+  Modules->Modules[0].Type = LOADER_MODULE_KERNEL;
+  Loader_block->Modules = Modules;
+
+  LOADER_HANDOFF_HEADER * Handoff;
+  GoTimeStatus = BuildHandoff(Loader_block, &Handoff);
+  if(EFI_ERROR(GoTimeStatus))
+  {
+    return GoTimeStatus;
+  }
+  Loader_block->Handoff = Handoff;
+
+  LOG_MESSAGE(HANDOFF, DEBUG, L"Loader block allocated at 0x%llx, size of structure: %llu", (UINT64)Loader_block, sizeof(LOADER_PARAMS));
+  LOG_MESSAGE(HANDOFF, DEBUG, L"Handoff buffer allocated at 0x%llx, size: %llu, capabilities: 0x%llx", (UINT64)Handoff, Handoff->TotalSize, Handoff->Capabilities);
+  LOG_MESSAGE(HANDOFF, INFO, L"Exiting boot services");
+
  //----------------------------------------------------------------------------------------------------------------------------------
  //  Get Memory Map and Exit Boot Services
  //----------------------------------------------------------------------------------------------------------------------------------
@@ -2621,71 +1939,63 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
   GoTimeStatus = BS->ExitBootServices(ImageHandle, MemMapKey);
 */
 
-// Below is a better, but more complex version. EFI Spec recommends this method; apparently some systems need a second call to ExitBootServices.
+// Below is the version that's actually used. The buffer gets allocated once, with enough room for the map to grow a bit, and then
+// GetMemoryMap() and ExitBootServices() get retried with no allocations in between. Some firmware has timer events that allocate or
+// free memory, which changes the key between the two calls; after a failed ExitBootServices() only GetMemoryMap() and
+// ExitBootServices() can be used anyway.
+
+#ifdef LOADER_LOG_SERIAL_ENABLED
+  // EFI_SERIAL_IO_PROTOCOL can't be used after ExitBootServices(), so send everything logged so far first
+  FlushLoaderLogSerial();
+#endif
 
-  // Get memory map and exit boot services
+  // Just need to know how big the memory map is right now
   GoTimeStatus = BS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
-  if(GoTimeStatus == EFI_BUFFER_TOO_SMALL)
+  if(GoTimeStatus != EFI_BUFFER_TOO_SMALL)
   {
-    MemMapSize += MemMapDescriptorSize;
-    GoTimeStatus = BS->AllocatePool(EfiLoaderData, MemMapSize, (void **)&MemMap); // Allocate pool for MemMap (it should always be resident in memory)
-    if(EFI_ERROR(GoTimeStatus)) // Error! Wouldn't be safe to continue.
-    {
-      Print(L"MemMap AllocatePool error. 0x%llx\r\n", GoTimeStatus);
-      return GoTimeStatus;
-    }
-    GoTimeStatus = BS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
+    Print(L"Error getting memory map size. 0x%llx\r\n", GoTimeStatus);
+    return GoTimeStatus;
   }
 
-  GoTimeStatus = BS->ExitBootServices(ImageHandle, MemMapKey);
-
-  if(EFI_ERROR(GoTimeStatus)) // Error! EFI_INVALID_PARAMETER, MemMapKey is incorrect
+  UINTN MemMapCapacity = MemMapSize + EXIT_BOOT_SERVICES_MEMMAP_SLACK * MemMapDescriptorSize;
+  GoTimeStatus = BS->AllocatePool(EfiLoaderData, MemMapCapacity, (void **)&MemMap); // Allocate pool for MemMap (it should always be resident in memory)
+  if(EFI_ERROR(GoTimeStatus)) // Error! Wouldn't be safe to continue.
   {
+    Print(L"MemMap AllocatePool error. 0x%llx\r\n", GoTimeStatus);
+    return GoTimeStatus;
+  }
 
-    GoTimeStatus = BS->FreePool(MemMap);
-    if(EFI_ERROR(GoTimeStatus)) // Error! Wouldn't be safe to continue.
-    {
-      Print(L"Error freeing MemMap pool from failed ExitBootServices. 0x%llx\r\n", GoTimeStatus);
-      Keywait(L"\0");
-    }
-
-#ifdef FINAL_LOADER_DEBUG_ENABLED
-    Print(L"ExitBootServices #1 failed. 0x%llx, Trying again...\r\n", GoTimeStatus);
-    Keywait(L"\0");
-#endif
+  UINT32 ExitBootServicesAttempts = 0;
+  UINT64 ExitBootServicesStartTsc = ReadTsc();
+  UINT64 ExitBootServicesCallTsc = 0;
 
-    MemMapSize = 0;
+  do {
+    MemMapSize = MemMapCapacity;
     GoTimeStatus = BS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
-    if(GoTimeStatus == EFI_BUFFER_TOO_SMALL)
+    if(EFI_ERROR(GoTimeStatus)) // Grew by more than the slack, and nothing can be allocated anymore
     {
-      MemMapSize += MemMapDescriptorSize;
-      GoTimeStatus = BS->AllocatePool(EfiLoaderData, MemMapSize, (void **)&MemMap);
-      if(EFI_ERROR(GoTimeStatus)) // Error! Wouldn't be safe to continue.
-      {
-        Print(L"MemMap AllocatePool error #2. 0x%llx\r\n", GoTimeStatus);
-        return GoTimeStatus;
-      }
-      GoTimeStatus = BS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
+      break;
     }
 
+    ExitBootServicesAttempts++;
+    *ExitBootServicesCalled = 1;
+    ExitBootServicesCallTsc = ReadTsc(); // Only the last one counts, since that's the call that worked
     GoTimeStatus = BS->ExitBootServices(ImageHandle, MemMapKey);
+  } while((GoTimeStatus == EFI_INVALID_PARAMETER) && (ExitBootServicesAttempts < EXIT_BOOT_SERVICES_MAX_ATTEMPTS)); // EFI_INVALID_PARAMETER: MemMapKey is stale
 
-  }
-
-  // This applies to both the simple and larger versions of the above.
+  // This applies to both the simple and larger versions of the above. Boot services are in an unknown state after a failed
+  // ExitBootServices(), so no printing or freeing MemMap here, just hand the status back.
   if(EFI_ERROR(GoTimeStatus))
   {
-    Print(L"Could not exit boot services... 0x%llx\r\n", GoTimeStatus);
-    GoTimeStatus = BS->FreePool(MemMap);
-    if(EFI_ERROR(GoTimeStatus)) // Error! Wouldn't be safe to continue.
-    {
-      Print(L"Error freeing MemMap pool. 0x%llx\r\n", GoTimeStatus);
-    }
-    Print(L"MemMapSize: %llx, MemMapKey: %llx\r\n", MemMapSize, MemMapKey);
-    Print(L"DescriptorSize: %llx, DescriptorVersion: %x\r\n", MemMapDescriptorSize, MemMapDescriptorVersion);
     return GoTimeStatus;
   }
 
+  UINT64 ExitBootServicesTsc = ReadTsc();
+
+  // No more console from here on
+  DetachLogConsole();
+  LOG_MESSAGE(HANDOFF, INFO, L"Exited boot services, attempts: %u", ExitBootServicesAttempts);
+
   //----------------------------------------------------------------------------------------------------------------------------------
   //  Entry Point Jump
   //----------------------------------------------------------------------------------------------------------------------------------
@@ -2737,49 +2047,104 @@ EFI_STATUS GoTime(EFI_HANDLE ImageHandle, GPU_CONFIG * Graphics, EFI_CONFIGURATI
 
     EFI_CONFIGURATION_TABLE  *ConfigTables;                   // UEFI-installed system configuration tables (ACPI, SMBIOS, etc.)
     UINTN                     Number_of_ConfigTables;         // The number of system configuration tables
+
+    MEMORY_TIER_TABLE        *Memory_Tiers;                   // RAM classified by tier (DRAM, specific-purpose, persistent, uncached) with SRAT/HMAT hints
+    MEMORY_PERF_TABLE        *Memory_Performance;             // Measured bandwidth & latency of large RAM ranges, or NULL if MEMORY_CHARACTERIZATION_ENABLED is off
+
+    EFI_PHYSICAL_ADDRESS      Page_Table_Root;                // Physical address of the loader-built PML4 (already loaded in CR3), or 0 if LOADER_PAGE_TABLES_ENABLED is off
+    UINT64                    Kernel_VirtualBase;             // Higher-half virtual address that Kernel_BaseAddress is mapped to, or 0 if there's no such mapping
+
+    ZEROED_MEMORY_MAP        *Zeroed_Memory;                  // Which 2MB chunks of RAM are already zeroed, or NULL if MEMORY_PREZERO_ENABLED is off
+
+    struct _LOADER_HANDOFF_HEADER *Handoff;                   // All of the above (and more) in one contiguous buffer; see LOADER_HANDOFF_HEADER below
+
+    CPU_FEATURES             *Cpu_Features;                   // CPUID summary and the CR4/XCR0 state at kernel entry
+
+    LOADER_ENTRY_STATE       *Entry_State;                    // The loader's stack, GDT and IDT the kernel starts with, or NULL if LOADER_ENTRY_STATE_ENABLED is off
+
+    LOADER_AP_PARKING        *Ap_Parking;                     // Mailboxes of the parked application processors, or NULL if AP_PARKING_ENABLED is off or there are no APs
+
+    CPU_TOPOLOGY             *Cpu_Topology;                   // Packages, dies, cores, threads and caches of every processor
+
+    PCI_INVENTORY            *Pci_Inventory;                  // Every PCI function firmware found, with its IDs, class, BARs and driver name
+
+    RUNTIME_MAP              *Runtime_Map;                    // Virtual addresses of the runtime services ranges, or NULL if RUNTIME_VIRTUAL_MAP_ENABLED is off
+
+    LOADER_LOG               *Loader_Log;                     // Everything the loader logged, with timestamps
+
+    struct _LOADER_MODULES_TAG *Modules;                      // The kernel, then the boot entry's module files in Kernel64.txt order
   } LOADER_PARAMS;
 */
 
-  // This shouldn't modify the memory map.
-  Loader_block->UEFI_Version = UEFIVer;
-  Loader_block->Bootloader_MajorVersion = MAJOR_VER;
-  Loader_block->Bootloader_MinorVersion = MINOR_VER;
-
+  // This shouldn't modify the memory map. The rest of the loader block was filled in before ExitBootServices().
   Loader_block->Memory_Map_Descriptor_Version = MemMapDescriptorVersion;
   Loader_block->Memory_Map_Descriptor_Size = MemMapDescriptorSize;
   Loader_block->Memory_Map = MemMap;
   Loader_block->Memory_Map_Size = MemMapSize;
 
-  Loader_block->Kernel_BaseAddress = KernelBaseAddress;
-  Loader_block->Kernel_Pages = KernelPages;
+#ifdef RUNTIME_VIRTUAL_MAP_ENABLED
+  // Has to happen before the memory map gets copied into the handoff, since it fills in the runtime descriptors' VirtualStart
+  ApplyRuntimeMap(RuntimeMap, MemMap, MemMapSize, MemMapDescriptorSize, MemMapDescriptorVersion);
+#endif
 
-  Loader_block->ESP_Root_Device_Path = ESPRoot;
-  Loader_block->ESP_Root_Size = ESPRootSize;
-  Loader_block->Kernel_Path = KernelPath;
-  Loader_block->Kernel_Path_Size = KernelPathSize;
-  Loader_block->Kernel_Options = Cmdline;
-  Loader_block->Kernel_Options_Size = CmdlineSize;
+  // No more boot services, so this just reads the final memory map and the ACPI tables
+  BuildMemoryTierTable(TierTable, MemMap, MemMapSize, MemMapDescriptorSize);
 
-  Loader_block->RTServices = RT;
-  Loader_block->GPU_Configs = Graphics;
-  Loader_block->FileMeta = FileInfo;
+  // Copy the final memory map and tier table into the handoff buffer
+  FinishHandoff(Handoff, Loader_block, ExitBootServicesStartTsc, ExitBootServicesCallTsc, ExitBootServicesTsc, ExitBootServicesAttempts);
 
-  Loader_block->ConfigTables = SysCfgTables;
-  Loader_block->Number_of_ConfigTables = NumSysCfgTables;
+#ifdef LOADER_PAGE_TABLES_ENABLED
+  // Everything the loader still touches is identity mapped, so it's safe to switch over here
+  if(PageTableRoot != 0)
+  {
+    LoadPageTables(PageTableRoot);
+  }
+#endif
+
+#ifdef AP_PARKING_ENABLED
+  // Catch APs that firmware took back at ExitBootServices(), and move the rest onto the loader's page tables
+  if(ApParking != NULL)
+  {
+    CheckParkedApplicationProcessors(ApParking, PageTableRoot);
+  }
+#endif
+
+#ifdef FRAMEBUFFER_WRITE_COMBINING_ENABLED
+  // MTRRs and the PAT only change once firmware is gone, so it can't change them back
+  ApplyFrameBufferCaching(Graphics);
+#endif
+
+#ifdef CPU_FEATURES_ENABLED
+  // Last thing before the jump, so the loader never runs with state firmware didn't set up
+  EnableCpuFeatures(CpuFeatures);
+#endif
+
+#ifdef LOADER_LOG_SERIAL_ENABLED
+  // The kernel takes over the UART from here
+  FlushLoaderLogSerial();
+#endif
 
   // Jump to entry point, and WE ARE LIVE!!
+#ifdef LOADER_ENTRY_STATE_ENABLED
+  // New descriptors and stack, and the arguments go in the registers for both ABIs
+  LoadEntryState(EntryState);
+  StampKernelEntry(Handoff);
+  JumpToKernel(Header_memory, Loader_block, Handoff, EntryState->StackTop);
+#else
+  StampKernelEntry(Handoff);
   if(KernelisPE)
   {
-    typedef void (__attribute__((ms_abi)) *EntryPointFunction)(LOADER_PARAMS * LP); // Placeholder names for jump
+    typedef void (__attribute__((ms_abi)) *EntryPointFunction)(LOADER_PARAMS * LP, LOADER_HANDOFF_HEADER * Handoff); // Placeholder names for jump
     EntryPointFunction EntryPointPlaceholder = (EntryPointFunction)(Header_memory);
-    EntryPointPlaceholder(Loader_block);
+    EntryPointPlaceholder(Loader_block, Handoff);
   }
   else
   {
-    typedef void (__attribute__((sysv_abi)) *EntryPointFunction)(LOADER_PARAMS * LP); // Placeholder names for jump
+    typedef void (__attribute__((sysv_abi)) *EntryPointFunction)(LOADER_PARAMS * LP, LOADER_HANDOFF_HEADER * Handoff); // Placeholder names for jump
     EntryPointFunction EntryPointPlaceholder = (EntryPointFunction)(Header_memory);
-    EntryPointPlaceholder(Loader_block);
+    EntryPointPlaceholder(Loader_block, Handoff);
   }
+#endif
 
   // Should never get here
   return GoTimeStatus;
@@ -0,0 +1,762 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Loader Log Functions
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This file contains the loader's log: a ring buffer of timestamped, leveled text records that the kernel gets in the handoff, so it
+// can show what the loader did (dmesg-style) without anyone having to watch the screen or press keys during boot.
+//
+// Each subsystem (LOADER_LOG_SUBSYSTEM_*) has its own level, set at runtime. Messages are logged with LOG_MESSAGE(), which only costs a
+// test of LoaderLogMask when that subsystem's level is off.
+//
+// With LOADER_LOG_SERIAL_ENABLED, records also go out over a 16550 UART (or EFI_SERIAL_IO_PROTOCOL) as text lines, batched so the
+// UART gets a full FIFO's worth at a time instead of one polled character at a time.
+//
+// NOTE: LoaderLog() doesn't call boot services unless it's mirroring to the console or EFI_SERIAL_IO_PROTOCOL, so it also works after
+// ExitBootServices(). It's not safe to call from APs.
+//
+
+#include "Bootloader.h"
+
+#define LOG_LEVELS_UP_TO(Level) ((2U << (Level)) - 1) // Mask bits of Level and everything more severe, for subsystem 0
+
+UINT32 LoaderLogMask = 0; // Nothing gets logged until InitLoaderLog()
+
+STATIC LOADER_LOG * Log = NULL;
+STATIC UINT8 LogConsole = 0;
+STATIC UINT32 LogConsoleLevel = LOADER_LOG_CONSOLE_LEVEL;
+
+STATIC EFI_GUID LoaderVariableGuid = LOADER_VARIABLE_GUID;
+
+STATIC CONST CHAR16 * LogSubsystemNames[LOADER_LOG_SUBSYSTEMS] = {L"main", L"gop", L"loader", L"pe", L"elf", L"macho", L"memory", L"handoff"};
+STATIC CONST CHAR16 * LogLevelNames[LOADER_LOG_DEBUG + 1] = {L"error", L"warning", L"info", L"debug"};
+
+#ifdef LOADER_LOG_SERIAL_ENABLED
+
+// 16550 registers, numbered before LOADER_LOG_SERIAL_MMIO_SHIFT is applied
+#define UART_DATA               0 // Divisor low byte while UART_LCR_DIVISOR_LATCH is set
+#define UART_INTERRUPT_ENABLE   1 // Divisor high byte while UART_LCR_DIVISOR_LATCH is set
+#define UART_FIFO_CONTROL       2 // Interrupt identification when read
+#define UART_LINE_CONTROL       3
+#define UART_MODEM_CONTROL      4
+#define UART_LINE_STATUS        5
+
+#define UART_LCR_8N1            0x03
+#define UART_LCR_DIVISOR_LATCH  0x80
+#define UART_MCR_DTR_RTS        0x03
+#define UART_FCR_ENABLE_CLEAR   0x07
+#define UART_IIR_FIFO_ENABLED   0xC0 // Both bits set means a working 16-byte FIFO (16550A and later)
+#define UART_LSR_THR_EMPTY      0x20 // The whole transmit FIFO is empty, not just one slot of it
+#define UART_FIFO_DEPTH         16
+#define UART_TIMEOUT            100000 // Line status polls before deciding there's no UART there
+
+#define LOG_SERIAL_LINE_MAX     (sizeof(((LOADER_LOG_RECORD*)0)->Text) + 48) // Timestamp, names and line break included
+
+STATIC CHAR8 LogSerialBatch[LOADER_LOG_SERIAL_BATCH];
+STATIC UINT32 LogSerialLength = 0;
+STATIC UINT8 LogSerial = 0; // Whether there's anywhere to send records
+STATIC UINT64 LogSerialTicksPerMicrosecond = 1;
+
+#ifdef LOADER_LOG_SERIAL_IO_ENABLED
+STATIC EFI_SERIAL_IO_PROTOCOL * LogSerialIo = NULL;
+#else
+STATIC UINT32 LogSerialBurst = 1; // Bytes sent per wait for the transmitter to empty out
+#endif
+
+#endif
+
+#ifdef LOADER_LOG_SERIAL_ENABLED
+
+#ifndef LOADER_LOG_SERIAL_IO_ENABLED
+
+//==================================================================================================================================
+//  LogUartRead/LogUartWrite: Access A 16550 Register
+//==================================================================================================================================
+//
+// At I/O port LOADER_LOG_SERIAL_PORT + Register, or in memory at LOADER_LOG_SERIAL_MMIO if the port is 0.
+//
+
+STATIC UINT8 LogUartRead(UINT32 Register)
+{
+#if LOADER_LOG_SERIAL_PORT != 0
+  return IoRead8((UINT16)(LOADER_LOG_SERIAL_PORT + Register));
+#elif LOADER_LOG_SERIAL_MMIO_SHIFT >= 2
+  return (UINT8)*(volatile UINT32*)(LOADER_LOG_SERIAL_MMIO + ((UINT64)Register << LOADER_LOG_SERIAL_MMIO_SHIFT));
+#else
+  return *(volatile UINT8*)(LOADER_LOG_SERIAL_MMIO + ((UINT64)Register << LOADER_LOG_SERIAL_MMIO_SHIFT));
+#endif
+}
+
+STATIC VOID LogUartWrite(UINT32 Register, UINT8 Value)
+{
+#if LOADER_LOG_SERIAL_PORT != 0
+  IoWrite8((UINT16)(LOADER_LOG_SERIAL_PORT + Register), Value);
+#elif LOADER_LOG_SERIAL_MMIO_SHIFT >= 2
+  *(volatile UINT32*)(LOADER_LOG_SERIAL_MMIO + ((UINT64)Register << LOADER_LOG_SERIAL_MMIO_SHIFT)) = Value;
+#else
+  *(volatile UINT8*)(LOADER_LOG_SERIAL_MMIO + ((UINT64)Register << LOADER_LOG_SERIAL_MMIO_SHIFT)) = Value;
+#endif
+}
+
+#endif
+
+//==================================================================================================================================
+//  InitLogSerial: Set Up The Serial Log Output
+//==================================================================================================================================
+//
+// Program the UART for LOADER_LOG_SERIAL_BAUD 8N1 with its FIFOs on, or find firmware's EFI_SERIAL_IO_PROTOCOL with
+// LOADER_LOG_SERIAL_IO_ENABLED. Also gets the TSC frequency for the timestamps, which may need boot services the first time.
+//
+
+STATIC VOID InitLogSerial(VOID)
+{
+  LogSerialTicksPerMicrosecond = GetTscFrequency() / 1000000;
+  if(LogSerialTicksPerMicrosecond == 0)
+  {
+    LogSerialTicksPerMicrosecond = 1;
+  }
+
+#ifdef LOADER_LOG_SERIAL_IO_ENABLED
+  if(EFI_ERROR(BS->LocateProtocol(&SerialIoProtocol, NULL, (void**)&LogSerialIo)))
+  {
+    Print(L"No serial port for the loader log.\r\n");
+    LogSerialIo = NULL;
+    return;
+  }
+
+#if LOADER_LOG_SERIAL_BAUD != 0
+  // 0 means the default for everything else
+  LogSerialIo->SetAttributes(LogSerialIo, LOADER_LOG_SERIAL_BAUD, 0, 0, DefaultParity, 0, DefaultStopBits);
+#endif
+#else
+#if LOADER_LOG_SERIAL_BAUD != 0
+  UINT32 Divisor = LOADER_LOG_SERIAL_CLOCK / (16 * LOADER_LOG_SERIAL_BAUD);
+
+  LogUartWrite(UART_INTERRUPT_ENABLE, 0x00); // Polled, so no interrupts
+  LogUartWrite(UART_LINE_CONTROL, UART_LCR_DIVISOR_LATCH);
+  LogUartWrite(UART_DATA, (UINT8)Divisor);
+  LogUartWrite(UART_INTERRUPT_ENABLE, (UINT8)(Divisor >> 8));
+  LogUartWrite(UART_LINE_CONTROL, UART_LCR_8N1);
+  LogUartWrite(UART_MODEM_CONTROL, UART_MCR_DTR_RTS);
+#endif
+
+  // An 8250 or 16450 has no FIFO, so it only takes one byte at a time
+  LogUartWrite(UART_FIFO_CONTROL, UART_FCR_ENABLE_CLEAR);
+  if((LogUartRead(UART_FIFO_CONTROL) & UART_IIR_FIFO_ENABLED) == UART_IIR_FIFO_ENABLED)
+  {
+    LogSerialBurst = UART_FIFO_DEPTH;
+  }
+#endif
+
+  LogSerial = 1;
+}
+
+//==================================================================================================================================
+//  FlushLoaderLogSerial: Send Out The Batched Log Records
+//==================================================================================================================================
+//
+// This waits until all but the last FIFO's worth has gone out over the wire. Nothing else sends the last batch, so this has to be
+// called right before jumping to the kernel, and right before ExitBootServices() with LOADER_LOG_SERIAL_IO_ENABLED.
+//
+
+VOID FlushLoaderLogSerial(VOID)
+{
+  if(!LogSerial || (LogSerialLength == 0))
+  {
+    LogSerialLength = 0;
+    return;
+  }
+
+#ifdef LOADER_LOG_SERIAL_IO_ENABLED
+  UINTN Size = LogSerialLength;
+  LogSerialIo->Write(LogSerialIo, &Size, LogSerialBatch);
+#else
+  for(UINT32 Sent = 0; Sent < LogSerialLength; )
+  {
+    UINT32 Timeout = UART_TIMEOUT;
+    while(!(LogUartRead(UART_LINE_STATUS) & UART_LSR_THR_EMPTY))
+    {
+      if(--Timeout == 0)
+      {
+        // Nothing's taking the bytes, so don't hold up the rest of the boot on every record
+        LogSerial = 0;
+        break;
+      }
+      CpuPause();
+    }
+    if(!LogSerial)
+    {
+      break;
+    }
+
+    // The FIFO is empty, so it can take a whole burst without checking again
+    for(UINT32 Burst = 0; (Burst < LogSerialBurst) && (Sent < LogSerialLength); Burst++)
+    {
+      LogUartWrite(UART_DATA, (UINT8)LogSerialBatch[Sent++]);
+    }
+  }
+#endif
+
+  LogSerialLength = 0;
+}
+
+//==================================================================================================================================
+//  LogSerialDecimal: Put A Number In The Serial Batch
+//==================================================================================================================================
+//
+// Write Value in decimal at Out, padded on the left with Pad to at least Width characters, and return how many characters that took.
+//
+
+STATIC UINT32 LogSerialDecimal(CHAR8 * Out, UINT64 Value, UINT32 Width, CHAR8 Pad)
+{
+  CHAR8 Digits[24];
+  UINT32 Count = 0;
+
+  do {
+    Digits[Count++] = '0' + (Value % 10);
+    Value /= 10;
+  } while(Value != 0);
+
+  for(; (Count < Width) && (Count < sizeof(Digits)); Count++)
+  {
+    Digits[Count] = Pad;
+  }
+
+  for(UINT32 k = 0; k < Count; k++)
+  {
+    Out[k] = Digits[Count - 1 - k];
+  }
+
+  return Count;
+}
+
+//==================================================================================================================================
+//  LogSerialRecord: Add A Record To The Serial Batch
+//==================================================================================================================================
+//
+// Records become lines like "[    1.234567] gop: info: text", timed from the start of the loader. Errors and warnings flush the batch
+// right away, so that they're out before whatever goes wrong next.
+//
+
+STATIC VOID LogSerialRecord(CONST LOADER_LOG_RECORD * Record)
+{
+  if(!LogSerial)
+  {
+    return;
+  }
+
+  if(LogSerialLength + LOG_SERIAL_LINE_MAX > sizeof(LogSerialBatch))
+  {
+    FlushLoaderLogSerial();
+  }
+
+  UINT64 Microseconds = (Record->Tsc - LoaderStartTsc) / LogSerialTicksPerMicrosecond;
+  CHAR8 * Out = &LogSerialBatch[LogSerialLength];
+  UINT32 Length = 0;
+
+  Out[Length++] = '[';
+  Length += LogSerialDecimal(&Out[Length], Microseconds / 1000000, 5, ' ');
+  Out[Length++] = '.';
+  Length += LogSerialDecimal(&Out[Length], Microseconds % 1000000, 6, '0');
+  Out[Length++] = ']';
+  Out[Length++] = ' ';
+
+  for(CONST CHAR16 * Name = LogSubsystemNames[Record->Subsystem]; *Name != L'\0'; Name++)
+  {
+    Out[Length++] = (CHAR8)*Name;
+  }
+  Out[Length++] = ':';
+  Out[Length++] = ' ';
+  for(CONST CHAR16 * Name = LogLevelNames[Record->Level]; *Name != L'\0'; Name++)
+  {
+    Out[Length++] = (CHAR8)*Name;
+  }
+  Out[Length++] = ':';
+  Out[Length++] = ' ';
+
+  for(UINT32 k = 0; k < Record->Length; k++)
+  {
+    Out[Length++] = Record->Text[k];
+  }
+  Out[Length++] = '\r';
+  Out[Length++] = '\n';
+
+  LogSerialLength += Length;
+
+  if(Record->Level <= LOADER_LOG_WARNING)
+  {
+    FlushLoaderLogSerial();
+  }
+}
+
+#endif
+
+//==================================================================================================================================
+//  InitLoaderLog: Allocate The Log Ring Buffer
+//==================================================================================================================================
+//
+// Allocate LOADER_LOG_SIZE_KB for the log and set each subsystem's starting level from LOADER_LOG_DEFAULT_LEVELS in Bootloader.h.
+// Then apply the LoaderLog UEFI variable, if there is one. Until this runs (or if it fails), nothing gets logged.
+//
+
+EFI_STATUS InitLoaderLog(VOID)
+{
+  EFI_STATUS log_status;
+  UINT32 NumberOfRecords = ((LOADER_LOG_SIZE_KB << 10) - sizeof(LOADER_LOG)) / sizeof(LOADER_LOG_RECORD);
+  UINT64 LogSize = sizeof(LOADER_LOG) + NumberOfRecords * sizeof(LOADER_LOG_RECORD);
+
+  log_status = BS->AllocatePool(EfiLoaderData, LogSize, (void**)&Log);
+  if(EFI_ERROR(log_status))
+  {
+    Print(L"Error allocating loader log. 0x%llx\r\n", log_status);
+    Log = NULL;
+    return log_status;
+  }
+
+  ZeroMem(Log, LogSize);
+  Log->NumberOfRecords = NumberOfRecords;
+
+#ifdef LOADER_LOG_CONSOLE_ENABLED
+  LogConsole = 1;
+#endif
+
+  SetLoaderLogLevels(LOADER_LOG_DEFAULT_LEVELS, sizeof(LOADER_LOG_DEFAULT_LEVELS) / sizeof(CHAR16));
+
+#ifdef LOADER_LOG_SERIAL_ENABLED
+  InitLogSerial();
+#endif
+
+  CHAR16 Settings[128];
+  UINTN SettingsSize = sizeof(Settings);
+  if(!EFI_ERROR(RT->GetVariable(L"LoaderLog", &LoaderVariableGuid, NULL, &SettingsSize, Settings)))
+  {
+    SetLoaderLogLevels(Settings, SettingsSize / sizeof(CHAR16));
+  }
+
+  return EFI_SUCCESS;
+}
+
+//==================================================================================================================================
+//  LogNameMatches: Compare A Setting With A Name
+//==================================================================================================================================
+//
+// Returns 1 if the Length characters at Text are Name, ignoring case. Name is lowercase and null-terminated; Text doesn't need to be.
+//
+
+STATIC UINT8 LogNameMatches(CONST CHAR16 * Text, UINT64 Length, CONST CHAR16 * Name)
+{
+  UINT64 k;
+
+  for(k = 0; k < Length; k++)
+  {
+    CHAR16 Character = Text[k];
+    if((Character >= L'A') && (Character <= L'Z'))
+    {
+      Character += L'a' - L'A';
+    }
+
+    if(Character != Name[k]) // Also catches Name being shorter
+    {
+      return 0;
+    }
+  }
+
+  return (Name[k] == L'\0');
+}
+
+//==================================================================================================================================
+//  SetLoaderLogLevels: Change Log Levels At Runtime
+//==================================================================================================================================
+//
+// Apply a comma-separated list of [subsystem:]level settings, left to right, stopping at a space, a null or Length characters. The
+// levels are off, error, warning, info and debug, and each one includes the ones before it. The subsystems are main, gop, loader, pe,
+// elf, macho, memory and handoff; no subsystem (or "all") means all of them. E.g. "info,gop:debug,memory:off". Anything else gets
+// skipped with a warning.
+//
+
+VOID SetLoaderLogLevels(CONST CHAR16 * Settings, UINT64 Length)
+{
+  UINT64 Start = 0;
+
+  while(Start < Length)
+  {
+    UINT64 End = Start;
+    UINT64 Colon = Length;
+
+    while((End < Length) && (Settings[End] != L',') && (Settings[End] != L' ') && (Settings[End] != L'\0'))
+    {
+      if((Settings[End] == L':') && (Colon == Length))
+      {
+        Colon = End;
+      }
+      End++;
+    }
+
+    UINT32 FirstSubsystem = 0;
+    UINT32 LastSubsystem = LOADER_LOG_SUBSYSTEMS - 1;
+    UINT64 LevelStart = Start;
+
+    if(Colon < End)
+    {
+      LevelStart = Colon + 1;
+
+      if(!LogNameMatches(&Settings[Start], Colon - Start, L"all"))
+      {
+        for(FirstSubsystem = 0; FirstSubsystem < LOADER_LOG_SUBSYSTEMS; FirstSubsystem++)
+        {
+          if(LogNameMatches(&Settings[Start], Colon - Start, LogSubsystemNames[FirstSubsystem]))
+          {
+            break;
+          }
+        }
+        LastSubsystem = FirstSubsystem;
+      }
+    }
+
+    UINT32 Levels = LOG_LEVELS_UP_TO(LOADER_LOG_DEBUG) + 1; // Not a valid mask, so it marks an unknown level
+    if(LogNameMatches(&Settings[LevelStart], End - LevelStart, L"off"))
+    {
+      Levels = 0;
+    }
+    else
+    {
+      for(UINT32 Level = 0; Level <= LOADER_LOG_DEBUG; Level++)
+      {
+        if(LogNameMatches(&Settings[LevelStart], End - LevelStart, LogLevelNames[Level]))
+        {
+          Levels = LOG_LEVELS_UP_TO(Level);
+          break;
+        }
+      }
+    }
+
+    if((FirstSubsystem < LOADER_LOG_SUBSYSTEMS) && (Levels <= LOG_LEVELS_UP_TO(LOADER_LOG_DEBUG)))
+    {
+      for(UINT32 Subsystem = FirstSubsystem; Subsystem <= LastSubsystem; Subsystem++)
+      {
+        LoaderLogMask = (LoaderLogMask & ~(LOG_LEVELS_UP_TO(LOADER_LOG_DEBUG) << (Subsystem * 4))) | (Levels << (Subsystem * 4));
+      }
+    }
+    else if(End > Start)
+    {
+      LOG_MESSAGE(MAIN, WARNING, L"Unknown log setting at character %llu", Start);
+    }
+
+    if((End == Length) || (Settings[End] != L','))
+    {
+      break;
+    }
+    Start = End + 1;
+  }
+}
+
+//==================================================================================================================================
+//  GetLoaderLog: Get The Log For The Handoff
+//==================================================================================================================================
+//
+// Returns NULL if InitLoaderLog() failed.
+//
+
+LOADER_LOG * GetLoaderLog(VOID)
+{
+  return Log;
+}
+
+//==================================================================================================================================
+//  SetLogConsoleLevel: Print Less Of The Log To The Console
+//==================================================================================================================================
+//
+// Only records at Level or more severe get printed from now on, if that's fewer than LOADER_LOG_CONSOLE_LEVEL lets through. The
+// ring buffer and serial port still get everything.
+//
+
+VOID SetLogConsoleLevel(UINT32 Level)
+{
+  if(Level < LogConsoleLevel)
+  {
+    LogConsoleLevel = Level;
+  }
+}
+
+//==================================================================================================================================
+//  DetachLogConsole: Stop Mirroring The Log To The Console
+//==================================================================================================================================
+//
+// ConOut is gone after ExitBootServices(), so this has to be called right after it. Records still go into the ring buffer. The same
+// goes for EFI_SERIAL_IO_PROTOCOL; a UART the loader drives itself keeps going.
+//
+
+VOID DetachLogConsole(VOID)
+{
+  LogConsole = 0;
+
+#ifdef LOADER_LOG_SERIAL_IO_ENABLED
+  LogSerial = 0;
+  LogSerialLength = 0;
+#endif
+}
+
+//==================================================================================================================================
+//  LogFormat: Minimal Print() Formatting Straight To ASCII
+//==================================================================================================================================
+//
+// Format into Out (Size bytes, always null-terminated) and return the length. This understands the subset of Print()'s format syntax
+// the loader uses: flags '0' and '-', a width, 'l'/'ll'/'h'/'hh' size prefixes, and %d %i %u %x %X %p %c %s (CHAR16) %a (CHAR8) %r %%.
+// %r prints the status code in hex instead of looking up its name. Non-ASCII characters come out as '?'. It's a lot cheaper than
+// UnicodeVSPrint() into a CHAR16 buffer and converting that, which keeps each log record down to a few hundred cycles.
+//
+
+STATIC UINT32 LogFormat(CHAR8 * Out, UINT32 Size, CONST CHAR16 * Format, va_list Args)
+{
+  UINT32 Length = 0;
+  Size--; // Room for the null terminator
+
+  for(; (*Format != L'\0') && (Length < Size); Format++)
+  {
+    if(*Format != L'%')
+    {
+      // Each record is one line, so line breaks in the middle of a message turn into spaces
+      if(*Format == L'\n')
+      {
+        Out[Length++] = ' ';
+      }
+      else if(*Format != L'\r')
+      {
+        Out[Length++] = (*Format < 0x80) ? (CHAR8)*Format : '?';
+      }
+      continue;
+    }
+
+    Format++;
+
+    CHAR8 Pad = ' ';
+    UINT8 LeftAlign = 0;
+    UINT32 Width = 0;
+    UINT8 Long = 0;
+
+    for(; (*Format == L'0') || (*Format == L'-'); Format++)
+    {
+      if(*Format == L'0')
+      {
+        Pad = '0';
+      }
+      else
+      {
+        LeftAlign = 1;
+      }
+    }
+    for(; (*Format >= L'0') && (*Format <= L'9'); Format++)
+    {
+      Width = Width * 10 + (*Format - L'0');
+    }
+    for(; (*Format == L'l') || (*Format == L'h'); Format++)
+    {
+      if(*Format == L'l')
+      {
+        Long = 1;
+      }
+    }
+
+    CHAR8 Digits[24];
+    CONST CHAR8 * Text = Digits;
+    CONST CHAR16 * WideText = NULL;
+    UINT32 TextLength = 0;
+    UINT64 Value = 0;
+    UINT8 Numeric = 1;
+    UINT8 Negative = 0;
+    UINT32 Base = 10;
+    CONST CHAR8 * DigitChars = (CONST CHAR8*)"0123456789abcdef";
+
+    switch(*Format)
+    {
+      case L'd':
+      case L'i':
+        if(Long)
+        {
+          INT64 Signed = va_arg(Args, INT64);
+          Negative = (Signed < 0);
+          Value = Negative ? -(UINT64)Signed : (UINT64)Signed;
+        }
+        else
+        {
+          INT32 Signed = va_arg(Args, INT32);
+          Negative = (Signed < 0);
+          Value = Negative ? -(UINT64)(INT64)Signed : (UINT64)Signed;
+        }
+        break;
+      case L'X':
+        DigitChars = (CONST CHAR8*)"0123456789ABCDEF";
+        // Fall through
+      case L'x':
+        Base = 16;
+        // Fall through
+      case L'u':
+        Value = Long ? va_arg(Args, UINT64) : va_arg(Args, UINT32);
+        break;
+      case L'p':
+      case L'r':
+        Base = 16;
+        Value = va_arg(Args, UINT64);
+        break;
+      case L'c':
+        Numeric = 0;
+        Digits[0] = (CHAR8)va_arg(Args, UINT32);
+        if((UINT8)Digits[0] >= 0x80)
+        {
+          Digits[0] = '?';
+        }
+        TextLength = 1;
+        break;
+      case L'a':
+        Numeric = 0;
+        Text = va_arg(Args, CONST CHAR8*);
+        if(Text == NULL)
+        {
+          Text = (CONST CHAR8*)"(null)";
+        }
+        while(Text[TextLength] != '\0')
+        {
+          TextLength++;
+        }
+        break;
+      case L's':
+        Numeric = 0;
+        WideText = va_arg(Args, CONST CHAR16*);
+        if(WideText == NULL)
+        {
+          WideText = L"(null)";
+        }
+        while(WideText[TextLength] != L'\0')
+        {
+          TextLength++;
+        }
+        break;
+      case L'\0':
+        Format--; // Stray % at the end
+        continue;
+      default:
+        Numeric = 0;
+        Digits[0] = (*Format < 0x80) ? (CHAR8)*Format : '?'; // Includes %%
+        TextLength = 1;
+        break;
+    }
+
+    if(Numeric)
+    {
+      // Digits go in backwards from the end, so Text ends up pointing at the first one
+      CHAR8 * Digit = Digits + sizeof(Digits);
+      do {
+        *--Digit = DigitChars[Value % Base];
+        Value /= Base;
+      } while(Value != 0);
+
+      if(Negative)
+      {
+        if(Pad == '0')
+        {
+          // The sign goes before the zero padding
+          if(Length < Size)
+          {
+            Out[Length++] = '-';
+          }
+          if(Width > 0)
+          {
+            Width--;
+          }
+        }
+        else
+        {
+          *--Digit = '-';
+        }
+      }
+
+      Text = Digit;
+      TextLength = (UINT32)(Digits + sizeof(Digits) - Digit);
+    }
+
+    if(!LeftAlign)
+    {
+      for(; (Width > TextLength) && (Length < Size); Width--)
+      {
+        Out[Length++] = Pad;
+      }
+    }
+
+    for(UINT32 k = 0; (k < TextLength) && (Length < Size); k++)
+    {
+      if(WideText != NULL)
+      {
+        Out[Length++] = (WideText[k] < 0x80) ? (CHAR8)WideText[k] : '?';
+      }
+      else
+      {
+        Out[Length++] = Text[k];
+      }
+    }
+
+    for(; (Width > TextLength) && (Length < Size); Width--)
+    {
+      Out[Length++] = ' ';
+    }
+  }
+
+  Out[Length] = '\0';
+  return Length;
+}
+
+//==================================================================================================================================
+//  LoaderLog: Add A Record To The Log
+//==================================================================================================================================
+//
+// Format a message (with Print()'s syntax, minus the parts LogFormat() leaves out) into the next record of the ring buffer, overwriting
+// the oldest one if it's full. Line breaks become spaces and trailing ones get dropped, since each record is one line. Messages longer
+// than a record get cut short. With LOADER_LOG_CONSOLE_ENABLED, records at LOADER_LOG_CONSOLE_LEVEL (or SetLogConsoleLevel()'s level)
+// or more severe also get printed, until DetachLogConsole(). With LOADER_LOG_SERIAL_ENABLED, records at LOADER_LOG_SERIAL_LEVEL or more
+// severe get batched up for the serial port. This doesn't check LoaderLogMask; use LOG_MESSAGE() instead of calling it directly.
+//
+
+VOID LoaderLog(UINT32 Subsystem, UINT32 Level, CONST CHAR16 * Format, ...)
+{
+  if(Log == NULL)
+  {
+    return;
+  }
+
+  UINT64 Tsc = ReadTsc();
+  LOADER_LOG_RECORD * Record = &Log->Records[Log->NextSequence % Log->NumberOfRecords];
+
+  va_list Args;
+  va_start(Args, Format);
+  UINT32 Length = LogFormat(Record->Text, sizeof(Record->Text), Format, Args);
+  va_end(Args);
+
+  while((Length > 0) && (Record->Text[Length - 1] == ' '))
+  {
+    Record->Text[--Length] = '\0';
+  }
+
+  Record->Tsc = Tsc;
+  Record->Level = (UINT8)Level;
+  Record->Subsystem = (UINT8)Subsystem;
+  Record->Length = (UINT16)Length;
+  Log->NextSequence++;
+
+  if(LogConsole && (Level <= LogConsoleLevel))
+  {
+    Print(L"%a\r\n", Record->Text);
+  }
+
+#ifdef LOADER_LOG_SERIAL_ENABLED
+  if(Level <= LOADER_LOG_SERIAL_LEVEL)
+  {
+    LogSerialRecord(Record);
+  }
+#endif
+}
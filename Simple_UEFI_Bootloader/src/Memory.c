@@ -59,20 +59,41 @@ UINT8 VerifyZeroMem(UINT64 NumBytes, UINT64 BaseAddr) // BaseAddr is a 64-bit un
 }
 
 //==================================================================================================================================
-//  ActuallyFreeAddress: Find A Free Memory Address, Bottom-Up
+//  print_memmap: The Ultimate Debugging Tool
 //==================================================================================================================================
 //
-// This is meant to work in the event that AllocateAnyPages fails, but could have other uses. Returns the next EfiConventionalMemory
-// area that is > the supplied OldAddress.
+// Get the system memory map, parse it, and log it at MEMORY:DEBUG. Log the whole thing. It's a lot of records, so callers check
+// LOG_ENABLED(MEMORY, DEBUG) before getting the map at all.
 //
 
-EFI_PHYSICAL_ADDRESS ActuallyFreeAddress(UINT64 pages, EFI_PHYSICAL_ADDRESS OldAddress)
+// This array is a global variable so that it can be made static, which helps prevent a stack overflow if it ever needs to lengthen.
+STATIC CONST CHAR16 mem_types[16][27] = {
+      L"EfiReservedMemoryType     ",
+      L"EfiLoaderCode             ",
+      L"EfiLoaderData             ",
+      L"EfiBootServicesCode       ",
+      L"EfiBootServicesData       ",
+      L"EfiRuntimeServicesCode    ",
+      L"EfiRuntimeServicesData    ",
+      L"EfiConventionalMemory     ",
+      L"EfiUnusableMemory         ",
+      L"EfiACPIReclaimMemory      ",
+      L"EfiACPIMemoryNVS          ",
+      L"EfiMemoryMappedIO         ",
+      L"EfiMemoryMappedIOPortSpace",
+      L"EfiPalCode                ",
+      L"EfiPersistentMemory       ",
+      L"EfiMaxMemoryType          "
+};
+
+VOID print_memmap()
 {
   EFI_STATUS memmap_status;
   UINTN MemMapSize = 0, MemMapKey, MemMapDescriptorSize;
   UINT32 MemMapDescriptorVersion;
   EFI_MEMORY_DESCRIPTOR * MemMap = NULL;
   EFI_MEMORY_DESCRIPTOR * Piece;
+  UINT16 line = 0;
 
   memmap_status = BS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
   if(memmap_status == EFI_BUFFER_TOO_SMALL)
@@ -81,198 +102,1042 @@ EFI_PHYSICAL_ADDRESS ActuallyFreeAddress(UINT64 pages, EFI_PHYSICAL_ADDRESS OldA
     memmap_status = BS->AllocatePool(EfiBootServicesData, MemMapSize, (void **)&MemMap); // Allocate pool for MemMap
     if(EFI_ERROR(memmap_status)) // Error! Wouldn't be safe to continue.
     {
-      Print(L"ActuallyFreeAddress MemMap AllocatePool error. 0x%llx\r\n", memmap_status);
-      return ~0ULL;
+      Print(L"MemMap AllocatePool error. 0x%llx\r\n", memmap_status);
+      return;
     }
     memmap_status = BS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
   }
   if(EFI_ERROR(memmap_status))
   {
-    Print(L"Error getting memory map for ActuallyFreeAddress. 0x%llx\r\n", memmap_status);
-    return ~0ULL;
+    Print(L"Error getting memory map for printing. 0x%llx\r\n", memmap_status);
+    if(MemMap != NULL)
+    {
+      BS->FreePool(MemMap);
+    }
+    return;
   }
 
-  // Multiply NumberOfPages by EFI_PAGE_SIZE to get the end address... which should just be the start of the next section.
-  // Check for EfiConventionalMemory in the map
+  LOG_MESSAGE(MEMORY, DEBUG, L"MemMapSize: %llu, MemMapDescriptorSize: %llu, MemMapDescriptorVersion: 0x%x", MemMapSize, MemMapDescriptorSize, MemMapDescriptorVersion);
+  LOG_MESSAGE(MEMORY, DEBUG, L"#   Memory Type                Phys Addr Start   Num Of Pages   Attr");
+
+  // There's no virtual addressing yet, so there's no need to see Piece->VirtualStart
+  // Multiply NumOfPages by EFI_PAGE_SIZE or do (NumOfPages << EFI_PAGE_SHIFT) to get the end address... which should just be the start of the next section.
   for(Piece = MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
   {
-    // Within each compatible EfiConventionalMemory, look for space
-    if((Piece->Type == EfiConventionalMemory) && (Piece->NumberOfPages >= pages) && (Piece->PhysicalStart > OldAddress))
-    {
-      break;
-    }
+    UINT32 Type = (Piece->Type < EfiMaxMemoryType) ? Piece->Type : EfiMaxMemoryType; // OEM and OS types get the last name
+
+    LOG_MESSAGE(MEMORY, DEBUG, L"%2hu: %s 0x%016llx 0x%llx 0x%llx", line, mem_types[Type], Piece->PhysicalStart, Piece->NumberOfPages, Piece->Attribute);
+    line++;
   }
 
-  // Loop ended without a DiscoveredAddress
-  if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize))
+  memmap_status = BS->FreePool(MemMap);
+  if(EFI_ERROR(memmap_status))
   {
-    // Return address -1, which will cause AllocatePages to fail
-#ifdef MEMORY_CHECK_INFO
-    Print(L"No more free addresses...\r\n");
-#endif
-    return ~0ULL;
+    Print(L"Error freeing print_memmap pool. 0x%llx\r\n", memmap_status);
+  }
+}
+
+//==================================================================================================================================
+//  GetMemoryMapCopy: Take A Snapshot Of The Memory Map
+//==================================================================================================================================
+//
+// Allocate a pool and fill it with the current memory map, for functions that just need to look at it. The map key is thrown away since
+// the snapshot is out of date as soon as anything gets allocated. The caller frees the pool with BS->FreePool().
+//
+
+EFI_STATUS GetMemoryMapCopy(EFI_MEMORY_DESCRIPTOR ** MemMap, UINTN * MemMapSize, UINTN * MemMapDescriptorSize)
+{
+  EFI_STATUS memmap_status;
+  UINTN MemMapKey;
+  UINT32 MemMapDescriptorVersion;
+
+  *MemMap = NULL;
+  *MemMapSize = 0;
+
+  memmap_status = BS->GetMemoryMap(MemMapSize, *MemMap, &MemMapKey, MemMapDescriptorSize, &MemMapDescriptorVersion);
+  while(memmap_status == EFI_BUFFER_TOO_SMALL)
+  {
+    if(*MemMap != NULL)
+    {
+      BS->FreePool(*MemMap);
+    }
+
+    *MemMapSize += 2 * (*MemMapDescriptorSize); // Allocating the pool can split a descriptor or two
+    memmap_status = BS->AllocatePool(EfiBootServicesData, *MemMapSize, (void **)MemMap);
+    if(EFI_ERROR(memmap_status))
+    {
+      Print(L"MemMap copy AllocatePool error. 0x%llx\r\n", memmap_status);
+      *MemMap = NULL;
+      return memmap_status;
+    }
+
+    memmap_status = BS->GetMemoryMap(MemMapSize, *MemMap, &MemMapKey, MemMapDescriptorSize, &MemMapDescriptorVersion);
   }
 
-  memmap_status = BS->FreePool(MemMap);
   if(EFI_ERROR(memmap_status))
   {
-    Print(L"Error freeing ActuallyFreeAddress memmap pool. 0x%llx\r\n", memmap_status);
+    Print(L"Error getting memory map copy. 0x%llx\r\n", memmap_status);
+    if(*MemMap != NULL)
+    {
+      BS->FreePool(*MemMap);
+      *MemMap = NULL;
+    }
   }
 
-  return Piece->PhysicalStart;
+  return memmap_status;
 }
 
 //==================================================================================================================================
-//  ActuallyFreeAddressByPage: Find A Free Memory Address, Bottom-Up, The Hard Way
+//  AllocateMemoryTierTable: Reserve Space For The Memory Tier Table
 //==================================================================================================================================
 //
-// This is meant to work in the event that AllocateAnyPages fails, but could have other uses. Returns the next page address marked as
-// free (EfiConventionalMemory) that is > the supplied OldAddress.
+// The tier table gets filled in from the final memory map, which only exists after ExitBootServices(). Nothing can be allocated at that
+// point, so this allocates enough entries ahead of time for every descriptor in the current map, every runtime range in the memory
+// attributes table, every SRAT range boundary, and some slack for the descriptors that get added between now and ExitBootServices().
 //
 
-EFI_PHYSICAL_ADDRESS ActuallyFreeAddressByPage(UINT64 pages, EFI_PHYSICAL_ADDRESS OldAddress)
+#define MEMORY_TIER_SLACK_ENTRIES 64
+
+STATIC EFI_GUID MemoryAttributesTableGuid = EFI_MEMORY_ATTRIBUTES_TABLE_GUID;
+
+EFI_STATUS AllocateMemoryTierTable(MEMORY_TIER_TABLE ** TierTable)
 {
   EFI_STATUS memmap_status;
   UINTN MemMapSize = 0, MemMapKey, MemMapDescriptorSize;
   UINT32 MemMapDescriptorVersion;
-  EFI_MEMORY_DESCRIPTOR * MemMap = NULL;
-  EFI_MEMORY_DESCRIPTOR * Piece;
-  EFI_PHYSICAL_ADDRESS PhysicalEnd;
-  EFI_PHYSICAL_ADDRESS DiscoveredAddress;
+  UINT64 MaxEntries = MEMORY_TIER_SLACK_ENTRIES;
 
-  memmap_status = BS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
-  if(memmap_status == EFI_BUFFER_TOO_SMALL)
+  // Only need the size of the map, so this is supposed to fail with EFI_BUFFER_TOO_SMALL
+  memmap_status = BS->GetMemoryMap(&MemMapSize, NULL, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
+  if(memmap_status != EFI_BUFFER_TOO_SMALL)
   {
-    MemMapSize += MemMapDescriptorSize;
-    memmap_status = BS->AllocatePool(EfiBootServicesData, MemMapSize, (void **)&MemMap); // Allocate pool for MemMap
-    if(EFI_ERROR(memmap_status)) // Error! Wouldn't be safe to continue.
+    Print(L"Error getting memory map size for tier table. 0x%llx\r\n", memmap_status);
+    return memmap_status;
+  }
+  MaxEntries += MemMapSize / MemMapDescriptorSize;
+
+  EFI_MEMORY_ATTRIBUTES_TABLE * MemAttrTable = NULL;
+  if(!EFI_ERROR(LibGetSystemConfigurationTable(&MemoryAttributesTableGuid, (VOID**)&MemAttrTable)) && (MemAttrTable != NULL))
+  {
+    MaxEntries += MemAttrTable->NumberOfEntries;
+  }
+
+  ACPI_SRAT * SRAT = (ACPI_SRAT*)FindAcpiTable("SRAT", 0);
+  if(SRAT != NULL)
+  {
+    for(UINT8 * Sub = (UINT8*)SRAT + sizeof(ACPI_SRAT); Sub < (UINT8*)SRAT + SRAT->Header.Length; Sub += ((ACPI_SRAT_SUBTABLE_HEADER*)Sub)->Length)
     {
-      Print(L"ActuallyFreeAddressByPage MemMap AllocatePool error. 0x%llx\r\n", memmap_status);
-      return ~0ULL;
+      if(((ACPI_SRAT_SUBTABLE_HEADER*)Sub)->Length == 0) // Broken table
+      {
+        break;
+      }
+      if(((ACPI_SRAT_SUBTABLE_HEADER*)Sub)->Type == ACPI_SRAT_TYPE_MEMORY_AFFINITY)
+      {
+        MaxEntries += 2; // Each SRAT range can split a memory map range at both its start and its end
+      }
     }
-    memmap_status = BS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
   }
+
+  memmap_status = BS->AllocatePool(EfiLoaderData, sizeof(MEMORY_TIER_TABLE) + MaxEntries * sizeof(MEMORY_TIER_ENTRY), (void**)TierTable);
   if(EFI_ERROR(memmap_status))
   {
-    Print(L"Error getting memory map for ActuallyFreeAddressByPage. 0x%llx\r\n", memmap_status);
-    return ~0ULL;
+    Print(L"Memory tier table AllocatePool error. 0x%llx\r\n", memmap_status);
+    return memmap_status;
   }
 
-  // Multiply NumberOfPages by EFI_PAGE_SIZE to get the end address... which should just be the start of the next section.
-  // Check for EfiConventionalMemory in the map
+  (*TierTable)->NumberOfEntries = 0;
+  (*TierTable)->MaxEntries = (UINT32)MaxEntries;
+  (*TierTable)->Flags = 0;
+
+  return memmap_status;
+}
+
+//==================================================================================================================================
+//  BuildMemoryTierTable: Classify RAM Into Tiers
+//==================================================================================================================================
+//
+// Sort every RAM-backed range of the memory map into one of the MEMORY_TIER_* tiers, tag it with its SRAT proximity domain, and attach
+// the best read latency and bandwidth the HMAT reports for that domain. If firmware installed an EFI_MEMORY_ATTRIBUTES_TABLE, its
+// (finer-grained) runtime ranges replace the memory map's runtime ranges so that the RO/XP attributes come along too. The attributes
+// table only has permission bits, so everything else (cacheability included) still comes from the memory map range it's part of.
+//
+// This is meant to be called after ExitBootServices() on the final memory map, so it must not use any boot services.
+//
+
+// Returns 0 if the range isn't RAM, i.e. it's MMIO, unusable, or reserved for who-knows-what
+STATIC UINT8 ClassifyMemoryTier(UINT32 Type, UINT64 Attribute, UINT32 * Tier)
+{
+  switch(Type)
+  {
+    case EfiLoaderCode:
+    case EfiLoaderData:
+    case EfiBootServicesCode:
+    case EfiBootServicesData:
+    case EfiRuntimeServicesCode:
+    case EfiRuntimeServicesData:
+    case EfiConventionalMemory:
+    case EfiACPIReclaimMemory:
+    case EfiACPIMemoryNVS:
+    case EfiPersistentMemory:
+      break;
+    case EfiReservedMemoryType: // Some firmware reports specific-purpose memory as reserved so that old OSes leave it alone
+      if(Attribute & EFI_MEMORY_SP)
+      {
+        break;
+      }
+      return 0;
+    default:
+      return 0;
+  }
+
+  if((Type == EfiPersistentMemory) || (Attribute & EFI_MEMORY_NV))
+  {
+    *Tier = MEMORY_TIER_PERSISTENT;
+  }
+  else if(Attribute & EFI_MEMORY_SP)
+  {
+    *Tier = MEMORY_TIER_SPECIFIC_PURPOSE;
+  }
+  else if(!(Attribute & EFI_MEMORY_WB))
+  {
+    *Tier = MEMORY_TIER_UNCACHED;
+  }
+  else
+  {
+    *Tier = MEMORY_TIER_DRAM;
+  }
+
+  return 1;
+}
+
+// Append a range to the table, splitting it wherever it crosses an SRAT memory affinity boundary
+STATIC VOID AddMemoryTierRange(MEMORY_TIER_TABLE * TierTable, ACPI_SRAT * SRAT, EFI_PHYSICAL_ADDRESS Start, UINT64 Pages, UINT64 Attribute, UINT32 Tier)
+{
+  EFI_PHYSICAL_ADDRESS End = Start + (Pages << EFI_PAGE_SHIFT);
+
+  while(Start < End)
+  {
+    EFI_PHYSICAL_ADDRESS SegmentEnd = End;
+    UINT32 Domain = MEMORY_TIER_NO_DOMAIN;
+    UINT32 SegmentTier = Tier;
+
+    if(SRAT != NULL)
+    {
+      for(UINT8 * Sub = (UINT8*)SRAT + sizeof(ACPI_SRAT); Sub < (UINT8*)SRAT + SRAT->Header.Length; Sub += ((ACPI_SRAT_SUBTABLE_HEADER*)Sub)->Length)
+      {
+        if(((ACPI_SRAT_SUBTABLE_HEADER*)Sub)->Length == 0)
+        {
+          break;
+        }
+
+        ACPI_SRAT_MEMORY_AFFINITY * Affinity = (ACPI_SRAT_MEMORY_AFFINITY*)Sub;
+        if((Affinity->Type != ACPI_SRAT_TYPE_MEMORY_AFFINITY) || !(Affinity->Flags & ACPI_SRAT_MEM_ENABLED))
+        {
+          continue;
+        }
+
+        EFI_PHYSICAL_ADDRESS AffinityEnd = Affinity->BaseAddress + Affinity->RangeLength;
+        if((Affinity->BaseAddress <= Start) && (Start < AffinityEnd)) // Start is in this domain
+        {
+          Domain = Affinity->ProximityDomain;
+          if(AffinityEnd < SegmentEnd)
+          {
+            SegmentEnd = AffinityEnd;
+          }
+          if((Affinity->Flags & ACPI_SRAT_MEM_NON_VOLATILE) && (Tier == MEMORY_TIER_DRAM))
+          {
+            SegmentTier = MEMORY_TIER_PERSISTENT;
+          }
+        }
+        else if((Affinity->BaseAddress > Start) && (Affinity->BaseAddress < SegmentEnd)) // Another domain starts partway through
+        {
+          SegmentEnd = Affinity->BaseAddress;
+        }
+      }
+    }
+
+    // SRAT ranges don't have to be page-aligned, but these entries do
+    SegmentEnd = (SegmentEnd + EFI_PAGE_MASK) & ~((EFI_PHYSICAL_ADDRESS)EFI_PAGE_MASK);
+    if(SegmentEnd > End)
+    {
+      SegmentEnd = End;
+    }
+
+    if(TierTable->NumberOfEntries >= TierTable->MaxEntries)
+    {
+      TierTable->Flags |= MEMORY_TIER_FLAG_TRUNCATED;
+      return;
+    }
+
+    MEMORY_TIER_ENTRY * Entry = &TierTable->Entries[TierTable->NumberOfEntries++];
+    Entry->PhysicalStart = Start;
+    Entry->NumberOfPages = (SegmentEnd - Start) >> EFI_PAGE_SHIFT;
+    Entry->Attribute = Attribute;
+    Entry->Tier = SegmentTier;
+    Entry->ProximityDomain = Domain;
+    Entry->ReadLatency = 0;
+    Entry->ReadBandwidth = 0;
+
+    Start = SegmentEnd;
+  }
+}
+
+// Get the best (lowest latency, highest bandwidth) numbers any initiator sees for a target proximity domain
+STATIC VOID HmatLookup(ACPI_HMAT * HMAT, UINT32 Domain, UINT32 * ReadLatency, UINT32 * ReadBandwidth)
+{
+  // Index with the HMAT data type. Read-specific numbers are preferred over general access numbers when both are there.
+  UINT64 BestLatency[3] = {~0ULL, ~0ULL, ~0ULL};
+  UINT64 BestBandwidth[6] = {0};
+
+  for(UINT8 * Sub = (UINT8*)HMAT + sizeof(ACPI_HMAT); Sub < (UINT8*)HMAT + HMAT->Header.Length; Sub += ((ACPI_HMAT_STRUCTURE_HEADER*)Sub)->Length)
+  {
+    ACPI_HMAT_LOCALITY * Locality = (ACPI_HMAT_LOCALITY*)Sub;
+    if(Locality->Length == 0)
+    {
+      break;
+    }
+
+    if((Locality->Type != ACPI_HMAT_TYPE_LOCALITY) || ((Locality->Flags & ACPI_HMAT_HIERARCHY_MASK) != ACPI_HMAT_HIERARCHY_MEMORY) || (Locality->DataType > ACPI_HMAT_WRITE_BANDWIDTH))
+    {
+      continue;
+    }
+
+    UINT32 * TargetDomains = (UINT32*)(Sub + sizeof(ACPI_HMAT_LOCALITY)) + Locality->NumberOfInitiatorDomains;
+    UINT16 * Entries = (UINT16*)(TargetDomains + Locality->NumberOfTargetDomains);
+
+    for(UINT32 Target = 0; Target < Locality->NumberOfTargetDomains; Target++)
+    {
+      if(TargetDomains[Target] != Domain)
+      {
+        continue;
+      }
+
+      for(UINT32 Initiator = 0; Initiator < Locality->NumberOfInitiatorDomains; Initiator++)
+      {
+        UINT16 Value = Entries[Initiator * Locality->NumberOfTargetDomains + Target];
+        if((Value == ACPI_HMAT_ENTRY_NONE) || (Value == ACPI_HMAT_ENTRY_UNREACHABLE))
+        {
+          continue;
+        }
+
+        UINT64 Scaled = (UINT64)Value * Locality->EntryBaseUnit;
+        if(Locality->DataType <= ACPI_HMAT_WRITE_LATENCY)
+        {
+          if(Scaled < BestLatency[Locality->DataType])
+          {
+            BestLatency[Locality->DataType] = Scaled;
+          }
+        }
+        else if(Scaled > BestBandwidth[Locality->DataType])
+        {
+          BestBandwidth[Locality->DataType] = Scaled;
+        }
+      }
+    }
+  }
+
+  UINT64 Latency = (BestLatency[ACPI_HMAT_READ_LATENCY] != ~0ULL) ? BestLatency[ACPI_HMAT_READ_LATENCY] : BestLatency[ACPI_HMAT_ACCESS_LATENCY];
+  UINT64 Bandwidth = BestBandwidth[ACPI_HMAT_READ_BANDWIDTH] ? BestBandwidth[ACPI_HMAT_READ_BANDWIDTH] : BestBandwidth[ACPI_HMAT_ACCESS_BANDWIDTH];
+
+  *ReadLatency = (Latency == ~0ULL) ? 0 : ((Latency > 0xFFFFFFFF) ? 0xFFFFFFFF : (UINT32)Latency);
+  *ReadBandwidth = (Bandwidth > 0xFFFFFFFF) ? 0xFFFFFFFF : (UINT32)Bandwidth;
+}
+
+// The attribute bits an EFI_MEMORY_ATTRIBUTES_TABLE entry is allowed to have, besides EFI_MEMORY_RUNTIME
+#define MEMORY_ATTRIBUTES_TABLE_PERMISSIONS (EFI_MEMORY_RP | EFI_MEMORY_XP | EFI_MEMORY_RO)
+
+// Find the memory map range Address is in, or NULL if it's not in any of them
+STATIC EFI_MEMORY_DESCRIPTOR * FindMemoryMapRange(EFI_MEMORY_DESCRIPTOR * MemMap, UINTN MemMapSize, UINTN MemMapDescriptorSize, EFI_PHYSICAL_ADDRESS Address)
+{
+  for(EFI_MEMORY_DESCRIPTOR * Piece = MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
+  {
+    if((Address >= Piece->PhysicalStart) && (Address - Piece->PhysicalStart < (Piece->NumberOfPages << EFI_PAGE_SHIFT)))
+    {
+      return Piece;
+    }
+  }
+
+  return NULL;
+}
+
+VOID BuildMemoryTierTable(MEMORY_TIER_TABLE * TierTable, EFI_MEMORY_DESCRIPTOR * MemMap, UINTN MemMapSize, UINTN MemMapDescriptorSize)
+{
+  EFI_MEMORY_DESCRIPTOR * Piece;
+  EFI_MEMORY_ATTRIBUTES_TABLE * MemAttrTable = NULL;
+  UINT32 Tier;
+
+  TierTable->NumberOfEntries = 0;
+  TierTable->Flags = 0;
+
+  if(EFI_ERROR(LibGetSystemConfigurationTable(&MemoryAttributesTableGuid, (VOID**)&MemAttrTable)))
+  {
+    MemAttrTable = NULL;
+  }
+
+  ACPI_SRAT * SRAT = (ACPI_SRAT*)FindAcpiTable("SRAT", 0);
+  ACPI_HMAT * HMAT = (ACPI_HMAT*)FindAcpiTable("HMAT", 0);
+
   for(Piece = MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
   {
-    // Within each compatible EfiConventionalMemory, look for space
-    if((Piece->Type == EfiConventionalMemory) && (Piece->NumberOfPages >= pages))
+    if((MemAttrTable != NULL) && ((Piece->Type == EfiRuntimeServicesCode) || (Piece->Type == EfiRuntimeServicesData)))
+    {
+      continue; // These come from the memory attributes table instead
+    }
+
+    if(ClassifyMemoryTier(Piece->Type, Piece->Attribute, &Tier))
     {
-      PhysicalEnd = Piece->PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT) - EFI_PAGE_MASK; // Get the end of this range, and use it to set a bound on the range (define a max returnable address).
-      // (pages*EFI_PAGE_SIZE) or (pages << EFI_PAGE_SHIFT) gives the size the kernel would take up in memory
-      if((OldAddress >= Piece->PhysicalStart) && ((OldAddress + (pages << EFI_PAGE_SHIFT)) < PhysicalEnd)) // Bounds check on OldAddress
+      AddMemoryTierRange(TierTable, SRAT, Piece->PhysicalStart, Piece->NumberOfPages, Piece->Attribute, Tier);
+    }
+  }
+
+  if(MemAttrTable != NULL)
+  {
+    TierTable->Flags |= MEMORY_TIER_FLAG_ATTRIBUTES;
+
+    Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemAttrTable + sizeof(EFI_MEMORY_ATTRIBUTES_TABLE));
+    for(UINT32 i = 0; i < MemAttrTable->NumberOfEntries; i++, Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemAttrTable->DescriptorSize))
+    {
+      // Without a memory map range around it there's no telling whether it's cacheable, or even RAM
+      EFI_MEMORY_DESCRIPTOR * MapRange = FindMemoryMapRange(MemMap, MemMapSize, MemMapDescriptorSize, Piece->PhysicalStart);
+      if(MapRange == NULL)
       {
-        // Return the next available page's address in the range. We need to go page-by-page for the really buggy systems.
-        DiscoveredAddress = OldAddress + EFI_PAGE_SIZE; // Left shift EFI_PAGE_SIZE by 1 or 2 to check every 0x10 or 0x100 pages (must also modify the above PhysicalEnd bound check)
-        break;
-        // If PhysicalEnd == OldAddress, we need to go to the next EfiConventionalMemory range
+        continue;
       }
-      else if(Piece->PhysicalStart > OldAddress) // Try a new range
+
+      UINT64 Attribute = (MapRange->Attribute & ~MEMORY_ATTRIBUTES_TABLE_PERMISSIONS) | (Piece->Attribute & MEMORY_ATTRIBUTES_TABLE_PERMISSIONS);
+      if(ClassifyMemoryTier(MapRange->Type, Attribute, &Tier))
       {
-        DiscoveredAddress = Piece->PhysicalStart;
-        break;
+        AddMemoryTierRange(TierTable, SRAT, Piece->PhysicalStart, Piece->NumberOfPages, Attribute, Tier);
+      }
+    }
+  }
+
+  // Firmware isn't required to sort the memory map, and the attributes table ranges got tacked onto the end, so sort by address.
+  // Insertion sort, since the map is almost always sorted already.
+  for(UINT32 i = 1; i < TierTable->NumberOfEntries; i++)
+  {
+    MEMORY_TIER_ENTRY Current = TierTable->Entries[i];
+    UINT32 j = i;
+    while((j > 0) && (TierTable->Entries[j - 1].PhysicalStart > Current.PhysicalStart))
+    {
+      TierTable->Entries[j] = TierTable->Entries[j - 1];
+      j--;
+    }
+    TierTable->Entries[j] = Current;
+  }
+
+  // Merge adjacent ranges that have identical properties. Boot services, loader, and conventional ranges usually all collapse into one.
+  UINT32 Merged = 0;
+  for(UINT32 i = 0; i < TierTable->NumberOfEntries; i++)
+  {
+    MEMORY_TIER_ENTRY * Entry = &TierTable->Entries[i];
+
+    if(Merged > 0)
+    {
+      MEMORY_TIER_ENTRY * Previous = &TierTable->Entries[Merged - 1];
+      if((Previous->PhysicalStart + (Previous->NumberOfPages << EFI_PAGE_SHIFT) == Entry->PhysicalStart)
+         && (Previous->Tier == Entry->Tier) && (Previous->ProximityDomain == Entry->ProximityDomain)
+         && (Previous->Attribute == Entry->Attribute))
+      {
+        Previous->NumberOfPages += Entry->NumberOfPages;
+        continue;
+      }
+    }
+
+    TierTable->Entries[Merged++] = *Entry;
+  }
+  TierTable->NumberOfEntries = Merged;
+
+  if(SRAT != NULL)
+  {
+    TierTable->Flags |= MEMORY_TIER_FLAG_SRAT;
+  }
+
+  if(HMAT != NULL)
+  {
+    TierTable->Flags |= MEMORY_TIER_FLAG_HMAT;
+
+    for(UINT32 i = 0; i < TierTable->NumberOfEntries; i++)
+    {
+      if(TierTable->Entries[i].ProximityDomain != MEMORY_TIER_NO_DOMAIN)
+      {
+        HmatLookup(HMAT, TierTable->Entries[i].ProximityDomain, &TierTable->Entries[i].ReadLatency, &TierTable->Entries[i].ReadBandwidth);
       }
     }
   }
+}
 
-  // Loop ended without a DiscoveredAddress
-  if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize))
+#if defined(MEMORY_CHARACTERIZATION_ENABLED) || defined(MEMORY_PREZERO_ENABLED)
+// Convert a byte count and the TSC ticks it took into MB/s
+STATIC UINT32 TicksToMBs(UINT64 Bytes, UINT64 Ticks, UINT64 TscFrequency)
+{
+  if(Ticks == 0)
   {
-    // Return address -1, which will cause AllocatePages to fail
-#ifdef MEMORY_CHECK_INFO
-    Print(L"No more free addresses by page...\r\n");
+    return 0;
+  }
+  return (UINT32)(((Bytes * (TscFrequency / 1000)) / Ticks) / 1000);
+}
 #endif
-    return ~0ULL;
+
+#ifdef MEMORY_CHARACTERIZATION_ENABLED
+//==================================================================================================================================
+//  CharacterizeMemory: Measure Memory Bandwidth And Latency
+//==================================================================================================================================
+//
+// Run a short STREAM-style bandwidth test (read, write, copy, triad) and a pointer-chasing latency probe over a sample of each large
+// EfiConventionalMemory range, for systems where the HMAT is missing or can't be trusted. Everything runs on the BSP at TPL_HIGH_LEVEL,
+// so the bandwidth numbers are single-core numbers and the latency includes any page walks. The pass stops early instead of running
+// past MEMORY_CHARACTERIZATION_BUDGET_MS.
+//
+
+#define MEMORY_CHARACTERIZATION_PASSES 2    // Each bandwidth test runs this many times and the fastest one is kept, like STREAM does
+#define MEMORY_CHARACTERIZATION_STRIDE 256  // Spacing of pointer-chase nodes. It's bigger than a cache line so adjacent-line prefetch can't help.
+
+STATIC volatile UINT64 MemoryCharacterizationSink; // Keeps the compiler from throwing away the read and pointer-chase loops
+
+STATIC UINT64 ReadTest(UINT64 * Buffer, UINT64 Words)
+{
+  UINT64 Sum0 = 0, Sum1 = 0, Sum2 = 0, Sum3 = 0;
+  UINT64 Start = ReadTsc();
+
+  for(UINT64 i = 0; i < Words; i += 4)
+  {
+    Sum0 += Buffer[i];
+    Sum1 += Buffer[i + 1];
+    Sum2 += Buffer[i + 2];
+    Sum3 += Buffer[i + 3];
   }
 
+  UINT64 End = ReadTsc();
+  MemoryCharacterizationSink = Sum0 + Sum1 + Sum2 + Sum3;
+  return End - Start;
+}
+
+STATIC UINT64 WriteTest(UINT64 * Buffer, UINT64 Words)
+{
+  UINT64 Start = ReadTsc();
+
+  for(UINT64 i = 0; i < Words; i += 4)
+  {
+    Buffer[i] = i;
+    Buffer[i + 1] = i;
+    Buffer[i + 2] = i;
+    Buffer[i + 3] = i;
+  }
+
+  return ReadTsc() - Start;
+}
+
+STATIC UINT64 CopyTest(UINT64 * A, UINT64 * B, UINT64 Words)
+{
+  UINT64 Start = ReadTsc();
+
+  for(UINT64 i = 0; i < Words; i += 4)
+  {
+    A[i] = B[i];
+    A[i + 1] = B[i + 1];
+    A[i + 2] = B[i + 2];
+    A[i + 3] = B[i + 3];
+  }
+
+  return ReadTsc() - Start;
+}
+
+STATIC UINT64 TriadTest(UINT64 * A, UINT64 * B, UINT64 * C, UINT64 Words)
+{
+  UINT64 Start = ReadTsc();
+
+  for(UINT64 i = 0; i < Words; i += 4)
+  {
+    A[i] = B[i] + 3 * C[i];
+    A[i + 1] = B[i + 1] + 3 * C[i + 1];
+    A[i + 2] = B[i + 2] + 3 * C[i + 2];
+    A[i + 3] = B[i + 3] + 3 * C[i + 3];
+  }
+
+  return ReadTsc() - Start;
+}
+
+// Link the nodes into one big cycle in random order (Sattolo's algorithm), then follow it all the way around once. Every load depends
+// on the one before it, so the time per hop is the load latency.
+STATIC UINT64 LatencyTest(UINT8 * Buffer, UINT64 Bytes, UINT64 * Hops)
+{
+  UINT64 NumNodes = Bytes / MEMORY_CHARACTERIZATION_STRIDE;
+  UINT64 Seed = ReadTsc() | 1;
+
+  for(UINT64 i = 0; i < NumNodes; i++)
+  {
+    *(UINT64*)(Buffer + i * MEMORY_CHARACTERIZATION_STRIDE) = i;
+  }
+
+  for(UINT64 i = NumNodes - 1; i > 0; i--)
+  {
+    // xorshift64
+    Seed ^= Seed << 13;
+    Seed ^= Seed >> 7;
+    Seed ^= Seed << 17;
+
+    UINT64 j = Seed % i;
+    UINT64 Swap = *(UINT64*)(Buffer + i * MEMORY_CHARACTERIZATION_STRIDE);
+    *(UINT64*)(Buffer + i * MEMORY_CHARACTERIZATION_STRIDE) = *(UINT64*)(Buffer + j * MEMORY_CHARACTERIZATION_STRIDE);
+    *(UINT64*)(Buffer + j * MEMORY_CHARACTERIZATION_STRIDE) = Swap;
+  }
+
+  // Turn node indices into pointers
+  for(UINT64 i = 0; i < NumNodes; i++)
+  {
+    UINT64 * Node = (UINT64*)(Buffer + i * MEMORY_CHARACTERIZATION_STRIDE);
+    *Node = (UINT64)(Buffer + *Node * MEMORY_CHARACTERIZATION_STRIDE);
+  }
+
+  UINT64 * Node = (UINT64*)Buffer;
+  UINT64 Start = ReadTsc();
+
+  for(UINT64 i = 0; i < NumNodes; i++)
+  {
+    Node = (UINT64*)*Node;
+  }
+
+  UINT64 End = ReadTsc();
+  MemoryCharacterizationSink = (UINT64)Node;
+
+  *Hops = NumNodes;
+  return End - Start;
+}
+
+STATIC VOID MeasureMemoryRange(MEMORY_PERF_ENTRY * Entry, UINT64 TscFrequency)
+{
+  UINT64 * Buffer = (UINT64*)Entry->SampleStart;
+  UINT64 Words = Entry->SampleSize / sizeof(UINT64);
+  UINT64 Half = (Words / 2) & ~3ULL;
+  UINT64 Third = (Words / 3) & ~3ULL;
+  UINT64 ReadTicks = (UINT64)-1, WriteTicks = (UINT64)-1, CopyTicks = (UINT64)-1, TriadTicks = (UINT64)-1;
+
+  for(UINT64 Pass = 0; Pass < MEMORY_CHARACTERIZATION_PASSES; Pass++)
+  {
+    UINT64 Ticks;
+
+    // Write goes first so that nothing below reads stale firmware data (not that it matters for timing)
+    Ticks = WriteTest(Buffer, Words);
+    if(Ticks < WriteTicks)
+    {
+      WriteTicks = Ticks;
+    }
+
+    Ticks = ReadTest(Buffer, Words);
+    if(Ticks < ReadTicks)
+    {
+      ReadTicks = Ticks;
+    }
+
+    Ticks = CopyTest(Buffer, Buffer + Half, Half);
+    if(Ticks < CopyTicks)
+    {
+      CopyTicks = Ticks;
+    }
+
+    Ticks = TriadTest(Buffer, Buffer + Third, Buffer + 2 * Third, Third);
+    if(Ticks < TriadTicks)
+    {
+      TriadTicks = Ticks;
+    }
+  }
+
+  Entry->WriteBandwidth = TicksToMBs(Words * sizeof(UINT64), WriteTicks, TscFrequency);
+  Entry->ReadBandwidth = TicksToMBs(Words * sizeof(UINT64), ReadTicks, TscFrequency);
+  Entry->CopyBandwidth = TicksToMBs(2 * Half * sizeof(UINT64), CopyTicks, TscFrequency);
+  Entry->TriadBandwidth = TicksToMBs(3 * Third * sizeof(UINT64), TriadTicks, TscFrequency);
+
+  UINT64 Hops;
+  UINT64 LatencyTicks = LatencyTest((UINT8*)Buffer, Entry->SampleSize, &Hops);
+  if(Hops != 0)
+  {
+    // Split up to avoid overflow: ticks -> microticks per hop -> picoseconds
+    Entry->Latency = (UINT32)((((LatencyTicks * 1000000ULL) / Hops) * 1000000ULL) / TscFrequency);
+  }
+}
+
+EFI_STATUS CharacterizeMemory(MEMORY_PERF_TABLE ** PerfTable)
+{
+  EFI_STATUS memmap_status;
+  UINTN MemMapSize, MemMapDescriptorSize;
+  EFI_MEMORY_DESCRIPTOR * MemMap;
+  EFI_MEMORY_DESCRIPTOR * Piece;
+
+  UINT64 TscFrequency = GetTscFrequency();
+  if(TscFrequency < 1000)
+  {
+    Print(L"TSC doesn't seem to be running, can't time memory characterization.\r\n");
+    return EFI_UNSUPPORTED;
+  }
+
+  UINT64 BudgetTicks = (TscFrequency / 1000) * MEMORY_CHARACTERIZATION_BUDGET_MS;
+  UINT64 MinPages = EFI_SIZE_TO_PAGES((UINT64)MEMORY_CHARACTERIZATION_MIN_MB << 20);
+  UINT64 SampleSize = (UINT64)MEMORY_CHARACTERIZATION_SAMPLE_MB << 20;
+  UINT64 SamplePages = EFI_SIZE_TO_PAGES(SampleSize);
+
+  // Take a snapshot of the memory map to pick ranges from
+  memmap_status = GetMemoryMapCopy(&MemMap, &MemMapSize, &MemMapDescriptorSize);
+  if(EFI_ERROR(memmap_status))
+  {
+    return memmap_status;
+  }
+
+  UINT64 NumRanges = 0;
+  for(Piece = MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
+  {
+    if((Piece->Type == EfiConventionalMemory) && (Piece->NumberOfPages >= MinPages) && (Piece->NumberOfPages >= SamplePages))
+    {
+      NumRanges++;
+    }
+  }
+
+  memmap_status = BS->AllocatePool(EfiLoaderData, sizeof(MEMORY_PERF_TABLE) + NumRanges * sizeof(MEMORY_PERF_ENTRY), (void**)PerfTable);
+  if(EFI_ERROR(memmap_status))
+  {
+    Print(L"Memory performance table AllocatePool error. 0x%llx\r\n", memmap_status);
+    BS->FreePool(MemMap);
+    return memmap_status;
+  }
+
+  (*PerfTable)->NumberOfEntries = 0;
+  (*PerfTable)->Flags = 0;
+  (*PerfTable)->TscFrequency = TscFrequency;
+
+  UINT64 PassStart = ReadTsc();
+  UINT64 LastRangeTicks = 0;
+
+  for(Piece = MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
+  {
+    if((Piece->Type != EfiConventionalMemory) || (Piece->NumberOfPages < MinPages) || (Piece->NumberOfPages < SamplePages))
+    {
+      continue;
+    }
+
+    // Assume the next range takes as long as the last one did
+    if((ReadTsc() - PassStart) + LastRangeTicks > BudgetTicks)
+    {
+      (*PerfTable)->Flags |= MEMORY_PERF_FLAG_BUDGET_EXHAUSTED;
+      break;
+    }
+
+    // Use a 2MB-aligned sample if it fits, so that firmware large-page mappings keep TLB misses out of the bandwidth numbers
+    EFI_PHYSICAL_ADDRESS RangeEnd = Piece->PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT);
+    EFI_PHYSICAL_ADDRESS SampleStart = (Piece->PhysicalStart + 0x1FFFFF) & ~0x1FFFFFULL;
+    if(SampleStart + SampleSize > RangeEnd)
+    {
+      SampleStart = Piece->PhysicalStart;
+    }
+
+    // Something may have been allocated here since the snapshot was taken (like the table above), in which case just skip it
+    memmap_status = BS->AllocatePages(AllocateAddress, EfiLoaderData, SamplePages, &SampleStart);
+    if(EFI_ERROR(memmap_status))
+    {
+      LOG_MESSAGE(MEMORY, INFO, L"Could not claim characterization sample at 0x%llx. 0x%llx", SampleStart, memmap_status);
+      continue;
+    }
+
+    UINT64 RangeStart = ReadTsc();
+
+    MEMORY_PERF_ENTRY * Entry = &(*PerfTable)->Entries[(*PerfTable)->NumberOfEntries];
+    ZeroMem(Entry, sizeof(MEMORY_PERF_ENTRY));
+    Entry->PhysicalStart = Piece->PhysicalStart;
+    Entry->NumberOfPages = Piece->NumberOfPages;
+    Entry->SampleStart = SampleStart;
+    Entry->SampleSize = SampleSize;
+
+    // No timer interrupts or event callbacks in the middle of a measurement
+    EFI_TPL OldTpl = BS->RaiseTPL(TPL_HIGH_LEVEL);
+    MeasureMemoryRange(Entry, TscFrequency);
+    BS->RestoreTPL(OldTpl);
+
+    memmap_status = BS->FreePages(SampleStart, SamplePages);
+    if(EFI_ERROR(memmap_status))
+    {
+      Print(L"Error freeing characterization sample. 0x%llx\r\n", memmap_status);
+      BS->FreePool(*PerfTable);
+      *PerfTable = NULL;
+      BS->FreePool(MemMap);
+      return memmap_status;
+    }
+
+    (*PerfTable)->NumberOfEntries++;
+    LastRangeTicks = ReadTsc() - RangeStart;
+  }
+
+  (*PerfTable)->ElapsedMicroseconds = ((ReadTsc() - PassStart) * 1000ULL) / (TscFrequency / 1000);
+
   memmap_status = BS->FreePool(MemMap);
   if(EFI_ERROR(memmap_status))
   {
-    Print(L"Error freeing ActuallyFreeAddressByPage memmap pool. 0x%llx\r\n", memmap_status);
+    Print(L"Error freeing characterization MemMap pool. 0x%llx\r\n", memmap_status);
+    // The caller drops the table on an error, so don't leave it allocated
+    BS->FreePool(*PerfTable);
+    *PerfTable = NULL;
   }
 
-  return DiscoveredAddress;
+  return memmap_status;
 }
+#endif
 
+#ifdef MEMORY_PREZERO_ENABLED
 //==================================================================================================================================
-//  print_memmap: The Ultimate Debugging Tool
+//  PrezeroMemory: Zero Free Memory On Every Processor
 //==================================================================================================================================
 //
-// Get the system memory map, parse it, and print it. Print the whole thing.
+// Claim 2MB-aligned chunks of EfiConventionalMemory as EfiLoaderData, up to MEMORY_PREZERO_LIMIT_MB and leaving at least
+// MEMORY_PREZERO_RESERVE_MB for firmware, and zero them with non-temporal stores on all enabled processors at once. The APs get started
+// through EFI_MP_SERVICES_PROTOCOL and the BSP pitches in too. Each processor takes the next chunk off a shared counter until they're
+// all gone, so faster processors just end up doing more. If there's no MP services protocol, the BSP does it all by itself.
+//
+// The chunks stay allocated so that nothing can write to them before the kernel runs. The kernel can treat any chunk marked in the
+// bitmap as free memory that's already zeroed.
 //
 
-// This array is a global variable so that it can be made static, which helps prevent a stack overflow if it ever needs to lengthen.
-STATIC CONST CHAR16 mem_types[16][27] = {
-      L"EfiReservedMemoryType     ",
-      L"EfiLoaderCode             ",
-      L"EfiLoaderData             ",
-      L"EfiBootServicesCode       ",
-      L"EfiBootServicesData       ",
-      L"EfiRuntimeServicesCode    ",
-      L"EfiRuntimeServicesData    ",
-      L"EfiConventionalMemory     ",
-      L"EfiUnusableMemory         ",
-      L"EfiACPIReclaimMemory      ",
-      L"EfiACPIMemoryNVS          ",
-      L"EfiMemoryMappedIO         ",
-      L"EfiMemoryMappedIOPortSpace",
-      L"EfiPalCode                ",
-      L"EfiPersistentMemory       ",
-      L"EfiMaxMemoryType          "
-};
+typedef struct {
+  UINT64                  Bytes;
+  UINT64                  Ticks;
+} PREZERO_CPU_STATS;
 
-VOID print_memmap()
+typedef struct {
+  EFI_PHYSICAL_ADDRESS   *Chunks;
+  UINT64                  NumberOfChunks;
+  volatile UINT64         NextChunk;
+  volatile UINT64         NextSlot;
+  UINT64                  NumberOfSlots;
+  PREZERO_CPU_STATS      *Stats;
+} PREZERO_CONTEXT;
+
+STATIC EFI_GUID MpServicesProtocolGuid = EFI_MP_SERVICES_PROTOCOL_GUID;
+
+// This runs on the APs, so no boot services in here
+STATIC VOID EFIAPI PrezeroWorker(VOID * Argument)
+{
+  PREZERO_CONTEXT * Context = (PREZERO_CONTEXT*)Argument;
+  UINT64 Slot = __atomic_fetch_add(&Context->NextSlot, 1, __ATOMIC_RELAXED);
+  UINT64 Bytes = 0;
+  UINT64 Start = ReadTsc();
+
+  for(;;)
+  {
+    UINT64 Index = __atomic_fetch_add(&Context->NextChunk, 1, __ATOMIC_RELAXED);
+    if(Index >= Context->NumberOfChunks)
+    {
+      break;
+    }
+
+    ZeroMemNonTemporal((VOID*)Context->Chunks[Index], ZEROED_MEMORY_CHUNK_SIZE);
+    Bytes += ZEROED_MEMORY_CHUNK_SIZE;
+  }
+  StoreFence();
+
+  if(Slot < Context->NumberOfSlots)
+  {
+    Context->Stats[Slot].Bytes = Bytes;
+    Context->Stats[Slot].Ticks = ReadTsc() - Start;
+  }
+}
+
+EFI_STATUS PrezeroMemory(ZEROED_MEMORY_MAP ** ZeroMap)
 {
   EFI_STATUS memmap_status;
-  UINTN MemMapSize = 0, MemMapKey, MemMapDescriptorSize;
-  UINT32 MemMapDescriptorVersion;
-  EFI_MEMORY_DESCRIPTOR * MemMap = NULL;
+  UINTN MemMapSize, MemMapDescriptorSize;
+  EFI_MEMORY_DESCRIPTOR * MemMap;
   EFI_MEMORY_DESCRIPTOR * Piece;
-  UINT16 line = 0;
+  PREZERO_CONTEXT Context;
 
-  memmap_status = BS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
-  if(memmap_status == EFI_BUFFER_TOO_SMALL)
+  UINT64 TscFrequency = GetTscFrequency();
+  if(TscFrequency < 1000)
   {
-    MemMapSize += MemMapDescriptorSize;
-    memmap_status = BS->AllocatePool(EfiBootServicesData, MemMapSize, (void **)&MemMap); // Allocate pool for MemMap
-    if(EFI_ERROR(memmap_status)) // Error! Wouldn't be safe to continue.
+    Print(L"TSC doesn't seem to be running, can't time memory zeroing.\r\n");
+    return EFI_UNSUPPORTED;
+  }
+
+  // No MP services just means the BSP works alone
+  EFI_MP_SERVICES_PROTOCOL * MpServices = NULL;
+  UINTN NumberOfProcessors = 1, NumberOfEnabledProcessors = 1;
+  if(EFI_ERROR(BS->LocateProtocol(&MpServicesProtocolGuid, NULL, (void**)&MpServices)) || EFI_ERROR(MpServices->GetNumberOfProcessors(MpServices, &NumberOfProcessors, &NumberOfEnabledProcessors)))
+  {
+    MpServices = NULL;
+    NumberOfEnabledProcessors = 1;
+  }
+
+  memmap_status = GetMemoryMapCopy(&MemMap, &MemMapSize, &MemMapDescriptorSize);
+  if(EFI_ERROR(memmap_status))
+  {
+    return memmap_status;
+  }
+
+  // The bitmap needs to reach the highest free address
+  UINT64 TopAddress = 0, ConventionalBytes = 0;
+  for(Piece = MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
+  {
+    if(Piece->Type == EfiConventionalMemory)
     {
-      Print(L"MemMap AllocatePool error. 0x%llx\r\n", memmap_status);
-      return;
+      UINT64 End = Piece->PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT);
+      TopAddress = (End > TopAddress) ? End : TopAddress;
+      ConventionalBytes += Piece->NumberOfPages << EFI_PAGE_SHIFT;
     }
-    memmap_status = BS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
   }
+
+  UINT64 Limit = (MEMORY_PREZERO_LIMIT_MB == 0) ? ConventionalBytes : ((UINT64)MEMORY_PREZERO_LIMIT_MB << 20);
+  UINT64 Reserve = (UINT64)MEMORY_PREZERO_RESERVE_MB << 20;
+  if(ConventionalBytes < Reserve)
+  {
+    Limit = 0;
+  }
+  else if(Limit > ConventionalBytes - Reserve)
+  {
+    Limit = ConventionalBytes - Reserve;
+  }
+  UINT64 MaxChunks = Limit / ZEROED_MEMORY_CHUNK_SIZE;
+  UINT64 NumberOfBitmapChunks = (TopAddress + ZEROED_MEMORY_CHUNK_SIZE - 1) / ZEROED_MEMORY_CHUNK_SIZE;
+
+  memmap_status = BS->AllocatePool(EfiLoaderData, sizeof(ZEROED_MEMORY_MAP) + (NumberOfBitmapChunks + 7) / 8, (void**)ZeroMap);
   if(EFI_ERROR(memmap_status))
   {
-    Print(L"Error getting memory map for printing. 0x%llx\r\n", memmap_status);
+    Print(L"Zeroed memory map AllocatePool error. 0x%llx\r\n", memmap_status);
+    BS->FreePool(MemMap);
+    return memmap_status;
   }
+  ZeroMem(*ZeroMap, sizeof(ZEROED_MEMORY_MAP) + (NumberOfBitmapChunks + 7) / 8);
+  (*ZeroMap)->ChunkSize = ZEROED_MEMORY_CHUNK_SIZE;
+  (*ZeroMap)->NumberOfChunks = NumberOfBitmapChunks;
 
-  Print(L"MemMapSize: %llu, MemMapDescriptorSize: %llu, MemMapDescriptorVersion: 0x%x\r\n", MemMapSize, MemMapDescriptorSize, MemMapDescriptorVersion);
+  if(MaxChunks == 0)
+  {
+    BS->FreePool(MemMap);
+    return EFI_SUCCESS;
+  }
 
-  // There's no virtual addressing yet, so there's no need to see Piece->VirtualStart
-  // Multiply NumOfPages by EFI_PAGE_SIZE or do (NumOfPages << EFI_PAGE_SHIFT) to get the end address... which should just be the start of the next section.
-  for(Piece = MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
+  ZeroMem(&Context, sizeof(PREZERO_CONTEXT));
+  memmap_status = BS->AllocatePool(EfiBootServicesData, MaxChunks * sizeof(EFI_PHYSICAL_ADDRESS), (void**)&Context.Chunks);
+  if(EFI_ERROR(memmap_status))
   {
-    if(line%20 == 0)
+    Print(L"Prezero chunk list AllocatePool error. 0x%llx\r\n", memmap_status);
+    BS->FreePool(MemMap);
+    return memmap_status;
+  }
+
+  memmap_status = BS->AllocatePool(EfiBootServicesData, NumberOfEnabledProcessors * sizeof(PREZERO_CPU_STATS), (void**)&Context.Stats);
+  if(EFI_ERROR(memmap_status))
+  {
+    Print(L"Prezero stats AllocatePool error. 0x%llx\r\n", memmap_status);
+    BS->FreePool(Context.Chunks);
+    BS->FreePool(MemMap);
+    return memmap_status;
+  }
+  ZeroMem(Context.Stats, NumberOfEnabledProcessors * sizeof(PREZERO_CPU_STATS));
+  Context.NumberOfSlots = NumberOfEnabledProcessors;
+
+  // Claim as much of each range as possible in one go, and fall back to one chunk at a time if something else got allocated in the
+  // range since the snapshot was taken (like the pools above)
+  for(Piece = MemMap; (Piece < (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize)) && (Context.NumberOfChunks < MaxChunks); Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
+  {
+    if(Piece->Type != EfiConventionalMemory)
     {
-      Keywait(L"\0");
-      Print(L"#   Memory Type                Phys Addr Start   Num Of Pages   Attr\r\n");
+      continue;
     }
 
-    Print(L"%2hu: %s 0x%016llx 0x%llx 0x%llx\r\n", line, mem_types[Piece->Type], Piece->PhysicalStart, Piece->NumberOfPages, Piece->Attribute);
-    line++;
+    EFI_PHYSICAL_ADDRESS RunStart = (Piece->PhysicalStart + ZEROED_MEMORY_CHUNK_SIZE - 1) & ~(ZEROED_MEMORY_CHUNK_SIZE - 1);
+    EFI_PHYSICAL_ADDRESS RunEnd = (Piece->PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT)) & ~(ZEROED_MEMORY_CHUNK_SIZE - 1);
+    if(RunEnd <= RunStart)
+    {
+      continue;
+    }
+
+    UINT64 RunChunks = (RunEnd - RunStart) / ZEROED_MEMORY_CHUNK_SIZE;
+    if(RunChunks > MaxChunks - Context.NumberOfChunks)
+    {
+      RunChunks = MaxChunks - Context.NumberOfChunks;
+    }
+
+    EFI_PHYSICAL_ADDRESS Claim = RunStart;
+    if(!EFI_ERROR(BS->AllocatePages(AllocateAddress, EfiLoaderData, EFI_SIZE_TO_PAGES(RunChunks * ZEROED_MEMORY_CHUNK_SIZE), &Claim)))
+    {
+      for(UINT64 k = 0; k < RunChunks; k++)
+      {
+        Context.Chunks[Context.NumberOfChunks++] = RunStart + k * ZEROED_MEMORY_CHUNK_SIZE;
+      }
+    }
+    else
+    {
+      for(UINT64 k = 0; k < RunChunks; k++)
+      {
+        Claim = RunStart + k * ZEROED_MEMORY_CHUNK_SIZE;
+        if(!EFI_ERROR(BS->AllocatePages(AllocateAddress, EfiLoaderData, EFI_SIZE_TO_PAGES(ZEROED_MEMORY_CHUNK_SIZE), &Claim)))
+        {
+          Context.Chunks[Context.NumberOfChunks++] = Claim;
+        }
+      }
+    }
+  }
+
+  // Start the APs without waiting on them, so the BSP can help
+  EFI_EVENT ApsDone = NULL;
+  UINT8 ApsRunning = 0;
+  UINT64 Start = ReadTsc();
+
+  if((MpServices != NULL) && (NumberOfEnabledProcessors > 1))
+  {
+    if(!EFI_ERROR(BS->CreateEvent(0, 0, NULL, NULL, &ApsDone)))
+    {
+      if(!EFI_ERROR(MpServices->StartupAllAPs(MpServices, PrezeroWorker, FALSE, ApsDone, 0, &Context, NULL)))
+      {
+        ApsRunning = 1;
+      }
+      else
+      {
+        BS->CloseEvent(ApsDone);
+      }
+    }
   }
 
+  PrezeroWorker(&Context);
+
+  if(ApsRunning)
+  {
+    UINTN EventIndex;
+    BS->WaitForEvent(1, &ApsDone, &EventIndex);
+    BS->CloseEvent(ApsDone);
+  }
+
+  UINT64 ElapsedTicks = ReadTsc() - Start;
+
+  // Every claimed chunk got zeroed by somebody
+  for(UINT64 k = 0; k < Context.NumberOfChunks; k++)
+  {
+    UINT64 Index = Context.Chunks[k] / ZEROED_MEMORY_CHUNK_SIZE;
+    (*ZeroMap)->Bitmap[Index / 8] |= (UINT8)(1 << (Index % 8));
+  }
+
+  UINT64 PerCpuSum = 0;
+  for(UINT64 k = 0; k < Context.NumberOfSlots; k++)
+  {
+    if(Context.Stats[k].Bytes != 0)
+    {
+      (*ZeroMap)->NumberOfCpus++;
+      PerCpuSum += TicksToMBs(Context.Stats[k].Bytes, Context.Stats[k].Ticks, TscFrequency);
+    }
+  }
+
+  (*ZeroMap)->BytesZeroed = Context.NumberOfChunks * ZEROED_MEMORY_CHUNK_SIZE;
+  (*ZeroMap)->ElapsedMicroseconds = (ElapsedTicks * 1000ULL) / (TscFrequency / 1000);
+  (*ZeroMap)->TotalBandwidth = TicksToMBs((*ZeroMap)->BytesZeroed, ElapsedTicks, TscFrequency);
+  if((*ZeroMap)->NumberOfCpus != 0)
+  {
+    (*ZeroMap)->PerCpuBandwidth = (UINT32)(PerCpuSum / (*ZeroMap)->NumberOfCpus);
+  }
+
+  BS->FreePool(Context.Stats);
+  BS->FreePool(Context.Chunks);
+
   memmap_status = BS->FreePool(MemMap);
   if(EFI_ERROR(memmap_status))
   {
-    Print(L"Error freeing print_memmap pool. 0x%llx\r\n", memmap_status);
+    Print(L"Error freeing prezero MemMap pool. 0x%llx\r\n", memmap_status);
   }
+
+  return memmap_status;
 }
+#endif
@@ -0,0 +1,707 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Page Table Functions
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This file contains functions for building a set of x86-64 4-level page tables for the kernel, so that it doesn't have to do it
+// itself at 4kB granularity. The tables identity map everything the memory map describes using the biggest pages the CPU supports,
+// and also map the kernel image at LOADER_PAGING_KERNEL_VIRTUAL_BASE with the permissions its segments asked for.
+//
+// Only used if LOADER_PAGE_TABLES_ENABLED is defined in Bootloader.h.
+//
+
+#include "Bootloader.h"
+
+#ifdef LOADER_PAGE_TABLES_ENABLED
+
+// Page table entry bits
+#define PTE_PRESENT       0x1ULL
+#define PTE_WRITE         0x2ULL
+#define PTE_LARGE_PAGE    0x80ULL // 2MB page in a PD, 1GB page in a PDPT
+#define PTE_PAT_4KB       0x80ULL // Same bit as PTE_LARGE_PAGE, but in a PT
+#define PTE_PAT_LARGE     0x1000ULL
+#define PTE_WRITE_COMBINING 0x200ULL // Ignored by the CPU; MapRange() turns it into the right PAT bit for the page size
+#define PTE_NO_EXECUTE    (1ULL << 63)
+#define PTE_ADDRESS_MASK  0x000FFFFFFFFFF000ULL
+
+#define SIZE_2MB_PAGE     0x200000ULL
+#define SIZE_1GB_PAGE     0x40000000ULL
+
+#define MAX_KERNEL_SEGMENTS 64
+#define MAX_GUARD_PAGES     8
+#define MAX_RUNTIME_MAPPINGS 64
+#define MAX_PAGING_MTRRS    (MTRRCAP_VCNT_MASK + 1)
+
+#define FIXED_MTRR_LIMIT    0x100000ULL // The fixed-range MTRRs cover the first 1MB
+
+typedef struct {
+  UINT64 Offset; // Relative to the kernel's base address
+  UINT64 Size;
+  UINT64 Flags;  // KERNEL_SEGMENT_* values
+} KERNEL_SEGMENT;
+
+STATIC KERNEL_SEGMENT KernelSegments[MAX_KERNEL_SEGMENTS];
+STATIC UINT64 NumKernelSegments = 0;
+STATIC UINT8 KernelSegmentsOverflowed = 0;
+
+STATIC EFI_PHYSICAL_ADDRESS GuardPages[MAX_GUARD_PAGES];
+STATIC UINT64 NumGuardPages = 0;
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS PhysicalStart;
+  EFI_VIRTUAL_ADDRESS  VirtualStart;
+  UINT64               Size;
+} RUNTIME_MAPPING;
+
+STATIC RUNTIME_MAPPING RuntimeMappings[MAX_RUNTIME_MAPPINGS];
+STATIC UINT64 NumRuntimeMappings = 0;
+
+STATIC UINT64 * PageTablePool = NULL;
+STATIC UINT64 PageTablePoolPages = 0;
+STATIC UINT64 PageTablePoolUsed = 0;
+
+STATIC UINT8 PagingUsesNoExecute = 0;
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS Base;
+  UINT64               Mask; // Same meaning as an IA32_MTRR_PHYSMASK mask: an address is in the range if (Address & Mask) == Base
+} PAGING_MTRR;
+
+STATIC PAGING_MTRR PagingMtrrs[MAX_PAGING_MTRRS];
+STATIC UINT64 NumPagingMtrrs = 0;
+STATIC UINT8 PagingMtrrsOverflowed = 0;
+STATIC UINT8 PagingFixedMtrrs = 0;
+
+//==================================================================================================================================
+//  AddKernelSegment: Record A Kernel Segment's Permissions
+//==================================================================================================================================
+//
+// The PE, ELF, and Mach-O loaders call this for each section/segment they load. Offset is relative to the kernel's base address, and
+// Flags is a combination of KERNEL_SEGMENT_WRITE & KERNEL_SEGMENT_EXECUTE. If there are too many segments to keep track of, the whole
+// kernel just gets mapped read/write/execute instead.
+//
+
+VOID AddKernelSegment(UINT64 Offset, UINT64 Size, UINT64 Flags)
+{
+  if(Size == 0)
+  {
+    return;
+  }
+
+  if(NumKernelSegments >= MAX_KERNEL_SEGMENTS)
+  {
+    KernelSegmentsOverflowed = 1;
+    return;
+  }
+
+  KernelSegments[NumKernelSegments].Offset = Offset;
+  KernelSegments[NumKernelSegments].Size = Size;
+  KernelSegments[NumKernelSegments].Flags = Flags;
+  NumKernelSegments++;
+}
+
+//==================================================================================================================================
+//  AddGuardPage: Leave A Page Out Of The Identity Map
+//==================================================================================================================================
+//
+// The 4kB page at Address gets unmapped after everything else is mapped, so that touching it faults. Used for the bottom of stacks.
+//
+
+VOID AddGuardPage(EFI_PHYSICAL_ADDRESS Address)
+{
+  if(NumGuardPages < MAX_GUARD_PAGES)
+  {
+    GuardPages[NumGuardPages++] = Address & ~(EFI_PAGE_SIZE - 1);
+  }
+}
+
+//==================================================================================================================================
+//  AddRuntimeMapping: Map A Runtime Services Range Outside The Identity Map
+//==================================================================================================================================
+//
+// Map Pages pages at PhysicalStart a second time at VirtualStart, for the layout that SetVirtualAddressMap() gets told about. Returns 0
+// if there are already too many to keep track of, in which case that range only gets the identity mapping.
+//
+
+UINT8 AddRuntimeMapping(EFI_PHYSICAL_ADDRESS PhysicalStart, EFI_VIRTUAL_ADDRESS VirtualStart, UINT64 Pages)
+{
+  if(NumRuntimeMappings >= MAX_RUNTIME_MAPPINGS)
+  {
+    return 0;
+  }
+
+  RuntimeMappings[NumRuntimeMappings].PhysicalStart = PhysicalStart;
+  RuntimeMappings[NumRuntimeMappings].VirtualStart = VirtualStart;
+  RuntimeMappings[NumRuntimeMappings].Size = Pages << EFI_PAGE_SHIFT;
+  NumRuntimeMappings++;
+
+  return 1;
+}
+
+//==================================================================================================================================
+//  MtrrTypeUniform: Check That A Large Page Has One Memory Type
+//==================================================================================================================================
+//
+// The SDM leaves the memory type of a large page undefined if the MTRRs don't give all of it the same type, so MapRange() only uses a
+// large page where no MTRR range starts or ends inside it. Start has to be aligned to Size, which has to be a power of 2. This is a
+// bit stricter than it needs to be, since two ranges of the same type can meet inside a page, but it doesn't have to know how
+// overlapping types combine.
+//
+
+STATIC VOID AddPagingMtrr(EFI_PHYSICAL_ADDRESS Base, UINT64 Mask)
+{
+  if(NumPagingMtrrs >= MAX_PAGING_MTRRS)
+  {
+    PagingMtrrsOverflowed = 1;
+    return;
+  }
+
+  PagingMtrrs[NumPagingMtrrs].Mask = Mask & PTE_ADDRESS_MASK;
+  PagingMtrrs[NumPagingMtrrs].Base = Base & PagingMtrrs[NumPagingMtrrs].Mask;
+  NumPagingMtrrs++;
+}
+
+STATIC UINT8 MtrrTypeUniform(EFI_PHYSICAL_ADDRESS Start, UINT64 Size)
+{
+  if(PagingFixedMtrrs && (Start < FIXED_MTRR_LIMIT))
+  {
+    return 0;
+  }
+
+  for(UINT64 i = 0; i < NumPagingMtrrs; i++)
+  {
+    // Addresses in the page only differ below Size. If the mask's bits above that don't match, none of the page is in the range, and
+    // if the mask has no bits below that, all of it is.
+    if(!((Start ^ PagingMtrrs[i].Base) & PagingMtrrs[i].Mask & ~(Size - 1)) && (PagingMtrrs[i].Mask & (Size - 1)))
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+//==================================================================================================================================
+//  MapRange: Add A Mapping To The Page Tables
+//==================================================================================================================================
+//
+// Map Size bytes at Virtual to Physical, using pages no bigger than LargestPage. Each step uses the biggest page that is aligned in both
+// address spaces, fits in what's left, and has one memory type according to MtrrTypeUniform(). Where a page was already mapped by an
+// earlier range (e.g. two ELF segments sharing a page), the page gets the permissions of both.
+//
+
+STATIC UINT64 * NewPageTable(VOID)
+{
+  if(PageTablePoolUsed >= PageTablePoolPages)
+  {
+    return NULL;
+  }
+
+  UINT64 * Table = PageTablePool + PageTablePoolUsed * 512;
+  PageTablePoolUsed++;
+  return Table;
+}
+
+STATIC VOID SetPageTableEntry(UINT64 * Entry, UINT64 Value)
+{
+  if(*Entry & PTE_PRESENT)
+  {
+    *Entry |= (Value & PTE_WRITE);
+    if(!(Value & PTE_NO_EXECUTE))
+    {
+      *Entry &= ~PTE_NO_EXECUTE;
+    }
+  }
+  else
+  {
+    *Entry = Value;
+  }
+}
+
+// Leaves with PAT = 1, PCD = 0, PWT = 0 use PAT entry 4, which ApplyFrameBufferCaching() sets to WC
+STATIC UINT64 LeafFlags(UINT64 Flags, UINT64 Shift)
+{
+  if(Flags & PTE_WRITE_COMBINING)
+  {
+    Flags |= (Shift == 12) ? PTE_PAT_4KB : PTE_PAT_LARGE;
+  }
+  return Flags;
+}
+
+STATIC EFI_STATUS MapRange(UINT64 * Pml4, UINT64 Virtual, EFI_PHYSICAL_ADDRESS Physical, UINT64 Size, UINT64 Flags, UINT64 LargestPage)
+{
+  while(Size > 0)
+  {
+    UINT64 * Table = Pml4;
+    UINT64 Step = EFI_PAGE_SIZE;
+
+    for(UINT64 Shift = 39; Shift >= 12; Shift -= 9)
+    {
+      UINT64 * Entry = &Table[(Virtual >> Shift) & 0x1FF];
+      UINT64 PageSize = 1ULL << Shift;
+
+      if(Shift == 12)
+      {
+        SetPageTableEntry(Entry, Physical | LeafFlags(Flags, Shift));
+        Step = PageSize;
+        break;
+      }
+
+      // A leaf can go here if the addresses line up, nothing below this level has been mapped yet, and the MTRRs don't split it
+      if((Shift <= 30) && (PageSize <= LargestPage) && !((Virtual | Physical) & (PageSize - 1)) && (Size >= PageSize)
+          && (!(*Entry & PTE_PRESENT) || (*Entry & PTE_LARGE_PAGE)) && MtrrTypeUniform(Physical, PageSize))
+      {
+        SetPageTableEntry(Entry, Physical | LeafFlags(Flags, Shift) | PTE_LARGE_PAGE);
+        Step = PageSize;
+        break;
+      }
+
+      if(*Entry & PTE_LARGE_PAGE)
+      {
+        // Already covered by a large page from an earlier range
+        SetPageTableEntry(Entry, Flags);
+        Step = PageSize - (Virtual & (PageSize - 1));
+        break;
+      }
+
+      if(!(*Entry & PTE_PRESENT))
+      {
+        UINT64 * NewTable = NewPageTable();
+        if(NewTable == NULL)
+        {
+          return EFI_OUT_OF_RESOURCES;
+        }
+        // Permissions are enforced at the leaves, so the upper levels allow everything
+        *Entry = (UINT64)NewTable | PTE_PRESENT | PTE_WRITE;
+      }
+
+      Table = (UINT64*)(*Entry & PTE_ADDRESS_MASK);
+    }
+
+    if(Step > Size)
+    {
+      Step = Size;
+    }
+    Virtual += Step;
+    Physical += Step;
+    Size -= Step;
+  }
+
+  return EFI_SUCCESS;
+}
+
+//==================================================================================================================================
+//  UnmapGuardPages: Punch The Guard Pages Out Of The Page Tables
+//==================================================================================================================================
+//
+// Large pages that contain a guard page get split into a table of the next size down, with the same permissions and memory type,
+// until the guard page has its own 4kB entry that can be cleared.
+//
+
+STATIC EFI_STATUS SplitLargePage(UINT64 * Entry, UINT64 Shift)
+{
+  UINT64 * NewTable = NewPageTable();
+  if(NewTable == NULL)
+  {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  UINT64 ChildShift = Shift - 9;
+  UINT64 Base = *Entry & PTE_ADDRESS_MASK & ~((1ULL << Shift) - 1);
+  UINT64 Flags = *Entry & ~PTE_ADDRESS_MASK;
+
+  // The PAT bit moves to bit 7 in 4kB pages, which is where the large page bit is in bigger ones
+  if(ChildShift == 12)
+  {
+    Flags &= ~PTE_LARGE_PAGE;
+    if(*Entry & PTE_PAT_LARGE)
+    {
+      Flags |= PTE_PAT_4KB;
+    }
+  }
+  else
+  {
+    Flags |= (*Entry & PTE_PAT_LARGE);
+  }
+
+  for(UINT64 i = 0; i < 512; i++)
+  {
+    NewTable[i] = (Base + (i << ChildShift)) | Flags;
+  }
+
+  *Entry = (UINT64)NewTable | PTE_PRESENT | PTE_WRITE;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS UnmapGuardPages(UINT64 * Pml4)
+{
+  EFI_STATUS Status;
+
+  for(UINT64 i = 0; i < NumGuardPages; i++)
+  {
+    UINT64 * Table = Pml4;
+
+    for(UINT64 Shift = 39; Shift >= 12; Shift -= 9)
+    {
+      UINT64 * Entry = &Table[(GuardPages[i] >> Shift) & 0x1FF];
+
+      if(!(*Entry & PTE_PRESENT))
+      {
+        break; // Never got mapped in the first place
+      }
+
+      if(Shift == 12)
+      {
+        *Entry = 0;
+        break;
+      }
+
+      if(*Entry & PTE_LARGE_PAGE)
+      {
+        Status = SplitLargePage(Entry, Shift);
+        if(EFI_ERROR(Status))
+        {
+          return Status;
+        }
+      }
+
+      Table = (UINT64*)(*Entry & PTE_ADDRESS_MASK);
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+//==================================================================================================================================
+//  BuildPageTables: Make Page Tables For The Kernel
+//==================================================================================================================================
+//
+// Build the page tables before ExitBootServices(), since they need memory. They don't get used until LoadPageTables().
+//
+// The identity map covers the first 4GB (for the local APIC, I/O APIC, HPET, etc.), every range in the memory map, and the framebuffers,
+// all as read/write/execute and all rounded out to the page size in use. Memory types are left to the MTRRs the firmware set up, like
+// UEFI's own identity map does. Large pages are only used where the MTRRs give the whole page one type, so anything that straddles a
+// variable MTRR boundary, or the fixed-range MTRRs in the first 1MB, gets 2MB or 4kB pages instead. The MTRRs are read here, before
+// ExitBootServices(), and the WC ranges PlanFrameBufferCaching() might add for the framebuffers get counted in advance.
+//
+// With FRAMEBUFFER_WRITE_COMBINING_ENABLED, the framebuffers get mapped first, exactly (to the page) and through PAT entry 4. Everything
+// mapped after that only adds permissions to existing entries, so the framebuffers keep their memory type and nothing else gets it.
+//
+// The kernel image is mapped a second time at LOADER_PAGING_KERNEL_VIRTUAL_BASE + segment offset with each segment's permissions.
+// The kernel still gets entered at its physical address, so it can switch to the higher half whenever it's ready.
+//
+// Ranges passed to AddRuntimeMapping() get mapped exactly (to the page) at their runtime virtual addresses, on top of the identity map.
+//
+// Pages passed to AddGuardPage() get unmapped again at the end, splitting up whatever large pages they were in.
+//
+
+STATIC EFI_STATUS FillPageTables(EFI_MEMORY_DESCRIPTOR * MemMap, UINTN MemMapSize, UINTN MemMapDescriptorSize, GPU_CONFIG * Graphics, EFI_PHYSICAL_ADDRESS KernelBaseAddress, UINT64 KernelPages, UINT64 LargestPage, UINT64 MaxPhysical)
+{
+  EFI_STATUS Status;
+  UINT64 * Pml4 = NewPageTable();
+  UINT64 IdentityFlags = PTE_PRESENT | PTE_WRITE;
+
+  if(Pml4 == NULL)
+  {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+#ifdef FRAMEBUFFER_WRITE_COMBINING_ENABLED
+  for(UINT64 k = 0; k < Graphics->NumberOfFrameBuffers; k++)
+  {
+    EFI_PHYSICAL_ADDRESS Start = Graphics->GPUArray[k].FrameBufferBase & ~(EFI_PAGE_SIZE - 1);
+    EFI_PHYSICAL_ADDRESS End = (Graphics->GPUArray[k].FrameBufferBase + Graphics->GPUArray[k].FrameBufferSize + EFI_PAGE_SIZE - 1) & ~(EFI_PAGE_SIZE - 1);
+
+    if(End > MaxPhysical)
+    {
+      End = MaxPhysical;
+    }
+    if(Start < End)
+    {
+      Status = MapRange(Pml4, Start, Start, End - Start, IdentityFlags | PTE_WRITE_COMBINING, LargestPage);
+      if(EFI_ERROR(Status))
+      {
+        return Status;
+      }
+    }
+  }
+#endif
+
+  Status = MapRange(Pml4, 0, 0, 4 * SIZE_1GB_PAGE, IdentityFlags, LargestPage);
+  if(EFI_ERROR(Status))
+  {
+    return Status;
+  }
+
+  for(EFI_MEMORY_DESCRIPTOR * Piece = MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
+  {
+    EFI_PHYSICAL_ADDRESS Start = Piece->PhysicalStart & ~(LargestPage - 1);
+    EFI_PHYSICAL_ADDRESS End = (Piece->PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT) + LargestPage - 1) & ~(LargestPage - 1);
+
+    if(End > MaxPhysical)
+    {
+      End = MaxPhysical;
+    }
+    if(Start < End)
+    {
+      Status = MapRange(Pml4, Start, Start, End - Start, IdentityFlags, LargestPage);
+      if(EFI_ERROR(Status))
+      {
+        return Status;
+      }
+    }
+  }
+
+  for(UINT64 k = 0; k < Graphics->NumberOfFrameBuffers; k++)
+  {
+    EFI_PHYSICAL_ADDRESS Start = Graphics->GPUArray[k].FrameBufferBase & ~(LargestPage - 1);
+    EFI_PHYSICAL_ADDRESS End = (Graphics->GPUArray[k].FrameBufferBase + Graphics->GPUArray[k].FrameBufferSize + LargestPage - 1) & ~(LargestPage - 1);
+
+    if(End > MaxPhysical)
+    {
+      End = MaxPhysical;
+    }
+    if(Start < End)
+    {
+      Status = MapRange(Pml4, Start, Start, End - Start, IdentityFlags, LargestPage);
+      if(EFI_ERROR(Status))
+      {
+        return Status;
+      }
+    }
+  }
+
+  for(UINT64 k = 0; k < NumRuntimeMappings; k++)
+  {
+    Status = MapRange(Pml4, RuntimeMappings[k].VirtualStart, RuntimeMappings[k].PhysicalStart, RuntimeMappings[k].Size, IdentityFlags, LargestPage);
+    if(EFI_ERROR(Status))
+    {
+      return Status;
+    }
+  }
+
+  // Higher-half kernel mapping
+  UINT64 KernelSize = KernelPages << EFI_PAGE_SHIFT;
+
+  if((NumKernelSegments == 0) || KernelSegmentsOverflowed)
+  {
+    // Don't know what the segments want, so allow everything
+    return MapRange(Pml4, LOADER_PAGING_KERNEL_VIRTUAL_BASE, KernelBaseAddress, KernelSize, PTE_PRESENT | PTE_WRITE, SIZE_2MB_PAGE);
+  }
+
+  for(UINT64 i = 0; i < NumKernelSegments; i++)
+  {
+    UINT64 Start = KernelSegments[i].Offset & ~(EFI_PAGE_SIZE - 1);
+    UINT64 End = (KernelSegments[i].Offset + KernelSegments[i].Size + EFI_PAGE_SIZE - 1) & ~(EFI_PAGE_SIZE - 1);
+    UINT64 Flags = PTE_PRESENT;
+
+    if(End > KernelSize)
+    {
+      End = KernelSize;
+    }
+    if(Start >= End)
+    {
+      continue;
+    }
+
+    if(KernelSegments[i].Flags & KERNEL_SEGMENT_WRITE)
+    {
+      Flags |= PTE_WRITE;
+    }
+    if(PagingUsesNoExecute && !(KernelSegments[i].Flags & KERNEL_SEGMENT_EXECUTE))
+    {
+      Flags |= PTE_NO_EXECUTE;
+    }
+
+    Status = MapRange(Pml4, LOADER_PAGING_KERNEL_VIRTUAL_BASE + Start, KernelBaseAddress + Start, End - Start, Flags, SIZE_2MB_PAGE);
+    if(EFI_ERROR(Status))
+    {
+      return Status;
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS BuildPageTables(EFI_PHYSICAL_ADDRESS KernelBaseAddress, UINT64 KernelPages, GPU_CONFIG * Graphics, EFI_PHYSICAL_ADDRESS * PageTableRoot)
+{
+  EFI_STATUS paging_status;
+  UINT32 Eax, Ebx, Ecx, Edx;
+  UINT64 LargestPage = SIZE_2MB_PAGE;
+  UINT64 MaxPhysical = 1ULL << 36; // Every x86-64 CPU supports at least this much
+
+  if(ReadCr4() & CR4_LA57)
+  {
+    Print(L"Firmware has 5-level paging turned on, can't use 4-level loader page tables.\r\n");
+    return EFI_UNSUPPORTED;
+  }
+
+  CpuId(CPUID_EXTENDED_MAX_LEAF, 0, &Eax, &Ebx, &Ecx, &Edx);
+  UINT32 MaxExtendedLeaf = Eax;
+
+  if(MaxExtendedLeaf >= CPUID_EXTENDED_FEATURES)
+  {
+    CpuId(CPUID_EXTENDED_FEATURES, 0, &Eax, &Ebx, &Ecx, &Edx);
+    if(Edx & CPUID_EXTENDED_EDX_1GB)
+    {
+      LargestPage = SIZE_1GB_PAGE;
+    }
+    if(Edx & CPUID_EXTENDED_EDX_NX)
+    {
+      PagingUsesNoExecute = 1;
+    }
+  }
+
+  if(MaxExtendedLeaf >= CPUID_ADDRESS_SIZES)
+  {
+    CpuId(CPUID_ADDRESS_SIZES, 0, &Eax, &Ebx, &Ecx, &Edx);
+    MaxPhysical = 1ULL << (Eax & 0xFF);
+  }
+
+  // The identity map has to stay in the lower canonical half
+  if(MaxPhysical > (1ULL << 47))
+  {
+    MaxPhysical = 1ULL << 47;
+  }
+
+  // Take a snapshot of the MTRRs, so that large pages don't straddle memory types
+  NumPagingMtrrs = 0;
+  PagingMtrrsOverflowed = 0;
+  PagingFixedMtrrs = 0;
+
+  CpuId(CPUID_FEATURES, 0, &Eax, &Ebx, &Ecx, &Edx);
+  if(Edx & CPUID_FEATURES_EDX_MTRR)
+  {
+    UINT64 MtrrCap = ReadMsr(MSR_MTRRCAP);
+    UINT64 DefType = ReadMsr(MSR_MTRR_DEF_TYPE);
+
+    // With MTRRs turned off everything is UC, which is as uniform as it gets
+    if(DefType & MTRR_DEF_TYPE_E)
+    {
+      PagingFixedMtrrs = (MtrrCap & MTRRCAP_FIX) && (DefType & MTRR_DEF_TYPE_FE);
+
+      for(UINT64 i = 0; i < (MtrrCap & MTRRCAP_VCNT_MASK); i++)
+      {
+        UINT64 PhysMask = ReadMsr(MSR_MTRR_PHYSMASK(i));
+        if(PhysMask & MTRR_PHYSMASK_VALID)
+        {
+          AddPagingMtrr(ReadMsr(MSR_MTRR_PHYSBASE(i)), PhysMask);
+        }
+      }
+    }
+  }
+
+#ifdef FRAMEBUFFER_WRITE_COMBINING_ENABLED
+  // PlanFrameBufferCaching() runs after this and might cover each framebuffer with the smallest naturally aligned power of 2 that
+  // contains it, so count those blocks as MTRR ranges already
+  for(UINT64 k = 0; k < Graphics->NumberOfFrameBuffers; k++)
+  {
+    EFI_PHYSICAL_ADDRESS Base = Graphics->GPUArray[k].FrameBufferBase;
+    UINT64 Size = Graphics->GPUArray[k].FrameBufferSize;
+    UINT64 BlockSize = EFI_PAGE_SIZE;
+
+    if(Size == 0)
+    {
+      continue;
+    }
+
+    while(((Base & ~(BlockSize - 1)) + BlockSize < Base + Size) && (BlockSize < MaxPhysical))
+    {
+      BlockSize <<= 1;
+    }
+    AddPagingMtrr(Base, ~(BlockSize - 1));
+  }
+#endif
+
+  if(PagingMtrrsOverflowed)
+  {
+    LOG_MESSAGE(HANDOFF, WARNING, L"Too many MTRR ranges to keep track of, some large pages might straddle memory types");
+  }
+
+  // Take a snapshot of the memory map. Allocations between now and ExitBootServices() only change the types of ranges, not which
+  // addresses exist, so this covers everything the final map will.
+  UINTN MemMapSize, MemMapDescriptorSize;
+  EFI_MEMORY_DESCRIPTOR * MemMap;
+
+  paging_status = GetMemoryMapCopy(&MemMap, &MemMapSize, &MemMapDescriptorSize);
+  if(EFI_ERROR(paging_status))
+  {
+    return paging_status;
+  }
+
+  // Guess at how many tables are needed: the identity map needs a few per memory map range at most, and the kernel needs a page
+  // table per 2MB plus a couple per segment for unaligned ends. Runtime mappings need a couple for their ends and maybe a directory. Each
+  // MTRR range can split a 1GB and a 2MB page at each end. If that's not enough, double it and try again.
+  PageTablePoolPages = 16 + 4 * (MemMapSize / MemMapDescriptorSize) + (KernelPages >> 9) + 2 * NumKernelSegments + 2 * NumGuardPages + 3 * NumRuntimeMappings + 4 * NumPagingMtrrs;
+  if(LargestPage == SIZE_2MB_PAGE)
+  {
+    PageTablePoolPages += 4 + (MaxPhysical >> 39); // The first 4GB, plus a PDPT per 512GB
+  }
+
+  do {
+    EFI_PHYSICAL_ADDRESS PoolAddress = 0;
+
+    paging_status = BS->AllocatePages(AllocateAnyPages, EfiLoaderData, PageTablePoolPages, &PoolAddress);
+    if(EFI_ERROR(paging_status))
+    {
+      Print(L"Page table AllocatePages error. 0x%llx\r\n", paging_status);
+      BS->FreePool(MemMap);
+      return paging_status;
+    }
+
+    PageTablePool = (UINT64*)PoolAddress;
+    PageTablePoolUsed = 0;
+    ZeroMem(PageTablePool, PageTablePoolPages << EFI_PAGE_SHIFT);
+
+    paging_status = FillPageTables(MemMap, MemMapSize, MemMapDescriptorSize, Graphics, KernelBaseAddress, KernelPages, LargestPage, MaxPhysical);
+    if(!EFI_ERROR(paging_status))
+    {
+      paging_status = UnmapGuardPages(PageTablePool);
+    }
+    if(paging_status == EFI_OUT_OF_RESOURCES)
+    {
+      BS->FreePages(PoolAddress, PageTablePoolPages);
+      PageTablePoolPages *= 2;
+    }
+  } while(paging_status == EFI_OUT_OF_RESOURCES);
+
+  LOG_MESSAGE(HANDOFF, DEBUG, L"Page tables at 0x%llx: %llu of %llu pages used, largest page 0x%llx, NX: %u, MTRR ranges: %llu", (UINT64)PageTablePool, PageTablePoolUsed, PageTablePoolPages, LargestPage, (UINT32)PagingUsesNoExecute, NumPagingMtrrs);
+
+  *PageTableRoot = (EFI_PHYSICAL_ADDRESS)PageTablePool; // The PML4 is always the first table
+
+  paging_status = BS->FreePool(MemMap);
+  if(EFI_ERROR(paging_status))
+  {
+    Print(L"Error freeing paging MemMap pool. 0x%llx\r\n", paging_status);
+  }
+
+  return paging_status;
+}
+
+//==================================================================================================================================
+//  LoadPageTables: Switch To The Loader-Built Page Tables
+//==================================================================================================================================
+//
+// Meant to be called after ExitBootServices(), right before jumping to the kernel. This also turns on EFER.NXE (if the tables use the
+// NX bit, since it's a reserved bit otherwise) and CR0.WP (so read-only kernel segments are actually read-only).
+//
+
+VOID LoadPageTables(EFI_PHYSICAL_ADDRESS PageTableRoot)
+{
+  if(PagingUsesNoExecute)
+  {
+    WriteMsr(MSR_EFER, ReadMsr(MSR_EFER) | EFER_NXE);
+  }
+
+  WriteCr0(ReadCr0() | CR0_WP);
+  WriteCr3(PageTableRoot);
+}
+
+#endif
@@ -0,0 +1,377 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Application Processor Parking Functions
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This file contains the functions that send the application processors (APs) into a parking loop before ExitBootServices(), where
+// they wait on per-CPU mailboxes for the kernel to give them somewhere to jump. See LOADER_AP_MAILBOX in Bootloader.h for how that works.
+//
+// NOTE: The parking loop gets copied into its own EfiLoaderCode page, so unlike the rest of the bootloader, the kernel has to leave
+// that page (and the mailboxes and stacks) alone until every AP has been started.
+//
+// Only used if AP_PARKING_ENABLED is defined in Bootloader.h.
+//
+
+#include "Bootloader.h"
+
+#ifdef AP_PARKING_ENABLED
+
+STATIC EFI_GUID ApParkingMpServicesGuid = EFI_MP_SERVICES_PROTOCOL_GUID;
+
+//==================================================================================================================================
+//  ApParkingLoop: Where The APs Wait
+//==================================================================================================================================
+//
+// Entered with RDI pointing to the AP's LOADER_AP_MAILBOX and RSP at the top of its parking stack. This only uses relative jumps and
+// the mailbox, so it still works after being copied somewhere else, and after firmware's memory is gone.
+//
+// MONITOR gets armed before the mailbox is checked one last time, since a write that lands between the first check and MONITOR
+// wouldn't wake MWAIT up. Anything that writes to the mailbox's line does, and so does INIT, so INIT-SIPI-SIPI still works on a parked AP.
+//
+
+extern UINT8 ApParkingLoop[];
+extern UINT8 ApParkingLoopEnd[];
+
+__asm__(".text\n"
+        ".balign 16\n"
+        "ApParkingLoop:\n"
+        "cli\n"
+        "movq %rdi, %r8\n"
+        "movl $1, %eax\n"
+        "cpuid\n"
+        "movl %ecx, %r9d\n"
+        "andl $8, %r9d\n"               // CPUID_FEATURES_ECX_MONITOR
+        "movl $1, 32(%r8)\n"            // Status = LOADER_AP_PARKED
+        "1:\n"
+        "movq 0(%r8), %rax\n"           // JumpAddress
+        "testq %rax, %rax\n"
+        "jnz 4f\n"
+        "movl 40(%r8), %ecx\n"          // Ping
+        "cmpl %ecx, 44(%r8)\n"          // Pong
+        "jne 3f\n"
+        "testl %r9d, %r9d\n"
+        "jz 2f\n"
+        "movq %r8, %rax\n"
+        "xorl %ecx, %ecx\n"
+        "xorl %edx, %edx\n"
+        "monitor\n"
+        "cmpq $0, 0(%r8)\n"
+        "jne 1b\n"
+        "movl 40(%r8), %ecx\n"
+        "cmpl %ecx, 44(%r8)\n"
+        "jne 1b\n"
+        "xorl %eax, %eax\n"             // C1
+        "xorl %ecx, %ecx\n"             // No interrupt break events, since interrupts are off anyway
+        "mwait\n"
+        "jmp 1b\n"
+        "2:\n"
+        "pause\n"
+        "jmp 1b\n"
+        "3:\n"
+        "movl %ecx, %r10d\n"            // Ping, since RDMSR and WRMSR need ECX
+        "movq 56(%r8), %r11\n"          // EferBits, which have to be on before the new page tables are
+        "testq %r11, %r11\n"
+        "jz 7f\n"
+        "movl $0xC0000080, %ecx\n"      // MSR_EFER
+        "rdmsr\n"
+        "orl %r11d, %eax\n"             // Every EFER bit is in the low half
+        "wrmsr\n"
+        "7:\n"
+        "movq 24(%r8), %rdx\n"          // Cr3
+        "testq %rdx, %rdx\n"
+        "jz 5f\n"
+        "movq %rdx, %cr3\n"
+        "5:\n"
+        "movl %r10d, 44(%r8)\n"
+        "jmp 1b\n"
+        "4:\n"
+        "movq 16(%r8), %rdx\n"          // StackPointer
+        "testq %rdx, %rdx\n"
+        "jnz 6f\n"
+        "movq 48(%r8), %rdx\n"          // StackTop
+        "6:\n"
+        "leaq -40(%rdx), %rsp\n"
+        "movq $0, (%rsp)\n"
+        "movq 8(%r8), %rcx\n"           // Argument
+        "movq %rcx, %rdi\n"
+        "movq %r8, %rdx\n"
+        "movq %r8, %rsi\n"
+        "xorl %ebp, %ebp\n"
+        "movl $2, 32(%r8)\n"            // Status = LOADER_AP_STARTED, after the last read from the mailbox
+        "jmp *%rax\n"
+        "ApParkingLoopEnd:\n");
+
+//==================================================================================================================================
+//  ApParkingWorker: Send An AP To The Parking Loop
+//==================================================================================================================================
+//
+// This runs on the APs through EFI_MP_SERVICES_PROTOCOL, so no boot services in here. Each AP finds its own mailbox by APIC ID and
+// leaves firmware's stack for good. An AP without a mailbox just returns.
+//
+
+STATIC VOID EFIAPI ApParkingWorker(VOID * Argument)
+{
+  LOADER_AP_PARKING * Parking = (LOADER_AP_PARKING*)Argument;
+  UINT32 ApicId = GetInitialApicId();
+
+  for(UINT32 i = 0; i < Parking->NumberOfMailboxes; i++)
+  {
+    LOADER_AP_MAILBOX * Mailbox = (LOADER_AP_MAILBOX*)(Parking->Mailboxes + (UINT64)i * Parking->MailboxStride);
+    if(Mailbox->ApicId == ApicId)
+    {
+      __asm__ __volatile__("movq %0, %%rsp\n\t"
+                           "jmp *%1"
+                           :
+                           : "r" (Mailbox->StackTop), "r" (Parking->ParkingCode), "D" (Mailbox)
+                           : "memory");
+      __builtin_unreachable();
+    }
+  }
+}
+
+//==================================================================================================================================
+//  WaitForApPongs: Wait For Parked APs To Answer
+//==================================================================================================================================
+//
+// Wait until every mailbox with a Status of LOADER_AP_PARKED has Pong equal to Ping, or until Ticks TSC ticks have gone by. Returns
+// how many of them answered.
+//
+
+STATIC UINT32 WaitForApPongs(LOADER_AP_PARKING * Parking, UINT64 Ticks)
+{
+  UINT64 Start = ReadTsc();
+  UINT32 Answered;
+
+  do
+  {
+    UINT32 Waiting = 0;
+    Answered = 0;
+
+    for(UINT32 i = 0; i < Parking->NumberOfMailboxes; i++)
+    {
+      LOADER_AP_MAILBOX * Mailbox = (LOADER_AP_MAILBOX*)(Parking->Mailboxes + (UINT64)i * Parking->MailboxStride);
+      if(Mailbox->Status != LOADER_AP_PARKED)
+      {
+        continue;
+      }
+
+      if(Mailbox->Pong == Mailbox->Ping)
+      {
+        Answered++;
+      }
+      else
+      {
+        Waiting++;
+      }
+    }
+
+    if(Waiting == 0)
+    {
+      break;
+    }
+    CpuPause();
+  } while(ReadTsc() - Start < Ticks);
+
+  return Answered;
+}
+
+//==================================================================================================================================
+//  ParkApplicationProcessors: Send Every AP To A Mailbox
+//==================================================================================================================================
+//
+// Give every enabled AP a mailbox and a stack, copy the parking loop into its own page, and start it on all of the APs at once. This
+// has to run after anything else that uses EFI_MP_SERVICES_PROTOCOL, since the APs never come back. Returns EFI_UNSUPPORTED if there's
+// no MP services protocol or no APs, in which case the kernel has to start the APs itself.
+//
+// StartupAllAPs() is called in non-blocking mode, and its event is left open on purpose: it never gets signaled, and firmware may still
+// be holding on to it.
+//
+
+EFI_STATUS ParkApplicationProcessors(LOADER_AP_PARKING ** Parking)
+{
+  EFI_STATUS parking_status;
+  EFI_MP_SERVICES_PROTOCOL * MpServices;
+  UINTN NumberOfProcessors, NumberOfEnabledProcessors;
+  UINT32 Eax, Ebx, Ecx, Edx;
+
+  if(EFI_ERROR(BS->LocateProtocol(&ApParkingMpServicesGuid, NULL, (void**)&MpServices)) || EFI_ERROR(MpServices->GetNumberOfProcessors(MpServices, &NumberOfProcessors, &NumberOfEnabledProcessors)) || (NumberOfEnabledProcessors < 2))
+  {
+    return EFI_UNSUPPORTED;
+  }
+
+  UINT64 TscFrequency = GetTscFrequency();
+  if(TscFrequency < 1000)
+  {
+    Print(L"TSC doesn't seem to be running, can't time AP parking.\r\n");
+    return EFI_UNSUPPORTED;
+  }
+
+  // Every mailbox gets a whole MONITOR line, so writing to one doesn't wake up its neighbors
+  UINT32 Flags = 0;
+  UINT32 MailboxStride = sizeof(LOADER_AP_MAILBOX);
+  CpuId(CPUID_MAX_LEAF, 0, &Eax, &Ebx, &Ecx, &Edx);
+  UINT32 MaxLeaf = Eax;
+  CpuId(CPUID_FEATURES, 0, &Eax, &Ebx, &Ecx, &Edx);
+  if(Ecx & CPUID_FEATURES_ECX_MONITOR)
+  {
+    Flags |= LOADER_AP_PARKING_MWAIT;
+
+    if(MaxLeaf >= CPUID_MONITOR)
+    {
+      CpuId(CPUID_MONITOR, 0, &Eax, &Ebx, &Ecx, &Edx);
+      UINT32 LineSize = Ebx & 0xFFFF;
+      if((LineSize > MailboxStride) && (LineSize <= EFI_PAGE_SIZE))
+      {
+        MailboxStride = (LineSize + sizeof(LOADER_AP_MAILBOX) - 1) & ~(UINT32)(sizeof(LOADER_AP_MAILBOX) - 1);
+      }
+    }
+  }
+
+  UINT64 MaxAps = NumberOfEnabledProcessors - 1;
+  UINT64 StackSize = EFI_SIZE_TO_PAGES((UINT64)AP_PARKING_STACK_KB << 10) << EFI_PAGE_SHIFT;
+  EFI_PHYSICAL_ADDRESS Mailboxes = 0, Stacks = 0, ParkingCode = 0;
+
+  parking_status = BS->AllocatePages(AllocateAnyPages, EfiLoaderData, EFI_SIZE_TO_PAGES(MaxAps * MailboxStride), &Mailboxes);
+  if(EFI_ERROR(parking_status))
+  {
+    Print(L"AP mailbox AllocatePages error. 0x%llx\r\n", parking_status);
+    return parking_status;
+  }
+  ZeroMem((VOID*)Mailboxes, EFI_SIZE_TO_PAGES(MaxAps * MailboxStride) << EFI_PAGE_SHIFT);
+
+  parking_status = BS->AllocatePages(AllocateAnyPages, EfiLoaderData, EFI_SIZE_TO_PAGES(MaxAps * StackSize), &Stacks);
+  if(EFI_ERROR(parking_status))
+  {
+    Print(L"AP stack AllocatePages error. 0x%llx\r\n", parking_status);
+    return parking_status;
+  }
+
+  // EfiLoaderCode, since firmware might not allow running anything from EfiLoaderData
+  parking_status = BS->AllocatePages(AllocateAnyPages, EfiLoaderCode, 1, &ParkingCode);
+  if(EFI_ERROR(parking_status))
+  {
+    Print(L"AP parking code AllocatePages error. 0x%llx\r\n", parking_status);
+    return parking_status;
+  }
+  CopyMem((VOID*)ParkingCode, ApParkingLoop, (UINT64)(ApParkingLoopEnd - ApParkingLoop));
+
+  parking_status = BS->AllocatePool(EfiLoaderData, sizeof(LOADER_AP_PARKING), (void**)Parking);
+  if(EFI_ERROR(parking_status))
+  {
+    Print(L"AP parking AllocatePool error. 0x%llx\r\n", parking_status);
+    return parking_status;
+  }
+
+  LOADER_AP_PARKING * Info = *Parking;
+  Info->NumberOfMailboxes = 0;
+  Info->MailboxStride = MailboxStride;
+  Info->BspApicId = GetInitialApicId();
+  Info->Flags = Flags;
+  Info->Mailboxes = Mailboxes;
+  Info->ParkingCode = ParkingCode;
+  Info->StackSize = StackSize;
+
+  for(UINTN ProcessorNumber = 0; (ProcessorNumber < NumberOfProcessors) && (Info->NumberOfMailboxes < MaxAps); ProcessorNumber++)
+  {
+    EFI_PROCESSOR_INFORMATION ProcessorInfo;
+    if(EFI_ERROR(MpServices->GetProcessorInfo(MpServices, ProcessorNumber, &ProcessorInfo)))
+    {
+      continue;
+    }
+
+    if((ProcessorInfo.StatusFlag & PROCESSOR_AS_BSP_BIT) || !(ProcessorInfo.StatusFlag & PROCESSOR_ENABLED_BIT))
+    {
+      continue;
+    }
+
+    LOADER_AP_MAILBOX * Mailbox = (LOADER_AP_MAILBOX*)(Mailboxes + (UINT64)Info->NumberOfMailboxes * MailboxStride);
+    Mailbox->Status = LOADER_AP_NOT_PARKED;
+    Mailbox->ApicId = (UINT32)ProcessorInfo.ProcessorId;
+    Mailbox->StackTop = Stacks + (Info->NumberOfMailboxes + 1) * StackSize;
+    Info->NumberOfMailboxes++;
+  }
+
+  EFI_EVENT ApsDone = NULL;
+  parking_status = BS->CreateEvent(0, 0, NULL, NULL, &ApsDone);
+  if(EFI_ERROR(parking_status))
+  {
+    Print(L"AP parking CreateEvent error. 0x%llx\r\n", parking_status);
+    return parking_status;
+  }
+
+  parking_status = MpServices->StartupAllAPs(MpServices, ApParkingWorker, FALSE, ApsDone, 0, Info, NULL);
+  if(EFI_ERROR(parking_status))
+  {
+    Print(L"AP parking StartupAllAPs error. 0x%llx\r\n", parking_status);
+    BS->CloseEvent(ApsDone);
+    return parking_status;
+  }
+
+  // A mailbox that never gets to LOADER_AP_PARKED just stays LOADER_AP_NOT_PARKED
+  UINT64 Start = ReadTsc();
+  UINT64 Ticks = (TscFrequency / 1000) * AP_PARKING_TIMEOUT_MS;
+  UINT32 Parked;
+  do
+  {
+    Parked = 0;
+    for(UINT32 i = 0; i < Info->NumberOfMailboxes; i++)
+    {
+      LOADER_AP_MAILBOX * Mailbox = (LOADER_AP_MAILBOX*)(Mailboxes + (UINT64)i * MailboxStride);
+      Parked += (Mailbox->Status == LOADER_AP_PARKED);
+    }
+    CpuPause();
+  } while((Parked < Info->NumberOfMailboxes) && (ReadTsc() - Start < Ticks));
+
+  LOG_MESSAGE(HANDOFF, DEBUG, L"Parked %u of %u APs, mailboxes at 0x%llx (%u bytes apart), MWAIT: %u", Parked, Info->NumberOfMailboxes, Mailboxes, MailboxStride, (Flags & LOADER_AP_PARKING_MWAIT) ? 1 : 0);
+
+  return EFI_SUCCESS;
+}
+
+//==================================================================================================================================
+//  CheckParkedApplicationProcessors: Make Sure The APs Are Still Parked
+//==================================================================================================================================
+//
+// Meant to be called after ExitBootServices(), once PageTableRoot (if not 0) is loaded on the BSP. Some firmware sends its own APs back
+// to a loop of its own at ExitBootServices(), which leaves stale LOADER_AP_PARKED mailboxes behind, so this pings every parked AP and
+// marks the ones that don't answer as LOADER_AP_NOT_PARKED. The ones that do answer get moved to the loader's page tables on the way,
+// so they don't depend on any of firmware's memory anymore. They also get EFER.NXE if the BSP has it, since the kernel's mappings in
+// those page tables can have the NX bit set, which is a reserved bit (and a page fault) without it.
+//
+
+VOID CheckParkedApplicationProcessors(LOADER_AP_PARKING * Parking, EFI_PHYSICAL_ADDRESS PageTableRoot)
+{
+  UINT64 EferBits = ReadMsr(MSR_EFER) & EFER_NXE;
+
+  for(UINT32 i = 0; i < Parking->NumberOfMailboxes; i++)
+  {
+    LOADER_AP_MAILBOX * Mailbox = (LOADER_AP_MAILBOX*)(Parking->Mailboxes + (UINT64)i * Parking->MailboxStride);
+    if(Mailbox->Status == LOADER_AP_PARKED)
+    {
+      Mailbox->EferBits = EferBits;
+      Mailbox->Cr3 = PageTableRoot;
+      Mailbox->Ping++;
+    }
+  }
+
+  WaitForApPongs(Parking, (GetTscFrequency() / 1000) * AP_PARKING_TIMEOUT_MS);
+
+  for(UINT32 i = 0; i < Parking->NumberOfMailboxes; i++)
+  {
+    LOADER_AP_MAILBOX * Mailbox = (LOADER_AP_MAILBOX*)(Parking->Mailboxes + (UINT64)i * Parking->MailboxStride);
+    if((Mailbox->Status == LOADER_AP_PARKED) && (Mailbox->Pong != Mailbox->Ping))
+    {
+      Mailbox->Status = LOADER_AP_NOT_PARKED;
+    }
+    Mailbox->Cr3 = 0;
+    Mailbox->EferBits = 0;
+  }
+}
+
+#endif
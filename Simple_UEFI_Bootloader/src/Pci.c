@@ -0,0 +1,246 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: PCI Inventory Functions
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This file contains the functions that list every PCI function firmware enumerated, using the EFI_PCI_IO_PROTOCOL handles it left
+// behind, so kernels don't have to scan all of config space again just to find out what's there.
+//
+
+#include "Bootloader.h"
+
+//==================================================================================================================================
+//  GetPciDriverName: Get The Name Of The Driver Managing A PCI Device
+//==================================================================================================================================
+//
+// Find the driver that has PciIo open BY_DRIVER on Handle (the same test Graphics.c does for GPUs, but asking the handle instead of
+// trying every driver) and copy its EFI_COMPONENT_NAME2_PROTOCOL name into Name as null-terminated ASCII. Returns 1 if there's a driver,
+// even if it doesn't have a name.
+//
+
+STATIC UINT8 GetPciDriverName(EFI_HANDLE ImageHandle, EFI_HANDLE Handle, CHAR8 * Name)
+{
+  EFI_OPEN_PROTOCOL_INFORMATION_ENTRY * Entries;
+  UINTN NumberOfEntries;
+  EFI_HANDLE Driver = NULL;
+
+  if(EFI_ERROR(BS->OpenProtocolInformation(Handle, &PciIoProtocol, &Entries, &NumberOfEntries)))
+  {
+    return 0;
+  }
+
+  for(UINTN i = 0; i < NumberOfEntries; i++)
+  {
+    if(Entries[i].Attributes & EFI_OPEN_PROTOCOL_BY_DRIVER)
+    {
+      Driver = Entries[i].AgentHandle;
+      break;
+    }
+  }
+  BS->FreePool(Entries);
+
+  if(Driver == NULL)
+  {
+    return 0;
+  }
+
+  // Device names don't work on Macs, see InitUEFI_GOP()
+  EFI_COMPONENT_NAME2_PROTOCOL * Name2Device;
+  if(IsApple || EFI_ERROR(BS->OpenProtocol(Driver, &ComponentName2Protocol, (void**)&Name2Device, ImageHandle, NULL, EFI_OPEN_PROTOCOL_GET_PROTOCOL)))
+  {
+    return 1;
+  }
+
+  CHAR8 LanguageToUse[6] = {'e','n','-','U','S','\0'};
+  CHAR8 LanguageToUse2[3] = {'e','n','\0'};
+  CHAR8 LanguageToUse3[4] = {'e','n','g','\0'};
+  CHAR16 * DriverDisplayName;
+
+  EFI_STATUS pci_status = Name2Device->GetDriverName(Name2Device, LanguageToUse, &DriverDisplayName);
+  if(pci_status == EFI_UNSUPPORTED)
+  {
+    pci_status = Name2Device->GetDriverName(Name2Device, LanguageToUse2, &DriverDisplayName);
+    if(pci_status == EFI_UNSUPPORTED)
+    {
+      pci_status = Name2Device->GetDriverName(Name2Device, LanguageToUse3, &DriverDisplayName);
+    }
+  }
+
+  if(!EFI_ERROR(pci_status))
+  {
+    UINT32 Length = 0;
+    while((Length < PCI_DEVICE_NAME_SIZE - 1) && (DriverDisplayName[Length] != L'\0'))
+    {
+      Name[Length] = (DriverDisplayName[Length] < 0x80) ? (CHAR8)DriverDisplayName[Length] : '?';
+      Length++;
+    }
+    Name[Length] = '\0';
+  }
+
+  return 1;
+}
+
+//==================================================================================================================================
+//  GetPciBar: Describe One BAR
+//==================================================================================================================================
+//
+// Ask firmware where it put BAR BarIndex and how big it is, instead of sizing it by writing to config space.
+//
+
+STATIC VOID GetPciBar(EFI_PCI_IO_PROTOCOL * PciIo, UINT8 BarIndex, PCI_DEVICE_BAR * Bar)
+{
+  ACPI_QWORD_ADDRESS_SPACE * Resource;
+
+  if(EFI_ERROR(PciIo->GetBarAttributes(PciIo, BarIndex, NULL, (VOID**)&Resource)))
+  {
+    return; // Not implemented, or the upper half of a 64-bit BAR
+  }
+
+  if(Resource->Desc == ACPI_QWORD_ADDRESS_SPACE_DESCRIPTOR)
+  {
+    Bar->Address = Resource->AddrRangeMin;
+    Bar->Size = Resource->AddrLen;
+
+    if(Resource->ResType == ACPI_ADDRESS_SPACE_TYPE_IO)
+    {
+      Bar->Type = PCI_BAR_IO;
+    }
+    else if(Resource->ResType == ACPI_ADDRESS_SPACE_TYPE_MEM)
+    {
+      Bar->Type = (Resource->AddrSpaceGranularity == 64) ? PCI_BAR_MEMORY64 : PCI_BAR_MEMORY32;
+      if((Resource->SpecificFlag & ACPI_MEMORY_RESOURCE_PREFETCHABLE) == ACPI_MEMORY_RESOURCE_PREFETCHABLE)
+      {
+        Bar->Flags |= PCI_BAR_PREFETCHABLE;
+      }
+    }
+  }
+
+  BS->FreePool(Resource);
+}
+
+//==================================================================================================================================
+//  GetPciInventory: List Every PCI Function
+//==================================================================================================================================
+//
+// Allocate a PCI_INVENTORY and fill it with one PCI_DEVICE per EFI_PCI_IO_PROTOCOL handle, sorted by segment, bus, device and
+// function. Everything comes from firmware's own records and the first 64 bytes of config space, so nothing gets written to any device.
+// No PciIo handles at all (e.g. a VM without PCI) just means an empty list.
+//
+
+EFI_STATUS GetPciInventory(EFI_HANDLE ImageHandle, PCI_INVENTORY ** Inventory)
+{
+  EFI_STATUS pci_status;
+  EFI_HANDLE * PciHandles = NULL;
+  UINTN NumPciHandles = 0;
+
+  pci_status = BS->LocateHandleBuffer(ByProtocol, &PciIoProtocol, NULL, &NumPciHandles, &PciHandles);
+  if(EFI_ERROR(pci_status))
+  {
+    NumPciHandles = 0;
+    PciHandles = NULL;
+  }
+
+  pci_status = BS->AllocatePool(EfiLoaderData, sizeof(PCI_INVENTORY) + NumPciHandles * sizeof(PCI_DEVICE), (void**)Inventory);
+  if(EFI_ERROR(pci_status))
+  {
+    Print(L"Error allocating PCI inventory. 0x%llx\r\n", pci_status);
+    return pci_status;
+  }
+
+  PCI_INVENTORY * List = *Inventory;
+  ZeroMem(List, sizeof(PCI_INVENTORY) + NumPciHandles * sizeof(PCI_DEVICE));
+
+  for(UINTN i = 0; i < NumPciHandles; i++)
+  {
+    EFI_PCI_IO_PROTOCOL * PciIo;
+    UINTN Segment, Bus, Device, Function;
+    UINT32 Config[16];
+
+    if(EFI_ERROR(BS->OpenProtocol(PciHandles[i], &PciIoProtocol, (void**)&PciIo, ImageHandle, NULL, EFI_OPEN_PROTOCOL_GET_PROTOCOL)))
+    {
+      continue;
+    }
+
+    if(EFI_ERROR(PciIo->GetLocation(PciIo, &Segment, &Bus, &Device, &Function)) || EFI_ERROR(PciIo->Pci.Read(PciIo, EfiPciIoWidthUint32, 0, 16, Config)))
+    {
+      continue;
+    }
+
+    PCI_DEVICE * Entry = &List->Devices[List->NumberOfDevices++];
+    Entry->Segment = (UINT16)Segment;
+    Entry->Bus = (UINT8)Bus;
+    Entry->Device = (UINT8)Device;
+    Entry->Function = (UINT8)Function;
+    Entry->VendorId = (UINT16)Config[0];
+    Entry->DeviceId = (UINT16)(Config[0] >> 16);
+    Entry->RevisionId = (UINT8)Config[2];
+    Entry->ProgInterface = (UINT8)(Config[2] >> 8);
+    Entry->SubClass = (UINT8)(Config[2] >> 16);
+    Entry->BaseClass = (UINT8)(Config[2] >> 24);
+    Entry->HeaderType = (UINT8)(Config[3] >> 16) & 0x7F;
+
+    UINT8 NumberOfBars = 0;
+    if(Entry->HeaderType == 0)
+    {
+      Entry->SubsystemVendorId = (UINT16)Config[11];
+      Entry->SubsystemId = (UINT16)(Config[11] >> 16);
+      NumberOfBars = 6;
+    }
+    else if(Entry->HeaderType == 1)
+    {
+      NumberOfBars = 2;
+    }
+
+    for(UINT8 Bar = 0; Bar < NumberOfBars; Bar++)
+    {
+      GetPciBar(PciIo, Bar, &Entry->Bars[Bar]);
+    }
+
+    Entry->RomSize = PciIo->RomSize;
+    if((PciIo->RomImage != NULL) && (PciIo->RomSize != 0))
+    {
+      Entry->Flags |= PCI_DEVICE_HAS_ROM;
+    }
+
+    if(GetPciDriverName(ImageHandle, PciHandles[i], Entry->DriverName))
+    {
+      Entry->Flags |= PCI_DEVICE_DRIVER_BOUND;
+    }
+  }
+
+  if(PciHandles != NULL)
+  {
+    BS->FreePool(PciHandles);
+  }
+
+  // Insertion sort, since firmware usually creates the handles in bus scan order anyway
+  for(UINT32 i = 1; i < List->NumberOfDevices; i++)
+  {
+    PCI_DEVICE Entry = List->Devices[i];
+    UINT64 Key = ((UINT64)Entry.Segment << 24) | ((UINT64)Entry.Bus << 16) | ((UINT64)Entry.Device << 8) | Entry.Function;
+    UINT32 j = i;
+
+    while(j > 0)
+    {
+      PCI_DEVICE * Previous = &List->Devices[j - 1];
+      if((((UINT64)Previous->Segment << 24) | ((UINT64)Previous->Bus << 16) | ((UINT64)Previous->Device << 8) | Previous->Function) <= Key)
+      {
+        break;
+      }
+      List->Devices[j] = *Previous;
+      j--;
+    }
+    List->Devices[j] = Entry;
+  }
+
+  LOG_MESSAGE(HANDOFF, DEBUG, L"PCI inventory: %u functions", List->NumberOfDevices);
+
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,621 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Kernel Placement Functions
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This file contains the functions that find a home for the kernel in physical memory. They only talk to the firmware through
+// BS->AllocatePages(), BS->FreePages(), BS->GetMemoryMap(), the pool functions, and RT->GetVariable() and RT->SetVariable() for the
+// placement memo, so tools/Replay can build this file as-is on the host and run it against a simulated memory map.
+//
+// On machines whose firmware hands out memory that isn't really free, FindActuallyFreePages() can take a long time searching for some
+// that is, and it would find the same place on every boot. So when it has to search, where it ended up gets saved in the
+// LoaderPlacement UEFI variable (LOADER_PLACEMENT_MEMO), and the next time it's the same kernel, that address gets tried first.
+//
+
+#include "Bootloader.h"
+
+UINT32 PlacementMemoHits = 0;
+UINT32 PlacementMemoMisses = 0;
+
+STATIC EFI_GUID PlacementVariableGuid = LOADER_VARIABLE_GUID;
+
+//==================================================================================================================================
+//  ReadPlacementMemo: Get The Placement Memo
+//==================================================================================================================================
+//
+// Read LoaderPlacement into Memo, which comes out all 0 if there isn't one.
+//
+
+STATIC VOID ReadPlacementMemo(LOADER_PLACEMENT_MEMO * Memo)
+{
+  UINTN MemoSize = sizeof(LOADER_PLACEMENT_MEMO);
+  LOADER_PLACEMENT_MEMO NoMemo = {0};
+
+  if(EFI_ERROR(RT->GetVariable(L"LoaderPlacement", &PlacementVariableGuid, NULL, &MemoSize, Memo)) || (MemoSize != sizeof(LOADER_PLACEMENT_MEMO)))
+  {
+    *Memo = NoMemo;
+  }
+}
+
+//==================================================================================================================================
+//  PlacementKernelId: Identify A Kernel For The Placement Memo
+//==================================================================================================================================
+//
+// FNV-1a of the kernel's path (case-insensitively, since it's on FAT) and file size. A rebuilt kernel of the same size gets the same
+// ID, which is fine: it needs the same number of pages.
+//
+
+UINT64 PlacementKernelId(CONST CHAR16 * KernelPath, UINT64 FileSize)
+{
+  UINT64 Hash = 0xcbf29ce484222325ULL;
+
+  for(; *KernelPath != L'\0'; KernelPath++)
+  {
+    CHAR16 Char = *KernelPath;
+    if((Char >= L'a') && (Char <= L'z'))
+    {
+      Char -= L'a' - L'A';
+    }
+    Hash = (Hash ^ Char) * 0x100000001b3ULL;
+  }
+
+  for(UINT64 i = 0; i < 64; i += 8)
+  {
+    Hash = (Hash ^ ((FileSize >> i) & 0xFF)) * 0x100000001b3ULL;
+  }
+
+  return Hash;
+}
+
+//==================================================================================================================================
+//  RecallPlacement: Try Where The Last Search Ended Up
+//==================================================================================================================================
+//
+// If LoaderPlacement has a memo for this kernel and size, allocate its address and make sure it's zeroed (or holds the last boot's
+// kernel, which is the usual case). Returns 1 with the pages allocated at *AllocatedMemory if that worked. A memo that doesn't match
+// or doesn't work anymore counts as a miss and gets replaced by RememberPlacement() once the search is done.
+//
+
+STATIC UINT8 RecallPlacement(UINT64 pages, EFI_PHYSICAL_ADDRESS * AllocatedMemory, CONST VOID * MemCheck, UINT64 MemCheckSize, UINT8 Below4GB, UINT64 KernelId)
+{
+  LOADER_PLACEMENT_MEMO PlacementMemo;
+  EFI_PHYSICAL_ADDRESS Address;
+
+  ReadPlacementMemo(&PlacementMemo);
+  if(PlacementMemo.Pages == 0)
+  {
+    PlacementMemoMisses++;
+    LOG_MESSAGE(MEMORY, INFO, L"Placement memo miss: there isn't one (hits: %u, misses: %u)", PlacementMemoHits, PlacementMemoMisses);
+    return 0;
+  }
+
+  if((PlacementMemo.KernelId != KernelId) || (PlacementMemo.Pages != pages) || (PlacementMemo.Alignment != EFI_PAGE_SIZE)
+     || (PlacementMemo.Address & (PlacementMemo.Alignment - 1)) || (Below4GB && (PlacementMemo.Address + (pages << EFI_PAGE_SHIFT) > 0x100000000)))
+  {
+    PlacementMemoMisses++;
+    LOG_MESSAGE(MEMORY, INFO, L"Placement memo miss: it's for a different kernel (hits: %u, misses: %u)", PlacementMemoHits, PlacementMemoMisses);
+    return 0;
+  }
+
+  Address = PlacementMemo.Address;
+  if(EFI_ERROR(BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &Address)))
+  {
+    PlacementMemoMisses++;
+    LOG_MESSAGE(MEMORY, INFO, L"Placement memo miss: 0x%llx isn't free (hits: %u, misses: %u)", PlacementMemo.Address, PlacementMemoHits, PlacementMemoMisses);
+    return 0;
+  }
+
+  if(VerifyZeroMem(pages << EFI_PAGE_SHIFT, Address) && !compare((EFI_PHYSICAL_ADDRESS*)Address, MemCheck, MemCheckSize))
+  {
+    if(EFI_ERROR(BS->FreePages(Address, pages)))
+    {
+      Print(L"Could not free placement memo pages.\r\n");
+    }
+    PlacementMemoMisses++;
+    LOG_MESSAGE(MEMORY, INFO, L"Placement memo miss: 0x%llx isn't zeroed (hits: %u, misses: %u)", Address, PlacementMemoHits, PlacementMemoMisses);
+    return 0;
+  }
+
+  *AllocatedMemory = Address;
+  PlacementMemoHits++;
+  LOG_MESSAGE(MEMORY, INFO, L"Placement memo hit: 0x%llx (hits: %u, misses: %u)", Address, PlacementMemoHits, PlacementMemoMisses);
+
+  return 1;
+}
+
+//==================================================================================================================================
+//  RememberPlacement: Save Where The Search Ended Up
+//==================================================================================================================================
+//
+// Write a memo of Address to LoaderPlacement for the next boot, unless it's already there. It's in flash, so that's only after a
+// search, and only when the result changed.
+//
+
+STATIC VOID RememberPlacement(UINT64 pages, EFI_PHYSICAL_ADDRESS Address, UINT64 KernelId)
+{
+  EFI_STATUS memo_status;
+  LOADER_PLACEMENT_MEMO Memo = {KernelId, pages, Address, EFI_PAGE_SIZE};
+  LOADER_PLACEMENT_MEMO Saved;
+
+  ReadPlacementMemo(&Saved);
+  if((Saved.KernelId == Memo.KernelId) && (Saved.Pages == Memo.Pages) && (Saved.Address == Memo.Address) && (Saved.Alignment == Memo.Alignment))
+  {
+    return;
+  }
+
+  memo_status = RT->SetVariable(L"LoaderPlacement", &PlacementVariableGuid, EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS, sizeof(LOADER_PLACEMENT_MEMO), &Memo);
+  if(EFI_ERROR(memo_status))
+  {
+    Print(L"Error saving placement memo. 0x%llx\r\n", memo_status);
+    return;
+  }
+
+  LOG_MESSAGE(MEMORY, INFO, L"Placement memo saved: 0x%llx, %llu pages", Address, pages);
+}
+
+//==================================================================================================================================
+//  ActuallyFreeAddress: Find A Free Memory Address, Bottom-Up
+//==================================================================================================================================
+//
+// This is meant to work in the event that AllocateAnyPages fails, but could have other uses. Returns the next EfiConventionalMemory
+// area that is > the supplied OldAddress.
+//
+
+EFI_PHYSICAL_ADDRESS ActuallyFreeAddress(UINT64 pages, EFI_PHYSICAL_ADDRESS OldAddress)
+{
+  EFI_STATUS memmap_status;
+  UINTN MemMapSize = 0, MemMapKey, MemMapDescriptorSize;
+  UINT32 MemMapDescriptorVersion;
+  EFI_MEMORY_DESCRIPTOR * MemMap = NULL;
+  EFI_MEMORY_DESCRIPTOR * Piece;
+
+  memmap_status = BS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
+  if(memmap_status == EFI_BUFFER_TOO_SMALL)
+  {
+    MemMapSize += MemMapDescriptorSize;
+    memmap_status = BS->AllocatePool(EfiBootServicesData, MemMapSize, (void **)&MemMap); // Allocate pool for MemMap
+    if(EFI_ERROR(memmap_status)) // Error! Wouldn't be safe to continue.
+    {
+      Print(L"ActuallyFreeAddress MemMap AllocatePool error. 0x%llx\r\n", memmap_status);
+      return ~0ULL;
+    }
+    memmap_status = BS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
+  }
+  if(EFI_ERROR(memmap_status))
+  {
+    Print(L"Error getting memory map for ActuallyFreeAddress. 0x%llx\r\n", memmap_status);
+    return ~0ULL;
+  }
+
+  // Multiply NumberOfPages by EFI_PAGE_SIZE to get the end address... which should just be the start of the next section.
+  // Check for EfiConventionalMemory in the map
+  for(Piece = MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
+  {
+    // Within each compatible EfiConventionalMemory, look for space
+    if((Piece->Type == EfiConventionalMemory) && (Piece->NumberOfPages >= pages) && (Piece->PhysicalStart > OldAddress))
+    {
+      break;
+    }
+  }
+
+  // Loop ended without a DiscoveredAddress
+  if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize))
+  {
+    // Return address -1, which will cause AllocatePages to fail
+    LOG_MESSAGE(MEMORY, INFO, L"No more free addresses...");
+    return ~0ULL;
+  }
+
+  memmap_status = BS->FreePool(MemMap);
+  if(EFI_ERROR(memmap_status))
+  {
+    Print(L"Error freeing ActuallyFreeAddress memmap pool. 0x%llx\r\n", memmap_status);
+  }
+
+  return Piece->PhysicalStart;
+}
+
+//==================================================================================================================================
+//  ActuallyFreeAddressByPage: Find A Free Memory Address, Bottom-Up, The Hard Way
+//==================================================================================================================================
+//
+// This is meant to work in the event that AllocateAnyPages fails, but could have other uses. Returns the next page address marked as
+// free (EfiConventionalMemory) that is > the supplied OldAddress.
+//
+
+EFI_PHYSICAL_ADDRESS ActuallyFreeAddressByPage(UINT64 pages, EFI_PHYSICAL_ADDRESS OldAddress)
+{
+  EFI_STATUS memmap_status;
+  UINTN MemMapSize = 0, MemMapKey, MemMapDescriptorSize;
+  UINT32 MemMapDescriptorVersion;
+  EFI_MEMORY_DESCRIPTOR * MemMap = NULL;
+  EFI_MEMORY_DESCRIPTOR * Piece;
+  EFI_PHYSICAL_ADDRESS PhysicalEnd;
+  EFI_PHYSICAL_ADDRESS DiscoveredAddress;
+
+  memmap_status = BS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
+  if(memmap_status == EFI_BUFFER_TOO_SMALL)
+  {
+    MemMapSize += MemMapDescriptorSize;
+    memmap_status = BS->AllocatePool(EfiBootServicesData, MemMapSize, (void **)&MemMap); // Allocate pool for MemMap
+    if(EFI_ERROR(memmap_status)) // Error! Wouldn't be safe to continue.
+    {
+      Print(L"ActuallyFreeAddressByPage MemMap AllocatePool error. 0x%llx\r\n", memmap_status);
+      return ~0ULL;
+    }
+    memmap_status = BS->GetMemoryMap(&MemMapSize, MemMap, &MemMapKey, &MemMapDescriptorSize, &MemMapDescriptorVersion);
+  }
+  if(EFI_ERROR(memmap_status))
+  {
+    Print(L"Error getting memory map for ActuallyFreeAddressByPage. 0x%llx\r\n", memmap_status);
+    return ~0ULL;
+  }
+
+  // Multiply NumberOfPages by EFI_PAGE_SIZE to get the end address... which should just be the start of the next section.
+  // Check for EfiConventionalMemory in the map
+  for(Piece = MemMap; Piece < (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize); Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
+  {
+    // Within each compatible EfiConventionalMemory, look for space
+    if((Piece->Type == EfiConventionalMemory) && (Piece->NumberOfPages >= pages))
+    {
+      PhysicalEnd = Piece->PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT) - EFI_PAGE_MASK; // Get the end of this range, and use it to set a bound on the range (define a max returnable address).
+      // (pages*EFI_PAGE_SIZE) or (pages << EFI_PAGE_SHIFT) gives the size the kernel would take up in memory
+      if((OldAddress >= Piece->PhysicalStart) && ((OldAddress + (pages << EFI_PAGE_SHIFT)) < PhysicalEnd)) // Bounds check on OldAddress
+      {
+        // Return the next available page's address in the range. We need to go page-by-page for the really buggy systems.
+        DiscoveredAddress = OldAddress + EFI_PAGE_SIZE; // Left shift EFI_PAGE_SIZE by 1 or 2 to check every 0x10 or 0x100 pages (must also modify the above PhysicalEnd bound check)
+        break;
+        // If PhysicalEnd == OldAddress, we need to go to the next EfiConventionalMemory range
+      }
+      else if(Piece->PhysicalStart > OldAddress) // Try a new range
+      {
+        DiscoveredAddress = Piece->PhysicalStart;
+        break;
+      }
+    }
+  }
+
+  // Loop ended without a DiscoveredAddress
+  if(Piece >= (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize))
+  {
+    // Return address -1, which will cause AllocatePages to fail
+    LOG_MESSAGE(MEMORY, INFO, L"No more free addresses by page...");
+    return ~0ULL;
+  }
+
+  memmap_status = BS->FreePool(MemMap);
+  if(EFI_ERROR(memmap_status))
+  {
+    Print(L"Error freeing ActuallyFreeAddressByPage memmap pool. 0x%llx\r\n", memmap_status);
+  }
+
+  return DiscoveredAddress;
+}
+
+//==================================================================================================================================
+//  FindActuallyFreePages: Make Sure The Kernel Got Memory That's Really Free
+//==================================================================================================================================
+//
+// Some firmware hands out memory that's marked as free but that something is still using. Given the pages at AllocatedMemory that
+// were just allocated and zeroed, make sure they stayed zeroed. If not, free them and search the memory map bottom-up, and then
+// page-by-page, until an allocation turns up that reads back as zeros.
+//
+// MemCheck is the first MemCheckSize bytes of the kernel file: finding those in non-zero memory means it's what remains of the last
+// boot, which is safe to reuse. Below4GB keeps the search under 4GB, which PE32+ needs. KernelId is PlacementKernelId() of the kernel,
+// for the placement memo, which gets tried before searching and updated after. KernelType is only used in messages.
+//
+// On success AllocatedMemory holds the address to use, allocated as EfiLoaderData.
+//
+
+EFI_STATUS FindActuallyFreePages(UINT64 pages, EFI_PHYSICAL_ADDRESS * AllocatedMemory, CONST VOID * MemCheck, UINT64 MemCheckSize, UINT8 Below4GB, UINT64 KernelId, CONST CHAR16 * KernelType)
+{
+  EFI_STATUS placement_status = EFI_SUCCESS;
+
+  // Iterate through the entirety of what was just allocated and check to make sure it's all zeros
+  // Start buggy firmware workaround
+  if(VerifyZeroMem(pages << EFI_PAGE_SHIFT, *AllocatedMemory))
+  {
+
+    // From UEFI Specification 2.7, Errata A (http://www.uefi.org/specifications):
+    // MemoryType values in the range 0x80000000..0xFFFFFFFF are reserved for use by
+    // UEFI OS loaders that are provided by operating system vendors.
+
+    LOG_MESSAGE(MEMORY, INFO, L"Non-zero memory location allocated. Verifying cause...");
+
+    // Compare what's there with the kernel file's first bytes; the system might have been reset and the non-zero
+    // memory is what remains of last time. This can be safely overwritten to avoid cluttering up system RAM.
+
+    // Sure hope there aren't any other page-aligned kernel images floating around in memory marked as free
+    if(compare((EFI_PHYSICAL_ADDRESS*)*AllocatedMemory, MemCheck, MemCheckSize))
+    {
+      // Do nothing, we're fine
+      LOG_MESSAGE(MEMORY, INFO, L"System was reset. No issues.");
+    }
+    else // Not our remains, proceed with discovery of viable memory address
+    {
+
+      LOG_MESSAGE(MEMORY, INFO, L"Searching for actually free memory...");
+      LOG_MESSAGE(MEMORY, INFO, L"Perhaps the firmware is buggy?");
+
+      // Free the pages (well, return them to the system as they were...)
+      placement_status = BS->FreePages(*AllocatedMemory, pages);
+      if(EFI_ERROR(placement_status))
+      {
+        Print(L"Could not free pages for %s sections. Error code: 0x%llx\r\n", KernelType, placement_status);
+        return placement_status;
+      }
+
+      // Same kernel as last time? Then the search would probably end up where it did last time.
+      if(RecallPlacement(pages, AllocatedMemory, MemCheck, MemCheckSize, Below4GB, KernelId))
+      {
+        return EFI_SUCCESS;
+      }
+
+      // NOTE: CANNOT create an array of all compatible free addresses because the array takes up memory. So does the memory map.
+      // This results in a paradox, so we need to scan the memory map every time we need to find a new address...
+
+      // It appears that AllocateAnyPages uses a "MaxAddress" approach. This will go bottom-up instead.
+      EFI_PHYSICAL_ADDRESS NewAddress = 0; // Start at zero
+      EFI_PHYSICAL_ADDRESS OldAllocatedMemory = *AllocatedMemory;
+
+      placement_status = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress); // Need to check 0x0
+      while(placement_status != EFI_SUCCESS)
+      { // Keep checking free memory addresses until one works
+
+        if(placement_status == EFI_NOT_FOUND)
+        {
+          // 0's not a good address (not enough contiguous pages could be found), get another one
+          NewAddress = ActuallyFreeAddress(pages, NewAddress);
+          // Make sure the new address isn't the known bad one
+          if(NewAddress == OldAllocatedMemory)
+          {
+            // Get a new address if it is
+            NewAddress = ActuallyFreeAddress(pages, NewAddress);
+          }
+          else if(Below4GB && (NewAddress >= 0x100000000)) // Need to stay under 4GB for PE32+
+          {
+            NewAddress = ~0ULL;
+          }
+        }
+        else if(EFI_ERROR(placement_status))
+        {
+          Print(L"Could not get an address for %s pages. Error code: 0x%llx\r\n", KernelType, placement_status);
+          return placement_status;
+        }
+
+        if(NewAddress == ~0ULL)
+        {
+          // If you get this, you had no memory free anywhere.
+          Print(L"No memory marked as EfiConventionalMemory...\r\n");
+          return placement_status;
+        }
+
+        // Allocate the new address
+        placement_status = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
+        // This loop shouldn't run more than once, but in the event something is at 0x0 we need to
+        // leave the loop with an allocated address
+
+      }
+
+      // Got a new address that's been allocated--save it
+      *AllocatedMemory = NewAddress;
+
+      // Verify it's empty
+      while((NewAddress != ~0ULL) && VerifyZeroMem(pages << EFI_PAGE_SHIFT, *AllocatedMemory)) // Loop this in case the firmware is really screwed
+      { // It's not empty :(
+
+        // Sure hope there aren't any other page-aligned kernel images floating around in memory marked as free
+        if(compare((EFI_PHYSICAL_ADDRESS*)*AllocatedMemory, MemCheck, MemCheckSize))
+        {
+          // Do nothing, we're fine
+          LOG_MESSAGE(MEMORY, INFO, L"System appears to have been reset. No issues.");
+
+          break;
+        }
+        else
+        { // Gotta keep looking for a good memory address
+
+          LOG_MESSAGE(MEMORY, DEBUG, L"Still searching... 0x%llx", *AllocatedMemory);
+
+          // It's not actually free...
+          placement_status = BS->FreePages(*AllocatedMemory, pages);
+          if(EFI_ERROR(placement_status))
+          {
+            Print(L"Could not free pages for %s sections (loop). Error code: 0x%llx\r\n", KernelType, placement_status);
+            return placement_status;
+          }
+
+          // Allocate a new address
+          placement_status = EFI_NOT_FOUND;
+          while((placement_status != EFI_SUCCESS) && (NewAddress != ~0ULL))
+          {
+            if(placement_status == EFI_NOT_FOUND)
+            {
+              // Get an address (ideally, this should be very rare)
+              NewAddress = ActuallyFreeAddress(pages, NewAddress);
+              // Make sure the new address isn't the known bad one
+              if(NewAddress == OldAllocatedMemory)
+              {
+                // Get a new address if it is
+                NewAddress = ActuallyFreeAddress(pages, NewAddress);
+              }
+              else if(Below4GB && (NewAddress >= 0x100000000)) // Need to stay under 4GB
+              {
+                NewAddress = ~0ULL; // Get out of this loop, do a more thorough check
+                break;
+              }
+              // This loop will run until we get a good address (shouldn't be more than once, if ever)
+            }
+            else if(EFI_ERROR(placement_status))
+            {
+              // EFI_OUT_OF_RESOURCES means the firmware's just not gonna load anything.
+              Print(L"Could not get an address for %s pages (loop). Error code: 0x%llx\r\n", KernelType, placement_status);
+              return placement_status;
+            }
+            // NOTE: The number of times the message "No more free addresses" pops up
+            // helps indicate which NewAddress assignment hit the end.
+
+            placement_status = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
+          } // loop
+
+          // It's a new address
+          *AllocatedMemory = NewAddress;
+
+          // Verify new address is empty (in loop), if not then free it and try again.
+        } // else
+      } // End VerifyZeroMem while loop
+
+      // Ran out of easy addresses, time for a more thorough check
+      // Hopefully no one ever gets here
+      if(*AllocatedMemory == ~0ULL)
+      { // NewAddress is also -1
+
+#ifdef BY_PAGE_SEARCH_DISABLED // Set this to disable ByPage searching
+        Print(L"No easy addresses found with enough space and containing only zeros.\r\nConsider enabling page-by-page search.\r\n");
+        return placement_status;
+#endif
+
+#ifndef BY_PAGE_SEARCH_DISABLED
+        LOG_MESSAGE(MEMORY, INFO, L"Performing page-by-page search.");
+        LOG_MESSAGE(MEMORY, INFO, L"This might take a while...");
+
+        LOG_MESSAGE(MEMORY, DEBUG, L"About to search page by page");
+
+        if(Below4GB)
+        {
+          NewAddress = 0x80000000 - EFI_PAGE_SIZE; // Start over
+        }
+        else
+        {
+          NewAddress = ActuallyFreeAddress(pages, 0); // Start from the first suitable EfiConventionalMemory address.
+        }
+
+        // Allocate the page's address
+        placement_status = EFI_NOT_FOUND;
+        while(placement_status != EFI_SUCCESS)
+        {
+          if(placement_status == EFI_NOT_FOUND)
+          {
+            // Nope, get another one
+            NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
+            // Make sure the new address isn't the known bad one
+            if(NewAddress == OldAllocatedMemory)
+            {
+              // Get a new address if it is
+              NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
+            }
+            else if(Below4GB && (NewAddress >= 0x100000000)) // Need to stay under 4GB
+            {
+              NewAddress = ActuallyFreeAddress(pages, 0); // Start from the first suitable EfiConventionalMemory address.
+              // This is for BIOS vendors who blanketly set 0x80000000 in an EfiReservedMemoryType section.
+            }
+            // Otherwise addresses very well might be > 4GB with the filesizes these are allowed to be
+          }
+          else if(EFI_ERROR(placement_status))
+          {
+            Print(L"Could not get an address for %s pages by page. Error code: 0x%llx\r\n", KernelType, placement_status);
+            return placement_status;
+          }
+
+          if(NewAddress == ~0ULL)
+          {
+            // If you somehow get this, you really had no memory free anywhere.
+            Print(L"Hmm... How did you get here?\r\n");
+            return placement_status;
+          }
+
+          placement_status = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
+        }
+
+        *AllocatedMemory = NewAddress;
+
+        while(VerifyZeroMem(pages << EFI_PAGE_SHIFT, *AllocatedMemory))
+        {
+          // Sure hope there aren't any other page-aligned kernel images floating around in memory marked as free
+          if(compare((EFI_PHYSICAL_ADDRESS*)*AllocatedMemory, MemCheck, MemCheckSize))
+          {
+            // Do nothing, we're fine
+            LOG_MESSAGE(MEMORY, INFO, L"System might have been reset. Hopefully no issues.");
+
+            break;
+          }
+          else
+          {
+
+            LOG_MESSAGE(MEMORY, DEBUG, L"Still searching by page... 0x%llx", *AllocatedMemory);
+
+            // It's not actually free...
+            placement_status = BS->FreePages(*AllocatedMemory, pages);
+            if(EFI_ERROR(placement_status))
+            {
+              Print(L"Could not free pages for %s sections by page (loop). Error code: 0x%llx\r\n", KernelType, placement_status);
+              return placement_status;
+            }
+
+            placement_status = EFI_NOT_FOUND;
+            while(placement_status != EFI_SUCCESS)
+            {
+              if(placement_status == EFI_NOT_FOUND)
+              {
+                // Nope, get another one
+                NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
+                // Make sure the new address isn't the known bad one
+                if(NewAddress == OldAllocatedMemory)
+                {
+                  // Get a new address if it is
+                  NewAddress = ActuallyFreeAddressByPage(pages, NewAddress);
+                }
+                else if(Below4GB && (NewAddress >= 0x100000000)) // Need to stay under 4GB
+                {
+                  Print(L"Too much junk below 4GB. Complain to your motherboard vendor.\r\nTry using a 64-bit ELF or MACH-O kernel binary instead of PE32+.\r\n");
+                  NewAddress = ActuallyFreeAddress(pages, 0); // Either the BIOS vendor didn't read the spec or you need to use RAM space above 4GB.
+                }
+              }
+              else if(EFI_ERROR(placement_status))
+              {
+                Print(L"Could not get an address for %s pages by page (loop). Error code: 0x%llx\r\n", KernelType, placement_status);
+                return placement_status;
+              }
+
+              if(NewAddress == ~0ULL)
+              {
+                // Well, darn. Something's up with the system memory.
+                if(Below4GB)
+                {
+                  // Maybe you have 4GB or less?
+                  Print(L"Do you have 4GB or less of RAM? Looks like you need > 4GB for this.\r\nThat also means you'll need to use 64-bit ELF or MACH-O kernels.\r\n");
+                }
+                return placement_status;
+              }
+
+              placement_status = BS->AllocatePages(AllocateAddress, EfiLoaderData, pages, &NewAddress);
+            } // loop
+
+            *AllocatedMemory = NewAddress;
+
+          } // else
+        } // end ByPage VerifyZeroMem loop
+#endif
+      } // End "big guns"
+
+      // Got a good address!
+      LOG_MESSAGE(MEMORY, INFO, L"Found!");
+      RememberPlacement(pages, *AllocatedMemory, KernelId);
+    } // End discovery of viable memory address (else)
+    // Can move on now
+    LOG_MESSAGE(MEMORY, INFO, L"New AllocatedMemory location: 0x%llx", *AllocatedMemory);
+  } // End VerifyZeroMem buggy firmware workaround (outermost if)
+  else
+  {
+    LOG_MESSAGE(MEMORY, INFO, L"Allocated memory was zeroed OK");
+  }
+
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,200 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Runtime Services Virtual Map Functions
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This file contains the functions that give UEFI runtime services a virtual address layout and switch firmware over to it with
+// SetVirtualAddressMap(), so the kernel doesn't need to keep firmware's memory identity mapped to call GetTime(), GetVariable(), etc.
+//
+
+#include "Bootloader.h"
+
+#define RUNTIME_MAP_SLACK     8          // Extra entries for runtime ranges that appear between planning and ExitBootServices()
+#define RUNTIME_MAP_ALIGNMENT 0x200000ULL
+
+//==================================================================================================================================
+//  NextRuntimeVirtual: Pick A Virtual Address For A Runtime Range
+//==================================================================================================================================
+//
+// Return the lowest address at or above Cursor with the same offset within a 2MB page as PhysicalStart. Wastes less than 2MB of
+// virtual address space per range, and lets MapRange() use 2MB pages wherever the physical range could have.
+//
+
+STATIC EFI_VIRTUAL_ADDRESS NextRuntimeVirtual(EFI_VIRTUAL_ADDRESS Cursor, EFI_PHYSICAL_ADDRESS PhysicalStart)
+{
+  return Cursor + ((PhysicalStart - Cursor) & (RUNTIME_MAP_ALIGNMENT - 1));
+}
+
+//==================================================================================================================================
+//  PlanRuntimeMap: Lay Out The Runtime Ranges In Virtual Memory
+//==================================================================================================================================
+//
+// Allocate a RUNTIME_MAP and give each EFI_MEMORY_RUNTIME range in the current memory map a virtual address, in memory map order from
+// RUNTIME_VIRTUAL_BASE up. This has to happen before BuildPageTables(), which maps the ranges at those addresses. Runtime memory
+// doesn't normally change once boot services are this far along, but ApplyRuntimeMap() copes if it does.
+//
+
+EFI_STATUS PlanRuntimeMap(RUNTIME_MAP ** RuntimeMap)
+{
+  EFI_STATUS runtime_status;
+  UINTN MemMapSize, MemMapDescriptorSize;
+  EFI_MEMORY_DESCRIPTOR * MemMap;
+
+  runtime_status = GetMemoryMapCopy(&MemMap, &MemMapSize, &MemMapDescriptorSize);
+  if(EFI_ERROR(runtime_status))
+  {
+    return runtime_status;
+  }
+
+  EFI_MEMORY_DESCRIPTOR * MemMapEnd = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize);
+  UINT32 NumberOfRanges = 0;
+
+  for(EFI_MEMORY_DESCRIPTOR * Piece = MemMap; Piece < MemMapEnd; Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
+  {
+    if(Piece->Attribute & EFI_MEMORY_RUNTIME)
+    {
+      NumberOfRanges++;
+    }
+  }
+
+  UINT64 RuntimeMapSize = sizeof(RUNTIME_MAP) + (NumberOfRanges + RUNTIME_MAP_SLACK) * sizeof(RUNTIME_MAP_RANGE);
+  runtime_status = BS->AllocatePool(EfiLoaderData, RuntimeMapSize, (void**)RuntimeMap);
+  if(EFI_ERROR(runtime_status))
+  {
+    Print(L"Error allocating runtime map. 0x%llx\r\n", runtime_status);
+    BS->FreePool(MemMap);
+    return runtime_status;
+  }
+
+  RUNTIME_MAP * Map = *RuntimeMap;
+  ZeroMem(Map, RuntimeMapSize);
+  Map->VirtualBase = RUNTIME_VIRTUAL_BASE;
+  Map->MaxRanges = NumberOfRanges + RUNTIME_MAP_SLACK;
+
+  EFI_VIRTUAL_ADDRESS Cursor = RUNTIME_VIRTUAL_BASE;
+  for(EFI_MEMORY_DESCRIPTOR * Piece = MemMap; Piece < MemMapEnd; Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
+  {
+    if(!(Piece->Attribute & EFI_MEMORY_RUNTIME))
+    {
+      continue;
+    }
+
+    RUNTIME_MAP_RANGE * Range = &Map->Ranges[Map->NumberOfRanges++];
+    Range->PhysicalStart = Piece->PhysicalStart;
+    Range->VirtualStart = NextRuntimeVirtual(Cursor, Piece->PhysicalStart);
+    Range->NumberOfPages = Piece->NumberOfPages;
+    Range->Attribute = Piece->Attribute;
+    Range->Type = Piece->Type;
+    Cursor = Range->VirtualStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT);
+
+#ifdef LOADER_PAGE_TABLES_ENABLED
+    if(!AddRuntimeMapping(Range->PhysicalStart, Range->VirtualStart, Range->NumberOfPages))
+    {
+      Range->Flags |= RUNTIME_RANGE_NOT_MAPPED;
+    }
+#endif
+  }
+
+  LOG_MESSAGE(HANDOFF, DEBUG, L"Runtime map: %u ranges at 0x%llx - 0x%llx", Map->NumberOfRanges, Map->VirtualBase, Cursor);
+
+  runtime_status = BS->FreePool(MemMap);
+  if(EFI_ERROR(runtime_status))
+  {
+    Print(L"Error freeing runtime map MemMap pool. 0x%llx\r\n", runtime_status);
+  }
+
+  return runtime_status;
+}
+
+//==================================================================================================================================
+//  ApplyRuntimeMap: Switch Runtime Services To Their Virtual Addresses
+//==================================================================================================================================
+//
+// Fill in the VirtualStart of every runtime descriptor in the final memory map from the plan and call SetVirtualAddressMap() with it.
+// A descriptor that falls inside a planned range keeps that range's layout; anything else (new since PlanRuntimeMap()) goes after the
+// last planned range and isn't in the loader-built page tables. This runs after ExitBootServices(), while the identity map is still
+// what's loaded in CR3, since firmware converts its own pointers during the call.
+//
+
+VOID ApplyRuntimeMap(RUNTIME_MAP * RuntimeMap, EFI_MEMORY_DESCRIPTOR * MemMap, UINTN MemMapSize, UINTN MemMapDescriptorSize, UINT32 MemMapDescriptorVersion)
+{
+  EFI_MEMORY_DESCRIPTOR * MemMapEnd = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemMap + MemMapSize);
+  UINT32 NumberOfPlannedRanges = RuntimeMap->NumberOfRanges;
+  EFI_VIRTUAL_ADDRESS Cursor = RuntimeMap->VirtualBase;
+
+  for(UINT32 k = 0; k < NumberOfPlannedRanges; k++)
+  {
+    EFI_VIRTUAL_ADDRESS End = RuntimeMap->Ranges[k].VirtualStart + (RuntimeMap->Ranges[k].NumberOfPages << EFI_PAGE_SHIFT);
+    if(End > Cursor)
+    {
+      Cursor = End;
+    }
+  }
+
+  for(EFI_MEMORY_DESCRIPTOR * Piece = MemMap; Piece < MemMapEnd; Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)Piece + MemMapDescriptorSize))
+  {
+    if(!(Piece->Attribute & EFI_MEMORY_RUNTIME))
+    {
+      continue;
+    }
+
+    EFI_PHYSICAL_ADDRESS PieceEnd = Piece->PhysicalStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT);
+    UINT32 k;
+
+    for(k = 0; k < NumberOfPlannedRanges; k++)
+    {
+      RUNTIME_MAP_RANGE * Range = &RuntimeMap->Ranges[k];
+      if((Piece->PhysicalStart >= Range->PhysicalStart) && (PieceEnd <= Range->PhysicalStart + (Range->NumberOfPages << EFI_PAGE_SHIFT)))
+      {
+        Piece->VirtualStart = Range->VirtualStart + (Piece->PhysicalStart - Range->PhysicalStart);
+        break;
+      }
+    }
+
+    if(k == NumberOfPlannedRanges)
+    {
+      Piece->VirtualStart = NextRuntimeVirtual(Cursor, Piece->PhysicalStart);
+      Cursor = Piece->VirtualStart + (Piece->NumberOfPages << EFI_PAGE_SHIFT);
+
+      if(RuntimeMap->NumberOfRanges < RuntimeMap->MaxRanges)
+      {
+        RUNTIME_MAP_RANGE * Range = &RuntimeMap->Ranges[RuntimeMap->NumberOfRanges++];
+        Range->PhysicalStart = Piece->PhysicalStart;
+        Range->VirtualStart = Piece->VirtualStart;
+        Range->NumberOfPages = Piece->NumberOfPages;
+        Range->Attribute = Piece->Attribute;
+        Range->Type = Piece->Type;
+        Range->Flags = RUNTIME_RANGE_NOT_MAPPED;
+      }
+      else
+      {
+        RuntimeMap->Flags |= RUNTIME_MAP_TRUNCATED;
+      }
+    }
+  }
+
+  // RT itself is in one of the runtime ranges on any sane firmware
+  for(UINT32 k = 0; k < RuntimeMap->NumberOfRanges; k++)
+  {
+    RUNTIME_MAP_RANGE * Range = &RuntimeMap->Ranges[k];
+    if(((EFI_PHYSICAL_ADDRESS)RT >= Range->PhysicalStart) && ((EFI_PHYSICAL_ADDRESS)RT < Range->PhysicalStart + (Range->NumberOfPages << EFI_PAGE_SHIFT)))
+    {
+      RuntimeMap->RuntimeServices = Range->VirtualStart + ((EFI_PHYSICAL_ADDRESS)RT - Range->PhysicalStart);
+      break;
+    }
+  }
+
+  // No more runtime services calls from the loader after this, since their function pointers are virtual now
+  RuntimeMap->Status = RT->SetVirtualAddressMap(MemMapSize, MemMapDescriptorSize, MemMapDescriptorVersion, MemMap);
+  if(!EFI_ERROR(RuntimeMap->Status))
+  {
+    RuntimeMap->Flags |= RUNTIME_MAP_APPLIED;
+  }
+}
@@ -0,0 +1,440 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: SMBIOS Functions
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This file contains functions for indexing the SMBIOS structure table and decoding the parts of it kernels tend to want early.
+//
+// NOTE: Apart from looking up the entry point in the UEFI configuration tables, nothing in here calls boot services.
+//
+
+#include "Bootloader.h"
+
+STATIC EFI_GUID Smbios3TableGuid = SMBIOS3_TABLE_GUID;
+
+STATIC CONST CHAR8 Smbios2Anchor[4] = {'_','S','M','_'};
+STATIC CONST CHAR8 Smbios3Anchor[5] = {'_','S','M','3','_'};
+
+//==================================================================================================================================
+//  SmbiosStructureFits: Check A Structure's Formatted Area
+//==================================================================================================================================
+//
+// Return 1 if the structure at Structure has a sane header and its formatted area ends before End, 0 otherwise.
+//
+
+STATIC UINT8 SmbiosStructureFits(UINT8 * Structure, UINT8 * End)
+{
+  if(Structure + sizeof(SMBIOS_HEADER) > End)
+  {
+    return 0;
+  }
+
+  UINT8 Length = ((SMBIOS_HEADER*)Structure)->Length;
+
+  return (Length >= sizeof(SMBIOS_HEADER)) && (Structure + Length <= End);
+}
+
+//==================================================================================================================================
+//  SmbiosNextStructure: Skip Past A Structure's Strings
+//==================================================================================================================================
+//
+// Return a pointer to the structure after the one at Structure. The string set after the formatted area ends with two nulls (and is
+// just the two nulls if there are no strings). Returns End if the string set runs off the end of the table.
+//
+
+STATIC UINT8 * SmbiosNextStructure(UINT8 * Structure, UINT8 * End)
+{
+  UINT8 * Strings = Structure + ((SMBIOS_HEADER*)Structure)->Length;
+
+  while(Strings + 1 < End)
+  {
+    if((Strings[0] == 0) && (Strings[1] == 0))
+    {
+      return Strings + 2;
+    }
+    Strings++;
+  }
+
+  return End;
+}
+
+//==================================================================================================================================
+//  SmbiosString: Find A String In A Structure's String Set
+//==================================================================================================================================
+//
+// Return where string number Number (1 for the first one) of the structure at Structure starts, counted from Table. Returns 0 if
+// Number is 0, which is how SMBIOS says a structure doesn't have that string, or if there aren't that many strings.
+//
+
+STATIC UINT32 SmbiosString(UINT8 * Table, UINT8 * Structure, UINT8 * End, UINT8 Number)
+{
+  if(Number == 0)
+  {
+    return 0;
+  }
+
+  UINT8 * String = Structure + ((SMBIOS_HEADER*)Structure)->Length;
+
+  while((String < End) && (*String != 0))
+  {
+    if(--Number == 0)
+    {
+      return (UINT32)(String - Table);
+    }
+
+    while((String < End) && (*String != 0))
+    {
+      String++;
+    }
+    String++;
+  }
+
+  return 0;
+}
+
+//==================================================================================================================================
+//  SmbiosHandle: Get A Structure's Handle
+//==================================================================================================================================
+
+STATIC UINT16 SmbiosHandle(UINT8 * Structure)
+{
+  SMBIOS_HEADER * Header = (SMBIOS_HEADER*)Structure;
+  return (UINT16)(Header->Handle[0] | (Header->Handle[1] << 8));
+}
+
+//==================================================================================================================================
+//  DecodeSmbiosSystem: Decode A Type 1 Structure
+//==================================================================================================================================
+
+STATIC VOID DecodeSmbiosSystem(UINT8 * Table, UINT8 * Structure, UINT8 * End, LOADER_SMBIOS_SYSTEM * System)
+{
+  SMBIOS_SYSTEM_INFORMATION * Info = (SMBIOS_SYSTEM_INFORMATION*)Structure;
+  UINT8 Length = Info->Hdr.Length;
+
+  System->Present = 1;
+  System->Offset = (UINT32)(Structure - Table);
+
+  // SMBIOS 2.0 only has the strings
+  if(Length >= 8)
+  {
+    System->Manufacturer = SmbiosString(Table, Structure, End, Info->Manufacturer);
+    System->ProductName = SmbiosString(Table, Structure, End, Info->ProductName);
+    System->Version = SmbiosString(Table, Structure, End, Info->Version);
+    System->SerialNumber = SmbiosString(Table, Structure, End, Info->SerialNumber);
+  }
+
+  if(Length >= SMBIOS_TYPE1_LENGTH_2_1)
+  {
+    CopyMem(&System->Uuid, &Info->Uuid, sizeof(EFI_GUID));
+    System->WakeUpType = Info->WakeUpType;
+  }
+
+  if(Length >= SMBIOS_TYPE1_LENGTH_2_4)
+  {
+    System->SkuNumber = SmbiosString(Table, Structure, End, Info->SkuNumber);
+    System->Family = SmbiosString(Table, Structure, End, Info->Family);
+  }
+}
+
+//==================================================================================================================================
+//  DecodeSmbiosProcessor: Decode A Type 4 Structure
+//==================================================================================================================================
+
+STATIC VOID DecodeSmbiosProcessor(UINT8 * Table, UINT8 * Structure, UINT8 * End, LOADER_SMBIOS_PROCESSOR * Processor)
+{
+  SMBIOS_PROCESSOR_INFORMATION * Info = (SMBIOS_PROCESSOR_INFORMATION*)Structure;
+  UINT8 Length = Info->Hdr.Length;
+
+  ZeroMem(Processor, sizeof(LOADER_SMBIOS_PROCESSOR));
+  Processor->Offset = (UINT32)(Structure - Table);
+  Processor->Handle = SmbiosHandle(Structure);
+
+  if(Length < SMBIOS_TYPE4_LENGTH_2_0)
+  {
+    return;
+  }
+
+  Processor->ProcessorId = Info->ProcessorId;
+  Processor->SocketDesignation = SmbiosString(Table, Structure, End, Info->SocketDesignation);
+  Processor->Manufacturer = SmbiosString(Table, Structure, End, Info->ProcessorManufacturer);
+  Processor->Version = SmbiosString(Table, Structure, End, Info->ProcessorVersion);
+  Processor->ProcessorFamily = Info->ProcessorFamily;
+  Processor->MaxSpeed = Info->MaxSpeed;
+  Processor->CurrentSpeed = Info->CurrentSpeed;
+  Processor->ExternalClock = Info->ExternalClock;
+  Processor->ProcessorType = Info->ProcessorType;
+  Processor->Status = Info->Status;
+
+  if(Length >= SMBIOS_TYPE4_LENGTH_2_5)
+  {
+    Processor->CoreCount = Info->CoreCount;
+    Processor->CoreEnabled = Info->CoreEnabled;
+    Processor->ThreadCount = Info->ThreadCount;
+    Processor->Characteristics = Info->ProcessorCharacteristics;
+  }
+
+  if((Length >= SMBIOS_TYPE4_LENGTH_2_6) && (Info->ProcessorFamily == 0xFE))
+  {
+    Processor->ProcessorFamily = Info->ProcessorFamily2;
+  }
+
+  // 0xFF means there are too many to fit in a byte
+  if(Length >= SMBIOS_TYPE4_LENGTH_3_0)
+  {
+    if(Info->CoreCount == 0xFF)
+    {
+      Processor->CoreCount = Info->CoreCount2;
+    }
+    if(Info->CoreEnabled == 0xFF)
+    {
+      Processor->CoreEnabled = Info->CoreEnabled2;
+    }
+    if(Info->ThreadCount == 0xFF)
+    {
+      Processor->ThreadCount = Info->ThreadCount2;
+    }
+  }
+}
+
+//==================================================================================================================================
+//  DecodeSmbiosMemoryDevice: Decode A Type 17 Structure
+//==================================================================================================================================
+
+STATIC VOID DecodeSmbiosMemoryDevice(UINT8 * Table, UINT8 * Structure, UINT8 * End, LOADER_SMBIOS_MEMORY_DEVICE * Device)
+{
+  SMBIOS_MEMORY_DEVICE * Info = (SMBIOS_MEMORY_DEVICE*)Structure;
+  UINT8 Length = Info->Hdr.Length;
+
+  ZeroMem(Device, sizeof(LOADER_SMBIOS_MEMORY_DEVICE));
+  Device->Offset = (UINT32)(Structure - Table);
+  Device->Handle = SmbiosHandle(Structure);
+
+  if(Length < SMBIOS_TYPE17_LENGTH_2_1)
+  {
+    Device->Size = ~0ULL;
+    return;
+  }
+
+  Device->PhysicalMemoryArrayHandle = Info->PhysicalMemoryArrayHandle;
+  Device->TotalWidth = Info->TotalWidth;
+  Device->DataWidth = Info->DataWidth;
+  Device->FormFactor = Info->FormFactor;
+  Device->DeviceSet = Info->DeviceSet;
+  Device->DeviceLocator = SmbiosString(Table, Structure, End, Info->DeviceLocator);
+  Device->BankLocator = SmbiosString(Table, Structure, End, Info->BankLocator);
+  Device->MemoryType = Info->MemoryType;
+  Device->TypeDetail = Info->TypeDetail;
+
+  if(Info->Size == 0xFFFF)
+  {
+    Device->Size = ~0ULL;
+  }
+  else if(Info->Size == 0x7FFF)
+  {
+    if(Length >= SMBIOS_TYPE17_LENGTH_2_7)
+    {
+      Device->Size = (UINT64)(Info->ExtendedSize & 0x7FFFFFFF) << 20;
+    }
+    else
+    {
+      Device->Size = ~0ULL;
+    }
+  }
+  else if(Info->Size & 0x8000)
+  {
+    Device->Size = (UINT64)(Info->Size & 0x7FFF) << 10;
+  }
+  else
+  {
+    Device->Size = (UINT64)Info->Size << 20;
+  }
+
+  if(Length >= SMBIOS_TYPE17_LENGTH_2_3)
+  {
+    Device->Speed = Info->Speed;
+    Device->Manufacturer = SmbiosString(Table, Structure, End, Info->Manufacturer);
+    Device->SerialNumber = SmbiosString(Table, Structure, End, Info->SerialNumber);
+    Device->PartNumber = SmbiosString(Table, Structure, End, Info->PartNumber);
+  }
+
+  if(Length >= SMBIOS_TYPE17_LENGTH_2_6)
+  {
+    Device->Rank = Info->Attributes & 0xF;
+  }
+
+  if(Length >= SMBIOS_TYPE17_LENGTH_2_7)
+  {
+    Device->ConfiguredSpeed = Info->ConfiguredMemorySpeed;
+  }
+
+  if(Length >= SMBIOS_TYPE17_LENGTH_2_8)
+  {
+    Device->MinimumVoltage = Info->MinimumVoltage;
+    Device->MaximumVoltage = Info->MaximumVoltage;
+    Device->ConfiguredVoltage = Info->ConfiguredVoltage;
+  }
+
+  // 0xFFFF means the speed didn't fit in 16 bits
+  if(Device->Speed == 0xFFFF)
+  {
+    Device->Speed = (Length >= SMBIOS_TYPE17_LENGTH_3_3) ? Info->ExtendedSpeed : 0;
+  }
+  if(Device->ConfiguredSpeed == 0xFFFF)
+  {
+    Device->ConfiguredSpeed = (Length >= SMBIOS_TYPE17_LENGTH_3_3) ? Info->ExtendedConfiguredMemorySpeed : 0;
+  }
+}
+
+//==================================================================================================================================
+//  BuildSmbiosIndex: Index The SMBIOS Structure Table
+//==================================================================================================================================
+//
+// Find the SMBIOS structure table (preferring the SMBIOS 3.x entry point, since it can be above 4GB), make a list of where each
+// structure is, grouped by type, and decode the system, processor and memory device structures. See LOADER_SMBIOS_TAG in Bootloader.h.
+//
+// Returns the size Index needs to be, or 0 if there's no SMBIOS table. Call it with Index = NULL first to get the size, then again with
+// a buffer that big.
+//
+
+UINT64 BuildSmbiosIndex(LOADER_SMBIOS_TAG * Index)
+{
+  EFI_PHYSICAL_ADDRESS EntryPoint = 0;
+  UINT8 * Table = NULL;
+  UINT8 * End = NULL;
+  UINT8 EntryPointType = 0, MajorVersion = 0, MinorVersion = 0, DocRev = 0;
+
+  SMBIOS3_ENTRY_POINT * Smbios3 = NULL;
+  SMBIOS_STRUCTURE_TABLE * Smbios2 = NULL;
+
+  if((!EFI_ERROR(LibGetSystemConfigurationTable(&Smbios3TableGuid, (VOID**)&Smbios3))) && (Smbios3 != NULL) && compare(Smbios3->AnchorString, Smbios3Anchor, 5))
+  {
+    EntryPoint = (EFI_PHYSICAL_ADDRESS)Smbios3;
+    EntryPointType = 3;
+    MajorVersion = Smbios3->MajorVersion;
+    MinorVersion = Smbios3->MinorVersion;
+    DocRev = Smbios3->DocRev;
+    Table = (UINT8*)Smbios3->TableAddress;
+    End = Table + Smbios3->TableMaximumSize;
+  }
+  else if((!EFI_ERROR(LibGetSystemConfigurationTable(&SMBIOSTableGuid, (VOID**)&Smbios2))) && (Smbios2 != NULL) && compare(Smbios2->AnchorString, Smbios2Anchor, 4))
+  {
+    EntryPoint = (EFI_PHYSICAL_ADDRESS)Smbios2;
+    EntryPointType = 2;
+    MajorVersion = Smbios2->MajorVersion;
+    MinorVersion = Smbios2->MinorVersion;
+    Table = (UINT8*)(UINT64)Smbios2->TableAddress;
+    End = Table + Smbios2->TableLength;
+  }
+
+  if(Table == NULL)
+  {
+    return 0;
+  }
+
+  if(Index != NULL)
+  {
+    ZeroMem(Index, sizeof(LOADER_SMBIOS_TAG));
+  }
+
+  // First pass: count everything
+  UINT32 NumberOfStructures = 0, NumberOfProcessors = 0, NumberOfMemoryDevices = 0;
+  UINT8 * Structure = Table;
+
+  while(SmbiosStructureFits(Structure, End))
+  {
+    UINT8 Type = ((SMBIOS_HEADER*)Structure)->Type;
+
+    NumberOfStructures++;
+    if(Type == SMBIOS_TYPE_PROCESSOR)
+    {
+      NumberOfProcessors++;
+    }
+    else if(Type == SMBIOS_TYPE_MEMORY_DEVICE)
+    {
+      NumberOfMemoryDevices++;
+    }
+
+    if(Index != NULL)
+    {
+      Index->Types[Type].Count++;
+    }
+
+    Structure = SmbiosNextStructure(Structure, End);
+    if(Type == SMBIOS_TYPE_END_OF_TABLE)
+    {
+      break;
+    }
+  }
+
+  UINT32 StructureOffsetsOffset = sizeof(LOADER_SMBIOS_TAG);
+  UINT32 ProcessorsOffset = StructureOffsetsOffset + ((NumberOfStructures * sizeof(UINT32) + 7) & ~7U);
+  UINT32 MemoryDevicesOffset = ProcessorsOffset + NumberOfProcessors * sizeof(LOADER_SMBIOS_PROCESSOR);
+  UINT64 IndexSize = MemoryDevicesOffset + NumberOfMemoryDevices * sizeof(LOADER_SMBIOS_MEMORY_DEVICE);
+
+  if(Index == NULL)
+  {
+    return IndexSize;
+  }
+
+  Index->EntryPoint = EntryPoint;
+  Index->TableAddress = (EFI_PHYSICAL_ADDRESS)Table;
+  Index->TableLength = (UINT32)(Structure - Table);
+  Index->EntryPointType = EntryPointType;
+  Index->MajorVersion = MajorVersion;
+  Index->MinorVersion = MinorVersion;
+  Index->DocRev = DocRev;
+  Index->NumberOfStructures = NumberOfStructures;
+  Index->NumberOfProcessors = NumberOfProcessors;
+  Index->NumberOfMemoryDevices = NumberOfMemoryDevices;
+  Index->StructureOffsetsOffset = StructureOffsetsOffset;
+  Index->ProcessorsOffset = ProcessorsOffset;
+  Index->MemoryDevicesOffset = MemoryDevicesOffset;
+
+  // Each type's offsets start where the previous type's end. Count gets counted back up in the second pass.
+  UINT32 First = 0;
+  for(UINT32 t = 0; t < 256; t++)
+  {
+    Index->Types[t].First = First;
+    First += Index->Types[t].Count;
+    Index->Types[t].Count = 0;
+  }
+
+  UINT32 * StructureOffsets = (UINT32*)((UINT8*)Index + StructureOffsetsOffset);
+  LOADER_SMBIOS_PROCESSOR * Processors = (LOADER_SMBIOS_PROCESSOR*)((UINT8*)Index + ProcessorsOffset);
+  LOADER_SMBIOS_MEMORY_DEVICE * MemoryDevices = (LOADER_SMBIOS_MEMORY_DEVICE*)((UINT8*)Index + MemoryDevicesOffset);
+  UINT32 ProcessorIndex = 0, MemoryDeviceIndex = 0;
+
+  // Second pass: fill everything in
+  Structure = Table;
+  for(UINT32 i = 0; i < NumberOfStructures; i++)
+  {
+    UINT8 Type = ((SMBIOS_HEADER*)Structure)->Type;
+
+    StructureOffsets[Index->Types[Type].First + Index->Types[Type].Count] = (UINT32)(Structure - Table);
+    Index->Types[Type].Count++;
+
+    if((Type == SMBIOS_TYPE_SYSTEM_INFORMATION) && (!Index->System.Present))
+    {
+      DecodeSmbiosSystem(Table, Structure, End, &Index->System);
+    }
+    else if(Type == SMBIOS_TYPE_PROCESSOR)
+    {
+      DecodeSmbiosProcessor(Table, Structure, End, &Processors[ProcessorIndex++]);
+    }
+    else if(Type == SMBIOS_TYPE_MEMORY_DEVICE)
+    {
+      DecodeSmbiosMemoryDevice(Table, Structure, End, &MemoryDevices[MemoryDeviceIndex++]);
+    }
+
+    Structure = SmbiosNextStructure(Structure, End);
+  }
+
+  return IndexSize;
+}
@@ -0,0 +1,496 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: CPU Topology Functions
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This file contains the functions that work out how the processors are laid out (packages, dies, cores and threads) and what caches
+// they have, from CPUID and EFI_MP_SERVICES_PROTOCOL, so kernels can size per-CPU data and pick scheduling domains without redoing it.
+//
+
+#include "Bootloader.h"
+
+#define TOPOLOGY_MAX_CPU_CACHES 8  // Per processor; real CPUs have 4 or 5
+#define TOPOLOGY_MAX_CACHES     32 // Different kinds of cache in the whole system
+
+// What one processor's CPUID says about it
+typedef struct {
+  UINT32                    ApicId;
+  UINT8                     CoreType;
+  UINT8                     NumberOfCaches;
+  UINT16                    Reserved;
+  CPU_TOPOLOGY_CACHE        Caches[TOPOLOGY_MAX_CPU_CACHES];
+} TOPOLOGY_CPU_INFO;
+
+#ifdef CPU_TOPOLOGY_ALL_CPUS_ENABLED
+typedef struct {
+  TOPOLOGY_CPU_INFO        *Infos;
+  volatile UINT64           NextSlot;
+  UINT64                    NumberOfSlots;
+} TOPOLOGY_CONTEXT;
+#endif
+
+STATIC EFI_GUID TopologyMpServicesGuid = EFI_MP_SERVICES_PROTOCOL_GUID;
+
+//==================================================================================================================================
+//  TopologyBits: Count The APIC ID Bits Something Needs
+//==================================================================================================================================
+//
+// The smallest number of bits that can hold Count different values, which is how APIC IDs get split up.
+//
+
+STATIC UINT32 TopologyBits(UINT32 Count)
+{
+  UINT32 Bits = 0;
+
+  while((Bits < 32) && ((1ULL << Bits) < Count))
+  {
+    Bits++;
+  }
+
+  return Bits;
+}
+
+//==================================================================================================================================
+//  ReadCpuTopologyInfo: Read This Processor's Cache And Core Type Leaves
+//==================================================================================================================================
+//
+// Fill Info with the APIC ID, core type and caches of whatever processor this runs on. It only uses CPUID, so it can run on the APs.
+// AMD describes its caches in leaf 0x8000001D instead of 0x4, in the same format.
+//
+
+STATIC VOID ReadCpuTopologyInfo(TOPOLOGY_CPU_INFO * Info)
+{
+  UINT32 Eax, Ebx, Ecx, Edx;
+
+  Info->ApicId = GetInitialApicId();
+  Info->CoreType = 0;
+  Info->NumberOfCaches = 0;
+
+  CpuId(CPUID_MAX_LEAF, 0, &Eax, &Ebx, &Ecx, &Edx);
+  UINT32 MaxLeaf = Eax;
+  CpuId(CPUID_EXTENDED_MAX_LEAF, 0, &Eax, &Ebx, &Ecx, &Edx);
+  UINT32 MaxExtendedLeaf = Eax;
+
+  if(MaxLeaf >= CPUID_HYBRID)
+  {
+    CpuId(CPUID_STRUCTURED_FEATURES, 0, &Eax, &Ebx, &Ecx, &Edx);
+    if(Edx & CPUID_STRUCTURED_EDX_HYBRID)
+    {
+      CpuId(CPUID_HYBRID, 0, &Eax, &Ebx, &Ecx, &Edx);
+      Info->CoreType = (UINT8)(Eax >> 24);
+    }
+  }
+
+  UINT32 CacheLeaf = 0;
+  if(MaxExtendedLeaf >= CPUID_AMD_CACHE_PARAMETERS)
+  {
+    CpuId(CPUID_EXTENDED_FEATURES, 0, &Eax, &Ebx, &Ecx, &Edx);
+    if(Ecx & CPUID_EXTENDED_ECX_TOPOEXT)
+    {
+      CacheLeaf = CPUID_AMD_CACHE_PARAMETERS;
+    }
+  }
+  if((CacheLeaf == 0) && (MaxLeaf >= CPUID_CACHE_PARAMETERS))
+  {
+    CacheLeaf = CPUID_CACHE_PARAMETERS;
+  }
+  if(CacheLeaf == 0)
+  {
+    return;
+  }
+
+  for(UINT32 Subleaf = 0; Info->NumberOfCaches < TOPOLOGY_MAX_CPU_CACHES; Subleaf++)
+  {
+    CpuId(CacheLeaf, Subleaf, &Eax, &Ebx, &Ecx, &Edx);
+    if((Eax & 0x1F) == 0)
+    {
+      break;
+    }
+
+    CPU_TOPOLOGY_CACHE * Cache = &Info->Caches[Info->NumberOfCaches++];
+    ZeroMem(Cache, sizeof(CPU_TOPOLOGY_CACHE));
+    Cache->Type = (UINT8)(Eax & 0x1F);
+    Cache->Level = (UINT8)((Eax >> 5) & 0x7);
+    Cache->SharingShift = TopologyBits(((Eax >> 14) & 0xFFF) + 1);
+    Cache->LineSize = (UINT16)((Ebx & 0xFFF) + 1);
+    Cache->Partitions = (UINT16)(((Ebx >> 12) & 0x3FF) + 1);
+    Cache->Ways = ((Ebx >> 22) & 0x3FF) + 1;
+    Cache->Sets = Ecx + 1;
+    Cache->Size = (UINT64)Cache->Ways * Cache->Partitions * Cache->LineSize * Cache->Sets;
+    Cache->Flags = ((Edx & 0x2) ? CPU_TOPOLOGY_CACHE_INCLUSIVE : 0) | ((Eax & 0x200) ? CPU_TOPOLOGY_CACHE_FULLY_ASSOCIATIVE : 0) | ((Edx & 0x4) ? CPU_TOPOLOGY_CACHE_COMPLEX_INDEXING : 0);
+  }
+}
+
+#ifdef CPU_TOPOLOGY_ALL_CPUS_ENABLED
+// This runs on the APs, so no boot services in here
+STATIC VOID EFIAPI TopologyWorker(VOID * Argument)
+{
+  TOPOLOGY_CONTEXT * Context = (TOPOLOGY_CONTEXT*)Argument;
+  UINT64 Slot = __atomic_fetch_add(&Context->NextSlot, 1, __ATOMIC_RELAXED);
+
+  if(Slot < Context->NumberOfSlots)
+  {
+    ReadCpuTopologyInfo(&Context->Infos[Slot]);
+  }
+}
+#endif
+
+//==================================================================================================================================
+//  GetTopologyShifts: Work Out How APIC IDs Are Split Up
+//==================================================================================================================================
+//
+// Set the ThreadShift, CoreShift, PackageShift and Source of Topology from the BSP's CPUID, trying the extended topology leaves first,
+// then AMD's leaves, and then the old leaf 0x1 and 0x4 counts.
+//
+
+STATIC VOID GetTopologyShifts(CPU_TOPOLOGY * Topology)
+{
+  UINT32 Eax, Ebx, Ecx, Edx;
+
+  CpuId(CPUID_MAX_LEAF, 0, &Eax, &Ebx, &Ecx, &Edx);
+  UINT32 MaxLeaf = Eax;
+  CpuId(CPUID_EXTENDED_MAX_LEAF, 0, &Eax, &Ebx, &Ecx, &Edx);
+  UINT32 MaxExtendedLeaf = Eax;
+
+  UINT32 TopologyLeaf = 0;
+  if(MaxLeaf >= CPUID_V2_EXTENDED_TOPOLOGY)
+  {
+    CpuId(CPUID_V2_EXTENDED_TOPOLOGY, 0, &Eax, &Ebx, &Ecx, &Edx);
+    if(Ebx != 0)
+    {
+      TopologyLeaf = CPUID_V2_EXTENDED_TOPOLOGY;
+      Topology->Source = CPU_TOPOLOGY_LEAF_1F;
+    }
+  }
+  if((TopologyLeaf == 0) && (MaxLeaf >= CPUID_EXTENDED_TOPOLOGY))
+  {
+    CpuId(CPUID_EXTENDED_TOPOLOGY, 0, &Eax, &Ebx, &Ecx, &Edx);
+    if(Ebx != 0)
+    {
+      TopologyLeaf = CPUID_EXTENDED_TOPOLOGY;
+      Topology->Source = CPU_TOPOLOGY_LEAF_B;
+    }
+  }
+
+  if(TopologyLeaf != 0)
+  {
+    // Level types: 1 is SMT, 2 core, 3 module, 4 tile, 5 die, 6 die group. Each level's shift gets to the ID of the next one up, and
+    // the last one's gets to the package.
+    UINT32 ThreadShift = 0, CoreShift = 0, PackageShift = 0;
+    for(UINT32 Subleaf = 0; Subleaf < 8; Subleaf++)
+    {
+      CpuId(TopologyLeaf, Subleaf, &Eax, &Ebx, &Ecx, &Edx);
+      UINT32 LevelType = (Ecx >> 8) & 0xFF;
+      if(LevelType == 0)
+      {
+        break;
+      }
+
+      UINT32 Shift = Eax & 0x1F;
+      if(LevelType == 1)
+      {
+        ThreadShift = Shift;
+      }
+      if(LevelType < 5)
+      {
+        CoreShift = Shift;
+      }
+      PackageShift = Shift;
+    }
+
+    Topology->ThreadShift = (UINT8)ThreadShift;
+    Topology->CoreShift = (UINT8)((CoreShift > ThreadShift) ? CoreShift : ThreadShift);
+    Topology->PackageShift = (UINT8)PackageShift;
+    return;
+  }
+
+  // Leaf 0x80000008 ECX is reserved (0) on Intel
+  if(MaxExtendedLeaf >= CPUID_ADDRESS_SIZES)
+  {
+    CpuId(CPUID_EXTENDED_FEATURES, 0, &Eax, &Ebx, &Ecx, &Edx);
+    UINT32 TopologyExtensions = Ecx & CPUID_EXTENDED_ECX_TOPOEXT;
+
+    CpuId(CPUID_ADDRESS_SIZES, 0, &Eax, &Ebx, &Ecx, &Edx);
+    if(Ecx & 0xF0FF)
+    {
+      UINT32 PackageShift = (Ecx >> 12) & 0xF;
+      if(PackageShift == 0)
+      {
+        PackageShift = TopologyBits((Ecx & 0xFF) + 1);
+      }
+
+      UINT32 ThreadShift = 0, CoreShift = PackageShift;
+      if(TopologyExtensions && (MaxExtendedLeaf >= CPUID_AMD_PROCESSOR_TOPOLOGY))
+      {
+        CpuId(CPUID_AMD_PROCESSOR_TOPOLOGY, 0, &Eax, &Ebx, &Ecx, &Edx);
+        ThreadShift = TopologyBits(((Ebx >> 8) & 0xFF) + 1);
+        UINT32 NodeBits = TopologyBits(((Ecx >> 8) & 0x7) + 1);
+        CoreShift = (PackageShift > NodeBits) ? PackageShift - NodeBits : PackageShift;
+      }
+
+      Topology->ThreadShift = (UINT8)((ThreadShift < CoreShift) ? ThreadShift : CoreShift);
+      Topology->CoreShift = (UINT8)CoreShift;
+      Topology->PackageShift = (UINT8)PackageShift;
+      Topology->Source = CPU_TOPOLOGY_AMD;
+      return;
+    }
+  }
+
+  // Leaf 0x1 has how many APIC IDs a package takes up, and leaf 0x4 how many of those are cores
+  CpuId(CPUID_FEATURES, 0, &Eax, &Ebx, &Ecx, &Edx);
+  UINT32 PackageShift = (Edx & CPUID_FEATURES_EDX_HTT) ? TopologyBits((Ebx >> 16) & 0xFF) : 0;
+  UINT32 CoreBits = 0;
+  if(MaxLeaf >= CPUID_CACHE_PARAMETERS)
+  {
+    CpuId(CPUID_CACHE_PARAMETERS, 0, &Eax, &Ebx, &Ecx, &Edx);
+    CoreBits = TopologyBits((Eax >> 26) + 1);
+  }
+
+  Topology->ThreadShift = (UINT8)((PackageShift > CoreBits) ? PackageShift - CoreBits : 0);
+  Topology->CoreShift = (UINT8)PackageShift;
+  Topology->PackageShift = (UINT8)PackageShift;
+  Topology->Source = CPU_TOPOLOGY_LEGACY;
+}
+
+//==================================================================================================================================
+//  AddTopologyCaches: Merge One Processor's Caches Into The Table
+//==================================================================================================================================
+//
+// Add each of Info's caches to Caches unless an identical one is already there. Returns the shift of Info's last-level cache.
+//
+
+STATIC UINT32 AddTopologyCaches(CPU_TOPOLOGY * Topology, CPU_TOPOLOGY_CACHE * Caches, TOPOLOGY_CPU_INFO * Info)
+{
+  UINT32 LlcShift = Topology->PackageShift;
+  UINT32 LlcLevel = 0;
+
+  for(UINT32 i = 0; i < Info->NumberOfCaches; i++)
+  {
+    CPU_TOPOLOGY_CACHE * Cache = &Info->Caches[i];
+    Cache->CoreType = (Topology->Flags & CPU_TOPOLOGY_HYBRID) ? Info->CoreType : 0;
+
+    if((Cache->Type != CPU_TOPOLOGY_CACHE_INSTRUCTION) && (Cache->Level >= LlcLevel))
+    {
+      LlcLevel = Cache->Level;
+      LlcShift = Cache->SharingShift;
+    }
+
+    UINT32 k;
+    for(k = 0; k < Topology->NumberOfCaches; k++)
+    {
+      if(compare(&Caches[k], Cache, sizeof(CPU_TOPOLOGY_CACHE)))
+      {
+        break;
+      }
+    }
+
+    if((k == Topology->NumberOfCaches) && (Topology->NumberOfCaches < TOPOLOGY_MAX_CACHES))
+    {
+      Caches[Topology->NumberOfCaches++] = *Cache;
+    }
+  }
+
+  return LlcShift;
+}
+
+//==================================================================================================================================
+//  GetCpuTopology: Describe The Processors And Their Caches
+//==================================================================================================================================
+//
+// Allocate a CPU_TOPOLOGY and fill it in. The list of processors comes from EFI_MP_SERVICES_PROTOCOL (just the BSP if there isn't one),
+// and each one's package, die, core and thread come from splitting its APIC ID with the BSP's shifts. Sorting by APIC ID puts
+// everything that shares a core, die, package or cache next to each other, so numbering them is just counting changes.
+//
+// With CPU_TOPOLOGY_ALL_CPUS_ENABLED, every AP also reads its own core type and caches. Otherwise they're assumed to be the same as the
+// BSP's, which is only wrong on hybrid CPUs.
+//
+// This has to run before ParkApplicationProcessors(), since the APs don't come back from that.
+//
+
+EFI_STATUS GetCpuTopology(CPU_TOPOLOGY ** Topology)
+{
+  EFI_STATUS topology_status;
+  EFI_MP_SERVICES_PROTOCOL * MpServices = NULL;
+  UINTN NumberOfProcessors = 1, NumberOfEnabledProcessors = 1;
+  UINT32 Eax, Ebx, Ecx, Edx;
+
+  if(EFI_ERROR(BS->LocateProtocol(&TopologyMpServicesGuid, NULL, (void**)&MpServices)) || EFI_ERROR(MpServices->GetNumberOfProcessors(MpServices, &NumberOfProcessors, &NumberOfEnabledProcessors)))
+  {
+    MpServices = NULL;
+    NumberOfProcessors = 1;
+    NumberOfEnabledProcessors = 1;
+  }
+
+  UINT64 CacheOffset = sizeof(CPU_TOPOLOGY) + NumberOfProcessors * sizeof(CPU_TOPOLOGY_CPU);
+  UINT64 MaxSize = CacheOffset + TOPOLOGY_MAX_CACHES * sizeof(CPU_TOPOLOGY_CACHE);
+
+  topology_status = BS->AllocatePool(EfiLoaderData, MaxSize, (void**)Topology);
+  if(EFI_ERROR(topology_status))
+  {
+    Print(L"Error allocating CPU topology. 0x%llx\r\n", topology_status);
+    return topology_status;
+  }
+
+  CPU_TOPOLOGY * Table = *Topology;
+  ZeroMem(Table, MaxSize);
+  Table->CacheOffset = (UINT32)CacheOffset;
+  CPU_TOPOLOGY_CACHE * Caches = (CPU_TOPOLOGY_CACHE*)((UINT8*)Table + CacheOffset);
+
+  if(MpServices == NULL)
+  {
+    Table->Flags |= CPU_TOPOLOGY_BSP_ONLY;
+  }
+
+  CpuId(CPUID_MAX_LEAF, 0, &Eax, &Ebx, &Ecx, &Edx);
+  if(Eax >= CPUID_STRUCTURED_FEATURES)
+  {
+    CpuId(CPUID_STRUCTURED_FEATURES, 0, &Eax, &Ebx, &Ecx, &Edx);
+    if(Edx & CPUID_STRUCTURED_EDX_HYBRID)
+    {
+      Table->Flags |= CPU_TOPOLOGY_HYBRID;
+    }
+  }
+
+  GetTopologyShifts(Table);
+
+  TOPOLOGY_CPU_INFO BspInfo;
+  ReadCpuTopologyInfo(&BspInfo);
+  UINT32 BspLlcShift = AddTopologyCaches(Table, Caches, &BspInfo);
+
+  // Everything firmware knows about, in ProcessorNumber order for now
+  for(UINTN ProcessorNumber = 0; ProcessorNumber < NumberOfProcessors; ProcessorNumber++)
+  {
+    CPU_TOPOLOGY_CPU * Cpu = &Table->Cpus[Table->NumberOfCpus];
+
+    if(MpServices == NULL)
+    {
+      Cpu->ApicId = BspInfo.ApicId;
+      Cpu->Flags = CPU_TOPOLOGY_CPU_BSP | CPU_TOPOLOGY_CPU_ENABLED;
+    }
+    else
+    {
+      EFI_PROCESSOR_INFORMATION ProcessorInfo;
+      if(EFI_ERROR(MpServices->GetProcessorInfo(MpServices, ProcessorNumber, &ProcessorInfo)))
+      {
+        continue;
+      }
+
+      Cpu->ApicId = (UINT32)ProcessorInfo.ProcessorId;
+      Cpu->Flags = ((ProcessorInfo.StatusFlag & PROCESSOR_AS_BSP_BIT) ? CPU_TOPOLOGY_CPU_BSP : 0) | ((ProcessorInfo.StatusFlag & PROCESSOR_ENABLED_BIT) ? CPU_TOPOLOGY_CPU_ENABLED : 0);
+    }
+
+    if(Cpu->Flags & CPU_TOPOLOGY_CPU_BSP)
+    {
+      Cpu->Flags |= CPU_TOPOLOGY_CPU_ENUMERATED;
+      Cpu->CoreType = BspInfo.CoreType;
+    }
+
+    // Stash the LLC shift here until the numbering is done
+    Cpu->LlcDomain = BspLlcShift;
+    Table->NumberOfCpus++;
+  }
+
+#ifdef CPU_TOPOLOGY_ALL_CPUS_ENABLED
+  if((MpServices != NULL) && (NumberOfEnabledProcessors > 1))
+  {
+    TOPOLOGY_CONTEXT Context;
+    Context.NextSlot = 0;
+    Context.NumberOfSlots = NumberOfEnabledProcessors - 1;
+
+    topology_status = BS->AllocatePool(EfiBootServicesData, Context.NumberOfSlots * sizeof(TOPOLOGY_CPU_INFO), (void**)&Context.Infos);
+    if(EFI_ERROR(topology_status))
+    {
+      Print(L"Topology AllocatePool error. 0x%llx\r\n", topology_status);
+      return topology_status;
+    }
+    ZeroMem(Context.Infos, Context.NumberOfSlots * sizeof(TOPOLOGY_CPU_INFO));
+
+    // Blocking, since it's only a few CPUID instructions per AP
+    if(!EFI_ERROR(MpServices->StartupAllAPs(MpServices, TopologyWorker, FALSE, NULL, 0, &Context, NULL)))
+    {
+      Table->Flags |= CPU_TOPOLOGY_ALL_CPUS;
+
+      UINT64 Slots = (Context.NextSlot < Context.NumberOfSlots) ? Context.NextSlot : Context.NumberOfSlots;
+      for(UINT64 Slot = 0; Slot < Slots; Slot++)
+      {
+        TOPOLOGY_CPU_INFO * Info = &Context.Infos[Slot];
+        UINT32 LlcShift = AddTopologyCaches(Table, Caches, Info);
+
+        for(UINT32 i = 0; i < Table->NumberOfCpus; i++)
+        {
+          CPU_TOPOLOGY_CPU * Cpu = &Table->Cpus[i];
+          if((Cpu->ApicId == Info->ApicId) && !(Cpu->Flags & CPU_TOPOLOGY_CPU_BSP))
+          {
+            Cpu->Flags |= CPU_TOPOLOGY_CPU_ENUMERATED;
+            Cpu->CoreType = Info->CoreType;
+            Cpu->LlcDomain = LlcShift;
+            break;
+          }
+        }
+      }
+    }
+
+    BS->FreePool(Context.Infos);
+  }
+#endif
+
+  // Insertion sort, since there aren't that many and firmware usually has them nearly sorted anyway
+  for(UINT32 i = 1; i < Table->NumberOfCpus; i++)
+  {
+    CPU_TOPOLOGY_CPU Cpu = Table->Cpus[i];
+    UINT32 j = i;
+    while((j > 0) && (Table->Cpus[j - 1].ApicId > Cpu.ApicId))
+    {
+      Table->Cpus[j] = Table->Cpus[j - 1];
+      j--;
+    }
+    Table->Cpus[j] = Cpu;
+  }
+
+  for(UINT32 i = 0; i < Table->NumberOfCpus; i++)
+  {
+    CPU_TOPOLOGY_CPU * Cpu = &Table->Cpus[i];
+    CPU_TOPOLOGY_CPU * Previous = (i == 0) ? NULL : &Table->Cpus[i - 1];
+    UINT32 LlcShift = Cpu->LlcDomain;
+
+    if((Previous == NULL) || ((Cpu->ApicId >> Table->PackageShift) != (Previous->ApicId >> Table->PackageShift)))
+    {
+      Table->NumberOfPackages++;
+    }
+    if((Previous == NULL) || ((Cpu->ApicId >> Table->CoreShift) != (Previous->ApicId >> Table->CoreShift)))
+    {
+      Table->NumberOfDies++;
+    }
+    if((Previous == NULL) || ((Cpu->ApicId >> Table->ThreadShift) != (Previous->ApicId >> Table->ThreadShift)))
+    {
+      Table->NumberOfCores++;
+      Cpu->Thread = 0;
+    }
+    else
+    {
+      Cpu->Thread = Previous->Thread + 1;
+    }
+    if((Previous == NULL) || ((Cpu->ApicId >> LlcShift) != (Previous->ApicId >> LlcShift)))
+    {
+      Table->NumberOfLlcDomains++;
+    }
+
+    Cpu->Package = Table->NumberOfPackages - 1;
+    Cpu->Die = Table->NumberOfDies - 1;
+    Cpu->Core = Table->NumberOfCores - 1;
+    Cpu->LlcDomain = Table->NumberOfLlcDomains - 1;
+  }
+
+  Table->Size = (UINT32)(CacheOffset + Table->NumberOfCaches * sizeof(CPU_TOPOLOGY_CACHE));
+
+  LOG_MESSAGE(HANDOFF, DEBUG, L"CPU topology: %u CPUs, %u cores, %u dies, %u packages, %u LLC domains, %u caches, source %u", Table->NumberOfCpus, Table->NumberOfCores, Table->NumberOfDies, Table->NumberOfPackages, Table->NumberOfLlcDomains, Table->NumberOfCaches, (UINT32)Table->Source);
+
+  return EFI_SUCCESS;
+}
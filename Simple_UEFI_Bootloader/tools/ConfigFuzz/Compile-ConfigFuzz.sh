@@ -0,0 +1,40 @@
+#!/bin/bash
+#
+# =================================
+#
+# RELEASE VERSION 1.0
+#
+# Kernel64.txt Parser Fuzzer & Benchmark Linux Compile Script
+#
+# by KNNSpeed
+#
+# =================================
+#
+# Builds the host-side Kernel64.txt parser tester from ConfigFuzz.c and the bootloader's own src/Config.c. Uses the host's GCC, not
+# the UEFI toolchain. Usage: ./Compile-ConfigFuzz.sh, then ./configfuzz sample_Kernel64.txt
+#
+# ./Compile-ConfigFuzz.sh sanitize builds it with AddressSanitizer and UBSan instead, which is what fuzzing (-f) should use. Don't
+# benchmark that build.
+#
+
+set +v
+
+CurDir=$PWD
+LoaderDir=$CurDir/../..
+EFI_FOLDER_NAME=$LoaderDir/../Backend/gnu-efi-3.0.9
+
+Extra="-O2"
+if [ "$1" == "sanitize" ]; then
+  Extra="-O1 -g -fsanitize=address,undefined -fno-sanitize-recover=all"
+fi
+
+#
+# GNU_EFI_USE_MS_ABI and -fshort-wchar make the structures match what the bootloader sees, so Config.c compiles exactly as it does
+# for the real thing.
+#
+
+gcc -DGNU_EFI_USE_MS_ABI -fshort-wchar $Extra --std=gnu11 -Wall -Wextra -Wno-pointer-sign -I$LoaderDir/inc/ -I$EFI_FOLDER_NAME/inc -I$EFI_FOLDER_NAME/inc/x86_64 -I$EFI_FOLDER_NAME/inc/protocol -o configfuzz $LoaderDir/src/Config.c ConfigFuzz.c
+
+echo
+echo "Done!"
+echo
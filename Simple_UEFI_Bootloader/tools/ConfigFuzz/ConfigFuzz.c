@@ -0,0 +1,589 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Kernel64.txt Parser Fuzzer and Benchmark
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This is a host-side (Linux) program, not part of the bootloader. It links against the bootloader's own src/Config.c and does one
+// of three things with ParseLoaderConfig():
+//
+//  - Check: parse Kernel64.txt files and print what the loader would make of them, including the line of the first mistake.
+//  - Fuzz (-f): mutate the given files (plus a few built-in ones) at random for a number of rounds, and check every result: spans
+//    have to stay inside the file, convert to exactly as many UTF-16 units as they claim, and entries have to be in range. Build
+//    with "./Compile-ConfigFuzz.sh sanitize" so that reads past the end of the file get caught too.
+//  - Benchmark (-b): parse each file and convert all of its strings over and over, and report the time per parse.
+//
+// Build with Compile-ConfigFuzz.sh. Run with no arguments to see the options.
+//
+
+#include "Bootloader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FUZZ_MAX_FILE_SIZE      (64 * 1024)
+#define FUZZ_MAX_SEEDS          64
+#define FUZZ_DEFAULT_ROUNDS     1000000ULL
+#define BENCH_DEFAULT_SECONDS   2
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  Built-In Seeds
+//----------------------------------------------------------------------------------------------------------------------------------
+
+STATIC CONST char SeedV2[] =
+  "# Two kernels and a module\r\n"
+  "timeout = 5\r\n"
+  "gop_timeout = 30\r\n"
+  "gop = 1920x1080\r\n"
+  "default = test\r\n"
+  "\r\n"
+  "[main]\r\n"
+  "kernel = \\EFI\\Kernel\\Kernel64.elf\r\n"
+  "options = root=/dev/nvme0n1p2 quiet loader.log=info,gop:debug\r\n"
+  "module = \\EFI\\Kernel\\initrd.img\r\n"
+  "\r\n"
+  "[test]\r\n"
+  "kernel = \\EFI\\Kernel\\Test64.efi\r\n"
+  "placement = below4g\r\n"
+  "options = \xE2\x9C\x93 \xF0\x9F\x9A\x80\n";
+
+STATIC CONST char SeedV1[] =
+  "\\EFI\\Kernel\\Kernel64.elf\r\n"
+  "root=/dev/sda1 ro quiet\r\n"
+  "\r\n"
+  "Anything can go down here.\r\n";
+
+STATIC CONST char SeedMistakes[] =
+  "kernel = \\a\n"
+  "[unclosed\n"
+  "bogus key = 1\n"
+  "timeout = soon\n"
+  "[x] trailing\n"
+  "module =\n"
+  "[]\n"
+  "gop = 0x0\n"
+  "default = nowhere\n";
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  Shared State
+//----------------------------------------------------------------------------------------------------------------------------------
+
+typedef struct {
+  UINT8 * Data;
+  UINT64 Size;
+  CONST char * Name;
+} FUZZ_FILE;
+
+STATIC FUZZ_FILE Seeds[FUZZ_MAX_SEEDS];
+STATIC UINT64 SeedCount = 0;
+STATIC UINT64 RandomState = 0x9E3779B97F4A7C15ULL;
+
+// Pieces of syntax worth splicing in, since random bytes would almost never make them
+STATIC CONST char * CONST Tokens[] = {
+  "[", "]", "=", " ", "\t", "\r", "\n", "\r\n", "#", ";", "[a]\n", "kernel", "options", "module", "placement", "timeout",
+  "gop_timeout", "gop", "default", "below4g", "native", "menu", "1024x768", "\\EFI\\k", "99999999999", "\xEF\xBB\xBF",
+  "\xFF\xFE", "\xFE\xFF", "\xC0\x80", "\xED\xA0\x80", "\xF4\x90\x80\x80", "\xF0\x9F\x9A", "\xE2\x82", "\x80", "\x00"
+};
+
+STATIC UINT64 Random(VOID)
+{
+  // xorshift64*, so runs can be repeated with -s
+  RandomState ^= RandomState >> 12;
+  RandomState ^= RandomState << 25;
+  RandomState ^= RandomState >> 27;
+  return RandomState * 0x2545F4914F6CDD1DULL;
+}
+
+STATIC VOID AddSeed(CONST VOID * Data, UINT64 Size, CONST char * Name)
+{
+  if((SeedCount == FUZZ_MAX_SEEDS) || (Size > FUZZ_MAX_FILE_SIZE))
+  {
+    fprintf(stderr, "Skipping %s: too many files, or too big\n", Name);
+    return;
+  }
+
+  Seeds[SeedCount].Data = malloc(Size ? Size : 1);
+  memcpy(Seeds[SeedCount].Data, Data, Size);
+  Seeds[SeedCount].Size = Size;
+  Seeds[SeedCount].Name = Name;
+  SeedCount++;
+}
+
+// The same text as UTF-16LE with a BOM, which is what older Kernel64.txt files are
+STATIC VOID AddSeedUtf16(CONST char * Text, CONST char * Name)
+{
+  UINT64 Length = strlen(Text);
+  UINT8 * Data = malloc(2 + 2 * Length);
+
+  Data[0] = 0xFF;
+  Data[1] = 0xFE;
+  for(UINT64 i = 0; i < Length; i++)
+  {
+    Data[2 + 2 * i] = (UINT8)Text[i];
+    Data[3 + 2 * i] = 0;
+  }
+  AddSeed(Data, 2 + 2 * Length, Name);
+  free(Data);
+}
+
+STATIC int LoadSeed(CONST char * Path)
+{
+  FILE * File = fopen(Path, "rb");
+  if(File == NULL)
+  {
+    perror(Path);
+    return 0;
+  }
+
+  UINT8 * Data = malloc(FUZZ_MAX_FILE_SIZE + 1);
+  UINT64 Size = fread(Data, 1, FUZZ_MAX_FILE_SIZE + 1, File);
+  fclose(File);
+
+  AddSeed(Data, Size, Path);
+  free(Data);
+  return 1;
+}
+
+//==================================================================================================================================
+//  PrintSpan: Show A Span As UTF-8
+//==================================================================================================================================
+
+STATIC VOID PrintSpan(CONST LOADER_CONFIG * Config, CONST LOADER_CONFIG_SPAN * Span)
+{
+  CHAR16 * String = malloc((Span->Length + 1) * sizeof(CHAR16));
+  UINT64 Length = ConfigSpanToChar16(Config, Span, String);
+
+  putchar('"');
+  for(UINT64 i = 0; i < Length; i++)
+  {
+    UINT32 Char = String[i];
+    if(((Char & 0xFC00) == 0xD800) && (i + 1 < Length))
+    {
+      Char = 0x10000 + ((Char - 0xD800) << 10) + (String[++i] - 0xDC00);
+    }
+
+    if(Char < 0x80)
+    {
+      putchar((int)Char);
+    }
+    else if(Char < 0x800)
+    {
+      printf("%c%c", 0xC0 | (Char >> 6), 0x80 | (Char & 0x3F));
+    }
+    else if(Char < 0x10000)
+    {
+      printf("%c%c%c", 0xE0 | (Char >> 12), 0x80 | ((Char >> 6) & 0x3F), 0x80 | (Char & 0x3F));
+    }
+    else
+    {
+      printf("%c%c%c%c", 0xF0 | (Char >> 18), 0x80 | ((Char >> 12) & 0x3F), 0x80 | ((Char >> 6) & 0x3F), 0x80 | (Char & 0x3F));
+    }
+  }
+  putchar('"');
+  free(String);
+}
+
+//==================================================================================================================================
+//  Check: Print What The Loader Would See
+//==================================================================================================================================
+
+STATIC int Check(CONST FUZZ_FILE * File)
+{
+  LOADER_CONFIG Config;
+  EFI_STATUS Status = ParseLoaderConfig(File->Data, File->Size, &Config);
+
+  printf("%s: v%u, %s, status 0x%llx\n", File->Name, Config.Version, (Config.Encoding == LOADER_CONFIG_UTF16) ? "UTF-16" : "UTF-8", (unsigned long long)Status);
+  if(Config.ErrorLine)
+  {
+    printf("  Line %u ignored (the first one that was)\n", Config.ErrorLine);
+  }
+  if(EFI_ERROR(Status))
+  {
+    return 1;
+  }
+
+  printf("  timeout %u, gop_timeout %u, gop ", Config.Timeout, Config.GopTimeout);
+  if(Config.Gop == LOADER_CONFIG_GOP_RESOLUTION)
+  {
+    printf("%ux%u\n", Config.GopWidth, Config.GopHeight);
+  }
+  else
+  {
+    printf("%s\n", (Config.Gop == LOADER_CONFIG_GOP_NATIVE) ? "native" : "menu");
+  }
+
+  for(UINT32 i = 0; i < Config.NumberOfEntries; i++)
+  {
+    LOADER_CONFIG_ENTRY * Entry = &Config.Entries[i];
+
+    printf("  %u%s ", i + 1, (i == Config.DefaultEntry) ? "*" : " ");
+    PrintSpan(&Config, &Entry->Name);
+    printf(" (line %u)%s\n    kernel  ", Entry->Line, (Entry->Placement == LOADER_PLACEMENT_BELOW_4GB) ? ", below 4GB" : "");
+    PrintSpan(&Config, &Entry->Kernel);
+    printf("\n    options ");
+    PrintSpan(&Config, &Entry->Options);
+    printf("\n");
+    for(UINT32 k = 0; k < Entry->NumberOfModules; k++)
+    {
+      printf("    module  ");
+      PrintSpan(&Config, &Entry->Modules[k]);
+      printf("\n");
+    }
+  }
+
+  return 0;
+}
+
+//==================================================================================================================================
+//  Fuzz: Mutate, Parse And Check
+//==================================================================================================================================
+
+STATIC UINT64 Mutate(UINT8 * Data, UINT64 Size)
+{
+  UINT64 Mutations = 1 + Random() % 8;
+
+  for(UINT64 m = 0; m < Mutations; m++)
+  {
+    UINT64 Where = Size ? Random() % (Size + 1) : 0;
+
+    switch(Random() % 6)
+    {
+      case 0: // Flip a bit
+        if(Where < Size)
+        {
+          Data[Where] ^= (UINT8)(1 << (Random() % 8));
+        }
+        break;
+      case 1: // Random byte
+        if(Where < Size)
+        {
+          Data[Where] = (UINT8)Random();
+        }
+        break;
+      case 2: // Delete a run
+        if(Where < Size)
+        {
+          UINT64 Run = 1 + Random() % 16;
+          if(Run > Size - Where)
+          {
+            Run = Size - Where;
+          }
+          memmove(&Data[Where], &Data[Where + Run], Size - Where - Run);
+          Size -= Run;
+        }
+        break;
+      case 3: // Truncate
+        Size = Where;
+        break;
+      default: // Splice in a token
+      {
+        CONST char * Token = Tokens[Random() % (sizeof(Tokens) / sizeof(Tokens[0]))];
+        UINT64 TokenSize = strlen(Token) ? strlen(Token) : 1; // "\x00" is one NUL byte
+        if(Size + TokenSize <= FUZZ_MAX_FILE_SIZE)
+        {
+          memmove(&Data[Where + TokenSize], &Data[Where], Size - Where);
+          memcpy(&Data[Where], Token, TokenSize);
+          Size += TokenSize;
+        }
+        break;
+      }
+    }
+  }
+
+  return Size;
+}
+
+STATIC int CheckSpan(CONST LOADER_CONFIG * Config, CONST LOADER_CONFIG_SPAN * Span, CONST char * What)
+{
+  if((UINT64)Span->Offset + Span->Bytes > Config->FileSize)
+  {
+    printf("%s span 0x%x + 0x%x is past the end of the file (0x%llx)\n", What, Span->Offset, Span->Bytes, (unsigned long long)Config->FileSize);
+    return 0;
+  }
+
+  if(Span->Length > Span->Bytes)
+  {
+    printf("%s span is %u units long but only %u bytes\n", What, Span->Length, Span->Bytes);
+    return 0;
+  }
+
+  // One extra CHAR16 past the null terminator, to catch writes past the end
+  CHAR16 * String = malloc((Span->Length + 2) * sizeof(CHAR16));
+  String[Span->Length + 1] = 0xA5A5;
+  UINT64 Length = ConfigSpanToChar16(Config, Span, String);
+  int Good = (Length == Span->Length) && (String[Length] == L'\0') && (String[Span->Length + 1] == 0xA5A5);
+
+  for(UINT64 i = 0; Good && (i < Length); i++)
+  {
+    if((String[i] & 0xFC00) == 0xD800)
+    {
+      Good = (i + 1 < Length) && ((String[i + 1] & 0xFC00) == 0xDC00);
+      i++;
+    }
+    else if((String[i] & 0xFC00) == 0xDC00)
+    {
+      Good = 0;
+    }
+  }
+
+  if(!Good)
+  {
+    printf("%s span converted to %llu units instead of %u, or isn't valid UTF-16\n", What, (unsigned long long)Length, Span->Length);
+  }
+  free(String);
+  return Good;
+}
+
+STATIC int CheckConfig(CONST LOADER_CONFIG * Config, EFI_STATUS Status)
+{
+  if((Status != EFI_SUCCESS) && (Status != EFI_NOT_FOUND) && (Status != EFI_UNSUPPORTED))
+  {
+    printf("Unexpected status 0x%llx\n", (unsigned long long)Status);
+    return 0;
+  }
+
+  if(EFI_ERROR(Status))
+  {
+    return 1;
+  }
+
+  if((Config->NumberOfEntries == 0) || (Config->NumberOfEntries > LOADER_CONFIG_MAX_ENTRIES) || (Config->DefaultEntry >= Config->NumberOfEntries)
+     || (Config->SelectedEntry != Config->DefaultEntry) || ((Config->Version != 1) && (Config->Version != 2)))
+  {
+    printf("Bad entry count %u, default %u, or version %u\n", Config->NumberOfEntries, Config->DefaultEntry, Config->Version);
+    return 0;
+  }
+
+  for(UINT32 i = 0; i < Config->NumberOfEntries; i++)
+  {
+    CONST LOADER_CONFIG_ENTRY * Entry = &Config->Entries[i];
+
+    if((Entry->Kernel.Bytes == 0) || (Entry->NumberOfModules > LOADER_CONFIG_MAX_MODULES) || (Entry->Placement > LOADER_PLACEMENT_BELOW_4GB))
+    {
+      printf("Entry %u has no kernel, too many modules, or a bad placement\n", i);
+      return 0;
+    }
+
+    if(!CheckSpan(Config, &Entry->Name, "Name") || !CheckSpan(Config, &Entry->Kernel, "Kernel") || !CheckSpan(Config, &Entry->Options, "Options"))
+    {
+      return 0;
+    }
+
+    for(UINT32 k = 0; k < Entry->NumberOfModules; k++)
+    {
+      if(!CheckSpan(Config, &Entry->Modules[k], "Module"))
+      {
+        return 0;
+      }
+    }
+  }
+
+  return 1;
+}
+
+STATIC int Fuzz(UINT64 Rounds)
+{
+  UINT8 * Data = malloc(FUZZ_MAX_FILE_SIZE);
+  UINT64 Parsed[3] = {0}; // Successes, EFI_NOT_FOUND, EFI_UNSUPPORTED
+  LOADER_CONFIG Config;
+
+  for(UINT64 Round = 0; Round < Rounds; Round++)
+  {
+    UINT64 Size;
+
+    if(Random() % 16 == 0)
+    {
+      // Pure noise now and then
+      Size = Random() % 512;
+      for(UINT64 i = 0; i < Size; i++)
+      {
+        Data[i] = (UINT8)Random();
+      }
+    }
+    else
+    {
+      FUZZ_FILE * Seed = &Seeds[Random() % SeedCount];
+      memcpy(Data, Seed->Data, Seed->Size);
+      Size = Mutate(Data, Seed->Size);
+    }
+
+    // An exact-size copy, so the sanitizer notices any read past the end
+    UINT8 * File = malloc(Size ? Size : 1);
+    memcpy(File, Data, Size);
+
+    EFI_STATUS Status = ParseLoaderConfig(File, Size, &Config);
+    if(!CheckConfig(&Config, Status))
+    {
+      FILE * Crash = fopen("configfuzz-failure.bin", "wb");
+      if(Crash != NULL)
+      {
+        fwrite(File, 1, Size, Crash);
+        fclose(Crash);
+      }
+      printf("Round %llu failed; the input is in configfuzz-failure.bin\n", (unsigned long long)Round);
+      free(File);
+      free(Data);
+      return 1;
+    }
+
+    Parsed[(Status == EFI_SUCCESS) ? 0 : (Status == EFI_NOT_FOUND) ? 1 : 2]++;
+    free(File);
+  }
+
+  printf("%llu rounds: %llu parsed, %llu without a kernel, %llu big-endian\n", (unsigned long long)Rounds, (unsigned long long)Parsed[0], (unsigned long long)Parsed[1], (unsigned long long)Parsed[2]);
+  free(Data);
+  return 0;
+}
+
+//==================================================================================================================================
+//  Benchmark: Time Parsing Plus Conversion
+//==================================================================================================================================
+//
+// Each iteration does what the loader does with the file: parse it, then convert the selected entry's kernel path, options and
+// modules to UTF-16.
+//
+
+STATIC UINT64 NowNanoseconds(VOID)
+{
+  struct timespec Now;
+  clock_gettime(CLOCK_MONOTONIC, &Now);
+  return (UINT64)Now.tv_sec * 1000000000ULL + (UINT64)Now.tv_nsec;
+}
+
+STATIC VOID Benchmark(CONST FUZZ_FILE * File, UINT64 Seconds)
+{
+  LOADER_CONFIG Config;
+  CHAR16 * String = malloc((File->Size + 1) * sizeof(CHAR16)); // Nothing converts to more units than it has bytes
+  UINT64 Iterations = 0;
+  UINT64 Checksum = 0;
+  UINT64 Start = NowNanoseconds();
+  UINT64 Elapsed;
+
+  do
+  {
+    for(UINT32 Batch = 0; Batch < 1000; Batch++)
+    {
+      if(!EFI_ERROR(ParseLoaderConfig(File->Data, File->Size, &Config)))
+      {
+        LOADER_CONFIG_ENTRY * Entry = &Config.Entries[Config.SelectedEntry];
+        Checksum += ConfigSpanToChar16(&Config, &Entry->Kernel, String);
+        Checksum += ConfigSpanToChar16(&Config, &Entry->Options, String);
+        for(UINT32 k = 0; k < Entry->NumberOfModules; k++)
+        {
+          Checksum += ConfigSpanToChar16(&Config, &Entry->Modules[k], String);
+        }
+      }
+    }
+    Iterations += 1000;
+    Elapsed = NowNanoseconds() - Start;
+  } while(Elapsed < Seconds * 1000000000ULL);
+
+  printf("%s: %llu bytes, %.1f ns per parse, %.1f MB/s (checksum %llu)\n", File->Name, (unsigned long long)File->Size,
+         (double)Elapsed / (double)Iterations, ((double)File->Size * (double)Iterations * 1000.0) / (double)Elapsed, (unsigned long long)Checksum);
+  free(String);
+}
+
+//==================================================================================================================================
+//  main: Parse Options And Run
+//==================================================================================================================================
+
+STATIC VOID Usage(CONST char * Name)
+{
+  fprintf(stderr,
+    "Usage: %s [options] [Kernel64.txt...]\n"
+    "\n"
+    "Runs the bootloader's Kernel64.txt parser on the host. With no options, prints what it makes of each file.\n"
+    "\n"
+    "  -f ROUNDS   Fuzz: mutate the files (and built-in samples) ROUNDS times, checking every result\n"
+    "              (0 means the default, %llu)\n"
+    "  -s SEED     Random seed for -f, to repeat a run\n"
+    "  -b          Benchmark: time parsing each file (or the built-in samples)\n"
+    "  -t SECONDS  How long to benchmark each file (default %u)\n"
+    "\n"
+    "Fuzzing stops at the first failure and saves the input to configfuzz-failure.bin.\n",
+    Name, FUZZ_DEFAULT_ROUNDS, BENCH_DEFAULT_SECONDS);
+}
+
+int main(int argc, char ** argv)
+{
+  UINT64 Rounds = 0;
+  UINT8 FuzzMode = 0;
+  UINT8 BenchMode = 0;
+  UINT64 Seconds = BENCH_DEFAULT_SECONDS;
+  int Option;
+
+  while((Option = getopt(argc, argv, "f:s:bt:")) != -1)
+  {
+    switch(Option)
+    {
+      case 'f':
+        FuzzMode = 1;
+        Rounds = strtoull(optarg, NULL, 0);
+        break;
+      case 's':
+        RandomState = strtoull(optarg, NULL, 0) | 1;
+        break;
+      case 'b':
+        BenchMode = 1;
+        break;
+      case 't':
+        Seconds = strtoull(optarg, NULL, 0);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+
+  for(int i = optind; i < argc; i++)
+  {
+    if(!LoadSeed(argv[i]))
+    {
+      return 1;
+    }
+  }
+
+  if(!FuzzMode && !BenchMode)
+  {
+    if(SeedCount == 0)
+    {
+      Usage(argv[0]);
+      return 1;
+    }
+
+    int Failed = 0;
+    for(UINT64 i = 0; i < SeedCount; i++)
+    {
+      Failed |= Check(&Seeds[i]);
+    }
+    return Failed;
+  }
+
+  if((SeedCount == 0) || FuzzMode)
+  {
+    AddSeed(SeedV2, sizeof(SeedV2) - 1, "built-in v2");
+    AddSeedUtf16(SeedV2, "built-in v2, UTF-16");
+    AddSeedUtf16(SeedV1, "built-in v1, UTF-16");
+    AddSeed(SeedMistakes, sizeof(SeedMistakes) - 1, "built-in mistakes");
+  }
+
+  if(FuzzMode)
+  {
+    return Fuzz(Rounds ? Rounds : FUZZ_DEFAULT_ROUNDS);
+  }
+
+  for(UINT64 i = 0; i < SeedCount; i++)
+  {
+    Benchmark(&Seeds[i], Seconds);
+  }
+  return 0;
+}
@@ -0,0 +1,32 @@
+#!/bin/bash
+#
+# =================================
+#
+# RELEASE VERSION 1.0
+#
+# Memory Map Replay Simulator Linux Compile Script
+#
+# by KNNSpeed
+#
+# =================================
+#
+# Builds the host-side placement simulator from Replay.c and the bootloader's own src/Placement.c. Uses the host's GCC, not the
+# UEFI toolchain. Usage: ./Compile-Replay.sh, then ./replay memmap.txt
+#
+
+set +v
+
+CurDir=$PWD
+LoaderDir=$CurDir/../..
+EFI_FOLDER_NAME=$LoaderDir/../Backend/gnu-efi-3.0.9
+
+#
+# GNU_EFI_USE_MS_ABI and -fshort-wchar make the structures and function pointers match what the bootloader sees, so Placement.c
+# compiles exactly as it does for the real thing.
+#
+
+gcc -DGNU_EFI_USE_MS_ABI -fshort-wchar -O2 --std=gnu11 -Wall -Wextra -Wno-pointer-sign -I$LoaderDir/inc/ -I$EFI_FOLDER_NAME/inc -I$EFI_FOLDER_NAME/inc/x86_64 -I$EFI_FOLDER_NAME/inc/protocol -o replay $LoaderDir/src/Placement.c Replay.c
+
+echo
+echo "Done!"
+echo
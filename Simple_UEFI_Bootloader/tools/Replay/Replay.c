@@ -0,0 +1,981 @@
+//==================================================================================================================================
+//  Simple UEFI Bootloader: Memory Map Replay Simulator
+//==================================================================================================================================
+//
+// Version 2.3
+//
+// Author:
+//  KNNSpeed
+//
+// Source Code:
+//  https://github.com/KNNSpeed/Simple-UEFI-Bootloader
+//
+// This is a host-side (Linux) program, not part of the bootloader. It links against the bootloader's own src/Placement.c and runs
+// FindActuallyFreePages() -- and through it ActuallyFreeAddress() and ActuallyFreeAddressByPage() -- against a simulated set of boot
+// services backed by a memory map captured from a real machine. For each kernel size it reports where the kernel ended up, how many
+// memory probes the search made, and how many times it called into the "firmware". That way placement changes can be measured and
+// checked against badly fragmented maps without rebooting anything.
+//
+// Memory maps can be given either as print_memmap output (e.g. copied off a serial console) or as a binary dump of the raw
+// EFI_MEMORY_DESCRIPTOR array (e.g. LOADER_PARAMS->Memory_Map written out by a kernel).
+//
+// The simulated firmware behaves like EDK2 where it matters: AllocateAnyPages goes top-down, preferring memory below 4GB;
+// AllocateAddress fails with EFI_NOT_FOUND unless the whole range is EfiConventionalMemory; freed pages merge back into their
+// neighbors. Pool allocations come from the host and don't change the map.
+//
+// Since a memory map says nothing about what's actually in memory, the -b option marks ranges that firmware calls free but that
+// don't read back as zero, and -k marks addresses holding the remains of a previous kernel. By default the pages handed out by the
+// initial AllocateAnyPages are treated as non-zero so that the search always runs; -n turns that off.
+//
+// UEFI variables are simulated too, so -p can replay each run a second time as the next boot, with the placement memo the first one
+// saved in LoaderPlacement.
+//
+// Build with Compile-Replay.sh. Run with no arguments to see the options.
+//
+
+#include "Bootloader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REPLAY_DESCRIPTOR_SIZE  48 // What real firmware reports: sizeof(EFI_MEMORY_DESCRIPTOR) plus 8 bytes of padding
+#define REPLAY_MAX_RANGES       64
+#define REPLAY_DEFAULT_SIZES    "1M,16M,64M,256M,1G"
+#define REPLAY_DEFAULT_LIMIT    100000000ULL // Firmware calls before a run is declared stuck
+
+#define FOUR_GB 0x100000000ULL
+
+//----------------------------------------------------------------------------------------------------------------------------------
+//  Simulation State
+//----------------------------------------------------------------------------------------------------------------------------------
+
+typedef struct {
+  UINT32 Type;
+  UINT8  Touched; // Only descriptors the simulation has modified get merged, so the captured map stays as it was otherwise
+  EFI_PHYSICAL_ADDRESS PhysicalStart;
+  UINT64 NumberOfPages;
+  UINT64 Attribute;
+} SIM_DESCRIPTOR;
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS Start;
+  EFI_PHYSICAL_ADDRESS End; // Exclusive
+} SIM_RANGE;
+
+typedef struct {
+  UINT64 AllocatePages;
+  UINT64 AllocatePagesFailed;
+  UINT64 FreePages;
+  UINT64 GetMemoryMap;
+  UINT64 AllocatePool;
+  UINT64 FreePool;
+  UINT64 Variables; // GetVariable() and SetVariable() calls
+  UINT64 Probes; // VerifyZeroMem() calls
+  UINT64 Compares;
+  UINT64 Messages;
+} SIM_COUNTERS;
+
+STATIC SIM_DESCRIPTOR * Original = NULL;
+STATIC UINT64 OriginalCount = 0;
+
+STATIC SIM_DESCRIPTOR * Map = NULL;
+STATIC UINT64 MapCount = 0;
+STATIC UINT64 MapCapacity = 0;
+STATIC UINTN MapKey = 0;
+
+STATIC SIM_RANGE Busy[REPLAY_MAX_RANGES + 1]; // +1 for the AllocateAnyPages range
+STATIC UINT64 BusyCount = 0;
+STATIC EFI_PHYSICAL_ADDRESS Remains[REPLAY_MAX_RANGES];
+STATIC UINT64 RemainsCount = 0;
+
+STATIC SIM_COUNTERS Counters;
+STATIC UINT64 CallLimit = REPLAY_DEFAULT_LIMIT;
+STATIC VOID * Stuck[5]; // For __builtin_setjmp(). GNU-EFI's setjmp.h clashes with the host one.
+
+STATIC UINT8 Verbose = 0;
+
+STATIC UINT8 MemoVariable[64]; // LoaderPlacement, the only variable Placement.c uses
+STATIC UINTN MemoVariableSize = 0;
+
+STATIC CONST char * TypeNames[] = {
+  "EfiReservedMemoryType",
+  "EfiLoaderCode",
+  "EfiLoaderData",
+  "EfiBootServicesCode",
+  "EfiBootServicesData",
+  "EfiRuntimeServicesCode",
+  "EfiRuntimeServicesData",
+  "EfiConventionalMemory",
+  "EfiUnusableMemory",
+  "EfiACPIReclaimMemory",
+  "EfiACPIMemoryNVS",
+  "EfiMemoryMappedIO",
+  "EfiMemoryMappedIOPortSpace",
+  "EfiPalCode",
+  "EfiPersistentMemory"
+};
+
+#define TYPE_NAME_COUNT (sizeof(TypeNames) / sizeof(TypeNames[0]))
+
+STATIC VOID CountFirmwareCall(VOID)
+{
+  UINT64 Total = Counters.AllocatePages + Counters.FreePages + Counters.GetMemoryMap + Counters.AllocatePool + Counters.FreePool;
+  if(Total >= CallLimit)
+  {
+    __builtin_longjmp(Stuck, 1);
+  }
+}
+
+//==================================================================================================================================
+//  Simulated Memory Map
+//==================================================================================================================================
+//
+// The map is kept sorted by address, the same order firmware hands it out in.
+//
+
+STATIC VOID MapInsert(UINT64 Index, SIM_DESCRIPTOR Descriptor)
+{
+  if(MapCount == MapCapacity)
+  {
+    MapCapacity = MapCapacity ? MapCapacity * 2 : 64;
+    Map = realloc(Map, MapCapacity * sizeof(SIM_DESCRIPTOR));
+    if(Map == NULL)
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+  }
+  memmove(&Map[Index + 1], &Map[Index], (MapCount - Index) * sizeof(SIM_DESCRIPTOR));
+  Map[Index] = Descriptor;
+  MapCount++;
+}
+
+STATIC VOID MapRemove(UINT64 Index)
+{
+  memmove(&Map[Index], &Map[Index + 1], (MapCount - Index - 1) * sizeof(SIM_DESCRIPTOR));
+  MapCount--;
+}
+
+STATIC EFI_PHYSICAL_ADDRESS MapEnd(UINT64 Index)
+{
+  return Map[Index].PhysicalStart + (Map[Index].NumberOfPages << EFI_PAGE_SHIFT);
+}
+
+// Split descriptors so that Address falls on a descriptor boundary
+STATIC VOID MapSplit(EFI_PHYSICAL_ADDRESS Address)
+{
+  for(UINT64 i = 0; i < MapCount; i++)
+  {
+    if((Address > Map[i].PhysicalStart) && (Address < MapEnd(i)))
+    {
+      SIM_DESCRIPTOR Upper = Map[i];
+      Upper.PhysicalStart = Address;
+      Upper.NumberOfPages = (MapEnd(i) - Address) >> EFI_PAGE_SHIFT;
+      Map[i].NumberOfPages -= Upper.NumberOfPages;
+      MapInsert(i + 1, Upper);
+      return;
+    }
+  }
+}
+
+// Merge touched descriptors with same-typed neighbors, like firmware does
+STATIC VOID MapMerge(VOID)
+{
+  for(UINT64 i = 0; i + 1 < MapCount; )
+  {
+    if((Map[i].Touched || Map[i + 1].Touched) && (Map[i].Type == Map[i + 1].Type) && (Map[i].Attribute == Map[i + 1].Attribute) && (MapEnd(i) == Map[i + 1].PhysicalStart))
+    {
+      Map[i].NumberOfPages += Map[i + 1].NumberOfPages;
+      Map[i].Touched = 1;
+      MapRemove(i + 1);
+    }
+    else
+    {
+      i++;
+    }
+  }
+}
+
+// Return 1 if every byte of [Start, End) is covered by descriptors that are (Match = 1) or aren't (Match = 0) of type Type
+STATIC UINT8 MapCovered(EFI_PHYSICAL_ADDRESS Start, EFI_PHYSICAL_ADDRESS End, UINT32 Type, UINT8 Match)
+{
+  EFI_PHYSICAL_ADDRESS Next = Start;
+
+  for(UINT64 i = 0; (i < MapCount) && (Next < End); i++)
+  {
+    if((Map[i].PhysicalStart <= Next) && (MapEnd(i) > Next))
+    {
+      if((Map[i].Type == Type) != Match)
+      {
+        return 0;
+      }
+      Next = MapEnd(i);
+    }
+  }
+
+  return (Next >= End);
+}
+
+STATIC VOID MapSetType(EFI_PHYSICAL_ADDRESS Start, EFI_PHYSICAL_ADDRESS End, UINT32 Type)
+{
+  MapSplit(Start);
+  MapSplit(End);
+  for(UINT64 i = 0; i < MapCount; i++)
+  {
+    if((Map[i].PhysicalStart >= Start) && (MapEnd(i) <= End))
+    {
+      Map[i].Type = Type;
+      Map[i].Touched = 1;
+    }
+  }
+  MapMerge();
+  MapKey++;
+}
+
+STATIC VOID MapReset(VOID)
+{
+  MapCount = 0;
+  for(UINT64 i = 0; i < OriginalCount; i++)
+  {
+    MapInsert(i, Original[i]);
+  }
+  MapKey = 0;
+}
+
+//==================================================================================================================================
+//  Simulated Boot Services
+//==================================================================================================================================
+//
+// Only what Placement.c uses. Everything else in the table is NULL.
+//
+
+STATIC EFI_STATUS EFIAPI SimAllocatePages(EFI_ALLOCATE_TYPE Type, EFI_MEMORY_TYPE MemoryType, UINTN Pages, EFI_PHYSICAL_ADDRESS * Memory)
+{
+  CountFirmwareCall();
+  Counters.AllocatePages++;
+
+  UINT64 Bytes = (UINT64)Pages << EFI_PAGE_SHIFT;
+
+  if((Pages == 0) || (Memory == NULL))
+  {
+    Counters.AllocatePagesFailed++;
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if(Type == AllocateAddress)
+  {
+    EFI_PHYSICAL_ADDRESS Start = *Memory;
+    if((Start & EFI_PAGE_MASK) || (Start + Bytes < Start) || !MapCovered(Start, Start + Bytes, EfiConventionalMemory, 1))
+    {
+      Counters.AllocatePagesFailed++;
+      return EFI_NOT_FOUND;
+    }
+    MapSetType(Start, Start + Bytes, MemoryType);
+    return EFI_SUCCESS;
+  }
+
+  if(Type == AllocateAnyPages)
+  {
+    // Top-down, below 4GB first, then anywhere. Adjacent free descriptors count as one range.
+    for(UINT8 Pass = 0; Pass < 2; Pass++)
+    {
+      EFI_PHYSICAL_ADDRESS Limit = Pass ? ~0ULL : FOUR_GB;
+
+      for(UINT64 i = MapCount; i-- > 0; )
+      {
+        if(Map[i].Type != EfiConventionalMemory)
+        {
+          continue;
+        }
+
+        EFI_PHYSICAL_ADDRESS RunStart = Map[i].PhysicalStart;
+        EFI_PHYSICAL_ADDRESS RunEnd = MapEnd(i);
+        for(UINT64 j = i; (j-- > 0) && (Map[j].Type == EfiConventionalMemory) && (MapEnd(j) == RunStart); )
+        {
+          RunStart = Map[j].PhysicalStart;
+        }
+
+        if(RunEnd > Limit)
+        {
+          RunEnd = Limit;
+        }
+        if((RunEnd > RunStart) && (RunEnd - RunStart >= Bytes))
+        {
+          *Memory = RunEnd - Bytes;
+          MapSetType(*Memory, RunEnd, MemoryType);
+          return EFI_SUCCESS;
+        }
+      }
+    }
+
+    Counters.AllocatePagesFailed++;
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Counters.AllocatePagesFailed++;
+  return EFI_UNSUPPORTED;
+}
+
+STATIC EFI_STATUS EFIAPI SimFreePages(EFI_PHYSICAL_ADDRESS Memory, UINTN Pages)
+{
+  CountFirmwareCall();
+  Counters.FreePages++;
+
+  UINT64 Bytes = (UINT64)Pages << EFI_PAGE_SHIFT;
+
+  if((Memory & EFI_PAGE_MASK) || (Pages == 0))
+  {
+    return EFI_INVALID_PARAMETER;
+  }
+  if(!MapCovered(Memory, Memory + Bytes, EfiConventionalMemory, 0))
+  {
+    return EFI_NOT_FOUND;
+  }
+
+  MapSetType(Memory, Memory + Bytes, EfiConventionalMemory);
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS EFIAPI SimGetMemoryMap(UINTN * MemoryMapSize, EFI_MEMORY_DESCRIPTOR * MemoryMap, UINTN * MapKeyOut, UINTN * DescriptorSize, UINT32 * DescriptorVersion)
+{
+  CountFirmwareCall();
+  Counters.GetMemoryMap++;
+
+  UINTN Needed = MapCount * REPLAY_DESCRIPTOR_SIZE;
+
+  *DescriptorSize = REPLAY_DESCRIPTOR_SIZE;
+  *DescriptorVersion = EFI_MEMORY_DESCRIPTOR_VERSION;
+
+  if((*MemoryMapSize < Needed) || (MemoryMap == NULL))
+  {
+    *MemoryMapSize = Needed;
+    return EFI_BUFFER_TOO_SMALL;
+  }
+
+  memset(MemoryMap, 0, Needed);
+  for(UINT64 i = 0; i < MapCount; i++)
+  {
+    EFI_MEMORY_DESCRIPTOR * Piece = (EFI_MEMORY_DESCRIPTOR*)((UINT8*)MemoryMap + i * REPLAY_DESCRIPTOR_SIZE);
+    Piece->Type = Map[i].Type;
+    Piece->PhysicalStart = Map[i].PhysicalStart;
+    Piece->NumberOfPages = Map[i].NumberOfPages;
+    Piece->Attribute = Map[i].Attribute;
+  }
+
+  *MemoryMapSize = Needed;
+  *MapKeyOut = MapKey;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS EFIAPI SimAllocatePool(EFI_MEMORY_TYPE PoolType, UINTN Size, VOID ** Buffer)
+{
+  (VOID)PoolType;
+  CountFirmwareCall();
+  Counters.AllocatePool++;
+
+  *Buffer = malloc(Size);
+  return (*Buffer == NULL) ? EFI_OUT_OF_RESOURCES : EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS EFIAPI SimFreePool(VOID * Buffer)
+{
+  CountFirmwareCall();
+  Counters.FreePool++;
+
+  free(Buffer);
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_BOOT_SERVICES SimBootServices;
+EFI_BOOT_SERVICES * BS = &SimBootServices;
+
+//==================================================================================================================================
+//  Simulated Runtime Services
+//==================================================================================================================================
+//
+// Just enough of a variable store for the placement memo: one variable, kept until MemoVariableSize is reset.
+//
+
+STATIC EFI_STATUS EFIAPI SimGetVariable(CHAR16 * VariableName, EFI_GUID * VendorGuid, UINT32 * Attributes, UINTN * DataSize, VOID * Data)
+{
+  (VOID)VariableName;
+  (VOID)VendorGuid;
+  (VOID)Attributes;
+  Counters.Variables++;
+
+  if(MemoVariableSize == 0)
+  {
+    return EFI_NOT_FOUND;
+  }
+  if(*DataSize < MemoVariableSize)
+  {
+    *DataSize = MemoVariableSize;
+    return EFI_BUFFER_TOO_SMALL;
+  }
+
+  memcpy(Data, MemoVariable, MemoVariableSize);
+  *DataSize = MemoVariableSize;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS EFIAPI SimSetVariable(CHAR16 * VariableName, EFI_GUID * VendorGuid, UINT32 Attributes, UINTN DataSize, VOID * Data)
+{
+  (VOID)VariableName;
+  (VOID)VendorGuid;
+  (VOID)Attributes;
+  Counters.Variables++;
+
+  if(DataSize > sizeof(MemoVariable))
+  {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  memcpy(MemoVariable, Data, DataSize);
+  MemoVariableSize = DataSize;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_RUNTIME_SERVICES SimRuntimeServices;
+EFI_RUNTIME_SERVICES * RT = &SimRuntimeServices;
+
+//==================================================================================================================================
+//  Bootloader Functions Placement.c Needs
+//==================================================================================================================================
+//
+// The real VerifyZeroMem() and compare() read physical memory, so these answer from the -b and -k lists instead. Print() only
+// understands the handful of formats Placement.c uses, and LOG_MESSAGE()s go through it too.
+//
+
+UINT32 LoaderLogMask = ~0U;
+
+UINT8 VerifyZeroMem(UINT64 NumBytes, UINT64 BaseAddr)
+{
+  Counters.Probes++;
+  for(UINT64 i = 0; i < BusyCount; i++)
+  {
+    if((BaseAddr < Busy[i].End) && (BaseAddr + NumBytes > Busy[i].Start))
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+UINT8 compare(const void* firstitem, const void* seconditem, UINT64 comparelength)
+{
+  (VOID)seconditem;
+  (VOID)comparelength;
+  Counters.Compares++;
+  for(UINT64 i = 0; i < RemainsCount; i++)
+  {
+    if((EFI_PHYSICAL_ADDRESS)firstitem == Remains[i])
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+STATIC UINTN ReplayPrint(CONST CHAR16 * fmt, va_list Args)
+{
+  char Line[1024];
+  UINTN Length = 0;
+
+  Counters.Messages++;
+  if(!Verbose)
+  {
+    return 0;
+  }
+
+  for(; *fmt && (Length < sizeof(Line) - 64); fmt++)
+  {
+    if(*fmt != L'%')
+    {
+      if(*fmt != L'\r')
+      {
+        Line[Length++] = (char)*fmt;
+      }
+      continue;
+    }
+
+    // Skip flags, width and length modifiers
+    char Spec[16] = "%";
+    UINTN SpecLength = 1;
+    while(fmt[1] && strchr("0123456789l-h", (char)fmt[1]) && (SpecLength < sizeof(Spec) - 4))
+    {
+      Spec[SpecLength++] = (char)*++fmt;
+    }
+    fmt++;
+
+    if(*fmt == L's')
+    {
+      CONST CHAR16 * String = va_arg(Args, CONST CHAR16 *);
+      while(*String && (Length < sizeof(Line) - 64))
+      {
+        Line[Length++] = (char)*String++;
+      }
+    }
+    else if((*fmt == L'x') || (*fmt == L'u') || (*fmt == L'd'))
+    {
+      // Placement.c prints 64-bit values with %ll, and the memo counters with plain %u
+      Spec[SpecLength] = '\0';
+      UINT8 Long = (strchr(Spec, 'l') != NULL);
+      while(SpecLength && (Spec[SpecLength - 1] == 'l' || Spec[SpecLength - 1] == 'h'))
+      {
+        Spec[--SpecLength] = '\0';
+      }
+      strcat(Spec, "ll");
+      Spec[SpecLength + 2] = (char)*fmt;
+      Spec[SpecLength + 3] = '\0';
+      Length += snprintf(&Line[Length], sizeof(Line) - Length, Spec, Long ? va_arg(Args, unsigned long long) : (unsigned long long)va_arg(Args, unsigned int));
+    }
+    else
+    {
+      Line[Length++] = (char)*fmt;
+    }
+  }
+
+  Line[Length] = '\0';
+  printf("    | %s%s", Line, ((Length == 0) || (Line[Length - 1] != '\n')) ? "\n" : "");
+  return Length;
+}
+
+UINTN Print(IN CONST CHAR16 * fmt, ...)
+{
+  va_list Args;
+  UINTN Length;
+
+  va_start(Args, fmt);
+  Length = ReplayPrint(fmt, Args);
+  va_end(Args);
+
+  return Length;
+}
+
+VOID LoaderLog(UINT32 Subsystem, UINT32 Level, CONST CHAR16 * Format, ...)
+{
+  va_list Args;
+  (VOID)Subsystem;
+  (VOID)Level;
+
+  va_start(Args, Format);
+  ReplayPrint(Format, Args);
+  va_end(Args);
+}
+
+EFI_STATUS Keywait(CHAR16 *String)
+{
+  (VOID)String;
+  return EFI_SUCCESS;
+}
+
+//==================================================================================================================================
+//  LoadMemoryMap: Read A Captured Memory Map
+//==================================================================================================================================
+//
+// Binary dumps are a raw EFI_MEMORY_DESCRIPTOR array. Anything with a NUL byte in it is treated as one; everything else is parsed as
+// print_memmap output, where each line looks like "NN: EfiConventionalMemory      0x0000000000100000 0x700 0xf". Lines that don't
+// look like that are skipped, so a whole console log can be fed in as-is.
+//
+
+STATIC int CompareDescriptors(const void * a, const void * b)
+{
+  EFI_PHYSICAL_ADDRESS One = ((const SIM_DESCRIPTOR *)a)->PhysicalStart;
+  EFI_PHYSICAL_ADDRESS Two = ((const SIM_DESCRIPTOR *)b)->PhysicalStart;
+  return (One > Two) - (One < Two);
+}
+
+STATIC VOID AddOriginal(UINT32 Type, EFI_PHYSICAL_ADDRESS PhysicalStart, UINT64 NumberOfPages, UINT64 Attribute)
+{
+  if(NumberOfPages == 0)
+  {
+    return;
+  }
+  Original = realloc(Original, (OriginalCount + 1) * sizeof(SIM_DESCRIPTOR));
+  if(Original == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  Original[OriginalCount].Type = Type;
+  Original[OriginalCount].Touched = 0;
+  Original[OriginalCount].PhysicalStart = PhysicalStart;
+  Original[OriginalCount].NumberOfPages = NumberOfPages;
+  Original[OriginalCount].Attribute = Attribute;
+  OriginalCount++;
+}
+
+STATIC int LoadMemoryMap(CONST char * Path, UINT64 DescriptorSize)
+{
+  FILE * File = fopen(Path, "rb");
+  if(File == NULL)
+  {
+    perror(Path);
+    return 1;
+  }
+
+  fseek(File, 0, SEEK_END);
+  long FileSize = ftell(File);
+  fseek(File, 0, SEEK_SET);
+
+  UINT8 * Data = malloc(FileSize + 1);
+  if((Data == NULL) || (fread(Data, 1, FileSize, File) != (size_t)FileSize))
+  {
+    fprintf(stderr, "%s: read error\n", Path);
+    fclose(File);
+    return 1;
+  }
+  fclose(File);
+  Data[FileSize] = '\0';
+
+  free(Original);
+  Original = NULL;
+  OriginalCount = 0;
+
+  if(memchr(Data, 0, FileSize) != NULL) // Binary dump
+  {
+    if(DescriptorSize == 0)
+    {
+      // Firmware almost always pads descriptors to 48 bytes
+      DescriptorSize = ((FileSize % REPLAY_DESCRIPTOR_SIZE) == 0) ? REPLAY_DESCRIPTOR_SIZE : sizeof(EFI_MEMORY_DESCRIPTOR);
+    }
+    if((DescriptorSize < sizeof(EFI_MEMORY_DESCRIPTOR)) || (FileSize % DescriptorSize))
+    {
+      fprintf(stderr, "%s: size %ld is not a multiple of the %llu-byte descriptor size\n", Path, FileSize, (unsigned long long)DescriptorSize);
+      free(Data);
+      return 1;
+    }
+
+    for(long Offset = 0; Offset < FileSize; Offset += DescriptorSize)
+    {
+      EFI_MEMORY_DESCRIPTOR Piece;
+      memcpy(&Piece, &Data[Offset], sizeof(Piece));
+      AddOriginal(Piece.Type, Piece.PhysicalStart, Piece.NumberOfPages, Piece.Attribute);
+    }
+  }
+  else // print_memmap text
+  {
+    for(char * Line = strtok((char *)Data, "\n"); Line != NULL; Line = strtok(NULL, "\n"))
+    {
+      char * Name = strstr(Line, "Efi");
+      if(Name == NULL)
+      {
+        continue;
+      }
+
+      UINT32 Type;
+      for(Type = 0; Type < TYPE_NAME_COUNT; Type++)
+      {
+        size_t NameLength = strlen(TypeNames[Type]);
+        if((strncmp(Name, TypeNames[Type], NameLength) == 0) && ((Name[NameLength] == ' ') || (Name[NameLength] == '\t')))
+        {
+          break;
+        }
+      }
+      if(Type == TYPE_NAME_COUNT)
+      {
+        continue;
+      }
+
+      unsigned long long PhysicalStart, NumberOfPages, Attribute;
+      if(sscanf(Name + strlen(TypeNames[Type]), " %llx %llx %llx", &PhysicalStart, &NumberOfPages, &Attribute) == 3)
+      {
+        AddOriginal(Type, PhysicalStart, NumberOfPages, Attribute);
+      }
+    }
+  }
+
+  free(Data);
+
+  if(OriginalCount == 0)
+  {
+    fprintf(stderr, "%s: no memory map entries found\n", Path);
+    return 1;
+  }
+
+  qsort(Original, OriginalCount, sizeof(SIM_DESCRIPTOR), CompareDescriptors);
+  return 0;
+}
+
+//==================================================================================================================================
+//  Replay: Place One Kernel
+//==================================================================================================================================
+//
+// Do what GoTime() does: AllocateAnyPages, then FindActuallyFreePages(). Below4GB is what PE32+ kernels get; ELF and Mach-O kernels
+// take the same path without it. NextBoot keeps the placement memo from the run before; otherwise it's a machine that's never booted
+// this kernel. Next-boot runs that succeed say MEMO-HIT or MEMO-MISS instead of OK.
+//
+
+STATIC VOID Replay(UINT64 Bytes, UINT8 Below4GB, UINT8 TrustFirstAllocation, UINT8 ShowTime, UINT8 NextBoot)
+{
+  UINT64 pages = EFI_SIZE_TO_PAGES(Bytes);
+  EFI_PHYSICAL_ADDRESS AllocatedMemory = 0;
+  EFI_STATUS Status;
+  UINT64 SavedBusyCount = BusyCount;
+  struct timespec Start, End;
+  CONST char * Result;
+
+  MapReset();
+  memset(&Counters, 0, sizeof(Counters));
+  PlacementMemoHits = 0;
+  PlacementMemoMisses = 0;
+  if(!NextBoot)
+  {
+    MemoVariableSize = 0;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &Start);
+
+  if(__builtin_setjmp(Stuck))
+  {
+    Result = "STUCK";
+    AllocatedMemory = ~0ULL;
+  }
+  else
+  {
+    Status = BS->AllocatePages(AllocateAnyPages, EfiLoaderData, pages, &AllocatedMemory);
+    if(EFI_ERROR(Status))
+    {
+      Result = "NO-MEMORY";
+      AllocatedMemory = ~0ULL;
+    }
+    else
+    {
+      if(!TrustFirstAllocation)
+      {
+        Busy[BusyCount].Start = AllocatedMemory;
+        Busy[BusyCount].End = AllocatedMemory + (pages << EFI_PAGE_SHIFT);
+        BusyCount++;
+      }
+
+      Status = FindActuallyFreePages(pages, &AllocatedMemory, "MZ", 2, Below4GB, PlacementKernelId(L"\\EFI\\Kernel\\Kernel64", Bytes), Below4GB ? L"PE32+" : L"ELF");
+      if(EFI_ERROR(Status))
+      {
+        Result = "FAILED";
+        AllocatedMemory = ~0ULL;
+      }
+      else
+      {
+        Result = (Below4GB && (AllocatedMemory + (pages << EFI_PAGE_SHIFT) > FOUR_GB)) ? "ABOVE-4GB" : !NextBoot ? "OK" : PlacementMemoHits ? "MEMO-HIT" : "MEMO-MISS";
+      }
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &End);
+  BusyCount = SavedBusyCount;
+
+  printf("%10llu %-5s %-9s ", (unsigned long long)pages, Below4GB ? "PE" : "ELF", Result);
+  if(AllocatedMemory == ~0ULL)
+  {
+    printf("%18s", "-");
+  }
+  else
+  {
+    printf("0x%016llx", (unsigned long long)AllocatedMemory);
+  }
+  printf(" %8llu %8llu %8llu %8llu %8llu %8llu %8llu", (unsigned long long)Counters.Probes, (unsigned long long)Counters.AllocatePages,
+         (unsigned long long)Counters.AllocatePagesFailed, (unsigned long long)Counters.FreePages, (unsigned long long)Counters.GetMemoryMap,
+         (unsigned long long)(Counters.AllocatePool + Counters.FreePool), (unsigned long long)Counters.Messages);
+  if(ShowTime)
+  {
+    printf(" %10.1f", (double)(End.tv_sec - Start.tv_sec) * 1e6 + (double)(End.tv_nsec - Start.tv_nsec) / 1e3);
+  }
+  printf("\n");
+}
+
+//==================================================================================================================================
+//  main: Parse Options And Run Every Size On Every Map
+//==================================================================================================================================
+
+STATIC UINT64 ParseSize(CONST char * String, char ** EndPtr)
+{
+  UINT64 Value = strtoull(String, EndPtr, 0);
+  switch(**EndPtr)
+  {
+    case 'K': case 'k': Value <<= 10; (*EndPtr)++; break;
+    case 'M': case 'm': Value <<= 20; (*EndPtr)++; break;
+    case 'G': case 'g': Value <<= 30; (*EndPtr)++; break;
+    default: break;
+  }
+  return Value;
+}
+
+STATIC VOID Usage(CONST char * Name)
+{
+  fprintf(stderr,
+    "Usage: %s [options] memmap [memmap...]\n"
+    "\n"
+    "Replays the bootloader's kernel placement against captured memory maps (print_memmap text or raw\n"
+    "EFI_MEMORY_DESCRIPTOR dumps) and prints one line per kernel size and format.\n"
+    "\n"
+    "  -s SIZES    Comma-separated kernel sizes, with optional K/M/G suffix (default " REPLAY_DEFAULT_SIZES ")\n"
+    "  -f FORMAT   pe, elf or all (default all). Mach-O kernels are placed the same way as ELF ones.\n"
+    "  -b START-END  Memory in [START, END) is marked free but doesn't read back as zero. Repeatable.\n"
+    "  -k ADDR     A previous kernel's remains start at ADDR. Repeatable.\n"
+    "  -n          Trust the pages AllocateAnyPages hands out (by default they're treated as non-zero)\n"
+    "  -d SIZE     Descriptor size of binary dumps (default: 48 if it fits, else 40)\n"
+    "  -l CALLS    Firmware calls before a run counts as stuck (default %llu)\n"
+    "  -p          Replay each run again as the next boot, with the placement memo the first one saved\n"
+    "  -r          Leave out timings, for output that can be diffed\n"
+    "  -m          Print each memory map after loading it\n"
+    "  -v          Show the loader's own messages\n"
+    "\n"
+    "Columns: pages, format, result, chosen address, memory probes (VerifyZeroMem), AllocatePages calls,\n"
+    "failed AllocatePages calls, FreePages calls, GetMemoryMap calls, pool calls, loader messages, and\n"
+    "host time in microseconds.\n",
+    Name, REPLAY_DEFAULT_LIMIT);
+}
+
+int main(int argc, char ** argv)
+{
+  CONST char * Sizes = REPLAY_DEFAULT_SIZES;
+  UINT8 Formats = 3; // Bit 0: PE, bit 1: ELF
+  UINT8 TrustFirstAllocation = 0;
+  UINT8 ShowTime = 1;
+  UINT8 ShowMap = 0;
+  UINT8 NextBoots = 0;
+  UINT64 DescriptorSize = 0;
+  int Option;
+
+  while((Option = getopt(argc, argv, "s:f:b:k:nd:l:prmv")) != -1)
+  {
+    char * End;
+    switch(Option)
+    {
+      case 's':
+        Sizes = optarg;
+        break;
+      case 'f':
+        Formats = (strcmp(optarg, "pe") == 0) ? 1 : (strcmp(optarg, "elf") == 0) ? 2 : 3;
+        break;
+      case 'b':
+        if(BusyCount == REPLAY_MAX_RANGES)
+        {
+          fprintf(stderr, "Too many -b ranges\n");
+          return 1;
+        }
+        Busy[BusyCount].Start = strtoull(optarg, &End, 0);
+        if(*End++ != '-')
+        {
+          Usage(argv[0]);
+          return 1;
+        }
+        Busy[BusyCount].End = strtoull(End, &End, 0);
+        BusyCount++;
+        break;
+      case 'k':
+        if(RemainsCount == REPLAY_MAX_RANGES)
+        {
+          fprintf(stderr, "Too many -k addresses\n");
+          return 1;
+        }
+        Remains[RemainsCount++] = strtoull(optarg, &End, 0);
+        break;
+      case 'n':
+        TrustFirstAllocation = 1;
+        break;
+      case 'd':
+        DescriptorSize = strtoull(optarg, &End, 0);
+        break;
+      case 'l':
+        CallLimit = strtoull(optarg, &End, 0);
+        break;
+      case 'p':
+        NextBoots = 1;
+        break;
+      case 'r':
+        ShowTime = 0;
+        break;
+      case 'm':
+        ShowMap = 1;
+        break;
+      case 'v':
+        Verbose = 1;
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if(optind >= argc)
+  {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  SimBootServices.AllocatePages = SimAllocatePages;
+  SimBootServices.FreePages = SimFreePages;
+  SimBootServices.GetMemoryMap = SimGetMemoryMap;
+  SimBootServices.AllocatePool = SimAllocatePool;
+  SimBootServices.FreePool = SimFreePool;
+  SimRuntimeServices.GetVariable = SimGetVariable;
+  SimRuntimeServices.SetVariable = SimSetVariable;
+
+  for(int Arg = optind; Arg < argc; Arg++)
+  {
+    if(LoadMemoryMap(argv[Arg], DescriptorSize))
+    {
+      return 1;
+    }
+
+    UINT64 FreePages = 0;
+    for(UINT64 i = 0; i < OriginalCount; i++)
+    {
+      if(Original[i].Type == EfiConventionalMemory)
+      {
+        FreePages += Original[i].NumberOfPages;
+      }
+    }
+    printf("%s: %llu descriptors, %llu MB free\n", argv[Arg], (unsigned long long)OriginalCount, (unsigned long long)(FreePages >> 8));
+
+    if(ShowMap)
+    {
+      for(UINT64 i = 0; i < OriginalCount; i++)
+      {
+        printf("  %-26s 0x%016llx 0x%llx 0x%llx\n", (Original[i].Type < TYPE_NAME_COUNT) ? TypeNames[Original[i].Type] : "(unknown)",
+               (unsigned long long)Original[i].PhysicalStart, (unsigned long long)Original[i].NumberOfPages, (unsigned long long)Original[i].Attribute);
+      }
+    }
+
+    printf("%10s %-5s %-9s %-18s %8s %8s %8s %8s %8s %8s %8s%s\n", "Pages", "Fmt", "Result", "Address", "Probes", "Alloc", "AllocErr",
+           "Free", "GetMap", "Pool", "Msgs", ShowTime ? "    Time us" : "");
+
+    CONST char * Size = Sizes;
+    while(*Size)
+    {
+      char * End;
+      UINT64 Bytes = ParseSize(Size, &End);
+      if((End == Size) || ((*End != ',') && (*End != '\0')) || (Bytes == 0))
+      {
+        fprintf(stderr, "Bad size list: %s\n", Sizes);
+        return 1;
+      }
+
+      if(Formats & 1)
+      {
+        Replay(Bytes, 1, TrustFirstAllocation, ShowTime, 0);
+        if(NextBoots)
+        {
+          Replay(Bytes, 1, TrustFirstAllocation, ShowTime, 1);
+        }
+      }
+      if(Formats & 2)
+      {
+        Replay(Bytes, 0, TrustFirstAllocation, ShowTime, 0);
+        if(NextBoots)
+        {
+          Replay(Bytes, 0, TrustFirstAllocation, ShowTime, 1);
+        }
+      }
+
+      Size = (*End == ',') ? End + 1 : End;
+    }
+    printf("\n");
+  }
+
+  return 0;
+}